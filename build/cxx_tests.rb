@@ -39,22 +39,38 @@
     "test/cxx/Core/ApplicationPool/PoolTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/Core/SpawningKit/DirectSpawnerTest.o" =>
     "test/cxx/Core/SpawningKit/DirectSpawnerTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Core/SpawningKit/OutputMultiplexerTest.o" =>
+    "test/cxx/Core/SpawningKit/OutputMultiplexerTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/Core/SpawningKit/SmartSpawnerTest.o" =>
     "test/cxx/Core/SpawningKit/SmartSpawnerTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Core/UnionStation/AsyncSenderTest.o" =>
+    "test/cxx/Core/UnionStation/AsyncSenderTest.cpp",
 
   "#{TEST_OUTPUT_DIR}cxx/Core/ResponseCacheTest.o" =>
     "test/cxx/Core/ResponseCacheTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Core/ResponseCompressorTest.o" =>
+    "test/cxx/Core/ResponseCompressorTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Core/OpenFileCacheTest.o" =>
+    "test/cxx/Core/OpenFileCacheTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/Core/SecurityUpdateCheckerTest.o" =>
       "test/cxx/Core/SecurityUpdateCheckerTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/Core/ControllerTest.o" =>
     "test/cxx/Core/ControllerTest.cpp",
 
+  "#{TEST_OUTPUT_DIR}cxx/ServerKit/AcceptLoadBalancerTest.o" =>
+    "test/cxx/ServerKit/AcceptLoadBalancerTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/ChannelTest.o" =>
     "test/cxx/ServerKit/ChannelTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/FileBufferedChannelTest.o" =>
     "test/cxx/ServerKit/FileBufferedChannelTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/ServerKit/FileBufferedFdSinkChannelTest.o" =>
+    "test/cxx/ServerKit/FileBufferedFdSinkChannelTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/HeaderTableTest.o" =>
     "test/cxx/ServerKit/HeaderTableTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/ServerKit/HttpParserTest.o" =>
+    "test/cxx/ServerKit/HttpParserTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/ServerKit/Http2SessionTest.o" =>
+    "test/cxx/ServerKit/Http2SessionTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/ServerTest.o" =>
     "test/cxx/ServerKit/ServerTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/HttpServerTest.o" =>
@@ -72,6 +88,8 @@
     "test/cxx/ConfigKit/TranslationTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ConfigKit/SubSchemaTest.o" =>
     "test/cxx/ConfigKit/SubSchemaTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/LoggingKit/AsyncWriterTest.o" =>
+    "test/cxx/LoggingKit/AsyncWriterTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/MemoryKit/MbufTest.o" =>
     "test/cxx/MemoryKit/MbufTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/MemoryKit/PallocTest.o" =>
@@ -80,6 +98,8 @@
     "test/cxx/DataStructures/LStringTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/DataStructures/StringKeyTableTest.o" =>
     "test/cxx/DataStructures/StringKeyTableTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/DataStructures/IndexedMinHeapTest.o" =>
+    "test/cxx/DataStructures/IndexedMinHeapTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/MessageReadersWritersTest.o" =>
     "test/cxx/MessageReadersWritersTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/StaticStringTest.o" =>
@@ -88,6 +108,8 @@
     "test/cxx/FileChangeCheckerTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/FileDescriptorTest.o" =>
     "test/cxx/FileDescriptorTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/IoUringTest.o" =>
+    "test/cxx/IoUringTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/SystemTimeTest.o" =>
     "test/cxx/SystemTimeTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/FilterSupportTest.o" =>
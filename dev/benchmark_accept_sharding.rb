@@ -0,0 +1,164 @@
+#!/usr/bin/env ruby
+# Measures how many new connections per second the Passenger core can accept,
+# with the AcceptLoadBalancer (the default) and with SO_REUSEPORT accept
+# sharding (--reuse-port). The core is started in the 'after_accept' benchmark
+# mode, so that it responds immediately without involving an application.
+# Every client opens a new connection for every request.
+#
+# Run `rake agent` first. Example:
+#
+#   ./dev/benchmark_accept_sharding.rb --threads 4 --clients 16 --duration 10
+
+require 'socket'
+require 'optparse'
+require 'timeout'
+
+class AcceptShardingBenchmark
+  ROOT = File.expand_path(File.dirname(__FILE__) + "/..")
+
+  REQUEST =
+    "GET / HTTP/1.1\r\n" <<
+    "Host: 127.0.0.1\r\n" <<
+    "Connection: close\r\n" <<
+    "\r\n"
+
+  def initialize(options = {})
+    @options = options
+    @options[:agent] ||= "#{ROOT}/buildout/support-binaries/PassengerAgent"
+    @options[:port] ||= 3000
+    @options[:threads] ||= 2
+    @options[:clients] ||= 8
+    @options[:duration] ||= 10
+  end
+
+  def run
+    if !File.exist?(@options[:agent])
+      abort "#{@options[:agent]} not found. Please run 'rake agent' first."
+    end
+
+    puts "Using #{@options[:threads]} core threads"
+    puts "Using #{@options[:clients]} client processes"
+    puts "Running each mode for #{@options[:duration]} seconds"
+    puts
+
+    modes = [
+      ["AcceptLoadBalancer", []],
+      ["SO_REUSEPORT", ["--reuse-port"]]
+    ]
+    if @options[:cpu_steering]
+      modes << ["SO_REUSEPORT + CPU steering",
+        ["--reuse-port", "--reuse-port-cpu-steering", "--cpu-affine"]]
+    end
+
+    results = modes.map do |name, args|
+      rate = benchmark(args)
+      printf "%-30s %10.0f connections/sec\n", name, rate
+      rate
+    end
+    puts
+    printf "SO_REUSEPORT vs AcceptLoadBalancer: %.2fx\n", results[1] / results[0]
+  end
+
+private
+  def benchmark(extra_args)
+    pid = start_core(extra_args)
+    begin
+      wait_until_listening
+      run_clients
+    ensure
+      Process.kill('TERM', pid)
+      Process.waitpid(pid)
+    end
+  end
+
+  def start_core(extra_args)
+    Process.spawn(@options[:agent], "core",
+      "--passenger-root", ROOT,
+      "--listen", "tcp://127.0.0.1:#{@options[:port]}",
+      "--threads", @options[:threads].to_s,
+      "--benchmark", "after_accept",
+      "--no-graceful-exit",
+      "--log-level", "1",
+      *extra_args)
+  end
+
+  def wait_until_listening
+    Timeout.timeout(10) do
+      begin
+        TCPSocket.new('127.0.0.1', @options[:port]).close
+      rescue Errno::ECONNREFUSED
+        sleep 0.05
+        retry
+      end
+    end
+  end
+
+  def run_clients
+    deadline = Time.now + @options[:duration]
+    readers = []
+    @options[:clients].times do
+      reader, writer = IO.pipe
+      fork do
+        reader.close
+        writer.write(client_loop(deadline).to_s)
+        writer.close
+        exit!(0)
+      end
+      writer.close
+      readers << reader
+    end
+    total = readers.map { |reader| reader.read.to_i }.inject(0, :+)
+    Process.waitall
+    total / @options[:duration].to_f
+  end
+
+  def client_loop(deadline)
+    count = 0
+    while Time.now < deadline
+      socket = TCPSocket.new('127.0.0.1', @options[:port])
+      begin
+        socket.write(REQUEST)
+        socket.read
+      ensure
+        socket.close
+      end
+      count += 1
+    end
+    count
+  end
+end
+
+options = {}
+parser = OptionParser.new do |opts|
+  opts.banner = "Usage: ./benchmark_accept_sharding.rb [options]"
+  opts.separator ""
+
+  opts.separator "Options:"
+  opts.on("--agent PATH", String, "Path to the PassengerAgent binary") do |val|
+    options[:agent] = val
+  end
+  opts.on("--port PORT", Integer, "Let the core listen on the given TCP port. Default: 3000") do |val|
+    options[:port] = val
+  end
+  opts.on("--threads N", Integer, "Number of core threads. Default: 2") do |val|
+    options[:threads] = val
+  end
+  opts.on("--clients N", Integer, "Number of client processes. Default: 8") do |val|
+    options[:clients] = val
+  end
+  opts.on("--duration SECONDS", Integer, "Duration of each run. Default: 10") do |val|
+    options[:duration] = val
+  end
+  opts.on("--cpu-steering", "Also benchmark SO_REUSEPORT with CPU steering") do
+    options[:cpu_steering] = true
+  end
+end
+begin
+  parser.parse!
+rescue OptionParser::ParseError => e
+  puts e
+  puts
+  puts "Please see '--help' for valid options."
+  exit 1
+end
+AcceptShardingBenchmark.new(options).run
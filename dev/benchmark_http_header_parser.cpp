@@ -0,0 +1,137 @@
+/*
+ * Measures the throughput of the HTTP header parser on a few realistic
+ * request and response headers, using the scalar header scanner and the
+ * SIMD one (if the CPU supports it).
+ *
+ * Compile and run with:
+ *
+ *   g++ -O3 -Isrc/cxx_supportlib -Isrc/cxx_supportlib/vendor-modified/boost \
+ *     dev/benchmark_http_header_parser.cpp src/cxx_supportlib/ServerKit/http_parser.cpp \
+ *     -o /tmp/benchmark_http_header_parser
+ *   /tmp/benchmark_http_header_parser
+ */
+#include <ServerKit/http_parser.h>
+#include <sys/time.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+static const unsigned int ITERATIONS = 200000;
+
+static double
+now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static string
+makeCookieHeader(unsigned int size) {
+	string result = "Cookie: ";
+	unsigned int i = 0;
+	while (result.size() < size) {
+		char buf[96];
+		snprintf(buf, sizeof(buf),
+			"_ga_%u=GA1.2.1736478352.1492701943%u; session_%u=eyJhbGciOiJIUzI1NiJ9%u; ",
+			i, i, i, i);
+		result.append(buf);
+		i++;
+	}
+	result.append("\r\n");
+	return result;
+}
+
+static string
+makeSmallRequest() {
+	return "GET / HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"User-Agent: curl/7.52.1\r\n"
+		"Accept: */*\r\n"
+		"\r\n";
+}
+
+static string
+makeBrowserRequest() {
+	return "GET /projects/1234/issues?page=2&per_page=50 HTTP/1.1\r\n"
+		"Host: www.example.com\r\n"
+		"Connection: keep-alive\r\n"
+		"Upgrade-Insecure-Requests: 1\r\n"
+		"User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_12_4) AppleWebKit/537.36 "
+			"(KHTML, like Gecko) Chrome/58.0.3029.81 Safari/537.36\r\n"
+		"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+		"Referer: https://www.example.com/projects/1234/issues?page=1&per_page=50\r\n"
+		"Accept-Encoding: gzip, deflate, sdch, br\r\n"
+		"Accept-Language: en-US,en;q=0.8,nl;q=0.6\r\n"
+		+ makeCookieHeader(3000)
+		+ "\r\n";
+}
+
+static string
+makeAppResponse() {
+	return "HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/html; charset=utf-8\r\n"
+		"Content-Length: 18734\r\n"
+		"X-Frame-Options: SAMEORIGIN\r\n"
+		"X-XSS-Protection: 1; mode=block\r\n"
+		"X-Content-Type-Options: nosniff\r\n"
+		"ETag: W/\"3a5d7f1c5b9e4c1fa3b4d0b6e2c1f9a8\"\r\n"
+		"Cache-Control: max-age=0, private, must-revalidate\r\n"
+		"Set-Cookie: _app_session=QWxhZGRpbjpvcGVuIHNlc2FtZQ%3D%3D--5d41402abc4b2a76b9719d911017c592"
+			"7e240b4e46d1c9e8a2b6f1d0c3e5a7b9; path=/; HttpOnly\r\n"
+		"X-Request-Id: 8f14e45f-ceea-467a-9f3e-2b5a7c1d9e0f\r\n"
+		"X-Runtime: 0.041870\r\n"
+		"Strict-Transport-Security: max-age=31536000\r\n"
+		"\r\n";
+}
+
+static int
+onHeadersComplete(http_parser *parser) {
+	// Don't parse a body.
+	return 1;
+}
+
+static double
+benchmark(const string &data, enum http_parser_type type) {
+	http_parser_settings settings;
+	http_parser parser;
+	double start = now();
+
+	memset(&settings, 0, sizeof(settings));
+	settings.on_headers_complete = onHeadersComplete;
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		http_parser_init(&parser, type);
+		size_t ret = http_parser_execute(&parser, &settings, data.data(), data.size());
+		if (ret != data.size() || HTTP_PARSER_ERRNO(&parser) != HPE_OK) {
+			fprintf(stderr, "Parse error: %s\n",
+				http_errno_description(HTTP_PARSER_ERRNO(&parser)));
+			return -1;
+		}
+	}
+	return now() - start;
+}
+
+static void
+run(const char *name, const string &data, enum http_parser_type type) {
+	http_parser_set_simd_enabled(0);
+	double scalarTime = benchmark(data, type);
+	http_parser_set_simd_enabled(1);
+	double simdTime = benchmark(data, type);
+	double mb = (double) data.size() * ITERATIONS / 1024 / 1024;
+
+	printf("%-18s %6u %15.0f %15.0f %8.2fx\n", name, (unsigned int) data.size(),
+		mb / scalarTime, mb / simdTime, scalarTime / simdTime);
+}
+
+int
+main() {
+	http_parser_set_simd_enabled(1);
+	printf("SIMD header scanner: %s\n\n", http_parser_header_scanner_name());
+	printf("%-18s %6s %15s %15s %9s\n", "headers", "bytes", "scalar (MB/s)",
+		"simd (MB/s)", "speedup");
+	run("small request", makeSmallRequest(), HTTP_REQUEST);
+	run("browser request", makeBrowserRequest(), HTTP_REQUEST);
+	run("app response", makeAppResponse(), HTTP_RESPONSE);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Compares the cost of initializing the pool options of a request by
+ * copying the cached Options object (the old implementation) and by
+ * referencing the cached immutable snapshot (the current one). Every
+ * iteration simulates the option handling of Controller::initializePoolOptions()
+ * for one request, including the per-request PASSENGER_MAX_REQUESTS
+ * override, and the release of the options when the request ends.
+ *
+ * Compile and run with:
+ *
+ *   g++ -O2 -Isrc/agent -Isrc/cxx_supportlib -Isrc/cxx_supportlib/vendor-modified \
+ *     -Isrc/cxx_supportlib/vendor-modified/boost \
+ *     dev/benchmark_pool_options.cpp src/cxx_supportlib/Utils/Hasher.cpp \
+ *     buildout/common/libboost_oxt.a -lpthread -o /tmp/benchmark_pool_options
+ *   /tmp/benchmark_pool_options
+ */
+#include <Core/ApplicationPool/Options.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <sys/time.h>
+#include <cstdio>
+
+using namespace Passenger;
+using namespace Passenger::ApplicationPool2;
+
+static const unsigned int ITERATIONS = 10000000;
+
+static double
+now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static boost::shared_ptr<const Options>
+createSnapshot() {
+	Options options;
+	options.appRoot = P_STATIC_STRING("/webapps/foo");
+	options.appGroupName = P_STATIC_STRING("/webapps/foo (production)");
+	options.appType = P_STATIC_STRING("rack");
+	options.environment = P_STATIC_STRING("production");
+	options.ruby = P_STATIC_STRING("/usr/bin/ruby");
+	options.python = P_STATIC_STRING("python");
+	options.nodejs = P_STATIC_STRING("node");
+	options.startupFile = P_STATIC_STRING("config.ru");
+	options.integrationMode = P_STATIC_STRING("nginx");
+	options.environmentVariables = P_STATIC_STRING("UkFJTFNfRU5WAHByb2R1Y3Rpb24A");
+	options.maxRequests = 1000;
+
+	boost::shared_ptr<Options> snapshot = boost::make_shared<Options>(options);
+	snapshot->persist(options);
+	return snapshot;
+}
+
+struct CopyingRequest {
+	Options options;
+};
+
+struct SnapshotRequest {
+	const Options *options;
+	boost::shared_ptr<const Options> optionsSnapshot;
+	Options ownOptions;
+};
+
+static double
+benchmarkCopy(const boost::shared_ptr<const Options> &cached, unsigned long *checksum) {
+	CopyingRequest req;
+	unsigned long sum = 0;
+	double start = now();
+
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		req.options = *cached;
+		req.options.maxRequests = 1000;
+		sum += req.options.maxRequests + req.options.appRoot.size();
+		req.options.transaction.reset();
+	}
+
+	*checksum = sum;
+	return now() - start;
+}
+
+static double
+benchmarkSnapshot(const boost::shared_ptr<const Options> &cached, unsigned long *checksum) {
+	SnapshotRequest req;
+	unsigned long sum = 0;
+	double start = now();
+
+	req.options = &req.ownOptions;
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		req.optionsSnapshot = cached;
+		req.options = cached.get();
+		unsigned long maxRequests = 1000;
+		if (maxRequests != req.options->maxRequests) {
+			req.ownOptions = *req.options;
+			req.ownOptions.maxRequests = maxRequests;
+			req.options = &req.ownOptions;
+		}
+		sum += req.options->maxRequests + req.options->appRoot.size();
+		req.options = &req.ownOptions;
+		req.optionsSnapshot.reset();
+		req.ownOptions.transaction.reset();
+	}
+
+	*checksum = sum;
+	return now() - start;
+}
+
+int
+main() {
+	boost::shared_ptr<const Options> cached = createSnapshot();
+	unsigned long copyChecksum, snapshotChecksum;
+	double copyTime = benchmarkCopy(cached, &copyChecksum);
+	double snapshotTime = benchmarkSnapshot(cached, &snapshotChecksum);
+
+	if (copyChecksum != snapshotChecksum) {
+		fprintf(stderr, "Copy and snapshot saw different options!\n");
+		return 1;
+	}
+	printf("%14s %18s %8s\n", "copy (ns/op)", "snapshot (ns/op)", "speedup");
+	printf("%14.1f %18.1f %7.1fx\n",
+		copyTime * 1e9 / ITERATIONS, snapshotTime * 1e9 / ITERATIONS,
+		copyTime / snapshotTime);
+	return 0;
+}
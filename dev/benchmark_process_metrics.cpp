@@ -0,0 +1,80 @@
+/*
+ * Measures how long it takes to collect the metrics of a number of
+ * processes, by running 'ps' and by reading /proc directly. The Pool
+ * does this every few seconds for all application processes.
+ *
+ * Linux only. After building Passenger, compile and run with:
+ *
+ *   g++ -O3 -Isrc/cxx_supportlib -Isrc/cxx_supportlib/vendor-copy \
+ *     -Isrc/cxx_supportlib/vendor-modified -Isrc/cxx_supportlib/vendor-modified/boost \
+ *     dev/benchmark_process_metrics.cpp $(find buildout/common/libpassenger_common -name '*.o') \
+ *     buildout/common/libboost_oxt.a -lpthread -lcrypto -lz \
+ *     -o /tmp/benchmark_process_metrics
+ *   /tmp/benchmark_process_metrics [number of processes]
+ */
+#include <Utils/ProcessMetricsCollector.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace Passenger;
+
+static const unsigned int ITERATIONS = 50;
+
+static double
+now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void
+report(const char *name, double begin, double end, unsigned int found) {
+	printf("%-8s %8.3f ms per collection (%u processes found)\n", name,
+		(end - begin) * 1000 / ITERATIONS, found);
+}
+
+int
+main(int argc, char *argv[]) {
+	unsigned int count = (argc > 1) ? atoi(argv[1]) : 32;
+	vector<pid_t> pids;
+
+	// Processes that idle like application processes do.
+	for (unsigned int i = 0; i < count; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			pause();
+			_exit(0);
+		}
+		pids.push_back(pid);
+	}
+
+	ProcessMetricsCollector collector;
+	ProcessMetricMap result;
+	double begin, end;
+
+	begin = now();
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		result = collector.collectWithPs(pids);
+	}
+	end = now();
+	report("ps", begin, end, result.size());
+
+	begin = now();
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		result = collector.collectFromProc(pids);
+	}
+	end = now();
+	report("/proc", begin, end, result.size());
+
+	for (unsigned int i = 0; i < count; i++) {
+		kill(pids[i], SIGKILL);
+		waitpid(pids[i], NULL, 0);
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Compares the cost of picking the least busy process in a Group with a
+ * linear scan over the busyness levels (the old implementation) and with
+ * IndexedMinHeap (the current one). Every iteration simulates one request:
+ * pick the least busy process, open a session on it (busyness goes up),
+ * and close a session on a random process (busyness goes down).
+ *
+ * Compile and run with:
+ *
+ *   g++ -O2 -Isrc/cxx_supportlib -Isrc/cxx_supportlib/vendor-modified \
+ *     dev/benchmark_process_routing.cpp -o /tmp/benchmark_process_routing
+ *   /tmp/benchmark_process_routing
+ */
+#include <DataStructures/IndexedMinHeap.h>
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace Passenger;
+
+static const unsigned int ITERATIONS = 10000000;
+
+static double
+now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double
+benchmarkScan(unsigned int processCount, unsigned int *checksum) {
+	std::vector<int> levels(processCount, 0);
+	unsigned int sum = 0;
+	double start = now();
+
+	srand(1);
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		unsigned int best = 0;
+		for (unsigned int j = 1; j < processCount; j++) {
+			if (levels[j] < levels[best]) {
+				best = j;
+			}
+		}
+		levels[best]++;
+		sum += best;
+
+		unsigned int victim = rand() % processCount;
+		if (levels[victim] > 0) {
+			levels[victim]--;
+		}
+	}
+
+	*checksum = sum;
+	return now() - start;
+}
+
+static double
+benchmarkHeap(unsigned int processCount, unsigned int *checksum) {
+	std::vector<int> levels(processCount, 0);
+	IndexedMinHeap heap;
+	unsigned int sum = 0;
+
+	for (unsigned int j = 0; j < processCount; j++) {
+		heap.push(0);
+	}
+
+	double start = now();
+
+	srand(1);
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		unsigned int best = heap.top();
+		heap.update(best, ++levels[best]);
+		sum += best;
+
+		unsigned int victim = rand() % processCount;
+		if (levels[victim] > 0) {
+			heap.update(victim, --levels[victim]);
+		}
+	}
+
+	*checksum = sum;
+	return now() - start;
+}
+
+int
+main() {
+	static const unsigned int processCounts[] = { 4, 16, 64, 128, 256, 1024 };
+
+	printf("%10s %14s %14s %8s\n", "processes", "scan (ns/op)", "heap (ns/op)", "speedup");
+	for (unsigned int i = 0; i < sizeof(processCounts) / sizeof(unsigned int); i++) {
+		unsigned int scanChecksum, heapChecksum;
+		double scanTime = benchmarkScan(processCounts[i], &scanChecksum);
+		double heapTime = benchmarkHeap(processCounts[i], &heapChecksum);
+		if (scanChecksum != heapChecksum) {
+			fprintf(stderr, "Scan and heap picked different processes!\n");
+			return 1;
+		}
+		printf("%10u %14.1f %14.1f %7.1fx\n", processCounts[i],
+			scanTime * 1e9 / ITERATIONS, heapTime * 1e9 / ITERATIONS,
+			scanTime / heapTime);
+	}
+	return 0;
+}
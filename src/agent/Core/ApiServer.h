@@ -44,6 +44,7 @@
 #include <Shared/ApiServerUtils.h>
 #include <Shared/ApiAccountUtils.h>
 #include <ServerKit/HttpServer.h>
+#include <ServerKit/AcceptLoadBalancer.h>
 #include <DataStructures/LString.h>
 #include <Exceptions.h>
 #include <StaticString.h>
@@ -69,6 +70,8 @@ using namespace std;
  *   accept_burst_count             unsigned integer   -   default(32)
  *   authorizations                 array              -   default("[FILTERED]"),secret
  *   client_freelist_limit          unsigned integer   -   default(0)
+ *   http2                          boolean            -   default(false)
+ *   http2_max_concurrent_streams   unsigned integer   -   default(100)
  *   instance_dir                   string             -   -
  *   min_spare_clients              unsigned integer   -   default(0)
  *   request_freelist_limit         unsigned integer   -   default(1024)
@@ -263,6 +266,23 @@ private:
 				string key = "thread" + toString(i + 1);
 				response[key] = req->controllerStates[i];
 			}
+			if (loadBalancer != NULL) {
+				response["load_balancer"] = loadBalancer->inspectStateAsJson();
+			}
+			if (turbocacheStore != NULL) {
+				response["turbocache"] = turbocacheStore->inspectStateAsJson();
+			}
+			if (LoggingKit::context != NULL) {
+				response["async_logging"] = LoggingKit::context->inspectAsyncWriterState();
+			}
+			const UnionStation::ContextPtr &unionStationContext =
+				appPool->getUnionStationContext();
+			if (unionStationContext != NULL
+			 && unionStationContext->getAsyncSender() != NULL)
+			{
+				response["union_station_sender"] =
+					unionStationContext->getAsyncSender()->inspectStateAsJson();
+			}
 
 			writeSimpleResponse(client, 200, &headers,
 				psg_pstrdup(req->pool, response.toStyledString()));
@@ -683,6 +703,9 @@ public:
 	// Dependencies
 	vector<Controller *> controllers;
 	ApplicationPool2::PoolPtr appPool;
+	ResponseCacheStorePtr turbocacheStore;
+	// Only set if clients are distributed by an AcceptLoadBalancer.
+	ServerKit::AcceptLoadBalancer<Controller> *loadBalancer;
 	EventFd *exitEvent;
 
 	ApiServer(ServerKit::Context *context, const Schema &schema,
@@ -690,6 +713,7 @@ public:
 		const ConfigKit::Translator &translator = ConfigKit::DummyTranslator())
 		: ParentClass(context, schema, initialConfig, translator),
 		  serverConnectionPath("^/server/(.+)\\.json$"),
+		  loadBalancer(NULL),
 		  exitEvent(NULL)
 	{
 		apiAccountDatabase = ApiAccountUtils::ApiAccountDatabase(
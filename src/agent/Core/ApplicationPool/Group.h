@@ -37,6 +37,7 @@
 #include <boost/make_shared.hpp>
 #include <boost/container/vector.hpp>
 #include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
 #include <oxt/macros.hpp>
 #include <oxt/thread.hpp>
 #include <oxt/dynamic_thread_group.hpp>
@@ -45,10 +46,14 @@
 #include <cstdlib>
 #include <cassert>
 #include <SmallVector.h>
+#include <DataStructures/IndexedMinHeap.h>
+#include <Algorithms/MovingAverage.h>
 #include <MemoryKit/palloc.h>
 #include <Hooks.h>
 #include <Utils.h>
+#include <Utils/SpeedMeter.h>
 #include <Core/ApplicationPool/Common.h>
+#include <Core/ApplicationPool/PoolLock.h>
 #include <Core/ApplicationPool/Context.h>
 #include <Core/ApplicationPool/BasicGroupInfo.h>
 #include <Core/ApplicationPool/Process.h>
@@ -134,12 +139,29 @@ public:
 	 */
 	unsigned int restartsInitiated;
 	/**
-	 * The number of processes that are being spawned right now.
+	 * The number of processes that are being spawned right now. Every
+	 * spawner thread spawns at most one process at a time, so this is
+	 * also the number of spawner threads that are busy spawning. It
+	 * only exceeds `options.spawnConcurrency` if that option was lowered
+	 * while spawns were in progress.
 	 *
 	 * Invariant:
 	 *     if processesBeingSpawned > 0: m_spawning
 	 */
 	short processesBeingSpawned;
+	/**
+	 * When the current spawn burst (the period during which m_spawning
+	 * is true) started, and how many processes it has attached so far.
+	 */
+	unsigned long long spawnBurstStartTime;
+	unsigned int spawnBurstProcessCount;
+	/**
+	 * How long the last completed spawn burst took, in microseconds,
+	 * and how many processes it attached. 0 if no spawn burst has
+	 * completed yet.
+	 */
+	unsigned long long lastTimeToCapacity;
+	unsigned int lastSpawnBurstProcessCount;
 	/**
 	 * A Group object progresses through a life.
 	 *
@@ -154,9 +176,9 @@ public:
 	 */
 	boost::atomic<boost::uint8_t> lifeStatus;
 	/**
-	 * Whether the spawner thread is currently working. Note that even
-	 * if it's working, it doesn't necessarily mean that processes are
-	 * being spawned (i.e. that processesBeingSpawned > 0). After the
+	 * Whether any spawner thread is currently working. Note that even
+	 * if one is working, it doesn't necessarily mean that processes are
+	 * being spawned (i.e. that processesBeingSpawned > 0). After a
 	 * thread is done spawning a process, it will attempt to attach
 	 * the newly-spawned process to the group. During that time it's not
 	 * technically spawning anything.
@@ -175,7 +197,7 @@ public:
 	bool m_restarting: 1;
 	bool alwaysRestartFileExists: 1;
 
-	/** Contains the spawn loop thread and the restarter thread. */
+	/** Contains the spawn loop threads and the restarter thread. */
 	dynamic_thread_group interruptableThreads;
 
 	string restartFile;
@@ -186,7 +208,7 @@ public:
 	 * whether any of the Processes can be shut down.
 	 */
 	bool detachedProcessesCheckerActive;
-	boost::condition_variable detachedProcessesCheckerCond;
+	boost::condition_variable_any detachedProcessesCheckerCond;
 	Callback shutdownCallback;
 	GroupPtr selfPointer;
 
@@ -207,6 +229,8 @@ public:
 	static void _onSessionClose(Session *session);
 	OXT_FORCE_INLINE void onSessionInitiateFailure(Process *process, Session *session);
 	OXT_FORCE_INLINE void onSessionClose(Process *process, Session *session);
+	bool sessionCloseNeedsExclusivePoolLock(Process *process) const;
+	void updateStatisticsAfterSessionClose(Process *process, Session *session);
 
 	/****** Spawning and restarting ******/
 
@@ -214,6 +238,12 @@ public:
 		unsigned int restartsInitiated);
 	void spawnThreadRealMain(const SpawningKit::SpawnerPtr &spawner, const Options &options,
 		unsigned int restartsInitiated);
+	void startSpawnThread();
+	void startMoreSpawnThreads();
+	bool spawnLoopShouldContinue() const;
+	void finishSpawnBurst();
+	unsigned int predictProcessCount(unsigned long long now);
+	Process *findProcessToTrimPredictively(unsigned long long now) const;
 	void finalizeRestart(GroupPtr self, Options oldOptions, Options newOptions,
 		RestartMethod method, SpawningKit::FactoryPtr spawningKitFactory,
 		unsigned int restartsInitiated, boost::container::vector<Callback> postLockActions);
@@ -224,6 +254,9 @@ public:
 	Process *findProcessWithStickySessionIdOrLowestBusyness(unsigned int id) const;
 	Process *findProcessWithLowestBusyness(const ProcessList &processes) const;
 	Process *findEnabledProcessWithLowestBusyness() const;
+	Process *findEnabledProcessWithPowerOfTwoChoices() const;
+	Process *findEnabledProcessWithLeastLatency() const;
+	unsigned int nextRoutingRandomNumber() const;
 
 	void addProcessToList(const ProcessPtr &process, ProcessList &destination);
 	void removeProcessFromList(const ProcessPtr &process, ProcessList &source);
@@ -360,11 +393,72 @@ public:
 	ProcessList detachedProcesses;
 
 	/**
-	 * A cache of the processes' busyness. It's in a compact structure
-	 * so that `findProcessWithLowestBusyness()` can work very quickly
-	 * when there are a large number of processes.
+	 * A cache of the enabled processes' busyness, indexed by their position
+	 * in `enabledProcesses`. It's a min-heap so that
+	 * `findEnabledProcessWithLowestBusyness()` takes constant time and
+	 * busyness updates take logarithmic time, even when there are a large
+	 * number of processes.
+	 */
+	IndexedMinHeap enabledProcessBusynessLevels;
+
+	/**
+	 * State of the pseudo random number generator used by the
+	 * RS_POWER_OF_TWO_CHOICES routing strategy. Part of the routing state
+	 * (see `routingSyncher`).
+	 */
+	mutable boost::uint32_t routingRandomState;
+
+	/**
+	 * Inputs for predictive spawning (see updatePredictiveSpawning()).
+	 * The number of get() requests received so far and a moving average of
+	 * the time between opening and closing a session, in microseconds. Part
+	 * of the routing state (see `routingSyncher`). The response time is only
+	 * measured if `options.predictiveSpawning` is set.
+	 */
+	boost::uint64_t requestsArrived;
+	DiscExpMovingAverage<500, 10 * 1000000, 10 * 1000000> responseTimeAverage;
+
+	/**
+	 * Predictive spawning state. Only accessed with the pool lock held
+	 * exclusively.
+	 *
+	 * `arrivalRateMeter` is sampled with `requestsArrived` on every
+	 * evaluation and yields the number of requests per second.
+	 * `arrivalRateTrend` is a smoothed estimate of how fast that rate
+	 * changes, in requests per second per second. `spawnTimeAverage` is a
+	 * moving average of how long spawning a process takes, in microseconds.
+	 * `predictedProcessCount` is the number of processes that the last
+	 * evaluation deemed necessary, or 0 if predictive spawning is disabled
+	 * or no prediction could be made.
+	 */
+	SpeedMeter<double, 8, 1000000, 60 * 1000000, 1000000> arrivalRateMeter;
+	double lastArrivalRate;
+	double arrivalRateTrend;
+	unsigned long long lastPredictionTime;
+	DiscExpMovingAverage<500, 60 * 1000000, 60 * 1000000> spawnTimeAverage;
+	unsigned int predictedProcessCount;
+
+	/**
+	 * Memory limit state (see findProcessToRecycleForMemory()). Only
+	 * accessed with the pool lock held exclusively. If a replacement
+	 * process is being spawned for a process that is over the memory limit,
+	 * then this is the number of enabled processes that the group must
+	 * reach before that process is detached. 0 otherwise.
 	 */
-	boost::container::vector<int> enabledProcessBusynessLevels;
+	unsigned int memoryRecyclingTarget;
+
+	/**
+	 * Serializes the request routing fast path within this group, i.e. code
+	 * that holds the pool lock in shared mode only (see PoolMutex). Such code
+	 * may only modify this group's routing state: `options`, the restart file
+	 * check state, `enabledProcessBusynessLevels`, `nEnabledProcessesTotallyBusy`,
+	 * `routingRandomState`, `requestsArrived`, `responseTimeAverage` and
+	 * the session counters and statistics of the
+	 * enabled processes and their sockets.
+	 *
+	 * Code that holds the pool lock exclusively doesn't have to lock this.
+	 */
+	mutable GroupMutex routingSyncher;
 
 	/**
 	 * get() requests for this group that cannot be immediately satisfied are
@@ -441,18 +535,23 @@ public:
 
 	SessionPtr get(const Options &newOptions, const GetCallback &callback,
 		boost::container::vector<Callback> &postLockActions);
+	SessionPtr getWithSharedPoolLock(const Options &newOptions);
 
 	/****** Spawning and restarting ******/
 
 	void restart(const Options &options, RestartMethod method = RM_DEFAULT);
 	bool restarting() const;
 	bool needsRestart(const Options &options);
+	bool restartFileCheckDue(const Options &options) const;
 
 	SpawnResult spawn();
 	bool spawning() const;
 	bool shouldSpawn() const;
 	bool shouldSpawnForGetAction() const;
 	bool allowSpawn() const;
+	unsigned long long updatePredictiveSpawning(unsigned long long now,
+		boost::container::vector<Callback> &postLockActions);
+	ProcessPtr findProcessToRecycleForMemory();
 
 	/****** Process list management ******/
 
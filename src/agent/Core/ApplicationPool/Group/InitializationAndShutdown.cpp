@@ -109,9 +109,20 @@ Group::Group(Pool *_pool, const Options &_options)
 	disablingCount = 0;
 	disabledCount  = 0;
 	nEnabledProcessesTotallyBusy = 0;
+	routingRandomState = (boost::uint32_t) SystemTime::getUsec() | 1;
+	requestsArrived = 0;
+	lastArrivalRate = 0;
+	arrivalRateTrend = 0;
+	lastPredictionTime = 0;
+	predictedProcessCount = 0;
+	memoryRecyclingTarget = 0;
 	spawner        = getContext()->getSpawningKitFactory()->create(options);
 	restartsInitiated = 0;
 	processesBeingSpawned = 0;
+	spawnBurstStartTime = 0;
+	spawnBurstProcessCount = 0;
+	lastTimeToCapacity = 0;
+	lastSpawnBurstProcessCount = 0;
 	m_spawning     = false;
 	m_restarting   = false;
 	lifeStatus.store(ALIVE, boost::memory_order_relaxed);
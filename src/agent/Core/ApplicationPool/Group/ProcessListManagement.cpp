@@ -59,25 +59,11 @@ Group::findProcessWithStickySessionId(unsigned int id) const {
 
 Process *
 Group::findProcessWithStickySessionIdOrLowestBusyness(unsigned int id) const {
-	int leastBusyProcessIndex = -1;
-	int lowestBusyness = 0;
-	unsigned int i, size = enabledProcessBusynessLevels.size();
-	const int *enabledProcessBusynessLevels = &this->enabledProcessBusynessLevels[0];
-
-	for (i = 0; i < size; i++) {
-		Process *process = enabledProcesses[i].get();
-		if (process->getStickySessionId() == id) {
-			return process;
-		} else if (leastBusyProcessIndex == -1 || enabledProcessBusynessLevels[i] < lowestBusyness) {
-			leastBusyProcessIndex = i;
-			lowestBusyness = enabledProcessBusynessLevels[i];
-		}
-	}
-
-	if (leastBusyProcessIndex == -1) {
-		return NULL;
+	Process *process = findProcessWithStickySessionId(id);
+	if (process != NULL) {
+		return process;
 	} else {
-		return enabledProcesses[leastBusyProcessIndex].get();
+		return findEnabledProcessWithLowestBusyness();
 	}
 }
 
@@ -103,26 +89,115 @@ Group::findProcessWithLowestBusyness(const ProcessList &processes) const {
 }
 
 /**
- * Cache-optimized version of findProcessWithLowestBusyness() for the common case.
+ * Constant-time version of findProcessWithLowestBusyness() for the common case.
+ * Picks the same process as findProcessWithLowestBusyness(enabledProcesses) would.
  */
 Process *
 Group::findEnabledProcessWithLowestBusyness() const {
 	if (enabledProcesses.empty()) {
 		return NULL;
+	} else {
+		return enabledProcesses[enabledProcessBusynessLevels.top()].get();
 	}
+}
 
-	int leastBusyProcessIndex = -1;
-	int lowestBusyness = 0;
-	unsigned int i, size = enabledProcessBusynessLevels.size();
-	const int *enabledProcessBusynessLevels = &this->enabledProcessBusynessLevels[0];
+/**
+ * Picks two random enabled processes and returns the least busy one of the two,
+ * or the one with the lowest index if they're equally busy. Falls back to
+ * findEnabledProcessWithLowestBusyness() if neither of them can be routed to.
+ */
+Process *
+Group::findEnabledProcessWithPowerOfTwoChoices() const {
+	unsigned int size = enabledProcesses.size();
+	if (size < 2) {
+		return findEnabledProcessWithLowestBusyness();
+	}
+
+	unsigned int i = nextRoutingRandomNumber() % size;
+	unsigned int j = nextRoutingRandomNumber() % (size - 1);
+	if (j >= i) {
+		j++;
+	}
+	if (j < i) {
+		std::swap(i, j);
+	}
 
-	for (i = 0; i < size; i++) {
-		if (leastBusyProcessIndex == -1 || enabledProcessBusynessLevels[i] < lowestBusyness) {
-			leastBusyProcessIndex = i;
-			lowestBusyness = enabledProcessBusynessLevels[i];
+	Process *process;
+	if (enabledProcessBusynessLevels.get(j) < enabledProcessBusynessLevels.get(i)) {
+		process = enabledProcesses[j].get();
+	} else {
+		process = enabledProcesses[i].get();
+	}
+	if (process->canBeRoutedTo()) {
+		return process;
+	} else {
+		return findEnabledProcessWithLowestBusyness();
+	}
+}
+
+/**
+ * Returns the enabled process with the lowest expected latency (see
+ * Process::expectedLatency()) among those that can be routed to. Ties are
+ * broken by busyness. Processes for which no response time has been measured
+ * yet are assumed to be as fast as the fastest measured process.
+ * Falls back to findEnabledProcessWithLowestBusyness() if no process can be
+ * routed to.
+ */
+Process *
+Group::findEnabledProcessWithLeastLatency() const {
+	ProcessList::const_iterator it, end = enabledProcesses.end();
+	double defaultResponseTime = -1;
+
+	for (it = enabledProcesses.begin(); it != end; it++) {
+		const Process *process = it->get();
+		if (process->responseTimeAverage.available()) {
+			double average = process->responseTimeAverage.average();
+			if (defaultResponseTime < 0 || average < defaultResponseTime) {
+				defaultResponseTime = average;
+			}
+		}
+	}
+	if (defaultResponseTime < 0) {
+		defaultResponseTime = 0;
+	}
+
+	Process *bestProcess = NULL;
+	double bestLatency = 0;
+	for (it = enabledProcesses.begin(); it != end; it++) {
+		Process *process = it->get();
+		if (!process->canBeRoutedTo()) {
+			continue;
+		}
+
+		double latency = process->expectedLatency(defaultResponseTime);
+		if (bestProcess == NULL
+		 || latency < bestLatency
+		 || (latency == bestLatency && process->busyness() < bestProcess->busyness()))
+		{
+			bestProcess = process;
+			bestLatency = latency;
 		}
 	}
-	return enabledProcesses[leastBusyProcessIndex].get();
+
+	if (bestProcess != NULL) {
+		return bestProcess;
+	} else {
+		return findEnabledProcessWithLowestBusyness();
+	}
+}
+
+/**
+ * A xorshift pseudo random number generator. Good enough for spreading
+ * requests, and cheap enough to be called on every route().
+ */
+unsigned int
+Group::nextRoutingRandomNumber() const {
+	boost::uint32_t x = routingRandomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	routingRandomState = x;
+	return x;
 }
 
 /**
@@ -138,7 +213,7 @@ Group::addProcessToList(const ProcessPtr &process, ProcessList &destination) {
 	if (&destination == &enabledProcesses) {
 		process->enabled = Process::ENABLED;
 		enabledCount++;
-		enabledProcessBusynessLevels.push_back(process->busyness());
+		enabledProcessBusynessLevels.push(process->busyness());
 		if (process->isTotallyBusy()) {
 			nEnabledProcessesTotallyBusy++;
 		}
@@ -172,8 +247,9 @@ Group::addProcessToList(const ProcessPtr &process, ProcessList &destination) {
 void
 Group::removeProcessFromList(const ProcessPtr &process, ProcessList &source) {
 	ProcessPtr p = process; // Keep an extra reference count just in case.
+	unsigned int index = process->getIndex();
 
-	source.erase(source.begin() + process->getIndex());
+	source.erase(source.begin() + index);
 	process->setIndex(-1);
 
 	switch (process->enabled) {
@@ -207,14 +283,8 @@ Group::removeProcessFromList(const ProcessPtr &process, ProcessList &source) {
 		process->setIndex(i);
 	}
 
-	// Rebuild enabledProcessBusynessLevels
 	if (&source == &enabledProcesses) {
-		enabledProcessBusynessLevels.clear();
-		for (it = source.begin(); it != end; it++, i++) {
-			const ProcessPtr &process = *it;
-			enabledProcessBusynessLevels.push_back(process->busyness());
-		}
-		enabledProcessBusynessLevels.shrink_to_fit();
+		enabledProcessBusynessLevels.erase(index);
 	}
 }
 
@@ -301,7 +371,7 @@ Group::detachedProcessesCheckerMain(GroupPtr self) {
 		debug->messages->recv("Proceed with starting detached processes checker");
 	}
 
-	boost::unique_lock<boost::mutex> lock(pool->syncher);
+	PoolScopedLock lock(pool->syncher);
 	while (true) {
 		assert(detachedProcessesCheckerActive);
 
@@ -48,6 +48,9 @@ using namespace boost;
 /* Determines which process to route a get() action to. The returned process
  * is guaranteed to be `canBeRoutedTo()`, i.e. not totally busy.
  *
+ * Which enabled process is picked depends on the group's routing strategy
+ * (`options.routingStrategy`), unless a sticky session ID is given.
+ *
  * A request is routed to an enabled processes, or if there are none,
  * from a disabling process. The rationale is as follows:
  * If there are no enabled process, then waiting for one to spawn is too
@@ -58,7 +61,18 @@ Group::RouteResult
 Group::route(const Options &options) const {
 	if (OXT_LIKELY(enabledCount > 0)) {
 		if (options.stickySessionId == 0) {
-			Process *process = findEnabledProcessWithLowestBusyness();
+			Process *process;
+			switch (this->options.routingStrategy) {
+			case RS_POWER_OF_TWO_CHOICES:
+				process = findEnabledProcessWithPowerOfTwoChoices();
+				break;
+			case RS_LEAST_LATENCY:
+				process = findEnabledProcessWithLeastLatency();
+				break;
+			default:
+				process = findEnabledProcessWithLowestBusyness();
+				break;
+			}
 			if (process->canBeRoutedTo()) {
 				return RouteResult(process);
 			} else {
@@ -94,7 +108,7 @@ Group::newSession(Process *process, unsigned long long now) {
 	session->onInitiateFailure = _onSessionInitiateFailure;
 	session->onClose   = _onSessionClose;
 	if (process->enabled == Process::ENABLED) {
-		enabledProcessBusynessLevels[process->getIndex()] = process->busyness();
+		enabledProcessBusynessLevels.update(process->getIndex(), process->busyness());
 		if (!wasTotallyBusy && process->isTotallyBusy()) {
 			nEnabledProcessesTotallyBusy++;
 		}
@@ -123,7 +137,7 @@ Group::onSessionInitiateFailure(Process *process, Session *session) {
 	TRACE_POINT();
 	// Standard resource management boilerplate stuff...
 	Pool *pool = getPool();
-	boost::unique_lock<boost::mutex> lock(pool->syncher);
+	PoolScopedLock lock(pool->syncher);
 	assert(process->isAlive());
 	assert(isAlive() || getLifeStatus() == SHUTTING_DOWN);
 
@@ -138,33 +152,83 @@ Group::onSessionInitiateFailure(Process *process, Session *session) {
 	runAllActions(actions);
 }
 
-OXT_FORCE_INLINE void
-Group::onSessionClose(Process *process, Session *session) {
-	TRACE_POINT();
-	// Standard resource management boilerplate stuff...
-	Pool *pool = getPool();
-	boost::unique_lock<boost::mutex> lock(pool->syncher);
-	assert(process->isAlive());
-	assert(isAlive() || getLifeStatus() == SHUTTING_DOWN);
-
-	P_TRACE(2, "Session closed for process " << process->inspect());
-	verifyInvariants();
-	UPDATE_TRACE_POINT();
+/* Whether closing a session of the given process involves more than
+ * updating this group's routing state, e.g. detaching or disabling the
+ * process, initiating out-of-band work or assigning the freed capacity to
+ * a waiting request. Called from the fast path in onSessionClose(), with the
+ * pool lock held in shared mode and `routingSyncher` held.
+ */
+bool
+Group::sessionCloseNeedsExclusivePoolLock(Process *process) const {
+	const Pool *pool = getPool();
+	return !isAlive()
+		|| !process->isAlive()
+		|| process->enabled != Process::ENABLED
+		|| !getWaitlist.empty()
+		|| (options.maxRequests > 0 && process->processed + 1 >= options.maxRequests)
+		|| (process->sessions == 1
+			&& (!pool->getWaitlist.empty() || anotherGroupIsWaitingForCapacity()))
+		|| shouldInitiateOobw(process);
+}
 
-	/* Update statistics. */
+void
+Group::updateStatisticsAfterSessionClose(Process *process, Session *session) {
 	bool wasTotallyBusy = process->isTotallyBusy();
+	if (options.routingStrategy == RS_LEAST_LATENCY || options.predictiveSpawning) {
+		unsigned long long now = SystemTime::getUsec();
+		if (now > session->checkoutTime) {
+			if (options.routingStrategy == RS_LEAST_LATENCY) {
+				process->responseTimeAverage.update(now - session->checkoutTime, now);
+			}
+			if (options.predictiveSpawning) {
+				responseTimeAverage.update(now - session->checkoutTime, now);
+			}
+		}
+	}
 	process->sessionClosed(session);
 	assert(process->getLifeStatus() == Process::ALIVE);
 	assert(process->enabled == Process::ENABLED
 		|| process->enabled == Process::DISABLING
 		|| process->enabled == Process::DETACHED);
 	if (process->enabled == Process::ENABLED) {
-		enabledProcessBusynessLevels[process->getIndex()] = process->busyness();
+		enabledProcessBusynessLevels.update(process->getIndex(), process->busyness());
 		if (wasTotallyBusy) {
 			assert(nEnabledProcessesTotallyBusy >= 1);
 			nEnabledProcessesTotallyBusy--;
 		}
 	}
+}
+
+OXT_FORCE_INLINE void
+Group::onSessionClose(Process *process, Session *session) {
+	TRACE_POINT();
+	Pool *pool = getPool();
+
+	/* Fast path: if only this group's routing state changes, then
+	 * we don't need to hold the pool lock exclusively.
+	 */
+	{
+		PoolSharedLock sharedLock(pool->syncher);
+		GroupLockGuard l(routingSyncher);
+		if (OXT_LIKELY(!sessionCloseNeedsExclusivePoolLock(process))) {
+			P_TRACE(2, "Session closed for process " << process->inspect());
+			updateStatisticsAfterSessionClose(process, session);
+			verifyInvariants();
+			return;
+		}
+	}
+
+	// Standard resource management boilerplate stuff...
+	PoolScopedLock lock(pool->syncher);
+	assert(process->isAlive());
+	assert(isAlive() || getLifeStatus() == SHUTTING_DOWN);
+
+	P_TRACE(2, "Session closed for process " << process->inspect());
+	verifyInvariants();
+	UPDATE_TRACE_POINT();
+
+	/* Update statistics. */
+	updateStatisticsAfterSessionClose(process, session);
 
 	/* This group now has a process that's guaranteed to be not
 	 * totally busy.
@@ -252,6 +316,42 @@ Group::onSessionClose(Process *process, Session *session) {
  ****************************/
 
 
+/**
+ * The fast path of get(), for callers that hold the pool lock in shared mode
+ * only. It handles the common case, in which a session can be checked out
+ * right away, and only touches this group's routing state. Returns NULL if
+ * the request needs anything else (a restart file check, spawning, queueing,
+ * etc.), in which case the caller must call get() with the pool lock held
+ * exclusively.
+ */
+SessionPtr
+Group::getWithSharedPoolLock(const Options &newOptions) {
+	if (OXT_UNLIKELY(!isAlive()
+		|| restarting()
+		|| newOptions.noop
+		|| restartFileCheckDue(newOptions)))
+	{
+		return SessionPtr();
+	}
+
+	GroupLockGuard l(routingSyncher);
+	mergeOptions(newOptions);
+	if (OXT_UNLIKELY(!getWaitlist.empty() || shouldSpawnForGetAction())) {
+		return SessionPtr();
+	}
+
+	RouteResult result = route(newOptions);
+	if (result.process == NULL) {
+		return SessionPtr();
+	}
+
+	P_DEBUG("Session checked out from process " << result.process->inspect());
+	requestsArrived++;
+	SessionPtr session = newSession(result.process, newOptions.currentTime);
+	verifyInvariants();
+	return session;
+}
+
 SessionPtr
 Group::get(const Options &newOptions, const GetCallback &callback,
 	boost::container::vector<Callback> &postLockActions)
@@ -288,6 +388,8 @@ Group::get(const Options &newOptions, const GetCallback &callback,
 		return nullProcess->createSessionObject((Socket *) NULL);
 	}
 
+	requestsArrived++;
+
 	if (OXT_UNLIKELY(enabledCount == 0)) {
 		/* We don't have any processes yet, but they're on the way.
 		 *
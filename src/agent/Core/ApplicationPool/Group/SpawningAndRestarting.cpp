@@ -37,6 +37,17 @@ namespace ApplicationPool2 {
 using namespace std;
 using namespace boost;
 
+// How often the pool garbage collector runs updatePredictiveSpawning()
+// for groups that have predictive spawning enabled.
+static const unsigned long long PREDICTIVE_SPAWNING_INTERVAL = 2000000;
+// The fraction of their concurrency that processes are expected to be
+// busy with at the predicted arrival rate, in percent. The rest is headroom
+// for bursts.
+static const unsigned int PREDICTIVE_SPAWNING_TARGET_UTILIZATION = 75;
+// How long a process must have been idle before predictive spawning
+// shuts it down.
+static const unsigned long long PREDICTIVE_SPAWNING_MIN_IDLE_TIME = 10000000;
+
 
 /****************************
  *
@@ -112,7 +123,7 @@ Group::spawnThreadRealMain(const SpawningKit::SpawnerPtr &spawner,
 
 		UPDATE_TRACE_POINT();
 		ScopeGuard guard(boost::bind(Process::forceTriggerShutdownAndCleanup, process));
-		boost::unique_lock<boost::mutex> lock(pool->syncher);
+		PoolScopedLock lock(pool->syncher);
 
 		if (!isAlive()) {
 			if (process != NULL) {
@@ -145,7 +156,6 @@ Group::spawnThreadRealMain(const SpawningKit::SpawnerPtr &spawner,
 		assert(processesBeingSpawned > 0);
 
 		processesBeingSpawned--;
-		assert(processesBeingSpawned == 0);
 
 		UPDATE_TRACE_POINT();
 		boost::container::vector<Callback> actions;
@@ -153,6 +163,11 @@ Group::spawnThreadRealMain(const SpawningKit::SpawnerPtr &spawner,
 			AttachResult result = attach(process, actions);
 			if (result == AR_OK) {
 				guard.clear();
+				spawnBurstProcessCount++;
+				if (process->getSpawnDuration() > 0) {
+					spawnTimeAverage.update(process->getSpawnDuration(),
+						SystemTime::getUsec());
+				}
 				if (getWaitlist.empty()) {
 					pool->assignSessionsToGetWaiters(actions);
 				} else {
@@ -178,15 +193,19 @@ Group::spawnThreadRealMain(const SpawningKit::SpawnerPtr &spawner,
 			done = true;
 		}
 
-		done = done
-			|| (processLowerLimitsSatisfied() && getWaitlist.empty())
-			|| processUpperLimitsReached()
-			|| pool->atFullCapacityUnlocked();
-		m_spawning = !done;
+		done = done || !spawnLoopShouldContinue();
 		if (done) {
-			P_DEBUG("Spawn loop done");
+			if (processesBeingSpawned == 0) {
+				m_spawning = false;
+				finishSpawnBurst();
+				P_DEBUG("Spawn loop done");
+			} else {
+				P_DEBUG("Spawn loop thread done, " << processesBeingSpawned <<
+					" other spawns still in progress");
+			}
 		} else {
 			processesBeingSpawned++;
+			startMoreSpawnThreads();
 			P_DEBUG("Continue spawning");
 		}
 
@@ -203,6 +222,142 @@ Group::spawnThreadRealMain(const SpawningKit::SpawnerPtr &spawner,
 	}
 }
 
+void
+Group::startSpawnThread() {
+	interruptableThreads.create_thread(
+		boost::bind(&Group::spawnThreadMain,
+			this, shared_from_this(), spawner,
+			options.copyAndPersist().clearPerRequestFields(),
+			restartsInitiated),
+		"Group process spawner: " + info.name,
+		POOL_HELPER_THREAD_STACK_SIZE);
+	processesBeingSpawned++;
+}
+
+/**
+ * Starts additional spawner threads for as long as `options.spawnConcurrency`
+ * allows and there is demand for more processes than the ones that are already
+ * being spawned: either the lower limits are not satisfied yet, or there are
+ * more get waiters than processes being spawned.
+ */
+void
+Group::startMoreSpawnThreads() {
+	while ((unsigned int) processesBeingSpawned < options.spawnConcurrency
+		&& spawnLoopShouldContinue())
+	{
+		P_DEBUG("Starting additional spawner thread for group " << info.name <<
+			" (" << processesBeingSpawned << " spawns in progress)");
+		startSpawnThread();
+	}
+}
+
+/**
+ * Whether a spawner thread that just finished spawning a process should
+ * spawn another one. Processes that are still being spawned by other
+ * spawner threads count towards the limits, and each of them is expected
+ * to serve at least one get waiter. Predictive spawning may ask for more
+ * processes than the lower limits.
+ */
+bool
+Group::spawnLoopShouldContinue() const {
+	return (
+			!processLowerLimitsSatisfied()
+			|| getWaitlist.size() > (unsigned int) processesBeingSpawned
+			|| (unsigned int) capacityUsed() < predictedProcessCount
+		)
+		&& !processUpperLimitsReached()
+		&& !getPool()->atFullCapacityUnlocked();
+}
+
+void
+Group::finishSpawnBurst() {
+	unsigned long long now = SystemTime::getUsec();
+	if (now > spawnBurstStartTime) {
+		lastTimeToCapacity = now - spawnBurstStartTime;
+	} else {
+		lastTimeToCapacity = 0;
+	}
+	lastSpawnBurstProcessCount = spawnBurstProcessCount;
+	P_DEBUG("Spawning for group " << info.name << " done after " <<
+		(lastTimeToCapacity / 1000) << " msec, processes spawned: " <<
+		spawnBurstProcessCount);
+}
+
+/**
+ * Predicts how many processes this group needs to serve the requests that
+ * will arrive by the time a newly spawned process is ready. Returns 0 if no
+ * prediction can be made (yet).
+ *
+ * The arrival rate is extrapolated over the average spawn time using its
+ * recent trend. By Little's law, the number of requests being handled at
+ * the same time is the arrival rate times the average response time. We
+ * want enough processes to handle that at the target utilization.
+ */
+unsigned int
+Group::predictProcessCount(unsigned long long now) {
+	arrivalRateMeter.addSample(requestsArrived, now);
+	double arrivalRate = arrivalRateMeter.currentSpeed();
+	if (arrivalRate == SpeedMeter<double>::unknownSpeed() || arrivalRate < 0) {
+		return 0;
+	}
+
+	if (lastPredictionTime != 0 && now > lastPredictionTime) {
+		double trend = (arrivalRate - lastArrivalRate)
+			/ ((now - lastPredictionTime) / 1000000.0);
+		arrivalRateTrend = (arrivalRateTrend + trend) / 2;
+	}
+	lastArrivalRate = arrivalRate;
+	lastPredictionTime = now;
+
+	if (enabledCount == 0 || !responseTimeAverage.available()) {
+		return 0;
+	}
+	// Processes with unlimited concurrency never need company to handle
+	// more requests.
+	int concurrency = enabledProcesses[0]->getConcurrency();
+	if (concurrency == 0) {
+		return 0;
+	}
+
+	double leadTime = 0;
+	if (spawnTimeAverage.available()) {
+		leadTime = spawnTimeAverage.average() / 1000000.0;
+	}
+	double predictedArrivalRate = arrivalRate
+		+ std::max(0.0, arrivalRateTrend) * leadTime;
+	double concurrentRequests = predictedArrivalRate
+		* responseTimeAverage.average() / 1000000.0;
+	double result = ceil(concurrentRequests * 100
+		/ (concurrency * PREDICTIVE_SPAWNING_TARGET_UTILIZATION));
+
+	result = std::max(result, (double) options.minProcesses);
+	if (options.maxProcesses > 0) {
+		result = std::min(result, (double) options.maxProcesses);
+	}
+	return (unsigned int) std::min(result, (double) getPool()->max);
+}
+
+/**
+ * Returns the enabled process that has been idle for the longest time, if it
+ * has been idle for at least PREDICTIVE_SPAWNING_MIN_IDLE_TIME.
+ */
+Process *
+Group::findProcessToTrimPredictively(unsigned long long now) const {
+	Process *result = NULL;
+	ProcessList::const_iterator it, end = enabledProcesses.end();
+
+	for (it = enabledProcesses.begin(); it != end; it++) {
+		Process *process = it->get();
+		if (process->sessions == 0
+		 && now >= process->lastUsed + PREDICTIVE_SPAWNING_MIN_IDLE_TIME
+		 && (result == NULL || process->lastUsed < result->lastUsed))
+		{
+			result = process;
+		}
+	}
+	return result;
+}
+
 // The 'self' parameter is for keeping the current Group object alive while this thread is running.
 void
 Group::finalizeRestart(GroupPtr self,
@@ -238,7 +393,7 @@ Group::finalizeRestart(GroupPtr self,
 		debug->messages->recv("Finish restarting");
 	}
 
-	ScopedLock l(pool->syncher);
+	PoolScopedLock l(pool->syncher);
 	if (!isAlive()) {
 		P_DEBUG("Group " << getName() << " is shutting down, so aborting restart");
 		return;
@@ -407,6 +562,30 @@ Group::needsRestart(const Options &options) {
 	}
 }
 
+/**
+ * Whether needsRestart() would currently do anything other than return false
+ * without looking at the filesystem. The routing fast path uses this to
+ * leave restart file checks to get().
+ */
+bool
+Group::restartFileCheckDue(const Options &options) const {
+	if (m_restarting) {
+		return false;
+	} else {
+		time_t now;
+
+		if (options.currentTime != 0) {
+			now = options.currentTime / 1000000;
+		} else {
+			now = SystemTime::get();
+		}
+
+		return lastRestartFileCheckTime == 0
+			|| lastRestartFileCheckTime <= now - (time_t) options.statThrottleRate
+			|| alwaysRestartFileExists;
+	}
+}
+
 /**
  * Attempts to increase the number of processes by one, while respecting the
  * resource limits. That is, this method will ensure that there are at least
@@ -417,6 +596,7 @@ SpawnResult
 Group::spawn() {
 	assert(isAlive());
 	if (m_spawning) {
+		startMoreSpawnThreads();
 		return SR_IN_PROGRESS;
 	} else if (restarting()) {
 		return SR_ERR_RESTARTING;
@@ -426,15 +606,11 @@ Group::spawn() {
 		return SR_ERR_POOL_AT_FULL_CAPACITY;
 	} else {
 		P_DEBUG("Requested spawning of new process for group " << info.name);
-		interruptableThreads.create_thread(
-			boost::bind(&Group::spawnThreadMain,
-				this, shared_from_this(), spawner,
-				options.copyAndPersist().clearPerRequestFields(),
-				restartsInitiated),
-			"Group process spawner: " + info.name,
-			POOL_HELPER_THREAD_STACK_SIZE);
 		m_spawning = true;
-		processesBeingSpawned++;
+		spawnBurstStartTime = SystemTime::getUsec();
+		spawnBurstProcessCount = 0;
+		startSpawnThread();
+		startMoreSpawnThreads();
 		return SR_OK;
 	}
 }
@@ -463,6 +639,117 @@ Group::shouldSpawnForGetAction() const {
 	return enabledCount == 0 || shouldSpawn();
 }
 
+/**
+ * Spawns or shuts down processes ahead of demand if `options.predictiveSpawning`
+ * is set. Called periodically by the pool garbage collector. At most one
+ * process is shut down per call, so that the group shrinks gradually.
+ * Returns the time at which this should be called again, or 0 if predictive
+ * spawning is disabled.
+ */
+unsigned long long
+Group::updatePredictiveSpawning(unsigned long long now,
+	boost::container::vector<Callback> &postLockActions)
+{
+	if (!options.predictiveSpawning || !isAlive()) {
+		predictedProcessCount = 0;
+		return 0;
+	}
+
+	predictedProcessCount = predictProcessCount(now);
+	if (predictedProcessCount == 0 || restarting()) {
+		return now + PREDICTIVE_SPAWNING_INTERVAL;
+	}
+
+	if ((unsigned int) capacityUsed() < predictedProcessCount) {
+		P_DEBUG("Predictive spawning: group " << info.name << " needs " <<
+			predictedProcessCount << " processes, has " << capacityUsed());
+		spawn();
+	} else if ((unsigned int) getProcessCount() > predictedProcessCount
+		&& !m_spawning
+		&& getWaitlist.empty())
+	{
+		Process *process = findProcessToTrimPredictively(now);
+		if (process != NULL) {
+			P_DEBUG("Predictive spawning: group " << info.name << " needs " <<
+				predictedProcessCount << " processes, shutting down idle process " <<
+				process->inspect());
+			detach(process->shared_from_this(), postLockActions);
+		}
+	}
+
+	return now + PREDICTIVE_SPAWNING_INTERVAL;
+}
+
+/**
+ * Enforces `options.memoryLimit`. Called by the pool after it has updated
+ * the process metrics. Returns the process that should be gracefully
+ * detached because it uses more memory than allowed, or NULL if there is
+ * none, or if it isn't time yet to detach it.
+ *
+ * Processes are replaced one at a time, the heaviest first. A process is
+ * only detached after a replacement has been spawned, so that the group
+ * never drops below its current capacity. If no replacement can be spawned
+ * right now, e.g. because the pool is full, then the process is kept and
+ * we try again the next time the metrics are updated.
+ */
+ProcessPtr
+Group::findProcessToRecycleForMemory() {
+	if (options.memoryLimit == 0 || !isAlive() || restarting()) {
+		memoryRecyclingTarget = 0;
+		return ProcessPtr();
+	}
+
+	size_t limit = (size_t) options.memoryLimit * 1024;
+	Process *result = NULL;
+	ProcessList::const_iterator it, end = enabledProcesses.end();
+
+	for (it = enabledProcesses.begin(); it != end; it++) {
+		Process *process = it->get();
+		if (process->metrics.isValid()
+		 && process->metrics.realMemory() > limit
+		 && (result == NULL
+		  || process->metrics.realMemory() > result->metrics.realMemory()))
+		{
+			result = process;
+		}
+	}
+	if (result == NULL) {
+		memoryRecyclingTarget = 0;
+		return ProcessPtr();
+	}
+
+	if (memoryRecyclingTarget != 0) {
+		if ((unsigned int) enabledCount >= memoryRecyclingTarget) {
+			memoryRecyclingTarget = 0;
+			P_INFO("Process " << result->inspect() << " uses " <<
+				result->metrics.realMemory() / 1024 << " MB, which is more than the "
+				"memory limit of " << options.memoryLimit << " MB. Shutting it down "
+				"now that its replacement has been spawned");
+			return result->shared_from_this();
+		} else if (m_spawning) {
+			// Wait for the replacement process.
+			return ProcessPtr();
+		} else {
+			// Spawning has finished (or failed) without adding a
+			// process, so start over.
+			memoryRecyclingTarget = 0;
+		}
+	}
+
+	if (!m_spawning && allowSpawn()) {
+		P_INFO("Process " << result->inspect() << " uses " <<
+			result->metrics.realMemory() / 1024 << " MB, which is more than the "
+			"memory limit of " << options.memoryLimit << " MB. Spawning a "
+			"replacement process before shutting it down");
+		memoryRecyclingTarget = enabledCount + 1;
+		spawn();
+	} else {
+		P_DEBUG("Process " << result->inspect() << " is over the memory limit, "
+			"but no replacement process can be spawned right now");
+	}
+	return ProcessPtr();
+}
+
 /**
  * Whether a new process is allowed to be spawned for this group,
  * i.e. whether the upper processes limits have not been reached.
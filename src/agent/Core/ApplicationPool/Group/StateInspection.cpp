@@ -135,6 +135,26 @@ Group::inspectXml(std::ostream &stream, bool includeSecrets) const {
 	stream << "<get_wait_list_size>" << getWaitlist.size() << "</get_wait_list_size>";
 	stream << "<disable_wait_list_size>" << disableWaitlist.size() << "</disable_wait_list_size>";
 	stream << "<processes_being_spawned>" << processesBeingSpawned << "</processes_being_spawned>";
+	stream << "<time_to_capacity>" << lastTimeToCapacity << "</time_to_capacity>";
+	stream << "<last_spawn_burst_process_count>" << lastSpawnBurstProcessCount << "</last_spawn_burst_process_count>";
+	if (options.predictiveSpawning) {
+		stream << "<predictive_spawning>";
+		stream << "<predicted_process_count>" << predictedProcessCount << "</predicted_process_count>";
+		stream << "<arrival_rate>" << lastArrivalRate << "</arrival_rate>";
+		stream << "<arrival_rate_trend>" << arrivalRateTrend << "</arrival_rate_trend>";
+		if (responseTimeAverage.available()) {
+			stream << "<response_time_average>" << (unsigned long long) responseTimeAverage.average()
+				<< "</response_time_average>";
+		}
+		if (spawnTimeAverage.available()) {
+			stream << "<spawn_time_average>" << (unsigned long long) spawnTimeAverage.average()
+				<< "</spawn_time_average>";
+		}
+		stream << "</predictive_spawning>";
+	}
+	stream << "<routing_lock>";
+	routingSyncher.getStats().inspectXml(stream);
+	stream << "</routing_lock>";
 	if (m_spawning) {
 		stream << "<spawning/>";
 	}
@@ -264,6 +284,11 @@ Group::inspectConfigInAdminPanelFormat(Json::Value &result) const {
 	result["max_requests"] = VAL((Json::UInt) options.maxRequests, 0u);
 	result["abort_websockets_on_process_shutdown"] = VAL(options.abortWebsocketsOnProcessShutdown);
 	result["force_max_concurrent_requests_per_process"] = VAL(options.forceMaxConcurrentRequestsPerProcess, -1);
+	result["routing_strategy"] = SVAL(getRoutingStrategyString(options.routingStrategy),
+		P_STATIC_STRING("lowest_busyness"));
+	result["spawn_concurrency"] = VAL(options.spawnConcurrency, 1u);
+	result["predictive_spawning"] = VAL(options.predictiveSpawning, false);
+	result["memory_limit"] = VAL(options.memoryLimit, 0u);
 	result["restart_dir"] = NON_EMPTY_SVAL(options.restartDir);
 
 	if (!options.environmentVariables.empty()) {
@@ -91,6 +91,7 @@ Group::verifyInvariants() const {
 
 	// Verify list sizes.
 	assert((int) enabledProcesses.size() == enabledCount);
+	assert(enabledProcessBusynessLevels.size() == enabledProcesses.size());
 	assert((int) disablingProcesses.size() == disablingCount);
 	assert((int) disabledProcesses.size() == disabledCount);
 	assert(nEnabledProcessesTotallyBusy <= enabledCount);
@@ -113,6 +114,7 @@ Group::verifyExpensiveInvariants() const {
 		const ProcessPtr &process = *it;
 		assert(process->enabled == Process::ENABLED);
 		assert(process->isAlive());
+		assert(enabledProcessBusynessLevels.get(process->getIndex()) == process->busyness());
 		assert(process->oobwStatus == Process::OOBW_NOT_ACTIVE
 			|| process->oobwStatus == Process::OOBW_REQUESTED);
 	}
@@ -46,6 +46,51 @@ namespace ApplicationPool2 {
 using namespace std;
 using namespace boost;
 
+
+/**
+ * Determines how Group::route() picks a process among the enabled processes.
+ */
+enum RoutingStrategy {
+	// Pick the process with the lowest busyness.
+	RS_LOWEST_BUSYNESS,
+	// Pick two random processes and route to the least busy one of the two.
+	RS_POWER_OF_TWO_CHOICES,
+	// Pick the process with the lowest expected latency, based on a moving
+	// average of its response times and the number of requests it is
+	// currently handling.
+	RS_LEAST_LATENCY,
+
+	RS_UNKNOWN
+};
+
+inline RoutingStrategy
+parseRoutingStrategy(const StaticString &name) {
+	if (name == P_STATIC_STRING("lowest_busyness")) {
+		return RS_LOWEST_BUSYNESS;
+	} else if (name == P_STATIC_STRING("power_of_two_choices")) {
+		return RS_POWER_OF_TWO_CHOICES;
+	} else if (name == P_STATIC_STRING("least_latency")) {
+		return RS_LEAST_LATENCY;
+	} else {
+		return RS_UNKNOWN;
+	}
+}
+
+inline StaticString
+getRoutingStrategyString(RoutingStrategy strategy) {
+	switch (strategy) {
+	case RS_LOWEST_BUSYNESS:
+		return P_STATIC_STRING("lowest_busyness");
+	case RS_POWER_OF_TWO_CHOICES:
+		return P_STATIC_STRING("power_of_two_choices");
+	case RS_LEAST_LATENCY:
+		return P_STATIC_STRING("least_latency");
+	default:
+		return P_STATIC_STRING("unknown");
+	}
+}
+
+
 /**
  * This struct encapsulates information for ApplicationPool::get() and for
  * Spawner::spawn(), such as which application is to be spawned.
@@ -369,6 +414,33 @@ public:
 	 */
 	bool abortWebsocketsOnProcessShutdown;
 
+	/**
+	 * How requests are distributed over the group's processes.
+	 * See `RoutingStrategy` for the available strategies.
+	 */
+	RoutingStrategy routingStrategy;
+
+	/**
+	 * The maximum number of processes that the group may be spawning
+	 * at the same time. The default of 1 spawns processes one after
+	 * another.
+	 */
+	unsigned int spawnConcurrency;
+
+	/**
+	 * Whether processes are spawned and shut down ahead of demand, based on
+	 * the group's request arrival rate and response times. See
+	 * Group::updatePredictiveSpawning().
+	 */
+	bool predictiveSpawning;
+
+	/**
+	 * The maximum amount of memory, in MB, that a process may use before
+	 * it is gracefully replaced. A value of 0 means unlimited. See
+	 * Group::findProcessToRecycleForMemory().
+	 */
+	unsigned int memoryLimit;
+
 	/**
 	 * The Union Station key to use in case analytics logging is enabled.
 	 * It is used by Pool::collectAnalytics() and other administrative
@@ -495,6 +567,10 @@ public:
 		  maxOutOfBandWorkInstances(1),
 		  maxRequestQueueSize(DEFAULT_MAX_REQUEST_QUEUE_SIZE),
 		  abortWebsocketsOnProcessShutdown(true),
+		  routingStrategy(RS_LOWEST_BUSYNESS),
+		  spawnConcurrency(1),
+		  predictiveSpawning(false),
+		  memoryLimit(0),
 
 		  stickySessionId(0),
 		  statThrottleRate(DEFAULT_STAT_THROTTLE_RATE),
@@ -632,6 +708,10 @@ public:
 			appendKeyValue3(vec, "max_processes",       maxProcesses);
 			appendKeyValue2(vec, "max_preloader_idle_time", maxPreloaderIdleTime);
 			appendKeyValue3(vec, "max_out_of_band_work_instances", maxOutOfBandWorkInstances);
+			appendKeyValue (vec, "routing_strategy",    getRoutingStrategyString(routingStrategy));
+			appendKeyValue3(vec, "spawn_concurrency",   spawnConcurrency);
+			appendKeyValue4(vec, "predictive_spawning", predictiveSpawning);
+			appendKeyValue3(vec, "memory_limit",        memoryLimit);
 		}
 		if ((fields & SPAWN_OPTIONS) || (fields & PER_GROUP_POOL_OPTIONS)) {
 			appendKeyValue (vec, "union_station_key",   unionStationKey);
@@ -61,6 +61,7 @@
 #include <Utils/SystemMetricsCollector.h>
 #include <Core/UnionStation/StopwatchLog.h>
 #include <Core/ApplicationPool/Common.h>
+#include <Core/ApplicationPool/PoolLock.h>
 #include <Core/ApplicationPool/Context.h>
 #include <Core/ApplicationPool/Process.h>
 #include <Core/ApplicationPool/Group.h>
@@ -206,7 +207,7 @@ public:
 	friend class Process;
 	friend struct tut::ApplicationPool2_PoolTest;
 
-	mutable boost::mutex syncher;
+	mutable PoolMutex syncher;
 	unsigned int max;
 	unsigned long long maxIdleTime;
 	bool selfchecking;
@@ -322,6 +323,7 @@ public:
 		string data;
 	};
 
+	ProcessMetricsCollector processMetricsCollector;
 	SystemMetricsCollector systemMetricsCollector;
 	SystemMetrics systemMetrics;
 
@@ -346,7 +348,7 @@ public:
 		boost::container::vector<Callback> actions;
 	};
 
-	boost::condition_variable garbageCollectionCond;
+	boost::condition_variable_any garbageCollectionCond;
 
 	void initializeGarbageCollection();
 	static void garbageCollect(PoolPtr self);
@@ -158,13 +158,13 @@ Pool::realCollectAnalytics() {
 	// Collect all the PIDs.
 	{
 		UPDATE_TRACE_POINT();
-		LockGuard l(syncher);
+		PoolLockGuard l(syncher);
 		max = this->max;
 	}
 	pids.reserve(max);
 	{
 		UPDATE_TRACE_POINT();
-		LockGuard l(syncher);
+		PoolLockGuard l(syncher);
 		GroupMap::ConstIterator g_it(groups);
 
 		while (*g_it != NULL) {
@@ -182,7 +182,7 @@ Pool::realCollectAnalytics() {
 	try {
 		UPDATE_TRACE_POINT();
 		P_DEBUG("Collecting process metrics");
-		processMetrics = ProcessMetricsCollector().collect(pids);
+		processMetrics = processMetricsCollector.collect(pids);
 	} catch (const ParseException &) {
 		P_WARN("Unable to collect process metrics: cannot parse 'ps' output.");
 		return;
@@ -201,7 +201,7 @@ Pool::realCollectAnalytics() {
 		vector<UnionStationLogEntry> logEntries;
 		vector<ProcessPtr> processesToDetach;
 		boost::container::vector<Callback> actions;
-		ScopedLock l(syncher);
+		PoolScopedLock l(syncher);
 		GroupMap::ConstIterator g_it(groups);
 
 		UPDATE_TRACE_POINT();
@@ -222,6 +222,24 @@ Pool::realCollectAnalytics() {
 		UPDATE_TRACE_POINT();
 		processesToDetach.clear();
 
+		// Enforce memory limits now that the metrics are up to date.
+		UPDATE_TRACE_POINT();
+		GroupMap::ConstIterator g_it2(groups);
+		while (*g_it2 != NULL) {
+			const GroupPtr &group = g_it2.getValue();
+			ProcessPtr process = group->findProcessToRecycleForMemory();
+			if (process != NULL) {
+				processesToDetach.push_back(process);
+			}
+			g_it2.next();
+		}
+		UPDATE_TRACE_POINT();
+		foreach (const ProcessPtr process, processesToDetach) {
+			detachProcessUnlocked(process, actions);
+		}
+		UPDATE_TRACE_POINT();
+		processesToDetach.clear();
+
 		l.unlock();
 		UPDATE_TRACE_POINT();
 		if (!logEntries.empty()) {
@@ -51,7 +51,7 @@ void
 Pool::garbageCollect(PoolPtr self) {
 	TRACE_POINT();
 	{
-		ScopedLock lock(self->syncher);
+		PoolScopedLock lock(self->syncher);
 		self->garbageCollectionCond.timed_wait(lock,
 			posix_time::seconds(5));
 	}
@@ -60,7 +60,7 @@ Pool::garbageCollect(PoolPtr self) {
 			UPDATE_TRACE_POINT();
 			unsigned long long sleepTime = self->realGarbageCollect();
 			UPDATE_TRACE_POINT();
-			ScopedLock lock(self->syncher);
+			PoolScopedLock lock(self->syncher);
 			self->garbageCollectionCond.timed_wait(lock,
 				posix_time::microseconds(sleepTime));
 		} catch (const thread_interrupted &) {
@@ -141,7 +141,7 @@ Pool::maybeCleanPreloader(GarbageCollectorState &state, const GroupPtr &group) {
 unsigned long long
 Pool::realGarbageCollect() {
 	TRACE_POINT();
-	ScopedLock lock(syncher);
+	PoolScopedLock lock(syncher);
 	GroupMap::ConstIterator g_it(groups);
 	GarbageCollectorState state;
 	state.now = SystemTime::getUsec();
@@ -159,6 +159,13 @@ Pool::realGarbageCollect() {
 			garbageCollectProcessesInGroup(state, group);
 		}
 
+		// ...spawn or shut down processes ahead of demand.
+		unsigned long long predictionTime = group->updatePredictiveSpawning(
+			state.now, state.actions);
+		if (predictionTime != 0) {
+			maybeUpdateNextGcRuntime(state, predictionTime);
+		}
+
 		group->verifyInvariants();
 
 		// ...cleanup the spawner if it's been idle for more than preloaderIdleTime.
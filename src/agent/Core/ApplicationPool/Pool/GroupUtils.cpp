@@ -145,7 +145,7 @@ Pool::findOrCreateGroup(const Options &options) {
 
 	Ticket ticket;
 	{
-		LockGuard l(syncher);
+		PoolLockGuard l(syncher);
 		GroupPtr *group;
 		if (!groups.lookup(options.getAppGroupName(), &group)) {
 			// Forcefully create Group, don't care whether resource limits
@@ -158,7 +158,7 @@ Pool::findOrCreateGroup(const Options &options) {
 
 GroupPtr
 Pool::findGroupByApiKey(const StaticString &value, bool lock) const {
-	DynamicScopedLock l(syncher, lock);
+	DynamicPoolScopedLock l(syncher, lock);
 	GroupMap::ConstIterator g_it(groups);
 	while (*g_it != NULL) {
 		const GroupPtr &group = g_it.getValue();
@@ -173,7 +173,7 @@ Pool::findGroupByApiKey(const StaticString &value, bool lock) const {
 bool
 Pool::detachGroupByName(const HashedStaticString &name) {
 	TRACE_POINT();
-	ScopedLock l(syncher);
+	PoolScopedLock l(syncher);
 	GroupPtr group = groups.lookupCopy(name);
 
 	if (OXT_LIKELY(group != NULL)) {
@@ -216,7 +216,7 @@ Pool::detachGroupByName(const HashedStaticString &name) {
 
 bool
 Pool::detachGroupByApiKey(const StaticString &value) {
-	ScopedLock l(syncher);
+	PoolScopedLock l(syncher);
 	GroupPtr group = findGroupByApiKey(value, false);
 	if (group != NULL) {
 		string name = group->getName();
@@ -230,7 +230,7 @@ Pool::detachGroupByApiKey(const StaticString &value) {
 
 bool
 Pool::restartGroupByName(const StaticString &name, const RestartOptions &options) {
-	ScopedLock l(syncher);
+	PoolScopedLock l(syncher);
 	GroupMap::ConstIterator g_it(groups);
 	while (*g_it != NULL) {
 		const GroupPtr &group = g_it.getValue();
@@ -253,7 +253,7 @@ Pool::restartGroupByName(const StaticString &name, const RestartOptions &options
 
 unsigned int
 Pool::restartGroupsByAppRoot(const StaticString &appRoot, const RestartOptions &options) {
-	ScopedLock l(syncher);
+	PoolScopedLock l(syncher);
 	GroupMap::ConstIterator g_it(groups);
 	unsigned int result = 0;
 
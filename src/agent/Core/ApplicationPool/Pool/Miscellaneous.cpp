@@ -42,7 +42,26 @@ using namespace boost;
 // should never call the callback while holding the lock.
 void
 Pool::asyncGet(const Options &options, const GetCallback &callback, bool lockNow, UnionStation::StopwatchLog **stopwatchLog) {
-	DynamicScopedLock lock(syncher, lockNow);
+	if (OXT_LIKELY(lockNow && stopwatchLog == NULL)) {
+		/* Fast path: the group exists and one of its processes can handle
+		 * the request right away. This only needs the pool lock in shared
+		 * mode, so requests for different groups, and the bookkeeping for
+		 * requests within a group, don't wait for each other.
+		 */
+		PoolSharedLock sharedLock(syncher);
+		Group *existingGroup = findMatchingGroup(options);
+		if (OXT_LIKELY(existingGroup != NULL && lifeStatus == ALIVE)) {
+			SessionPtr session = existingGroup->getWithSharedPoolLock(options);
+			if (session != NULL) {
+				sharedLock.unlock();
+				P_TRACE(2, "asyncGet() finished through the fast path");
+				callback(session, ExceptionPtr());
+				return;
+			}
+		}
+	}
+
+	DynamicPoolScopedLock lock(syncher, lockNow);
 
 	assert(lifeStatus == ALIVE || lifeStatus == PREPARED_FOR_SHUTDOWN);
 	verifyInvariants();
@@ -193,7 +212,7 @@ Pool::get(const Options &options, Ticket *ticket) {
 
 void
 Pool::setMax(unsigned int max) {
-	ScopedLock l(syncher);
+	PoolScopedLock l(syncher);
 	assert(max > 0);
 	fullVerifyInvariants();
 	bool bigger = max > this->max;
@@ -222,14 +241,14 @@ Pool::setMax(unsigned int max) {
 
 void
 Pool::setMaxIdleTime(unsigned long long value) {
-	LockGuard l(syncher);
+	PoolLockGuard l(syncher);
 	maxIdleTime = value;
 	wakeupGarbageCollector();
 }
 
 void
 Pool::enableSelfChecking(bool enabled) {
-	LockGuard l(syncher);
+	PoolLockGuard l(syncher);
 	selfchecking = enabled;
 }
 
@@ -238,7 +257,7 @@ Pool::enableSelfChecking(bool enabled) {
  */
 bool
 Pool::isSpawning(bool lock) const {
-	DynamicScopedLock l(syncher, lock);
+	DynamicPoolScopedLock l(syncher, lock);
 	GroupMap::ConstIterator g_it(groups);
 	while (*g_it != NULL) {
 		const GroupPtr &group = g_it.getValue();
@@ -252,7 +271,7 @@ Pool::isSpawning(bool lock) const {
 
 void
 Pool::setAgentConfig(const Json::Value &agentConfig) {
-	LockGuard l(syncher);
+	PoolLockGuard l(syncher);
 	this->agentConfig = agentConfig;
 }
 
@@ -267,7 +286,7 @@ Pool::authorizeByUid(uid_t uid, bool lock) const {
 		return true;
 	}
 
-	DynamicScopedLock l(syncher, lock);
+	DynamicPoolScopedLock l(syncher, lock);
 	GroupMap::ConstIterator g_it(groups);
 	while (*g_it != NULL) {
 		const GroupPtr &group = g_it.getValue();
@@ -125,7 +125,7 @@ Pool::inspectProcessList(const InspectOptions &options, stringstream &result,
 
 string
 Pool::inspect(const InspectOptions &options, bool lock) const {
-	DynamicScopedLock l(syncher, lock);
+	DynamicPoolScopedLock l(syncher, lock);
 	stringstream result;
 	const char *headerColor = maybeColorize(options, ANSI_COLOR_YELLOW ANSI_COLOR_BLUE_BG ANSI_COLOR_BOLD);
 	const char *resetColor  = maybeColorize(options, ANSI_COLOR_RESET);
@@ -176,6 +176,10 @@ Pool::inspect(const InspectOptions &options, bool lock) const {
 					maybePluralize(group->processesBeingSpawned, "process", "processes") <<
 					"...)" << endl;
 			}
+		} else if (group->lastSpawnBurstProcessCount > 0) {
+			result << "  Last spawned " << group->lastSpawnBurstProcessCount << " " <<
+				maybePluralize(group->lastSpawnBurstProcessCount, "process", "processes") <<
+				" in " << (group->lastTimeToCapacity / 1000) << " msec" << endl;
 		}
 		result << "  Requests in queue: " << group->getWaitlist.size() << endl;
 		inspectProcessList(options, result, group.get(), group->enabledProcesses);
@@ -191,7 +195,7 @@ Pool::inspect(const InspectOptions &options, bool lock) const {
 
 string
 Pool::toXml(const ToXmlOptions &options, bool lock) const {
-	DynamicScopedLock l(syncher, lock);
+	DynamicPoolScopedLock l(syncher, lock);
 	stringstream result;
 	GroupMap::ConstIterator g_it(groups);
 	ProcessList::const_iterator p_it;
@@ -211,6 +215,9 @@ Pool::toXml(const ToXmlOptions &options, bool lock) const {
 	result << "<max>" << max << "</max>";
 	result << "<capacity_used>" << capacityUsedUnlocked() << "</capacity_used>";
 	result << "<get_wait_list_size>" << getWaitlist.size() << "</get_wait_list_size>";
+	result << "<pool_lock>";
+	syncher.inspectXml(result);
+	result << "</pool_lock>";
 
 	if (options.secrets) {
 		vector<GetWaiter>::const_iterator w_it, w_end = getWaitlist.end();
@@ -260,7 +267,7 @@ Pool::toXml(const ToXmlOptions &options, bool lock) const {
 
 Json::Value
 Pool::inspectPropertiesInAdminPanelFormat(const ToJsonOptions &options) const {
-	ScopedLock l(syncher);
+	PoolScopedLock l(syncher);
 	Json::Value result(Json::objectValue);
 	GroupMap::ConstIterator g_it(groups);
 	ProcessList::const_iterator p_it;
@@ -301,7 +308,7 @@ Pool::inspectPropertiesInAdminPanelFormat(const ToJsonOptions &options) const {
 
 Json::Value
 Pool::inspectConfigInAdminPanelFormat(const ToJsonOptions &options) const {
-	ScopedLock l(syncher);
+	PoolScopedLock l(syncher);
 	Json::Value result(Json::objectValue);
 	GroupMap::ConstIterator g_it(groups);
 	ProcessList::const_iterator p_it;
@@ -390,13 +397,13 @@ Pool::makeSingleNonEmptyStrValueJsonConfigFormat(const StaticString &val) {
 
 unsigned int
 Pool::capacityUsed() const {
-	LockGuard l(syncher);
+	PoolLockGuard l(syncher);
 	return capacityUsedUnlocked();
 }
 
 bool
 Pool::atFullCapacity() const {
-	LockGuard l(syncher);
+	PoolLockGuard l(syncher);
 	return atFullCapacityUnlocked();
 }
 
@@ -407,7 +414,7 @@ Pool::atFullCapacity() const {
  */
 unsigned int
 Pool::getProcessCount(bool lock) const {
-	DynamicScopedLock l(syncher, lock);
+	DynamicPoolScopedLock l(syncher, lock);
 	unsigned int result = 0;
 	GroupMap::ConstIterator g_it(groups);
 	while (*g_it != NULL) {
@@ -420,7 +427,7 @@ Pool::getProcessCount(bool lock) const {
 
 unsigned int
 Pool::getGroupCount() const {
-	LockGuard l(syncher);
+	PoolLockGuard l(syncher);
 	return groups.size();
 }
 
@@ -0,0 +1,270 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_APPLICATION_POOL2_POOL_LOCK_H_
+#define _PASSENGER_APPLICATION_POOL2_POOL_LOCK_H_
+
+#include <boost/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <oxt/macros.hpp>
+#include <Utils/SystemTime.h>
+
+namespace Passenger {
+namespace ApplicationPool2 {
+
+using namespace std;
+using namespace boost;
+
+
+/**
+ * How often a lock has been acquired, how long threads had to wait for it and
+ * how long it was held. Times are in microseconds.
+ *
+ * Not thread-safe: the owner of a LockStats object only updates it while holding
+ * the lock that it describes.
+ */
+struct LockStats {
+	boost::uint64_t acquisitions;
+	/** Number of acquisitions for which the lock was not immediately available. */
+	boost::uint64_t contendedAcquisitions;
+	boost::uint64_t totalWaitTime;
+	boost::uint64_t maxWaitTime;
+	boost::uint64_t totalHoldTime;
+	boost::uint64_t maxHoldTime;
+
+	LockStats()
+		: acquisitions(0),
+		  contendedAcquisitions(0),
+		  totalWaitTime(0),
+		  maxWaitTime(0),
+		  totalHoldTime(0),
+		  maxHoldTime(0)
+		{ }
+
+	static MonotonicTimeUsec now() {
+		// Called from unlock(), which must not throw. The monotonic clock
+		// practically never fails, so a failure just results in a bogus sample.
+		try {
+			return SystemTime::getMonotonicUsec();
+		} catch (const TimeRetrievalException &) {
+			return 0;
+		}
+	}
+
+	void recordAcquisition() {
+		acquisitions++;
+	}
+
+	void recordContendedAcquisition(MonotonicTimeUsec waitTime) {
+		acquisitions++;
+		contendedAcquisitions++;
+		totalWaitTime += waitTime;
+		maxWaitTime = std::max<boost::uint64_t>(maxWaitTime, waitTime);
+	}
+
+	void recordRelease(MonotonicTimeUsec holdTime) {
+		totalHoldTime += holdTime;
+		maxHoldTime = std::max<boost::uint64_t>(maxHoldTime, holdTime);
+	}
+
+	template<typename Stream>
+	void inspectXml(Stream &stream) const {
+		stream << "<acquisitions>" << acquisitions << "</acquisitions>";
+		stream << "<contended_acquisitions>" << contendedAcquisitions << "</contended_acquisitions>";
+		stream << "<total_wait_time>" << totalWaitTime << "</total_wait_time>";
+		stream << "<max_wait_time>" << maxWaitTime << "</max_wait_time>";
+		stream << "<total_hold_time>" << totalHoldTime << "</total_hold_time>";
+		stream << "<max_hold_time>" << maxHoldTime << "</max_hold_time>";
+	}
+};
+
+
+/**
+ * The lock that protects a Pool and all its Groups, Processes and Sockets.
+ *
+ * Almost all pool code locks it exclusively. Only the request routing fast
+ * path (Pool::asyncGet() and Group::onSessionClose() when nothing but a
+ * Group's routing state changes) locks it in shared mode, and then also
+ * locks that Group's `routingSyncher`. So while you hold this lock
+ * exclusively, you own everything in the pool, just like before there was
+ * a shared mode.
+ *
+ * Exclusive acquisitions are instrumented, so that the effect of moving work
+ * to (or from) the fast path can be seen in the pool's XML state.
+ */
+class PoolMutex {
+private:
+	boost::shared_mutex mutex;
+	MonotonicTimeUsec lockedAt;
+	LockStats exclusiveStats;
+	boost::atomic<boost::uint64_t> contendedSharedAcquisitions;
+	boost::atomic<boost::uint64_t> sharedWaitTime;
+
+public:
+	PoolMutex()
+		: lockedAt(0),
+		  contendedSharedAcquisitions(0),
+		  sharedWaitTime(0)
+		{ }
+
+	void lock() {
+		if (OXT_LIKELY(mutex.try_lock())) {
+			lockedAt = LockStats::now();
+			exclusiveStats.recordAcquisition();
+		} else {
+			MonotonicTimeUsec begin = LockStats::now();
+			mutex.lock();
+			lockedAt = LockStats::now();
+			exclusiveStats.recordContendedAcquisition(lockedAt - begin);
+		}
+	}
+
+	bool try_lock() {
+		if (mutex.try_lock()) {
+			lockedAt = LockStats::now();
+			exclusiveStats.recordAcquisition();
+			return true;
+		} else {
+			return false;
+		}
+	}
+
+	void unlock() {
+		exclusiveStats.recordRelease(LockStats::now() - lockedAt);
+		mutex.unlock();
+	}
+
+	void lock_shared() {
+		if (OXT_UNLIKELY(!mutex.try_lock_shared())) {
+			MonotonicTimeUsec begin = LockStats::now();
+			mutex.lock_shared();
+			contendedSharedAcquisitions.fetch_add(1, boost::memory_order_relaxed);
+			sharedWaitTime.fetch_add(LockStats::now() - begin, boost::memory_order_relaxed);
+		}
+	}
+
+	bool try_lock_shared() {
+		return mutex.try_lock_shared();
+	}
+
+	void unlock_shared() {
+		mutex.unlock_shared();
+	}
+
+	/**
+	 * Only call while holding the lock exclusively.
+	 */
+	template<typename Stream>
+	void inspectXml(Stream &stream) const {
+		stream << "<exclusive>";
+		exclusiveStats.inspectXml(stream);
+		stream << "</exclusive>";
+		stream << "<shared>";
+		stream << "<contended_acquisitions>"
+			<< contendedSharedAcquisitions.load(boost::memory_order_relaxed)
+			<< "</contended_acquisitions>";
+		stream << "<total_wait_time>"
+			<< sharedWaitTime.load(boost::memory_order_relaxed)
+			<< "</total_wait_time>";
+		stream << "</shared>";
+	}
+};
+
+
+/**
+ * A mutex that keeps LockStats. Used for Group::routingSyncher.
+ */
+class GroupMutex {
+private:
+	boost::mutex mutex;
+	MonotonicTimeUsec lockedAt;
+	LockStats stats;
+
+public:
+	GroupMutex()
+		: lockedAt(0)
+		{ }
+
+	void lock() {
+		if (OXT_LIKELY(mutex.try_lock())) {
+			lockedAt = LockStats::now();
+			stats.recordAcquisition();
+		} else {
+			MonotonicTimeUsec begin = LockStats::now();
+			mutex.lock();
+			lockedAt = LockStats::now();
+			stats.recordContendedAcquisition(lockedAt - begin);
+		}
+	}
+
+	bool try_lock() {
+		if (mutex.try_lock()) {
+			lockedAt = LockStats::now();
+			stats.recordAcquisition();
+			return true;
+		} else {
+			return false;
+		}
+	}
+
+	void unlock() {
+		stats.recordRelease(LockStats::now() - lockedAt);
+		mutex.unlock();
+	}
+
+	/**
+	 * Only call while holding the pool lock exclusively (which guarantees
+	 * that nobody holds this lock).
+	 */
+	const LockStats &getStats() const {
+		return stats;
+	}
+};
+
+
+typedef boost::lock_guard<PoolMutex> PoolLockGuard;
+typedef boost::unique_lock<PoolMutex> PoolScopedLock;
+typedef boost::shared_lock<PoolMutex> PoolSharedLock;
+typedef boost::lock_guard<GroupMutex> GroupLockGuard;
+
+/** Like DynamicScopedLock, but for a PoolMutex. */
+class DynamicPoolScopedLock: public PoolScopedLock {
+public:
+	DynamicPoolScopedLock(PoolMutex &m, bool lockNow = true)
+		: PoolScopedLock(m, boost::defer_lock)
+	{
+		if (lockNow) {
+			lock();
+		}
+	}
+};
+
+
+} // namespace ApplicationPool2
+} // namespace Passenger
+
+#endif /* _PASSENGER_APPLICATION_POOL2_POOL_LOCK_H_ */
@@ -42,6 +42,7 @@
 #include <cstring>
 #include <Constants.h>
 #include <FileDescriptor.h>
+#include <Algorithms/MovingAverage.h>
 #include <LoggingKit/LoggingKit.h>
 #include <Utils/SystemTime.h>
 #include <Utils/StrIntUtils.h>
@@ -368,6 +369,13 @@ public:
 	int sessions;
 	/** Number of sessions opened so far. */
 	unsigned int processed;
+	/**
+	 * Moving average of the time (in microseconds) between opening and closing
+	 * a session. Only maintained if the Group routes with RS_LEAST_LATENCY.
+	 * The average halves its weight on old data every second, so that it
+	 * quickly reflects temporary slowdowns such as garbage collection pauses.
+	 */
+	DiscExpMovingAverage<500, 1000000, 1000000> responseTimeAverage;
 	/** Do not access directly, always use `isAlive()`/`isDead()`/`getLifeStatus()` or
 	 * through `lifetimeSyncher`. */
 	enum LifeStatus {
@@ -719,6 +727,25 @@ public:
 		}
 	}
 
+	/**
+	 * The maximum number of concurrent sessions this process can handle.
+	 * 0 means unlimited.
+	 */
+	int getConcurrency() const {
+		return concurrency;
+	}
+
+	/**
+	 * How long it took to spawn this process, in microseconds. 0 if unknown.
+	 */
+	unsigned long long getSpawnDuration() const {
+		if (spawnStartTime != 0 && spawnEndTime > spawnStartTime) {
+			return spawnEndTime - spawnStartTime;
+		} else {
+			return 0;
+		}
+	}
+
 	/**
 	 * Whether we've reached the maximum number of concurrent sessions for this
 	 * process.
@@ -736,6 +763,20 @@ public:
 		return !isTotallyBusy();
 	}
 
+	/**
+	 * The expected time that a new request would take on this process:
+	 * the average response time, multiplied by the number of requests that
+	 * the process would be handling. `defaultResponseTime` is used if no
+	 * response time has been measured yet.
+	 */
+	double expectedLatency(double defaultResponseTime) const {
+		if (responseTimeAverage.available()) {
+			return responseTimeAverage.average() * (sessions + 1);
+		} else {
+			return defaultResponseTime * (sessions + 1);
+		}
+	}
+
 	/**
 	 * Create a new communication session with this process. This will connect to one
 	 * of the session sockets or reuse an existing connection. See Session for
@@ -760,7 +801,9 @@ public:
 			} else {
 				lastUsed = SystemTime::getUsec();
 			}
-			return createSessionObject(socket);
+			SessionPtr session = createSessionObject(socket);
+			session->checkoutTime = lastUsed;
+			return session;
 		}
 	}
 
@@ -891,6 +934,7 @@ public:
 				stream << "<protocol>" << escapeForXml(socket.protocol) << "</protocol>";
 				stream << "<concurrency>" << socket.concurrency << "</concurrency>";
 				stream << "<sessions>" << socket.sessions << "</sessions>";
+				socket.inspectConnectionPoolXml(stream);
 				stream << "</socket>";
 			}
 			stream << "</sockets>";
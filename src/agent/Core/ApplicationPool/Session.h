@@ -117,6 +117,8 @@ private:
 public:
 	Callback onInitiateFailure;
 	Callback onClose;
+	/** The time at which this Session was checked out from its Process. */
+	unsigned long long checkoutTime;
 
 	Session(Context *_context, const BasicProcessInfo *_processInfo, Socket *_socket)
 		: context(_context),
@@ -125,7 +127,8 @@ public:
 		  refcount(1),
 		  closed(false),
 		  onInitiateFailure(NULL),
-		  onClose(NULL)
+		  onClose(NULL),
+		  checkoutTime(0)
 		{ }
 
 	~Session() {
@@ -33,11 +33,14 @@
 #include <boost/weak_ptr.hpp>
 #include <climits>
 #include <cassert>
+#include <cerrno>
+#include <poll.h>
 #include <SmallVector.h>
 #include <LoggingKit/LoggingKit.h>
 #include <StaticString.h>
 #include <MemoryKit/palloc.h>
 #include <Utils/IOUtils.h>
+#include <Utils/SystemTime.h>
 #include <Core/ApplicationPool/Common.h>
 
 namespace Passenger {
@@ -52,14 +55,36 @@ struct Connection {
 	bool wantKeepAlive: 1;
 	bool fail: 1;
 	bool blocking: 1;
+	/** When this connection was checked into the connection pool. */
+	unsigned long long idleSince;
 
 	Connection()
 		: fd(-1),
 		  wantKeepAlive(false),
 		  fail(false),
-		  blocking(true)
+		  blocking(true),
+		  idleSince(0)
 		{ }
 
+	/**
+	 * Checks whether an idle connection can still be used for a new
+	 * session. An idle connection should neither be readable nor be
+	 * hung up: if it is, then the application closed it, or it sent
+	 * data that does not belong to any session.
+	 */
+	bool isHealthy() const {
+		struct pollfd pfd;
+		int ret;
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		do {
+			ret = poll(&pfd, 1, 0);
+		} while (ret == -1 && errno == EINTR);
+		return ret == 0;
+	}
+
 	void close() {
 		if (fd != -1) {
 			int fd2 = fd;
@@ -74,15 +99,83 @@ struct Connection {
 /**
  * Not thread-safe except for the connection pooling methods, so only use
  * within the ApplicationPool lock.
+ *
+ * Connections to the socket are pooled: when a session is closed and its
+ * connection may be kept alive, then the connection is put in a bounded
+ * pool of idle connections, to be reused by a later session. Idle
+ * connections are reused in LIFO order, so that the most recently used
+ * connection (which is most likely still warm inside the application) is
+ * preferred, and so that surplus connections age at the bottom of the pool.
+ * Before an idle connection is reused it is checked for health, and idle
+ * connections that are older than MAX_IDLE_CONNECTION_TIME are closed,
+ * because applications tend to close idle keep-alive connections on
+ * their own after a few seconds.
  */
 class Socket {
+public:
+	/**
+	 * The maximum number of idle connections to keep, for sockets
+	 * with unlimited concurrency.
+	 */
+	static const int UNLIMITED_CONCURRENCY_CONNECTION_POOL_LIMIT = 32;
+	/** In microseconds. */
+	static const unsigned long long MAX_IDLE_CONNECTION_TIME = 4000000;
+
 private:
-	boost::mutex connectionPoolLock;
+	mutable boost::mutex connectionPoolLock;
 	vector<Connection> idleConnections;
 
+	/** Statistics, protected by connectionPoolLock. */
+	unsigned long long totalConnectionsCreated;
+	unsigned long long totalConnectionsReused;
+	unsigned long long totalIdleConnectionsDiscarded;
+
 	OXT_FORCE_INLINE
 	int connectionPoolLimit() const {
-		return concurrency;
+		if (concurrency == 0) {
+			return UNLIMITED_CONCURRENCY_CONNECTION_POOL_LIMIT;
+		} else {
+			return concurrency;
+		}
+	}
+
+	bool idleConnectionExpired(const Connection &connection, unsigned long long now) const {
+		return now >= connection.idleSince + MAX_IDLE_CONNECTION_TIME;
+	}
+
+	/**
+	 * Closes the idle connections that have been idle for too long. Because
+	 * connections are checked in at the back, these are at the front.
+	 */
+	void discardExpiredIdleConnections(unsigned long long now,
+		vector<Connection> &discarded)
+	{
+		vector<Connection>::iterator it = idleConnections.begin();
+		while (it != idleConnections.end() && idleConnectionExpired(*it, now)) {
+			discarded.push_back(*it);
+			it++;
+		}
+		if (it != idleConnections.begin()) {
+			int count = it - idleConnections.begin();
+			P_TRACE(3, "Socket " << address << ": discarding " << count <<
+				" expired idle connection(s)");
+			idleConnections.erase(idleConnections.begin(), it);
+			totalConnections -= count;
+			totalIdleConnections -= count;
+			totalIdleConnectionsDiscarded += count;
+		}
+	}
+
+	void closeConnections(vector<Connection> &connections) {
+		vector<Connection>::iterator it, end = connections.end();
+
+		for (it = connections.begin(); it != end; it++) {
+			try {
+				it->close();
+			} catch (const SystemException &e) {
+				P_ERROR("Cannot close a connection with socket " << address << ": " << e.what());
+			}
+		}
 	}
 
 	Connection connect() const {
@@ -112,13 +205,19 @@ public:
 	int sessions;
 
 	Socket()
-		: pid(-1),
+		: totalConnectionsCreated(0),
+		  totalConnectionsReused(0),
+		  totalIdleConnectionsDiscarded(0),
+		  pid(-1),
 		  concurrency(0)
 		{ }
 
 	Socket(pid_t _pid, const StaticString &_name, const StaticString &_address,
 		const StaticString &_protocol, int _concurrency)
-		: name(_name),
+		: totalConnectionsCreated(0),
+		  totalConnectionsReused(0),
+		  totalIdleConnectionsDiscarded(0),
+		  name(_name),
 		  address(_address),
 		  protocol(_protocol),
 		  pid(_pid),
@@ -130,6 +229,9 @@ public:
 
 	Socket(const Socket &other)
 		: idleConnections(other.idleConnections),
+		  totalConnectionsCreated(other.totalConnectionsCreated),
+		  totalConnectionsReused(other.totalConnectionsReused),
+		  totalIdleConnectionsDiscarded(other.totalIdleConnectionsDiscarded),
 		  name(other.name),
 		  address(other.address),
 		  protocol(other.protocol),
@@ -144,6 +246,9 @@ public:
 		totalConnections = other.totalConnections;
 		totalIdleConnections = other.totalIdleConnections;
 		idleConnections = other.idleConnections;
+		totalConnectionsCreated = other.totalConnectionsCreated;
+		totalConnectionsReused = other.totalConnectionsReused;
+		totalIdleConnectionsDiscarded = other.totalIdleConnectionsDiscarded;
 		name = other.name;
 		address = other.address;
 		protocol = other.protocol;
@@ -161,22 +266,46 @@ public:
 	 */
 	Connection checkoutConnection() {
 		boost::unique_lock<boost::mutex> l(connectionPoolLock);
+		vector<Connection> discarded;
 
-		if (!idleConnections.empty()) {
-			P_TRACE(3, "Socket " << address << ": checking out connection from connection pool (" <<
-				idleConnections.size() << " -> " << (idleConnections.size() - 1) <<
-				" items). Current total number of connections: " << totalConnections);
+		discardExpiredIdleConnections(SystemTime::getUsec(), discarded);
+		while (!idleConnections.empty()) {
 			Connection connection = idleConnections.back();
 			idleConnections.pop_back();
 			totalIdleConnections--;
-			return connection;
-		} else {
-			Connection connection = connect();
-			totalConnections++;
-			P_TRACE(3, "Socket " << address << ": there are now " <<
-				totalConnections << " total connections");
-			l.unlock();
-			return connection;
+			if (connection.isHealthy()) {
+				P_TRACE(3, "Socket " << address << ": checking out connection from connection pool (" <<
+					(idleConnections.size() + 1) << " -> " << idleConnections.size() <<
+					" items). Current total number of connections: " << totalConnections);
+				totalConnectionsReused++;
+				l.unlock();
+				closeConnections(discarded);
+				return connection;
+			} else {
+				P_TRACE(3, "Socket " << address << ": discarding idle connection "
+					"that has been closed by the application");
+				totalConnections--;
+				totalIdleConnectionsDiscarded++;
+				discarded.push_back(connection);
+			}
+		}
+
+		// Connect outside the lock so that other threads can
+		// still check out and check in connections meanwhile.
+		totalConnections++;
+		totalConnectionsCreated++;
+		P_TRACE(3, "Socket " << address << ": there are now " <<
+			totalConnections << " total connections");
+		l.unlock();
+		closeConnections(discarded);
+
+		try {
+			return connect();
+		} catch (...) {
+			l.lock();
+			totalConnections--;
+			totalConnectionsCreated--;
+			throw;
 		}
 	}
 
@@ -192,11 +321,17 @@ public:
 			l.unlock();
 			connection.close();
 		} else {
+			vector<Connection> discarded;
+
 			P_TRACE(3, "Socket " << address << ": checking in connection into connection pool (" <<
 				totalIdleConnections << " -> " << (totalIdleConnections + 1) <<
 				" items). Current total number of connections: " << totalConnections);
+			connection.idleSince = SystemTime::getUsec();
 			totalIdleConnections++;
 			idleConnections.push_back(connection);
+			discardExpiredIdleConnections(connection.idleSince, discarded);
+			l.unlock();
+			closeConnections(discarded);
 		}
 	}
 
@@ -204,20 +339,45 @@ public:
 		boost::unique_lock<boost::mutex> l(connectionPoolLock);
 		assert(sessions == 0);
 		assert(totalConnections == totalIdleConnections);
-		vector<Connection>::iterator it, end = idleConnections.end();
-
-		for (it = idleConnections.begin(); it != end; it++) {
-			try {
-				it->close();
-			} catch (const SystemException &e) {
-				P_ERROR("Cannot close a connection with socket " << address << ": " << e.what());
-			}
-		}
+		closeConnections(idleConnections);
 		idleConnections.clear();
 		totalConnections = 0;
 		totalIdleConnections = 0;
 	}
 
+	template<typename Stream>
+	void inspectConnectionPoolXml(Stream &stream) const {
+		boost::lock_guard<boost::mutex> l(connectionPoolLock);
+		stream << "<total_connections>" << totalConnections << "</total_connections>";
+		stream << "<idle_connections>" << totalIdleConnections << "</idle_connections>";
+		stream << "<connection_pool_limit>" << connectionPoolLimit() << "</connection_pool_limit>";
+		stream << "<connections_created>" << totalConnectionsCreated << "</connections_created>";
+		stream << "<connections_reused>" << totalConnectionsReused << "</connections_reused>";
+		stream << "<idle_connections_discarded>" << totalIdleConnectionsDiscarded << "</idle_connections_discarded>";
+		if (totalConnectionsCreated + totalConnectionsReused > 0) {
+			// The fraction of sessions that reused a pooled connection
+			// instead of connecting to the socket.
+			stream << "<connection_reuse_ratio>" << (totalConnectionsReused /
+				(double) (totalConnectionsCreated + totalConnectionsReused)) <<
+				"</connection_reuse_ratio>";
+		}
+	}
+
+	unsigned long long getTotalConnectionsCreated() const {
+		boost::lock_guard<boost::mutex> l(connectionPoolLock);
+		return totalConnectionsCreated;
+	}
+
+	unsigned long long getTotalConnectionsReused() const {
+		boost::lock_guard<boost::mutex> l(connectionPoolLock);
+		return totalConnectionsReused;
+	}
+
+	unsigned long long getTotalIdleConnectionsDiscarded() const {
+		boost::lock_guard<boost::mutex> l(connectionPoolLock);
+		return totalIdleConnectionsDiscarded;
+	}
+
 
 	bool isIdle() const {
 		return sessions == 0;
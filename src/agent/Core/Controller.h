@@ -68,6 +68,7 @@
 #include <ServerKit/Errors.h>
 #include <ServerKit/HttpServer.h>
 #include <ServerKit/HttpHeaderParser.h>
+#include <ServerKit/SplicePipe.h>
 #include <MemoryKit/palloc.h>
 #include <DataStructures/LString.h>
 #include <DataStructures/StringKeyTable.h>
@@ -83,6 +84,10 @@
 #include <Core/Controller/Client.h>
 #include <Core/Controller/AppResponse.h>
 #include <Core/Controller/TurboCaching.h>
+#include <Core/Controller/CollapsedForwarding.h>
+#include <Core/ResponseCacheStore.h>
+#include <Core/ResponseCompressor.h>
+#include <Core/OpenFileCache.h>
 #include <Core/UnionStation/Context.h>
 
 namespace Passenger {
@@ -113,10 +118,12 @@ private:
 	// If you change this value, make sure that Request::sessionCheckoutTry
 	// has enough bits.
 	static const unsigned int MAX_SESSION_CHECKOUT_TRY = 10;
+	// Maximum number of idle splice pipes to keep around for reuse.
+	static const unsigned int MAX_IDLE_SPLICE_PIPES = 16;
 
 	ControllerMainConfig mainConfig;
 	ControllerRequestConfigPtr requestConfig;
-	StringKeyTable< boost::shared_ptr<Options> > poolOptionsCache;
+	StringKeyTable< boost::shared_ptr<const Options> > poolOptionsCache;
 
 	HashedStaticString PASSENGER_APP_GROUP_NAME;
 	HashedStaticString PASSENGER_ENV_VARS;
@@ -139,11 +146,24 @@ private:
 	HashedStaticString HTTP_CONNECTION;
 	HashedStaticString HTTP_STATUS;
 	HashedStaticString HTTP_TRANSFER_ENCODING;
+	HashedStaticString HTTP_ACCEPT_ENCODING;
+	HashedStaticString HTTP_CONTENT_ENCODING;
+	HashedStaticString HTTP_CACHE_CONTROL;
+	HashedStaticString HTTP_ETAG;
+	HashedStaticString HTTP_VARY;
+	HashedStaticString HTTP_RANGE;
+	HashedStaticString HTTP_IF_RANGE;
 
 	friend class TurboCaching<Request>;
 	friend class ResponseCache<Request>;
 	struct ev_check checkWatcher;
 	TurboCaching<Request> turboCaching;
+	struct ev_timer collapsedForwardingTimer;
+	CollapsedForwarding<Request> collapsedForwarding;
+	OpenFileCache openFileCache;
+	vector<ServerKit::SplicePipe> idleSplicePipes;
+	boost::uint64_t bytesSplicedToApps;
+	boost::uint64_t bytesSplicedToClients;
 	ConfigKit::Store *singleAppModeConfig;
 
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
@@ -163,6 +183,13 @@ private:
 
 	void initializeFlags(Client *client, Request *req, RequestAnalysis &analysis);
 	bool respondFromTurboCache(Client *client, Request *req);
+	void respondWithTurboCacheEntry(Client *client, Request *req,
+		ResponseCache<Request>::Entry &entry);
+	bool collapseRequest(Client *client, Request *req);
+	void releaseCollapsedRequests(Request *leader);
+	static void resumeCollapsedRequestLater(Request *req);
+	void resumeCollapsedRequest(Client *client, Request *req);
+	void forwardRequestToApp(Client *client, Request *req, RequestAnalysis &analysis);
 	void initializePoolOptions(Client *client, Request *req, RequestAnalysis &analysis);
 	void fillPoolOptionsFromConfigCaches(Options &options, psg_pool_t *pool,
 		const ControllerRequestConfigPtr &requestConfigCache);
@@ -178,6 +205,8 @@ private:
 		const HashedStaticString &name);
 	static void fillPoolOption(Request *req, long &field,
 		const HashedStaticString &name);
+	static void fillPoolOption(Request *req, RoutingStrategy &field,
+		const HashedStaticString &name);
 	static void fillPoolOptionSecToMsec(Request *req, unsigned int &field,
 		const HashedStaticString &name);
 	void createNewPoolOptions(Client *client, Request *req,
@@ -258,6 +287,8 @@ private:
 	Channel::Result onAppSourceData(Client *client, Request *req,
 		const MemoryKit::mbuf &buffer, int errcode);
 	void onAppResponseBegin(Client *client, Request *req);
+	void prepareAppResponseCompression(Client *client, Request *req);
+	bool appResponseIsCompressible(Client *client, Request *req);
 	void prepareAppResponseCaching(Client *client, Request *req);
 	void onAppResponse100Continue(Client *client, Request *req);
 	bool constructHeaderBuffersForResponse(Request *req, struct iovec *buffers,
@@ -285,6 +316,9 @@ private:
 		const MemoryKit::mbuf &buffer);
 	void markResponsePartForTurboCaching(Client *client, Request *req,
 		const MemoryKit::mbuf &buffer);
+	static bool onCompressedResponseData(void *userData, const MemoryKit::mbuf &output,
+		const MemoryKit::mbuf &payload);
+	void finishResponseCompression(Client *client, Request *req);
 	void maybeThrottleAppSource(Client *client, Request *req);
 	static void _outputBuffersFlushed(FileBufferedChannel *_channel);
 	void outputBuffersFlushed(Client *client, Request *req);
@@ -296,6 +330,37 @@ private:
 	void finalizeUnionStationWithSuccess(Client *client, Request *req);
 
 
+	/****** Stage: send file on behalf of the application ******/
+
+	bool canServeAppResponseFile(Client *client, Request *req);
+	int resolveAppResponseFilePath(Request *req, StaticString &path);
+	void serveAppResponseFile(Client *client, Request *req);
+	void prepareAppResponseFileHeaders(Client *client, Request *req,
+		const OpenFileCache::File &file);
+	void beginSendingFileBody(Client *client, Request *req);
+	static void _fileBodyOutputFlushed(FileBufferedChannel *_channel);
+	static void onFileBodySocketWritable(EV_P_ struct ev_io *io, int revents);
+	void sendFileBody(Client *client, Request *req);
+	static ssize_t writeFileToSocket(int sock, int fd, boost::uint64_t offset,
+		size_t size);
+
+
+	/****** Stage: relay bodies with splice() ******/
+
+	bool canSpliceRequestBody(Client *client, Request *req);
+	void beginSplicingRequestBody(Client *client, Request *req);
+	static void onRequestBodySpliceEvent(EV_P_ struct ev_io *io, int revents);
+	void spliceRequestBody(Client *client, Request *req);
+	bool canSpliceResponseBody(Client *client, Request *req);
+	void beginSplicingResponseBody(Client *client, Request *req);
+	static void _responseBodySpliceOutputFlushed(FileBufferedChannel *_channel);
+	static void onResponseBodySpliceEvent(EV_P_ struct ev_io *io, int revents);
+	void spliceResponseBody(Client *client, Request *req);
+	bool acquireSplicePipe(Client *client, ServerKit::SplicePipe &pipe);
+	void releaseSplicePipe(ServerKit::SplicePipe &pipe);
+	void stopSplicing(Client *client, Request *req);
+
+
 	/***** Hooks ******/
 
 	static Channel::Result onBodyBufferData(Channel *_channel,
@@ -304,6 +369,7 @@ private:
 		static void onEventLoopPrepare(EV_P_ struct ev_prepare *w, int revents);
 	#endif
 	static void onEventLoopCheck(EV_P_ struct ev_check *w, int revents);
+	static void onCollapsedForwardingTimeout(EV_P_ struct ev_timer *w, int revents);
 
 
 	/****** Internal utility functions ******/
@@ -319,6 +385,7 @@ private:
 	void endRequestWithSimpleResponse(Client **c, Request **r,
 		const StaticString &body, int code = 200);
 	void endRequestAsBadGateway(Client **client, Request **req);
+	bool respondFromTurboCacheOnError(Client **c, Request **r);
 	void writeBenchmarkResponse(Client **client, Request **req,
 		bool end = true);
 	bool getBoolOption(Request *req, const HashedStaticString &name,
@@ -371,6 +438,8 @@ public:
 	ResourceLocator *resourceLocator;
 	PoolPtr appPool;
 	UnionStation::ContextPtr unionStationContext;
+	/** If set, the turbocache is shared with other Controllers through this store. */
+	ResponseCacheStorePtr turbocacheStore;
 
 
 	/****** Initialization and shutdown ******/
@@ -390,6 +459,8 @@ public:
 		  poolOptionsCache(4),
 
 		  turboCaching(),
+		  bytesSplicedToApps(0),
+		  bytesSplicedToClients(0),
 		  singleAppModeConfig(NULL),
 		  resourceLocator(NULL)
 		  /**************************/
@@ -44,6 +44,7 @@ namespace Core {
 
 
 class HttpHeaderParser;
+class ResponseCompressor;
 
 class AppResponse {
 public:
@@ -126,6 +127,10 @@ public:
 	LString *cacheControl;
 	LString *expiresHeader;
 	LString *lastModifiedHeader;
+	/* The normalized Vary header: lowercase header names, separated by newlines.
+	 * Only set if the response is eligible for turbocaching.
+	 */
+	LString *vary;
 
 	/* If the response is eligible for turbocaching, then the buffers
 	 * that contain the part of the response that can be cached, will be
@@ -140,11 +145,17 @@ public:
 	 */
 	LString bodyCacheBuffer;
 
+	/* Set if the response body is being compressed by us, in which case
+	 * the body is sent to the client (and the turbocache) through it.
+	 */
+	ResponseCompressor *compressor;
+
 
 	AppResponse()
 		: headers(16),
 		  secureHeaders(0),
-		  bodyAlreadyRead(0)
+		  bodyAlreadyRead(0),
+		  compressor(NULL)
 	{
 		parserState.headerParser = NULL;
 		aux.bodyInfo.contentLength = 0; // Sets the entire union to 0.
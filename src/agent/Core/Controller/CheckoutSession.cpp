@@ -49,10 +49,9 @@ using namespace boost;
 void
 Controller::checkoutSession(Client *client, Request *req) {
 	GetCallback callback;
-	Options &options = req->options;
 
 	CC_BENCHMARK_POINT(client, req, BM_BEFORE_CHECKOUT);
-	SKC_TRACE(client, 2, "Checking out session: appRoot=" << options.appRoot);
+	SKC_TRACE(client, 2, "Checking out session: appRoot=" << req->options->appRoot);
 	req->state = Request::CHECKING_OUT_SESSION;
 
 	if (req->requestBodyBuffering) {
@@ -64,8 +63,6 @@ Controller::checkoutSession(Client *client, Request *req) {
 	callback.func = sessionCheckedOut;
 	callback.userData = req;
 
-	options.currentTime = SystemTime::getUsec();
-
 	refRequest(req, __FILE__, __LINE__);
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		req->timeBeforeAccessingApplicationPool = ev_now(getLoop());
@@ -83,7 +80,7 @@ Controller::checkoutSession(Client *client, Request *req) {
 
 void
 Controller::asyncGetFromApplicationPool(Request *req, ApplicationPool2::GetCallback callback) {
-	appPool->asyncGet(req->options, callback, true,
+	appPool->asyncGet(*req->options, callback, true,
 		req->useUnionStation()
 		? &req->stopwatchLogs.getFromPool
 		: NULL);
@@ -355,7 +352,7 @@ Controller::endRequestWithErrorResponse(Client **c, Request **r, const StaticStr
 
 	if (friendlyErrorPagesEnabled(req)) {
 		try {
-			data = renderer.renderWithDetails(message, req->options, e);
+			data = renderer.renderWithDetails(message, *req->options, e);
 		} catch (const SystemException &e2) {
 			SKC_ERROR(client, "Cannot render an error page: " << e2.what() <<
 				"\n" << e2.backtrace());
@@ -379,7 +376,7 @@ Controller::friendlyErrorPagesEnabled(Request *req) {
 	bool defaultValue;
 	const StaticString &defaultStr = req->config->defaultFriendlyErrorPages;
 	if (defaultStr == "auto") {
-		defaultValue = (req->options.environment == "development");
+		defaultValue = (req->options->environment == "development");
 	} else {
 		defaultValue = defaultStr == "true";
 	}
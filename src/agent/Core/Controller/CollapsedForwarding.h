@@ -0,0 +1,236 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_COLLAPSED_FORWARDING_H_
+#define _PASSENGER_COLLAPSED_FORWARDING_H_
+
+#include <boost/cstdint.hpp>
+#include <oxt/macros.hpp>
+#include <ev++.h>
+#include <vector>
+#include <cassert>
+#include <cstring>
+#include <psg_sysqueue.h>
+#include <DataStructures/HashedStaticString.h>
+
+namespace Passenger {
+namespace Core {
+
+
+using namespace std;
+
+
+/**
+ * Bookkeeping for collapsed forwarding: when a cacheable request misses the
+ * turbocache, it becomes the "leader" for its cache key and is forwarded to
+ * the app. Identical requests that arrive while the leader is in flight are
+ * parked as its "waiters" instead of being forwarded too. Once the leader's
+ * response has been stored in the turbocache (or has turned out not to be
+ * cacheable), the waiters are resumed: they are answered from the turbocache,
+ * or forwarded to the app if that fails.
+ *
+ * A leader only holds back its waiters for `timeout` seconds, after which
+ * they are resumed anyway. Because all leaders use the same timeout, the
+ * leader list is ordered by deadline.
+ *
+ * This class only maintains the data structures. The Controller is
+ * responsible for parking and resuming requests. It is not thread-safe:
+ * every Controller has its own instance.
+ */
+template<typename Request>
+class CollapsedForwarding {
+public:
+	static const unsigned int BUCKETS = 256;
+
+	TAILQ_HEAD(RequestList, Request);
+
+private:
+	vector<Request *> buckets;
+	RequestList leaders;
+	unsigned int nLeaders;
+	unsigned int nWaiters;
+	unsigned int timeout;
+	bool enabled;
+	boost::uint64_t collapsed;
+	boost::uint64_t timeouts;
+
+	OXT_FORCE_INLINE
+	Request **getBucket(boost::uint32_t hash) {
+		return &buckets[hash & (BUCKETS - 1)];
+	}
+
+public:
+	CollapsedForwarding()
+		: buckets(BUCKETS, (Request *) NULL),
+		  nLeaders(0),
+		  nWaiters(0),
+		  timeout(0),
+		  enabled(false),
+		  collapsed(0),
+		  timeouts(0)
+	{
+		TAILQ_INIT(&leaders);
+	}
+
+	void initialize(bool _enabled, unsigned int _timeout) {
+		enabled = _enabled;
+		timeout = _timeout;
+	}
+
+	OXT_FORCE_INLINE
+	bool isEnabled() const {
+		return enabled;
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getTimeout() const {
+		return timeout;
+	}
+
+	Request *lookupLeader(const HashedStaticString &cacheKey) {
+		Request *req = *getBucket(cacheKey.hash());
+		while (req != NULL) {
+			if (req->cacheKey == cacheKey) {
+				return req;
+			}
+			req = req->nextCollapsedLeaderInBucket;
+		}
+		return NULL;
+	}
+
+	/**
+	 * @pre lookupLeader(req->cacheKey) == NULL
+	 * @pre !req->leadingCollapsedRequests
+	 */
+	void addLeader(Request *req, ev_tstamp now) {
+		Request **bucket = getBucket(req->cacheKey.hash());
+		req->leadingCollapsedRequests = true;
+		req->collapsedDeadline = now + timeout;
+		req->nextCollapsedLeaderInBucket = *bucket;
+		*bucket = req;
+		TAILQ_INIT(&req->collapsedWaiters);
+		TAILQ_INSERT_TAIL(&leaders, req, nextCollapsedRequest);
+		nLeaders++;
+	}
+
+	/**
+	 * Unregisters the leader. Its waiters must then be taken
+	 * with popWaiter().
+	 *
+	 * @pre req->leadingCollapsedRequests
+	 * @pre req->cacheKey has not changed since addLeader()
+	 */
+	void removeLeader(Request *req) {
+		Request **bucket = getBucket(req->cacheKey.hash());
+		while (*bucket != req) {
+			bucket = &(*bucket)->nextCollapsedLeaderInBucket;
+		}
+		*bucket = req->nextCollapsedLeaderInBucket;
+		req->nextCollapsedLeaderInBucket = NULL;
+		req->leadingCollapsedRequests = false;
+		TAILQ_REMOVE(&leaders, req, nextCollapsedRequest);
+		nLeaders--;
+	}
+
+	/**
+	 * Returns the leader with the earliest deadline if that deadline has
+	 * passed, or NULL.
+	 */
+	Request *getExpiredLeader(ev_tstamp now) {
+		Request *req = TAILQ_FIRST(&leaders);
+		if (req != NULL && req->collapsedDeadline <= now) {
+			timeouts++;
+			return req;
+		} else {
+			return NULL;
+		}
+	}
+
+	/**
+	 * Returns the earliest leader deadline, or 0 if there are no leaders.
+	 */
+	ev_tstamp getNextDeadline() const {
+		Request *req = TAILQ_FIRST(&leaders);
+		if (req != NULL) {
+			return req->collapsedDeadline;
+		} else {
+			return 0;
+		}
+	}
+
+	/**
+	 * @pre leader->leadingCollapsedRequests
+	 * @pre req->collapsedLeader == NULL
+	 */
+	void addWaiter(Request *leader, Request *req) {
+		req->collapsedLeader = leader;
+		TAILQ_INSERT_TAIL(&leader->collapsedWaiters, req, nextCollapsedRequest);
+		nWaiters++;
+		collapsed++;
+	}
+
+	/**
+	 * @pre req->collapsedLeader != NULL
+	 */
+	void removeWaiter(Request *req) {
+		TAILQ_REMOVE(&req->collapsedLeader->collapsedWaiters, req, nextCollapsedRequest);
+		req->collapsedLeader = NULL;
+		nWaiters--;
+	}
+
+	Request *popWaiter(Request *leader) {
+		Request *req = TAILQ_FIRST(&leader->collapsedWaiters);
+		if (req != NULL) {
+			removeWaiter(req);
+		}
+		return req;
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getLeaderCount() const {
+		return nLeaders;
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getWaiterCount() const {
+		return nWaiters;
+	}
+
+	OXT_FORCE_INLINE
+	boost::uint64_t getCollapsedCount() const {
+		return collapsed;
+	}
+
+	OXT_FORCE_INLINE
+	boost::uint64_t getTimeoutCount() const {
+		return timeouts;
+	}
+};
+
+
+} // namespace Core
+} // namespace Passenger
+
+#endif /* _PASSENGER_COLLAPSED_FORWARDING_H_ */
@@ -38,6 +38,7 @@
 #include <ConfigKit/SchemaUtils.h>
 #include <MemoryKit/palloc.h>
 #include <ServerKit/HttpServer.h>
+#include <Core/ApplicationPool/Options.h>
 #include <AppTypes.h>
 #include <Constants.h>
 #include <Exceptions.h>
@@ -94,33 +95,55 @@ parseControllerBenchmarkMode(const StaticString &mode) {
  *   default_max_preloader_idle_time                     unsigned integer   -          default(300)
  *   default_max_request_queue_size                      unsigned integer   -          default(100)
  *   default_max_requests                                unsigned integer   -          default(0)
+ *   default_memory_limit                                unsigned integer   -          default(0)
  *   default_meteor_app_settings                         string             -          -
  *   default_min_instances                               unsigned integer   -          default(1)
  *   default_nodejs                                      string             -          default("node")
+ *   default_predictive_spawning                         boolean            -          default(false)
  *   default_python                                      string             -          default("python")
+ *   default_routing_strategy                            string             -          default("lowest_busyness")
  *   default_ruby                                        string             -          default("ruby")
  *   default_server_name                                 string             required   -
  *   default_server_port                                 unsigned integer   required   -
+ *   default_spawn_concurrency                           unsigned integer   -          default(1)
  *   default_spawn_method                                string             -          default("smart")
  *   default_sticky_sessions                             boolean            -          default(false)
  *   default_sticky_sessions_cookie_name                 string             -          default("_passenger_route")
  *   default_user                                        string             -          default("nobody")
  *   graceful_exit                                       boolean            -          default(true)
+ *   http2                                               boolean            -          default(false)
+ *   http2_max_concurrent_streams                        unsigned integer   -          default(100)
  *   integration_mode                                    string             -          default("standalone"),read_only
  *   min_spare_clients                                   unsigned integer   -          default(0)
  *   multi_app                                           boolean            -          default(true),read_only
+ *   native_x_sendfile                                   boolean            -          default(false)
+ *   open_file_cache_size                                unsigned integer   -          default(256),read_only
  *   request_freelist_limit                              unsigned integer   -          default(1024)
  *   response_buffer_high_watermark                      unsigned integer   -          default(134217728)
+ *   response_compression                                boolean            -          default(false)
+ *   response_compression_level                          unsigned integer   -          default(6)
+ *   response_compression_min_size                       unsigned integer   -          default(256)
  *   server_software                                     string             -          default("Phusion_Passenger/5.1.13")
  *   show_version_in_header                              boolean            -          default(true)
+ *   splice_relay                                        boolean            -          default(false)
+ *   splice_relay_min_size                               unsigned integer   -          default(131072)
  *   start_reading_after_accept                          boolean            -          default(true)
  *   stat_throttle_rate                                  unsigned integer   -          default(10)
  *   thread_number                                       unsigned integer   required   read_only
+ *   turbocache_collapsed_forwarding                     boolean            -          default(false),read_only
+ *   turbocache_collapsed_forwarding_timeout             unsigned integer   -          default(5),read_only
+ *   turbocache_max_body_size                            unsigned integer   -          default(262144),read_only
+ *   turbocache_max_entries                              unsigned integer   -          default(1024),read_only
+ *   turbocache_max_memory                               unsigned integer   -          default(33554432),read_only
  *   turbocaching                                        boolean            -          default(true),read_only
  *   user_switching                                      boolean            -          default(true)
  *   ust_router_address                                  string             -          -
+ *   ust_router_async                                    boolean            -          default(false),read_only
+ *   ust_router_async_queue_size                         unsigned integer   -          default(4194304),read_only
  *   ust_router_password                                 string             -          secret
  *   vary_turbocache_by_cookie                           string             -          -
+ *   x_accel_redirect_root                               string             -          -
+ *   x_sendfile_root                                     string             -          -
  *
  * END
  */
@@ -132,7 +155,13 @@ private:
 		add("thread_number", UINT_TYPE, REQUIRED | READ_ONLY);
 		add("multi_app", BOOL_TYPE, OPTIONAL | READ_ONLY, true);
 		add("turbocaching", BOOL_TYPE, OPTIONAL | READ_ONLY, true);
+		add("turbocache_max_entries", UINT_TYPE, OPTIONAL | READ_ONLY, DEFAULT_TURBOCACHE_MAX_ENTRIES);
+		add("turbocache_max_memory", UINT_TYPE, OPTIONAL | READ_ONLY, DEFAULT_TURBOCACHE_MAX_MEMORY);
+		add("turbocache_max_body_size", UINT_TYPE, OPTIONAL | READ_ONLY, DEFAULT_TURBOCACHE_MAX_BODY_SIZE);
+		add("turbocache_collapsed_forwarding", BOOL_TYPE, OPTIONAL | READ_ONLY, false);
+		add("turbocache_collapsed_forwarding_timeout", UINT_TYPE, OPTIONAL | READ_ONLY, DEFAULT_TURBOCACHE_COLLAPSED_FORWARDING_TIMEOUT);
 		add("integration_mode", STRING_TYPE, OPTIONAL | READ_ONLY, DEFAULT_INTEGRATION_MODE);
+		add("open_file_cache_size", UINT_TYPE, OPTIONAL | READ_ONLY, DEFAULT_OPEN_FILE_CACHE_SIZE);
 
 		add("user_switching", BOOL_TYPE, OPTIONAL, true);
 		add("stat_throttle_rate", UINT_TYPE, OPTIONAL, DEFAULT_STAT_THROTTLE_RATE);
@@ -140,12 +169,22 @@ private:
 		add("response_buffer_high_watermark", UINT_TYPE, OPTIONAL, DEFAULT_RESPONSE_BUFFER_HIGH_WATERMARK);
 		add("graceful_exit", BOOL_TYPE, OPTIONAL, true);
 		add("benchmark_mode", STRING_TYPE, OPTIONAL);
+		add("response_compression", BOOL_TYPE, OPTIONAL, false);
+		add("response_compression_level", UINT_TYPE, OPTIONAL, DEFAULT_RESPONSE_COMPRESSION_LEVEL);
+		add("response_compression_min_size", UINT_TYPE, OPTIONAL, DEFAULT_RESPONSE_COMPRESSION_MIN_SIZE);
+		add("native_x_sendfile", BOOL_TYPE, OPTIONAL, false);
+		add("x_sendfile_root", STRING_TYPE, OPTIONAL);
+		add("x_accel_redirect_root", STRING_TYPE, OPTIONAL);
+		add("splice_relay", BOOL_TYPE, OPTIONAL, false);
+		add("splice_relay_min_size", UINT_TYPE, OPTIONAL, DEFAULT_SPLICE_RELAY_MIN_SIZE);
 
 		add("default_ruby", STRING_TYPE, OPTIONAL, DEFAULT_RUBY);
 		add("default_python", STRING_TYPE, OPTIONAL, DEFAULT_PYTHON);
 		add("default_nodejs", STRING_TYPE, OPTIONAL, DEFAULT_NODEJS);
 		add("ust_router_address", STRING_TYPE, OPTIONAL);
 		add("ust_router_password", STRING_TYPE, OPTIONAL | SECRET);
+		add("ust_router_async", BOOL_TYPE, OPTIONAL | READ_ONLY, false);
+		add("ust_router_async_queue_size", UINT_TYPE, OPTIONAL | READ_ONLY, DEFAULT_UST_ROUTER_ASYNC_QUEUE_SIZE);
 		add("default_user", STRING_TYPE, OPTIONAL, DEFAULT_WEB_APP_USER);
 		addWithDynamicDefault(
 			"default_group", STRING_TYPE, OPTIONAL | CACHE_DEFAULT_VALUE,
@@ -169,6 +208,10 @@ private:
 		add("default_force_max_concurrent_requests_per_process", INT_TYPE, OPTIONAL, -1);
 		add("default_abort_websockets_on_process_shutdown", BOOL_TYPE, OPTIONAL, true);
 		add("default_max_requests", UINT_TYPE, OPTIONAL, 0);
+		add("default_routing_strategy", STRING_TYPE, OPTIONAL, "lowest_busyness");
+		add("default_spawn_concurrency", UINT_TYPE, OPTIONAL, 1);
+		add("default_predictive_spawning", BOOL_TYPE, OPTIONAL, false);
+		add("default_memory_limit", UINT_TYPE, OPTIONAL, 0);
 
 
 		/*******************/
@@ -177,6 +220,7 @@ private:
 
 		addValidator(validate);
 		addValidator(ConfigKit::validateIntegrationMode);
+		addNormalizer(normalizeSendfileRoots);
 	}
 
 	static Json::Value inferDefaultValueForDefaultGroup(const ConfigKit::Store &config) {
@@ -199,10 +243,71 @@ private:
 		if (mode == BM_UNKNOWN) {
 			errors.push_back(Error("'{{benchmark_mode}}' is not set to a valid value"));
 		}
+		if (config["turbocache_max_entries"].asUInt() < 1) {
+			errors.push_back(Error("'{{turbocache_max_entries}}' must be at least 1"));
+		}
+		if (config["turbocache_collapsed_forwarding_timeout"].asUInt() < 1) {
+			errors.push_back(Error("'{{turbocache_collapsed_forwarding_timeout}}' must be at least 1"));
+		}
+		if (ApplicationPool2::parseRoutingStrategy(config["default_routing_strategy"].asString())
+			== ApplicationPool2::RS_UNKNOWN)
+		{
+			errors.push_back(Error("'{{default_routing_strategy}}' must be one of"
+				" 'lowest_busyness', 'power_of_two_choices' or 'least_latency'"));
+		}
+		if (config["response_compression_level"].asUInt() < 1
+		 || config["response_compression_level"].asUInt() > 9)
+		{
+			errors.push_back(Error("'{{response_compression_level}}' must be between 1 and 9"));
+		}
+		if (!config["x_sendfile_root"].isNull()
+		 && !startsWith(config["x_sendfile_root"].asString(), "/"))
+		{
+			errors.push_back(Error("'{{x_sendfile_root}}' must be an absolute path"));
+		}
+		if (!config["x_accel_redirect_root"].isNull()
+		 && !startsWith(config["x_accel_redirect_root"].asString(), "/"))
+		{
+			errors.push_back(Error("'{{x_accel_redirect_root}}' must be an absolute path"));
+		}
+		if (config["native_x_sendfile"].asBool()
+		 && config["x_sendfile_root"].isNull()
+		 && config["x_accel_redirect_root"].isNull())
+		{
+			errors.push_back(Error("'{{native_x_sendfile}}' requires '{{x_sendfile_root}}'"
+				" or '{{x_accel_redirect_root}}' to be set"));
+		}
+		if (config["default_spawn_concurrency"].asUInt() < 1) {
+			errors.push_back(Error("'{{default_spawn_concurrency}}' must be at least 1"));
+		}
 
 		/*******************/
 	}
 
+	/**
+	 * Resolves symlinks in the X-Sendfile and X-Accel-Redirect roots, so
+	 * that the paths that are served can be checked against them. A root
+	 * that doesn't exist (yet) is kept as-is.
+	 */
+	static Json::Value normalizeSendfileRoots(const Json::Value &effectiveValues) {
+		Json::Value updates;
+		const char *keys[] = { "x_sendfile_root", "x_accel_redirect_root" };
+
+		for (unsigned int i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+			const Json::Value &value = effectiveValues[keys[i]];
+			if (value.isNull() || !startsWith(value.asString(), "/")) {
+				continue;
+			}
+			try {
+				updates[keys[i]] = canonicalizePath(value.asString());
+			} catch (const FileSystemException &) {
+				// Leave it alone.
+			}
+		}
+
+		return updates;
+	}
+
 public:
 	ControllerSchema()
 		: ServerKit::HttpServerSchema(false)
@@ -309,6 +414,7 @@ public:
 	unsigned int threadNumber;
 	unsigned int statThrottleRate;
 	unsigned int responseBufferHighWatermark;
+	unsigned int spliceRelayMinSize;
 	StaticString integrationMode;
 	StaticString serverLogName;
 	ControllerBenchmarkMode benchmarkMode: 3;
@@ -316,6 +422,7 @@ public:
 	bool userSwitching: 1;
 	bool defaultStickySessions: 1;
 	bool gracefulExit: 1;
+	bool spliceRelay: 1;
 
 	/*******************/
 	/*******************/
@@ -326,13 +433,15 @@ public:
 		  threadNumber(config["thread_number"].asUInt()),
 		  statThrottleRate(config["stat_throttle_rate"].asUInt()),
 		  responseBufferHighWatermark(config["response_buffer_high_watermark"].asUInt()),
+		  spliceRelayMinSize(config["splice_relay_min_size"].asUInt()),
 		  integrationMode(psg_pstrdup(pool, config["integration_mode"].asString())),
 		  serverLogName(createServerLogName()),
 		  benchmarkMode(parseControllerBenchmarkMode(config["benchmark_mode"].asString())),
 		  singleAppMode(!config["multi_app"].asBool()),
 		  userSwitching(config["user_switching"].asBool()),
 		  defaultStickySessions(config["default_sticky_sessions"].asBool()),
-		  gracefulExit(config["graceful_exit"].asBool())
+		  gracefulExit(config["graceful_exit"].asBool()),
+		  spliceRelay(config["splice_relay"].asBool())
 
 		  /*******************/
 	{
@@ -355,6 +464,7 @@ public:
 		std::swap(threadNumber, other.threadNumber);
 		std::swap(statThrottleRate, other.statThrottleRate);
 		std::swap(responseBufferHighWatermark, other.responseBufferHighWatermark);
+		std::swap(spliceRelayMinSize, other.spliceRelayMinSize);
 		std::swap(integrationMode, other.integrationMode);
 		std::swap(serverLogName, other.serverLogName);
 		SWAP_BITFIELD(ControllerBenchmarkMode, benchmarkMode);
@@ -362,6 +472,7 @@ public:
 		SWAP_BITFIELD(bool, userSwitching);
 		SWAP_BITFIELD(bool, defaultStickySessions);
 		SWAP_BITFIELD(bool, gracefulExit);
+		SWAP_BITFIELD(bool, spliceRelay);
 
 		/*******************/
 
@@ -396,6 +507,8 @@ public:
 	StaticString serverSoftware;
 	StaticString defaultStickySessionsCookieName;
 	StaticString defaultVaryTurbocacheByCookie;
+	StaticString xSendfileRoot;
+	StaticString xAccelRedirectRoot;
 
 	StaticString defaultFriendlyErrorPages;
 	StaticString defaultEnvironment;
@@ -407,9 +520,17 @@ public:
 	unsigned int defaultMaxRequestQueueSize;
 	unsigned int defaultMaxRequests;
 	int defaultForceMaxConcurrentRequestsPerProcess;
+	ApplicationPool2::RoutingStrategy defaultRoutingStrategy;
+	unsigned int defaultSpawnConcurrency;
+	unsigned int defaultMemoryLimit;
+	unsigned int responseCompressionLevel;
+	unsigned int responseCompressionMinSize;
 	bool showVersionInHeader: 1;
+	bool responseCompression: 1;
+	bool nativeXSendfile: 1;
 	bool defaultAbortWebsocketsOnProcessShutdown;
 	bool defaultLoadShellEnvvars;
+	bool defaultPredictiveSpawning;
 
 	/*******************/
 	/*******************/
@@ -430,6 +551,8 @@ public:
 		  serverSoftware(psg_pstrdup(pool, config["server_software"].asString())),
 		  defaultStickySessionsCookieName(psg_pstrdup(pool, config["default_sticky_sessions_cookie_name"].asString())),
 		  defaultVaryTurbocacheByCookie(psg_pstrdup(pool, config["vary_turbocache_by_cookie"].asString())),
+		  xSendfileRoot(psg_pstrdup(pool, config["x_sendfile_root"].asString())),
+		  xAccelRedirectRoot(psg_pstrdup(pool, config["x_accel_redirect_root"].asString())),
 
 		  defaultFriendlyErrorPages(psg_pstrdup(pool, config["default_friendly_error_pages"].asString())),
 		  defaultEnvironment(psg_pstrdup(pool, config["default_environment"].asString())),
@@ -441,9 +564,17 @@ public:
 		  defaultMaxRequestQueueSize(config["default_max_request_queue_size"].asUInt()),
 		  defaultMaxRequests(config["default_max_requests"].asUInt()),
 		  defaultForceMaxConcurrentRequestsPerProcess(config["default_force_max_concurrent_requests_per_process"].asInt()),
+		  defaultRoutingStrategy(ApplicationPool2::parseRoutingStrategy(config["default_routing_strategy"].asString())),
+		  defaultSpawnConcurrency(config["default_spawn_concurrency"].asUInt()),
+		  defaultMemoryLimit(config["default_memory_limit"].asUInt()),
+		  responseCompressionLevel(config["response_compression_level"].asUInt()),
+		  responseCompressionMinSize(config["response_compression_min_size"].asUInt()),
 		  showVersionInHeader(config["show_version_in_header"].asBool()),
+		  responseCompression(config["response_compression"].asBool()),
+		  nativeXSendfile(config["native_x_sendfile"].asBool()),
 		  defaultAbortWebsocketsOnProcessShutdown(config["default_abort_websockets_on_process_shutdown"].asBool()),
-		  defaultLoadShellEnvvars(config["default_load_shell_envvars"].asBool())
+		  defaultLoadShellEnvvars(config["default_load_shell_envvars"].asBool()),
+		  defaultPredictiveSpawning(config["default_predictive_spawning"].asBool())
 
 		  /*******************/
 		{ }
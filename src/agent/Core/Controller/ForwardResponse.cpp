@@ -165,6 +165,8 @@ Controller::onAppSourceData(Client *client, Request *req, const MemoryKit::mbuf
 						SKC_TRACE(client, 2, "End of application response body reached");
 						handleAppResponseBodyEnd(client, req);
 						endRequest(&client, &req);
+					} else if (canSpliceResponseBody(client, req)) {
+						beginSplicingResponseBody(client, req);
 					} else {
 						maybeThrottleAppSource(client, req);
 					}
@@ -208,7 +210,7 @@ Controller::onAppSourceData(Client *client, Request *req, const MemoryKit::mbuf
 				.feed(buffer));
 			resp->bodyAlreadyRead += event.consumed;
 
-			if (req->dechunkResponse) {
+			if (req->dechunkResponse || resp->compressor != NULL) {
 				UPDATE_TRACE_POINT();
 				switch (event.type) {
 				case ServerKit::HttpChunkedEvent::NONE:
@@ -295,6 +297,7 @@ Controller::onAppSourceData(Client *client, Request *req, const MemoryKit::mbuf
 			// EOF
 			UPDATE_TRACE_POINT();
 			SKC_TRACE(client, 2, "Application sent EOF");
+			finishResponseCompression(client, req);
 			SKC_TRACE(client, 2, "Not keep-aliving application session connection");
 			req->session->close(true, false);
 			endRequest(&client, &req);
@@ -317,7 +320,7 @@ Controller::onAppResponseBegin(Client *client, Request *req) {
 	TRACE_POINT();
 	AppResponse *resp = &req->appResponse;
 	ssize_t bytesWritten;
-	bool oobw;
+	bool oobw, serveFile = false;
 
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		req->timeOnRequestHeaderSent = ev_now(getLoop());
@@ -327,6 +330,10 @@ Controller::onAppResponseBegin(Client *client, Request *req) {
 			ev_now(getLoop()));
 	#endif
 
+	if (resp->statusCode >= 500 && respondFromTurboCacheOnError(&client, &req)) {
+		return;
+	}
+
 	// Localize hash table operations for better CPU caching.
 	oobw = resp->secureHeaders.lookup(PASSENGER_REQUEST_OOB_WORK) != NULL;
 	resp->date = resp->headers.lookup(HTTP_DATE);
@@ -360,14 +367,20 @@ Controller::onAppResponseBegin(Client *client, Request *req) {
 	if (resp->headers.lookup(ServerKit::HTTP_X_SENDFILE) != NULL
 	 || resp->headers.lookup(ServerKit::HTTP_X_ACCEL_REDIRECT) != NULL)
 	{
-		// If X-Sendfile or X-Accel-Redirect is set, then HttpHeaderParser
-		// treats the app response as having no body, and removes the
-		// Content-Length and Transfer-Encoding headers. Because of this,
-		// the response that we output also doesn't Content-Length
-		// or Transfer-Encoding. So we should disable keep-alive.
-		req->wantKeepAlive = false;
+		serveFile = canServeAppResponseFile(client, req);
+		if (!serveFile) {
+			// If X-Sendfile or X-Accel-Redirect is set, then HttpHeaderParser
+			// treats the app response as having no body, and removes the
+			// Content-Length and Transfer-Encoding headers. Because of this,
+			// the response that we output also doesn't Content-Length
+			// or Transfer-Encoding. So we should disable keep-alive.
+			req->wantKeepAlive = false;
+		}
 	}
 
+	if (!serveFile) {
+		prepareAppResponseCompression(client, req);
+	}
 	prepareAppResponseCaching(client, req);
 
 	if (OXT_UNLIKELY(oobw)) {
@@ -377,6 +390,11 @@ Controller::onAppResponseBegin(Client *client, Request *req) {
 		}
 	}
 
+	if (serveFile) {
+		serveAppResponseFile(client, req);
+		return;
+	}
+
 	UPDATE_TRACE_POINT();
 	if (!sendResponseHeaderWithWritev(client, req, bytesWritten)) {
 		UPDATE_TRACE_POINT();
@@ -396,6 +414,139 @@ Controller::onAppResponseBegin(Client *client, Request *req) {
 	}
 }
 
+/**
+ * Decides whether we compress the response body ourselves and, if so, sets
+ * up `req->appResponse.compressor` and adjusts the response headers
+ * accordingly. This must happen before prepareAppResponseCaching() so that
+ * the turbocache sees the Vary header that we add, and stores the
+ * compressed variant.
+ */
+void
+Controller::prepareAppResponseCompression(Client *client, Request *req) {
+	if (!req->config->responseCompression || !appResponseIsCompressible(client, req)) {
+		return;
+	}
+
+	TRACE_POINT();
+	AppResponse *resp = &req->appResponse;
+	const LString *value = req->headers.lookup(HTTP_ACCEPT_ENCODING);
+	if (value == NULL || value->size == 0) {
+		return;
+	}
+	value = psg_lstr_make_contiguous(value, req->pool);
+	ServerKit::ContentCoding coding = ServerKit::negotiateContentCoding(
+		StaticString(value->start->data, value->size));
+	if (coding == ServerKit::CC_IDENTITY) {
+		return;
+	}
+
+	// Without chunked framing, the only way to tell the client where the
+	// compressed body ends is to close the connection.
+	unsigned int httpVersion = req->httpMajor * 1000 + req->httpMinor * 10;
+	bool chunked = !req->dechunkResponse && httpVersion >= 1010;
+	boost::uint64_t expectedSize = (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH)
+		? resp->aux.bodyInfo.contentLength
+		: 0;
+
+	resp->compressor = new ResponseCompressor();
+	if (!resp->compressor->initialize(&getContext()->mbuf_pool, coding,
+		req->config->responseCompressionLevel, expectedSize, chunked))
+	{
+		SKC_WARN(client, "Cannot initialize response compression");
+		delete resp->compressor;
+		resp->compressor = NULL;
+		return;
+	}
+	SKC_TRACE(client, 2, "Compressing response body with " <<
+		ServerKit::getContentCodingName(coding));
+
+	if (!chunked) {
+		req->wantKeepAlive = false;
+	}
+	resp->headers.insert(req->pool, P_STATIC_STRING("Content-Encoding"),
+		ServerKit::getContentCodingName(coding));
+
+	value = resp->headers.lookup(HTTP_VARY);
+	if (value == NULL) {
+		resp->headers.insert(req->pool, P_STATIC_STRING("Vary"),
+			P_STATIC_STRING("Accept-Encoding"));
+	} else {
+		// HeaderTable joins the new value with the existing one.
+		value = psg_lstr_make_contiguous(value, req->pool);
+		StaticString vary(value->start->data, value->size);
+		bool found = false;
+		for (string::size_type i = 0; i < vary.size() && !found; i++) {
+			found = vary[i] == '*'
+				|| (vary.size() - i >= sizeof("accept-encoding") - 1
+					&& strncasecmp(vary.data() + i, "accept-encoding",
+						sizeof("accept-encoding") - 1) == 0);
+		}
+		if (!found) {
+			resp->headers.insert(req->pool, P_STATIC_STRING("Vary"),
+				P_STATIC_STRING("Accept-Encoding"));
+		}
+	}
+
+	// The compressed representation is not byte-for-byte identical to the
+	// one that the app tagged, so a strong validator must become a weak one.
+	LString *etag = resp->headers.lookup(HTTP_ETAG);
+	if (etag != NULL && etag->size > 0
+	 && !(etag->size >= 2 && etag->start->size >= 2 && memcmp(etag->start->data, "W/", 2) == 0))
+	{
+		const LString *contiguousEtag = psg_lstr_make_contiguous(etag, req->pool);
+		char *weakEtag = (char *) psg_pnalloc(req->pool, contiguousEtag->size + 2);
+		memcpy(weakEtag, "W/", 2);
+		memcpy(weakEtag + 2, contiguousEtag->start->data, contiguousEtag->size);
+		unsigned int size = contiguousEtag->size + 2;
+		psg_lstr_deinit(etag);
+		psg_lstr_init(etag);
+		psg_lstr_append(etag, req->pool, weakEtag, size);
+	}
+}
+
+bool
+Controller::appResponseIsCompressible(Client *client, Request *req) {
+	AppResponse *resp = &req->appResponse;
+	const LString *value;
+
+	if (mainConfig.benchmarkMode == BM_RESPONSE_BEGIN
+	 || req->method == HTTP_HEAD
+	 || !resp->hasBody()
+	 || resp->upgraded()
+	 || resp->statusCode == 206)
+	{
+		return false;
+	}
+	if (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH
+	 && resp->aux.bodyInfo.contentLength < req->config->responseCompressionMinSize)
+	{
+		return false;
+	}
+	if (resp->headers.lookup(HTTP_CONTENT_ENCODING) != NULL) {
+		return false;
+	}
+
+	value = resp->headers.lookup(HTTP_CONTENT_TYPE);
+	if (value == NULL || value->size == 0) {
+		return false;
+	}
+	value = psg_lstr_make_contiguous(value, req->pool);
+	if (!ServerKit::isCompressibleContentType(StaticString(value->start->data, value->size))) {
+		return false;
+	}
+
+	value = resp->headers.lookup(HTTP_CACHE_CONTROL);
+	if (value != NULL && value->size > 0) {
+		value = psg_lstr_make_contiguous(value, req->pool);
+		StaticString cacheControl(value->start->data, value->size);
+		if (cacheControl.find("no-transform") != string::npos) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void
 Controller::prepareAppResponseCaching(Client *client, Request *req) {
 	if (turboCaching.isEnabled() && !req->cacheKey.empty()) {
@@ -406,24 +557,27 @@ Controller::prepareAppResponseCaching(Client *client, Request *req) {
 		 && turboCaching.responseCache.prepareRequestForStoring(req))
 		{
 			if (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH
-			 && resp->aux.bodyInfo.contentLength > ResponseCache<Request>::MAX_BODY_SIZE)
+			 && resp->aux.bodyInfo.contentLength > turboCaching.responseCache.getMaxBodySize())
 			{
 				SKC_DEBUG(client, "Response body larger than " <<
-					ResponseCache<Request>::MAX_BODY_SIZE <<
+					turboCaching.responseCache.getMaxBodySize() <<
 					" bytes, so response is not eligible for turbocaching");
 				// Decrease store success ratio.
 				turboCaching.responseCache.incStores();
+				releaseCollapsedRequests(req);
 				req->cacheKey = HashedStaticString();
 			}
 		} else if (turboCaching.responseCache.requestAllowsInvalidating(req)) {
 			SKC_DEBUG(client, "Processing turbocache invalidation based on response");
 			turboCaching.responseCache.invalidate(req);
+			releaseCollapsedRequests(req);
 			req->cacheKey = HashedStaticString();
 			SKC_TRACE(client, 2, "Turbocache entries:\n" << turboCaching.responseCache.inspect());
 		} else {
 			SKC_TRACE(client, 2, "Turbocache: response not eligible for turbocaching");
 			// Decrease store success ratio.
 			turboCaching.responseCache.incStores();
+			releaseCollapsedRequests(req);
 			req->cacheKey = HashedStaticString();
 		}
 	}
@@ -674,7 +828,11 @@ Controller::constructHeaderBuffersForResponse(Request *req, struct iovec *buffer
 
 	nCacheableBuffers = i;
 
-	if (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH) {
+	if (resp->compressor != NULL) {
+		if (resp->compressor->isChunked()) {
+			PUSH_STATIC_BUFFER("Transfer-Encoding: chunked\r\n");
+		}
+	} else if (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH) {
 		PUSH_STATIC_BUFFER("Content-Length: ");
 		if (buffers != NULL) {
 			BEGIN_PUSH_NEXT_BUFFER();
@@ -712,7 +870,7 @@ Controller::constructHeaderBuffersForResponse(Request *req, struct iovec *buffer
 	}
 
 	if (req->stickySession) {
-		StaticString baseURI = req->options.baseURI;
+		StaticString baseURI = req->options->baseURI;
 		if (baseURI.empty()) {
 			baseURI = P_STATIC_STRING("/");
 		}
@@ -812,6 +970,12 @@ Controller::sendResponseHeaderWithWritev(Client *client, Request *req,
 		writeBenchmarkResponse(&client, &req, false);
 		return true;
 	}
+	if (client->getFd() == -1) {
+		// The client is an HTTP/2 stream; all output goes through
+		// client->output.
+		bytesWritten = 0;
+		return false;
+	}
 
 	unsigned int maxbuffers = std::min<unsigned int>(
 		8 + req->appResponse.headers.size() * 4 + 11, IOV_MAX);
@@ -940,6 +1104,7 @@ Controller::markHeaderBuffersForTurboCaching(Client *client, Request *req,
 				" bytes, so response is not eligible for turbocaching");
 			// Decrease store success ratio.
 			turboCaching.responseCache.incStores();
+			releaseCollapsedRequests(req);
 			req->cacheKey = HashedStaticString();
 		} else {
 			req->appResponse.headerCacheBuffers = buffers;
@@ -983,6 +1148,15 @@ void
 Controller::writeResponseAndMarkForTurboCaching(Client *client, Request *req,
 	const MemoryKit::mbuf &buffer)
 {
+	if (req->appResponse.compressor != NULL) {
+		if (!req->appResponse.compressor->feed(buffer.start, buffer.size(),
+			onCompressedResponseData, client)
+		 && !req->ended())
+		{
+			disconnectWithError(&client, "error compressing response body");
+		}
+		return;
+	}
 	if (OXT_LIKELY(mainConfig.benchmarkMode != BM_RESPONSE_BEGIN)) {
 		writeResponse(client, buffer);
 	}
@@ -995,12 +1169,13 @@ Controller::markResponsePartForTurboCaching(Client *client, Request *req,
 {
 	if (!req->ended() && turboCaching.isEnabled() && !req->cacheKey.empty()) {
 		unsigned int totalSize = req->appResponse.bodyCacheBuffer.size + buffer.size();
-		if (totalSize > ResponseCache<Request>::MAX_BODY_SIZE) {
+		if (totalSize > turboCaching.responseCache.getMaxBodySize()) {
 			SKC_DEBUG(client, "Response body larger than " <<
-				ResponseCache<Request>::MAX_HEADER_SIZE <<
+				turboCaching.responseCache.getMaxBodySize() <<
 				" bytes, so response is not eligible for turbocaching");
 			// Decrease store success ratio.
 			turboCaching.responseCache.incStores();
+			releaseCollapsedRequests(req);
 			req->cacheKey = HashedStaticString();
 			psg_lstr_deinit(&req->appResponse.bodyCacheBuffer);
 		} else {
@@ -1010,6 +1185,43 @@ Controller::markResponsePartForTurboCaching(Client *client, Request *req,
 	}
 }
 
+bool
+Controller::onCompressedResponseData(void *userData, const MemoryKit::mbuf &output,
+	const MemoryKit::mbuf &payload)
+{
+	Client *client = static_cast<Client *>(userData);
+	Request *req = static_cast<Request *>(client->currentRequest);
+	Controller *self = static_cast<Controller *>(getServerFromClient(client));
+
+	self->writeResponse(client, output);
+	self->markResponsePartForTurboCaching(client, req, payload);
+	return !req->ended();
+}
+
+void
+Controller::finishResponseCompression(Client *client, Request *req) {
+	ResponseCompressor *compressor = req->appResponse.compressor;
+	if (compressor == NULL || compressor->isFinished()) {
+		return;
+	}
+
+	if (compressor->finish(onCompressedResponseData, client)) {
+		if (compressor->isChunked()) {
+			writeResponse(client, P_STATIC_STRING("0\r\n\r\n"));
+		}
+		SKC_TRACE(client, 2, "Compressed response body from " <<
+			compressor->getBytesIn() << " to " << compressor->getBytesOut() <<
+			" bytes");
+	} else if (!req->ended()) {
+		// Leave the body unterminated so that the client notices that it
+		// is incomplete, and don't cache it.
+		SKC_WARN(client, "Error finishing response body compression");
+		req->wantKeepAlive = false;
+		releaseCollapsedRequests(req);
+		req->cacheKey = HashedStaticString();
+	}
+}
+
 void
 Controller::maybeThrottleAppSource(Client *client, Request *req) {
 	if (!req->ended()) {
@@ -1080,6 +1292,7 @@ Controller::outputDataFlushed(Client *client, Request *req) {
 
 void
 Controller::handleAppResponseBodyEnd(Client *client, Request *req) {
+	finishResponseCompression(client, req);
 	keepAliveAppConnection(client, req);
 	storeAppResponseInTurboCache(client, req);
 	finalizeUnionStationWithSuccess(client, req);
@@ -1092,6 +1305,12 @@ Controller::keepAliveAppConnection(Client *client, Request *req) {
 		SKC_TRACE(client, 2, "Not keep-aliving application session connection"
 			" because it had been half-closed before");
 		req->session->close(true, false);
+	} else if (req->state != Request::WAITING_FOR_APP_OUTPUT || req->appSink.hasError()) {
+		// The application responded before it received the entire request
+		// body, so the connection may still carry (part of) that body.
+		SKC_TRACE(client, 2, "Not keep-aliving application session connection"
+			" because the request body was not completely sent to it");
+		req->session->close(true, false);
 	} else {
 		// halfClosePolicy is initialized in sendHeaderToApp(). That method is
 		// called immediately after checking out a session, before any events
@@ -1112,37 +1331,16 @@ void
 Controller::storeAppResponseInTurboCache(Client *client, Request *req) {
 	if (turboCaching.isEnabled() && !req->cacheKey.empty()) {
 		TRACE_POINT();
-		AppResponse *resp = &req->appResponse;
-		unsigned int headerSize = 0;
-		unsigned int i;
-
-		for (i = 0; i < resp->nHeaderCacheBuffers; i++) {
-			headerSize += resp->headerCacheBuffers[i].iov_len;
-		}
 		ResponseCache<Request>::Entry entry(
-			turboCaching.responseCache.store(req, ev_now(getLoop()),
-				headerSize, resp->bodyCacheBuffer.size));
+			turboCaching.responseCache.store(req, ev_now(getLoop())));
 		if (entry.valid()) {
-			UPDATE_TRACE_POINT();
-			SKC_DEBUG(client, "Storing app response in turbocache");
+			SKC_DEBUG(client, "Stored app response in turbocache");
 			SKC_TRACE(client, 2, "Turbocache entries:\n" << turboCaching.responseCache.inspect());
-
-			gatherBuffers(entry.body->httpHeaderData,
-				ResponseCache<Request>::MAX_HEADER_SIZE,
-				resp->headerCacheBuffers, resp->nHeaderCacheBuffers);
-
-			char *pos = entry.body->httpBodyData;
-			const char *end = entry.body->httpBodyData
-				+ ResponseCache<Request>::MAX_BODY_SIZE;
-			const LString::Part *part = resp->bodyCacheBuffer.start;
-			while (part != NULL) {
-				pos = appendData(pos, end, part->data, part->size);
-				part = part->next;
-			}
 		} else {
 			SKC_DEBUG(client, "Could not store app response for turbocaching");
 		}
 	}
+	releaseCollapsedRequests(req);
 }
 
 void
@@ -79,6 +79,26 @@ Controller::onEventLoopCheck(EV_P_ struct ev_check *w, int revents) {
 	#endif
 }
 
+void
+Controller::onCollapsedForwardingTimeout(EV_P_ struct ev_timer *w, int revents) {
+	Controller *self = static_cast<Controller *>(w->data);
+	ev_tstamp now = ev_now(EV_A);
+	Request *leader;
+
+	while ((leader = self->collapsedForwarding.getExpiredLeader(now)) != NULL) {
+		P_DEBUG("Collapsed forwarding: response for \"" <<
+			cEscapeString(leader->cacheKey) << "\" took too long;"
+			" resuming waiting requests");
+		self->releaseCollapsedRequests(leader);
+	}
+
+	if (self->collapsedForwarding.getLeaderCount() > 0) {
+		ev_timer_set(w, std::max<ev_tstamp>(
+			self->collapsedForwarding.getNextDeadline() - now, 0.001), 0);
+		ev_timer_start(EV_A_ w);
+	}
+}
+
 
 /****************************
  *
@@ -107,6 +127,13 @@ Controller::onRequestObjectCreated(Client *client, Request *req) {
 	req->bodyBuffer.setContext(getContext());
 	req->bodyBuffer.setHooks(&req->hooks);
 	req->bodyBuffer.setDataCallback(onBodyBufferData);
+
+	ev_io_init(&req->fileBodyWatcher, onFileBodySocketWritable, -1, EV_WRITE);
+	req->fileBodyWatcher.data = req;
+	ev_io_init(&req->requestBodySpliceWatcher, onRequestBodySpliceEvent, -1, EV_READ);
+	req->requestBodySpliceWatcher.data = req;
+	ev_io_init(&req->responseBodySpliceWatcher, onResponseBodySpliceEvent, -1, EV_READ);
+	req->responseBodySpliceWatcher.data = req;
 }
 
 void
@@ -134,13 +161,18 @@ Controller::reinitializeRequest(Client *client, Request *req) {
 	req->appResponseInitialized = false;
 	req->strip100ContinueHeader = false;
 	req->hasPragmaHeader = false;
+	req->leadingCollapsedRequests = false;
 	req->host = NULL;
 	req->config = requestConfig;
 	req->bodyBytesBuffered = 0;
 	req->cacheKey = HashedStaticString();
 	req->cacheControl = NULL;
 	req->varyCookie = NULL;
+	req->staleCacheEntry = ResponseCacheEntry();
+	req->collapsedLeader = NULL;
 	req->envvars = NULL;
+	req->fileBodyOffset = 0;
+	req->fileBodyRemaining = 0;
 
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		req->timedAppPoolGet = false;
@@ -154,6 +186,11 @@ Controller::reinitializeRequest(Client *client, Request *req) {
 
 void
 Controller::deinitializeRequest(Client *client, Request *req) {
+	if (req->collapsedLeader != NULL) {
+		collapsedForwarding.removeWaiter(req);
+	}
+	releaseCollapsedRequests(req);
+
 	req->session.reset();
 	req->config.reset();
 
@@ -162,7 +199,10 @@ Controller::deinitializeRequest(Client *client, Request *req) {
 	req->endStopwatchLog(&req->stopwatchLogs.requestProxying, false);
 	req->endStopwatchLog(&req->stopwatchLogs.requestProcessing, false);
 
-	req->options.transaction.reset();
+	req->options = &req->ownOptions;
+	req->optionsSnapshot.reset();
+	req->ownOptions.transaction.reset();
+	req->staleCacheEntry = ResponseCacheEntry();
 
 	req->appSink.setConsumedCallback(NULL);
 	req->appSink.deinitialize();
@@ -170,6 +210,18 @@ Controller::deinitializeRequest(Client *client, Request *req) {
 	req->bodyBuffer.clearBuffersFlushedCallback();
 	req->bodyBuffer.deinitialize();
 
+	if (req->fileBody != -1) {
+		ev_io_stop(getLoop(), &req->fileBodyWatcher);
+		if (client->output.getDataFlushedCallback() == _fileBodyOutputFlushed) {
+			client->output.setDataFlushedCallback(getClientOutputDataFlushedCallback());
+		}
+		// Don't close(): the file descriptor is shared with openFileCache.
+		req->fileBody = FileDescriptor();
+	}
+	if (req->requestBodyPipe.isOpen() || req->responseBodyPipe.isOpen()) {
+		stopSplicing(client, req);
+	}
+
 	/***************/
 	/***************/
 
@@ -202,10 +254,12 @@ Controller::reinitializeAppResponse(Client *client, Request *req) {
 	resp->cacheControl = NULL;
 	resp->expiresHeader = NULL;
 	resp->lastModifiedHeader = NULL;
+	resp->vary = NULL;
 
 	resp->headerCacheBuffers = NULL;
 	resp->nHeaderCacheBuffers = 0;
 	psg_lstr_init(&resp->bodyCacheBuffer);
+	resp->compressor = NULL;
 }
 
 void
@@ -244,6 +298,9 @@ Controller::deinitializeAppResponse(Client *client, Request *req) {
 		psg_lstr_deinit(resp->setCookie);
 	}
 	psg_lstr_deinit(&resp->bodyCacheBuffer);
+
+	delete resp->compressor;
+	resp->compressor = NULL;
 }
 
 ServerKit::Channel::Result
@@ -264,7 +321,11 @@ Controller::onRequestBody(Client *client, Request *req, const MemoryKit::mbuf &b
 void
 Controller::onNextRequestEarlyReadError(Client *client, Request *req, int errcode) {
 	ParentClass::onNextRequestEarlyReadError(client, req, errcode);
-	if (req->halfClosePolicy == Request::HALF_CLOSE_UPON_NEXT_REQUEST_EARLY_READ_ERROR) {
+	// When a file is served on behalf of the app, the session may
+	// already have been closed.
+	if (req->halfClosePolicy == Request::HALF_CLOSE_UPON_NEXT_REQUEST_EARLY_READ_ERROR
+	 && !req->session->isClosed())
+	{
 		SKC_TRACE(client, 3, "Half-closing application socket with SHUT_WR"
 			" because the next request's early read error has been detected: "
 			<< ServerKit::getErrorDesc(errcode) << " (errno=" << errcode << ")");
@@ -114,17 +114,15 @@ Controller::respondFromTurboCache(Client *client, Request *req) {
 			ev_now(getLoop())));
 		if (entry.valid()) {
 			SKC_TRACE(client, 2, "Turbocaching: cache hit (key \"" <<
-				cEscapeString(req->cacheKey) << "\")");
-			turboCaching.writeResponse(this, client, req, entry);
-			if (!req->ended()) {
-				endRequest(&client, &req);
-			}
+				cEscapeString(req->cacheKey) << "\"" <<
+				(entry.stale ? ", stale" : "") << ")");
+			respondWithTurboCacheEntry(client, req, entry);
 			return true;
 		} else {
 			SKC_TRACE(client, 2, "Turbocaching: cache miss: " <<
 				entry.getCacheMissReasonString() <<
 				" (key \"" << cEscapeString(req->cacheKey) << "\")");
-			return false;
+			return collapseRequest(client, req);
 		}
 	} else {
 		SKC_TRACE(client, 2, "Turbocaching: request not eligible for caching");
@@ -132,14 +130,150 @@ Controller::respondFromTurboCache(Client *client, Request *req) {
 	}
 }
 
+void
+Controller::respondWithTurboCacheEntry(Client *client, Request *req,
+	ResponseCache<Request>::Entry &entry)
+{
+	if (turboCaching.responseCache.requestIsNotModified(req, entry)) {
+		SKC_TRACE(client, 2, "Turbocaching: responding with 304 Not Modified");
+		turboCaching.writeNotModifiedResponse(this, client, req, entry);
+	} else {
+		turboCaching.writeResponse(this, client, req, entry);
+	}
+	if (!req->ended()) {
+		endRequest(&client, &req);
+	}
+}
+
+/**
+ * Called upon a turbocache miss. If another request with the same cache key
+ * is already being forwarded to the app, then parks this request until that
+ * request's response is available, and returns true. Otherwise registers this
+ * request as the one that is forwarded, and returns false.
+ */
+bool
+Controller::collapseRequest(Client *client, Request *req) {
+	if (!collapsedForwarding.isEnabled()
+	 || req->hasBody()
+	 || !turboCaching.responseCache.requestAllowsStoring(req))
+	{
+		return false;
+	}
+
+	Request *leader = collapsedForwarding.lookupLeader(req->cacheKey);
+	if (leader == NULL) {
+		SKC_TRACE(client, 2, "Collapsed forwarding: forwarding request to the app,"
+			" identical requests will wait for its response");
+		collapsedForwarding.addLeader(req, ev_now(getLoop()));
+		if (!ev_is_active(&collapsedForwardingTimer)) {
+			ev_timer_set(&collapsedForwardingTimer, collapsedForwarding.getTimeout(), 0);
+			ev_timer_start(getLoop(), &collapsedForwardingTimer);
+		}
+		return false;
+	} else {
+		SKC_DEBUG(client, "Collapsed forwarding: waiting for the response of an"
+			" identical request that is being forwarded to the app");
+		req->state = Request::WAITING_FOR_COLLAPSED_RESPONSE;
+		collapsedForwarding.addWaiter(leader, req);
+		return true;
+	}
+}
+
+/**
+ * Unregisters the given request as the one whose response is waited for,
+ * and resumes all requests that are waiting for it. Called once its response
+ * has been stored in the turbocache, turned out to be uncacheable, or when
+ * the request is ended otherwise.
+ */
+void
+Controller::releaseCollapsedRequests(Request *leader) {
+	if (!leader->leadingCollapsedRequests) {
+		return;
+	}
+
+	Request *req;
+	collapsedForwarding.removeLeader(leader);
+	while ((req = collapsedForwarding.popWaiter(leader)) != NULL) {
+		// Resume the request outside the leader's processing context.
+		refRequest(req, __FILE__, __LINE__);
+		getContext()->libev->runLater(boost::bind(resumeCollapsedRequestLater, req));
+	}
+}
+
+void
+Controller::resumeCollapsedRequestLater(Request *req) {
+	Client *client = static_cast<Client *>(req->client);
+	Controller *self = static_cast<Controller *>(
+		Controller::getServerFromClient(client));
+	SKC_LOG_EVENT_FROM_STATIC(self, Controller, client, "resumeCollapsedRequestLater");
+
+	if (!req->ended()) {
+		self->resumeCollapsedRequest(client, req);
+	}
+	self->unrefRequest(req, __FILE__, __LINE__);
+}
+
+void
+Controller::resumeCollapsedRequest(Client *client, Request *req) {
+	TRACE_POINT();
+	ResponseCache<Request>::Entry entry(turboCaching.responseCache.fetch(req,
+		ev_now(getLoop())));
+
+	req->state = Request::ANALYZING_REQUEST;
+	if (entry.valid()) {
+		SKC_TRACE(client, 2, "Collapsed forwarding: responding from turbocache");
+		respondWithTurboCacheEntry(client, req, entry);
+	} else {
+		SKC_DEBUG(client, "Collapsed forwarding: no cached response available,"
+			" forwarding request to the app");
+		RequestAnalysis analysis;
+		analysis.flags = NULL;
+		analysis.appGroupNameCell = mainConfig.singleAppMode
+			? NULL
+			: req->secureHeaders.lookupCell(PASSENGER_APP_GROUP_NAME);
+		analysis.unionStationSupport = unionStationContext != NULL
+			&& getBoolOption(req, UNION_STATION_SUPPORT, false);
+		forwardRequestToApp(client, req, analysis);
+	}
+}
+
+void
+Controller::forwardRequestToApp(Client *client, Request *req, RequestAnalysis &analysis) {
+	initializePoolOptions(client, req, analysis);
+	if (req->ended()) {
+		return;
+	}
+	initializeUnionStation(client, req, analysis);
+	if (req->ended()) {
+		return;
+	}
+	setStickySessionId(client, req);
+
+	if (!req->hasBody() || !req->requestBodyBuffering) {
+		req->requestBodyBuffering = false;
+		checkoutSession(client, req);
+	} else {
+		beginBufferingBody(client, req);
+	}
+}
+
 void
 Controller::initializePoolOptions(Client *client, Request *req, RequestAnalysis &analysis) {
-	boost::shared_ptr<Options> *options;
+	boost::shared_ptr<const Options> *options;
+
+	// See comment for req->envvars to learn how it is different
+	// from req->options->environmentVariables.
+	req->envvars = req->secureHeaders.lookup(PASSENGER_ENV_VARS);
+	if (req->envvars != NULL && req->envvars->size > 0) {
+		req->envvars = psg_lstr_make_contiguous(req->envvars, req->pool);
+	} else {
+		req->envvars = NULL;
+	}
 
 	if (mainConfig.singleAppMode) {
 		P_ASSERT_EQ(poolOptionsCache.size(), 1);
 		poolOptionsCache.lookupRandom(NULL, &options);
-		req->options = **options;
+		req->setOptionsSnapshot(*options);
 	} else {
 		ServerKit::HeaderTable::Cell *appGroupNameCell = analysis.appGroupNameCell;
 		if (appGroupNameCell != NULL && appGroupNameCell->header->val.size > 0) {
@@ -152,7 +286,7 @@ Controller::initializePoolOptions(Client *client, Request *req, RequestAnalysis
 			poolOptionsCache.lookup(hAppGroupName, &options);
 
 			if (options != NULL) {
-				req->options = **options;
+				req->setOptionsSnapshot(*options);
 			} else {
 				createNewPoolOptions(client, req, hAppGroupName);
 			}
@@ -162,18 +296,21 @@ Controller::initializePoolOptions(Client *client, Request *req, RequestAnalysis
 	}
 
 	if (!req->ended()) {
-		// See comment for req->envvars to learn how it is different
-		// from req->options.environmentVariables.
-		req->envvars = req->secureHeaders.lookup(PASSENGER_ENV_VARS);
-		if (req->envvars != NULL && req->envvars->size > 0) {
-			req->envvars = psg_lstr_make_contiguous(req->envvars, req->pool);
-			req->options.environmentVariables = StaticString(
-				req->envvars->start->data,
-				req->envvars->size);
+		// Allow certain options to be overridden on a per-request basis.
+		// The snapshot is only copied if an override actually differs
+		// from the app group's value, which is rare.
+		if (req->envvars != NULL) {
+			StaticString envvars(req->envvars->start->data, req->envvars->size);
+			if (envvars != req->options->environmentVariables) {
+				req->mutableOptions().environmentVariables = envvars;
+			}
 		}
 
-		// Allow certain options to be overridden on a per-request basis
-		fillPoolOption(req, req->options.maxRequests, PASSENGER_MAX_REQUESTS);
+		unsigned long maxRequests = req->options->maxRequests;
+		fillPoolOption(req, maxRequests, PASSENGER_MAX_REQUESTS);
+		if (maxRequests != req->options->maxRequests) {
+			req->mutableOptions().maxRequests = maxRequests;
+		}
 	}
 }
 
@@ -200,6 +337,10 @@ Controller::fillPoolOptionsFromConfigCaches(Options &options,
 	options.maxRequestQueueSize = requestConfig->defaultMaxRequestQueueSize;
 	options.abortWebsocketsOnProcessShutdown = requestConfig->defaultAbortWebsocketsOnProcessShutdown;
 	options.forceMaxConcurrentRequestsPerProcess = requestConfig->defaultForceMaxConcurrentRequestsPerProcess;
+	options.routingStrategy = requestConfig->defaultRoutingStrategy;
+	options.spawnConcurrency = requestConfig->defaultSpawnConcurrency;
+	options.predictiveSpawning = requestConfig->defaultPredictiveSpawning;
+	options.memoryLimit = requestConfig->defaultMemoryLimit;
 	options.environment = requestConfig->defaultEnvironment;
 	options.spawnMethod = requestConfig->defaultSpawnMethod;
 	options.loadShellEnvvars = requestConfig->defaultLoadShellEnvvars;
@@ -274,6 +415,24 @@ Controller::fillPoolOption(Request *req, long &field,
 	}
 }
 
+void
+Controller::fillPoolOption(Request *req, RoutingStrategy &field,
+	const HashedStaticString &name)
+{
+	const LString *value = req->secureHeaders.lookup(name);
+	if (value != NULL && value->size > 0) {
+		value = psg_lstr_make_contiguous(value, req->pool);
+		RoutingStrategy strategy = parseRoutingStrategy(
+			StaticString(value->start->data, value->size));
+		if (strategy != RS_UNKNOWN) {
+			field = strategy;
+		} else {
+			P_WARN("Ignoring unknown routing strategy '" <<
+				StaticString(value->start->data, value->size) << "'");
+		}
+	}
+}
+
 void
 Controller::fillPoolOptionSecToMsec(Request *req, unsigned int &field,
 	const HashedStaticString &name)
@@ -290,7 +449,7 @@ Controller::createNewPoolOptions(Client *client, Request *req,
 	const HashedStaticString &appGroupName)
 {
 	ServerKit::HeaderTable &secureHeaders = req->secureHeaders;
-	Options &options = req->options;
+	Options &options = req->ownOptions;
 
 	SKC_TRACE(client, 2, "Creating new pool options: app group name=" << appGroupName);
 
@@ -370,6 +529,10 @@ Controller::createNewPoolOptions(Client *client, Request *req,
 	fillPoolOption(req, options.maxRequestQueueSize, "!~PASSENGER_MAX_REQUEST_QUEUE_SIZE");
 	fillPoolOption(req, options.abortWebsocketsOnProcessShutdown, "!~PASSENGER_ABORT_WEBSOCKETS_ON_PROCESS_SHUTDOWN");
 	fillPoolOption(req, options.forceMaxConcurrentRequestsPerProcess, "!~PASSENGER_FORCE_MAX_CONCURRENT_REQUESTS_PER_PROCESS");
+	fillPoolOption(req, options.routingStrategy, "!~PASSENGER_ROUTING_STRATEGY");
+	fillPoolOption(req, options.spawnConcurrency, "!~PASSENGER_SPAWN_CONCURRENCY");
+	fillPoolOption(req, options.predictiveSpawning, "!~PASSENGER_PREDICTIVE_SPAWNING");
+	fillPoolOption(req, options.memoryLimit, "!~PASSENGER_MEMORY_LIMIT");
 	fillPoolOption(req, options.restartDir, "!~PASSENGER_RESTART_DIR");
 	fillPoolOption(req, options.startupFile, "!~PASSENGER_STARTUP_FILE");
 	fillPoolOption(req, options.loadShellEnvvars, "!~PASSENGER_LOAD_SHELL_ENVVARS");
@@ -383,12 +546,13 @@ Controller::createNewPoolOptions(Client *client, Request *req,
 	optionsCopy->clearPerRequestFields();
 	optionsCopy->detachFromUnionStationTransaction();
 	poolOptionsCache.insert(options.getAppGroupName(), optionsCopy);
+	req->setOptionsSnapshot(optionsCopy);
 }
 
 void
 Controller::initializeUnionStation(Client *client, Request *req, RequestAnalysis &analysis) {
 	if (analysis.unionStationSupport) {
-		Options &options = req->options;
+		Options &options = req->mutableOptions();
 		ServerKit::HeaderTable &headers = req->secureHeaders;
 
 		const LString *key = headers.lookup("!~UNION_STATION_KEY");
@@ -436,7 +600,7 @@ Controller::setStickySessionId(Client *client, Request *req) {
 			foreach (cookie, cookies) {
 				if (psg_lstr_cmp(cookieName, cookie.first)) {
 					// This cookie matches the one we're looking for.
-					req->options.stickySessionId = stringToUint(cookie.second);
+					req->mutableOptions().stickySessionId = stringToUint(cookie.second);
 					return;
 				}
 			}
@@ -494,22 +658,7 @@ Controller::onRequestBegin(Client *client, Request *req) {
 		if (respondFromTurboCache(client, req)) {
 			return;
 		}
-		initializePoolOptions(client, req, analysis);
-		if (req->ended()) {
-			return;
-		}
-		initializeUnionStation(client, req, analysis);
-		if (req->ended()) {
-			return;
-		}
-		setStickySessionId(client, req);
-	}
-
-	if (!req->hasBody() || !req->requestBodyBuffering) {
-		req->requestBodyBuffering = false;
-		checkoutSession(client, req);
-	} else {
-		beginBufferingBody(client, req);
+		forwardRequestToApp(client, req, analysis);
 	}
 }
 
@@ -46,6 +46,7 @@ using namespace boost;
 
 Controller::~Controller() {
 	ev_check_stop(getLoop(), &checkWatcher);
+	ev_timer_stop(getLoop(), &collapsedForwardingTimer);
 	delete singleAppModeConfig;
 }
 
@@ -56,6 +57,9 @@ Controller::preinitialize() {
 	ev_check_start(getLoop(), &checkWatcher);
 	checkWatcher.data = this;
 
+	ev_timer_init(&collapsedForwardingTimer, onCollapsedForwardingTimeout, 0, 0);
+	collapsedForwardingTimer.data = this;
+
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		ev_prepare_init(&prepareWatcher, onEventLoopPrepare);
 		ev_prepare_start(getLoop(), &prepareWatcher);
@@ -85,6 +89,13 @@ Controller::preinitialize() {
 	HTTP_CONNECTION = "connection";
 	HTTP_STATUS = "status";
 	HTTP_TRANSFER_ENCODING = "transfer-encoding";
+	HTTP_ACCEPT_ENCODING = "accept-encoding";
+	HTTP_CONTENT_ENCODING = "content-encoding";
+	HTTP_CACHE_CONTROL = "cache-control";
+	HTTP_ETAG = "etag";
+	HTTP_VARY = "vary";
+	HTTP_RANGE = "range";
+	HTTP_IF_RANGE = "if-range";
 
 	/**************************/
 }
@@ -103,7 +114,19 @@ Controller::initialize() {
 	}
 
 	ParentClass::initialize();
+	if (turbocacheStore == NULL) {
+		turboCaching.responseCache.setLimits(
+			config["turbocache_max_entries"].asUInt(),
+			config["turbocache_max_memory"].asUInt(),
+			config["turbocache_max_body_size"].asUInt());
+	} else {
+		turboCaching.responseCache.setStore(turbocacheStore,
+			config["turbocache_max_body_size"].asUInt());
+	}
 	turboCaching.initialize(config["turbocaching"].asBool());
+	collapsedForwarding.initialize(config["turbocache_collapsed_forwarding"].asBool(),
+		config["turbocache_collapsed_forwarding_timeout"].asUInt());
+	openFileCache.setMaxSize(config["open_file_cache_size"].asUInt());
 
 	if (mainConfig.singleAppMode) {
 		boost::shared_ptr<Options> options = boost::make_shared<Options>();
@@ -124,6 +124,10 @@ Controller::endRequestWithSimpleResponse(Client **c, Request **r,
 	Request *req = *r;
 	ServerKit::HeaderTable headers;
 
+	if (code >= 500 && respondFromTurboCacheOnError(c, r)) {
+		return;
+	}
+
 	headers.insert(req->pool, "cache-control", "no-cache, no-store, must-revalidate");
 	writeSimpleResponse(client, code, &headers, body);
 	endRequest(c, r);
@@ -133,6 +137,8 @@ void
 Controller::endRequestAsBadGateway(Client **client, Request **req) {
 	if ((*req)->responseBegun) {
 		disconnectWithError(client, "bad gateway");
+	} else if (respondFromTurboCacheOnError(client, req)) {
+		return;
 	} else {
 		ServerKit::HeaderTable headers;
 		headers.insert((*req)->pool, "cache-control", "no-cache, no-store, must-revalidate");
@@ -141,6 +147,32 @@ Controller::endRequestAsBadGateway(Client **client, Request **req) {
 	}
 }
 
+/**
+ * Serves the stale turbocache response that was found while fetching, if
+ * the response allows being served when an error occurs (`stale-if-error`).
+ * Returns whether the request was ended.
+ */
+bool
+Controller::respondFromTurboCacheOnError(Client **c, Request **r) {
+	Client *client = *c;
+	Request *req = *r;
+
+	if (!req->staleCacheEntry.valid()
+	 || req->responseBegun
+	 || ev_now(getLoop()) >= req->staleCacheEntry.item->staleIfErrorDate)
+	{
+		return false;
+	}
+
+	SKC_DEBUG(client, "Serving stale response from turbocache because of an error");
+	ResponseCache<Request>::Entry entry(req->staleCacheEntry);
+	turboCaching.writeResponse(this, client, req, entry);
+	if (!req->ended()) {
+		endRequest(c, r);
+	}
+	return true;
+}
+
 void
 Controller::writeBenchmarkResponse(Client **client, Request **req, bool end) {
 	if (canKeepAlive(*req)) {
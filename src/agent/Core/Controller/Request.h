@@ -33,6 +33,8 @@
 #include <ServerKit/HttpRequest.h>
 #include <ServerKit/FdSinkChannel.h>
 #include <ServerKit/FdSourceChannel.h>
+#include <ServerKit/SplicePipe.h>
+#include <FileDescriptor.h>
 #include <LoggingKit/LoggingKit.h>
 #include <Core/ApplicationPool/Pool.h>
 #include <Core/UnionStation/Context.h>
@@ -40,6 +42,7 @@
 #include <Core/UnionStation/StopwatchLog.h>
 #include <Core/Controller/Config.h>
 #include <Core/Controller/AppResponse.h>
+#include <Core/ResponseCacheStore.h>
 
 namespace Passenger {
 namespace Core {
@@ -53,6 +56,7 @@ class Request: public ServerKit::BaseHttpRequest {
 public:
 	enum State {
 		ANALYZING_REQUEST,
+		WAITING_FOR_COLLAPSED_RESPONSE,
 		BUFFERING_REQUEST_BODY,
 		CHECKING_OUT_SESSION,
 		SENDING_HEADER_TO_APP,
@@ -81,8 +85,20 @@ public:
 	bool appResponseInitialized: 1;
 	bool strip100ContinueHeader: 1;
 	bool hasPragmaHeader: 1;
-
-	Options options;
+	bool leadingCollapsedRequests: 1;
+
+	/**
+	 * The pool options for this request. This usually points to an
+	 * immutable snapshot in Controller::poolOptionsCache that is shared by
+	 * all requests for the same app group, so that initializing a request
+	 * does not copy an entire Options object. Call `mutableOptions()`
+	 * before changing an option for this request only.
+	 */
+	const Options *options;
+	// Keeps the snapshot that `options` points to alive.
+	boost::shared_ptr<const Options> optionsSnapshot;
+	// Copy-on-write target for `options`; see `mutableOptions()`.
+	Options ownOptions;
 	AbstractSessionPtr session;
 	const LString *host;
 	ControllerRequestConfigPtr config;
@@ -104,14 +120,43 @@ public:
 	HashedStaticString cacheKey;
 	LString *cacheControl;
 	LString *varyCookie;
+	// A stale turbocache response that may be served if the app fails
+	// to respond. Set by ResponseCache::fetch().
+	ResponseCacheEntry staleCacheEntry;
+
+	// Collapsed forwarding; see CollapsedForwarding.h. A request is
+	// either a leader or a waiter, so they share `nextCollapsedRequest`.
+	// If this request is a waiter: the leader whose response it waits for.
+	Request *collapsedLeader;
+	// The following are only valid if `leadingCollapsedRequests`.
+	Request *nextCollapsedLeaderInBucket;
+	ev_tstamp collapsedDeadline;
+	TAILQ_HEAD(CollapsedRequestList, Request) collapsedWaiters;
+	TAILQ_ENTRY(Request) nextCollapsedRequest;
 	// Value of the `!~PASSENGER_ENV_VARS` header. This is different
-	// from `options.environmentVariables`. If `!~PASSENGER_ENV_VARS`
+	// from `options->environmentVariables`. If `!~PASSENGER_ENV_VARS`
 	// is not set or is empty, then `envvars` is NULL, while
-	// `options.environmentVariables` retains a previous value.
+	// `options->environmentVariables` retains the app group's value.
 	//
 	// This value is guaranteed to be contiguous.
 	LString *envvars;
 
+	// The file that is being sent with sendfile() on behalf of an X-Sendfile
+	// or X-Accel-Redirect response; see SendFile.cpp. `fileBody` is -1
+	// unless a file is being sent.
+	FileDescriptor fileBody;
+	boost::uint64_t fileBodyOffset;
+	boost::uint64_t fileBodyRemaining;
+	struct ev_io fileBodyWatcher;
+
+	// Pipes through which the request body and the response body are
+	// relayed with splice(); see SpliceRelay.cpp. A pipe is only open
+	// while the corresponding body is being relayed.
+	ServerKit::SplicePipe requestBodyPipe;
+	ServerKit::SplicePipe responseBodyPipe;
+	struct ev_io requestBodySpliceWatcher;
+	struct ev_io responseBodySpliceWatcher;
+
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		bool timedAppPoolGet;
 		ev_tstamp timeBeforeAccessingApplicationPool;
@@ -121,7 +166,8 @@ public:
 
 
 	Request()
-		: BaseHttpRequest()
+		: BaseHttpRequest(),
+		  options(&ownOptions)
 	{
 		memset(&stopwatchLogs, 0, sizeof(stopwatchLogs));
 	}
@@ -130,6 +176,8 @@ public:
 		switch (state) {
 		case ANALYZING_REQUEST:
 			return "ANALYZING_REQUEST";
+		case WAITING_FOR_COLLAPSED_RESPONSE:
+			return "WAITING_FOR_COLLAPSED_RESPONSE";
 		case BUFFERING_REQUEST_BODY:
 			return "BUFFERING_REQUEST_BODY";
 		case CHECKING_OUT_SESSION:
@@ -145,13 +193,30 @@ public:
 		}
 	}
 
+	void setOptionsSnapshot(const boost::shared_ptr<const Options> &snapshot) {
+		optionsSnapshot = snapshot;
+		options = snapshot.get();
+	}
+
+	/**
+	 * Returns an Options object that may be modified without affecting
+	 * other requests. The shared snapshot is copied on the first call.
+	 */
+	Options &mutableOptions() {
+		if (options != &ownOptions) {
+			ownOptions = *options;
+			options = &ownOptions;
+		}
+		return ownOptions;
+	}
+
 	bool useUnionStation() const {
-		return options.transaction != NULL;
+		return options->transaction != NULL;
 	}
 
 	void beginStopwatchLog(UnionStation::StopwatchLog **stopwatchLog, const char *id, const char *nameAndData = NULL) {
-		if (options.transaction != NULL) {
-			*stopwatchLog = new UnionStation::StopwatchLog(options.transaction, id, nameAndData);
+		if (options->transaction != NULL) {
+			*stopwatchLog = new UnionStation::StopwatchLog(options->transaction, id, nameAndData);
 		}
 	}
 
@@ -164,7 +229,7 @@ public:
 	}
 
 	void logMessage(const StaticString &message) {
-		options.transaction->message(message);
+		options->transaction->message(message);
 	}
 
 	DEFINE_SERVER_KIT_BASE_HTTP_REQUEST_FOOTER(Passenger::Core::Request);
@@ -0,0 +1,412 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2011-2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#include <climits>
+#include <cstdlib>
+#include <cerrno>
+#include <Core/Controller.h>
+#include <ServerKit/ByteRange.h>
+#include <FileTools/PathManip.h>
+#ifdef __linux__
+	#include <sys/sendfile.h>
+#endif
+
+/*************************************************************************
+ *
+ * Implements Core::Controller methods pertaining serving the file that an
+ * X-Sendfile or X-Accel-Redirect application response refers to. The app
+ * process is released as soon as its response headers have been received;
+ * the file is then sent to the client with sendfile().
+ *
+ *************************************************************************/
+
+namespace Passenger {
+namespace Core {
+
+using namespace std;
+using namespace boost;
+
+
+/****************************
+ *
+ * Private methods
+ *
+ ****************************/
+
+
+/**
+ * Called by onAppResponseBegin() when the app response contains an
+ * X-Sendfile or X-Accel-Redirect header. If this returns false, the header
+ * is passed on to the client, so that a web server in front of us can
+ * act upon it.
+ */
+bool
+Controller::canServeAppResponseFile(Client *client, Request *req) {
+	return req->config->nativeXSendfile
+		// HTTP/2 streams have no socket to sendfile() to.
+		&& client->getFd() != -1
+		// Don't interfere with a request body that is still being forwarded.
+		&& req->state == Request::WAITING_FOR_APP_OUTPUT
+		&& mainConfig.benchmarkMode != BM_RESPONSE_BEGIN
+		// Only serve files from a directory that has been explicitly allowed.
+		&& (req->appResponse.headers.lookup(ServerKit::HTTP_X_SENDFILE) != NULL
+			? !req->config->xSendfileRoot.empty()
+			: !req->config->xAccelRedirectRoot.empty());
+}
+
+static bool
+isWithinDirectory(const StaticString &path, StaticString dir) {
+	while (dir.size() > 1 && dir[dir.size() - 1] == '/') {
+		dir = dir.substr(0, dir.size() - 1);
+	}
+	if (dir == "/") {
+		return true;
+	}
+	return path.size() > dir.size()
+		&& startsWith(path, dir)
+		&& path[dir.size()] == '/';
+}
+
+/**
+ * Resolves all symlinks and relative path elements in `path`, which MUST be
+ * NULL-terminated, and checks that the result lies within `root`. On success,
+ * `path` is replaced by the canonical path.
+ *
+ * Returns 0 on success, or the HTTP status code to respond with.
+ */
+static int
+canonicalizeFilePathWithinRoot(psg_pool_t *pool, const StaticString &root,
+	StaticString &path)
+{
+	char buf[PATH_MAX];
+
+	if (realpath(path.data(), buf) == NULL) {
+		int e = errno;
+		// Don't reveal whether files outside the root exist.
+		if (!isWithinDirectory(absolutizePath(path), root)) {
+			return 403;
+		} else if (e == ENOENT || e == ENOTDIR || e == ENAMETOOLONG) {
+			return 404;
+		} else if (e == EACCES) {
+			return 403;
+		} else {
+			return 500;
+		}
+	}
+
+	path = psg_pstrdup(pool, buf);
+	return isWithinDirectory(path, root) ? 0 : 403;
+}
+
+/**
+ * Determines the filename that the app response refers to. X-Sendfile
+ * contains an absolute filename that must lie within `x_sendfile_root`,
+ * while X-Accel-Redirect contains a URI that is looked up in the
+ * `x_accel_redirect_root` directory.
+ *
+ * Returns 0 on success, or the HTTP status code to respond with.
+ */
+int
+Controller::resolveAppResponseFilePath(Request *req, StaticString &path) {
+	AppResponse *resp = &req->appResponse;
+	const LString *value = resp->headers.lookup(ServerKit::HTTP_X_SENDFILE);
+
+	if (value != NULL) {
+		value = psg_lstr_make_contiguous(value, req->pool);
+		path = psg_pstrdup(req->pool, StaticString(value->start->data, value->size));
+		if (!startsWith(path, "/")) {
+			return 500;
+		}
+		return canonicalizeFilePathWithinRoot(req->pool,
+			req->config->xSendfileRoot, path);
+	}
+
+	value = psg_lstr_make_contiguous(
+		resp->headers.lookup(ServerKit::HTTP_X_ACCEL_REDIRECT), req->pool);
+	StaticString uri(value->start->data, value->size);
+	string::size_type pos = uri.find('?');
+	if (pos != string::npos) {
+		uri = uri.substr(0, pos);
+	}
+	if (!startsWith(uri, "/")) {
+		return 500;
+	}
+	if (uri.find("/../") != string::npos
+	 || (uri.size() >= 3 && uri.substr(uri.size() - 3) == "/.."))
+	{
+		return 403;
+	}
+
+	StaticString root = req->config->xAccelRedirectRoot;
+	if (root.size() > 0 && root[root.size() - 1] == '/') {
+		root = root.substr(0, root.size() - 1);
+	}
+	char *buf = (char *) psg_pnalloc(req->pool, root.size() + uri.size() + 1);
+	memcpy(buf, root.data(), root.size());
+	memcpy(buf + root.size(), uri.data(), uri.size());
+	buf[root.size() + uri.size()] = '\0';
+	path = StaticString(buf, root.size() + uri.size());
+	return canonicalizeFilePathWithinRoot(req->pool,
+		req->config->xAccelRedirectRoot, path);
+}
+
+void
+Controller::serveAppResponseFile(Client *client, Request *req) {
+	TRACE_POINT();
+	StaticString path;
+	OpenFileCache::File file;
+	ssize_t bytesWritten;
+	int code;
+
+	code = resolveAppResponseFilePath(req, path);
+	if (code == 0) {
+		int e = openFileCache.open(path, mainConfig.statThrottleRate, file);
+		if (e == ENOENT || e == ENOTDIR || e == ENAMETOOLONG) {
+			code = 404;
+		} else if (e == EACCES || e == EISDIR) {
+			code = 403;
+		} else if (e != 0) {
+			code = 500;
+		}
+		if (e != 0) {
+			SKC_WARN(client, "Cannot serve file " << path << " on behalf of the"
+				" application: " << strerror(e) << " (errno=" << e << ")");
+		}
+	} else {
+		SKC_WARN(client, "Cannot serve the file that the application refers to"
+			" with X-Sendfile or X-Accel-Redirect: invalid path, nonexistent file,"
+			" or a file outside the allowed root directory (status " << code << ")");
+	}
+
+	if (code != 0) {
+		handleAppResponseBodyEnd(client, req);
+		if (code == 404) {
+			endRequestWithSimpleResponse(&client, &req, "<h1>Not Found</h1>", 404);
+		} else if (code == 403) {
+			endRequestWithSimpleResponse(&client, &req, "<h1>Forbidden</h1>", 403);
+		} else {
+			endRequestWithSimpleResponse(&client, &req,
+				"<h1>Internal Server Error</h1>", 500);
+		}
+		return;
+	}
+
+	SKC_TRACE(client, 2, "Serving file " << path << " (" << file.size <<
+		" bytes) on behalf of the application");
+	prepareAppResponseFileHeaders(client, req, file);
+
+	UPDATE_TRACE_POINT();
+	if (!sendResponseHeaderWithWritev(client, req, bytesWritten)) {
+		UPDATE_TRACE_POINT();
+		if (bytesWritten >= 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
+			sendResponseHeaderWithBuffering(client, req, bytesWritten);
+		} else {
+			int e = errno;
+			P_ASSERT_EQ(bytesWritten, -1);
+			disconnectWithClientSocketWriteError(&client, e);
+			return;
+		}
+	}
+
+	if (req->ended()) {
+		return;
+	}
+
+	// The app response is complete, so release the app process right away.
+	// This must happen after sending the header, which may contain the
+	// sticky session ID.
+	handleAppResponseBodyEnd(client, req);
+	if (req->method == HTTP_HEAD || req->fileBodyRemaining == 0) {
+		endRequest(&client, &req);
+	} else {
+		req->fileBody = file.fd;
+		beginSendingFileBody(client, req);
+	}
+}
+
+/**
+ * Replaces the X-Sendfile or X-Accel-Redirect header with the headers that
+ * describe the file, taking a single byte range into account.
+ */
+void
+Controller::prepareAppResponseFileHeaders(Client *client, Request *req,
+	const OpenFileCache::File &file)
+{
+	AppResponse *resp = &req->appResponse;
+	ServerKit::ByteRangeResult range = ServerKit::BR_IGNORE;
+	boost::uint64_t begin = 0, length = file.size;
+
+	resp->headers.erase(ServerKit::HTTP_X_SENDFILE);
+	resp->headers.erase(ServerKit::HTTP_X_ACCEL_REDIRECT);
+
+	if (resp->statusCode == 200) {
+		const LString *value = req->headers.lookup(HTTP_RANGE);
+
+		resp->headers.insert(req->pool, P_STATIC_STRING("Accept-Ranges"),
+			P_STATIC_STRING("bytes"));
+		// We don't validate If-Range, so we serve the full file
+		// when it's present, which is always correct.
+		if (value != NULL && value->size > 0
+		 && req->headers.lookup(HTTP_IF_RANGE) == NULL)
+		{
+			value = psg_lstr_make_contiguous(value, req->pool);
+			range = ServerKit::parseByteRange(
+				StaticString(value->start->data, value->size),
+				file.size, begin, length);
+		}
+	}
+
+	if (range != ServerKit::BR_IGNORE) {
+		const unsigned int BUFSIZE = 64;
+		char *buf = (char *) psg_pnalloc(req->pool, BUFSIZE);
+		const char *end = buf + BUFSIZE;
+		char *pos = buf;
+
+		pos = appendData(pos, end, "bytes ");
+		if (range == ServerKit::BR_SATISFIABLE) {
+			SKC_TRACE(client, 2, "Serving bytes " << begin << "-" <<
+				(begin + length - 1) << " of the file");
+			resp->statusCode = 206;
+			pos += integerToOtherBase<boost::uint64_t, 10>(begin, pos, end - pos);
+			pos = appendData(pos, end, "-");
+			pos += integerToOtherBase<boost::uint64_t, 10>(begin + length - 1,
+				pos, end - pos);
+		} else {
+			SKC_TRACE(client, 2, "Requested range is not satisfiable");
+			resp->statusCode = 416;
+			begin = length = 0;
+			pos = appendData(pos, end, "*");
+		}
+		pos = appendData(pos, end, "/");
+		pos += integerToOtherBase<boost::uint64_t, 10>(file.size, pos, end - pos);
+		resp->headers.insert(req->pool, P_STATIC_STRING("Content-Range"),
+			StaticString(buf, pos - buf));
+	}
+
+	resp->bodyType = AppResponse::RBT_CONTENT_LENGTH;
+	resp->aux.bodyInfo.contentLength = length;
+	req->fileBodyOffset = begin;
+	req->fileBodyRemaining = length;
+}
+
+void
+Controller::beginSendingFileBody(Client *client, Request *req) {
+	if (client->output.isFlushed()) {
+		sendFileBody(client, req);
+	} else {
+		// Part of the response header is still buffered, and must be
+		// written before we can write to the socket ourselves.
+		SKC_TRACE(client, 2, "Waiting until the response header is flushed");
+		client->output.setDataFlushedCallback(_fileBodyOutputFlushed);
+	}
+}
+
+void
+Controller::_fileBodyOutputFlushed(FileBufferedChannel *_channel) {
+	FileBufferedFdSinkChannel *channel = reinterpret_cast<FileBufferedFdSinkChannel *>(_channel);
+	Client *client = static_cast<Client *>(static_cast<
+		ServerKit::BaseClient *>(channel->getHooks()->userData));
+	Request *req = static_cast<Request *>(client->currentRequest);
+	Controller *self = static_cast<Controller *>(getServerFromClient(client));
+
+	getClientOutputDataFlushedCallback()(_channel);
+	if (client->connected() && req != NULL && !req->ended()) {
+		client->output.setDataFlushedCallback(getClientOutputDataFlushedCallback());
+		self->sendFileBody(client, req);
+	}
+}
+
+void
+Controller::onFileBodySocketWritable(EV_P_ struct ev_io *io, int revents) {
+	Request *req = static_cast<Request *>(io->data);
+	Client *client = static_cast<Client *>(req->client);
+	Controller *self = static_cast<Controller *>(getServerFromClient(client));
+	SKC_LOG_EVENT_FROM_STATIC(self, Controller, client, "onFileBodySocketWritable");
+
+	ev_io_stop(self->getLoop(), io);
+	self->sendFileBody(client, req);
+}
+
+void
+Controller::sendFileBody(Client *client, Request *req) {
+	TRACE_POINT();
+	// Limit the amount of data sent per event loop iteration, so that a
+	// client on a fast network doesn't starve the others.
+	size_t budget = 1024 * 1024;
+
+	while (req->fileBodyRemaining > 0) {
+		size_t size = (size_t) std::min<boost::uint64_t>(req->fileBodyRemaining, budget);
+		ssize_t ret = writeFileToSocket(client->getFd(), req->fileBody,
+			req->fileBodyOffset, size);
+		if (ret > 0) {
+			req->fileBodyOffset += ret;
+			req->fileBodyRemaining -= ret;
+			req->lastDataSendTime = ev_now(getLoop());
+			budget -= ret;
+			if (budget == 0 && req->fileBodyRemaining > 0) {
+				ev_io_set(&req->fileBodyWatcher, client->getFd(), EV_WRITE);
+				ev_io_start(getLoop(), &req->fileBodyWatcher);
+				return;
+			}
+		} else if (ret == 0) {
+			// The file became smaller than the Content-Length that we sent.
+			disconnectWithError(&client, "file was truncated while it was being sent");
+			return;
+		} else if (errno == EINTR) {
+			continue;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			ev_io_set(&req->fileBodyWatcher, client->getFd(), EV_WRITE);
+			ev_io_start(getLoop(), &req->fileBodyWatcher);
+			return;
+		} else {
+			int e = errno;
+			disconnectWithClientSocketWriteError(&client, e);
+			return;
+		}
+	}
+
+	SKC_TRACE(client, 2, "File sent");
+	req->fileBody = FileDescriptor();
+	endRequest(&client, &req);
+}
+
+ssize_t
+Controller::writeFileToSocket(int sock, int fd, boost::uint64_t offset, size_t size) {
+	#ifdef __linux__
+		off_t off = offset;
+		return sendfile(sock, fd, &off, size);
+	#else
+		char buf[1024 * 16];
+		ssize_t ret = pread(fd, buf, std::min(size, sizeof(buf)), offset);
+		if (ret <= 0) {
+			return ret;
+		}
+		return write(sock, buf, ret);
+	#endif
+}
+
+
+} // namespace Core
+} // namespace Passenger
@@ -323,10 +323,10 @@ Controller::determineHeaderSizeForSessionProtocol(Request *req,
 	unsigned int dataSize = sizeof(boost::uint32_t);
 
 	state.path        = req->getPathWithoutQueryString();
-	state.hasBaseURI  = req->options.baseURI != P_STATIC_STRING("/")
-		&& startsWith(state.path, req->options.baseURI);
+	state.hasBaseURI  = req->options->baseURI != P_STATIC_STRING("/")
+		&& startsWith(state.path, req->options->baseURI);
 	if (state.hasBaseURI) {
-		state.path = state.path.substr(req->options.baseURI.size());
+		state.path = state.path.substr(req->options->baseURI.size());
 		if (state.path.empty()) {
 			state.path = P_STATIC_STRING("/");
 		}
@@ -366,7 +366,7 @@ Controller::determineHeaderSizeForSessionProtocol(Request *req,
 
 	dataSize += sizeof("SCRIPT_NAME");
 	if (state.hasBaseURI) {
-		dataSize += req->options.baseURI.size();
+		dataSize += req->options->baseURI.size();
 	} else {
 		dataSize += sizeof("");
 	}
@@ -446,9 +446,9 @@ Controller::determineHeaderSizeForSessionProtocol(Request *req,
 		dataSize += sizeof("on");
 	}
 
-	if (req->options.analytics) {
+	if (req->options->analytics) {
 		dataSize += sizeof("PASSENGER_TXN_ID");
-		dataSize += req->options.transaction->getTxnId().size() + 1;
+		dataSize += req->options->transaction->getTxnId().size() + 1;
 
 		dataSize += sizeof("PASSENGER_DELTA_MONOTONIC");
 		dataSize += delta_monotonic.size() + 1;
@@ -492,7 +492,7 @@ Controller::constructHeaderForSessionProtocol(Request *req, char * restrict buff
 
 	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("SCRIPT_NAME"));
 	if (state.hasBaseURI) {
-		pos = appendData(pos, end, req->options.baseURI);
+		pos = appendData(pos, end, req->options->baseURI);
 		pos = appendData(pos, end, "", 1);
 	} else {
 		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL(""));
@@ -564,9 +564,9 @@ Controller::constructHeaderForSessionProtocol(Request *req, char * restrict buff
 		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("on"));
 	}
 
-	if (req->options.analytics) {
+	if (req->options->analytics) {
 		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("PASSENGER_TXN_ID"));
-		pos = appendData(pos, end, req->options.transaction->getTxnId());
+		pos = appendData(pos, end, req->options->transaction->getTxnId());
 		pos = appendData(pos, end, "", 1);
 
 		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("PASSENGER_DELTA_MONOTONIC"));
@@ -745,7 +745,7 @@ Controller::constructHeaderBuffersForHttpProtocol(Request *req, struct iovec *bu
 	if (req->upgraded()) {
 		PUSH_STATIC_BUFFER(" HTTP/1.1\r\nConnection: upgrade\r\n");
 	} else {
-		PUSH_STATIC_BUFFER(" HTTP/1.1\r\nConnection: close\r\n");
+		PUSH_STATIC_BUFFER(" HTTP/1.1\r\nConnection: keep-alive\r\n");
 	}
 
 	if (cache.setCookie != NULL) {
@@ -863,16 +863,16 @@ Controller::constructHeaderBuffersForHttpProtocol(Request *req, struct iovec *bu
 		PUSH_STATIC_BUFFER("\r\n");
 	}
 
-	if (req->options.analytics) {
+	if (req->options->analytics) {
 		PUSH_STATIC_BUFFER("!~Passenger-Txn-Id: ");
 
 		if (buffers != NULL) {
 			BEGIN_PUSH_NEXT_BUFFER();
-			buffers[i].iov_base = (void *) req->options.transaction->getTxnId().data();
-			buffers[i].iov_len  = req->options.transaction->getTxnId().size();
+			buffers[i].iov_base = (void *) req->options->transaction->getTxnId().data();
+			buffers[i].iov_len  = req->options->transaction->getTxnId().size();
 		}
 		INC_BUFFER_ITER(i);
-		dataSize += req->options.transaction->getTxnId().size();
+		dataSize += req->options->transaction->getTxnId().size();
 
 		PUSH_STATIC_BUFFER("\r\n");
 	}
@@ -1025,6 +1025,8 @@ Controller::whenSendingRequest_onRequestBody(Client *client, Request *req,
 				req->state = Request::WAITING_FOR_APP_OUTPUT;
 				stopBodyChannel(client, req);
 			}
+		} else if (canSpliceRequestBody(client, req)) {
+			beginSplicingRequestBody(client, req);
 		}
 		return Channel::Result(buffer.size(), false);
 	} else if (errcode == 0 || errcode == ECONNRESET) {
@@ -0,0 +1,368 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#include <Core/Controller.h>
+
+/*************************************************************************
+ *
+ * Implements Core::Controller methods pertaining relaying request and
+ * response bodies between the client and the app with splice(), through a
+ * kernel pipe, instead of copying them through mbufs. This is only done
+ * for bodies with a Content-Length that we pass on unmodified: bodies that
+ * aren't buffered, dechunked, compressed or turbocached.
+ *
+ * We switch to splicing after the first part of a body has been forwarded
+ * the normal way, because that part has already been read into an mbuf.
+ *
+ *************************************************************************/
+
+namespace Passenger {
+namespace Core {
+
+using namespace std;
+using namespace boost;
+
+
+/****************************
+ *
+ * Private methods
+ *
+ ****************************/
+
+
+/**
+ * Called by whenSendingRequest_onRequestBody() after it has forwarded
+ * a part of the request body to the app.
+ */
+bool
+Controller::canSpliceRequestBody(Client *client, Request *req) {
+	return mainConfig.spliceRelay
+		&& ServerKit::SplicePipe::isSupported()
+		// HTTP/2 streams have no socket of their own.
+		&& client->getFd() != -1
+		&& req->state == Request::FORWARDING_BODY_TO_APP
+		&& req->bodyType == Request::RBT_CONTENT_LENGTH
+		&& !req->requestBodyBuffering
+		&& !req->requestBodyPipe.isOpen()
+		// If set, HttpServer resumes client->input as soon as we return.
+		&& req->bodyChannel.consumedCallback == NULL
+		&& req->appSink.acceptingInput()
+		&& req->aux.bodyInfo.contentLength - req->bodyAlreadyRead
+			>= mainConfig.spliceRelayMinSize;
+}
+
+void
+Controller::beginSplicingRequestBody(Client *client, Request *req) {
+	if (!acquireSplicePipe(client, req->requestBodyPipe)) {
+		return;
+	}
+
+	SKC_TRACE(client, 2, "Relaying the remaining " <<
+		(req->aux.bodyInfo.contentLength - req->bodyAlreadyRead) <<
+		" bytes of the request body with splice()");
+	// We're called from a client->input callback, so wait for the next
+	// event before touching the socket.
+	client->input.stop();
+	ev_io_set(&req->requestBodySpliceWatcher, client->getFd(), EV_READ);
+	ev_io_start(getLoop(), &req->requestBodySpliceWatcher);
+}
+
+void
+Controller::onRequestBodySpliceEvent(EV_P_ struct ev_io *io, int revents) {
+	Request *req = static_cast<Request *>(io->data);
+	Client *client = static_cast<Client *>(req->client);
+	Controller *self = static_cast<Controller *>(getServerFromClient(client));
+	SKC_LOG_EVENT_FROM_STATIC(self, Controller, client, "onRequestBodySpliceEvent");
+
+	ev_io_stop(self->getLoop(), io);
+	self->spliceRequestBody(client, req);
+}
+
+void
+Controller::spliceRequestBody(Client *client, Request *req) {
+	TRACE_POINT();
+	ServerKit::SplicePipe &pipe = req->requestBodyPipe;
+	int clientFd = client->getFd();
+	int appFd = req->session->fd();
+	// Don't let one fast upload starve the other clients.
+	size_t budget = 1024 * 1024;
+	ssize_t ret;
+
+	while (!pipe.empty() || !req->bodyFullyRead()) {
+		if (budget == 0) {
+			ev_io_set(&req->requestBodySpliceWatcher,
+				pipe.empty() ? clientFd : appFd,
+				pipe.empty() ? EV_READ : EV_WRITE);
+			ev_io_start(getLoop(), &req->requestBodySpliceWatcher);
+			return;
+		}
+
+		if (!pipe.empty()) {
+			ret = pipe.drain(appFd);
+			if (ret > 0) {
+				bytesSplicedToApps += ret;
+				budget -= std::min<size_t>(ret, budget);
+			} else if (ret == 0) {
+				// No progress, but no error either (errno is stale).
+				// Try again once the app socket is writable.
+				ev_io_set(&req->requestBodySpliceWatcher, appFd, EV_WRITE);
+				ev_io_start(getLoop(), &req->requestBodySpliceWatcher);
+				return;
+			} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				ev_io_set(&req->requestBodySpliceWatcher, appFd, EV_WRITE);
+				ev_io_start(getLoop(), &req->requestBodySpliceWatcher);
+				return;
+			} else {
+				// Just like when req->appSink fails to write: stop sending
+				// the body, but keep forwarding the response.
+				int e = errno;
+				logAppSocketWriteError(client, e);
+				req->appSink.feedError(e);
+				releaseSplicePipe(pipe);
+				req->state = Request::WAITING_FOR_APP_OUTPUT;
+				return;
+			}
+		} else {
+			size_t size = (size_t) std::min<boost::uint64_t>(
+				req->aux.bodyInfo.contentLength - req->bodyAlreadyRead,
+				ServerKit::SplicePipe::PREFERRED_CAPACITY);
+			ret = pipe.fill(clientFd, size);
+			if (ret > 0) {
+				req->bodyAlreadyRead += ret;
+				req->lastDataReceiveTime = ev_now(getLoop());
+			} else if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				ev_io_set(&req->requestBodySpliceWatcher, clientFd, EV_READ);
+				ev_io_start(getLoop(), &req->requestBodySpliceWatcher);
+				return;
+			} else {
+				// Let whenSendingRequest_onRequestBody() handle the error,
+				// like it does for errors that HttpServer encounters.
+				int e = (ret == 0) ? (int) ServerKit::UNEXPECTED_EOF : errno;
+				releaseSplicePipe(pipe);
+				req->bodyChannel.feedError(e);
+				return;
+			}
+		}
+	}
+
+	SKC_TRACE(client, 2, "End of request body reached");
+	releaseSplicePipe(pipe);
+	// Continue where HttpServer would have continued after reading
+	// the last part of the body.
+	client->input.start();
+	req->detectingNextRequestEarlyReadError = true;
+	req->bodyChannel.feed(MemoryKit::mbuf());
+}
+
+/**
+ * Called by onAppSourceData() after it has forwarded a part of the
+ * response body to the client.
+ */
+bool
+Controller::canSpliceResponseBody(Client *client, Request *req) {
+	AppResponse *resp = &req->appResponse;
+	return mainConfig.spliceRelay
+		&& ServerKit::SplicePipe::isSupported()
+		&& client->getFd() != -1
+		&& resp->httpState == AppResponse::PARSING_BODY_WITH_LENGTH
+		&& resp->compressor == NULL
+		&& req->cacheKey.empty()
+		&& mainConfig.benchmarkMode != BM_RESPONSE_BEGIN
+		&& !req->responseBodyPipe.isOpen()
+		&& client->output.getBuffersFlushedCallback() == NULL
+		&& client->output.getDataFlushedCallback() == getClientOutputDataFlushedCallback()
+		&& resp->aux.bodyInfo.contentLength - resp->bodyAlreadyRead
+			>= mainConfig.spliceRelayMinSize;
+}
+
+void
+Controller::beginSplicingResponseBody(Client *client, Request *req) {
+	if (!acquireSplicePipe(client, req->responseBodyPipe)) {
+		maybeThrottleAppSource(client, req);
+		return;
+	}
+
+	SKC_TRACE(client, 2, "Relaying the remaining " <<
+		(req->appResponse.aux.bodyInfo.contentLength - req->appResponse.bodyAlreadyRead) <<
+		" bytes of the response body with splice()");
+	req->appSource.stop();
+	if (client->output.isFlushed()) {
+		ev_io_set(&req->responseBodySpliceWatcher, req->session->fd(), EV_READ);
+		ev_io_start(getLoop(), &req->responseBodySpliceWatcher);
+	} else {
+		// Whatever we've written to client->output so far must reach
+		// the client before the data that we splice.
+		SKC_TRACE(client, 2, "Waiting until buffered response data is flushed");
+		client->output.setDataFlushedCallback(_responseBodySpliceOutputFlushed);
+	}
+}
+
+void
+Controller::_responseBodySpliceOutputFlushed(FileBufferedChannel *_channel) {
+	FileBufferedFdSinkChannel *channel = reinterpret_cast<FileBufferedFdSinkChannel *>(_channel);
+	Client *client = static_cast<Client *>(static_cast<
+		ServerKit::BaseClient *>(channel->getHooks()->userData));
+	Request *req = static_cast<Request *>(client->currentRequest);
+	Controller *self = static_cast<Controller *>(getServerFromClient(client));
+
+	getClientOutputDataFlushedCallback()(_channel);
+	if (client->connected() && req != NULL && !req->ended()) {
+		client->output.setDataFlushedCallback(getClientOutputDataFlushedCallback());
+		self->spliceResponseBody(client, req);
+	}
+}
+
+void
+Controller::onResponseBodySpliceEvent(EV_P_ struct ev_io *io, int revents) {
+	Request *req = static_cast<Request *>(io->data);
+	Client *client = static_cast<Client *>(req->client);
+	Controller *self = static_cast<Controller *>(getServerFromClient(client));
+	SKC_LOG_EVENT_FROM_STATIC(self, Controller, client, "onResponseBodySpliceEvent");
+
+	ev_io_stop(self->getLoop(), io);
+	self->spliceResponseBody(client, req);
+}
+
+void
+Controller::spliceResponseBody(Client *client, Request *req) {
+	TRACE_POINT();
+	AppResponse *resp = &req->appResponse;
+	ServerKit::SplicePipe &pipe = req->responseBodyPipe;
+	int clientFd = client->getFd();
+	int appFd = req->session->fd();
+	// Don't let one fast download starve the other clients.
+	size_t budget = 1024 * 1024;
+	ssize_t ret;
+
+	while (!pipe.empty() || !resp->bodyFullyRead()) {
+		if (budget == 0) {
+			ev_io_set(&req->responseBodySpliceWatcher,
+				pipe.empty() ? appFd : clientFd,
+				pipe.empty() ? EV_READ : EV_WRITE);
+			ev_io_start(getLoop(), &req->responseBodySpliceWatcher);
+			return;
+		}
+
+		if (!pipe.empty()) {
+			ret = pipe.drain(clientFd);
+			if (ret > 0) {
+				bytesSplicedToClients += ret;
+				req->lastDataSendTime = ev_now(getLoop());
+				budget -= std::min<size_t>(ret, budget);
+			} else if (ret == 0) {
+				// No progress, but no error either (errno is stale).
+				// Try again once the client socket is writable.
+				ev_io_set(&req->responseBodySpliceWatcher, clientFd, EV_WRITE);
+				ev_io_start(getLoop(), &req->responseBodySpliceWatcher);
+				return;
+			} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				ev_io_set(&req->responseBodySpliceWatcher, clientFd, EV_WRITE);
+				ev_io_start(getLoop(), &req->responseBodySpliceWatcher);
+				return;
+			} else {
+				int e = errno;
+				disconnectWithClientSocketWriteError(&client, e);
+				return;
+			}
+		} else {
+			size_t size = (size_t) std::min<boost::uint64_t>(
+				resp->aux.bodyInfo.contentLength - resp->bodyAlreadyRead,
+				ServerKit::SplicePipe::PREFERRED_CAPACITY);
+			ret = pipe.fill(appFd, size);
+			if (ret > 0) {
+				resp->bodyAlreadyRead += ret;
+			} else if (ret == 0 || errno == ECONNRESET) {
+				SKC_WARN(client, "Application sent EOF before finishing response body: " <<
+					resp->bodyAlreadyRead << " bytes already read, " <<
+					resp->aux.bodyInfo.contentLength << " bytes expected");
+				endRequestWithAppSocketIncompleteResponse(&client, &req);
+				return;
+			} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				ev_io_set(&req->responseBodySpliceWatcher, appFd, EV_READ);
+				ev_io_start(getLoop(), &req->responseBodySpliceWatcher);
+				return;
+			} else {
+				int e = errno;
+				endRequestWithAppSocketReadError(&client, &req, e);
+				return;
+			}
+		}
+	}
+
+	SKC_TRACE(client, 2, "End of application response body reached");
+	releaseSplicePipe(pipe);
+	handleAppResponseBodyEnd(client, req);
+	endRequest(&client, &req);
+}
+
+bool
+Controller::acquireSplicePipe(Client *client, ServerKit::SplicePipe &pipe) {
+	if (!idleSplicePipes.empty()) {
+		pipe = idleSplicePipes.back();
+		idleSplicePipes.pop_back();
+		return true;
+	} else if (pipe.open(__FILE__, __LINE__)) {
+		return true;
+	} else {
+		int e = errno;
+		SKC_WARN(client, "Cannot create a pipe for relaying data with splice(): " <<
+			strerror(e) << " (errno=" << e << "). Relaying data the normal way");
+		return false;
+	}
+}
+
+/**
+ * Puts an empty pipe back into the idle pool. A pipe that still contains
+ * data can't be reused, so it is closed.
+ */
+void
+Controller::releaseSplicePipe(ServerKit::SplicePipe &pipe) {
+	if (pipe.empty() && idleSplicePipes.size() < MAX_IDLE_SPLICE_PIPES) {
+		idleSplicePipes.push_back(pipe);
+	}
+	pipe.reset();
+}
+
+/**
+ * Called by deinitializeRequest() to abort any splicing in progress.
+ */
+void
+Controller::stopSplicing(Client *client, Request *req) {
+	ev_io_stop(getLoop(), &req->requestBodySpliceWatcher);
+	ev_io_stop(getLoop(), &req->responseBodySpliceWatcher);
+	if (client->output.getDataFlushedCallback() == _responseBodySpliceOutputFlushed) {
+		client->output.setDataFlushedCallback(getClientOutputDataFlushedCallback());
+	}
+	if (req->requestBodyPipe.isOpen()) {
+		releaseSplicePipe(req->requestBodyPipe);
+	}
+	if (req->responseBodyPipe.isOpen()) {
+		releaseSplicePipe(req->responseBodyPipe);
+	}
+}
+
+
+} // namespace Core
+} // namespace Passenger
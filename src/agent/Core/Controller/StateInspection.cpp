@@ -62,8 +62,38 @@ Controller::inspectStateAsJson() const {
 		subdoc["stores"] = turboCaching.responseCache.getStores();
 		subdoc["store_successes"] = turboCaching.responseCache.getStoreSuccesses();
 		subdoc["store_success_ratio"] = turboCaching.responseCache.getStoreSuccessRatio();
+		if (turboCaching.responseCache.isShared()) {
+			// The shared store is inspected by the ApiServer.
+			subdoc["shared"] = true;
+		} else {
+			const ResponseCacheStorePtr &store = turboCaching.responseCache.getStore();
+			ResponseCacheShard::Statistics stats(store->getStatistics());
+			subdoc["shared"] = false;
+			subdoc["evictions"] = stats.evictions;
+			subdoc["entries"] = stats.entries;
+			subdoc["protected_entries"] = stats.protectedEntries;
+			subdoc["max_entries"] = store->getMaxEntries();
+			subdoc["memory_usage"] = byteSizeToJson(stats.memoryUsage);
+			subdoc["max_memory"] = byteSizeToJson(store->getMaxMemory());
+		}
+		if (collapsedForwarding.isEnabled()) {
+			Json::Value cfdoc;
+			cfdoc["leaders"] = collapsedForwarding.getLeaderCount();
+			cfdoc["waiting"] = collapsedForwarding.getWaiterCount();
+			cfdoc["collapsed"] = (Json::UInt64) collapsedForwarding.getCollapsedCount();
+			cfdoc["timeouts"] = (Json::UInt64) collapsedForwarding.getTimeoutCount();
+			cfdoc["timeout"] = collapsedForwarding.getTimeout();
+			subdoc["collapsed_forwarding"] = cfdoc;
+		}
 		doc["turbocaching"] = subdoc;
 	}
+	if (mainConfig.spliceRelay) {
+		Json::Value subdoc;
+		subdoc["bytes_spliced_to_apps"] = byteSizeToJson(bytesSplicedToApps);
+		subdoc["bytes_spliced_to_clients"] = byteSizeToJson(bytesSplicedToClients);
+		subdoc["idle_pipes"] = (Json::UInt) idleSplicePipes.size();
+		doc["splice_relay"] = subdoc;
+	}
 	return doc;
 }
 
@@ -85,7 +115,7 @@ Controller::inspectRequestStateAsJson(const Request *req) const {
 	}
 	doc["state"] = req->getStateString();
 	if (req->stickySession) {
-		doc["sticky_session_id"] = req->options.stickySessionId;
+		doc["sticky_session_id"] = req->options->stickySessionId;
 	}
 	doc["sticky_session"] = req->stickySession;
 	doc["session_checkout_try"] = req->sessionCheckoutTry;
@@ -93,6 +123,8 @@ Controller::inspectRequestStateAsJson(const Request *req) const {
 	flags["dechunk_response"] = req->dechunkResponse;
 	flags["request_body_buffering"] = req->requestBodyBuffering;
 	flags["https"] = req->https;
+	flags["splicing_request_body"] = req->requestBodyPipe.isOpen();
+	flags["splicing_response_body"] = req->responseBodyPipe.isOpen();
 	doc["flags"] = flags;
 
 	if (req->requestBodyBuffering) {
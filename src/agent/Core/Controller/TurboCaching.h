@@ -31,6 +31,8 @@
 #include <ctime>
 #include <cstddef>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 #include <MemoryKit/mbuf.h>
 #include <ServerKit/Context.h>
 #include <Constants.h>
@@ -95,24 +97,35 @@ private:
 		unsigned int ageValueSize;
 		unsigned int contentLengthStrSize;
 		bool showVersionInHeader;
+		bool notModified;
+		// Only used if notModified.
+		unsigned int dateSize;
+		char dateStr[64];
 	};
 
 	template<typename Server>
 	void prepareResponseHeader(ResponsePreparation &prep, Server *server,
-		Request *req, const ResponseCacheEntryType &entry)
+		Request *req, const ResponseCacheEntryType &entry, bool notModified = false)
 	{
 		prep.req   = req;
 		prep.entry = &entry;
 		prep.now   = (time_t) ev_now(server->getLoop());
+		prep.notModified = notModified;
+		if (notModified) {
+			prep.dateSize = server->constructDateHeaderBuffersForResponse(
+				prep.dateStr, sizeof(prep.dateStr));
+		} else {
+			prep.dateSize = 0;
+		}
 
-		if (prep.now >= entry.header->date) {
-			prep.age = prep.now - entry.header->date;
+		if (prep.now >= entry.item->date) {
+			prep.age = prep.now - entry.item->date;
 		} else {
 			prep.age = 0;
 		}
 
 		prep.ageValueSize = integerSizeInOtherBase<time_t, 10>(prep.age);
-		prep.contentLengthStrSize = uintSizeAsString(entry.body->httpBodySize);
+		prep.contentLengthStrSize = uintSizeAsString(entry.item->httpBodySize);
 		prep.showVersionInHeader = req->config->showVersionInHeader;
 	}
 
@@ -136,19 +149,35 @@ private:
 		char *pos = output;
 		const char *end = output + outputSize;
 
-		result += entry->body->httpHeaderSize;
-		if (output != NULL) {
-			pos = appendData(pos, end, entry->body->httpHeaderData,
-				entry->body->httpHeaderSize);
-		}
+		if (prep.notModified) {
+			PUSH_STATIC_STRING("HTTP/1.1 304 Not Modified\r\nStatus: 304 Not Modified\r\n");
 
-		PUSH_STATIC_STRING("Content-Length: ");
-		result += prep.contentLengthStrSize;
-		if (output != NULL) {
-			uintToString(entry->body->httpBodySize, pos, end - pos);
-			pos += prep.contentLengthStrSize;
+			result += prep.dateSize;
+			if (output != NULL) {
+				pos = appendData(pos, end, prep.dateStr, prep.dateSize);
+			}
+			PUSH_STATIC_STRING("\r\n");
+
+			result += entry->item->notModifiedHeaderSize;
+			if (output != NULL) {
+				pos = appendData(pos, end, entry->item->notModifiedHeaderData,
+					entry->item->notModifiedHeaderSize);
+			}
+		} else {
+			result += entry->item->httpHeaderSize;
+			if (output != NULL) {
+				pos = appendData(pos, end, entry->item->httpHeaderData,
+					entry->item->httpHeaderSize);
+			}
+
+			PUSH_STATIC_STRING("Content-Length: ");
+			result += prep.contentLengthStrSize;
+			if (output != NULL) {
+				uintToString(entry->item->httpBodySize, pos, end - pos);
+				pos += prep.contentLengthStrSize;
+			}
+			PUSH_STATIC_STRING("\r\n");
 		}
-		PUSH_STATIC_STRING("\r\n");
 
 		PUSH_STATIC_STRING("Age: ");
 		result += prep.ageValueSize;
@@ -158,6 +187,10 @@ private:
 		}
 		PUSH_STATIC_STRING("\r\n");
 
+		if (entry->stale) {
+			PUSH_STATIC_STRING("Warning: 110 - \"Response is Stale\"\r\n");
+		}
+
 		if (prep.showVersionInHeader) {
 			PUSH_STATIC_STRING("X-Powered-By: " PROGRAM_NAME " " PASSENGER_VERSION "\r\n");
 		} else {
@@ -243,11 +276,14 @@ public:
 				state = TEMPORARILY_DISABLED;
 				nextTimeout = now + TEMPORARY_DISABLE_TIMEOUT;
 			} else {
-				P_DEBUG("Clearing turbocache");
 				nextTimeout = now + ENABLED_TIMEOUT;
 			}
+			if (state == TEMPORARILY_DISABLED && !responseCache.isShared()) {
+				// A shared cache is still used by the other threads.
+				P_DEBUG("Clearing turbocache");
+				responseCache.clear();
+			}
 			responseCache.resetStatistics();
-			responseCache.clear();
 			break;
 		case TEMPORARILY_DISABLED:
 			P_INFO("Re-enabling turbocaching");
@@ -266,30 +302,76 @@ public:
 	void writeResponse(Server *server, Client *client, Request *req, ResponseCacheEntryType &entry) {
 		MemoryKit::mbuf_pool &mbuf_pool = server->getContext()->mbuf_pool;
 		const unsigned int MBUF_MAX_SIZE = mbuf_pool_data_size(&mbuf_pool);
+		const typename ResponseCacheType::Item *item = entry.item;
 		ResponsePreparation prep;
 		unsigned int headerSize;
 
 		prepareResponseHeader(prep, server, req, entry);
 		headerSize = buildResponseHeader(prep, server, NULL, 0);
 
-		if (headerSize + entry.body->httpBodySize <= MBUF_MAX_SIZE) {
+		if (headerSize + item->httpBodySize <= MBUF_MAX_SIZE) {
 			// Header and body fit inside a single mbuf
 			MemoryKit::mbuf buffer(MemoryKit::mbuf_get(&mbuf_pool));
-			buffer = MemoryKit::mbuf(buffer, 0, headerSize + entry.body->httpBodySize);
+			buffer = MemoryKit::mbuf(buffer, 0, headerSize + item->httpBodySize);
 
 			buildResponseHeader(prep, server, buffer.start, buffer.size());
-			memcpy(buffer.start + headerSize, entry.body->httpBodyData, entry.body->httpBodySize);
+			char *pos = buffer.start + headerSize;
+			for (unsigned int i = 0; i < item->httpBodyBuffers.size(); i++) {
+				const MemoryKit::mbuf &bodyBuffer = item->httpBodyBuffers[i];
+				memcpy(pos, bodyBuffer.start, bodyBuffer.size());
+				pos += bodyBuffer.size();
+			}
 
 			server->writeResponse(client, buffer);
 		} else {
-			char *buffer = (char *) psg_pnalloc(req->pool, headerSize + entry.body->httpBodySize);
-			buildResponseHeader(prep, server, buffer,
-				headerSize + entry.body->httpBodySize);
-			memcpy(buffer + headerSize, entry.body->httpBodyData, entry.body->httpBodySize);
-
-			server->writeResponse(client, buffer, headerSize + entry.body->httpBodySize);
+			char *buffer = (char *) psg_pnalloc(req->pool, headerSize);
+			buildResponseHeader(prep, server, buffer, headerSize);
+			server->writeResponse(client, buffer, headerSize);
+
+			if (!responseCache.isShared()) {
+				// Write the body directly from the cache's mbufs, without copying.
+				for (unsigned int i = 0; i < item->httpBodyBuffers.size() && !req->ended(); i++) {
+					server->writeResponse(client, item->httpBodyBuffers[i]);
+				}
+			} else {
+				// The cache's mbufs belong to another thread's pool, and mbuf
+				// reference counting is not thread-safe, so copy them into our
+				// own mbufs.
+				for (unsigned int i = 0; i < item->httpBodyBuffers.size() && !req->ended(); i++) {
+					const MemoryKit::mbuf &bodyBuffer = item->httpBodyBuffers[i];
+					unsigned int offset = 0;
+
+					while (offset < bodyBuffer.size() && !req->ended()) {
+						MemoryKit::mbuf copy(MemoryKit::mbuf_get(&mbuf_pool));
+						unsigned int size = std::min<unsigned int>(
+							bodyBuffer.size() - offset, copy.size());
+						memcpy(copy.start, bodyBuffer.start + offset, size);
+						server->writeResponse(client, MemoryKit::mbuf(copy, 0, size));
+						offset += size;
+					}
+				}
+			}
 		}
 	}
+
+	/**
+	 * Responds with 304 Not Modified, with the validator and caching
+	 * headers of the cached response.
+	 */
+	template<typename Server, typename Client>
+	void writeNotModifiedResponse(Server *server, Client *client, Request *req,
+		ResponseCacheEntryType &entry)
+	{
+		ResponsePreparation prep;
+		unsigned int headerSize;
+
+		prepareResponseHeader(prep, server, req, entry, true);
+		headerSize = buildResponseHeader(prep, server, NULL, 0);
+
+		char *buffer = (char *) psg_pnalloc(req->pool, headerSize);
+		buildResponseHeader(prep, server, buffer, headerSize);
+		server->writeResponse(client, buffer, headerSize);
+	}
 };
 
 
@@ -85,6 +85,7 @@
 #include <FileDescriptor.h>
 #include <ResourceLocator.h>
 #include <BackgroundEventLoop.cpp>
+#include <IoUring.cpp>
 #include <FileTools/FileManip.h>
 #include <Exceptions.h>
 #include <Utils.h>
@@ -98,6 +99,7 @@
 #include <Core/Config.h>
 #include <Core/ConfigChange.h>
 #include <Core/ApplicationPool/Pool.h>
+#include <Core/SpawningKit/OutputMultiplexer.h>
 #include <Core/UnionStation/Context.h>
 #include <Core/SecurityUpdateChecker.h>
 #include <Core/AdminPanelConnector.h>
@@ -139,6 +141,10 @@ namespace Core {
 
 	struct WorkingObjects {
 		int serverFds[SERVER_KIT_MAX_SERVER_ENDPOINTS];
+		// If accepting on serverFds[i] is sharded over the controller
+		// threads with SO_REUSEPORT, then serverFds[i] belongs to
+		// thread 1 and this contains the sockets of threads 2..n.
+		vector<int> reusePortServerFds[SERVER_KIT_MAX_SERVER_ENDPOINTS];
 		int apiServerFds[SERVER_KIT_MAX_SERVER_ENDPOINTS];
 		string controllerSecureHeadersPassword;
 
@@ -147,12 +153,15 @@ namespace Core {
 		ResourceLocator resourceLocator;
 		RandomGeneratorPtr randomGenerator;
 		UnionStation::ContextPtr unionStationContext;
+		SpawningKit::OutputMultiplexer *outputMultiplexer;
 		SpawningKit::ConfigPtr spawningKitConfig;
 		SpawningKit::FactoryPtr spawningKitFactory;
 		PoolPtr appPool;
+		ResponseCacheStorePtr turbocacheStore;
 		Json::Value singleAppModeConfig;
 
 		ServerKit::AcceptLoadBalancer<Controller> loadBalancer;
+		bool useLoadBalancer;
 		vector<ThreadWorkingObjects> threadWorkingObjects;
 		struct ev_signal sigintWatcher;
 		struct ev_signal sigtermWatcher;
@@ -171,7 +180,9 @@ namespace Core {
 		oxt::thread *adminPanelConnectorThread;
 
 		WorkingObjects()
-			: exitEvent(__FILE__, __LINE__, "WorkingObjects: exitEvent"),
+			: outputMultiplexer(NULL),
+			  useLoadBalancer(false),
+			  exitEvent(__FILE__, __LINE__, "WorkingObjects: exitEvent"),
 			  allClientsDisconnectedEvent(__FILE__, __LINE__, "WorkingObjects: allClientsDisconnectedEvent"),
 			  terminationCount(0),
 			  shutdownCounter(0),
@@ -421,10 +432,14 @@ startListening() {
 		setSelinuxSocketContext();
 	#endif
 
+	unsigned int nthreads = coreConfig->get("controller_threads").asUInt();
+	bool reusePort = coreConfig->get("controller_reuse_port").asBool() && nthreads > 1;
+
 	for (it = addresses.begin(), i = 0; it != addresses.end(); it++, i++) {
+		bool shardAccepts = reusePort && getSocketAddressType(it->asString()) == SAT_TCP;
 		wo->serverFds[i] = createServer(it->asString(),
 			coreConfig->get("controller_socket_backlog").asUInt(), true,
-			__FILE__, __LINE__);
+			__FILE__, __LINE__, shardAccepts);
 		#ifdef USE_SELINUX
 			resetSelinuxSocketContext();
 			if (i == 0 && getSocketAddressType(it->asString()) == SAT_UNIX) {
@@ -440,6 +455,25 @@ startListening() {
 		if (getSocketAddressType(it->asString()) == SAT_UNIX) {
 			makeFileWorldReadableAndWritable(parseUnixSocketAddress(it->asString()));
 		}
+
+		if (shardAccepts) {
+			P_DEBUG("Sharding accepts on " << it->asString() << " over "
+				<< nthreads << " SO_REUSEPORT sockets");
+			for (unsigned int j = 1; j < nthreads; j++) {
+				int fd = createServer(it->asString(),
+					coreConfig->get("controller_socket_backlog").asUInt(), true,
+					__FILE__, __LINE__, true);
+				wo->reusePortServerFds[i].push_back(fd);
+				P_LOG_FILE_DESCRIPTOR_PURPOSE(fd,
+					"Server address: " << it->asString() << " (thread " << (j + 1) << ")");
+			}
+			if (coreConfig->get("controller_reuse_port_cpu_steering").asBool()) {
+				setReusePortCpuSteering(wo->serverFds[i], nthreads);
+			}
+		} else if (reusePort) {
+			P_DEBUG("Not sharding accepts on " << it->asString()
+				<< ": SO_REUSEPORT is only supported on TCP sockets");
+		}
 	}
 	for (it = apiAddresses.begin(), i = 0; it != apiAddresses.end(); it++, i++) {
 		wo->apiServerFds[i] = createServer(it->asString(), 0, true,
@@ -663,15 +697,21 @@ initializeNonPrivilegedWorkingObjects() {
 			coreConfig->get("ust_router_address").asString(),
 			"logging",
 			coreConfig->get("ust_router_password").asString());
+		if (coreConfig->get("ust_router_async").asBool()) {
+			wo->unionStationContext->enableAsyncSending(
+				coreConfig->get("ust_router_async_queue_size").asUInt());
+		}
 	}
 
 	UPDATE_TRACE_POINT();
+	wo->outputMultiplexer = new SpawningKit::OutputMultiplexer();
 	wo->spawningKitConfig = boost::make_shared<SpawningKit::Config>();
 	wo->spawningKitConfig->resourceLocator = &wo->resourceLocator;
 	wo->spawningKitConfig->agentConfig = coreConfig->inspectEffectiveValues();
 	wo->spawningKitConfig->errorHandler = spawningKitErrorHandler;
 	wo->spawningKitConfig->unionStationContext = wo->unionStationContext;
 	wo->spawningKitConfig->randomGenerator = wo->randomGenerator;
+	wo->spawningKitConfig->outputMultiplexer = wo->outputMultiplexer;
 	wo->spawningKitConfig->instanceDir = coreConfig->get("instance_dir").asString();
 	if (!wo->spawningKitConfig->instanceDir.empty()) {
 		wo->spawningKitConfig->instanceDir = absolutizePath(
@@ -688,9 +728,24 @@ initializeNonPrivilegedWorkingObjects() {
 	wo->appPool->enableSelfChecking(coreConfig->get("pool_selfchecks").asBool());
 	wo->appPool->abortLongRunningConnectionsCallback = abortLongRunningConnections;
 
+	UPDATE_TRACE_POINT();
+	if (coreConfig->get("turbocache_shared").asBool()) {
+		wo->turbocacheStore = boost::make_shared<ResponseCacheStore>(
+			coreConfig->get("turbocache_max_entries").asUInt(),
+			coreConfig->get("turbocache_max_memory").asUInt(),
+			coreConfig->get("turbocache_shards").asUInt(),
+			true);
+	}
+
 	UPDATE_TRACE_POINT();
 	unsigned int nthreads = coreConfig->get("controller_threads").asUInt();
 	BackgroundEventLoop *firstLoop = NULL; // Avoid compiler warning
+	bool useIoUring = coreConfig->get("controller_io_uring").asBool();
+	if (useIoUring && !IoUring::isSupported()) {
+		P_WARN("io_uring is not supported by this kernel; "
+			"falling back to thread pool based file I/O");
+		useIoUring = false;
+	}
 	wo->threadWorkingObjects.reserve(nthreads);
 	for (unsigned int i = 0; i < nthreads; i++) {
 		UPDATE_TRACE_POINT();
@@ -703,9 +758,9 @@ initializeNonPrivilegedWorkingObjects() {
 		controllerConfig["thread_number"] = i + 1;
 
 		if (i == 0) {
-			two.bgloop = firstLoop = new BackgroundEventLoop(true, true);
+			two.bgloop = firstLoop = new BackgroundEventLoop(true, !useIoUring, useIoUring);
 		} else {
-			two.bgloop = new BackgroundEventLoop(true, true);
+			two.bgloop = new BackgroundEventLoop(true, !useIoUring, useIoUring);
 		}
 
 		UPDATE_TRACE_POINT();
@@ -715,6 +770,7 @@ initializeNonPrivilegedWorkingObjects() {
 			coreSchema->controllerServerKit.translator);
 		two.serverKitContext->libev = two.bgloop->safe;
 		two.serverKitContext->libuv = two.bgloop->libuv_loop;
+		two.serverKitContext->ioUring = two.bgloop->io_uring;
 		two.serverKitContext->initialize();
 
 		UPDATE_TRACE_POINT();
@@ -728,6 +784,7 @@ initializeNonPrivilegedWorkingObjects() {
 		two.controller->resourceLocator = &wo->resourceLocator;
 		two.controller->appPool = wo->appPool;
 		two.controller->unionStationContext = wo->unionStationContext;
+		two.controller->turbocacheStore = wo->turbocacheStore;
 		two.controller->shutdownFinishCallback = controllerShutdownFinished;
 		two.controller->initialize();
 		wo->shutdownCounter.fetch_add(1, boost::memory_order_relaxed);
@@ -769,6 +826,7 @@ initializeNonPrivilegedWorkingObjects() {
 				wo->threadWorkingObjects[i].controller);
 		}
 		awo->apiServer->appPool = wo->appPool;
+		awo->apiServer->turbocacheStore = wo->turbocacheStore;
 		awo->apiServer->exitEvent = &wo->exitEvent;
 		awo->apiServer->shutdownFinishCallback = apiServerShutdownFinished;
 		awo->apiServer->initialize();
@@ -785,23 +843,36 @@ initializeNonPrivilegedWorkingObjects() {
 	 * This is especially noticeable on systems that heavily swap.
 	 */
 	for (unsigned int i = 0; i < addresses.size(); i++) {
-		if (nthreads == 1) {
+		if (!wo->reusePortServerFds[i].empty()) {
+			// Every thread accepts on its own socket.
+			wo->threadWorkingObjects[0].controller->listen(wo->serverFds[i]);
+			for (unsigned int j = 1; j < nthreads; j++) {
+				ThreadWorkingObjects *two = &wo->threadWorkingObjects[j];
+				two->controller->listen(wo->reusePortServerFds[i][j - 1]);
+			}
+		} else if (nthreads == 1) {
 			ThreadWorkingObjects *two = &wo->threadWorkingObjects[0];
 			two->controller->listen(wo->serverFds[i]);
 		} else {
 			wo->loadBalancer.listen(wo->serverFds[i]);
+			wo->useLoadBalancer = true;
 		}
 	}
 	for (unsigned int i = 0; i < nthreads; i++) {
 		ThreadWorkingObjects *two = &wo->threadWorkingObjects[i];
 		two->controller->createSpareClients();
 	}
-	if (nthreads > 1) {
+	if (wo->useLoadBalancer) {
+		wo->loadBalancer.strategy = ServerKit::parseAcceptLoadBalancingStrategy(
+			coreConfig->get("controller_load_balancing_strategy").asString());
 		wo->loadBalancer.servers.reserve(nthreads);
 		for (unsigned int i = 0; i < nthreads; i++) {
 			ThreadWorkingObjects *two = &wo->threadWorkingObjects[i];
 			wo->loadBalancer.servers.push_back(two->controller);
 		}
+		if (wo->apiWorkingObjects.apiServer != NULL) {
+			wo->apiWorkingObjects.apiServer->loadBalancer = &wo->loadBalancer;
+		}
 	}
 	for (unsigned int i = 0; i < apiAddresses.size(); i++) {
 		wo->apiWorkingObjects.apiServer->listen(wo->apiServerFds[i]);
@@ -1044,12 +1115,14 @@ mainLoop() {
 			}
 		#endif
 	}
+	// The load balancer must be started before the API server,
+	// which inspects the load balancer's state.
+	if (wo->useLoadBalancer) {
+		wo->loadBalancer.start();
+	}
 	if (wo->apiWorkingObjects.apiServer != NULL) {
 		wo->apiWorkingObjects.bgloop->start("API event loop", 0);
 	}
-	if (wo->threadWorkingObjects.size() > 1) {
-		wo->loadBalancer.start();
-	}
 	waitForExitEvent();
 }
 
@@ -1158,7 +1231,7 @@ waitForExitEvent() {
 			ThreadWorkingObjects *two = &wo->threadWorkingObjects[i];
 			two->bgloop->safe->runLater(boost::bind(shutdownController, two));
 		}
-		if (wo->threadWorkingObjects.size() > 1) {
+		if (wo->useLoadBalancer) {
 			wo->loadBalancer.shutdown();
 		}
 		if (wo->apiWorkingObjects.apiServer != NULL) {
@@ -1203,6 +1276,8 @@ cleanup() {
 		wo->apiWorkingObjects.bgloop->stop();
 	}
 	wo->appPool.reset();
+	delete wo->outputMultiplexer;
+	wo->outputMultiplexer = NULL;
 	for (unsigned i = 0; i < wo->threadWorkingObjects.size(); i++) {
 		ThreadWorkingObjects *two = &wo->threadWorkingObjects[i];
 		delete two->controller;
@@ -1217,6 +1292,9 @@ cleanup() {
 		if (wo->serverFds[i] != -1) {
 			close(wo->serverFds[i]);
 		}
+		for (unsigned int j = 0; j < wo->reusePortServerFds[i].size(); j++) {
+			close(wo->reusePortServerFds[i][j]);
+		}
 		if (wo->apiServerFds[i] != -1) {
 			close(wo->apiServerFds[i]);
 		}
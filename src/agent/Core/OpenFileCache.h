@@ -0,0 +1,219 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_OPEN_FILE_CACHE_H_
+#define _PASSENGER_OPEN_FILE_CACHE_H_
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <oxt/system_calls.hpp>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <algorithm>
+#include <string>
+#include <list>
+#include <FileDescriptor.h>
+#include <StaticString.h>
+#include <Utils/CachedFileStat.hpp>
+#include <Utils/StringMap.h>
+
+namespace Passenger {
+namespace Core {
+
+using namespace std;
+
+
+/**
+ * Keeps the most recently served files open, so that serving an
+ * X-Sendfile response doesn't cost an open() and a close() every time.
+ *
+ * Whether a cached file descriptor is still current is checked with a
+ * CachedFileStat, so a file is stat()ted at most once every `throttleRate`
+ * seconds. A file that has been replaced or modified in place is reopened.
+ * Within the throttle window a replaced file may still be served from the
+ * old file descriptor, just like the stat throttling elsewhere in Passenger.
+ *
+ * File descriptors are reference counted, so evicting an entry doesn't
+ * close a file that is still being sent.
+ *
+ * Not thread-safe; every Controller has its own cache.
+ */
+class OpenFileCache: public boost::noncopyable {
+public:
+	struct File {
+		FileDescriptor fd;
+		boost::uint64_t size;
+		time_t mtime;
+		dev_t dev;
+		ino_t ino;
+
+		File()
+			: size(0),
+			  mtime(0),
+			  dev(0),
+			  ino(0)
+			{ }
+	};
+
+private:
+	struct Entry {
+		string path;
+		File file;
+	};
+
+	typedef list<Entry> EntryList;
+
+	CachedFileStat cstat;
+	EntryList entries;
+	StringMap<EntryList::iterator> index;
+	unsigned int maxSize;
+
+	static bool matches(const File &file, const struct stat &buf) {
+		return file.dev == buf.st_dev
+			&& file.ino == buf.st_ino
+			&& file.size == (boost::uint64_t) buf.st_size
+			&& file.mtime == buf.st_mtime;
+	}
+
+	void remove(const StaticString &path) {
+		EntryList::iterator it = index.get(path, entries.end());
+		if (it != entries.end()) {
+			index.remove(path);
+			entries.erase(it);
+		}
+	}
+
+	void trim() {
+		while (index.size() > maxSize) {
+			index.remove(entries.back().path);
+			entries.pop_back();
+		}
+	}
+
+public:
+	// A CachedFileStat with a maximum size of 0 is unlimited, so give it
+	// at least one entry.
+	OpenFileCache(unsigned int _maxSize = 256)
+		: cstat(std::max(_maxSize, 1u)),
+		  maxSize(_maxSize)
+		{ }
+
+	/**
+	 * Looks up an open file descriptor for the regular file at `path`,
+	 * opening the file if necessary.
+	 *
+	 * Returns 0 on success, or an errno code. EISDIR is returned if `path`
+	 * exists but is not a regular file.
+	 */
+	int open(const StaticString &path, unsigned int throttleRate, File &result) {
+		struct stat buf;
+
+		if (cstat.stat(path, &buf, throttleRate) == -1) {
+			int e = errno;
+			remove(path);
+			return e;
+		}
+		if (!S_ISREG(buf.st_mode)) {
+			remove(path);
+			return EISDIR;
+		}
+
+		EntryList::iterator it = index.get(path, entries.end());
+		if (it != entries.end()) {
+			if (matches(it->file, buf)) {
+				entries.splice(entries.begin(), entries, it);
+				result = it->file;
+				return 0;
+			}
+			index.remove(path);
+			entries.erase(it);
+		}
+
+		string pathStr = path;
+		// O_NONBLOCK keeps us from blocking the event loop if the file was
+		// replaced by a FIFO after the stat(). It has no effect on regular files.
+		FileDescriptor fd(syscalls::open(pathStr.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK),
+			__FILE__, __LINE__);
+		if (fd == -1) {
+			return errno;
+		}
+		// The file may have been replaced after the stat(), so describe
+		// what we actually opened.
+		if (fstat(fd, &buf) == -1) {
+			return errno;
+		}
+		if (!S_ISREG(buf.st_mode)) {
+			return EISDIR;
+		}
+
+		result.fd = fd;
+		result.size = buf.st_size;
+		result.mtime = buf.st_mtime;
+		result.dev = buf.st_dev;
+		result.ino = buf.st_ino;
+
+		if (maxSize > 0) {
+			entries.push_front(Entry());
+			entries.front().path = pathStr;
+			entries.front().file = result;
+			index.set(entries.front().path, entries.begin());
+			trim();
+		}
+		return 0;
+	}
+
+	/**
+	 * Changes the maximum number of open files. A size of 0 disables
+	 * caching: every lookup opens the file.
+	 */
+	void setMaxSize(unsigned int _maxSize) {
+		maxSize = _maxSize;
+		cstat.setMaxSize(std::max(_maxSize, 1u));
+		trim();
+	}
+
+	unsigned int getMaxSize() const {
+		return maxSize;
+	}
+
+	unsigned int size() const {
+		return index.size();
+	}
+
+	void clear() {
+		while (!entries.empty()) {
+			index.remove(entries.back().path);
+			entries.pop_back();
+		}
+	}
+};
+
+
+} // namespace Core
+} // namespace Passenger
+
+#endif /* _PASSENGER_OPEN_FILE_CACHE_H_ */
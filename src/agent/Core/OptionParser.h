@@ -70,6 +70,15 @@ coreUsage() {
 	printf("                            are applicable\n");
 	printf("      --socket-backlog      Override size of the socket backlog.\n");
 	printf("                            Default: %d\n", DEFAULT_SOCKET_BACKLOG);
+	printf("      --reuse-port          Give every request handling thread its own\n");
+	printf("                            SO_REUSEPORT socket for each TCP --listen\n");
+	printf("                            address, instead of accepting clients on a\n");
+	printf("                            single thread and distributing them\n");
+	printf("      --reuse-port-cpu-steering\n");
+	printf("                            With --reuse-port, hand each new connection to\n");
+	printf("                            the thread that belongs to the CPU which received\n");
+	printf("                            it. Requires --cpu-affine, and works best with\n");
+	printf("                            one thread per CPU core (Linux only)\n");
 	printf("\n");
 	printf("Daemon options (optional):\n");
 	printf("      --pid-file PATH       Store the core's PID in the given file. The file\n");
@@ -151,7 +160,8 @@ coreUsage() {
 	printf("                            requests per process\n");
 	printf("      --min-instances N     Minimum number of application processes. Default: 1\n");
 	printf("      --memory-limit MB     Restart application processes that go over the\n");
-	printf("                            given memory limit (Enterprise only)\n");
+	printf("                            given memory limit. Processes are replaced one\n");
+	printf("                            at a time. Default: 0 (no limit)\n");
 	printf("\n");
 	printf("Request handling options (optional):\n");
 	printf("      --max-requests        Restart application processes that have handled\n");
@@ -161,6 +171,16 @@ coreUsage() {
 	printf("      --max-request-queue-size NUMBER\n");
 	printf("                            Specify request queue size. Default: %d\n",
 		DEFAULT_MAX_REQUEST_QUEUE_SIZE);
+	printf("      --predictive-spawning Spawn and shut down processes ahead of demand,\n");
+	printf("                            based on the request arrival rate and response\n");
+	printf("                            times\n");
+	printf("      --routing-strategy NAME\n");
+	printf("                            How requests are distributed over an application's\n");
+	printf("                            processes: 'lowest_busyness', 'power_of_two_choices'\n");
+	printf("                            or 'least_latency'. Default: lowest_busyness\n");
+	printf("      --spawn-concurrency NUMBER\n");
+	printf("                            Maximum number of processes that are spawned at\n");
+	printf("                            the same time for a single application. Default: 1\n");
 	printf("      --sticky-sessions     Enable sticky sessions\n");
 	printf("      --sticky-sessions-cookie-name NAME\n");
 	printf("                            Cookie name to use for sticky sessions.\n");
@@ -169,14 +189,91 @@ coreUsage() {
 	printf("                            Vary the turbocache by the cookie of the given name\n");
 	printf("      --disable-turbocaching\n");
 	printf("                            Disable turbocaching\n");
+	printf("      --turbocache-max-entries NUMBER\n");
+	printf("                            Maximum number of responses in the turbocache.\n");
+	printf("                            Default: %d\n", DEFAULT_TURBOCACHE_MAX_ENTRIES);
+	printf("      --turbocache-max-memory BYTES\n");
+	printf("                            Maximum amount of memory that the turbocache may\n");
+	printf("                            use. Default: %d\n", DEFAULT_TURBOCACHE_MAX_MEMORY);
+	printf("      --turbocache-max-body-size BYTES\n");
+	printf("                            Maximum size of a response body that may be\n");
+	printf("                            turbocached. Default: %d\n", DEFAULT_TURBOCACHE_MAX_BODY_SIZE);
+	printf("      --turbocache-shared   Share a single turbocache between all request\n");
+	printf("                            handling threads\n");
+	printf("      --turbocache-shards NUMBER\n");
+	printf("                            Number of independently locked partitions of\n");
+	printf("                            the shared turbocache. Default: %d\n", DEFAULT_TURBOCACHE_SHARDS);
+	printf("      --turbocache-collapsed-forwarding\n");
+	printf("                            Forward only one of several concurrent identical\n");
+	printf("                            cacheable requests to the app, and serve the\n");
+	printf("                            others from the turbocache\n");
+	printf("      --turbocache-collapsed-forwarding-timeout SECONDS\n");
+	printf("                            Maximum time that collapsed requests wait for\n");
+	printf("                            the first response. Default: %d\n",
+		DEFAULT_TURBOCACHE_COLLAPSED_FORWARDING_TIMEOUT);
 	printf("      --no-abort-websockets-on-process-shutdown\n");
 	printf("                            Do not abort WebSocket connections on process\n");
 	printf("                            shutdown or restart\n");
+	printf("      --http2               Accept HTTP/2 over cleartext connections, using\n");
+	printf("                            either prior knowledge or an h2c upgrade\n");
+	printf("      --http2-max-concurrent-streams NUMBER\n");
+	printf("                            Maximum number of concurrent HTTP/2 streams per\n");
+	printf("                            connection. Default: 100\n");
+	printf("      --response-compression\n");
+	printf("                            Compress textual response bodies with gzip or\n");
+	printf("                            deflate if the client accepts it\n");
+	printf("      --response-compression-level NUMBER\n");
+	printf("                            zlib compression level (1-9). Default: %d\n",
+		DEFAULT_RESPONSE_COMPRESSION_LEVEL);
+	printf("      --response-compression-min-size BYTES\n");
+	printf("                            Do not compress response bodies that are known\n");
+	printf("                            to be smaller than this. Default: %d\n",
+		DEFAULT_RESPONSE_COMPRESSION_MIN_SIZE);
+	printf("      --native-x-sendfile   Serve the files that apps refer to with\n");
+	printf("                            X-Sendfile or X-Accel-Redirect ourselves.\n");
+	printf("                            Requires --x-sendfile-root or\n");
+	printf("                            --x-accel-redirect-root\n");
+	printf("      --x-sendfile-root PATH\n");
+	printf("                            Directory that X-Sendfile files must be in.\n");
+	printf("                            Without it, X-Sendfile responses are not\n");
+	printf("                            served natively\n");
+	printf("      --x-accel-redirect-root PATH\n");
+	printf("                            Directory that X-Accel-Redirect URIs are\n");
+	printf("                            relative to. Without it, X-Accel-Redirect\n");
+	printf("                            responses are not served natively\n");
+	printf("      --open-file-cache-size NUMBER\n");
+	printf("                            Number of X-Sendfile files to keep open per\n");
+	printf("                            thread. Default: %d\n", DEFAULT_OPEN_FILE_CACHE_SIZE);
+	printf("      --splice-relay        Relay large request and response bodies between\n");
+	printf("                            clients and apps with splice(), without copying\n");
+	printf("                            them through user space (Linux only)\n");
+	printf("      --splice-relay-min-size BYTES\n");
+	printf("                            Only relay bodies with splice() if at least this\n");
+	printf("                            much of them remains. Default: %d\n",
+		DEFAULT_SPLICE_RELAY_MIN_SIZE);
+	printf("      --ust-router-async    Send Union Station data to the UstRouter from a\n");
+	printf("                            background thread instead of from the request\n");
+	printf("                            path\n");
+	printf("      --ust-router-async-queue-size BYTES\n");
+	printf("                            Maximum amount of Union Station data to queue\n");
+	printf("                            for sending. Data that does not fit is dropped.\n");
+	printf("                            Default: %d\n", DEFAULT_UST_ROUTER_ASYNC_QUEUE_SIZE);
 	printf("\n");
 	printf("Other options (optional):\n");
 	printf("      --log-file PATH       Log to the given file.\n");
 	printf("      --log-level LEVEL     Logging level. Default: %d\n", DEFAULT_LOG_LEVEL);
 	printf("      --fd-log-file PATH    Log file descriptor activity to the given file.\n");
+	printf("      --async-logging       Write log entries from a background thread, so\n");
+	printf("                            that threads that log never block on the log\n");
+	printf("                            file\n");
+	printf("      --async-logging-buffer-size BYTES\n");
+	printf("                            Size of the per-thread buffers for asynchronous\n");
+	printf("                            logging. Default: %d\n",
+		DEFAULT_ASYNC_LOGGING_BUFFER_SIZE);
+	printf("      --async-logging-overflow-policy drop|block\n");
+	printf("                            What to do when a thread's asynchronous logging\n");
+	printf("                            buffer is full: drop the entry, or wait until\n");
+	printf("                            there is room. Default: drop\n");
 	printf("      --stat-throttle-rate SECONDS\n");
 	printf("                            Throttle filesystem restart.txt checks to at most\n");
 	printf("                            once per given seconds. Default: %d\n", DEFAULT_STAT_THROTTLE_RATE);
@@ -186,6 +283,9 @@ coreUsage() {
 	printf("      --data-buffer-dir PATH\n");
 	printf("                            Directory to store data buffers in. Default:\n");
 	printf("                            %s\n", getSystemTempDir());
+	printf("      --io-uring            Perform data buffer file I/O through io_uring\n");
+	printf("                            instead of through a thread pool, if the kernel\n");
+	printf("                            supports it (Linux only)\n");
 	printf("      --no-graceful-exit    When exiting, exit immediately instead of waiting\n");
 	printf("                            for all connections to terminate\n");
 	printf("      --benchmark MODE      Enable benchmark mode. Available modes:\n");
@@ -198,6 +298,11 @@ coreUsage() {
 	printf("                            Default: number of CPU cores (%d)\n",
 		boost::thread::hardware_concurrency());
 	printf("      --cpu-affine          Enable per-thread CPU affinity (Linux only)\n");
+	printf("      --load-balancing-strategy STRATEGY\n");
+	printf("                            How to distribute new clients over the request\n");
+	printf("                            handling threads: round_robin, or\n");
+	printf("                            least_active_clients to pick the thread with\n");
+	printf("                            the fewest clients. Default: round_robin\n");
 	printf("      --core-file-descriptor-ulimit NUMBER\n");
 	printf("                            Set custom file descriptor ulimit for the core\n");
 	printf("      --admin-panel-url URL\n");
@@ -267,6 +372,12 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--socket-backlog")) {
 		updates["controller_socket_backlog"] = argv[i + 1];
 		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--reuse-port")) {
+		updates["controller_reuse_port"] = true;
+		i++;
+	} else if (p.isFlag(argv[i], '\0', "--reuse-port-cpu-steering")) {
+		updates["controller_reuse_port_cpu_steering"] = true;
+		i++;
 	} else if (p.isFlag(argv[i], '\0', "--no-user-switching")) {
 		updates["user_switching"] = false;
 		i++;
@@ -297,6 +408,9 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--min-instances")) {
 		updates["default_min_instances"] = atoi(argv[i + 1]);
 		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--memory-limit")) {
+		updates["default_memory_limit"] = atoi(argv[i + 1]);
+		i += 2;
 	} else if (p.isValueFlag(argc, i, argv[i], 'e', "--environment")) {
 		updates["default_environment"] = argv[i + 1];
 		i += 2;
@@ -327,6 +441,15 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--max-request-queue-size")) {
 		updates["default_max_request_queue_size"] = atoi(argv[i + 1]);
 		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--predictive-spawning")) {
+		updates["default_predictive_spawning"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--routing-strategy")) {
+		updates["default_routing_strategy"] = argv[i + 1];
+		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--spawn-concurrency")) {
+		updates["default_spawn_concurrency"] = atoi(argv[i + 1]);
+		i += 2;
 	} else if (p.isFlag(argv[i], '\0', "--sticky-sessions")) {
 		updates["default_sticky_sessions"] = true;
 		i++;
@@ -339,9 +462,69 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isFlag(argv[i], '\0', "--disable-turbocaching")) {
 		updates["turbocaching"] = false;
 		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--turbocache-max-entries")) {
+		updates["turbocache_max_entries"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--turbocache-max-memory")) {
+		updates["turbocache_max_memory"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--turbocache-max-body-size")) {
+		updates["turbocache_max_body_size"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--turbocache-shared")) {
+		updates["turbocache_shared"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--turbocache-shards")) {
+		updates["turbocache_shards"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--turbocache-collapsed-forwarding")) {
+		updates["turbocache_collapsed_forwarding"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--turbocache-collapsed-forwarding-timeout")) {
+		updates["turbocache_collapsed_forwarding_timeout"] = atoi(argv[i + 1]);
+		i += 2;
 	} else if (p.isFlag(argv[i], '\0', "--no-abort-websockets-on-process-shutdown")) {
 		updates["default_abort_websockets_on_process_shutdown"] = false;
 		i++;
+	} else if (p.isFlag(argv[i], '\0', "--http2")) {
+		updates["controller_http2"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--http2-max-concurrent-streams")) {
+		updates["controller_http2_max_concurrent_streams"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--response-compression")) {
+		updates["response_compression"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--response-compression-level")) {
+		updates["response_compression_level"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--response-compression-min-size")) {
+		updates["response_compression_min_size"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--native-x-sendfile")) {
+		updates["native_x_sendfile"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--x-sendfile-root")) {
+		updates["x_sendfile_root"] = argv[i + 1];
+		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--x-accel-redirect-root")) {
+		updates["x_accel_redirect_root"] = argv[i + 1];
+		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--open-file-cache-size")) {
+		updates["open_file_cache_size"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--splice-relay")) {
+		updates["splice_relay"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--splice-relay-min-size")) {
+		updates["splice_relay_min_size"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--ust-router-async")) {
+		updates["ust_router_async"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--ust-router-async-queue-size")) {
+		updates["ust_router_async_queue_size"] = atoi(argv[i + 1]);
+		i += 2;
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--ruby")) {
 		updates["default_ruby"] = argv[i + 1];
 		i += 2;
@@ -366,6 +549,15 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--fd-log-file")) {
 		updates["file_descriptor_log_target"] = argv[i + 1];
 		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--async-logging")) {
+		updates["async_logging"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--async-logging-buffer-size")) {
+		updates["async_logging_buffer_size"] = atoi(argv[i + 1]);
+		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--async-logging-overflow-policy")) {
+		updates["async_logging_overflow_policy"] = argv[i + 1];
+		i += 2;
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--stat-throttle-rate")) {
 		updates["stat_throttle_rate"] = atoi(argv[i + 1]);
 		i += 2;
@@ -375,6 +567,9 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--data-buffer-dir")) {
 		updates["controller_file_buffered_channel_buffer_dir"] = atoi(argv[i + 1]);
 		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--io-uring")) {
+		updates["controller_io_uring"] = true;
+		i++;
 	} else if (p.isFlag(argv[i], '\0', "--no-graceful-exit")) {
 		updates["graceful_exit"] = false;
 		i++;
@@ -390,6 +585,9 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isFlag(argv[i], '\0', "--cpu-affine")) {
 		updates["controller_cpu_affine"] = true;
 		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--load-balancing-strategy")) {
+		updates["controller_load_balancing_strategy"] = argv[i + 1];
+		i += 2;
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--core-file-descriptor-ulimit")) {
 		updates["file_descriptor_ulimit"] = atoi(argv[i + 1]);
 		i += 2;
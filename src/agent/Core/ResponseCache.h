@@ -27,102 +27,68 @@
 #define _PASSENGER_RESPONSE_CACHE_H_
 
 #include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <oxt/macros.hpp>
+#include <sys/uio.h>
 #include <time.h>
 #include <cassert>
 #include <cstring>
 #include <DataStructures/HashedStaticString.h>
 #include <ServerKit/http_parser.h>
 #include <ServerKit/CookieUtils.h>
+#include <ServerKit/ContentCoding.h>
+#include <Constants.h>
 #include <StaticString.h>
 #include <Utils/DateParsing.h>
 #include <Utils/StrIntUtils.h>
+#include <Core/ResponseCacheStore.h>
 
 namespace Passenger {
 
 /**
+ * A response cache engine, used by turbocaching.
+ *
+ * This class decides which requests and responses are cacheable, and generates
+ * the cache keys. The responses themselves are kept in a ResponseCacheStore:
+ * response headers are stored together with the key, while the (dechunked)
+ * response body is copied into a chain of mbufs that are allocated from an mbuf
+ * pool owned by the store. The total number of entries, the total amount of
+ * memory and the maximum size of a single body are all configurable. See
+ * ResponseCacheShard for the eviction policy.
+ *
+ * By default every ResponseCache has a private store. Multiple ResponseCaches
+ * may share a single thread-safe store through setStore().
+ *
+ * Responses with a Vary header are stored under a secondary key, which is
+ * derived from the values of the request headers that the response varies on.
+ * A Vary marker under the primary key records the names of those headers.
+ * Responses with `stale-while-revalidate` or `stale-if-error` Cache-Control
+ * extensions are kept after they expire; see ResponseCacheShard::fetch().
+ *
+ * This class is not thread-safe.
+ *
  * Relevant RFCs:
+ * https://tools.ietf.org/html/rfc7232    HTTP 1.1 Conditional Requests
  * https://tools.ietf.org/html/rfc7234    HTTP 1.1 Caching
+ * https://tools.ietf.org/html/rfc5861    HTTP Cache-Control Extensions for Stale Content
  * https://tools.ietf.org/html/rfc2109    HTTP State Management Mechanism
  */
 template<typename Request>
-class ResponseCache {
+class ResponseCache: public boost::noncopyable {
 public:
-	static const unsigned int MAX_ENTRIES     = 8; // Fits in exactly 2 cache lines
 	static const unsigned int MAX_KEY_LENGTH  = 256;
+	static const unsigned int MAX_VARIANT_KEY_LENGTH = 1024;
 	static const unsigned int MAX_HEADER_SIZE = 4096;
-	static const unsigned int MAX_BODY_SIZE   = 1024 * 32;
+	static const unsigned int DEFAULT_MAX_ENTRIES = DEFAULT_TURBOCACHE_MAX_ENTRIES;
+	static const unsigned int DEFAULT_MAX_MEMORY  = DEFAULT_TURBOCACHE_MAX_MEMORY;
+	static const unsigned int DEFAULT_MAX_BODY_SIZE = DEFAULT_TURBOCACHE_MAX_BODY_SIZE;
 	static const unsigned int DEFAULT_HEURISTIC_FRESHNESS = 10;
 	static const unsigned int MIN_HEURISTIC_FRESHNESS = 1;
+	static const unsigned int MBUF_BLOCK_CHUNK_SIZE = ResponseCacheShard::MBUF_BLOCK_CHUNK_SIZE;
 
-	struct Header {
-		bool valid;
-		unsigned short keySize;
-		boost::uint32_t hash;
-		time_t date;
-
-		Header()
-			: valid(false),
-			  keySize(0),
-			  hash(0),
-			  date(0)
-			{ }
-	};
-
-	struct Body {
-		unsigned short httpHeaderSize;
-		unsigned short httpBodySize;
-		time_t expiryDate;
-		char key[MAX_KEY_LENGTH];
-		char httpHeaderData[MAX_HEADER_SIZE];
-		// This data is dechunked.
-		char httpBodyData[MAX_BODY_SIZE];
-
-		Body()
-			: httpHeaderSize(0),
-			  httpBodySize(0),
-			  expiryDate(0)
-		{
-			key[0] = httpHeaderData[0] = httpBodyData[0] = '\0';
-		}
-	};
-
-	struct Entry {
-		unsigned int index;
-		Header *header;
-		Body *body;
-		enum {
-			NOT_FOUND,
-			NOT_FRESH
-		} cacheMissReason;
-
-		Entry()
-			: index(0),
-			  header(NULL),
-			  body(NULL)
-			{ }
-
-		Entry(unsigned int i, Header *h, Body *b)
-			: index(i),
-			  header(h),
-			  body(b)
-			{ }
-
-		OXT_FORCE_INLINE
-		bool valid() const {
-			return header != NULL;
-		}
-
-		const char *getCacheMissReasonString() const {
-			switch (cacheMissReason) {
-			case NOT_FOUND:
-				return "NOT_FOUND";
-			case NOT_FRESH:
-				return "NOT_FRESH";
-			default:
-				return "UNKNOWN";
-			}
-		}
-	};
+	typedef ResponseCacheItem Item;
+	typedef ResponseCacheEntry Entry;
 
 private:
 	HashedStaticString HOST;
@@ -135,6 +101,9 @@ private:
 	HashedStaticString X_ACCEL_REDIRECT;
 	HashedStaticString EXPIRES;
 	HashedStaticString LAST_MODIFIED;
+	HashedStaticString ETAG;
+	HashedStaticString IF_NONE_MATCH;
+	HashedStaticString IF_MODIFIED_SINCE;
 	HashedStaticString LOCATION;
 	HashedStaticString CONTENT_LOCATION;
 	HashedStaticString COOKIE;
@@ -142,8 +111,8 @@ private:
 
 	unsigned int fetches, hits, stores, storeSuccesses;
 
-	Header headers[MAX_ENTRIES];
-	Body bodies[MAX_ENTRIES];
+	unsigned int maxBodySize;
+	ResponseCacheStorePtr storage;
 
 	unsigned int calculateKeyLength(const LString * restrict host,
 		const LString * restrict varyCookie,
@@ -216,37 +185,6 @@ private:
 		}
 	}
 
-	Entry lookup(const HashedStaticString &cacheKey) {
-		for (unsigned int i = 0; i < MAX_ENTRIES; i++) {
-			if (headers[i].valid
-			 && headers[i].hash == cacheKey.hash()
-			 && cacheKey == StaticString(bodies[i].key, headers[i].keySize))
-			{
-				return Entry(i, &headers[i], &bodies[i]);
-			}
-		}
-		return Entry();
-	}
-
-	Entry lookupInvalidOrOldest() {
-		int oldest = -1;
-
-		for (unsigned int i = 0; i < MAX_ENTRIES; i++) {
-			if (!headers[i].valid) {
-				return Entry(i, &headers[i], &bodies[i]);
-			} else if (oldest == -1 || headers[i].date < headers[oldest].date) {
-				oldest = i;
-			}
-		}
-
-		return Entry(oldest, &headers[oldest], &bodies[oldest]);
-	}
-
-	OXT_FORCE_INLINE
-	void erase(unsigned int index) {
-		headers[index].valid = false;
-	}
-
 	time_t parseDate(psg_pool_t *pool, const LString *date, ev_tstamp now) const {
 		if (date == NULL || date->size == 0) {
 			return (time_t) now;
@@ -313,8 +251,226 @@ private:
 		return now + DEFAULT_HEURISTIC_FRESHNESS;
 	}
 
-	bool isFresh(const Entry &entry, ev_tstamp now) const {
-		return entry.body->expiryDate > now;
+	/**
+	 * Returns the value of a `name=seconds` Cache-Control directive,
+	 * or 0 if it's not present.
+	 */
+	static unsigned int parseCacheControlSeconds(const LString *cacheControl,
+		const StaticString &name)
+	{
+		if (cacheControl == NULL || cacheControl->size == 0) {
+			return 0;
+		}
+
+		StaticString value(cacheControl->start->data, cacheControl->size);
+		string::size_type pos = value.find(name);
+		if (pos == string::npos || value.size() <= pos + name.size()
+		 || value[pos + name.size()] != '=')
+		{
+			return 0;
+		}
+		return stringToUint(value.substr(pos + name.size() + 1));
+	}
+
+	static StaticString trimHttpWhitespace(const char *begin, const char *end) {
+		while (begin < end && (*begin == ' ' || *begin == '\t')) {
+			begin++;
+		}
+		while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {
+			end--;
+		}
+		return StaticString(begin, end - begin);
+	}
+
+	/**
+	 * Normalizes a Vary header value into a list of lowercase header names,
+	 * separated by newlines. Returns false if the response varies on
+	 * something other than request headers (`Vary: *`).
+	 */
+	bool normalizeVaryHeader(psg_pool_t *pool, const LString *value, LString *output) const {
+		const char *pos = value->start->data;
+		const char *end = value->start->data + value->size;
+
+		psg_lstr_init(output);
+		while (pos < end) {
+			const char *sep = (const char *) memchr(pos, ',', end - pos);
+			if (sep == NULL) {
+				sep = end;
+			}
+
+			StaticString name = trimHttpWhitespace(pos, sep);
+			if (name == "*") {
+				return false;
+			} else if (!name.empty()) {
+				char *lowercaseName = (char *) psg_pnalloc(pool, name.size());
+				convertLowerCase((const unsigned char *) name.data(),
+					(unsigned char *) lowercaseName, name.size());
+				if (output->size > 0) {
+					psg_lstr_append(output, pool, "\n", 1);
+				}
+				psg_lstr_append(output, pool, lowercaseName, name.size());
+			}
+
+			pos = sep + 1;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Returns the value of the given request header as it goes into a variant
+	 * key. An Accept-Encoding value that only mentions codings which the
+	 * Controller can apply itself is reduced to the coding that it negotiates,
+	 * so that e.g. "gzip, deflate" and "deflate;q=0.5, gzip" share the
+	 * compressed variant.
+	 */
+	StaticString lookupVariantHeader(Request *req, const StaticString &name) const {
+		const LString *value = req->headers.lookup(name);
+		if (value == NULL || value->size == 0) {
+			return StaticString();
+		}
+
+		value = psg_lstr_make_contiguous(value, req->pool);
+		StaticString result(value->start->data, value->size);
+		if (name == "accept-encoding") {
+			bool onlyKnownCodings;
+			ServerKit::ContentCoding coding = ServerKit::negotiateContentCoding(
+				result, &onlyKnownCodings);
+			if (onlyKnownCodings) {
+				result = ServerKit::getContentCodingName(coding);
+			}
+		}
+		return result;
+	}
+
+	/**
+	 * Generates the secondary key of the given request, under which the
+	 * response variant is stored that matches the request headers named by
+	 * the Vary marker. Returns an empty key if it would be too long.
+	 */
+	HashedStaticString generateVariantKey(Request *req, const Item *marker) const {
+		StaticString names = marker->getVaryHeaders();
+		char varyIdStr[16];
+		unsigned int varyIdSize = uintToString(marker->varyId, varyIdStr, sizeof(varyIdStr));
+		unsigned int size = req->cacheKey.size() + 2 + varyIdSize;
+		const char *pos, *end = names.data() + names.size();
+		const char *sep;
+
+		for (pos = names.data(); pos < end; pos = sep + 1) {
+			sep = (const char *) memchr(pos, '\n', end - pos);
+			if (sep == NULL) {
+				sep = end;
+			}
+			size += 1 + lookupVariantHeader(req, StaticString(pos, sep - pos)).size();
+		}
+		if (size > MAX_VARIANT_KEY_LENGTH) {
+			return HashedStaticString();
+		}
+
+		char *key = (char *) psg_pnalloc(req->pool, size);
+		char *output = key;
+		const char *outputEnd = key + size;
+		output = appendData(output, outputEnd, req->cacheKey);
+		output = appendData(output, outputEnd, "\nV", 2);
+		output = appendData(output, outputEnd, varyIdStr, varyIdSize);
+
+		for (pos = names.data(); pos < end; pos = sep + 1) {
+			sep = (const char *) memchr(pos, '\n', end - pos);
+			if (sep == NULL) {
+				sep = end;
+			}
+			output = appendData(output, outputEnd, "\n", 1);
+			output = appendData(output, outputEnd,
+				lookupVariantHeader(req, StaticString(pos, sep - pos)));
+		}
+
+		return HashedStaticString(key, size);
+	}
+
+	/**
+	 * Returns the size of the header data that is sent in a 304 response, or
+	 * writes it to `output` if it's not NULL. This consists of the response
+	 * headers that RFC 7232 section 4.1 requires (except for Date, which is
+	 * generated) plus Last-Modified.
+	 */
+	unsigned int buildNotModifiedHeader(const Request *req, char *output) const {
+		static const StaticString names[] = {
+			P_STATIC_STRING("Cache-Control"),
+			P_STATIC_STRING("Content-Location"),
+			P_STATIC_STRING("ETag"),
+			P_STATIC_STRING("Expires"),
+			P_STATIC_STRING("Last-Modified"),
+			P_STATIC_STRING("Vary")
+		};
+		const HashedStaticString *keys[] = {
+			&CACHE_CONTROL, &CONTENT_LOCATION, &ETAG, &EXPIRES, &LAST_MODIFIED, &VARY
+		};
+		unsigned int size = 0;
+
+		for (unsigned int i = 0; i < sizeof(names) / sizeof(StaticString); i++) {
+			const LString *value = req->appResponse.headers.lookup(*keys[i]);
+			if (value == NULL) {
+				continue;
+			}
+
+			if (output != NULL) {
+				memcpy(output + size, names[i].data(), names[i].size());
+				memcpy(output + size + names[i].size(), ": ", 2);
+			}
+			size += names[i].size() + 2;
+
+			const LString::Part *part = value->start;
+			while (part != NULL) {
+				if (output != NULL) {
+					memcpy(output + size, part->data, part->size);
+				}
+				size += part->size;
+				part = part->next;
+			}
+
+			if (output != NULL) {
+				memcpy(output + size, "\r\n", 2);
+			}
+			size += 2;
+		}
+
+		return size;
+	}
+
+	static StaticString stripWeakEtagPrefix(const StaticString &etag) {
+		if (etag.size() >= 2 && etag[0] == 'W' && etag[1] == '/') {
+			return etag.substr(2);
+		} else {
+			return etag;
+		}
+	}
+
+	/**
+	 * Checks whether an If-None-Match header value matches the given ETag,
+	 * using the weak comparison function.
+	 */
+	static bool ifNoneMatchMatches(const StaticString &header, const StaticString &etag) {
+		StaticString opaqueEtag = stripWeakEtagPrefix(etag);
+		const char *pos = header.data();
+		const char *end = header.data() + header.size();
+
+		while (pos < end) {
+			const char *sep = (const char *) memchr(pos, ',', end - pos);
+			if (sep == NULL) {
+				sep = end;
+			}
+
+			StaticString candidate = trimHttpWhitespace(pos, sep);
+			if (candidate == "*") {
+				return true;
+			} else if (!opaqueEtag.empty() && stripWeakEtagPrefix(candidate) == opaqueEtag) {
+				return true;
+			}
+
+			pos = sep + 1;
+		}
+
+		return false;
 	}
 
 	StaticString extractHostNameWithPortFromParsedUrl(struct http_parser_url &url,
@@ -402,14 +558,14 @@ private:
 		char *key = (char *) psg_pnalloc(req->pool, keySize);
 		generateKey(https, path, req->host, req->varyCookie, key, keySize);
 
-		Entry entry(lookup(StaticString(key, keySize)));
-		if (entry.valid()) {
-			entry.header->valid = false;
-		}
+		HashedStaticString cacheKey(key, keySize);
+		storage->getShard(cacheKey.hash())->invalidate(cacheKey);
 	}
 
 public:
-	ResponseCache()
+	ResponseCache(unsigned int maxEntries = DEFAULT_MAX_ENTRIES,
+		unsigned int maxMemory = DEFAULT_MAX_MEMORY,
+		unsigned int _maxBodySize = DEFAULT_MAX_BODY_SIZE)
 		: CACHE_CONTROL("cache-control"),
 		  PRAGMA_CONST("pragma"),
 		  AUTHORIZATION("authorization"),
@@ -419,6 +575,9 @@ public:
 		  X_ACCEL_REDIRECT("x-accel-redirect"),
 		  EXPIRES("expires"),
 		  LAST_MODIFIED("last-modified"),
+		  ETAG("etag"),
+		  IF_NONE_MATCH("if-none-match"),
+		  IF_MODIFIED_SINCE("if-modified-since"),
 		  LOCATION("location"),
 		  CONTENT_LOCATION("content-location"),
 		  COOKIE("cookie"),
@@ -426,8 +585,77 @@ public:
 		  fetches(0),
 		  hits(0),
 		  stores(0),
-		  storeSuccesses(0)
-		{ }
+		  storeSuccesses(0),
+		  maxBodySize(0)
+	{
+		setLimits(maxEntries, maxMemory, _maxBodySize);
+	}
+
+	/**
+	 * Replaces the storage by a new, private store with the given capacity.
+	 *
+	 * @pre maxEntries > 0
+	 */
+	void setLimits(unsigned int maxEntries, unsigned int maxMemory,
+		unsigned int _maxBodySize)
+	{
+		storage = boost::make_shared<ResponseCacheStore>(maxEntries, maxMemory);
+		maxBodySize = _maxBodySize;
+	}
+
+	/**
+	 * Makes this cache use the given store, which may be shared with other
+	 * ResponseCaches if it is thread-safe.
+	 */
+	void setStore(const ResponseCacheStorePtr &_store, unsigned int _maxBodySize) {
+		storage = _store;
+		maxBodySize = _maxBodySize;
+	}
+
+	OXT_FORCE_INLINE
+	const ResponseCacheStorePtr &getStore() const {
+		return storage;
+	}
+
+	/**
+	 * Whether the store is shared with other threads. If so, then the mbufs
+	 * of the cached response bodies must not be referenced by users.
+	 */
+	OXT_FORCE_INLINE
+	bool isShared() const {
+		return storage->isThreadSafe();
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getMaxEntries() const {
+		return storage->getMaxEntries();
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getMaxMemory() const {
+		return storage->getMaxMemory();
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getMaxBodySize() const {
+		return maxBodySize;
+	}
+
+	unsigned int getEntryCount() const {
+		return storage->getStatistics().entries;
+	}
+
+	unsigned int getProtectedEntryCount() const {
+		return storage->getStatistics().protectedEntries;
+	}
+
+	unsigned int getMemoryUsage() const {
+		return storage->getStatistics().memoryUsage;
+	}
+
+	unsigned int getEvictions() const {
+		return storage->getStatistics().evictions;
+	}
 
 	OXT_FORCE_INLINE
 	unsigned int getFetches() const {
@@ -473,9 +701,7 @@ public:
 	}
 
 	void clear() {
-		for (unsigned int i = 0; i < MAX_ENTRIES; i++) {
-			headers[i].valid = false;
-		}
+		storage->clear();
 	}
 
 
@@ -537,7 +763,13 @@ public:
 			&& !req->hasPragmaHeader;
 	}
 
-	// @pre requestAllowsFetching()
+	/**
+	 * Fetches the response for the given request. On a miss,
+	 * `req->staleCacheEntry` is set to a stale response that may be served
+	 * if the app fails to respond, if there is one.
+	 *
+	 * @pre requestAllowsFetching()
+	 */
 	Entry fetch(Request *req, ev_tstamp now) {
 		fetches++;
 		if (OXT_UNLIKELY(fetches == 0)) {
@@ -546,21 +778,57 @@ public:
 			hits = 0;
 		}
 
-		Entry entry(lookup(req->cacheKey));
-		if (entry.valid()) {
-			hits++;
-			if (isFresh(entry, now)) {
-				return entry;
+		req->staleCacheEntry = Entry();
+		Entry result(storage->getShard(req->cacheKey.hash())->fetch(req->cacheKey, now,
+			req->staleCacheEntry));
+		if (result.valid() && result.item->varyMarker) {
+			HashedStaticString variantKey(generateVariantKey(req, result.item));
+			if (variantKey.empty()) {
+				result = Entry();
 			} else {
-				erase(entry.index);
-				Entry result;
-				result.cacheMissReason = Entry::NOT_FRESH;
-				return result;
+				result = storage->getShard(variantKey.hash())->fetch(variantKey, now,
+					req->staleCacheEntry);
 			}
-		} else {
-			entry.cacheMissReason = Entry::NOT_FOUND;
-			return entry;
 		}
+		if (result.valid() || result.cacheMissReason == Entry::NOT_FRESH) {
+			hits++;
+		}
+		return result;
+	}
+
+
+	/**
+	 * Checks whether the request's If-None-Match or If-Modified-Since header
+	 * allows responding with 304 Not Modified instead of the cached response.
+	 * If-None-Match takes precedence, as per RFC 7232 section 6.
+	 *
+	 * @pre entry.valid()
+	 */
+	bool requestIsNotModified(Request *req, const Entry &entry) const {
+		const Item *item = entry.item;
+		if (item->statusCode != 200) {
+			return false;
+		}
+
+		const LString *value = req->headers.lookup(IF_NONE_MATCH);
+		if (value != NULL) {
+			value = psg_lstr_make_contiguous(value, req->pool);
+			return ifNoneMatchMatches(StaticString(value->start->data, value->size),
+				item->getEtag());
+		}
+
+		value = req->headers.lookup(IF_MODIFIED_SINCE);
+		if (value != NULL && value->size > 0 && item->lastModified != (time_t) -1) {
+			struct tm tm;
+			int zone;
+
+			value = psg_lstr_make_contiguous(value, req->pool);
+			if (parseImfFixdate(value->start->data, value->start->data + value->size, tm, zone)) {
+				return item->lastModified <= parsedDateToTimestamp(tm, zone);
+			}
+		}
+
+		return false;
 	}
 
 
@@ -595,7 +863,6 @@ public:
 		}
 
 		if (req->headers.lookup(AUTHORIZATION) != NULL
-		 || respHeaders.lookup(VARY) != NULL
 		 || respHeaders.lookup(WWW_AUTHENTICATE) != NULL
 		 || respHeaders.lookup(X_SENDFILE) != NULL
 		 || respHeaders.lookup(X_ACCEL_REDIRECT) != NULL)
@@ -603,34 +870,65 @@ public:
 			return false;
 		}
 
-		req->appResponse.expiresHeader = respHeaders.lookup(EXPIRES);
-		if (req->appResponse.expiresHeader == NULL) {
-			// lastModifiedHeader is only used in determineExpiryDate(),
-			// and only if expiresHeader is not present, and Cache-Control
-			// does not contain max-age.
-			req->appResponse.lastModifiedHeader =
-				respHeaders.lookup(LAST_MODIFIED);
-			if (req->appResponse.lastModifiedHeader != NULL) {
-				req->appResponse.lastModifiedHeader =
-					psg_lstr_make_contiguous(req->appResponse.lastModifiedHeader,
-						req->pool);
+		const LString *vary = respHeaders.lookup(VARY);
+		if (vary != NULL) {
+			LString *normalizedVary = (LString *) psg_palloc(req->pool, sizeof(LString));
+			vary = psg_lstr_make_contiguous(vary, req->pool);
+			if (!normalizeVaryHeader(req->pool, vary, normalizedVary)) {
+				return false;
 			}
-		} else {
+			if (normalizedVary->size > 0) {
+				req->appResponse.vary = psg_lstr_make_contiguous(normalizedVary, req->pool);
+			}
+		}
+
+		req->appResponse.expiresHeader = respHeaders.lookup(EXPIRES);
+		if (req->appResponse.expiresHeader != NULL) {
 			req->appResponse.expiresHeader =
 				psg_lstr_make_contiguous(req->appResponse.expiresHeader,
 					req->pool);
 		}
 
+		// lastModifiedHeader is used in determineExpiryDate() if expiresHeader
+		// is not present and Cache-Control does not contain max-age, and
+		// for answering conditional requests.
+		req->appResponse.lastModifiedHeader = respHeaders.lookup(LAST_MODIFIED);
+		if (req->appResponse.lastModifiedHeader != NULL) {
+			req->appResponse.lastModifiedHeader =
+				psg_lstr_make_contiguous(req->appResponse.lastModifiedHeader,
+					req->pool);
+		}
+
 		return req->appResponse.cacheControl != NULL
 			|| req->appResponse.expiresHeader != NULL;
 	}
 
-	// @pre requestAllowsStoring()
-	// @pre prepareRequestForStoring()
-	Entry store(Request *req, ev_tstamp now, unsigned int headerSize, unsigned int bodySize) {
+	/**
+	 * Stores the response in the cache. The response header is taken from
+	 * `req->appResponse.headerCacheBuffers` and the dechunked response body
+	 * from `req->appResponse.bodyCacheBuffer`. Entries are evicted as
+	 * necessary in order to stay within the configured limits.
+	 *
+	 * @pre requestAllowsStoring()
+	 * @pre prepareRequestForStoring()
+	 */
+	Entry store(Request *req, ev_tstamp now) {
 		stores++;
 
-		if (headerSize > MAX_HEADER_SIZE || bodySize > MAX_BODY_SIZE) {
+		const struct iovec *headerBuffers = req->appResponse.headerCacheBuffers;
+		unsigned int nHeaderBuffers = req->appResponse.nHeaderCacheBuffers;
+		const LString *body = &req->appResponse.bodyCacheBuffer;
+		const LString *etag = req->appResponse.headers.lookup(ETAG);
+		unsigned int headerSize = 0;
+		unsigned int etagSize = (etag != NULL) ? etag->size : 0;
+		unsigned int notModifiedHeaderSize = buildNotModifiedHeader(req, NULL);
+
+		for (unsigned int i = 0; i < nHeaderBuffers; i++) {
+			headerSize += headerBuffers[i].iov_len;
+		}
+		if (headerSize > MAX_HEADER_SIZE || etagSize > MAX_HEADER_SIZE
+		 || notModifiedHeaderSize > MAX_HEADER_SIZE || body->size > maxBodySize)
+		{
 			return Entry();
 		}
 
@@ -644,21 +942,67 @@ public:
 			return Entry();
 		}
 
-		const HashedStaticString &cacheKey = req->cacheKey;
-		Entry entry(lookup(cacheKey));
-		if (!entry.valid()) {
-			entry = lookupInvalidOrOldest();
-			entry.header->valid   = true;
-			entry.header->hash    = cacheKey.hash();
-			entry.header->keySize = cacheKey.size();
-			memcpy(entry.body->key, cacheKey.data(), cacheKey.size());
+		time_t lastModified = parseDate(req->pool, req->appResponse.lastModifiedHeader, now);
+		if (req->appResponse.lastModifiedHeader == NULL) {
+			lastModified = (time_t) -1;
+		}
+		unsigned int staleWhileRevalidate = parseCacheControlSeconds(
+			req->appResponse.cacheControl, P_STATIC_STRING("stale-while-revalidate"));
+		unsigned int staleIfError = parseCacheControlSeconds(
+			req->appResponse.cacheControl, P_STATIC_STRING("stale-if-error"));
+
+		HashedStaticString cacheKey = req->cacheKey;
+		Entry varyMarker;
+		if (req->appResponse.vary != NULL) {
+			time_t markerExpiryDate = expiryDate + std::max(staleWhileRevalidate, staleIfError);
+			varyMarker = storage->getShard(cacheKey.hash())->storeVaryMarker(cacheKey,
+				StaticString(req->appResponse.vary->start->data, req->appResponse.vary->size),
+				markerExpiryDate);
+			cacheKey = generateVariantKey(req, varyMarker.item);
+			if (cacheKey.empty()) {
+				return Entry();
+			}
+		}
+
+		ResponseCacheShard *shard = storage->getShard(cacheKey.hash());
+		unsigned int itemMemoryUsage = shard->calculateMemoryUsage(cacheKey.size(),
+			headerSize + etagSize + notModifiedHeaderSize, body->size);
+		if (itemMemoryUsage > shard->getMaxMemory()) {
+			return Entry();
 		}
-		entry.header->date     = responseDate;
-		entry.body->expiryDate = expiryDate;
-		entry.body->httpHeaderSize = headerSize;
-		entry.body->httpBodySize   = bodySize;
+
+		Item *item = new Item(shard, cacheKey.size(), headerSize, etagSize,
+			notModifiedHeaderSize);
+		item->statusCode = req->appResponse.statusCode;
+		item->memoryUsage = itemMemoryUsage;
+		item->date = responseDate;
+		item->expiryDate = expiryDate;
+		item->lastModified = lastModified;
+		if (staleWhileRevalidate > 0) {
+			item->staleWhileRevalidateDate = expiryDate + staleWhileRevalidate;
+		}
+		if (staleIfError > 0) {
+			item->staleIfErrorDate = expiryDate + staleIfError;
+		}
+		memcpy(item->key, cacheKey.data(), cacheKey.size());
+
+		char *pos = item->httpHeaderData;
+		const char *end = item->httpHeaderData + headerSize;
+		for (unsigned int i = 0; i < nHeaderBuffers; i++) {
+			pos = appendData(pos, end, (const char *) headerBuffers[i].iov_base,
+				headerBuffers[i].iov_len);
+		}
+		if (etag != NULL) {
+			pos = item->etag;
+			end = item->etag + etagSize;
+			for (const LString::Part *part = etag->start; part != NULL; part = part->next) {
+				pos = appendData(pos, end, part->data, part->size);
+			}
+		}
+		buildNotModifiedHeader(req, item->notModifiedHeaderData);
+
 		storeSuccesses++;
-		return entry;
+		return shard->insert(item, body);
 	}
 
 
@@ -670,10 +1014,7 @@ public:
 
 	// @pre requestAllowsInvalidating()
 	void invalidate(Request *req) {
-		Entry entry(lookup(req->cacheKey));
-		if (entry.valid()) {
-			entry.header->valid = false;
-		}
+		storage->getShard(req->cacheKey.hash())->invalidate(req->cacheKey);
 
 		invalidateLocation(req, LOCATION);
 		invalidateLocation(req, CONTENT_LOCATION);
@@ -682,14 +1023,13 @@ public:
 
 	string inspect() const {
 		stringstream stream;
-		for (unsigned int i = 0; i < MAX_ENTRIES; i++) {
-			time_t expiryDate = bodies[i].expiryDate;
-			stream << " #" << i << ": valid=" << headers[i].valid
-				<< ", hash=" << headers[i].hash
-				<< ", expiryDate=" << expiryDate
-				<< ", keySize=" << headers[i].keySize << ", key=\""
-				<< cEscapeString(StaticString(bodies[i].key, headers[i].keySize)) << "\"\n";
-		}
+		ResponseCacheShard::Statistics stats(storage->getStatistics());
+
+		stream << " entries=" << stats.entries << "/" << storage->getMaxEntries()
+			<< ", protected=" << stats.protectedEntries
+			<< ", memoryUsage=" << stats.memoryUsage << "/" << storage->getMaxMemory()
+			<< ", shards=" << storage->getShardCount() << "\n";
+		storage->inspect(stream);
 		return stream.str();
 	}
 };
@@ -0,0 +1,949 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_RESPONSE_CACHE_STORE_H_
+#define _PASSENGER_RESPONSE_CACHE_STORE_H_
+
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <oxt/macros.hpp>
+#include <ev++.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <jsoncpp/json.h>
+#include <psg_sysqueue.h>
+#include <MemoryKit/mbuf.h>
+#include <MemoryKit/palloc.h>
+#include <DataStructures/LString.h>
+#include <DataStructures/HashedStaticString.h>
+#include <StaticString.h>
+#include <Utils/JsonUtils.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+
+using namespace std;
+
+
+class ResponseCacheShard;
+
+/**
+ * A response stored in a ResponseCacheShard.
+ *
+ * Everything except the LRU bookkeeping, `revalidatingUntil` and the expiry
+ * date of Vary markers is immutable once the item has been inserted into a
+ * shard, so the data may be read without holding the shard's lock for as long
+ * as a reference is held. The mutable fields are only accessed with the lock
+ * held. The shard holds one reference while the item is indexed, and every
+ * ResponseCacheEntry holds one.
+ *
+ * An item is either a response, or a Vary marker. A Vary marker is stored under
+ * the primary cache key of a response that has a Vary header. Its header data
+ * contains the normalized names of the request headers that the response
+ * varies on, and the response itself is stored under a secondary key that is
+ * derived from the marker's `varyId` and the values of those request headers.
+ */
+struct ResponseCacheItem {
+	enum Segment {
+		PROBATION_SEGMENT,
+		PROTECTED_SEGMENT
+	};
+
+	TAILQ_ENTRY(ResponseCacheItem) lruEntry;
+	ResponseCacheItem *hashNext;
+	ResponseCacheShard *shard;
+	mutable boost::atomic<int> refcount;
+
+	boost::uint32_t hash;
+	unsigned short keySize;
+	unsigned short httpHeaderSize;
+	unsigned short etagSize;
+	unsigned short notModifiedHeaderSize;
+	unsigned short statusCode;
+	bool varyMarker;
+	/** Number of bytes this item accounts for in the memory budget. */
+	unsigned int memoryUsage;
+	unsigned int httpBodySize;
+	/** Identifies the set of secondary keys of a Vary marker. */
+	unsigned int varyId;
+	Segment segment;
+	time_t date;
+	time_t expiryDate;
+	/** Last-Modified date of the response, or -1 if it doesn't have one. */
+	time_t lastModified;
+	/** The stale response may be served while it's being revalidated until this date. */
+	time_t staleWhileRevalidateDate;
+	/** The stale response may be served in case of errors until this date. */
+	time_t staleIfErrorDate;
+	/** A request is revalidating this stale response until this date. */
+	time_t revalidatingUntil;
+
+	/**
+	 * Points to a single allocation containing the key, the header data,
+	 * the ETag value and the header data of a 304 response, in that order.
+	 */
+	char *key;
+	char *httpHeaderData;
+	char *etag;
+	char *notModifiedHeaderData;
+	// This data is dechunked.
+	vector<MemoryKit::mbuf> httpBodyBuffers;
+
+	ResponseCacheItem(ResponseCacheShard *_shard, unsigned int _keySize,
+		unsigned int _httpHeaderSize, unsigned int _etagSize = 0,
+		unsigned int _notModifiedHeaderSize = 0)
+		: hashNext(NULL),
+		  shard(_shard),
+		  refcount(1),
+		  hash(0),
+		  keySize(_keySize),
+		  httpHeaderSize(_httpHeaderSize),
+		  etagSize(_etagSize),
+		  notModifiedHeaderSize(_notModifiedHeaderSize),
+		  statusCode(0),
+		  varyMarker(false),
+		  memoryUsage(0),
+		  httpBodySize(0),
+		  varyId(0),
+		  segment(PROBATION_SEGMENT),
+		  date(0),
+		  expiryDate(0),
+		  lastModified(-1),
+		  staleWhileRevalidateDate(0),
+		  staleIfErrorDate(0),
+		  revalidatingUntil(0)
+	{
+		key = (char *) malloc(_keySize + _httpHeaderSize + _etagSize
+			+ _notModifiedHeaderSize);
+		if (OXT_UNLIKELY(key == NULL)) {
+			throw std::bad_alloc();
+		}
+		httpHeaderData = key + _keySize;
+		etag = httpHeaderData + _httpHeaderSize;
+		notModifiedHeaderData = etag + _etagSize;
+	}
+
+	~ResponseCacheItem() {
+		free(key);
+	}
+
+	StaticString getKey() const {
+		return StaticString(key, keySize);
+	}
+
+	StaticString getEtag() const {
+		return StaticString(etag, etagSize);
+	}
+
+	/** For Vary markers: the header names, separated by newlines. */
+	StaticString getVaryHeaders() const {
+		return StaticString(httpHeaderData, httpHeaderSize);
+	}
+
+	void ref() const {
+		refcount.fetch_add(1, boost::memory_order_relaxed);
+	}
+
+	// Defined after ResponseCacheShard.
+	void unref() const;
+};
+
+/**
+ * A reference to a ResponseCacheItem, as returned by fetch and store operations.
+ * The item stays valid for as long as the entry exists, even if it is evicted
+ * from the cache in the mean time.
+ */
+struct ResponseCacheEntry {
+	ResponseCacheItem *item;
+	enum {
+		NOT_FOUND,
+		NOT_FRESH
+	} cacheMissReason;
+	/** Whether the item is served after its expiry date. */
+	bool stale;
+
+	ResponseCacheEntry()
+		: item(NULL),
+		  cacheMissReason(NOT_FOUND),
+		  stale(false)
+		{ }
+
+	// Takes over the reference that the caller holds on the item.
+	ResponseCacheEntry(ResponseCacheItem *i)
+		: item(i),
+		  cacheMissReason(NOT_FOUND),
+		  stale(false)
+		{ }
+
+	ResponseCacheEntry(const ResponseCacheEntry &other)
+		: item(other.item),
+		  cacheMissReason(other.cacheMissReason),
+		  stale(other.stale)
+	{
+		if (item != NULL) {
+			item->ref();
+		}
+	}
+
+	~ResponseCacheEntry() {
+		if (item != NULL) {
+			item->unref();
+		}
+	}
+
+	ResponseCacheEntry &operator=(const ResponseCacheEntry &other) {
+		if (other.item != NULL) {
+			other.item->ref();
+		}
+		if (item != NULL) {
+			item->unref();
+		}
+		item = other.item;
+		cacheMissReason = other.cacheMissReason;
+		stale = other.stale;
+		return *this;
+	}
+
+	OXT_FORCE_INLINE
+	bool valid() const {
+		return item != NULL;
+	}
+
+	const char *getCacheMissReasonString() const {
+		switch (cacheMissReason) {
+		case NOT_FOUND:
+			return "NOT_FOUND";
+		case NOT_FRESH:
+			return "NOT_FRESH";
+		default:
+			return "UNKNOWN";
+		}
+	}
+};
+
+
+/**
+ * One independently locked partition of a ResponseCacheStore. It contains a hash
+ * table of items, the segmented LRU lists, and the mbuf pool from which the
+ * response bodies are allocated.
+ *
+ * Eviction is done through a segmented LRU (SLRU) policy. Newly stored entries
+ * are admitted to the "probation" segment. Entries that are hit while in the
+ * probation segment are promoted to the "protected" segment, which may contain
+ * at most PROTECTED_SEGMENT_RATIO of all entries. Entries that fall out of
+ * the protected segment are demoted back to probation, and eviction victims are
+ * always taken from the probation segment first. This means that a burst of
+ * one-hit-wonders cannot flush out the responses that are actually hot.
+ *
+ * Responses that were stored with `stale-while-revalidate` are served stale
+ * after they expire, while a single request revalidates them: the first fetch
+ * after expiry is reported as a miss (so that the request is forwarded to the
+ * app), and all other fetches within REVALIDATION_TIMEOUT seconds get the stale
+ * response. This way only one request per key reaches the app.
+ *
+ * If the shard is created as thread-safe then all operations lock `syncher`.
+ * Otherwise no locking is done at all.
+ */
+class ResponseCacheShard: public boost::noncopyable {
+public:
+	typedef ResponseCacheItem Item;
+	typedef ResponseCacheEntry Entry;
+
+	/** Size of the mbuf blocks in which response bodies are stored. */
+	static const unsigned int MBUF_BLOCK_CHUNK_SIZE = 1024 * 4;
+	/** Percentage of the maximum number of entries that may be protected. */
+	static const unsigned int PROTECTED_SEGMENT_RATIO = 80;
+	/** Number of seconds after which another request may revalidate a stale response. */
+	static const unsigned int REVALIDATION_TIMEOUT = 10;
+
+	struct Statistics {
+		unsigned int fetches;
+		unsigned int hits;
+		unsigned int staleHits;
+		unsigned int stores;
+		unsigned int evictions;
+		unsigned int entries;
+		unsigned int protectedEntries;
+		unsigned int memoryUsage;
+	};
+
+private:
+	friend struct ResponseCacheItem;
+	TAILQ_HEAD(ItemList, ResponseCacheItem);
+
+	mutable boost::mutex syncher;
+	const bool threadSafe;
+
+	unsigned int fetches, hits, staleHits, stores, evictions;
+	unsigned int nextVaryId;
+
+	unsigned int maxEntries;
+	unsigned int maxMemory;
+	unsigned int maxProtectedEntries;
+
+	unsigned int nEntries;
+	unsigned int nProtectedEntries;
+	unsigned int memoryUsage;
+
+	vector<Item *> buckets;
+	ItemList probationItems;
+	ItemList protectedItems;
+	struct MemoryKit::mbuf_pool mbufPool;
+
+	static unsigned int roundUpToPowerOfTwo(unsigned int value) {
+		unsigned int result = 1;
+		while (result < value) {
+			result *= 2;
+		}
+		return result;
+	}
+
+	OXT_FORCE_INLINE
+	void lock(boost::unique_lock<boost::mutex> &l) const {
+		if (threadSafe) {
+			l.lock();
+		}
+	}
+
+	OXT_FORCE_INLINE
+	Item **getBucket(boost::uint32_t hash) {
+		return &buckets[hash & (buckets.size() - 1)];
+	}
+
+	Item *lookup(const HashedStaticString &cacheKey) {
+		boost::uint32_t hash = cacheKey.hash();
+		Item *item = *getBucket(hash);
+		while (item != NULL) {
+			if (item->hash == hash
+			 && item->keySize == cacheKey.size()
+			 && memcmp(item->key, cacheKey.data(), cacheKey.size()) == 0)
+			{
+				return item;
+			}
+			item = item->hashNext;
+		}
+		return NULL;
+	}
+
+	ItemList *getSegmentList(Item::Segment segment) {
+		if (segment == Item::PROTECTED_SEGMENT) {
+			return &protectedItems;
+		} else {
+			return &probationItems;
+		}
+	}
+
+	void touch(Item *item) {
+		if (item->segment == Item::PROTECTED_SEGMENT) {
+			TAILQ_REMOVE(&protectedItems, item, lruEntry);
+			TAILQ_INSERT_HEAD(&protectedItems, item, lruEntry);
+			return;
+		}
+
+		TAILQ_REMOVE(&probationItems, item, lruEntry);
+		TAILQ_INSERT_HEAD(&protectedItems, item, lruEntry);
+		item->segment = Item::PROTECTED_SEGMENT;
+		nProtectedEntries++;
+
+		if (nProtectedEntries > maxProtectedEntries) {
+			Item *demoted = TAILQ_LAST(&protectedItems, ItemList);
+			TAILQ_REMOVE(&protectedItems, demoted, lruEntry);
+			TAILQ_INSERT_HEAD(&probationItems, demoted, lruEntry);
+			demoted->segment = Item::PROBATION_SEGMENT;
+			nProtectedEntries--;
+		}
+	}
+
+	/**
+	 * Removes the item from the index and drops the shard's reference.
+	 * The item is only freed once no entries refer to it anymore.
+	 */
+	void erase(Item *item) {
+		Item **bucket = getBucket(item->hash);
+		while (*bucket != item) {
+			bucket = &(*bucket)->hashNext;
+		}
+		*bucket = item->hashNext;
+
+		TAILQ_REMOVE(getSegmentList(item->segment), item, lruEntry);
+		if (item->segment == Item::PROTECTED_SEGMENT) {
+			nProtectedEntries--;
+		}
+		nEntries--;
+		memoryUsage -= item->memoryUsage;
+		unrefLocked(item);
+	}
+
+	bool evictOne() {
+		Item *victim = TAILQ_LAST(&probationItems, ItemList);
+		if (victim == NULL) {
+			victim = TAILQ_LAST(&protectedItems, ItemList);
+		}
+		if (victim == NULL) {
+			return false;
+		} else {
+			erase(victim);
+			evictions++;
+			return true;
+		}
+	}
+
+	// The body mbufs are returned to `mbufPool`, so this must be called
+	// with the lock held.
+	void unrefLocked(const Item *item) {
+		if (item->refcount.fetch_sub(1, boost::memory_order_release) == 1) {
+			boost::atomic_thread_fence(boost::memory_order_acquire);
+			delete item;
+		}
+	}
+
+	void unref(const Item *item) {
+		if (item->refcount.fetch_sub(1, boost::memory_order_release) == 1) {
+			boost::atomic_thread_fence(boost::memory_order_acquire);
+			boost::unique_lock<boost::mutex> l(syncher, boost::defer_lock);
+			lock(l);
+			delete item;
+		}
+	}
+
+	void copyBody(Item *item, const LString *body) {
+		const LString::Part *part = body->start;
+		MemoryKit::mbuf buffer;
+		unsigned int bufferUsed = 0;
+
+		while (part != NULL) {
+			const char *data = part->data;
+			unsigned int remaining = part->size;
+
+			while (remaining > 0) {
+				if (buffer.is_null() || bufferUsed == buffer.size()) {
+					if (!buffer.is_null()) {
+						item->httpBodyBuffers.push_back(buffer);
+					}
+					buffer = MemoryKit::mbuf_get(&mbufPool);
+					bufferUsed = 0;
+				}
+
+				unsigned int size = std::min<unsigned int>(remaining,
+					buffer.size() - bufferUsed);
+				memcpy(buffer.start + bufferUsed, data, size);
+				bufferUsed += size;
+				data += size;
+				remaining -= size;
+			}
+
+			part = part->next;
+		}
+
+		if (bufferUsed > 0) {
+			item->httpBodyBuffers.push_back(MemoryKit::mbuf(buffer, 0, bufferUsed));
+		}
+	}
+
+	void insertLocked(Item *item, const LString *body) {
+		while (nEntries >= maxEntries || memoryUsage + item->memoryUsage > maxMemory) {
+			if (!evictOne()) {
+				break;
+			}
+		}
+
+		if (body != NULL) {
+			copyBody(item, body);
+		}
+
+		Item **bucket = getBucket(item->hash);
+		item->hashNext = *bucket;
+		*bucket = item;
+		TAILQ_INSERT_HEAD(&probationItems, item, lruEntry);
+		nEntries++;
+		memoryUsage += item->memoryUsage;
+	}
+
+	void countFetch(bool hit) {
+		fetches++;
+		if (OXT_UNLIKELY(fetches == 0)) {
+			// Value rolled over
+			fetches = 1;
+			hits = 0;
+			staleHits = 0;
+		}
+		if (hit) {
+			hits++;
+		}
+	}
+
+	void clearLocked() {
+		Item *item;
+
+		while ((item = TAILQ_FIRST(&probationItems)) != NULL) {
+			TAILQ_REMOVE(&probationItems, item, lruEntry);
+			unrefLocked(item);
+		}
+		while ((item = TAILQ_FIRST(&protectedItems)) != NULL) {
+			TAILQ_REMOVE(&protectedItems, item, lruEntry);
+			unrefLocked(item);
+		}
+		std::fill(buckets.begin(), buckets.end(), (Item *) NULL);
+		nEntries = 0;
+		nProtectedEntries = 0;
+		memoryUsage = 0;
+		MemoryKit::mbuf_pool_compact(&mbufPool);
+	}
+
+	static void inspectItem(stringstream &stream, unsigned int i, const Item *item) {
+		time_t expiryDate = item->expiryDate;
+		stream << " #" << i << ": segment="
+			<< ((item->segment == Item::PROTECTED_SEGMENT) ? "protected" : "probation")
+			<< ", hash=" << item->hash
+			<< ", expiryDate=" << expiryDate;
+		if (item->varyMarker) {
+			stream << ", varyId=" << item->varyId
+				<< ", vary=\"" << cEscapeString(item->getVaryHeaders()) << "\"";
+		}
+		stream << ", bodySize=" << item->httpBodySize
+			<< ", keySize=" << item->keySize << ", key=\""
+			<< cEscapeString(item->getKey()) << "\"\n";
+	}
+
+public:
+	/**
+	 * @pre maxEntries > 0
+	 */
+	ResponseCacheShard(unsigned int _maxEntries, unsigned int _maxMemory, bool _threadSafe)
+		: threadSafe(_threadSafe),
+		  fetches(0),
+		  hits(0),
+		  staleHits(0),
+		  stores(0),
+		  evictions(0),
+		  nextVaryId(1),
+		  maxEntries(_maxEntries),
+		  maxMemory(_maxMemory),
+		  nEntries(0),
+		  nProtectedEntries(0),
+		  memoryUsage(0)
+	{
+		assert(_maxEntries > 0);
+		maxProtectedEntries = std::max<unsigned int>(1,
+			(unsigned long long) maxEntries * PROTECTED_SEGMENT_RATIO / 100);
+		buckets.assign(roundUpToPowerOfTwo(std::max<unsigned int>(maxEntries, 16)),
+			(Item *) NULL);
+		TAILQ_INIT(&probationItems);
+		TAILQ_INIT(&protectedItems);
+		mbufPool.mbuf_block_chunk_size = MBUF_BLOCK_CHUNK_SIZE;
+		MemoryKit::mbuf_pool_init(&mbufPool);
+	}
+
+	~ResponseCacheShard() {
+		clearLocked();
+		MemoryKit::mbuf_pool_deinit(&mbufPool);
+	}
+
+	OXT_FORCE_INLINE
+	bool isThreadSafe() const {
+		return threadSafe;
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getMaxEntries() const {
+		return maxEntries;
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getMaxMemory() const {
+		return maxMemory;
+	}
+
+	unsigned int calculateMemoryUsage(unsigned int keySize, unsigned int headerSize,
+		unsigned int bodySize) const
+	{
+		unsigned int blockDataSize = mbufPool.mbuf_block_offset;
+		unsigned int nblocks = (bodySize + blockDataSize - 1) / blockDataSize;
+		return sizeof(Item) + keySize + headerSize + nblocks * MBUF_BLOCK_CHUNK_SIZE;
+	}
+
+	/**
+	 * Looks up a response. If a Vary marker is found then it is returned
+	 * as-is, without counting it as a fetch: the caller is expected to fetch
+	 * the secondary key next.
+	 *
+	 * If the response is stale, but may still be served in case the app
+	 * fails to respond (`stale-if-error`), or this request is selected for
+	 * revalidating it (`stale-while-revalidate`), then the result is a miss
+	 * and `staleEntry` is set to the stale response.
+	 *
+	 * @pre !staleEntry.valid()
+	 */
+	Entry fetch(const HashedStaticString &cacheKey, ev_tstamp now, Entry &staleEntry) {
+		boost::unique_lock<boost::mutex> l(syncher, boost::defer_lock);
+		lock(l);
+		assert(!staleEntry.valid());
+
+		Item *item = lookup(cacheKey);
+		if (item == NULL) {
+			countFetch(false);
+			Entry result;
+			result.cacheMissReason = Entry::NOT_FOUND;
+			return result;
+		}
+
+		if (item->expiryDate > now) {
+			if (!item->varyMarker) {
+				countFetch(true);
+			}
+			touch(item);
+			item->ref();
+			return Entry(item);
+		}
+
+		Entry result;
+		result.cacheMissReason = Entry::NOT_FRESH;
+		if (item->varyMarker) {
+			countFetch(false);
+			erase(item);
+		} else if (now < item->staleWhileRevalidateDate && now < item->revalidatingUntil) {
+			// Another request is revalidating this response.
+			countFetch(true);
+			staleHits++;
+			touch(item);
+			item->ref();
+			result.item = item;
+			result.stale = true;
+		} else if (now < item->staleWhileRevalidateDate || now < item->staleIfErrorDate) {
+			countFetch(false);
+			if (now < item->staleWhileRevalidateDate) {
+				item->revalidatingUntil = (time_t) now + REVALIDATION_TIMEOUT;
+			}
+			item->ref();
+			staleEntry.item = item;
+			staleEntry.stale = true;
+		} else {
+			countFetch(false);
+			erase(item);
+		}
+		return result;
+	}
+
+	/**
+	 * Inserts a response, replacing any existing item with the same key. The
+	 * key, header data and dates must already have been filled in. The body
+	 * is copied into the shard's mbufs. Entries are evicted as necessary in
+	 * order to stay within the limits.
+	 *
+	 * @pre item->shard == this
+	 * @pre item->memoryUsage == calculateMemoryUsage(item->keySize,
+	 *      item->httpHeaderSize + item->etagSize + item->notModifiedHeaderSize,
+	 *      body->size)
+	 * @pre item->memoryUsage <= getMaxMemory()
+	 */
+	Entry insert(Item *item, const LString *body) {
+		HashedStaticString cacheKey(item->key, item->keySize);
+		item->hash = cacheKey.hash();
+		item->httpBodySize = body->size;
+
+		boost::unique_lock<boost::mutex> l(syncher, boost::defer_lock);
+		lock(l);
+
+		stores++;
+
+		Item *oldItem = lookup(cacheKey);
+		if (oldItem != NULL) {
+			erase(oldItem);
+		}
+		insertLocked(item, body);
+
+		item->ref();
+		return Entry(item);
+	}
+
+	/**
+	 * Ensures that a Vary marker for the given header names is stored under
+	 * the given (primary) key, and that it doesn't expire before `expiryDate`.
+	 * An existing marker with the same header names is reused, so that
+	 * the responses that are already stored under its secondary keys stay
+	 * reachable. Any other item is replaced.
+	 */
+	Entry storeVaryMarker(const HashedStaticString &cacheKey, const StaticString &varyHeaders,
+		time_t expiryDate)
+	{
+		boost::unique_lock<boost::mutex> l(syncher, boost::defer_lock);
+		lock(l);
+
+		Item *item = lookup(cacheKey);
+		if (item != NULL) {
+			if (item->varyMarker && item->getVaryHeaders() == varyHeaders) {
+				item->expiryDate = std::max(item->expiryDate, expiryDate);
+				item->ref();
+				return Entry(item);
+			}
+			erase(item);
+		}
+
+		item = new Item(this, cacheKey.size(), varyHeaders.size());
+		item->hash = cacheKey.hash();
+		item->varyMarker = true;
+		item->varyId = nextVaryId++;
+		if (OXT_UNLIKELY(nextVaryId == 0)) {
+			nextVaryId = 1;
+		}
+		item->date = expiryDate;
+		item->expiryDate = expiryDate;
+		item->memoryUsage = calculateMemoryUsage(cacheKey.size(), varyHeaders.size(), 0);
+		memcpy(item->key, cacheKey.data(), cacheKey.size());
+		memcpy(item->httpHeaderData, varyHeaders.data(), varyHeaders.size());
+		insertLocked(item, NULL);
+
+		item->ref();
+		return Entry(item);
+	}
+
+	void invalidate(const HashedStaticString &cacheKey) {
+		boost::unique_lock<boost::mutex> l(syncher, boost::defer_lock);
+		lock(l);
+		Item *item = lookup(cacheKey);
+		if (item != NULL) {
+			erase(item);
+		}
+	}
+
+	void clear() {
+		boost::unique_lock<boost::mutex> l(syncher, boost::defer_lock);
+		lock(l);
+		clearLocked();
+	}
+
+	Statistics getStatistics() const {
+		boost::unique_lock<boost::mutex> l(syncher, boost::defer_lock);
+		lock(l);
+		Statistics stats;
+		stats.fetches = fetches;
+		stats.hits = hits;
+		stats.staleHits = staleHits;
+		stats.stores = stores;
+		stats.evictions = evictions;
+		stats.entries = nEntries;
+		stats.protectedEntries = nProtectedEntries;
+		stats.memoryUsage = memoryUsage;
+		return stats;
+	}
+
+	void inspect(stringstream &stream, unsigned int &i) const {
+		boost::unique_lock<boost::mutex> l(syncher, boost::defer_lock);
+		lock(l);
+		const Item *item;
+
+		TAILQ_FOREACH (item, &protectedItems, lruEntry) {
+			inspectItem(stream, i, item);
+			i++;
+		}
+		TAILQ_FOREACH (item, &probationItems, lruEntry) {
+			inspectItem(stream, i, item);
+			i++;
+		}
+	}
+};
+
+inline void
+ResponseCacheItem::unref() const {
+	shard->unref(this);
+}
+
+
+/**
+ * The storage behind a ResponseCache: a set of ResponseCacheShards, selected
+ * by the cache key's hash. The entry and memory limits are divided evenly
+ * over the shards.
+ *
+ * A store that is created as thread-safe may be shared by the ResponseCaches
+ * of multiple Controller threads, so that a response that is cached by one
+ * thread can be served by all threads. Each shard is then protected by its own
+ * lock, which is held only for index and LRU operations: readers access the
+ * (immutable) item data after releasing the lock. Note that mbufs are not
+ * thread-safe, so users of a thread-safe store must copy response bodies
+ * instead of referencing the store's mbufs.
+ */
+class ResponseCacheStore: public boost::noncopyable {
+public:
+	typedef ResponseCacheItem Item;
+	typedef ResponseCacheEntry Entry;
+
+	static const unsigned int MAX_SHARDS = 256;
+
+private:
+	vector<ResponseCacheShard *> shards;
+	unsigned int maxEntries;
+	unsigned int maxMemory;
+
+	static unsigned int roundUpToPowerOfTwo(unsigned int value) {
+		unsigned int result = 1;
+		while (result < value) {
+			result *= 2;
+		}
+		return result;
+	}
+
+public:
+	/**
+	 * @pre maxEntries > 0
+	 */
+	ResponseCacheStore(unsigned int _maxEntries, unsigned int _maxMemory,
+		unsigned int nshards = 1, bool threadSafe = false)
+		: maxEntries(_maxEntries),
+		  maxMemory(_maxMemory)
+	{
+		assert(_maxEntries > 0);
+		nshards = roundUpToPowerOfTwo(std::max<unsigned int>(1,
+			std::min<unsigned int>(nshards, (unsigned int) MAX_SHARDS)));
+		while (nshards > 1 && nshards > _maxEntries) {
+			nshards /= 2;
+		}
+
+		unsigned int shardMaxEntries = (_maxEntries + nshards - 1) / nshards;
+		unsigned int shardMaxMemory = _maxMemory / nshards;
+		shards.reserve(nshards);
+		for (unsigned int i = 0; i < nshards; i++) {
+			shards.push_back(new ResponseCacheShard(shardMaxEntries,
+				shardMaxMemory, threadSafe));
+		}
+	}
+
+	~ResponseCacheStore() {
+		vector<ResponseCacheShard *>::iterator it;
+		for (it = shards.begin(); it != shards.end(); it++) {
+			delete *it;
+		}
+	}
+
+	OXT_FORCE_INLINE
+	ResponseCacheShard *getShard(boost::uint32_t hash) const {
+		// The low bits select the hash bucket within the shard, so use
+		// the high bits for selecting the shard.
+		return shards[(hash >> 16) & (shards.size() - 1)];
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getShardCount() const {
+		return shards.size();
+	}
+
+	OXT_FORCE_INLINE
+	bool isThreadSafe() const {
+		return shards[0]->isThreadSafe();
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getMaxEntries() const {
+		return maxEntries;
+	}
+
+	OXT_FORCE_INLINE
+	unsigned int getMaxMemory() const {
+		return maxMemory;
+	}
+
+	ResponseCacheShard::Statistics getStatistics() const {
+		ResponseCacheShard::Statistics result;
+		memset(&result, 0, sizeof(result));
+		for (unsigned int i = 0; i < shards.size(); i++) {
+			ResponseCacheShard::Statistics stats(shards[i]->getStatistics());
+			result.fetches += stats.fetches;
+			result.hits += stats.hits;
+			result.staleHits += stats.staleHits;
+			result.stores += stats.stores;
+			result.evictions += stats.evictions;
+			result.entries += stats.entries;
+			result.protectedEntries += stats.protectedEntries;
+			result.memoryUsage += stats.memoryUsage;
+		}
+		return result;
+	}
+
+	void clear() {
+		for (unsigned int i = 0; i < shards.size(); i++) {
+			shards[i]->clear();
+		}
+	}
+
+	Json::Value inspectStateAsJson() const {
+		Json::Value doc;
+		Json::Value shardsDoc(Json::arrayValue);
+		ResponseCacheShard::Statistics total;
+
+		memset(&total, 0, sizeof(total));
+		for (unsigned int i = 0; i < shards.size(); i++) {
+			ResponseCacheShard::Statistics stats(shards[i]->getStatistics());
+			Json::Value shardDoc;
+
+			shardDoc["hits"] = stats.hits;
+			shardDoc["misses"] = stats.fetches - stats.hits;
+			shardDoc["stale_hits"] = stats.staleHits;
+			shardDoc["stores"] = stats.stores;
+			shardDoc["evictions"] = stats.evictions;
+			shardDoc["entries"] = stats.entries;
+			shardDoc["memory_usage"] = byteSizeToJson(stats.memoryUsage);
+			shardsDoc.append(shardDoc);
+
+			total.fetches += stats.fetches;
+			total.hits += stats.hits;
+			total.staleHits += stats.staleHits;
+			total.entries += stats.entries;
+			total.memoryUsage += stats.memoryUsage;
+		}
+
+		doc["hits"] = total.hits;
+		doc["misses"] = total.fetches - total.hits;
+		doc["stale_hits"] = total.staleHits;
+		doc["entries"] = total.entries;
+		doc["max_entries"] = maxEntries;
+		doc["memory_usage"] = byteSizeToJson(total.memoryUsage);
+		doc["max_memory"] = byteSizeToJson(maxMemory);
+		doc["shards"] = shardsDoc;
+		return doc;
+	}
+
+	void inspect(stringstream &stream) const {
+		unsigned int i = 0;
+		for (unsigned int s = 0; s < shards.size(); s++) {
+			shards[s]->inspect(stream, i);
+		}
+	}
+};
+
+typedef boost::shared_ptr<ResponseCacheStore> ResponseCacheStorePtr;
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_RESPONSE_CACHE_STORE_H_ */
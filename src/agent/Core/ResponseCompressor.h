@@ -0,0 +1,259 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_RESPONSE_COMPRESSOR_H_
+#define _PASSENGER_RESPONSE_COMPRESSOR_H_
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <oxt/macros.hpp>
+#include <zlib.h>
+#include <cassert>
+#include <cstring>
+#include <MemoryKit/mbuf.h>
+#include <ServerKit/ContentCoding.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace Core {
+
+
+/**
+ * Compresses a response body with gzip or deflate, one input buffer at a time.
+ *
+ * zlib writes its output directly into mbufs taken from the given pool, so
+ * the compressed data is never copied. If chunked framing is requested, every
+ * output mbuf reserves room for the chunk header in front of the compressed
+ * data and for the chunk trailer behind it, and the framing is written around
+ * the data in place.
+ *
+ * Output is passed to a callback as two slices of the same mbuf: `output` is
+ * what should be sent to the client (including chunk framing), and `payload`
+ * is only the compressed data, which is what the turbocache stores.
+ *
+ * Output is only produced when an mbuf is full or when the body is finished,
+ * so a slowly trickling response may be held back until the end.
+ */
+class ResponseCompressor: public boost::noncopyable {
+public:
+	/**
+	 * Called for every compressed block. Return false to stop compressing,
+	 * e.g. because the client disconnected.
+	 */
+	typedef bool (*OutputCallback)(void *userData, const MemoryKit::mbuf &output,
+		const MemoryKit::mbuf &payload);
+
+	/** Enough room for the hexadecimal size of an mbuf's worth of data, plus CRLF. */
+	static const unsigned int CHUNK_HEADER_RESERVE = 10;
+	static const unsigned int CHUNK_TRAILER_SIZE = 2;
+
+private:
+	z_stream stream;
+	MemoryKit::mbuf_pool *pool;
+	MemoryKit::mbuf output;
+	unsigned int outputUsed;
+	ServerKit::ContentCoding coding;
+	bool initialized;
+	bool chunked;
+	bool finished;
+	boost::uint64_t bytesIn;
+	boost::uint64_t bytesOut;
+
+	unsigned int headerReserve() const {
+		return chunked ? CHUNK_HEADER_RESERVE : 0;
+	}
+
+	unsigned int trailerReserve() const {
+		return chunked ? CHUNK_TRAILER_SIZE : 0;
+	}
+
+	bool emit(OutputCallback callback, void *userData) {
+		unsigned int begin = headerReserve();
+		unsigned int end = begin + outputUsed;
+
+		if (chunked) {
+			char header[CHUNK_HEADER_RESERVE];
+			unsigned int len = integerToHex<unsigned int>(outputUsed, header);
+			begin -= len + 2;
+			memcpy(output.start + begin, header, len);
+			memcpy(output.start + begin + len, "\r\n", 2);
+			memcpy(output.start + end, "\r\n", 2);
+			end += 2;
+		}
+
+		MemoryKit::mbuf framed(output, begin, end - begin);
+		MemoryKit::mbuf payload(output, headerReserve(), outputUsed);
+		bytesOut += outputUsed;
+		output = MemoryKit::mbuf();
+		outputUsed = 0;
+		return callback(userData, framed, payload);
+	}
+
+	bool run(const char *data, size_t size, int flush, OutputCallback callback,
+		void *userData)
+	{
+		stream.next_in = (Bytef *) data;
+		stream.avail_in = size;
+		bytesIn += size;
+
+		while (true) {
+			if (output.empty()) {
+				output = MemoryKit::mbuf_get(pool);
+				outputUsed = 0;
+				if (OXT_UNLIKELY(output.empty())) {
+					return false;
+				}
+			}
+
+			unsigned int capacity = output.size() - headerReserve()
+				- trailerReserve() - outputUsed;
+			stream.next_out = (Bytef *) output.start + headerReserve() + outputUsed;
+			stream.avail_out = capacity;
+
+			int ret = deflate(&stream, flush);
+			if (ret == Z_STREAM_ERROR) {
+				return false;
+			}
+			outputUsed += capacity - stream.avail_out;
+
+			// If deflate() did not fill the output buffer then it has
+			// consumed all input.
+			bool done = (flush == Z_FINISH)
+				? ret == Z_STREAM_END
+				: stream.avail_out != 0;
+			if (stream.avail_out == 0 || (done && flush == Z_FINISH && outputUsed > 0)) {
+				if (!emit(callback, userData)) {
+					return false;
+				}
+			}
+			if (done) {
+				return true;
+			}
+		}
+	}
+
+public:
+	ResponseCompressor()
+		: pool(NULL),
+		  outputUsed(0),
+		  coding(ServerKit::CC_IDENTITY),
+		  initialized(false),
+		  chunked(false),
+		  finished(false),
+		  bytesIn(0),
+		  bytesOut(0)
+	{
+		memset(&stream, 0, sizeof(stream));
+	}
+
+	~ResponseCompressor() {
+		if (initialized) {
+			deflateEnd(&stream);
+		}
+	}
+
+	/**
+	 * `expectedSize` is the size of the uncompressed body, or 0 if unknown.
+	 * Small bodies get a smaller compression window, which saves memory.
+	 * Returns false if zlib could not be initialized.
+	 */
+	bool initialize(MemoryKit::mbuf_pool *_pool, ServerKit::ContentCoding _coding,
+		int level, boost::uint64_t expectedSize, bool _chunked)
+	{
+		int windowBits = MAX_WBITS;
+		int memLevel = 8;
+
+		assert(!initialized);
+		assert(_coding != ServerKit::CC_IDENTITY);
+		assert(MemoryKit::mbuf_pool_data_size(_pool) > CHUNK_HEADER_RESERVE + CHUNK_TRAILER_SIZE);
+
+		if (expectedSize > 0) {
+			while (windowBits > 9 && expectedSize <= (1u << (windowBits - 1))) {
+				windowBits--;
+				memLevel--;
+			}
+		}
+		if (_coding == ServerKit::CC_GZIP) {
+			windowBits += 16;
+		}
+
+		if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, memLevel,
+			Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			return false;
+		}
+		pool = _pool;
+		coding = _coding;
+		chunked = _chunked;
+		initialized = true;
+		return true;
+	}
+
+	bool feed(const char *data, size_t size, OutputCallback callback, void *userData) {
+		assert(initialized);
+		assert(!finished);
+		if (size == 0) {
+			return true;
+		}
+		return run(data, size, Z_NO_FLUSH, callback, userData);
+	}
+
+	/**
+	 * Flushes all remaining compressed data. If chunked framing is used,
+	 * the caller is responsible for writing the terminating chunk.
+	 */
+	bool finish(OutputCallback callback, void *userData) {
+		assert(initialized);
+		assert(!finished);
+		finished = true;
+		return run("", 0, Z_FINISH, callback, userData);
+	}
+
+	ServerKit::ContentCoding getCoding() const {
+		return coding;
+	}
+
+	bool isChunked() const {
+		return chunked;
+	}
+
+	bool isFinished() const {
+		return finished;
+	}
+
+	boost::uint64_t getBytesIn() const {
+		return bytesIn;
+	}
+
+	boost::uint64_t getBytesOut() const {
+		return bytesOut;
+	}
+};
+
+
+} // namespace Core
+} // namespace Passenger
+
+#endif /* _PASSENGER_RESPONSE_COMPRESSOR_H_ */
@@ -53,6 +53,7 @@ using namespace std;
 
 
 struct Config;
+class OutputMultiplexer;
 typedef ApplicationPool2::Options Options;
 typedef boost::shared_ptr<Config> ConfigPtr;
 
@@ -79,8 +80,11 @@ struct Config {
 	unsigned int spawnerCreationSleepTime;
 	unsigned int spawnTime;
 
-	// Used by PipeWatcher.
+	// Used by PipeWatcher. If outputMultiplexer is set, then PipeWatchers
+	// register their pipes with it instead of spawning a thread per pipe.
+	// It must outlive all Processes and Spawners.
 	OutputHandler outputHandler;
+	OutputMultiplexer *outputMultiplexer;
 
 	// Other.
 	void *data;
@@ -91,6 +95,7 @@ struct Config {
 		  concurrency(1),
 		  spawnerCreationSleepTime(0),
 		  spawnTime(0),
+		  outputMultiplexer(NULL),
 		  data(NULL)
 		{ }
 
@@ -54,6 +54,7 @@ public:
 		TRACE_POINT();
 		possiblyRaiseInternalError(options);
 
+		unsigned long long spawnStartTime = SystemTime::getUsec();
 		syscalls::usleep(config->spawnTime);
 
 		SocketPair adminSocket = createUnixSocketPair(__FILE__, __LINE__);
@@ -70,7 +71,7 @@ public:
 		result["pid"] = number;
 		result["gupid"] = "gupid-" + toString(number);
 		result["spawner_creation_time"] = (Json::UInt64) SystemTime::getUsec();
-		result["spawn_start_time"] = (Json::UInt64) SystemTime::getUsec();
+		result["spawn_start_time"] = (Json::UInt64) spawnStartTime;
 		result["sockets"].append(socket);
 		result.adminSocket = adminSocket.second;
 
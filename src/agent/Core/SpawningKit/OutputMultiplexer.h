@@ -0,0 +1,237 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_SPAWNING_KIT_OUTPUT_MULTIPLEXER_H_
+#define _PASSENGER_SPAWNING_KIT_OUTPUT_MULTIPLEXER_H_
+
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <oxt/backtrace.hpp>
+#include <ev++.h>
+#include <vector>
+#include <set>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/types.h>
+
+#include <jsoncpp/json.h>
+#include <FileDescriptor.h>
+#include <Constants.h>
+#include <BackgroundEventLoop.h>
+#include <SafeLibev.h>
+#include <LoggingKit/LoggingKit.h>
+#include <Utils.h>
+#include <Utils/IOUtils.h>
+#include <Utils/StrIntUtils.h>
+#include <Core/SpawningKit/Config.h>
+
+namespace Passenger {
+namespace SpawningKit {
+
+using namespace std;
+
+
+/**
+ * Forwards a chunk of output that was read from an application process's
+ * stdout or stderr to the log, line by line, and to `config->outputHandler`.
+ */
+inline void
+forwardAppOutput(const ConfigPtr &config, pid_t pid, const char *name,
+	const char *data, size_t size)
+{
+	if (size == 1 && data[0] == '\n') {
+		LoggingKit::logAppOutput(pid, name, "", 0);
+	} else {
+		vector<StaticString> lines;
+		size_t size2 = size;
+		if (size2 > 0 && data[size2 - 1] == '\n') {
+			size2--;
+		}
+		split(StaticString(data, size2), '\n', lines);
+		foreach (const StaticString line, lines) {
+			LoggingKit::logAppOutput(pid, name, line.data(), line.size());
+		}
+	}
+
+	if (config->outputHandler) {
+		config->outputHandler(data, size);
+	}
+}
+
+
+/**
+ * Reads the stdout and stderr pipes of all application processes from a
+ * single event loop thread, instead of dedicating a thread to every pipe.
+ * A pipe is watched until it reaches EOF, even if the Process object that
+ * registered it has already been destroyed.
+ *
+ * At most `READ_BUFFER_SIZE` bytes are read per pipe per event loop
+ * iteration, so that a single chatty process cannot starve the others.
+ */
+class OutputMultiplexer: public boost::noncopyable {
+public:
+	static const unsigned int READ_BUFFER_SIZE = 1024 * 8;
+
+private:
+	struct Watcher {
+		ev_io io;
+		OutputMultiplexer *self;
+		ConfigPtr config;
+		FileDescriptor fd;
+		const char *name;
+		pid_t pid;
+	};
+
+	BackgroundEventLoop bgloop;
+	/** Only accessed from the event loop thread. */
+	set<Watcher *> watchers;
+
+	boost::mutex syncher;
+	/** Watchers that have been added but not yet started by the event loop. */
+	vector<Watcher *> newWatchers;
+
+	boost::atomic<unsigned int> watcherCount;
+	boost::atomic<boost::uint64_t> bytesRead;
+
+	void startNewWatchers() {
+		TRACE_POINT();
+		vector<Watcher *> watchersToStart;
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			watchersToStart.swap(newWatchers);
+		}
+
+		foreach (Watcher *watcher, watchersToStart) {
+			ev_io_init(&watcher->io, onReadable, watcher->fd, EV_READ);
+			watcher->io.data = watcher;
+			ev_io_start(bgloop.libev_loop, &watcher->io);
+			watchers.insert(watcher);
+		}
+	}
+
+	static void onReadable(struct ev_loop *loop, ev_io *io, int revents) {
+		Watcher *watcher = static_cast<Watcher *>(io->data);
+		watcher->self->onReadable(watcher);
+	}
+
+	void onReadable(Watcher *watcher) {
+		TRACE_POINT();
+		char buf[READ_BUFFER_SIZE];
+		ssize_t ret;
+
+		do {
+			ret = ::read(watcher->fd, buf, sizeof(buf));
+		} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
+
+		if (ret > 0) {
+			UPDATE_TRACE_POINT();
+			bytesRead.fetch_add(ret, boost::memory_order_relaxed);
+			forwardAppOutput(watcher->config, watcher->pid, watcher->name,
+				buf, ret);
+		} else if (ret == 0) {
+			removeWatcher(watcher);
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			int e = errno;
+			if (e != ECONNRESET) {
+				P_WARN("Cannot read from process " << watcher->pid << " "
+					<< watcher->name << ": " << strerror(e) << " (errno="
+					<< e << ")");
+			}
+			removeWatcher(watcher);
+		}
+	}
+
+	void removeWatcher(Watcher *watcher) {
+		ev_io_stop(bgloop.libev_loop, &watcher->io);
+		watchers.erase(watcher);
+		delete watcher;
+		watcherCount.fetch_sub(1, boost::memory_order_relaxed);
+	}
+
+public:
+	OutputMultiplexer()
+		: bgloop(true, false),
+		  watcherCount(0),
+		  bytesRead(0)
+	{
+		bgloop.start("Output multiplexer", POOL_HELPER_THREAD_STACK_SIZE);
+	}
+
+	~OutputMultiplexer() {
+		bgloop.stop();
+		foreach (Watcher *watcher, watchers) {
+			delete watcher;
+		}
+		foreach (Watcher *watcher, newWatchers) {
+			delete watcher;
+		}
+	}
+
+	/**
+	 * Starts forwarding the output that is read from `fd` until EOF.
+	 * `fd` is made non-blocking. `name` must be a string literal.
+	 * Thread-safe.
+	 */
+	void add(const ConfigPtr &config, const FileDescriptor &fd,
+		const char *name, pid_t pid)
+	{
+		Watcher *watcher = new Watcher();
+		watcher->self = this;
+		watcher->config = config;
+		watcher->fd = fd;
+		watcher->name = name;
+		watcher->pid = pid;
+		setNonBlocking(fd);
+
+		watcherCount.fetch_add(1, boost::memory_order_relaxed);
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			newWatchers.push_back(watcher);
+		}
+		bgloop.safe->runLater(boost::bind(&OutputMultiplexer::startNewWatchers, this));
+	}
+
+	/** The number of pipes that haven't reached EOF yet. */
+	unsigned int getWatcherCount() const {
+		return watcherCount.load(boost::memory_order_relaxed);
+	}
+
+	Json::Value inspectStateAsJson() const {
+		Json::Value doc;
+		doc["pipes"] = getWatcherCount();
+		doc["bytes_read"] = (Json::UInt64) bytesRead.load(boost::memory_order_relaxed);
+		return doc;
+	}
+};
+
+
+} // namespace SpawningKit
+} // namespace Passenger
+
+#endif /* _PASSENGER_SPAWNING_KIT_OUTPUT_MULTIPLEXER_H_ */
@@ -44,6 +44,7 @@
 #include <Utils.h>
 #include <Utils/StrIntUtils.h>
 #include <Core/SpawningKit/Config.h>
+#include <Core/SpawningKit/OutputMultiplexer.h>
 
 namespace Passenger {
 namespace SpawningKit {
@@ -51,7 +52,11 @@ namespace SpawningKit {
 using namespace boost;
 
 
-/** A PipeWatcher lives until the file descriptor is closed. */
+/**
+ * A PipeWatcher lives until the file descriptor is closed. If
+ * `config->outputMultiplexer` is set, then the file descriptor is watched
+ * by the multiplexer, otherwise by a dedicated thread.
+ */
 class PipeWatcher: public boost::enable_shared_from_this<PipeWatcher> {
 private:
 	ConfigPtr config;
@@ -95,24 +100,9 @@ private:
 						": " << strerror(e) << " (errno=" << e << ")");
 					break;
 				}
-			} else if (ret == 1 && buf[0] == '\n') {
-				UPDATE_TRACE_POINT();
-				LoggingKit::logAppOutput(pid, name, "", 0);
 			} else {
 				UPDATE_TRACE_POINT();
-				vector<StaticString> lines;
-				ssize_t ret2 = ret;
-				if (ret2 > 0 && buf[ret2 - 1] == '\n') {
-					ret2--;
-				}
-				split(StaticString(buf, ret2), '\n', lines);
-				foreach (const StaticString line, lines) {
-					LoggingKit::logAppOutput(pid, name, line.data(), line.size());
-				}
-			}
-
-			if (config->outputHandler) {
-				config->outputHandler(buf, ret);
+				forwardAppOutput(config, pid, name, buf, ret);
 			}
 		}
 	}
@@ -128,12 +118,19 @@ public:
 		{ }
 
 	void initialize() {
+		if (config->outputMultiplexer != NULL) {
+			return;
+		}
 		oxt::thread(boost::bind(threadMain, shared_from_this()),
 			"PipeWatcher: PID " + toString(pid) + " " + name + ", fd " + toString(fd),
 			POOL_HELPER_THREAD_STACK_SIZE);
 	}
 
 	void start() {
+		if (config->outputMultiplexer != NULL) {
+			config->outputMultiplexer->add(config, fd, name, pid);
+			return;
+		}
 		boost::lock_guard<boost::mutex> lock(startSyncher);
 		started = true;
 		startCond.notify_all();
@@ -70,7 +70,7 @@ private:
 	map<string, string> preloaderAnnotations;
 	Options options;
 
-	// Protects m_lastUsed and pid.
+	// Protects m_lastUsed, pid and preloaderAnnotations.
 	mutable boost::mutex simpleFieldSyncher;
 	// Protects everything else.
 	mutable boost::mutex syncher;
@@ -319,7 +319,11 @@ private:
 			watcher->initialize();
 			watcher->start();
 
-			preloaderAnnotations = debugDir->readAll();
+			{
+				map<string, string> annotations = debugDir->readAll();
+				boost::lock_guard<boost::mutex> l(simpleFieldSyncher);
+				preloaderAnnotations = annotations;
+			}
 			P_INFO("Preloader for " << options.appRoot <<
 				" started on PID " << pid <<
 				", listening on " << socketAddress);
@@ -759,7 +763,12 @@ private:
 protected:
 	virtual void annotateAppSpawnException(SpawnException &e, NegotiationDetails &details) {
 		Spawner::annotateAppSpawnException(e, details);
-		e.addAnnotations(preloaderAnnotations);
+		map<string, string> annotations;
+		{
+			boost::lock_guard<boost::mutex> l(simpleFieldSyncher);
+			annotations = preloaderAnnotations;
+		}
+		e.addAnnotations(annotations);
 	}
 
 public:
@@ -796,14 +805,23 @@ public:
 			m_lastUsed = SystemTime::getUsec();
 		}
 		UPDATE_TRACE_POINT();
-		boost::lock_guard<boost::mutex> l(syncher);
-		if (!preloaderStarted()) {
+		// Only talking to the preloader needs to be serialized. Once the
+		// preloader has forked the process, negotiating with it only involves
+		// the process itself, so several spawns can negotiate concurrently.
+		SpawnPreparationInfo preparation;
+		NegotiationDetails details;
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			if (!preloaderStarted()) {
+				UPDATE_TRACE_POINT();
+				startPreloader();
+			}
+
 			UPDATE_TRACE_POINT();
-			startPreloader();
+			details = sendSpawnCommandAndGetNegotiationDetails(options);
+			preparation = this->preparation;
 		}
-
-		UPDATE_TRACE_POINT();
-		NegotiationDetails details = sendSpawnCommandAndGetNegotiationDetails(options);
+		details.preparation = &preparation;
 		Result result = negotiateSpawn(details);
 		P_DEBUG("Process spawning done: appRoot=" << options.appRoot <<
 			", pid=" << result["pid"].asInt());
@@ -0,0 +1,271 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_UNION_STATION_ASYNC_SENDER_H_
+#define _PASSENGER_UNION_STATION_ASYNC_SENDER_H_
+
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <oxt/thread.hpp>
+#include <oxt/backtrace.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <exception>
+
+#include <jsoncpp/json.h>
+#include <LoggingKit/LoggingKit.h>
+#include <Constants.h>
+#include <StaticString.h>
+#include <Utils/IOUtils.h>
+#include <Core/UnionStation/Connection.h>
+
+namespace Passenger {
+namespace UnionStation {
+
+using namespace std;
+
+
+class Context;
+
+inline void _checkinConnection(Context *ctx, const ConnectionPtr &connection);
+
+
+/**
+ * Sends transaction log data to the UstRouter from a background thread, so
+ * that logging a Union Station message never blocks on the UstRouter socket.
+ *
+ * Transactions queue already serialized protocol messages together with the
+ * connection they belong to. The sender thread takes everything that has
+ * been queued so far and writes consecutive messages for the same connection
+ * with a single `writev()`. Messages for the same connection are written in
+ * the order in which they were queued.
+ *
+ * The queue is bounded by `maxQueueSize` bytes. Messages that don't fit are
+ * dropped and counted. The message that closes a transaction is never
+ * dropped, because the connection is only checked back into the Context's
+ * connection pool after that message has been written.
+ */
+class AsyncSender: public boost::noncopyable {
+private:
+	static const unsigned long long IO_TIMEOUT = 5000000; // In microseconds.
+
+	struct Item {
+		ConnectionPtr connection;
+		string data;
+		/** If not NULL, check the connection into this Context after writing. */
+		Context *checkinTo;
+	};
+
+	const unsigned int maxQueueSize;
+	oxt::thread *thread;
+
+	mutable boost::mutex syncher;
+	boost::condition_variable wakeupCond;
+	boost::condition_variable drainedCond;
+	deque<Item> queue;
+	unsigned int queuedBytes;
+	bool sending;
+	bool shuttingDown;
+
+	boost::atomic<boost::uint64_t> messagesSent;
+	boost::atomic<boost::uint64_t> messagesDropped;
+	boost::atomic<boost::uint64_t> bytesSent;
+	boost::atomic<boost::uint64_t> writeCalls;
+
+	void threadMain() {
+		TRACE_POINT();
+		deque<Item> batch;
+
+		while (true) {
+			UPDATE_TRACE_POINT();
+			{
+				boost::unique_lock<boost::mutex> l(syncher);
+				sending = false;
+				drainedCond.notify_all();
+				while (queue.empty() && !shuttingDown) {
+					wakeupCond.wait(l);
+				}
+				if (queue.empty()) {
+					// Shutting down, and everything has been sent.
+					break;
+				}
+				batch.swap(queue);
+				queuedBytes = 0;
+				sending = true;
+			}
+
+			UPDATE_TRACE_POINT();
+			sendBatch(batch);
+			batch.clear();
+		}
+	}
+
+	void sendBatch(const deque<Item> &batch) {
+		deque<Item>::const_iterator it = batch.begin();
+		vector<StaticString> buffers;
+
+		while (it != batch.end()) {
+			const ConnectionPtr &connection = it->connection;
+			deque<Item>::const_iterator runEnd = it;
+			boost::uint64_t size = 0;
+
+			buffers.clear();
+			while (runEnd != batch.end() && runEnd->connection == connection) {
+				buffers.push_back(runEnd->data);
+				size += runEnd->data.size();
+				runEnd++;
+			}
+
+			writeToConnection(connection, buffers, size);
+
+			for (; it != runEnd; it++) {
+				if (it->checkinTo != NULL && connection->connected()) {
+					_checkinConnection(it->checkinTo, connection);
+				}
+			}
+		}
+	}
+
+	void writeToConnection(const ConnectionPtr &connection,
+		const vector<StaticString> &buffers, boost::uint64_t size)
+	{
+		TRACE_POINT();
+		ConnectionLock l(connection);
+		if (!connection->connected()) {
+			// An earlier write failed. Whatever was queued after
+			// that belongs to a transaction that is already lost.
+			messagesDropped.fetch_add(buffers.size(), boost::memory_order_relaxed);
+			return;
+		}
+
+		ConnectionGuard guard(connection.get());
+		try {
+			unsigned long long timeout = IO_TIMEOUT;
+			gatheredWrite(connection->fd, &buffers[0], buffers.size(), &timeout);
+			guard.clear();
+			messagesSent.fetch_add(buffers.size(), boost::memory_order_relaxed);
+			bytesSent.fetch_add(size, boost::memory_order_relaxed);
+			writeCalls.fetch_add(1, boost::memory_order_relaxed);
+		} catch (const std::exception &e) {
+			UPDATE_TRACE_POINT();
+			P_WARN("Cannot send Union Station data to the UstRouter: " << e.what());
+			messagesDropped.fetch_add(buffers.size(), boost::memory_order_relaxed);
+		}
+	}
+
+public:
+	AsyncSender(unsigned int _maxQueueSize = DEFAULT_UST_ROUTER_ASYNC_QUEUE_SIZE)
+		: maxQueueSize(_maxQueueSize),
+		  queuedBytes(0),
+		  sending(false),
+		  shuttingDown(false),
+		  messagesSent(0),
+		  messagesDropped(0),
+		  bytesSent(0),
+		  writeCalls(0)
+	{
+		thread = new oxt::thread(
+			boost::bind(&AsyncSender::threadMain, this),
+			"Union Station sender",
+			1024 * 128);
+	}
+
+	~AsyncSender() {
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			shuttingDown = true;
+			wakeupCond.notify_one();
+		}
+		thread->join();
+		delete thread;
+	}
+
+	/**
+	 * Queues serialized protocol data for writing to `connection`. The
+	 * contents of `data` are taken over. If `checkinTo` is given, then
+	 * the data is queued even if the queue is full, and the connection
+	 * is checked into that Context after the data has been written.
+	 * Returns whether the data was queued. Thread-safe.
+	 */
+	bool send(const ConnectionPtr &connection, string &data, Context *checkinTo = NULL) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		if (checkinTo == NULL && queuedBytes + data.size() > maxQueueSize) {
+			messagesDropped.fetch_add(1, boost::memory_order_relaxed);
+			return false;
+		}
+
+		queue.push_back(Item());
+		Item &item = queue.back();
+		item.connection = connection;
+		item.data.swap(data);
+		item.checkinTo = checkinTo;
+		queuedBytes += item.data.size();
+		if (queue.size() == 1) {
+			wakeupCond.notify_one();
+		}
+		return true;
+	}
+
+	/**
+	 * Waits until all data that has been queued so far is written.
+	 * Thread-safe.
+	 */
+	void flush() {
+		boost::unique_lock<boost::mutex> l(syncher);
+		while (!queue.empty() || sending) {
+			drainedCond.wait(l);
+		}
+	}
+
+	boost::uint64_t getMessagesDropped() const {
+		return messagesDropped.load(boost::memory_order_relaxed);
+	}
+
+	Json::Value inspectStateAsJson() const {
+		Json::Value doc;
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			doc["queued_messages"] = (Json::UInt) queue.size();
+			doc["queued_bytes"] = queuedBytes;
+		}
+		doc["max_queue_size"] = maxQueueSize;
+		doc["messages_sent"] = (Json::UInt64) messagesSent.load(boost::memory_order_relaxed);
+		doc["messages_dropped"] = (Json::UInt64) messagesDropped.load(boost::memory_order_relaxed);
+		doc["bytes_sent"] = (Json::UInt64) bytesSent.load(boost::memory_order_relaxed);
+		doc["write_calls"] = (Json::UInt64) writeCalls.load(boost::memory_order_relaxed);
+		return doc;
+	}
+};
+
+
+} // namespace UnionStation
+} // namespace Passenger
+
+#endif /* _PASSENGER_UNION_STATION_ASYNC_SENDER_H_ */
@@ -28,6 +28,7 @@
 
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 #include <oxt/backtrace.hpp>
 
@@ -44,6 +45,7 @@
 #include <Utils/MessageIO.h>
 #include <Utils/SystemTime.h>
 #include <Core/UnionStation/Connection.h>
+#include <Core/UnionStation/AsyncSender.h>
 #include <Core/UnionStation/Transaction.h>
 
 namespace Passenger {
@@ -80,6 +82,13 @@ private:
 	 */
 	unsigned long long nextReconnectTime;
 
+	/**
+	 * If set, transactions queue their messages here instead of writing
+	 * them to the UstRouter directly. Must be destroyed before the
+	 * connection pool, because it checks connections back in.
+	 */
+	boost::scoped_ptr<AsyncSender> asyncSender;
+
 	static bool isNetworkError(int code) {
 		return code == EPIPE || code == ECONNREFUSED || code == ECONNRESET
 			|| code == EHOSTUNREACH || code == ENETDOWN || code == ENETUNREACH
@@ -187,6 +196,26 @@ public:
 		initialize();
 	}
 
+	~Context() {
+		// Write out whatever is still queued.
+		asyncSender.reset();
+	}
+
+	/**
+	 * Makes transactions that are created from now on send their messages
+	 * from a background thread. Messages are queued in memory, up to
+	 * `maxQueueSize` bytes; messages that don't fit are dropped.
+	 * Not thread-safe: call this before creating any transactions.
+	 */
+	void enableAsyncSending(unsigned int maxQueueSize = DEFAULT_UST_ROUTER_ASYNC_QUEUE_SIZE) {
+		asyncSender.reset(new AsyncSender(maxQueueSize));
+	}
+
+	/** Returns NULL if asynchronous sending is not enabled. */
+	AsyncSender *getAsyncSender() const {
+		return asyncSender.get();
+	}
+
 
 	/***** Connection pool methods *****/
 
@@ -428,7 +457,9 @@ public:
 				txnId,
 				groupName,
 				category,
-				unionStationKey);
+				unionStationKey,
+				PRINT,
+				asyncSender.get());
 			guard.clear();
 			P_TRACE(2, "Created new Union Station transaction: group=" << groupName <<
 				", category=" << category << ", txnId=" << txnId);
@@ -483,7 +514,9 @@ public:
 				txnId,
 				groupName,
 				category,
-				unionStationKey);
+				unionStationKey,
+				PRINT,
+				asyncSender.get());
 			guard.clear();
 			return transaction;
 		} else {
@@ -529,6 +562,11 @@ _checkinConnection(const ContextPtr &ctx, const ConnectionPtr &connection) {
 	ctx->checkinConnection(connection);
 }
 
+inline void
+_checkinConnection(Context *ctx, const ConnectionPtr &connection) {
+	ctx->checkinConnection(connection);
+}
+
 
 } // namespace UnionStation
 } // namespace Passenger
@@ -39,10 +39,12 @@
 #include <LoggingKit/LoggingKit.h>
 #include <Exceptions.h>
 #include <StaticString.h>
+#include <MessageReadersWriters.h>
 #include <Utils/IOUtils.h>
 #include <Utils/SystemTime.h>
 #include <Utils/StrIntUtils.h>
 #include <Core/UnionStation/Connection.h>
+#include <Core/UnionStation/AsyncSender.h>
 
 namespace Passenger {
 namespace UnionStation {
@@ -76,6 +78,8 @@ private:
 	const string category;
 	const string unionStationKey;
 	const ExceptionHandlingMode exceptionHandlingMode;
+	/** If not NULL, messages are queued here instead of written directly. */
+	AsyncSender * const asyncSender;
 
 	/**
 	 * Buffer must be at least txnId.size() + 1 + INT64_STR_BUFSIZE + 1 bytes.
@@ -105,6 +109,29 @@ private:
 		return buffer;
 	}
 
+	static void appendArrayMessage(string &output, StaticString args[],
+		unsigned int nargs)
+	{
+		char header[sizeof(boost::uint16_t)];
+		StaticString buffers[1 + 2 * 4];
+		unsigned int nbuffers = ArrayMessage::outputSize(nargs);
+
+		assert(nbuffers <= sizeof(buffers) / sizeof(StaticString));
+		ArrayMessage::generate(args, nargs, header, buffers, nbuffers);
+		for (unsigned int i = 0; i < nbuffers; i++) {
+			output.append(buffers[i].data(), buffers[i].size());
+		}
+	}
+
+	static void appendScalarMessage(string &output, const StaticString &data) {
+		char header[sizeof(boost::uint32_t)];
+		StaticString buffers[2];
+
+		ScalarMessage::generate(data, header, buffers);
+		output.append(buffers[0].data(), buffers[0].size());
+		output.append(buffers[1].data(), buffers[1].size());
+	}
+
 	template<typename ExceptionType>
 	void handleException(const ExceptionType &e) {
 		switch (exceptionHandlingMode) {
@@ -127,7 +154,8 @@ private:
 
 public:
 	Transaction()
-		: exceptionHandlingMode(PRINT)
+		: exceptionHandlingMode(PRINT),
+		  asyncSender(NULL)
 		{ }
 
 	Transaction(const ContextPtr &_context,
@@ -136,14 +164,16 @@ public:
 		const string &_groupName,
 		const string &_category,
 		const string &_unionStationKey,
-		ExceptionHandlingMode _exceptionHandlingMode = PRINT)
+		ExceptionHandlingMode _exceptionHandlingMode = PRINT,
+		AsyncSender *_asyncSender = NULL)
 		: context(_context),
 		  connection(_connection),
 		  txnId(_txnId),
 		  groupName(_groupName),
 		  category(_category),
 		  unionStationKey(_unionStationKey),
-		  exceptionHandlingMode(_exceptionHandlingMode)
+		  exceptionHandlingMode(_exceptionHandlingMode),
+		  asyncSender(_asyncSender)
 		{ }
 
 	~Transaction() {
@@ -151,15 +181,28 @@ public:
 		if (connection == NULL) {
 			return;
 		}
-		ConnectionLock l(connection);
-		if (!connection->connected()) {
-			return;
-		}
 
 		char timestamp[2 * sizeof(unsigned long long) + 1];
 		integerToHexatri<unsigned long long>(SystemTime::getUsec(),
 			timestamp);
 
+		if (asyncSender != NULL) {
+			StaticString args[] = {
+				P_STATIC_STRING("closeTransaction"),
+				txnId,
+				timestamp
+			};
+			string data;
+			appendArrayMessage(data, args, sizeof(args) / sizeof(StaticString));
+			asyncSender->send(connection, data, context.get());
+			return;
+		}
+
+		ConnectionLock l(connection);
+		if (!connection->connected()) {
+			return;
+		}
+
 		UPDATE_TRACE_POINT();
 		ConnectionGuard guard(connection.get());
 		try {
@@ -186,15 +229,31 @@ public:
 			P_TRACE(3, "[Union Station log to null] " << text);
 			return;
 		}
+
+		char timestamp[2 * sizeof(unsigned long long) + 1];
+		integerToHexatri<unsigned long long>(SystemTime::getUsec(), timestamp);
+
+		if (asyncSender != NULL) {
+			P_TRACE(3, "[Union Station log] " << txnId << " " << timestamp << " " << text);
+			StaticString args[] = {
+				P_STATIC_STRING("log"),
+				txnId,
+				timestamp
+			};
+			string data;
+			data.reserve(64 + txnId.size() + text.size());
+			appendArrayMessage(data, args, sizeof(args) / sizeof(StaticString));
+			appendScalarMessage(data, text);
+			asyncSender->send(connection, data);
+			return;
+		}
+
 		ConnectionLock l(connection);
 		if (!connection->connected()) {
 			P_TRACE(3, "[Union Station log to null] " << text);
 			return;
 		}
 
-		char timestamp[2 * sizeof(unsigned long long) + 1];
-		integerToHexatri<unsigned long long>(SystemTime::getUsec(), timestamp);
-
 		UPDATE_TRACE_POINT();
 		ConnectionGuard guard(connection.get());
 		try {
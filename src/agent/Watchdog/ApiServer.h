@@ -55,13 +55,15 @@ using namespace std;
  * (do not edit: following text is automatically generated
  * by 'rake configkit_schemas_inline_comments')
  *
- *   accept_burst_count           unsigned integer   -          default(32)
- *   authorizations               array              -          default("[FILTERED]"),secret
- *   client_freelist_limit        unsigned integer   -          default(0)
- *   fd_passing_password          string             required   secret
- *   min_spare_clients            unsigned integer   -          default(0)
- *   request_freelist_limit       unsigned integer   -          default(1024)
- *   start_reading_after_accept   boolean            -          default(true)
+ *   accept_burst_count             unsigned integer   -          default(32)
+ *   authorizations                 array              -          default("[FILTERED]"),secret
+ *   client_freelist_limit          unsigned integer   -          default(0)
+ *   fd_passing_password            string             required   secret
+ *   http2                          boolean            -          default(false)
+ *   http2_max_concurrent_streams   unsigned integer   -          default(100)
+ *   min_spare_clients              unsigned integer   -          default(0)
+ *   request_freelist_limit         unsigned integer   -          default(1024)
+ *   start_reading_after_accept     boolean            -          default(true)
  *
  * END
  */
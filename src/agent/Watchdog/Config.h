@@ -61,6 +61,9 @@ using namespace std;
  *   admin_panel_websocketpp_debug_access                                     boolean            -          default(false)
  *   admin_panel_websocketpp_debug_error                                      boolean            -          default(false)
  *   app_output_log_level                                                     string             -          default("notice")
+ *   async_logging                                                            boolean            -          default(false)
+ *   async_logging_buffer_size                                                unsigned integer   -          default(65536)
+ *   async_logging_overflow_policy                                            string             -          default("drop")
  *   benchmark_mode                                                           string             -          -
  *   controller_accept_burst_count                                            unsigned integer   -          default(32)
  *   controller_addresses                                                     array of strings   -          default,read_only
@@ -72,10 +75,16 @@ using namespace std;
  *   controller_file_buffered_channel_delay_in_file_mode_switching            unsigned integer   -          default(0)
  *   controller_file_buffered_channel_max_disk_chunk_read_size                unsigned integer   -          default(0)
  *   controller_file_buffered_channel_threshold                               unsigned integer   -          default(131072)
+ *   controller_http2                                                         boolean            -          default(false)
+ *   controller_http2_max_concurrent_streams                                  unsigned integer   -          default(100)
+ *   controller_io_uring                                                      boolean            -          default(false),read_only
+ *   controller_load_balancing_strategy                                       string             -          default("round_robin"),read_only
  *   controller_mbuf_block_chunk_size                                         unsigned integer   -          default(4096),read_only
  *   controller_min_spare_clients                                             unsigned integer   -          default(0)
  *   controller_pid_file                                                      string             -          default,read_only
  *   controller_request_freelist_limit                                        unsigned integer   -          default(1024)
+ *   controller_reuse_port                                                    boolean            -          default(false),read_only
+ *   controller_reuse_port_cpu_steering                                       boolean            -          default(false),read_only
  *   controller_secure_headers_password                                       string             -          default,secret
  *   controller_socket_backlog                                                unsigned integer   -          default(2048),read_only
  *   controller_start_reading_after_accept                                    boolean            -          default(true)
@@ -90,6 +99,8 @@ using namespace std;
  *   core_api_server_file_buffered_channel_delay_in_file_mode_switching       unsigned integer   -          default(0)
  *   core_api_server_file_buffered_channel_max_disk_chunk_read_size           unsigned integer   -          default(0)
  *   core_api_server_file_buffered_channel_threshold                          unsigned integer   -          default(131072)
+ *   core_api_server_http2                                                    boolean            -          default(false)
+ *   core_api_server_http2_max_concurrent_streams                             unsigned integer   -          default(100)
  *   core_api_server_mbuf_block_chunk_size                                    unsigned integer   -          default(4096),read_only
  *   core_api_server_min_spare_clients                                        unsigned integer   -          default(0)
  *   core_api_server_request_freelist_limit                                   unsigned integer   -          default(1024)
@@ -107,13 +118,17 @@ using namespace std;
  *   default_max_preloader_idle_time                                          unsigned integer   -          default(300)
  *   default_max_request_queue_size                                           unsigned integer   -          default(100)
  *   default_max_requests                                                     unsigned integer   -          default(0)
+ *   default_memory_limit                                                     unsigned integer   -          default(0)
  *   default_meteor_app_settings                                              string             -          -
  *   default_min_instances                                                    unsigned integer   -          default(1)
  *   default_nodejs                                                           string             -          default("node")
+ *   default_predictive_spawning                                              boolean            -          default(false)
  *   default_python                                                           string             -          default("python")
+ *   default_routing_strategy                                                 string             -          default("lowest_busyness")
  *   default_ruby                                                             string             -          default("ruby")
  *   default_server_name                                                      string             -          default
  *   default_server_port                                                      unsigned integer   -          default
+ *   default_spawn_concurrency                                                unsigned integer   -          default(1)
  *   default_spawn_method                                                     string             -          default("smart")
  *   default_sticky_sessions                                                  boolean            -          default(false)
  *   default_sticky_sessions_cookie_name                                      string             -          default("_passenger_route")
@@ -130,12 +145,17 @@ using namespace std;
  *   log_target                                                               any                -          default({"stderr": true})
  *   max_pool_size                                                            unsigned integer   -          default(6)
  *   multi_app                                                                boolean            -          default(false),read_only
+ *   native_x_sendfile                                                        boolean            -          default(false)
+ *   open_file_cache_size                                                     unsigned integer   -          default(256),read_only
  *   passenger_root                                                           string             required   read_only
  *   pidfiles_to_delete_on_exit                                               array of strings   -          default([])
  *   pool_idle_time                                                           unsigned integer   -          default(300)
  *   pool_selfchecks                                                          boolean            -          default(false)
  *   prestart_urls                                                            array of strings   -          default([]),read_only
  *   response_buffer_high_watermark                                           unsigned integer   -          default(134217728)
+ *   response_compression                                                     boolean            -          default(false)
+ *   response_compression_level                                               unsigned integer   -          default(6)
+ *   response_compression_min_size                                            unsigned integer   -          default(256)
  *   security_update_checker_certificate_path                                 string             -          -
  *   security_update_checker_disabled                                         boolean            -          default(false)
  *   security_update_checker_interval                                         unsigned integer   -          default(86400)
@@ -147,13 +167,24 @@ using namespace std;
  *   single_app_mode_app_root                                                 string             -          default,read_only
  *   single_app_mode_app_type                                                 string             -          read_only
  *   single_app_mode_startup_file                                             string             -          read_only
+ *   splice_relay                                                             boolean            -          default(false)
+ *   splice_relay_min_size                                                    unsigned integer   -          default(131072)
  *   standalone_engine                                                        string             -          default
  *   startup_report_file                                                      string             -          -
  *   stat_throttle_rate                                                       unsigned integer   -          default(10)
+ *   turbocache_collapsed_forwarding                                          boolean            -          default(false),read_only
+ *   turbocache_collapsed_forwarding_timeout                                  unsigned integer   -          default(5),read_only
+ *   turbocache_max_body_size                                                 unsigned integer   -          default(262144),read_only
+ *   turbocache_max_entries                                                   unsigned integer   -          default(1024),read_only
+ *   turbocache_max_memory                                                    unsigned integer   -          default(33554432),read_only
+ *   turbocache_shards                                                        unsigned integer   -          default(16),read_only
+ *   turbocache_shared                                                        boolean            -          default(false),read_only
  *   turbocaching                                                             boolean            -          default(true),read_only
  *   user                                                                     string             -          default,read_only
  *   user_switching                                                           boolean            -          default(true)
  *   ust_router_address                                                       string             -          -
+ *   ust_router_async                                                         boolean            -          default(false),read_only
+ *   ust_router_async_queue_size                                              unsigned integer   -          default(4194304),read_only
  *   ust_router_password                                                      string             -          secret
  *   vary_turbocache_by_cookie                                                string             -          -
  *   watchdog_api_server_accept_burst_count                                   unsigned integer   -          default(32)
@@ -166,6 +197,8 @@ using namespace std;
  *   watchdog_api_server_file_buffered_channel_delay_in_file_mode_switching   unsigned integer   -          default(0)
  *   watchdog_api_server_file_buffered_channel_max_disk_chunk_read_size       unsigned integer   -          default(0)
  *   watchdog_api_server_file_buffered_channel_threshold                      unsigned integer   -          default(131072)
+ *   watchdog_api_server_http2                                                boolean            -          default(false)
+ *   watchdog_api_server_http2_max_concurrent_streams                         unsigned integer   -          default(100)
  *   watchdog_api_server_mbuf_block_chunk_size                                unsigned integer   -          default(4096),read_only
  *   watchdog_api_server_min_spare_clients                                    unsigned integer   -          default(0)
  *   watchdog_api_server_request_freelist_limit                               unsigned integer   -          default(1024)
@@ -174,6 +207,8 @@ using namespace std;
  *   watchdog_pid_file_autodelete                                             boolean            -          default(true)
  *   web_server_module_version                                                string             -          read_only
  *   web_server_version                                                       string             -          read_only
+ *   x_accel_redirect_root                                                    string             -          -
+ *   x_sendfile_root                                                          string             -          -
  *
  * END
  */
@@ -39,6 +39,7 @@
 #include <LoggingKit/LoggingKit.h>
 #include <Exceptions.h>
 #include <SafeLibev.h>
+#include <IoUring.h>
 
 #ifndef HAVE_KQUEUE
 	#if defined(__APPLE__) || \
@@ -106,6 +107,16 @@ struct BackgroundEventLoopPrivate {
 	 * libuv poller thread use 100% CPU.
 	 */
 	uv_timer_t libuv_timer;
+	/**
+	 * Processes io_uring completions on the libev thread, so that
+	 * io_uring callbacks don't need a separate poller thread.
+	 */
+	struct ev_io ioUringWatcher;
+	/**
+	 * Submits the io_uring operations queued during an event loop
+	 * iteration in a single system call, right before libev blocks.
+	 */
+	struct ev_prepare ioUringSubmitter;
 
 	oxt::thread *thr;
 	oxt::thread *libuvPollerThr;
@@ -122,6 +133,10 @@ signalLibevExit(struct ev_loop *loop, ev_async *async, int revents) {
 	if (bg->priv->usesLibuv) {
 		ev_async_stop(bg->libev_loop, &bg->priv->libuvActivitySignaller);
 	}
+	if (bg->io_uring != NULL) {
+		ev_prepare_stop(bg->libev_loop, &bg->priv->ioUringSubmitter);
+		ev_io_stop(bg->libev_loop, &bg->priv->ioUringWatcher);
+	}
 	ev_async_stop(bg->libev_loop, &bg->priv->exitSignaller);
 	ev_break(bg->libev_loop, EVBREAK_ALL);
 	if (bg->priv->usesLibuv) {
@@ -137,6 +152,20 @@ onLibuvActivity(struct ev_loop *loop, ev_async *async, int revents) {
 	uv_sem_post(&bg->priv->libuv_sem);
 }
 
+static void
+onIoUringCompletion(struct ev_loop *loop, ev_io *io, int revents) {
+	BackgroundEventLoop *bg = (BackgroundEventLoop *) io->data;
+	bg->io_uring->processCompletions();
+}
+
+static void
+submitIoUringOperations(struct ev_loop *loop, ev_prepare *prepare, int revents) {
+	BackgroundEventLoop *bg = (BackgroundEventLoop *) prepare->data;
+	if (bg->io_uring->hasPendingSubmissions()) {
+		bg->io_uring->submit();
+	}
+}
+
 static void
 doNothing(uv_timer_t *timer) {
 	// Do nothing
@@ -220,9 +249,11 @@ pollLibuv(BackgroundEventLoop *bg) {
 	}
 }
 
-BackgroundEventLoop::BackgroundEventLoop(bool scalable, bool usesLibuv)
+BackgroundEventLoop::BackgroundEventLoop(bool scalable, bool usesLibuv,
+	bool usesIoUring)
 	: libev_loop(NULL),
 	  libuv_loop(NULL),
+	  io_uring(NULL),
 	  priv(NULL)
 {
 	struct Guard {
@@ -240,6 +271,7 @@ BackgroundEventLoop::BackgroundEventLoop(bool scalable, bool usesLibuv)
 				if (self->libuv_loop != NULL) {
 					uv_loop_close(self->libuv_loop);
 				}
+				delete self->io_uring;
 				delete self->priv;
 			}
 		}
@@ -292,6 +324,15 @@ BackgroundEventLoop::BackgroundEventLoop(bool scalable, bool usesLibuv)
 		P_LOG_FILE_DESCRIPTOR_OPEN2(libuv_loop->signal_pipefd[1], "libuv event loop: signal pipe 1");
 	}
 
+	if (usesIoUring && IoUring::isSupported()) {
+		io_uring = new IoUring();
+		ev_io_init(&priv->ioUringWatcher, onIoUringCompletion,
+			io_uring->getFd(), EV_READ);
+		priv->ioUringWatcher.data = this;
+		ev_prepare_init(&priv->ioUringSubmitter, submitIoUringOperations);
+		priv->ioUringSubmitter.data = this;
+	}
+
 	priv->thr = NULL;
 	priv->libuvPollerThr = NULL;
 	priv->usesLibuv = usesLibuv;
@@ -316,6 +357,10 @@ BackgroundEventLoop::~BackgroundEventLoop() {
 			ev_async_stop(libev_loop, &priv->libuvActivitySignaller);
 		}
 	}
+	if (io_uring != NULL) {
+		io_uring->drain();
+		delete io_uring;
+	}
 	if (ev_is_active(&priv->exitSignaller)) {
 		ev_async_stop(libev_loop, &priv->exitSignaller);
 	}
@@ -330,6 +375,10 @@ BackgroundEventLoop::start(const string &threadName, unsigned int stackSize) {
 	if (priv->usesLibuv) {
 		ev_async_start(libev_loop, &priv->libuvActivitySignaller);
 	}
+	if (io_uring != NULL) {
+		ev_io_start(libev_loop, &priv->ioUringWatcher);
+		ev_prepare_start(libev_loop, &priv->ioUringSubmitter);
+	}
 	priv->thr = new oxt::thread(
 		boost::bind(runBackgroundLoop, this),
 		threadName,
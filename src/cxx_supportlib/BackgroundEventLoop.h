@@ -40,6 +40,7 @@ namespace Passenger {
 	using namespace boost;
 
 	class SafeLibev;
+	class IoUring;
 	struct BackgroundEventLoopPrivate;
 
 	/**
@@ -48,10 +49,17 @@ namespace Passenger {
 	struct BackgroundEventLoop {
 		struct ev_loop *libev_loop;
 		struct uv_loop_s *libuv_loop;
+		/**
+		 * An io_uring instance whose completions are processed on the
+		 * libev loop thread. NULL unless `usesIoUring` was passed and
+		 * the kernel supports io_uring.
+		 */
+		IoUring *io_uring;
 		boost::shared_ptr<SafeLibev> safe;
 		BackgroundEventLoopPrivate *priv;
 
-		BackgroundEventLoop(bool scalable = false, bool usesLibuv = true);
+		BackgroundEventLoop(bool scalable = false, bool usesLibuv = true,
+			bool usesIoUring = false);
 		~BackgroundEventLoop();
 
 		void start(const string &threadName = "", unsigned int stackSize = 1024 * 1024);
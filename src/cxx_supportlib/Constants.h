@@ -48,6 +48,7 @@
 #define DEFAULT_APP_OUTPUT_LOG_LEVEL 3
 #define DEFAULT_APP_OUTPUT_LOG_LEVEL_NAME "notice"
 #define DEFAULT_APP_THREAD_COUNT 1
+#define DEFAULT_ASYNC_LOGGING_BUFFER_SIZE 65536
 #define DEFAULT_CONCURRENCY_MODEL "process"
 #define DEFAULT_FILE_BUFFERED_CHANNEL_THRESHOLD 131072
 #define DEFAULT_HTTP_SERVER_LISTEN_ADDRESS "tcp://127.0.0.1:3000"
@@ -60,15 +61,25 @@
 #define DEFAULT_MAX_REQUEST_QUEUE_SIZE 100
 #define DEFAULT_MBUF_CHUNK_SIZE 4096
 #define DEFAULT_NODEJS "node"
+#define DEFAULT_OPEN_FILE_CACHE_SIZE 256
 #define DEFAULT_POOL_IDLE_TIME 300
 #define DEFAULT_PYTHON "python"
 #define DEFAULT_RESPONSE_BUFFER_HIGH_WATERMARK 134217728
+#define DEFAULT_RESPONSE_COMPRESSION_LEVEL 6
+#define DEFAULT_RESPONSE_COMPRESSION_MIN_SIZE 256
 #define DEFAULT_RUBY "ruby"
 #define DEFAULT_SOCKET_BACKLOG 2048
 #define DEFAULT_SPAWN_METHOD "smart"
+#define DEFAULT_SPLICE_RELAY_MIN_SIZE 131072
 #define DEFAULT_START_TIMEOUT 90000
 #define DEFAULT_STAT_THROTTLE_RATE 10
 #define DEFAULT_STICKY_SESSIONS_COOKIE_NAME "_passenger_route"
+#define DEFAULT_TURBOCACHE_COLLAPSED_FORWARDING_TIMEOUT 5
+#define DEFAULT_TURBOCACHE_MAX_BODY_SIZE 262144
+#define DEFAULT_TURBOCACHE_MAX_ENTRIES 1024
+#define DEFAULT_TURBOCACHE_MAX_MEMORY 33554432
+#define DEFAULT_TURBOCACHE_SHARDS 16
+#define DEFAULT_UST_ROUTER_ASYNC_QUEUE_SIZE 4194304
 #define DEFAULT_WEB_APP_USER "nobody"
 #define ENTERPRISE_URL "https://www.phusionpassenger.com/enterprise"
 #define FEEDBACK_FD 3
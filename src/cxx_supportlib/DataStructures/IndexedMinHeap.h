@@ -0,0 +1,196 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_DATA_STRUCTURES_INDEXED_MIN_HEAP_H_
+#define _PASSENGER_DATA_STRUCTURES_INDEXED_MIN_HEAP_H_
+
+#include <boost/container/vector.hpp>
+#include <cassert>
+
+namespace Passenger {
+
+
+/**
+ * A binary min-heap of integer keys in which every item is addressed by its
+ * position in an external, parallel list (item 0, 1, ..., size() - 1). It
+ * answers "which item has the smallest key?" in O(1) time, and changing
+ * the key of an arbitrary item or appending an item takes O(log n) time.
+ *
+ * Items with equal keys are ordered by item number, so `top()` always returns
+ * the lowest-numbered item among those with the smallest key. This is
+ * exactly the result of a linear scan that keeps the first minimum it
+ * encounters.
+ *
+ * `erase()` removes an item and renumbers all items after it, just like
+ * erasing an element from a vector does. This takes O(n) time.
+ */
+class IndexedMinHeap {
+private:
+	struct Node {
+		int key;
+		unsigned int item;
+	};
+
+	/** The heap itself. */
+	boost::container::vector<Node> nodes;
+	/** Maps an item number to its position in `nodes`. */
+	boost::container::vector<unsigned int> positions;
+
+	static bool lessThan(const Node &a, const Node &b) {
+		return a.key < b.key || (a.key == b.key && a.item < b.item);
+	}
+
+	void place(unsigned int pos, const Node &node) {
+		nodes[pos] = node;
+		positions[node.item] = pos;
+	}
+
+	void siftUp(unsigned int pos) {
+		Node node = nodes[pos];
+		while (pos > 0) {
+			unsigned int parent = (pos - 1) / 2;
+			if (!lessThan(node, nodes[parent])) {
+				break;
+			}
+			place(pos, nodes[parent]);
+			pos = parent;
+		}
+		place(pos, node);
+	}
+
+	void siftDown(unsigned int pos) {
+		Node node = nodes[pos];
+		unsigned int size = nodes.size();
+		while (true) {
+			unsigned int child = 2 * pos + 1;
+			if (child >= size) {
+				break;
+			}
+			if (child + 1 < size && lessThan(nodes[child + 1], nodes[child])) {
+				child++;
+			}
+			if (!lessThan(nodes[child], node)) {
+				break;
+			}
+			place(pos, nodes[child]);
+			pos = child;
+		}
+		place(pos, node);
+	}
+
+public:
+	bool empty() const {
+		return nodes.empty();
+	}
+
+	unsigned int size() const {
+		return nodes.size();
+	}
+
+	/**
+	 * Appends a new item with the given key. Its item number is
+	 * the size of the heap before the call.
+	 */
+	void push(int key) {
+		Node node;
+		node.key = key;
+		node.item = nodes.size();
+		nodes.push_back(node);
+		positions.push_back(node.item);
+		siftUp(node.item);
+	}
+
+	/**
+	 * Returns the number of the item with the smallest key.
+	 */
+	unsigned int top() const {
+		assert(!empty());
+		return nodes[0].item;
+	}
+
+	int topKey() const {
+		assert(!empty());
+		return nodes[0].key;
+	}
+
+	int get(unsigned int item) const {
+		assert(item < positions.size());
+		return nodes[positions[item]].key;
+	}
+
+	void update(unsigned int item, int key) {
+		assert(item < positions.size());
+		unsigned int pos = positions[item];
+		int oldKey = nodes[pos].key;
+		nodes[pos].key = key;
+		if (key < oldKey) {
+			siftUp(pos);
+		} else if (key > oldKey) {
+			siftDown(pos);
+		}
+	}
+
+	void erase(unsigned int item) {
+		assert(item < positions.size());
+		unsigned int pos = positions[item];
+		unsigned int size = nodes.size() - 1;
+
+		// Move the last node into the hole, then renumber. Renumbering
+		// preserves the relative order of the remaining items, so it
+		// does not affect the heap property.
+		nodes[pos] = nodes.back();
+		nodes.pop_back();
+		positions.pop_back();
+		for (unsigned int i = 0; i < size; i++) {
+			if (nodes[i].item > item) {
+				nodes[i].item--;
+			}
+			positions[nodes[i].item] = i;
+		}
+
+		if (pos < size) {
+			if (pos > 0 && lessThan(nodes[pos], nodes[(pos - 1) / 2])) {
+				siftUp(pos);
+			} else {
+				siftDown(pos);
+			}
+		}
+	}
+
+	void clear() {
+		nodes.clear();
+		positions.clear();
+	}
+
+	void shrink_to_fit() {
+		nodes.shrink_to_fit();
+		positions.shrink_to_fit();
+	}
+};
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_DATA_STRUCTURES_INDEXED_MIN_HEAP_H_ */
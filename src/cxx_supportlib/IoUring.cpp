@@ -0,0 +1,491 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <IoUring.h>
+#include <LoggingKit/LoggingKit.h>
+#include <Exceptions.h>
+
+#ifndef HAVE_IO_URING
+	#if defined(__linux__) && defined(__has_include)
+		#if __has_include(<linux/io_uring.h>)
+			#include <linux/io_uring.h>
+			#include <sys/syscall.h>
+			// IORING_FEAT_EXT_ARG was introduced in the same kernel
+			// version as IORING_OP_UNLINKAT, which is an enum value that
+			// we can't check for directly.
+			#if defined(IORING_FEAT_EXT_ARG) && defined(__NR_io_uring_setup)
+				#define HAVE_IO_URING 1
+			#endif
+		#endif
+	#endif
+#endif
+
+#ifdef HAVE_IO_URING
+	#include <linux/io_uring.h>
+	#include <sys/syscall.h>
+	#include <sys/mman.h>
+#endif
+
+
+namespace Passenger {
+
+using namespace std;
+
+
+#ifdef HAVE_IO_URING
+
+static int
+ioUringSetup(unsigned int entries, struct io_uring_params *params) {
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static bool
+ioUringSupportsAllOperations(int fd) {
+	static const unsigned char requiredOps[] = {
+		IORING_OP_OPENAT,
+		IORING_OP_READV,
+		IORING_OP_WRITEV,
+		IORING_OP_CLOSE,
+		IORING_OP_UNLINKAT
+	};
+	const unsigned int maxOps = 256;
+	size_t size = sizeof(struct io_uring_probe) + maxOps * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = (struct io_uring_probe *) calloc(1, size);
+	bool result = true;
+
+	if (probe == NULL) {
+		return false;
+	}
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, maxOps) == -1) {
+		free(probe);
+		return false;
+	}
+	for (unsigned int i = 0; i < sizeof(requiredOps) && result; i++) {
+		unsigned char op = requiredOps[i];
+		result = op <= probe->last_op
+			&& (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	}
+	free(probe);
+	return result;
+}
+
+static bool
+detectIoUringSupport() {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = ioUringSetup(4, &params);
+	if (fd == -1) {
+		return false;
+	}
+	bool result = ioUringSupportsAllOperations(fd);
+	::close(fd);
+	return result;
+}
+
+bool
+IoUring::isSupported() {
+	static const bool supported = detectIoUringSupport();
+	return supported;
+}
+
+IoUring::IoUring(unsigned int entries)
+	: fd(-1),
+	  sqRing(MAP_FAILED),
+	  sqRingSize(0),
+	  cqRing(MAP_FAILED),
+	  cqRingSize(0),
+	  sqes((struct io_uring_sqe *) MAP_FAILED),
+	  sqesSize(0),
+	  localSqTail(0),
+	  inFlight(0)
+{
+	struct io_uring_params params;
+	int e;
+
+	memset(&params, 0, sizeof(params));
+	fd = ioUringSetup(entries, &params);
+	if (fd == -1) {
+		e = errno;
+		throw SystemException("Cannot create an io_uring instance", e);
+	}
+	P_LOG_FILE_DESCRIPTOR_OPEN2(fd, "io_uring instance");
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	}
+
+	sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED) {
+		e = errno;
+		cleanup();
+		throw SystemException("Cannot map the io_uring submission ring", e);
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		cqRing = sqRing;
+	} else {
+		cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED) {
+			e = errno;
+			cleanup();
+			throw SystemException("Cannot map the io_uring completion ring", e);
+		}
+	}
+
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = (struct io_uring_sqe *) mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		e = errno;
+		cleanup();
+		throw SystemException("Cannot map the io_uring submission queue entries", e);
+	}
+
+	char *sq = (char *) sqRing;
+	char *cq = (char *) cqRing;
+	sqHead = (unsigned int *) (sq + params.sq_off.head);
+	sqTail = (unsigned int *) (sq + params.sq_off.tail);
+	sqFlags = (unsigned int *) (sq + params.sq_off.flags);
+	sqMask = *(unsigned int *) (sq + params.sq_off.ring_mask);
+	sqEntries = *(unsigned int *) (sq + params.sq_off.ring_entries);
+	cqHead = (unsigned int *) (cq + params.cq_off.head);
+	cqTail = (unsigned int *) (cq + params.cq_off.tail);
+	cqMask = *(unsigned int *) (cq + params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+	// SQEs are always used in ring order, so the indirection array
+	// is the identity mapping.
+	unsigned int *sqArray = (unsigned int *) (sq + params.sq_off.array);
+	for (unsigned int i = 0; i < sqEntries; i++) {
+		sqArray[i] = i;
+	}
+	localSqTail = *sqTail;
+}
+
+IoUring::~IoUring() {
+	drain();
+	cleanup();
+}
+
+void
+IoUring::cleanup() {
+	if (sqes != MAP_FAILED) {
+		munmap(sqes, sqesSize);
+	}
+	if (cqRing != MAP_FAILED && cqRing != sqRing) {
+		munmap(cqRing, cqRingSize);
+	}
+	if (sqRing != MAP_FAILED) {
+		munmap(sqRing, sqRingSize);
+	}
+	if (fd != -1) {
+		P_LOG_FILE_DESCRIPTOR_CLOSE(fd);
+		::close(fd);
+	}
+}
+
+int
+IoUring::enter(unsigned int toSubmit, unsigned int minComplete) {
+	unsigned int flags = (minComplete > 0) ? IORING_ENTER_GETEVENTS : 0;
+	int ret;
+
+	do {
+		ret = (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+			flags, NULL, 0);
+	} while (ret == -1 && errno == EINTR);
+	return (ret == -1) ? -errno : ret;
+}
+
+bool
+IoUring::hasPendingSubmissions() const {
+	return localSqTail != __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+}
+
+struct io_uring_sqe *
+IoUring::getSqe() {
+	if (localSqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+		submit();
+		if (localSqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+			return NULL;
+		}
+	}
+
+	struct io_uring_sqe *sqe = &sqes[localSqTail & sqMask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	localSqTail++;
+	return sqe;
+}
+
+void
+IoUring::prepareRequest(uv_fs_t *req, uv_fs_type type, uv_fs_cb cb) {
+	// Initialize the fields that uv_fs_req_cleanup() and our callers look
+	// at. The request type is deliberately not UV_FS, so that uv_cancel()
+	// rejects the request instead of touching libuv's work queue.
+	req->type = UV_UNKNOWN_REQ;
+	req->fs_type = type;
+	req->loop = NULL;
+	req->cb = cb;
+	req->result = 0;
+	req->ptr = NULL;
+	req->path = NULL;
+	req->new_path = NULL;
+	req->file = -1;
+}
+
+int
+IoUring::open(uv_fs_t *req, const char *path, int flags, int mode, uv_fs_cb cb) {
+	struct io_uring_sqe *sqe = getSqe();
+	if (sqe == NULL) {
+		return UV_EAGAIN;
+	}
+	prepareRequest(req, UV_FS_OPEN, cb);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (boost::uint64_t) (uintptr_t) path;
+	sqe->len = mode;
+	sqe->open_flags = flags | O_CLOEXEC;
+	sqe->user_data = (boost::uint64_t) (uintptr_t) req;
+	return 0;
+}
+
+int
+IoUring::read(uv_fs_t *req, uv_file file, const uv_buf_t bufs[],
+	unsigned int nbufs, boost::int64_t offset, uv_fs_cb cb)
+{
+	struct io_uring_sqe *sqe = getSqe();
+	if (sqe == NULL) {
+		return UV_EAGAIN;
+	}
+	prepareRequest(req, UV_FS_READ, cb);
+	req->file = file;
+	// uv_buf_t is layout-compatible with struct iovec on Unix.
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = file;
+	sqe->addr = (boost::uint64_t) (uintptr_t) bufs;
+	sqe->len = nbufs;
+	sqe->off = (boost::uint64_t) offset;
+	sqe->user_data = (boost::uint64_t) (uintptr_t) req;
+	return 0;
+}
+
+int
+IoUring::write(uv_fs_t *req, uv_file file, const uv_buf_t bufs[],
+	unsigned int nbufs, boost::int64_t offset, uv_fs_cb cb)
+{
+	struct io_uring_sqe *sqe = getSqe();
+	if (sqe == NULL) {
+		return UV_EAGAIN;
+	}
+	prepareRequest(req, UV_FS_WRITE, cb);
+	req->file = file;
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = file;
+	sqe->addr = (boost::uint64_t) (uintptr_t) bufs;
+	sqe->len = nbufs;
+	sqe->off = (boost::uint64_t) offset;
+	sqe->user_data = (boost::uint64_t) (uintptr_t) req;
+	return 0;
+}
+
+int
+IoUring::close(uv_fs_t *req, uv_file file, uv_fs_cb cb) {
+	struct io_uring_sqe *sqe = getSqe();
+	if (sqe == NULL) {
+		return UV_EAGAIN;
+	}
+	prepareRequest(req, UV_FS_CLOSE, cb);
+	req->file = file;
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = file;
+	sqe->user_data = (boost::uint64_t) (uintptr_t) req;
+	return 0;
+}
+
+int
+IoUring::unlink(uv_fs_t *req, const char *path, uv_fs_cb cb) {
+	struct io_uring_sqe *sqe = getSqe();
+	if (sqe == NULL) {
+		return UV_EAGAIN;
+	}
+	prepareRequest(req, UV_FS_UNLINK, cb);
+	sqe->opcode = IORING_OP_UNLINKAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (boost::uint64_t) (uintptr_t) path;
+	sqe->user_data = (boost::uint64_t) (uintptr_t) req;
+	return 0;
+}
+
+void
+IoUring::submit() {
+	unsigned int head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	if (localSqTail == head) {
+		return;
+	}
+
+	__atomic_store_n(sqTail, localSqTail, __ATOMIC_RELEASE);
+	int ret = enter(localSqTail - head, 0);
+	if (ret > 0) {
+		inFlight += ret;
+	} else if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+		// EAGAIN and EBUSY are transient; the entries stay queued
+		// and are submitted again by the next call.
+		P_ERROR("Cannot submit io_uring operations: " << strerror(-ret)
+			<< " (errno=" << -ret << ")");
+	}
+}
+
+unsigned int
+IoUring::processCompletions() {
+	unsigned int head = *cqHead;
+	unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+	unsigned int count = 0;
+
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &cqes[head & cqMask];
+		uv_fs_t *req = (uv_fs_t *) (uintptr_t) cqe->user_data;
+		int result = cqe->res;
+
+		// Release the entry before calling the callback, which
+		// may queue new operations.
+		head++;
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		inFlight--;
+		count++;
+
+		// libuv error codes are negated errno values on Unix,
+		// just like io_uring results.
+		req->result = result;
+		req->cb(req);
+
+		if (head == tail) {
+			tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+			if (head == tail
+			 && (__atomic_load_n(sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+			{
+				// Have the kernel move overflowed completions to the ring.
+				enter(0, 0);
+				tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+			}
+		}
+	}
+
+	return count;
+}
+
+void
+IoUring::drain() {
+	submit();
+	while (inFlight > 0 || hasPendingSubmissions()) {
+		if (processCompletions() == 0) {
+			int ret = enter(0, 1);
+			if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+				P_ERROR("Cannot wait for io_uring operations to complete: "
+					<< strerror(-ret) << " (errno=" << -ret << ")");
+				return;
+			}
+		}
+		submit();
+	}
+}
+
+#else /* HAVE_IO_URING */
+
+bool
+IoUring::isSupported() {
+	return false;
+}
+
+IoUring::IoUring(unsigned int entries)
+	: fd(-1),
+	  localSqTail(0),
+	  inFlight(0)
+{
+	throw RuntimeException("io_uring is not supported on this platform");
+}
+
+IoUring::~IoUring() { }
+
+void
+IoUring::cleanup() { }
+
+bool
+IoUring::hasPendingSubmissions() const {
+	return false;
+}
+
+int
+IoUring::open(uv_fs_t *req, const char *path, int flags, int mode, uv_fs_cb cb) {
+	return UV_ENOSYS;
+}
+
+int
+IoUring::read(uv_fs_t *req, uv_file file, const uv_buf_t bufs[],
+	unsigned int nbufs, boost::int64_t offset, uv_fs_cb cb)
+{
+	return UV_ENOSYS;
+}
+
+int
+IoUring::write(uv_fs_t *req, uv_file file, const uv_buf_t bufs[],
+	unsigned int nbufs, boost::int64_t offset, uv_fs_cb cb)
+{
+	return UV_ENOSYS;
+}
+
+int
+IoUring::close(uv_fs_t *req, uv_file file, uv_fs_cb cb) {
+	return UV_ENOSYS;
+}
+
+int
+IoUring::unlink(uv_fs_t *req, const char *path, uv_fs_cb cb) {
+	return UV_ENOSYS;
+}
+
+void
+IoUring::submit() { }
+
+unsigned int
+IoUring::processCompletions() {
+	return 0;
+}
+
+void
+IoUring::drain() { }
+
+#endif /* HAVE_IO_URING */
+
+
+} // namespace Passenger
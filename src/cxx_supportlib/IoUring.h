@@ -0,0 +1,150 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_IO_URING_H_
+#define _PASSENGER_IO_URING_H_
+
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>
+#include <uv.h>
+
+extern "C" {
+	struct io_uring_sqe;
+	struct io_uring_cqe;
+}
+
+namespace Passenger {
+
+
+/**
+ * A Linux io_uring instance that performs asynchronous filesystem I/O
+ * without a thread pool. It is a drop-in replacement for the subset of
+ * libuv's `uv_fs_*()` functions that FileBufferedChannel uses: the
+ * operations take an `uv_fs_t` and an `uv_fs_cb` and, upon completion,
+ * set `req->result` and call the callback just like libuv does.
+ *
+ * Operations are queued in the submission ring and are only handed to
+ * the kernel upon calling `submit()`, so that all operations started
+ * during one event loop iteration cost a single system call. Completions
+ * are processed by `processCompletions()`. `getFd()` becomes readable
+ * when there are completions, so it can be watched by an event loop;
+ * see BackgroundEventLoop.
+ *
+ * An IoUring object is not thread-safe: all methods must be called from
+ * the same thread, normally the event loop thread.
+ *
+ * Requests started through this class must not be passed to `uv_cancel()`
+ * or any other libuv function except for `uv_fs_req_cleanup()`.
+ */
+class IoUring: public boost::noncopyable {
+private:
+	int fd;
+	void *sqRing;
+	size_t sqRingSize;
+	void *cqRing;
+	size_t cqRingSize;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+
+	unsigned int *sqHead;
+	unsigned int *sqTail;
+	unsigned int *sqFlags;
+	unsigned int sqMask;
+	unsigned int sqEntries;
+	unsigned int *cqHead;
+	unsigned int *cqTail;
+	unsigned int cqMask;
+	struct io_uring_cqe *cqes;
+
+	/** Tail of the submission ring, including SQEs not yet submitted. */
+	unsigned int localSqTail;
+	/** Number of operations submitted to the kernel but not yet completed. */
+	unsigned int inFlight;
+
+	void cleanup();
+	struct io_uring_sqe *getSqe();
+	void prepareRequest(uv_fs_t *req, uv_fs_type type, uv_fs_cb cb);
+	int enter(unsigned int toSubmit, unsigned int minComplete);
+
+public:
+	/**
+	 * Returns whether the running kernel supports io_uring and all
+	 * operations that this class uses.
+	 */
+	static bool isSupported();
+
+	/**
+	 * @throws SystemException
+	 * @throws RuntimeException io_uring is not supported on this platform.
+	 */
+	IoUring(unsigned int entries = 256);
+	~IoUring();
+
+	int getFd() const {
+		return fd;
+	}
+
+	bool hasPendingSubmissions() const;
+
+	unsigned int getInFlight() const {
+		return inFlight;
+	}
+
+	/*
+	 * These methods have the same semantics as their `uv_fs_*()` counterparts.
+	 * They return 0 if the operation was queued, or a negative libuv error
+	 * code if it couldn't be, in which case the callback will not be called.
+	 */
+	int open(uv_fs_t *req, const char *path, int flags, int mode, uv_fs_cb cb);
+	int read(uv_fs_t *req, uv_file file, const uv_buf_t bufs[],
+		unsigned int nbufs, boost::int64_t offset, uv_fs_cb cb);
+	int write(uv_fs_t *req, uv_file file, const uv_buf_t bufs[],
+		unsigned int nbufs, boost::int64_t offset, uv_fs_cb cb);
+	int close(uv_fs_t *req, uv_file file, uv_fs_cb cb);
+	int unlink(uv_fs_t *req, const char *path, uv_fs_cb cb);
+
+	/**
+	 * Hands all queued operations to the kernel.
+	 */
+	void submit();
+
+	/**
+	 * Calls the callbacks of all completed operations. Returns the
+	 * number of completions processed.
+	 */
+	unsigned int processCompletions();
+
+	/**
+	 * Submits all queued operations and blocks until every operation
+	 * has completed, calling their callbacks.
+	 */
+	void drain();
+};
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_IO_URING_H_ */
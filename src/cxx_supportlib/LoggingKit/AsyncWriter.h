@@ -0,0 +1,185 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_LOGGING_KIT_ASYNC_WRITER_H_
+#define _PASSENGER_LOGGING_KIT_ASYNC_WRITER_H_
+
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <pthread.h>
+
+#include <oxt/thread.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <jsoncpp/json.h>
+#include <Constants.h>
+#include <StaticString.h>
+
+namespace Passenger {
+namespace LoggingKit {
+
+using namespace std;
+
+
+/**
+ * Writes log entries from a background thread, so that a thread that logs
+ * never blocks on a slow disk or a full log pipe.
+ *
+ * Every thread that logs gets its own ring buffer, which it appends entries
+ * to without taking any locks. The ring buffers are single-producer,
+ * single-consumer: the logging thread only moves the write position, the
+ * writer thread only moves the read position. The writer thread drains all
+ * ring buffers, writing consecutive entries for the same file descriptor
+ * with a single `writev()`.
+ *
+ * When a ring buffer is full, the overflow policy determines what happens:
+ * the entry is either dropped (and counted), or the logging thread waits
+ * until the writer thread has made room.
+ *
+ * Entries are written in order per thread, but entries from different
+ * threads may be written in a different order than they were logged in.
+ *
+ * After `fork()`, the child process has no writer thread, so entries logged
+ * by the child are written synchronously.
+ */
+class AsyncWriter: public boost::noncopyable {
+public:
+	enum OverflowPolicy {
+		DROP_ON_OVERFLOW,
+		BLOCK_ON_OVERFLOW,
+
+		UNKNOWN_OVERFLOW_POLICY
+	};
+
+private:
+	struct RecordHeader {
+		/** Size of the data that follows. */
+		boost::uint32_t size;
+		/** Target file descriptor, or -1 if this record is padding. */
+		boost::int32_t fd;
+	};
+
+	struct RingBuffer {
+		boost::uint64_t id;
+		char *data;
+		/** A power of two. */
+		boost::uint32_t capacity;
+		/**
+		 * Free-running positions; they are reduced modulo `capacity`
+		 * when accessing `data`, and are allowed to wrap around.
+		 */
+		boost::atomic<boost::uint32_t> readPos;
+		boost::atomic<boost::uint32_t> writePos;
+		/** Set when the thread that owns this buffer exits. */
+		boost::atomic<bool> abandoned;
+		AsyncWriter *writer;
+
+		RingBuffer(AsyncWriter *writer, boost::uint64_t id, boost::uint32_t capacity);
+		~RingBuffer();
+	};
+
+	pid_t pid;
+	pthread_key_t threadBufferKey;
+	oxt::thread *thread;
+
+	mutable boost::mutex syncher;
+	/** Signaled when there is work for the writer thread. */
+	boost::condition_variable wakeupCond;
+	/** Signaled by the writer thread after every pass over the buffers. */
+	boost::condition_variable drainedCond;
+	vector<RingBuffer *> buffers;
+	vector<RingBuffer *> buffersBeingDrained;
+	boost::uint64_t nextBufferId;
+	bool shuttingDown;
+	boost::atomic<bool> writerSleeping;
+
+	boost::atomic<boost::uint32_t> bufferSize;
+	boost::atomic<int> overflowPolicy;
+
+	boost::atomic<boost::uint64_t> entriesWritten;
+	boost::atomic<boost::uint64_t> entriesDropped;
+	boost::atomic<boost::uint64_t> entriesBlocked;
+	boost::atomic<boost::uint64_t> bytesWritten;
+	boost::atomic<boost::uint64_t> writeCalls;
+
+	static void onThreadExit(void *buffer);
+	static boost::uint32_t alignedRecordSize(unsigned int size);
+
+	RingBuffer *getThreadBuffer();
+	bool tryAppend(RingBuffer *buffer, int fd, const char *str, unsigned int size);
+	void appendBlocking(RingBuffer *buffer, int fd, const char *str, unsigned int size);
+	void wakeupWriter();
+	void threadMain();
+	bool hasQueuedEntries() const;
+	void removeAbandonedBuffers();
+	bool drain(RingBuffer *buffer);
+	void writeRecords(int fd, struct iovec *iov, unsigned int niov);
+
+public:
+	static const unsigned int MIN_BUFFER_SIZE = 1024 * 4;
+
+	AsyncWriter(unsigned int bufferSize = DEFAULT_ASYNC_LOGGING_BUFFER_SIZE,
+		OverflowPolicy overflowPolicy = DROP_ON_OVERFLOW);
+	~AsyncWriter();
+
+	/**
+	 * Queues a log entry for writing to `fd`. If the entry cannot be
+	 * queued, e.g. because it is larger than half the buffer size or
+	 * because we're in a forked child, then it is written synchronously.
+	 * Thread-safe.
+	 */
+	void write(int fd, const char *str, unsigned int size);
+
+	/**
+	 * Waits until all entries that have been queued so far are written.
+	 * Thread-safe.
+	 */
+	void flush();
+
+	/**
+	 * Changes the size of the ring buffers. Only affects threads that
+	 * haven't logged anything yet.
+	 */
+	void setBufferSize(unsigned int size);
+	void setOverflowPolicy(OverflowPolicy policy);
+
+	boost::uint64_t getEntriesDropped() const {
+		return entriesDropped.load(boost::memory_order_relaxed);
+	}
+
+	Json::Value inspectStateAsJson() const;
+
+	static OverflowPolicy parseOverflowPolicy(const StaticString &name);
+	static StaticString overflowPolicyToString(OverflowPolicy policy);
+};
+
+
+} // namespace LoggingKit
+} // namespace Passenger
+
+#endif /* _PASSENGER_LOGGING_KIT_ASYNC_WRITER_H_ */
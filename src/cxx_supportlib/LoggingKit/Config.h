@@ -34,6 +34,7 @@
 #include <vector>
 
 #include <LoggingKit/Forward.h>
+#include <LoggingKit/AsyncWriter.h>
 #include <ConfigKit/Schema.h>
 
 #include <jsoncpp/json.h>
@@ -49,11 +50,14 @@ using namespace std;
  * (do not edit: following text is automatically generated
  * by 'rake configkit_schemas_inline_comments')
  *
- *   app_output_log_level         string    -   default("notice")
- *   file_descriptor_log_target   any       -   -
- *   level                        string    -   default("notice")
- *   redirect_stderr              boolean   -   default(true)
- *   target                       any       -   default({"stderr": true})
+ *   app_output_log_level            string             -   default("notice")
+ *   async_logging                   boolean            -   default(false)
+ *   async_logging_buffer_size       unsigned integer   -   default(65536)
+ *   async_logging_overflow_policy   string             -   default("drop")
+ *   file_descriptor_log_target      any                -   -
+ *   level                           string             -   default("notice")
+ *   redirect_stderr                 boolean            -   default(true)
+ *   target                          any                -   default({"stderr": true})
  *
  * END
  */
@@ -64,6 +68,8 @@ private:
 		vector<ConfigKit::Error> &errors);
 	static void validateTarget(const string &key, const ConfigKit::Store &store,
 		vector<ConfigKit::Error> &errors);
+	static void validateAsyncLogging(const ConfigKit::Store &store,
+		vector<ConfigKit::Error> &errors);
 
 public:
 	Schema();
@@ -85,6 +91,16 @@ struct ConfigRealization {
 	int fileDescriptorLogTargetFd;
 	FdClosePolicy targetFdClosePolicy;
 	FdClosePolicy fileDescriptorLogTargetFdClosePolicy;
+
+	bool asyncLogging;
+	unsigned int asyncLoggingBufferSize;
+	AsyncWriter::OverflowPolicy asyncLoggingOverflowPolicy;
+	/**
+	 * Set by the Context if `asyncLogging` is enabled. Owned by the
+	 * Context, which keeps it alive for as long as it exists.
+	 */
+	AsyncWriter *asyncWriter;
+
 	bool finalized;
 
 	ConfigRealization(const ConfigKit::Store &store);
@@ -35,6 +35,7 @@
 #include <ConfigKit/ConfigKit.h>
 #include <LoggingKit/Forward.h>
 #include <LoggingKit/Config.h>
+#include <LoggingKit/AsyncWriter.h>
 #include <Utils/SystemTime.h>
 
 namespace Passenger {
@@ -71,6 +72,12 @@ private:
 	mutable boost::mutex syncher;
 	ConfigKit::Store config;
 	boost::atomic<ConfigRealization *> configRlz;
+	/**
+	 * Created when async logging is enabled for the first time. Stays
+	 * alive until the Context is destroyed, so that entries that were
+	 * queued before async logging was disabled are still written.
+	 */
+	AsyncWriter *asyncWriter;
 
 	mutable boost::mutex gcSyncher;
 	oxt::thread *gcThread;
@@ -90,6 +97,7 @@ public:
 	void commitConfigChange(LoggingKit::ConfigChangeRequest &req)
 		BOOST_NOEXCEPT_OR_NOTHROW;
 	Json::Value inspectConfig() const;
+	Json::Value inspectAsyncWriterState() const;
 
 	OXT_FORCE_INLINE
 	const ConfigRealization *getConfigRealization() const {
@@ -100,6 +108,7 @@ public:
 	void gcThreadMain();
 
 private:
+	void setupAsyncWriter(ConfigRealization *newConfigRlz);
 	pair<ConfigRealization*,MonotonicTimeUsec> peekOldConfig();
 	void popOldConfig(ConfigRealization *oldConfig);
 	bool oldConfigsExist();
@@ -50,6 +50,7 @@ namespace LoggingKit {
 class Schema;
 struct ConfigRealization;
 class Context;
+class AsyncWriter;
 
 enum Level {
 	CRIT   = 0,
@@ -75,12 +76,14 @@ extern Context *context;
 
 
 void shutdown();
+/** Waits until all log entries that have been queued for writing are written. */
+void flush();
 
 const char *_strdupFastStringStream(const FastStringStream<> &stream);
 bool _passesLogLevel(const Context *context, Level level, const ConfigRealization **outputConfigRlz);
 bool _shouldLogFileDescriptors(const Context *context, const ConfigRealization **outputConfigRlz);
 void _prepareLogEntry(FastStringStream<> &sstream, Level level, const char *file, unsigned int line);
-void _writeLogEntry(const ConfigRealization *configRlz, const char *str, unsigned int size);
+void _writeLogEntry(const ConfigRealization *configRlz, Level level, const char *str, unsigned int size);
 void _writeFileDescriptorLogEntry(const ConfigRealization *configRlz, const char *str, unsigned int size);
 
 Level getLevel();
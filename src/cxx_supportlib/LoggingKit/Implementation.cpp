@@ -34,7 +34,9 @@
 #include <cassert>
 #include <queue>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <utility>
 #include <unistd.h>
 #include <time.h>
@@ -52,6 +54,7 @@
 #include <LoggingKit/Assert.h>
 #include <LoggingKit/Config.h>
 #include <LoggingKit/Context.h>
+#include <LoggingKit/AsyncWriter.h>
 #include <ConfigKit/ConfigKit.h>
 #include <FileTools/PathManip.h>
 #include <Utils.h>
@@ -81,6 +84,16 @@ shutdown() {
 	context = NULL;
 }
 
+void
+flush() {
+	if (context != NULL) {
+		const ConfigRealization *configRlz = context->getConfigRealization();
+		if (configRlz->asyncWriter != NULL) {
+			configRlz->asyncWriter->flush();
+		}
+	}
+}
+
 Level getLevel() {
 	if (OXT_LIKELY(context != NULL)) {
 		return context->getConfigRealization()->level;
@@ -290,10 +303,31 @@ writeExactWithoutOXT(int fd, const char *str, unsigned int size) {
 	}
 }
 
+static void
+writeLogData(const ConfigRealization *configRealization, int fd,
+	const char *str, unsigned int size)
+{
+	if (configRealization != NULL && configRealization->asyncWriter != NULL) {
+		configRealization->asyncWriter->write(fd, str, size);
+	} else {
+		writeExactWithoutOXT(fd, str, size);
+	}
+}
+
 void
-_writeLogEntry(const ConfigRealization *configRealization, const char *str, unsigned int size) {
+_writeLogEntry(const ConfigRealization *configRealization, Level level,
+	const char *str, unsigned int size)
+{
 	if (OXT_LIKELY(configRealization != NULL)) {
-		writeExactWithoutOXT(configRealization->targetFd, str, size);
+		if (OXT_UNLIKELY(level == CRIT && configRealization->asyncWriter != NULL)) {
+			// Critical entries are usually followed by an abort, so
+			// make sure that they, and everything before them, end up
+			// in the log.
+			configRealization->asyncWriter->flush();
+			writeExactWithoutOXT(configRealization->targetFd, str, size);
+		} else {
+			writeLogData(configRealization, configRealization->targetFd, str, size);
+		}
 	} else {
 		writeExactWithoutOXT(STDERR_FILENO, str, size);
 	}
@@ -306,11 +340,13 @@ _writeFileDescriptorLogEntry(const ConfigRealization *configRealization,
 	assert(configRealization != NULL);
 	assert(configRealization->fileDescriptorLogTargetType != UNKNOWN_TARGET);
 	assert(configRealization->fileDescriptorLogTargetFd != -1);
-	writeExactWithoutOXT(configRealization->fileDescriptorLogTargetFd, str, size);
+	writeLogData(configRealization, configRealization->fileDescriptorLogTargetFd,
+		str, size);
 }
 
 static void
-realLogAppOutput(int targetFd, char *buf, unsigned int bufSize,
+realLogAppOutput(const ConfigRealization *configRealization, int targetFd,
+	char *buf, unsigned int bufSize,
 	const char *pidStr, unsigned int pidStrLen,
 	const char *channelName, unsigned int channelNameLen,
 	const char *message, unsigned int messageLen)
@@ -325,21 +361,23 @@ realLogAppOutput(int targetFd, char *buf, unsigned int bufSize,
 	pos = appendData(pos, end, ": ");
 	pos = appendData(pos, end, message, messageLen);
 	pos = appendData(pos, end, "\n");
-	writeExactWithoutOXT(targetFd, buf, pos - buf);
+	writeLogData(configRealization, targetFd, buf, pos - buf);
 }
 
 void
 logAppOutput(pid_t pid, const char *channelName, const char *message, unsigned int size) {
+	const ConfigRealization *configRealization;
 	int targetFd;
 
 	if (OXT_LIKELY(context != NULL)) {
-		const ConfigRealization *configRealization = context->getConfigRealization();
+		configRealization = context->getConfigRealization();
 		if (configRealization->level < configRealization->appOutputLogLevel) {
 			return;
 		}
 
 		targetFd = configRealization->targetFd;
 	} else {
+		configRealization = NULL;
 		targetFd = STDERR_FILENO;
 	}
 
@@ -358,14 +396,14 @@ logAppOutput(pid_t pid, const char *channelName, const char *message, unsigned i
 	totalLen = (sizeof("App X Y: \n") - 2) + pidStrLen + channelNameLen + size;
 	if (totalLen < 1024) {
 		char buf[1024];
-		realLogAppOutput(targetFd,
+		realLogAppOutput(configRealization, targetFd,
 			buf, sizeof(buf),
 			pidStr, pidStrLen,
 			channelName, channelNameLen,
 			message, size);
 	} else {
 		DynamicBuffer buf(totalLen);
-		realLogAppOutput(targetFd,
+		realLogAppOutput(configRealization, targetFd,
 			buf.data, totalLen,
 			pidStr, pidStrLen,
 			channelName, channelNameLen,
@@ -374,6 +412,449 @@ logAppOutput(pid_t pid, const char *channelName, const char *message, unsigned i
 }
 
 
+AsyncWriter::RingBuffer::RingBuffer(AsyncWriter *_writer, boost::uint64_t _id,
+	boost::uint32_t _capacity)
+	: id(_id),
+	  data((char *) malloc(_capacity)),
+	  capacity(_capacity),
+	  readPos(0),
+	  writePos(0),
+	  abandoned(false),
+	  writer(_writer)
+{
+	if (data == NULL) {
+		throw std::bad_alloc();
+	}
+}
+
+AsyncWriter::RingBuffer::~RingBuffer() {
+	free(data);
+}
+
+AsyncWriter::AsyncWriter(unsigned int _bufferSize, OverflowPolicy _overflowPolicy)
+	: pid(getpid()),
+	  thread(NULL),
+	  nextBufferId(1),
+	  shuttingDown(false),
+	  writerSleeping(false),
+	  bufferSize(0),
+	  overflowPolicy(_overflowPolicy),
+	  entriesWritten(0),
+	  entriesDropped(0),
+	  entriesBlocked(0),
+	  bytesWritten(0),
+	  writeCalls(0)
+{
+	int ret = pthread_key_create(&threadBufferKey, onThreadExit);
+	if (ret != 0) {
+		throw SystemException("Cannot create a thread-local storage key", ret);
+	}
+	setBufferSize(_bufferSize);
+	try {
+		thread = new oxt::thread(boost::bind(&AsyncWriter::threadMain, this),
+			"LoggingKit async writer thread",
+			128 * 1024);
+	} catch (...) {
+		pthread_key_delete(threadBufferKey);
+		throw;
+	}
+}
+
+AsyncWriter::~AsyncWriter() {
+	{
+		boost::lock_guard<boost::mutex> l(syncher);
+		shuttingDown = true;
+		wakeupCond.notify_one();
+		drainedCond.notify_all();
+	}
+	// The thread only exits once everything is written.
+	thread->join();
+	delete thread;
+
+	// Threads that still have a buffer won't have their
+	// exit handler called after this.
+	pthread_key_delete(threadBufferKey);
+
+	vector<RingBuffer *>::iterator it, end = buffers.end();
+	for (it = buffers.begin(); it != end; it++) {
+		delete *it;
+	}
+}
+
+void
+AsyncWriter::onThreadExit(void *_buffer) {
+	RingBuffer *buffer = static_cast<RingBuffer *>(_buffer);
+	AsyncWriter *self = buffer->writer;
+	buffer->abandoned.store(true, boost::memory_order_seq_cst);
+	self->wakeupWriter();
+}
+
+boost::uint32_t
+AsyncWriter::alignedRecordSize(unsigned int size) {
+	return sizeof(RecordHeader) + ((size + 7) & ~7u);
+}
+
+AsyncWriter::RingBuffer *
+AsyncWriter::getThreadBuffer() {
+	RingBuffer *buffer = static_cast<RingBuffer *>(pthread_getspecific(threadBufferKey));
+	if (OXT_UNLIKELY(buffer == NULL)) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		if (shuttingDown) {
+			return NULL;
+		}
+		buffer = new RingBuffer(this, nextBufferId++,
+			bufferSize.load(boost::memory_order_relaxed));
+		buffers.push_back(buffer);
+		pthread_setspecific(threadBufferKey, buffer);
+	}
+	return buffer;
+}
+
+bool
+AsyncWriter::tryAppend(RingBuffer *buffer, int fd, const char *str, unsigned int size) {
+	boost::uint32_t recordSize = alignedRecordSize(size);
+	boost::uint32_t writePos = buffer->writePos.load(boost::memory_order_relaxed);
+	boost::uint32_t readPos = buffer->readPos.load(boost::memory_order_acquire);
+	boost::uint32_t offset = writePos & (buffer->capacity - 1);
+	boost::uint32_t contiguous = buffer->capacity - offset;
+	boost::uint32_t needed;
+
+	// A record is never split over the end of the buffer. If it doesn't
+	// fit, we fill the end with a padding record and start over at the
+	// beginning.
+	if (recordSize <= contiguous) {
+		needed = recordSize;
+	} else {
+		needed = contiguous + recordSize;
+	}
+	if (buffer->capacity - (writePos - readPos) < needed) {
+		return false;
+	}
+
+	RecordHeader *header;
+	if (recordSize > contiguous) {
+		header = reinterpret_cast<RecordHeader *>(buffer->data + offset);
+		header->size = contiguous - sizeof(RecordHeader);
+		header->fd = -1;
+		writePos += contiguous;
+		offset = 0;
+	}
+	header = reinterpret_cast<RecordHeader *>(buffer->data + offset);
+	header->size = size;
+	header->fd = fd;
+	memcpy(header + 1, str, size);
+
+	// Sequentially consistent, so that wakeupWriter() can't observe
+	// a stale `writerSleeping`. See threadMain().
+	buffer->writePos.store(writePos + recordSize, boost::memory_order_seq_cst);
+	return true;
+}
+
+void
+AsyncWriter::appendBlocking(RingBuffer *buffer, int fd, const char *str, unsigned int size) {
+	boost::unique_lock<boost::mutex> l(syncher);
+	entriesBlocked.fetch_add(1, boost::memory_order_relaxed);
+	while (!tryAppend(buffer, fd, str, size)) {
+		if (shuttingDown) {
+			l.unlock();
+			writeExactWithoutOXT(fd, str, size);
+			return;
+		}
+		wakeupCond.notify_one();
+		drainedCond.timed_wait(l, boost::posix_time::milliseconds(100));
+	}
+	wakeupCond.notify_one();
+}
+
+void
+AsyncWriter::wakeupWriter() {
+	if (writerSleeping.load(boost::memory_order_seq_cst)) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		wakeupCond.notify_one();
+	}
+}
+
+void
+AsyncWriter::write(int fd, const char *str, unsigned int size) {
+	RingBuffer *buffer;
+
+	if (OXT_UNLIKELY(getpid() != pid)) {
+		// We're in a forked child, which doesn't have the writer thread.
+		writeExactWithoutOXT(fd, str, size);
+		return;
+	}
+
+	buffer = getThreadBuffer();
+	if (OXT_UNLIKELY(buffer == NULL)) {
+		writeExactWithoutOXT(fd, str, size);
+		return;
+	}
+
+	if (OXT_UNLIKELY(alignedRecordSize(size) > buffer->capacity / 2)) {
+		// Flush first so that this entry isn't written before the
+		// entries that were logged earlier.
+		flush();
+		writeExactWithoutOXT(fd, str, size);
+		return;
+	}
+
+	if (OXT_LIKELY(tryAppend(buffer, fd, str, size))) {
+		wakeupWriter();
+	} else if (overflowPolicy.load(boost::memory_order_relaxed) == BLOCK_ON_OVERFLOW) {
+		appendBlocking(buffer, fd, str, size);
+	} else {
+		entriesDropped.fetch_add(1, boost::memory_order_relaxed);
+		wakeupWriter();
+	}
+}
+
+void
+AsyncWriter::flush() {
+	vector< pair<boost::uint64_t, boost::uint32_t> > targets;
+	boost::unique_lock<boost::mutex> l(syncher);
+	vector<RingBuffer *>::const_iterator it, end = buffers.end();
+
+	if (getpid() != pid) {
+		return;
+	}
+
+	for (it = buffers.begin(); it != end; it++) {
+		targets.push_back(make_pair((*it)->id,
+			(*it)->writePos.load(boost::memory_order_acquire)));
+	}
+
+	while (!shuttingDown) {
+		bool done = true;
+
+		for (unsigned int i = 0; i < targets.size() && done; i++) {
+			for (it = buffers.begin(); it != end; it++) {
+				if ((*it)->id == targets[i].first) {
+					boost::uint32_t readPos = (*it)->readPos.load(boost::memory_order_acquire);
+					done = (boost::int32_t) (readPos - targets[i].second) >= 0;
+					break;
+				}
+			}
+		}
+
+		if (done) {
+			break;
+		}
+		wakeupCond.notify_one();
+		drainedCond.timed_wait(l, boost::posix_time::milliseconds(100));
+		end = buffers.end();
+	}
+}
+
+void
+AsyncWriter::setBufferSize(unsigned int size) {
+	boost::uint32_t capacity = MIN_BUFFER_SIZE;
+	while (capacity < size && capacity < 0x40000000u) {
+		capacity *= 2;
+	}
+	bufferSize.store(capacity, boost::memory_order_relaxed);
+}
+
+void
+AsyncWriter::setOverflowPolicy(OverflowPolicy policy) {
+	overflowPolicy.store(policy, boost::memory_order_relaxed);
+}
+
+void
+AsyncWriter::threadMain() {
+	boost::unique_lock<boost::mutex> l(syncher);
+
+	while (true) {
+		bool wroteSomething = false;
+
+		buffersBeingDrained = buffers;
+		l.unlock();
+		vector<RingBuffer *>::iterator it, end = buffersBeingDrained.end();
+		for (it = buffersBeingDrained.begin(); it != end; it++) {
+			wroteSomething = drain(*it) || wroteSomething;
+		}
+		l.lock();
+
+		removeAbandonedBuffers();
+		drainedCond.notify_all();
+
+		if (!wroteSomething) {
+			if (shuttingDown) {
+				break;
+			}
+			// Announce that we're going to sleep before checking the
+			// buffers one last time. Together with the sequentially
+			// consistent store in tryAppend(), this ensures that either
+			// we see the new entry, or the logging thread sees that it
+			// has to wake us up. The timeout is only a safety net.
+			writerSleeping.store(true, boost::memory_order_seq_cst);
+			if (!hasQueuedEntries()) {
+				wakeupCond.timed_wait(l, boost::posix_time::seconds(1));
+			}
+			writerSleeping.store(false, boost::memory_order_seq_cst);
+		}
+	}
+}
+
+bool
+AsyncWriter::hasQueuedEntries() const {
+	vector<RingBuffer *>::const_iterator it, end = buffers.end();
+	for (it = buffers.begin(); it != end; it++) {
+		if ((*it)->readPos.load(boost::memory_order_relaxed)
+			!= (*it)->writePos.load(boost::memory_order_seq_cst))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+AsyncWriter::removeAbandonedBuffers() {
+	vector<RingBuffer *>::iterator it = buffers.begin();
+	while (it != buffers.end()) {
+		RingBuffer *buffer = *it;
+		// The thread that owned the buffer has exited, so nothing
+		// can be appended anymore after we've seen `abandoned`.
+		if (buffer->abandoned.load(boost::memory_order_seq_cst)
+			&& buffer->readPos.load(boost::memory_order_relaxed)
+				== buffer->writePos.load(boost::memory_order_acquire))
+		{
+			delete buffer;
+			it = buffers.erase(it);
+		} else {
+			it++;
+		}
+	}
+}
+
+bool
+AsyncWriter::drain(RingBuffer *buffer) {
+	// Maximum number of records to write with a single writev().
+	const unsigned int MAX_IOVECS = IOV_MAX < 64 ? IOV_MAX : 64;
+	struct iovec iov[MAX_IOVECS];
+	unsigned int niov = 0;
+	int fd = -1;
+	boost::uint32_t readPos = buffer->readPos.load(boost::memory_order_relaxed);
+	boost::uint32_t writePos = buffer->writePos.load(boost::memory_order_acquire);
+
+	if (readPos == writePos) {
+		return false;
+	}
+
+	while (readPos != writePos) {
+		RecordHeader *header = reinterpret_cast<RecordHeader *>(
+			buffer->data + (readPos & (buffer->capacity - 1)));
+		if (header->fd != -1) {
+			if (niov > 0 && (header->fd != fd || niov == MAX_IOVECS)) {
+				writeRecords(fd, iov, niov);
+				niov = 0;
+				buffer->readPos.store(readPos, boost::memory_order_release);
+			}
+			fd = header->fd;
+			iov[niov].iov_base = header + 1;
+			iov[niov].iov_len = header->size;
+			niov++;
+		}
+		readPos += alignedRecordSize(header->size);
+	}
+	if (niov > 0) {
+		writeRecords(fd, iov, niov);
+	}
+	buffer->readPos.store(readPos, boost::memory_order_release);
+	return true;
+}
+
+void
+AsyncWriter::writeRecords(int fd, struct iovec *iov, unsigned int niov) {
+	size_t total = 0;
+	size_t written = 0;
+	unsigned int i;
+
+	for (i = 0; i < niov; i++) {
+		total += iov[i].iov_len;
+	}
+
+	// Like writeExactWithoutOXT(), ignore write errors.
+	while (written < total) {
+		ssize_t ret;
+		do {
+			ret = writev(fd, iov, niov);
+		} while (ret == -1 && errno == EINTR);
+		writeCalls.fetch_add(1, boost::memory_order_relaxed);
+		if (ret == -1) {
+			break;
+		}
+
+		written += ret;
+		// Skip over the iovecs that have been written completely.
+		while (niov > 0 && (size_t) ret >= iov[0].iov_len) {
+			ret -= iov[0].iov_len;
+			iov++;
+			niov--;
+		}
+		if (niov > 0) {
+			iov[0].iov_base = (char *) iov[0].iov_base + ret;
+			iov[0].iov_len -= ret;
+		}
+	}
+
+	entriesWritten.fetch_add(i, boost::memory_order_relaxed);
+	bytesWritten.fetch_add(written, boost::memory_order_relaxed);
+}
+
+Json::Value
+AsyncWriter::inspectStateAsJson() const {
+	Json::Value doc;
+	boost::uint64_t bytesBuffered = 0;
+	unsigned int threads;
+
+	{
+		boost::lock_guard<boost::mutex> l(syncher);
+		vector<RingBuffer *>::const_iterator it, end = buffers.end();
+		for (it = buffers.begin(); it != end; it++) {
+			bytesBuffered += (*it)->writePos.load(boost::memory_order_relaxed)
+				- (*it)->readPos.load(boost::memory_order_relaxed);
+		}
+		threads = buffers.size();
+	}
+
+	doc["buffer_size"] = bufferSize.load(boost::memory_order_relaxed);
+	doc["overflow_policy"] = overflowPolicyToString(
+		(OverflowPolicy) overflowPolicy.load(boost::memory_order_relaxed)).toString();
+	doc["threads"] = threads;
+	doc["bytes_buffered"] = (Json::UInt64) bytesBuffered;
+	doc["entries_written"] = (Json::UInt64) entriesWritten.load(boost::memory_order_relaxed);
+	doc["entries_dropped"] = (Json::UInt64) entriesDropped.load(boost::memory_order_relaxed);
+	doc["entries_blocked"] = (Json::UInt64) entriesBlocked.load(boost::memory_order_relaxed);
+	doc["bytes_written"] = (Json::UInt64) bytesWritten.load(boost::memory_order_relaxed);
+	doc["write_calls"] = (Json::UInt64) writeCalls.load(boost::memory_order_relaxed);
+	return doc;
+}
+
+AsyncWriter::OverflowPolicy
+AsyncWriter::parseOverflowPolicy(const StaticString &name) {
+	if (name == "drop") {
+		return DROP_ON_OVERFLOW;
+	} else if (name == "block") {
+		return BLOCK_ON_OVERFLOW;
+	} else {
+		return UNKNOWN_OVERFLOW_POLICY;
+	}
+}
+
+StaticString
+AsyncWriter::overflowPolicyToString(OverflowPolicy policy) {
+	switch (policy) {
+	case DROP_ON_OVERFLOW:
+		return P_STATIC_STRING("drop");
+	case BLOCK_ON_OVERFLOW:
+		return P_STATIC_STRING("block");
+	default:
+		return P_STATIC_STRING("unknown");
+	}
+}
+
+
 static Json::Value
 normalizeConfig(const Json::Value &effectiveValues) {
 	Json::Value updates(Json::objectValue);
@@ -408,15 +889,25 @@ normalizeConfig(const Json::Value &effectiveValues) {
 Context::Context(const Json::Value &initialConfig,
 	const ConfigKit::Translator &translator)
 	: config(schema, initialConfig, translator),
+	  asyncWriter(NULL),
 	  gcThread(NULL),
 	  shuttingDown(false)
 {
 	configRlz.store(new ConfigRealization(config));
+	setupAsyncWriter(configRlz.load());
 	configRlz.load()->apply(config, NULL);
 	configRlz.load()->finalize();
 }
 
 Context::~Context() {
+	if (asyncWriter != NULL) {
+		// Log entries from now on are written synchronously.
+		// Deleting the writer writes out everything that's queued.
+		configRlz.load()->asyncWriter = NULL;
+		delete asyncWriter;
+		asyncWriter = NULL;
+	}
+
 	boost::unique_lock<boost::mutex> l(gcSyncher);
 
 	// If a gc thread exists, tell it to shut down and
@@ -461,6 +952,7 @@ Context::commitConfigChange(LoggingKit::ConfigChangeRequest &req) BOOST_NOEXCEPT
 	ConfigRealization *oldConfigRlz = configRlz.load();
 	ConfigRealization *newConfigRlz = req.configRlz;
 
+	setupAsyncWriter(newConfigRlz);
 	req.configRlz->apply(*req.config, oldConfigRlz);
 
 	config.swap(*req.config);
@@ -477,6 +969,46 @@ Context::inspectConfig() const {
 	return config.inspect();
 }
 
+Json::Value
+Context::inspectAsyncWriterState() const {
+	Json::Value doc;
+	boost::lock_guard<boost::mutex> l(syncher);
+
+	doc["enabled"] = configRlz.load()->asyncWriter != NULL;
+	if (asyncWriter != NULL) {
+		Json::Value state = asyncWriter->inspectStateAsJson();
+		Json::Value::iterator it, end = state.end();
+		for (it = state.begin(); it != end; it++) {
+			doc[it.name()] = *it;
+		}
+	}
+	return doc;
+}
+
+void
+Context::setupAsyncWriter(ConfigRealization *newConfigRlz) {
+	if (!newConfigRlz->asyncLogging) {
+		newConfigRlz->asyncWriter = NULL;
+		return;
+	}
+
+	if (asyncWriter == NULL) {
+		try {
+			asyncWriter = new AsyncWriter(newConfigRlz->asyncLoggingBufferSize,
+				newConfigRlz->asyncLoggingOverflowPolicy);
+		} catch (const std::exception &e) {
+			P_ERROR("Error spawning background thread for asynchronous logging,"
+				" logging synchronously instead: " << e.what());
+			newConfigRlz->asyncWriter = NULL;
+			return;
+		}
+	} else {
+		asyncWriter->setBufferSize(newConfigRlz->asyncLoggingBufferSize);
+		asyncWriter->setOverflowPolicy(newConfigRlz->asyncLoggingOverflowPolicy);
+	}
+	newConfigRlz->asyncWriter = asyncWriter;
+}
+
 pair<ConfigRealization*,MonotonicTimeUsec>
 Context::peekOldConfig() {
 	return oldConfigs.front();
@@ -645,6 +1177,24 @@ Schema::validateTarget(const string &key, const ConfigKit::Store &store,
 	}
 }
 
+void
+Schema::validateAsyncLogging(const ConfigKit::Store &store,
+	vector<ConfigKit::Error> &errors)
+{
+	typedef ConfigKit::Error Error;
+
+	if (AsyncWriter::parseOverflowPolicy(store["async_logging_overflow_policy"].asString())
+		== AsyncWriter::UNKNOWN_OVERFLOW_POLICY)
+	{
+		errors.push_back(Error("'{{async_logging_overflow_policy}}' must be"
+			" either 'drop' or 'block'"));
+	}
+	if (store["async_logging_buffer_size"].asUInt() < AsyncWriter::MIN_BUFFER_SIZE) {
+		errors.push_back(Error("'{{async_logging_buffer_size}}' must be at least "
+			+ toString(AsyncWriter::MIN_BUFFER_SIZE)));
+	}
+}
+
 static Json::Value
 filterTargetFd(const Json::Value &value) {
 	Json::Value result = value;
@@ -662,6 +1212,9 @@ Schema::Schema() {
 		.setInspectFilter(filterTargetFd);
 	add("redirect_stderr", BOOL_TYPE, OPTIONAL, true);
 	add("app_output_log_level", STRING_TYPE, OPTIONAL, DEFAULT_APP_OUTPUT_LOG_LEVEL_NAME);
+	add("async_logging", BOOL_TYPE, OPTIONAL, false);
+	add("async_logging_buffer_size", UINT_TYPE, OPTIONAL, DEFAULT_ASYNC_LOGGING_BUFFER_SIZE);
+	add("async_logging_overflow_policy", STRING_TYPE, OPTIONAL, "drop");
 
 	addValidator(boost::bind(validateLogLevel, "level",
 		boost::placeholders::_1, boost::placeholders::_2));
@@ -671,6 +1224,7 @@ Schema::Schema() {
 		boost::placeholders::_1, boost::placeholders::_2));
 	addValidator(boost::bind(validateTarget, "file_descriptor_log_target",
 		boost::placeholders::_1, boost::placeholders::_2));
+	addValidator(validateAsyncLogging);
 
 	addNormalizer(normalizeConfig);
 
@@ -681,6 +1235,11 @@ Schema::Schema() {
 ConfigRealization::ConfigRealization(const ConfigKit::Store &store)
 	: level(parseLevel(store["level"].asString())),
 	  appOutputLogLevel(parseLevel(store["app_output_log_level"].asString())),
+	  asyncLogging(store["async_logging"].asBool()),
+	  asyncLoggingBufferSize(store["async_logging_buffer_size"].asUInt()),
+	  asyncLoggingOverflowPolicy(AsyncWriter::parseOverflowPolicy(
+		store["async_logging_overflow_policy"].asString())),
+	  asyncWriter(NULL),
 	  finalized(false)
 {
 	if (store["target"].isMember("stderr")) {
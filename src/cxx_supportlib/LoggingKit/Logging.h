@@ -46,7 +46,7 @@ namespace LoggingKit {
 			Passenger::FastStringStream<> _ostream; \
 			Passenger::LoggingKit::_prepareLogEntry(_ostream, (level), (file), (line)); \
 			_ostream << expr << "\n"; \
-			Passenger::LoggingKit::_writeLogEntry(_configRlz, _ostream.data(), _ostream.size()); \
+			Passenger::LoggingKit::_writeLogEntry(_configRlz, (level), _ostream.data(), _ostream.size()); \
 		} \
 	} while (false)
 
@@ -57,7 +57,7 @@ namespace LoggingKit {
 			Passenger::FastStringStream<> _ostream; \
 			Passenger::LoggingKit::_prepareLogEntry(_ostream, (level), (file), (line)); \
 			_ostream << expr << "\n"; \
-			Passenger::LoggingKit::_writeLogEntry(_configRlz, _ostream.data(), _ostream.size()); \
+			Passenger::LoggingKit::_writeLogEntry(_configRlz, (level), _ostream.data(), _ostream.size()); \
 		} \
 	} while (false)
 
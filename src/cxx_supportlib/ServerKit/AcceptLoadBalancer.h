@@ -28,6 +28,8 @@
 
 #include <boost/bind.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
 #include <oxt/thread.hpp>
 #include <oxt/macros.hpp>
 #include <vector>
@@ -41,7 +43,9 @@
 #include <arpa/inet.h>
 #include <poll.h>
 
+#include <jsoncpp/json.h>
 #include <Constants.h>
+#include <StaticString.h>
 #include <LoggingKit/LoggingKit.h>
 #include <Utils.h>
 #include <Utils/IOUtils.h>
@@ -53,9 +57,43 @@ using namespace std;
 using namespace boost;
 
 
+enum AcceptLoadBalancingStrategy {
+	/** Hand clients to servers in turn. */
+	ALB_ROUND_ROBIN,
+	/** Hand clients to the server with the fewest active clients. */
+	ALB_LEAST_ACTIVE_CLIENTS,
+
+	ALB_UNKNOWN
+};
+
+inline AcceptLoadBalancingStrategy
+parseAcceptLoadBalancingStrategy(const StaticString &strategy) {
+	if (strategy == "round_robin") {
+		return ALB_ROUND_ROBIN;
+	} else if (strategy == "least_active_clients") {
+		return ALB_LEAST_ACTIVE_CLIENTS;
+	} else {
+		return ALB_UNKNOWN;
+	}
+}
+
+inline const char *
+getAcceptLoadBalancingStrategyString(AcceptLoadBalancingStrategy strategy) {
+	switch (strategy) {
+	case ALB_ROUND_ROBIN:
+		return "round_robin";
+	case ALB_LEAST_ACTIVE_CLIENTS:
+		return "least_active_clients";
+	default:
+		return "unknown";
+	}
+}
+
+
 /**
  * Listens for client connections and load balances them to multiple
- * Server objects in a round-robin manner.
+ * Server objects, either in a round-robin manner or by picking the
+ * Server with the fewest active clients.
  *
  * Normally, the Server class listens for client connections directly.
  * But this is inefficient in multithreaded situations where you are
@@ -75,6 +113,13 @@ using namespace boost;
  * accepts are distributed to all registered Server objects, in a
  * round-robin manner.
  *
+ * Round-robin does not take into account how busy each Server is. A few
+ * long-lived clients, such as WebSockets or slow uploads, can pile up on
+ * one Server while the others are idle. With the ALB_LEAST_ACTIVE_CLIENTS
+ * strategy, every client is handed to the Server with the lowest number
+ * of active clients plus clients that have been handed to it but that it
+ * hasn't picked up yet. Ties are broken in a round-robin manner.
+ *
  * Inside the "PassengerAgent core", we activate AcceptLoadBalancer
  * only if `core_threads > 1`, which is often the case because
  * `core_threads` defaults to the number of CPU cores.
@@ -84,6 +129,18 @@ class AcceptLoadBalancer {
 private:
 	static const unsigned int ACCEPT_BURST_COUNT = 16;
 
+	struct ServerState {
+		// Number of clients handed to the server, but that
+		// the server hasn't picked up yet.
+		boost::atomic<unsigned int> pendingClientCount;
+		boost::atomic<unsigned long long> totalClientsDistributed;
+
+		ServerState()
+			: pendingClientCount(0),
+			  totalClientsDistributed(0)
+			{ }
+	};
+
 	int endpoints[SERVER_KIT_MAX_SERVER_ENDPOINTS];
 	struct pollfd pollers[1 + SERVER_KIT_MAX_SERVER_ENDPOINTS];
 	int newClients[ACCEPT_BURST_COUNT];
@@ -96,6 +153,7 @@ private:
 
 	int exitPipe[2];
 	oxt::thread *thread;
+	boost::scoped_array<ServerState> serverStates;
 
 	void pollAllEndpoints() {
 		pollers[0].fd = exitPipe[0];
@@ -155,23 +213,57 @@ private:
 		}
 	}
 
-	void distributeNewClients() {
+	unsigned int getServerLoad(unsigned int i) const {
+		return servers[i]->getActiveClientCountFromAnyThread()
+			+ serverStates[i].pendingClientCount.load(boost::memory_order_relaxed);
+	}
+
+	unsigned int selectLeastLoadedServer() const {
+		unsigned int result = nextServer;
+		unsigned int resultLoad = getServerLoad(result);
 		unsigned int i;
 
+		for (i = 1; i < servers.size() && resultLoad > 0; i++) {
+			unsigned int candidate = (nextServer + i) % servers.size();
+			unsigned int load = getServerLoad(candidate);
+			if (load < resultLoad) {
+				result = candidate;
+				resultLoad = load;
+			}
+		}
+
+		return result;
+	}
+
+	void distributeNewClients() {
+		unsigned int i, server;
+
 		for (i = 0; i < newClientCount; i++) {
-			ServerKit::Context *ctx = servers[nextServer]->getContext();
-			P_TRACE(2, "Feeding client to server thread " << (int) nextServer <<
+			if (strategy == ALB_LEAST_ACTIVE_CLIENTS) {
+				server = selectLeastLoadedServer();
+			} else {
+				server = nextServer;
+			}
+
+			ServerKit::Context *ctx = servers[server]->getContext();
+			P_TRACE(2, "Feeding client to server thread " << server <<
 				": file descriptor " << newClients[i]);
-			ctx->libev->runLater(boost::bind(feedNewClient, servers[nextServer],
-				newClients[i]));
-			nextServer = (nextServer + 1) % servers.size();
+			serverStates[server].pendingClientCount.fetch_add(1,
+				boost::memory_order_relaxed);
+			serverStates[server].totalClientsDistributed.fetch_add(1,
+				boost::memory_order_relaxed);
+			ctx->libev->runLater(boost::bind(&AcceptLoadBalancer<Server>::feedNewClient,
+				this, server, newClients[i]));
+			nextServer = (server + 1) % servers.size();
 		}
 
 		newClientCount = 0;
 	}
 
-	static void feedNewClient(Server *server, int fd) {
-		server->feedNewClients(&fd, 1);
+	void feedNewClient(unsigned int server, int fd) {
+		servers[server]->feedNewClients(&fd, 1);
+		serverStates[server].pendingClientCount.fetch_sub(1,
+			boost::memory_order_relaxed);
 	}
 
 	int acceptNonBlockingSocket(int serverFd) {
@@ -244,6 +336,7 @@ private:
 
 public:
 	vector<Server *> servers;
+	AcceptLoadBalancingStrategy strategy;
 
 	AcceptLoadBalancer()
 		: nEndpoints(0),
@@ -251,7 +344,8 @@ public:
 		  nextServer(0),
 		  accept4Available(true),
 		  quit(false),
-		  thread(NULL)
+		  thread(NULL),
+		  strategy(ALB_ROUND_ROBIN)
 	{
 		if (pipe(exitPipe) == -1) {
 			int e = errno;
@@ -301,6 +395,7 @@ public:
 	}
 
 	void start() {
+		serverStates.reset(new ServerState[servers.size()]);
 		boost::function<void ()> func = boost::bind(&AcceptLoadBalancer<Server>::mainLoop, this);
 		thread = new oxt::thread(boost::bind(runAndPrintExceptions, func, true),
 			"Load balancer");
@@ -320,6 +415,30 @@ public:
 			thread = NULL;
 		}
 	}
+
+	/**
+	 * May be called from any thread after start().
+	 */
+	Json::Value inspectStateAsJson() const {
+		Json::Value doc;
+
+		doc["strategy"] = getAcceptLoadBalancingStrategyString(strategy);
+		doc["threads"] = Json::Value(Json::objectValue);
+		if (serverStates.get() == NULL) {
+			return doc;
+		}
+		for (unsigned int i = 0; i < servers.size(); i++) {
+			Json::Value subdoc;
+			subdoc["active_client_count"] = servers[i]->getActiveClientCountFromAnyThread();
+			subdoc["pending_client_count"] = serverStates[i].pendingClientCount.load(
+				boost::memory_order_relaxed);
+			subdoc["total_clients_distributed"] = (Json::UInt64)
+				serverStates[i].totalClientsDistributed.load(boost::memory_order_relaxed);
+			doc["threads"]["thread" + toString(i + 1)] = subdoc;
+		}
+
+		return doc;
+	}
 };
 
 
@@ -0,0 +1,134 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_SERVER_KIT_BYTE_RANGE_H_
+#define _PASSENGER_SERVER_KIT_BYTE_RANGE_H_
+
+#include <boost/cstdint.hpp>
+#include <strings.h>
+#include <StaticString.h>
+
+namespace Passenger {
+namespace ServerKit {
+
+
+enum ByteRangeResult {
+	/** There is no usable range; serve the full representation. */
+	BR_IGNORE,
+	/** `begin` and `length` describe the part to serve with a 206. */
+	BR_SATISFIABLE,
+	/** The range lies beyond the end of the representation; respond with a 416. */
+	BR_UNSATISFIABLE
+};
+
+
+inline const char *
+parseByteRangePosition(const char *pos, const char *end, boost::uint64_t &result,
+	bool &present)
+{
+	unsigned int digits = 0;
+
+	result = 0;
+	while (pos < end && *pos >= '0' && *pos <= '9') {
+		if (digits == 18) {
+			// Larger than any file that we can serve. Pretend that it's
+			// "infinite", which is still meaningful for the range end.
+			result = (boost::uint64_t) -1;
+		} else {
+			result = result * 10 + (*pos - '0');
+			digits++;
+		}
+		pos++;
+	}
+	present = digits > 0;
+	return pos;
+}
+
+/**
+ * Parses the value of a Range request header (RFC 7233) for a representation
+ * of `size` bytes. Only a single byte range is supported. Multiple ranges and
+ * malformed values yield BR_IGNORE, in which case the full representation
+ * should be served, which the RFC allows.
+ */
+inline ByteRangeResult
+parseByteRange(const StaticString &value, boost::uint64_t size,
+	boost::uint64_t &begin, boost::uint64_t &length)
+{
+	const char *pos = value.data();
+	const char *end = pos + value.size();
+	boost::uint64_t first, last;
+	bool hasFirst, hasLast;
+
+	while (pos < end && (*pos == ' ' || *pos == '\t')) {
+		pos++;
+	}
+	while (end > pos && (end[-1] == ' ' || end[-1] == '\t')) {
+		end--;
+	}
+	if (end - pos < 6 || strncasecmp(pos, "bytes=", 6) != 0) {
+		return BR_IGNORE;
+	}
+	pos += 6;
+	while (pos < end && (*pos == ' ' || *pos == '\t')) {
+		pos++;
+	}
+
+	pos = parseByteRangePosition(pos, end, first, hasFirst);
+	if (pos == end || *pos != '-') {
+		return BR_IGNORE;
+	}
+	pos = parseByteRangePosition(pos + 1, end, last, hasLast);
+	if (pos != end || (!hasFirst && !hasLast)) {
+		return BR_IGNORE;
+	}
+
+	if (!hasFirst) {
+		// Suffix range: the last `last` bytes.
+		if (last == 0 || size == 0) {
+			return BR_UNSATISFIABLE;
+		}
+		length = (last < size) ? last : size;
+		begin = size - length;
+		return BR_SATISFIABLE;
+	}
+	if (hasLast && last < first) {
+		return BR_IGNORE;
+	}
+	if (first >= size) {
+		return BR_UNSATISFIABLE;
+	}
+	if (!hasLast || last >= size) {
+		last = size - 1;
+	}
+	begin = first;
+	length = last - first + 1;
+	return BR_SATISFIABLE;
+}
+
+
+} // namespace ServerKit
+} // namespace Passenger
+
+#endif /* _PASSENGER_SERVER_KIT_BYTE_RANGE_H_ */
@@ -0,0 +1,213 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_SERVER_KIT_CONTENT_CODING_H_
+#define _PASSENGER_SERVER_KIT_CONTENT_CODING_H_
+
+#include <strings.h>
+#include <cstring>
+#include <StaticString.h>
+
+namespace Passenger {
+namespace ServerKit {
+
+
+/** The content codings that we can apply to response bodies ourselves. */
+enum ContentCoding {
+	CC_IDENTITY,
+	CC_GZIP,
+	CC_DEFLATE
+};
+
+
+inline StaticString
+getContentCodingName(ContentCoding coding) {
+	switch (coding) {
+	case CC_GZIP:
+		return P_STATIC_STRING("gzip");
+	case CC_DEFLATE:
+		return P_STATIC_STRING("deflate");
+	default:
+		return P_STATIC_STRING("identity");
+	}
+}
+
+inline bool
+contentCodingTokenEquals(const char *pos, const char *end, const char *token) {
+	size_t len = strlen(token);
+	return (size_t) (end - pos) == len && strncasecmp(pos, token, len) == 0;
+}
+
+inline const char *
+skipContentCodingWhitespace(const char *pos, const char *end) {
+	while (pos < end && (*pos == ' ' || *pos == '\t')) {
+		pos++;
+	}
+	return pos;
+}
+
+/**
+ * Parses a qvalue (RFC 7231 section 5.3.1) into thousandths. Malformed
+ * qvalues are treated as 1, like most user agents and servers do.
+ */
+inline unsigned int
+parseContentCodingQValue(const char *pos, const char *end) {
+	unsigned int result, scale = 100;
+
+	if (pos == end || (*pos != '0' && *pos != '1')) {
+		return 1000;
+	}
+	result = (*pos - '0') * 1000;
+	pos++;
+	if (pos < end && *pos == '.') {
+		pos++;
+		while (pos < end && *pos >= '0' && *pos <= '9' && scale > 0) {
+			result += (*pos - '0') * scale;
+			scale /= 10;
+			pos++;
+		}
+	}
+	return (result > 1000) ? 1000 : result;
+}
+
+/**
+ * Given the value of an Accept-Encoding request header, returns the
+ * content coding that the response body should be compressed with.
+ * gzip is preferred over deflate when the client accepts both equally,
+ * and codings with a qvalue of 0 are never chosen.
+ *
+ * If `onlyKnownCodings` is not NULL, it is set to whether the header
+ * mentions nothing but codings that ContentCoding knows about. Two such
+ * headers that negotiate the same coding are interchangeable as far as
+ * our own compression is concerned.
+ */
+inline ContentCoding
+negotiateContentCoding(const StaticString &acceptEncoding, bool *onlyKnownCodings = NULL) {
+	const char *pos = acceptEncoding.data();
+	const char *end = pos + acceptEncoding.size();
+	int gzipQ = -1, deflateQ = -1, anyQ = -1;
+	bool known = true;
+
+	while (pos < end) {
+		const char *elemEnd = (const char *) memchr(pos, ',', end - pos);
+		if (elemEnd == NULL) {
+			elemEnd = end;
+		}
+
+		const char *tokenBegin = skipContentCodingWhitespace(pos, elemEnd);
+		const char *tokenEnd = tokenBegin;
+		while (tokenEnd < elemEnd && *tokenEnd != ';' && *tokenEnd != ' '
+			&& *tokenEnd != '\t')
+		{
+			tokenEnd++;
+		}
+
+		unsigned int q = 1000;
+		const char *param = (const char *) memchr(tokenEnd, ';', elemEnd - tokenEnd);
+		while (param != NULL) {
+			param = skipContentCodingWhitespace(param + 1, elemEnd);
+			const char *paramEnd = (const char *) memchr(param, ';', elemEnd - param);
+			if (elemEnd - param >= 2 && (param[0] == 'q' || param[0] == 'Q')
+			 && param[1] == '=')
+			{
+				q = parseContentCodingQValue(param + 2,
+					(paramEnd == NULL) ? elemEnd : paramEnd);
+			}
+			param = paramEnd;
+		}
+
+		if (tokenBegin == tokenEnd) {
+			// Empty element, e.g. trailing comma.
+		} else if (contentCodingTokenEquals(tokenBegin, tokenEnd, "gzip")
+		 || contentCodingTokenEquals(tokenBegin, tokenEnd, "x-gzip"))
+		{
+			gzipQ = q;
+		} else if (contentCodingTokenEquals(tokenBegin, tokenEnd, "deflate")) {
+			deflateQ = q;
+		} else if (contentCodingTokenEquals(tokenBegin, tokenEnd, "*")) {
+			anyQ = q;
+		} else if (!contentCodingTokenEquals(tokenBegin, tokenEnd, "identity")) {
+			known = false;
+		}
+
+		pos = elemEnd + 1;
+	}
+
+	if (onlyKnownCodings != NULL) {
+		*onlyKnownCodings = known;
+	}
+	if (gzipQ == -1) {
+		gzipQ = (anyQ == -1) ? 0 : anyQ;
+	}
+	if (deflateQ == -1) {
+		deflateQ = (anyQ == -1) ? 0 : anyQ;
+	}
+	if (gzipQ > 0 && gzipQ >= deflateQ) {
+		return CC_GZIP;
+	} else if (deflateQ > 0) {
+		return CC_DEFLATE;
+	} else {
+		return CC_IDENTITY;
+	}
+}
+
+/**
+ * Returns whether a response with the given Content-Type header value
+ * is worth compressing: textual formats, excluding event streams, which
+ * must reach the client without being held back by the compressor.
+ */
+inline bool
+isCompressibleContentType(const StaticString &contentType) {
+	const char *begin = skipContentCodingWhitespace(contentType.data(),
+		contentType.data() + contentType.size());
+	const char *end = (const char *) memchr(begin, ';',
+		contentType.data() + contentType.size() - begin);
+	if (end == NULL) {
+		end = contentType.data() + contentType.size();
+	}
+	while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {
+		end--;
+	}
+
+	size_t len = end - begin;
+	if (len > 5 && strncasecmp(begin, "text/", 5) == 0) {
+		return !contentCodingTokenEquals(begin, end, "text/event-stream");
+	}
+	if ((len > 5 && strncasecmp(end - 5, "+json", 5) == 0)
+	 || (len > 4 && strncasecmp(end - 4, "+xml", 4) == 0))
+	{
+		return true;
+	}
+	return contentCodingTokenEquals(begin, end, "application/json")
+		|| contentCodingTokenEquals(begin, end, "application/javascript")
+		|| contentCodingTokenEquals(begin, end, "application/x-javascript")
+		|| contentCodingTokenEquals(begin, end, "application/xml");
+}
+
+
+} // namespace ServerKit
+} // namespace Passenger
+
+#endif /* _PASSENGER_SERVER_KIT_CONTENT_CODING_H_ */
@@ -43,6 +43,9 @@ extern "C" {
 }
 
 namespace Passenger {
+
+class IoUring;
+
 namespace ServerKit {
 
 using namespace std;
@@ -58,6 +61,12 @@ public:
 	// Dependencies
 	SafeLibevPtr libev;
 	struct uv_loop_s *libuv;
+	/**
+	 * Optional. If set, FileBufferedChannel performs its file I/O
+	 * through this io_uring instead of through libuv, in which case
+	 * `libuv` may be NULL.
+	 */
+	IoUring *ioUring;
 
 	// Others
 	Config config;
@@ -67,6 +76,7 @@ public:
 		const ConfigKit::Translator &translator = ConfigKit::DummyTranslator())
 		: configStore(schema, initialConfig, translator),
 		  libuv(NULL),
+		  ioUring(NULL),
 		  config(configStore)
 		{ }
 
@@ -78,8 +88,8 @@ public:
 		if (libev == NULL) {
 			throw RuntimeException("libev must be non-NULL");
 		}
-		if (libuv == NULL) {
-			throw RuntimeException("libuv must be non-NULL");
+		if (libuv == NULL && ioUring == NULL) {
+			throw RuntimeException("Either libuv or ioUring must be non-NULL");
 		}
 
 		mbuf_pool.mbuf_block_chunk_size = configStore["mbuf_block_chunk_size"].asUInt();
@@ -207,6 +207,41 @@ public:
 		Channel::consumed(size, end);
 	}
 
+	/**
+	 * Feeds data that doesn't come from the file descriptor, for example
+	 * when this channel represents an HTTP/2 stream instead of a socket.
+	 *
+	 * @pre acceptingInput()
+	 */
+	int feed(const MemoryKit::mbuf &mbuf) {
+		return Channel::feed(mbuf);
+	}
+
+	OXT_FORCE_INLINE
+	bool acceptingInput() const {
+		return Channel::acceptingInput();
+	}
+
+	OXT_FORCE_INLINE
+	bool mayAcceptInputLater() const {
+		return Channel::mayAcceptInputLater();
+	}
+
+	OXT_FORCE_INLINE
+	bool ended() const {
+		return Channel::ended();
+	}
+
+	/**
+	 * Sets the callback that is called when the channel accepts input again.
+	 * Only for use together with `feed()`: while the file descriptor is being
+	 * read, the channel manages this callback itself.
+	 */
+	OXT_FORCE_INLINE
+	void setConsumedCallback(ConsumedCallback callback) {
+		consumedCallback = callback;
+	}
+
 	OXT_FORCE_INLINE
 	int getFd() const {
 		return watcher.fd;
@@ -32,6 +32,7 @@
 #include <boost/move/move.hpp>
 #include <boost/atomic.hpp>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <uv.h>
 #include <jsoncpp/json.h>
 #include <cassert>
@@ -47,6 +48,7 @@
 #include <ServerKit/Errors.h>
 #include <ServerKit/Channel.h>
 #include <Utils/JsonUtils.h>
+#include <IoUring.h>
 
 namespace Passenger {
 namespace ServerKit {
@@ -205,8 +207,66 @@ public:
 
 
 private:
+	/*
+	 * Asynchronous filesystem I/O is performed through the io_uring
+	 * instance if the Context has one, and through libuv otherwise.
+	 * Both report results and call callbacks in the same way.
+	 */
+
+	static int fsOpen(uv_loop_t *libuv, IoUring *ioUring, uv_fs_t *req,
+		const char *path, int flags, int mode, uv_fs_cb cb)
+	{
+		if (ioUring != NULL) {
+			return ioUring->open(req, path, flags, mode, cb);
+		} else {
+			return uv_fs_open(libuv, req, path, flags, mode, cb);
+		}
+	}
+
+	static int fsRead(uv_loop_t *libuv, IoUring *ioUring, uv_fs_t *req,
+		uv_file file, const uv_buf_t bufs[], unsigned int nbufs,
+		boost::int64_t offset, uv_fs_cb cb)
+	{
+		if (ioUring != NULL) {
+			return ioUring->read(req, file, bufs, nbufs, offset, cb);
+		} else {
+			return uv_fs_read(libuv, req, file, bufs, nbufs, offset, cb);
+		}
+	}
+
+	static int fsWrite(uv_loop_t *libuv, IoUring *ioUring, uv_fs_t *req,
+		uv_file file, const uv_buf_t bufs[], unsigned int nbufs,
+		boost::int64_t offset, uv_fs_cb cb)
+	{
+		if (ioUring != NULL) {
+			return ioUring->write(req, file, bufs, nbufs, offset, cb);
+		} else {
+			return uv_fs_write(libuv, req, file, bufs, nbufs, offset, cb);
+		}
+	}
+
+	static int fsClose(uv_loop_t *libuv, IoUring *ioUring, uv_fs_t *req,
+		uv_file file, uv_fs_cb cb)
+	{
+		if (ioUring != NULL) {
+			return ioUring->close(req, file, cb);
+		} else {
+			return uv_fs_close(libuv, req, file, cb);
+		}
+	}
+
+	static int fsUnlink(uv_loop_t *libuv, IoUring *ioUring, uv_fs_t *req,
+		const char *path, uv_fs_cb cb)
+	{
+		if (ioUring != NULL) {
+			return ioUring->unlink(req, path, cb);
+		} else {
+			return uv_fs_unlink(libuv, req, path, cb);
+		}
+	}
+
 	/**
-	 * A structure containing the details of a libuv asynchronous
+	 * A structure containing the details of a libuv or io_uring asynchronous
 	 * filesystem I/O request.
 	 *
 	 * The I/O callback is responsible for destroying its corresponding
@@ -225,8 +285,8 @@ private:
 		 */
 		FileBufferedChannel *self;
 		/**
-		 * Pointers to the libev and libuv loops that this FileBufferedChannel
-		 * used. We keep the pointers here so that callbacks can perform
+		 * Pointers to the libev and libuv loops (or the io_uring) that this
+		 * FileBufferedChannel used. We keep the pointers here so that callbacks can perform
 		 * asynchronous I/O operations as part of their cleanup, even in the
 		 * event the original I/O operation is canceled.
 		 *
@@ -236,6 +296,7 @@ private:
 		 */
 		SafeLibevPtr libev;
 		uv_loop_t *libuv;
+		IoUring *ioUring;
 		/* req.data always refers back to the FileIOContext object itself. */
 		uv_fs_t req;
 
@@ -251,6 +312,7 @@ private:
 			: self(_self),
 			  libev(_self->ctx->libev),
 			  libuv(_self->ctx->libuv),
+			  ioUring(_self->ctx->ioUring),
 			  logbase(_self)
 		{
 			req.type = UV_UNKNOWN_REQ;
@@ -263,8 +325,9 @@ private:
 		void cancel() {
 			if (!isCanceled()) {
 				// uv_cancel() fails if the work is already in progress
-				// or completed, so we set self to NULL as an extra
-				// indicator that this I/O operation is canceled.
+				// or completed, or if this is an io_uring request, so we
+				// set self to NULL as an extra indicator that this I/O
+				// operation is canceled.
 				uv_cancel((uv_req_t *) &req);
 				self = NULL;
 			}
@@ -322,9 +385,10 @@ private:
 		/***** Common state *****/
 
 		/**
-		 * The libuv loop associated with the FileBufferedChannel.
+		 * The libuv loop and io_uring associated with the FileBufferedChannel.
 		 */
 		uv_loop_t *libuv;
+		IoUring *ioUring;
 
 		/**
 		 * The file descriptor of the temp file. It's -1 if the file is being
@@ -375,8 +439,9 @@ private:
 		 */
 		boost::int64_t written;
 
-		InFileMode(uv_loop_t *_libuv)
+		InFileMode(uv_loop_t *_libuv, IoUring *_ioUring)
 			: libuv(_libuv),
+			  ioUring(_ioUring),
 			  fd(-1),
 			  readRequest(NULL),
 			  writerState(WS_INACTIVE),
@@ -401,7 +466,7 @@ private:
 				abort();
 			}
 
-			int result = uv_fs_close(libuv, req, fd, fileClosed);
+			int result = fsClose(libuv, ioUring, req, fd, fileClosed);
 			if (result != 0) {
 				P_CRITICAL("Cannot close file descriptor for FileBufferedChannel temp file: "
 					"cannot initiate I/O operation: "
@@ -737,9 +802,14 @@ private:
 		readerState = RS_READING_FROM_FILE;
 		inFileMode->readRequest = readContext;
 
-		uv_fs_read(ctx->libuv, &readContext->req, inFileMode->fd,
-			&readContext->uvBuffer, 1, inFileMode->readOffset,
+		int result = fsRead(ctx->libuv, ctx->ioUring, &readContext->req,
+			inFileMode->fd, &readContext->uvBuffer, 1, inFileMode->readOffset,
 			_nextChunkDoneReading);
+		if (result != 0) {
+			readContext->req.result = result;
+			ctx->libev->runLater(boost::bind(_nextChunkDoneReading,
+				&readContext->req));
+		}
 		verifyInvariants();
 	}
 
@@ -837,7 +907,7 @@ private:
 
 		FBC_DEBUG("Switching to in-file mode");
 		mode = IN_FILE_MODE;
-		inFileMode = boost::make_shared<InFileMode>(ctx->libuv);
+		inFileMode = boost::make_shared<InFileMode>(ctx->libuv, ctx->ioUring);
 		createBufferFile();
 	}
 
@@ -886,7 +956,7 @@ private:
 
 		if (config->delayInFileModeSwitching == 0) {
 			FBC_DEBUG("Writer: creating file " << fcContext->path);
-			int result = uv_fs_open(ctx->libuv, &fcContext->req,
+			int result = fsOpen(ctx->libuv, ctx->ioUring, &fcContext->req,
 				fcContext->path.c_str(), O_RDWR | O_CREAT | O_EXCL,
 				0600, _bufferFileCreated);
 			if (result != 0) {
@@ -917,7 +987,7 @@ private:
 	void bufferFileDoneDelaying(FileCreationContext *fcContext) {
 		FBC_DEBUG("Writer: done delaying in-file mode switching. "
 			"Creating file: " << fcContext->path);
-		int result = uv_fs_open(ctx->libuv, &fcContext->req,
+		int result = fsOpen(ctx->libuv, ctx->ioUring, &fcContext->req,
 			fcContext->path.c_str(), O_RDWR | O_CREAT | O_EXCL,
 			0600, _bufferFileCreated);
 		if (result != 0) {
@@ -987,8 +1057,8 @@ private:
 			abort();
 		}
 
-		int result = uv_fs_close(fcContext->libuv, closeReq, fcContext->req.result,
-			bufferFileClosed);
+		int result = fsClose(fcContext->libuv, fcContext->ioUring, closeReq,
+			fcContext->req.result, bufferFileClosed);
 		if (result != 0) {
 			FBC_CRITICAL_FROM_CALLBACK(fcContext,
 				"Cannot close file descriptor for " << fcContext->path
@@ -1011,8 +1081,8 @@ private:
 			delete fcContext;
 		} else {
 			unlinkReq->data = fcContext;
-			int result = uv_fs_unlink(fcContext->libuv, unlinkReq, fcContext->path.c_str(),
-				bufferFileUnlinked);
+			int result = fsUnlink(fcContext->libuv, fcContext->ioUring, unlinkReq,
+				fcContext->path.c_str(), bufferFileUnlinked);
 			if (result != 0) {
 				FBC_ERROR_FROM_CALLBACK(fcContext,
 					"Cannot delete " << fcContext->path << ": cannot initiate I/O operation: "
@@ -1096,8 +1166,8 @@ private:
 
 		inFileMode->writerState = WS_MOVING;
 		inFileMode->writerRequest = moveContext;
-		int result = uv_fs_write(ctx->libuv, &moveContext->req, inFileMode->fd,
-			&moveContext->uvBuffer, 1,
+		int result = fsWrite(ctx->libuv, ctx->ioUring, &moveContext->req,
+			inFileMode->fd, &moveContext->uvBuffer, 1,
 			inFileMode->readOffset + inFileMode->written,
 			_bufferWrittenToFile);
 		if (result != 0) {
@@ -1155,7 +1225,7 @@ private:
 				moveContext->uvBuffer = uv_buf_init(
 					moveContext->buffer.start + moveContext->written,
 					moveContext->buffer.size() - moveContext->written);
-				int result = uv_fs_write(ctx->libuv, &moveContext->req,
+				int result = fsWrite(ctx->libuv, ctx->ioUring, &moveContext->req,
 					inFileMode->fd, &moveContext->uvBuffer, 1,
 					inFileMode->readOffset + inFileMode->written,
 					_bufferWrittenToFile);
@@ -1329,6 +1399,57 @@ private:
 		}
 	}
 
+protected:
+	/**
+	 * Allows the data callback to consume the in-memory buffers that the
+	 * reader would pass to it after the current one, for example in order
+	 * to write them out with a single `writev()`. Fills `iov` with up to
+	 * `maxiov` of those buffers, in order, and returns the number of entries
+	 * filled. Stops at EOF. Returns 0 outside the in-memory mode, because
+	 * then the queued buffers belong to the writer.
+	 */
+	unsigned int peekQueuedBuffers(struct iovec *iov, unsigned int maxiov) const {
+		if (mode != IN_MEMORY_MODE
+		 || (readerState != RS_FEEDING && readerState != RS_WAITING_FOR_CHANNEL_IDLE)
+		 || nbuffers == 0
+		 || maxiov == 0
+		 || firstBuffer.empty())
+		{
+			return 0;
+		}
+
+		unsigned int count = 1;
+		iov[0].iov_base = firstBuffer.start;
+		iov[0].iov_len = firstBuffer.size();
+
+		deque<MemoryKit::mbuf>::const_iterator it, end = moreBuffers.end();
+		for (it = moreBuffers.begin(); it != end && count < maxiov && !it->empty(); it++) {
+			iov[count].iov_base = it->start;
+			iov[count].iov_len = it->size();
+			count++;
+		}
+		return count;
+	}
+
+	/**
+	 * Removes `size` bytes, which the data callback has consumed on behalf
+	 * of the reader, from the front of the buffers returned by
+	 * `peekQueuedBuffers()`. This may call the buffersFlushedCallback, so
+	 * the caller must check whether the generation has changed.
+	 */
+	void consumeQueuedBuffers(size_t size) {
+		while (size > 0 && nbuffers > 0) {
+			if (size >= firstBuffer.size()) {
+				size -= firstBuffer.size();
+				popBuffer();
+			} else {
+				bytesBuffered -= size;
+				firstBuffer = MemoryKit::mbuf(firstBuffer, size);
+				size = 0;
+			}
+		}
+	}
+
 public:
 	/**
 	 * Called when all the in-memory buffers have been popped. This could happen
@@ -28,6 +28,8 @@
 
 #include <oxt/macros.hpp>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <unistd.h>
 #include <LoggingKit/LoggingKit.h>
 #include <MemoryKit/mbuf.h>
@@ -40,8 +42,21 @@ namespace ServerKit {
 class FileBufferedFdSinkChannel: protected FileBufferedChannel {
 public:
 	typedef void (*ErrorCallback)(FileBufferedFdSinkChannel *channel, int errcode);
+	/**
+	 * Replaces writing to the file descriptor. Has the same semantics as a
+	 * Channel data callback: return `Channel::Result(-1, false)` to indicate
+	 * that the data will be consumed later, then call `sinkWritable()`.
+	 */
+	typedef Channel::Result (*SinkCallback)(FileBufferedFdSinkChannel *channel,
+		const MemoryKit::mbuf &buffer, int errcode);
 
 private:
+	/**
+	 * Maximum number of buffers to write with a single `writev()`. With the
+	 * default mbuf size, this is already far more than a socket buffer holds.
+	 */
+	static const unsigned int MAX_GATHERED_BUFFERS = IOV_MAX < 64 ? IOV_MAX : 64;
+
 	ev_io watcher;
 
 	static Channel::Result onDataCallback(Channel *channel, const MemoryKit::mbuf &buffer,
@@ -51,12 +66,34 @@ private:
 		// A RefGuard is not necessary here. Both Channel and FileBufferedChannel
 		// install a RefGuard before calling this callback.
 
-		if (buffer.size() > 0) {
+		if (self->sinkCallback != NULL) {
+			return self->sinkCallback(self, buffer, errcode);
+		} else if (buffer.size() > 0) {
+			// Write the given buffer together with the in-memory buffers
+			// queued after it, so that draining a large buffered response
+			// doesn't cost one system call per mbuf.
+			struct iovec iov[MAX_GATHERED_BUFFERS];
+			unsigned int niov;
 			ssize_t ret;
+
+			iov[0].iov_base = buffer.start;
+			iov[0].iov_len = buffer.size();
+			niov = 1 + self->peekQueuedBuffers(iov + 1, MAX_GATHERED_BUFFERS - 1);
+
 			do {
-				ret = ::write(self->watcher.fd, buffer.start, buffer.size());
+				if (niov == 1) {
+					ret = ::write(self->watcher.fd, buffer.start, buffer.size());
+				} else {
+					ret = ::writev(self->watcher.fd, iov, niov);
+				}
 			} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
 			if (ret != -1) {
+				if ((size_t) ret > buffer.size()) {
+					// consumeQueuedBuffers() may call a callback that deinitializes
+					// this channel, but the caller checks for that.
+					self->consumeQueuedBuffers(ret - buffer.size());
+					return Channel::Result(buffer.size(), false);
+				}
 				return Channel::Result(ret, false);
 			} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
 				ev_io_start(self->ctx->libev->getLoop(), &self->watcher);
@@ -93,9 +130,16 @@ private:
 
 public:
 	ErrorCallback errorCallback;
+	/**
+	 * If set, data is passed to this callback instead of being written to
+	 * the file descriptor. Used for channels that aren't backed by a socket,
+	 * such as HTTP/2 streams. Not reset by `deinitialize()`.
+	 */
+	SinkCallback sinkCallback;
 
 	FileBufferedFdSinkChannel()
-		: errorCallback(NULL)
+		: errorCallback(NULL),
+		  sinkCallback(NULL)
 	{
 		FileBufferedChannel::setDataCallback(onDataCallback);
 		watcher.active = false;
@@ -199,6 +243,14 @@ public:
 		return watcher.fd;
 	}
 
+	/**
+	 * Tells the channel that the `sinkCallback`, which previously returned
+	 * `Channel::Result(-1, false)`, can accept data again.
+	 */
+	void sinkWritable() {
+		consumed(0, false);
+	}
+
 	OXT_FORCE_INLINE
 	unsigned int getBytesBuffered() const {
 		return FileBufferedChannel::getBytesBuffered();
@@ -214,6 +266,17 @@ public:
 		return FileBufferedChannel::getTotalBytesBuffered();
 	}
 
+	/**
+	 * Returns whether everything that has been fed so far has been written
+	 * to the file descriptor, so that the caller may write to the file
+	 * descriptor directly without reordering the output.
+	 */
+	OXT_FORCE_INLINE
+	bool isFlushed() const {
+		return FileBufferedChannel::getReaderState() == RS_INACTIVE
+			&& FileBufferedChannel::getTotalBytesBuffered() == 0;
+	}
+
 	OXT_FORCE_INLINE
 	bool ended() const {
 		return FileBufferedChannel::ended();
@@ -0,0 +1,544 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#include <ServerKit/Http2Hpack.h>
+#include <cstring>
+
+namespace Passenger {
+namespace ServerKit {
+
+
+namespace {
+	struct StaticTableEntry {
+		const char *name;
+		unsigned int nameSize;
+		const char *value;
+		unsigned int valueSize;
+	};
+
+	#define STATIC_ENTRY(name, value) { name, sizeof(name) - 1, value, sizeof(value) - 1 }
+
+	// RFC 7541 Appendix A.
+	const StaticTableEntry staticTable[] = {
+	STATIC_ENTRY(":authority", ""),
+	STATIC_ENTRY(":method", "GET"),
+	STATIC_ENTRY(":method", "POST"),
+	STATIC_ENTRY(":path", "/"),
+	STATIC_ENTRY(":path", "/index.html"),
+	STATIC_ENTRY(":scheme", "http"),
+	STATIC_ENTRY(":scheme", "https"),
+	STATIC_ENTRY(":status", "200"),
+	STATIC_ENTRY(":status", "204"),
+	STATIC_ENTRY(":status", "206"),
+	STATIC_ENTRY(":status", "304"),
+	STATIC_ENTRY(":status", "400"),
+	STATIC_ENTRY(":status", "404"),
+	STATIC_ENTRY(":status", "500"),
+	STATIC_ENTRY("accept-charset", ""),
+	STATIC_ENTRY("accept-encoding", "gzip, deflate"),
+	STATIC_ENTRY("accept-language", ""),
+	STATIC_ENTRY("accept-ranges", ""),
+	STATIC_ENTRY("accept", ""),
+	STATIC_ENTRY("access-control-allow-origin", ""),
+	STATIC_ENTRY("age", ""),
+	STATIC_ENTRY("allow", ""),
+	STATIC_ENTRY("authorization", ""),
+	STATIC_ENTRY("cache-control", ""),
+	STATIC_ENTRY("content-disposition", ""),
+	STATIC_ENTRY("content-encoding", ""),
+	STATIC_ENTRY("content-language", ""),
+	STATIC_ENTRY("content-length", ""),
+	STATIC_ENTRY("content-location", ""),
+	STATIC_ENTRY("content-range", ""),
+	STATIC_ENTRY("content-type", ""),
+	STATIC_ENTRY("cookie", ""),
+	STATIC_ENTRY("date", ""),
+	STATIC_ENTRY("etag", ""),
+	STATIC_ENTRY("expect", ""),
+	STATIC_ENTRY("expires", ""),
+	STATIC_ENTRY("from", ""),
+	STATIC_ENTRY("host", ""),
+	STATIC_ENTRY("if-match", ""),
+	STATIC_ENTRY("if-modified-since", ""),
+	STATIC_ENTRY("if-none-match", ""),
+	STATIC_ENTRY("if-range", ""),
+	STATIC_ENTRY("if-unmodified-since", ""),
+	STATIC_ENTRY("last-modified", ""),
+	STATIC_ENTRY("link", ""),
+	STATIC_ENTRY("location", ""),
+	STATIC_ENTRY("max-forwards", ""),
+	STATIC_ENTRY("proxy-authenticate", ""),
+	STATIC_ENTRY("proxy-authorization", ""),
+	STATIC_ENTRY("range", ""),
+	STATIC_ENTRY("referer", ""),
+	STATIC_ENTRY("refresh", ""),
+	STATIC_ENTRY("retry-after", ""),
+	STATIC_ENTRY("server", ""),
+	STATIC_ENTRY("set-cookie", ""),
+	STATIC_ENTRY("strict-transport-security", ""),
+	STATIC_ENTRY("transfer-encoding", ""),
+	STATIC_ENTRY("user-agent", ""),
+	STATIC_ENTRY("vary", ""),
+	STATIC_ENTRY("via", ""),
+	STATIC_ENTRY("www-authenticate", ""),
+	};
+
+	#undef STATIC_ENTRY
+
+	const unsigned int STATIC_TABLE_SIZE = sizeof(staticTable) / sizeof(StaticTableEntry);
+
+	struct HuffmanCode {
+		boost::uint32_t code;
+		unsigned int length;
+	};
+
+	// RFC 7541 Appendix B, indexed by symbol. The EOS symbol is omitted:
+	// a decoder must treat it as an error.
+	const HuffmanCode huffmanCodes[256] = {
+	{ 0x00001ff8, 13 }, { 0x007fffd8, 23 }, { 0x0fffffe2, 28 }, { 0x0fffffe3, 28 },
+	{ 0x0fffffe4, 28 }, { 0x0fffffe5, 28 }, { 0x0fffffe6, 28 }, { 0x0fffffe7, 28 },
+	{ 0x0fffffe8, 28 }, { 0x00ffffea, 24 }, { 0x3ffffffc, 30 }, { 0x0fffffe9, 28 },
+	{ 0x0fffffea, 28 }, { 0x3ffffffd, 30 }, { 0x0fffffeb, 28 }, { 0x0fffffec, 28 },
+	{ 0x0fffffed, 28 }, { 0x0fffffee, 28 }, { 0x0fffffef, 28 }, { 0x0ffffff0, 28 },
+	{ 0x0ffffff1, 28 }, { 0x0ffffff2, 28 }, { 0x3ffffffe, 30 }, { 0x0ffffff3, 28 },
+	{ 0x0ffffff4, 28 }, { 0x0ffffff5, 28 }, { 0x0ffffff6, 28 }, { 0x0ffffff7, 28 },
+	{ 0x0ffffff8, 28 }, { 0x0ffffff9, 28 }, { 0x0ffffffa, 28 }, { 0x0ffffffb, 28 },
+	{ 0x00000014,  6 }, { 0x000003f8, 10 }, { 0x000003f9, 10 }, { 0x00000ffa, 12 },
+	{ 0x00001ff9, 13 }, { 0x00000015,  6 }, { 0x000000f8,  8 }, { 0x000007fa, 11 },
+	{ 0x000003fa, 10 }, { 0x000003fb, 10 }, { 0x000000f9,  8 }, { 0x000007fb, 11 },
+	{ 0x000000fa,  8 }, { 0x00000016,  6 }, { 0x00000017,  6 }, { 0x00000018,  6 },
+	{ 0x00000000,  5 }, { 0x00000001,  5 }, { 0x00000002,  5 }, { 0x00000019,  6 },
+	{ 0x0000001a,  6 }, { 0x0000001b,  6 }, { 0x0000001c,  6 }, { 0x0000001d,  6 },
+	{ 0x0000001e,  6 }, { 0x0000001f,  6 }, { 0x0000005c,  7 }, { 0x000000fb,  8 },
+	{ 0x00007ffc, 15 }, { 0x00000020,  6 }, { 0x00000ffb, 12 }, { 0x000003fc, 10 },
+	{ 0x00001ffa, 13 }, { 0x00000021,  6 }, { 0x0000005d,  7 }, { 0x0000005e,  7 },
+	{ 0x0000005f,  7 }, { 0x00000060,  7 }, { 0x00000061,  7 }, { 0x00000062,  7 },
+	{ 0x00000063,  7 }, { 0x00000064,  7 }, { 0x00000065,  7 }, { 0x00000066,  7 },
+	{ 0x00000067,  7 }, { 0x00000068,  7 }, { 0x00000069,  7 }, { 0x0000006a,  7 },
+	{ 0x0000006b,  7 }, { 0x0000006c,  7 }, { 0x0000006d,  7 }, { 0x0000006e,  7 },
+	{ 0x0000006f,  7 }, { 0x00000070,  7 }, { 0x00000071,  7 }, { 0x00000072,  7 },
+	{ 0x000000fc,  8 }, { 0x00000073,  7 }, { 0x000000fd,  8 }, { 0x00001ffb, 13 },
+	{ 0x0007fff0, 19 }, { 0x00001ffc, 13 }, { 0x00003ffc, 14 }, { 0x00000022,  6 },
+	{ 0x00007ffd, 15 }, { 0x00000003,  5 }, { 0x00000023,  6 }, { 0x00000004,  5 },
+	{ 0x00000024,  6 }, { 0x00000005,  5 }, { 0x00000025,  6 }, { 0x00000026,  6 },
+	{ 0x00000027,  6 }, { 0x00000006,  5 }, { 0x00000074,  7 }, { 0x00000075,  7 },
+	{ 0x00000028,  6 }, { 0x00000029,  6 }, { 0x0000002a,  6 }, { 0x00000007,  5 },
+	{ 0x0000002b,  6 }, { 0x00000076,  7 }, { 0x0000002c,  6 }, { 0x00000008,  5 },
+	{ 0x00000009,  5 }, { 0x0000002d,  6 }, { 0x00000077,  7 }, { 0x00000078,  7 },
+	{ 0x00000079,  7 }, { 0x0000007a,  7 }, { 0x0000007b,  7 }, { 0x00007ffe, 15 },
+	{ 0x000007fc, 11 }, { 0x00003ffd, 14 }, { 0x00001ffd, 13 }, { 0x0ffffffc, 28 },
+	{ 0x000fffe6, 20 }, { 0x003fffd2, 22 }, { 0x000fffe7, 20 }, { 0x000fffe8, 20 },
+	{ 0x003fffd3, 22 }, { 0x003fffd4, 22 }, { 0x003fffd5, 22 }, { 0x007fffd9, 23 },
+	{ 0x003fffd6, 22 }, { 0x007fffda, 23 }, { 0x007fffdb, 23 }, { 0x007fffdc, 23 },
+	{ 0x007fffdd, 23 }, { 0x007fffde, 23 }, { 0x00ffffeb, 24 }, { 0x007fffdf, 23 },
+	{ 0x00ffffec, 24 }, { 0x00ffffed, 24 }, { 0x003fffd7, 22 }, { 0x007fffe0, 23 },
+	{ 0x00ffffee, 24 }, { 0x007fffe1, 23 }, { 0x007fffe2, 23 }, { 0x007fffe3, 23 },
+	{ 0x007fffe4, 23 }, { 0x001fffdc, 21 }, { 0x003fffd8, 22 }, { 0x007fffe5, 23 },
+	{ 0x003fffd9, 22 }, { 0x007fffe6, 23 }, { 0x007fffe7, 23 }, { 0x00ffffef, 24 },
+	{ 0x003fffda, 22 }, { 0x001fffdd, 21 }, { 0x000fffe9, 20 }, { 0x003fffdb, 22 },
+	{ 0x003fffdc, 22 }, { 0x007fffe8, 23 }, { 0x007fffe9, 23 }, { 0x001fffde, 21 },
+	{ 0x007fffea, 23 }, { 0x003fffdd, 22 }, { 0x003fffde, 22 }, { 0x00fffff0, 24 },
+	{ 0x001fffdf, 21 }, { 0x003fffdf, 22 }, { 0x007fffeb, 23 }, { 0x007fffec, 23 },
+	{ 0x001fffe0, 21 }, { 0x001fffe1, 21 }, { 0x003fffe0, 22 }, { 0x001fffe2, 21 },
+	{ 0x007fffed, 23 }, { 0x003fffe1, 22 }, { 0x007fffee, 23 }, { 0x007fffef, 23 },
+	{ 0x000fffea, 20 }, { 0x003fffe2, 22 }, { 0x003fffe3, 22 }, { 0x003fffe4, 22 },
+	{ 0x007ffff0, 23 }, { 0x003fffe5, 22 }, { 0x003fffe6, 22 }, { 0x007ffff1, 23 },
+	{ 0x03ffffe0, 26 }, { 0x03ffffe1, 26 }, { 0x000fffeb, 20 }, { 0x0007fff1, 19 },
+	{ 0x003fffe7, 22 }, { 0x007ffff2, 23 }, { 0x003fffe8, 22 }, { 0x01ffffec, 25 },
+	{ 0x03ffffe2, 26 }, { 0x03ffffe3, 26 }, { 0x03ffffe4, 26 }, { 0x07ffffde, 27 },
+	{ 0x07ffffdf, 27 }, { 0x03ffffe5, 26 }, { 0x00fffff1, 24 }, { 0x01ffffed, 25 },
+	{ 0x0007fff2, 19 }, { 0x001fffe3, 21 }, { 0x03ffffe6, 26 }, { 0x07ffffe0, 27 },
+	{ 0x07ffffe1, 27 }, { 0x03ffffe7, 26 }, { 0x07ffffe2, 27 }, { 0x00fffff2, 24 },
+	{ 0x001fffe4, 21 }, { 0x001fffe5, 21 }, { 0x03ffffe8, 26 }, { 0x03ffffe9, 26 },
+	{ 0x0ffffffd, 28 }, { 0x07ffffe3, 27 }, { 0x07ffffe4, 27 }, { 0x07ffffe5, 27 },
+	{ 0x000fffec, 20 }, { 0x00fffff3, 24 }, { 0x000fffed, 20 }, { 0x001fffe6, 21 },
+	{ 0x003fffe9, 22 }, { 0x001fffe7, 21 }, { 0x001fffe8, 21 }, { 0x007ffff3, 23 },
+	{ 0x003fffea, 22 }, { 0x003fffeb, 22 }, { 0x01ffffee, 25 }, { 0x01ffffef, 25 },
+	{ 0x00fffff4, 24 }, { 0x00fffff5, 24 }, { 0x03ffffea, 26 }, { 0x007ffff4, 23 },
+	{ 0x03ffffeb, 26 }, { 0x07ffffe6, 27 }, { 0x03ffffec, 26 }, { 0x03ffffed, 26 },
+	{ 0x07ffffe7, 27 }, { 0x07ffffe8, 27 }, { 0x07ffffe9, 27 }, { 0x07ffffea, 27 },
+	{ 0x07ffffeb, 27 }, { 0x0ffffffe, 28 }, { 0x07ffffec, 27 }, { 0x07ffffed, 27 },
+	{ 0x07ffffee, 27 }, { 0x07ffffef, 27 }, { 0x07fffff0, 27 }, { 0x03ffffee, 26 },
+	};
+
+	const unsigned int HUFFMAN_MIN_CODE_LENGTH = 5;
+	const unsigned int HUFFMAN_MAX_CODE_LENGTH = 30;
+
+	/**
+	 * The HPACK Huffman code is canonical: all codes of the same length are
+	 * consecutive, and they are ordered by symbol. So a code of length N can be
+	 * decoded by checking whether it falls inside the range of codes of that
+	 * length, without walking a tree.
+	 */
+	struct HuffmanDecodeTable {
+		boost::uint32_t firstCode[HUFFMAN_MAX_CODE_LENGTH + 1];
+		unsigned int count[HUFFMAN_MAX_CODE_LENGTH + 1];
+		unsigned int offset[HUFFMAN_MAX_CODE_LENGTH + 1];
+		unsigned char symbols[256];
+
+		HuffmanDecodeTable() {
+			unsigned int i, len, n = 0;
+
+			for (len = 0; len <= HUFFMAN_MAX_CODE_LENGTH; len++) {
+				firstCode[len] = 0;
+				count[len] = 0;
+				offset[len] = n;
+				for (i = 0; i < 256; i++) {
+					if (huffmanCodes[i].length == len) {
+						if (count[len] == 0) {
+							firstCode[len] = huffmanCodes[i].code;
+						}
+						count[len]++;
+						symbols[n] = (unsigned char) i;
+						n++;
+					}
+				}
+			}
+		}
+	};
+
+	const HuffmanDecodeTable huffmanDecodeTable;
+}
+
+
+void
+HpackDecoder::evict(size_t maxSize) {
+	while (dynamicTableSize > maxSize) {
+		const Entry &entry = dynamicTable.back();
+		dynamicTableSize -= entry.name.size() + entry.value.size() + ENTRY_OVERHEAD;
+		dynamicTable.pop_back();
+	}
+}
+
+void
+HpackDecoder::insert(const StaticString &name, const StaticString &value) {
+	size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+	if (size > maxDynamicTableSize) {
+		// Not an error: this empties the table (RFC 7541 section 4.4).
+		evict(0);
+		return;
+	}
+
+	evict(maxDynamicTableSize - size);
+	dynamicTable.push_front(Entry());
+	dynamicTable.front().name.assign(name.data(), name.size());
+	dynamicTable.front().value.assign(value.data(), value.size());
+	dynamicTableSize += size;
+}
+
+bool
+HpackDecoder::lookup(boost::uint64_t index, StaticString &name, StaticString &value) const {
+	if (index == 0) {
+		return false;
+	} else if (index <= STATIC_TABLE_SIZE) {
+		const StaticTableEntry &entry = staticTable[index - 1];
+		name = StaticString(entry.name, entry.nameSize);
+		value = StaticString(entry.value, entry.valueSize);
+		return true;
+	} else if (index - STATIC_TABLE_SIZE <= dynamicTable.size()) {
+		const Entry &entry = dynamicTable[index - STATIC_TABLE_SIZE - 1];
+		name = entry.name;
+		value = entry.value;
+		return true;
+	} else {
+		return false;
+	}
+}
+
+size_t
+HpackDecoder::decodeInteger(const unsigned char *data, size_t size,
+	unsigned int prefixBits, boost::uint64_t &result)
+{
+	const boost::uint64_t prefixMax = (1u << prefixBits) - 1;
+	size_t i;
+	unsigned int shift = 0;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	result = data[0] & prefixMax;
+	if (result < prefixMax) {
+		return 1;
+	}
+
+	for (i = 1; i < size; i++) {
+		if (shift > 56) {
+			return 0;
+		}
+		result += (boost::uint64_t) (data[i] & 0x7f) << shift;
+		shift += 7;
+		if ((data[i] & 0x80) == 0) {
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+bool
+HpackDecoder::decodeHuffman(const unsigned char *data, size_t size, string &output) {
+	const HuffmanDecodeTable &table = huffmanDecodeTable;
+	boost::uint32_t code = 0;
+	unsigned int len = 0;
+
+	output.reserve(output.size() + size * 8 / 5);
+	for (size_t i = 0; i < size; i++) {
+		unsigned char byte = data[i];
+		for (int bit = 7; bit >= 0; bit--) {
+			code = (code << 1) | ((byte >> bit) & 1);
+			len++;
+			if (len >= HUFFMAN_MIN_CODE_LENGTH && code - table.firstCode[len] < table.count[len]) {
+				output.append(1, (char) table.symbols[table.offset[len] + code - table.firstCode[len]]);
+				code = 0;
+				len = 0;
+			} else if (len == HUFFMAN_MAX_CODE_LENGTH) {
+				// Either EOS or an invalid code.
+				return false;
+			}
+		}
+	}
+
+	// The remaining bits must be padding: a prefix of EOS (all ones)
+	// that is shorter than 8 bits.
+	return len < 8 && code == (1u << len) - 1;
+}
+
+bool
+HpackDecoder::decode(const char *data, size_t size, HeaderCallback callback, void *userData) {
+	const unsigned char *pos = (const unsigned char *) data;
+	const unsigned char *end = pos + size;
+	bool fieldSeen = false;
+
+	while (pos < end) {
+		boost::uint64_t index;
+		size_t ret;
+		StaticString name, value;
+		unsigned char type = *pos;
+
+		if (type & 0x80) {
+			// Indexed header field.
+			ret = decodeInteger(pos, end - pos, 7, index);
+			if (ret == 0 || !lookup(index, name, value)) {
+				return false;
+			}
+			pos += ret;
+			fieldSeen = true;
+			if (!callback(userData, name, value)) {
+				return false;
+			}
+			continue;
+
+		} else if ((type & 0xe0) == 0x20) {
+			// Dynamic table size update. Only allowed before the first field.
+			ret = decodeInteger(pos, end - pos, 5, index);
+			if (ret == 0 || fieldSeen || index > maxDynamicTableSizeSetting) {
+				return false;
+			}
+			pos += ret;
+			maxDynamicTableSize = index;
+			evict(maxDynamicTableSize);
+			continue;
+		}
+
+		// Literal header field: with incremental indexing (01xxxxxx),
+		// without indexing (0000xxxx) or never indexed (0001xxxx).
+		bool indexed = (type & 0xc0) == 0x40;
+		ret = decodeInteger(pos, end - pos, indexed ? 6 : 4, index);
+		if (ret == 0) {
+			return false;
+		}
+		pos += ret;
+
+		for (int i = 0; i < 2; i++) {
+			if (i == 0 && index != 0) {
+				StaticString unused;
+				if (!lookup(index, name, unused)) {
+					return false;
+				}
+				continue;
+			}
+
+			boost::uint64_t len;
+			bool huffman;
+
+			if (pos == end) {
+				return false;
+			}
+			huffman = *pos & 0x80;
+			ret = decodeInteger(pos, end - pos, 7, len);
+			if (ret == 0 || len > (boost::uint64_t) (end - pos - ret)) {
+				return false;
+			}
+			pos += ret;
+
+			if (huffman) {
+				string &buffer = (i == 0) ? nameBuffer : valueBuffer;
+				buffer.clear();
+				if (!decodeHuffman(pos, len, buffer)) {
+					return false;
+				}
+				if (i == 0) {
+					name = buffer;
+				} else {
+					value = buffer;
+				}
+			} else if (i == 0) {
+				name = StaticString((const char *) pos, len);
+			} else {
+				value = StaticString((const char *) pos, len);
+			}
+			pos += len;
+		}
+
+		fieldSeen = true;
+		if (indexed) {
+			if (index > STATIC_TABLE_SIZE) {
+				// The name refers to a dynamic table entry, which
+				// inserting may evict.
+				nameBuffer.assign(name.data(), name.size());
+				name = nameBuffer;
+			}
+			insert(name, value);
+		}
+		if (!callback(userData, name, value)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void
+HpackEncoder::encodeInteger(string &output, unsigned char flags,
+	unsigned int prefixBits, boost::uint64_t value)
+{
+	const boost::uint64_t prefixMax = (1u << prefixBits) - 1;
+
+	if (value < prefixMax) {
+		output.append(1, (char) (flags | value));
+	} else {
+		output.append(1, (char) (flags | prefixMax));
+		value -= prefixMax;
+		while (value >= 0x80) {
+			output.append(1, (char) ((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+		output.append(1, (char) value);
+	}
+}
+
+unsigned int
+HpackEncoder::findStaticTableEntry(const StaticString &name, const StaticString &value,
+	bool &exact)
+{
+	unsigned int result = 0;
+
+	exact = false;
+	for (unsigned int i = 0; i < STATIC_TABLE_SIZE; i++) {
+		const StaticTableEntry &entry = staticTable[i];
+		if (entry.nameSize == name.size()
+		 && memcmp(entry.name, name.data(), name.size()) == 0)
+		{
+			if (entry.valueSize == value.size()
+			 && memcmp(entry.value, value.data(), value.size()) == 0)
+			{
+				exact = true;
+				return i + 1;
+			}
+			if (result == 0) {
+				result = i + 1;
+			}
+		} else if (result != 0) {
+			// Entries with the same name are adjacent.
+			break;
+		}
+	}
+	return result;
+}
+
+void
+HpackEncoder::encodeHeader(string &output, const StaticString &name,
+	const StaticString &value)
+{
+	bool exact;
+	unsigned int index = findStaticTableEntry(name, value, exact);
+
+	if (exact) {
+		encodeInteger(output, 0x80, 7, index);
+		return;
+	}
+
+	// Literal header field without indexing.
+	encodeInteger(output, 0x00, 4, index);
+	if (index == 0) {
+		encodeInteger(output, 0x00, 7, name.size());
+		output.append(name.data(), name.size());
+	}
+	encodeInteger(output, 0x00, 7, value.size());
+	output.append(value.data(), value.size());
+}
+
+void
+HpackEncoder::encodeStatus(string &output, unsigned int status) {
+	char buf[3];
+
+	switch (status) {
+	case 200:
+		encodeInteger(output, 0x80, 7, 8);
+		return;
+	case 204:
+		encodeInteger(output, 0x80, 7, 9);
+		return;
+	case 206:
+		encodeInteger(output, 0x80, 7, 10);
+		return;
+	case 304:
+		encodeInteger(output, 0x80, 7, 11);
+		return;
+	case 400:
+		encodeInteger(output, 0x80, 7, 12);
+		return;
+	case 404:
+		encodeInteger(output, 0x80, 7, 13);
+		return;
+	case 500:
+		encodeInteger(output, 0x80, 7, 14);
+		return;
+	default:
+		buf[0] = '0' + (status / 100) % 10;
+		buf[1] = '0' + (status / 10) % 10;
+		buf[2] = '0' + status % 10;
+		// Literal without indexing, name ":status" (index 8).
+		encodeInteger(output, 0x00, 4, 8);
+		encodeInteger(output, 0x00, 7, 3);
+		output.append(buf, 3);
+		return;
+	}
+}
+
+
+} // namespace ServerKit
+} // namespace Passenger
@@ -0,0 +1,152 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_SERVER_KIT_HTTP2_HPACK_H_
+#define _PASSENGER_SERVER_KIT_HTTP2_HPACK_H_
+
+#include <boost/cstdint.hpp>
+#include <string>
+#include <deque>
+#include <cstddef>
+#include <StaticString.h>
+
+namespace Passenger {
+namespace ServerKit {
+
+using namespace std;
+
+
+/**
+ * HPACK (RFC 7541) header compression, as used by HTTP/2.
+ *
+ * HpackDecoder implements the full decoding side: indexed fields, literals
+ * with and without indexing, dynamic table size updates and Huffman-coded
+ * strings.
+ *
+ * HpackEncoder only emits what the peer can decode without any state on our
+ * side: fields from the static table and literals without indexing. It never
+ * Huffman-codes strings. This keeps response encoding cheap and means that we
+ * don't have to track the peer's SETTINGS_HEADER_TABLE_SIZE.
+ */
+class HpackDecoder {
+public:
+	/**
+	 * Called for every decoded header field. `name` and `value` are only valid
+	 * during the call. Return false to abort decoding.
+	 */
+	typedef bool (*HeaderCallback)(void *userData, const StaticString &name,
+		const StaticString &value);
+
+private:
+	struct Entry {
+		string name;
+		string value;
+	};
+
+	// Newest entry first.
+	deque<Entry> dynamicTable;
+	size_t dynamicTableSize;
+	size_t maxDynamicTableSize;
+	size_t maxDynamicTableSizeSetting;
+	string nameBuffer;
+	string valueBuffer;
+
+	void evict(size_t maxSize);
+	void insert(const StaticString &name, const StaticString &value);
+	bool lookup(boost::uint64_t index, StaticString &name, StaticString &value) const;
+
+public:
+	/** The size that RFC 7541 charges for a dynamic table entry on top of its name and value. */
+	static const size_t ENTRY_OVERHEAD = 32;
+	/** The default value of SETTINGS_HEADER_TABLE_SIZE. */
+	static const size_t DEFAULT_TABLE_SIZE = 4096;
+
+	HpackDecoder()
+		: dynamicTableSize(0),
+		  maxDynamicTableSize(DEFAULT_TABLE_SIZE),
+		  maxDynamicTableSizeSetting(DEFAULT_TABLE_SIZE)
+		{ }
+
+	/**
+	 * Decodes a complete header block. Returns false if the block is malformed,
+	 * in which case the decoder state is undefined and the connection must be
+	 * terminated with a COMPRESSION_ERROR.
+	 */
+	bool decode(const char *data, size_t size, HeaderCallback callback, void *userData);
+
+	size_t getDynamicTableSize() const {
+		return dynamicTableSize;
+	}
+
+	size_t getDynamicTableEntryCount() const {
+		return dynamicTable.size();
+	}
+
+	/**
+	 * Decodes an HPACK integer with an N-bit prefix. Returns the number of bytes
+	 * consumed, or 0 if the input is truncated or the value overflows.
+	 */
+	static size_t decodeInteger(const unsigned char *data, size_t size,
+		unsigned int prefixBits, boost::uint64_t &result);
+
+	/**
+	 * Decodes a Huffman-coded string and appends it to `output`.
+	 * Returns false if the input is not a valid Huffman code.
+	 */
+	static bool decodeHuffman(const unsigned char *data, size_t size, string &output);
+};
+
+
+class HpackEncoder {
+public:
+	/**
+	 * Appends an HPACK integer with an N-bit prefix. `flags` contains the bits
+	 * of the first byte that precede the prefix.
+	 */
+	static void encodeInteger(string &output, unsigned char flags,
+		unsigned int prefixBits, boost::uint64_t value);
+
+	/**
+	 * Appends a header field. `name` must already be lowercase.
+	 */
+	static void encodeHeader(string &output, const StaticString &name,
+		const StaticString &value);
+
+	/** Appends a `:status` pseudo-header field. */
+	static void encodeStatus(string &output, unsigned int status);
+
+	/**
+	 * Returns the 1-based index of `name` in the static table, or 0.
+	 * If `value` also matches, sets `exact` to true.
+	 */
+	static unsigned int findStaticTableEntry(const StaticString &name,
+		const StaticString &value, bool &exact);
+};
+
+
+} // namespace ServerKit
+} // namespace Passenger
+
+#endif /* _PASSENGER_SERVER_KIT_HTTP2_HPACK_H_ */
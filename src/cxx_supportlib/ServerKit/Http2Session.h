@@ -0,0 +1,1907 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_SERVER_KIT_HTTP2_SESSION_H_
+#define _PASSENGER_SERVER_KIT_HTTP2_SESSION_H_
+
+#include <boost/cstdint.hpp>
+#include <oxt/macros.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <jsoncpp/json.h>
+#include <modp_b64.h>
+#include <StaticString.h>
+#include <MemoryKit/mbuf.h>
+#include <ServerKit/Context.h>
+#include <ServerKit/Http2Hpack.h>
+#include <ServerKit/http_parser.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace ServerKit {
+
+using namespace std;
+
+
+class Http2Session;
+
+enum Http2ErrorCode {
+	HTTP2_NO_ERROR            = 0x0,
+	HTTP2_PROTOCOL_ERROR      = 0x1,
+	HTTP2_INTERNAL_ERROR      = 0x2,
+	HTTP2_FLOW_CONTROL_ERROR  = 0x3,
+	HTTP2_SETTINGS_TIMEOUT    = 0x4,
+	HTTP2_STREAM_CLOSED       = 0x5,
+	HTTP2_FRAME_SIZE_ERROR    = 0x6,
+	HTTP2_REFUSED_STREAM      = 0x7,
+	HTTP2_CANCEL              = 0x8,
+	HTTP2_COMPRESSION_ERROR   = 0x9,
+	HTTP2_CONNECT_ERROR       = 0xa,
+	HTTP2_ENHANCE_YOUR_CALM   = 0xb,
+	HTTP2_INADEQUATE_SECURITY = 0xc,
+	HTTP2_HTTP_1_1_REQUIRED   = 0xd
+};
+
+
+/**
+ * A single request/response exchange within an Http2Session.
+ *
+ * The request is presented to the user as a synthesized HTTP/1.1 request
+ * (`METHOD path HTTP/1.1`, headers, and a body that is either delimited
+ * by Content-Length or chunked), which can be fed to an unmodified HTTP/1.1
+ * request parser. The user writes back an HTTP/1.x response, which the
+ * session translates into HEADERS and DATA frames.
+ */
+struct Http2Stream {
+	struct InputBuffer {
+		MemoryKit::mbuf data;
+		/**
+		 * Number of DATA frame payload bytes in `data`. They are returned
+		 * to the peer's flow control windows once the buffer is taken.
+		 */
+		unsigned int flowControlled;
+
+		InputBuffer(const MemoryKit::mbuf &_data, unsigned int _flowControlled)
+			: data(_data),
+			  flowControlled(_flowControlled)
+			{ }
+	};
+
+	Http2Session *session;
+	/** Free for use by the Http2SessionHandler. */
+	void *userData;
+	boost::uint32_t id;
+
+	/**
+	 * How much response data we may still send. May become negative
+	 * when the peer shrinks SETTINGS_INITIAL_WINDOW_SIZE.
+	 */
+	boost::int64_t sendWindow;
+	/** How much request body data the peer may still send. */
+	boost::int64_t recvWindow;
+	/** Request body bytes taken by the user, but not yet acknowledged with a WINDOW_UPDATE. */
+	unsigned int recvUnacked;
+
+	/** Whether the peer has sent END_STREAM. */
+	bool remoteEnded: 1;
+	/** Whether we have sent END_STREAM or RST_STREAM. */
+	bool responseEnded: 1;
+	/** Whether RST_STREAM has been sent or received. */
+	bool reset: 1;
+	/** Whether closeStream() has been called. */
+	bool closed: 1;
+	bool chunkedRequestBody: 1;
+	bool hasContentLength: 1;
+	bool headRequest: 1;
+	/** Whether writeResponse() returned -1 and onHttp2StreamWritable() is due. */
+	bool waitingForWindow: 1;
+	/** Whether the headers of the final (non-1xx) response have been parsed. */
+	bool responseHeadersComplete: 1;
+	bool responseHeadersPending: 1;
+	/** Whether the response parser paused right before the LF that ends the header. */
+	bool responseHeaderTerminatorPending: 1;
+	bool lastResponseHeaderCallbackWasValue: 1;
+
+	boost::uint64_t contentLength;
+	boost::uint64_t bodyBytesReceived;
+
+	/** Synthesized HTTP/1.1 request data, waiting to be taken by the user. */
+	deque<InputBuffer> input;
+
+	http_parser responseParser;
+	string responseHeaderName;
+	string responseHeaderValue;
+	/** HPACK-encoded response headers that have not been sent yet. */
+	string responseHeaderBlock;
+	const MemoryKit::mbuf *currentResponseBuffer;
+
+	Http2Stream(Http2Session *_session, boost::uint32_t _id)
+		: session(_session),
+		  userData(NULL),
+		  id(_id),
+		  sendWindow(0),
+		  recvWindow(0),
+		  recvUnacked(0),
+		  remoteEnded(false),
+		  responseEnded(false),
+		  reset(false),
+		  closed(false),
+		  chunkedRequestBody(false),
+		  hasContentLength(false),
+		  headRequest(false),
+		  waitingForWindow(false),
+		  responseHeadersComplete(false),
+		  responseHeadersPending(false),
+		  responseHeaderTerminatorPending(false),
+		  lastResponseHeaderCallbackWasValue(false),
+		  contentLength(0),
+		  bodyBytesReceived(0),
+		  currentResponseBuffer(NULL)
+	{
+		http_parser_init(&responseParser, HTTP_RESPONSE);
+		responseParser.data = this;
+	}
+};
+
+
+/**
+ * Receives the events of an Http2Session. The session never calls the
+ * handler after `Http2Session::destroy()`.
+ */
+class Http2SessionHandler {
+public:
+	virtual ~Http2SessionHandler() { }
+
+	/** Frames that must be written to the connection, in order. */
+	virtual void onHttp2Output(Http2Session *session, const MemoryKit::mbuf &buffer) = 0;
+
+	/**
+	 * The peer opened a new stream. Return false to refuse it with
+	 * REFUSED_STREAM; the stream object is then deleted immediately.
+	 */
+	virtual bool onHttp2StreamOpened(Http2Session *session, Http2Stream *stream) = 0;
+
+	/** New request data can be taken with `Http2Session::takeStreamInput()`. */
+	virtual void onHttp2StreamInput(Http2Session *session, Http2Stream *stream) = 0;
+
+	/** `writeResponse()` previously returned -1, and may now accept data again. */
+	virtual void onHttp2StreamWritable(Http2Session *session, Http2Stream *stream) = 0;
+
+	/**
+	 * The stream was reset, either by the peer or because of a stream or
+	 * connection error. The handler must eventually call `closeStream()`.
+	 */
+	virtual void onHttp2StreamReset(Http2Session *session, Http2Stream *stream,
+		Http2ErrorCode code) = 0;
+
+	/**
+	 * The session has no more work to do: either a connection error occurred, or
+	 * a GOAWAY was exchanged and all streams are closed. After flushing the output,
+	 * the connection should be closed.
+	 */
+	virtual void onHttp2SessionFinished(Http2Session *session) = 0;
+};
+
+
+/**
+ * The server side of an HTTP/2 connection (RFC 7540), without TLS: h2c via
+ * prior knowledge or via an HTTP/1.1 Upgrade.
+ *
+ * Http2Session is purely a protocol engine. It does not perform I/O: the owner
+ * feeds it connection data with `feed()`, and the session emits frames through
+ * `Http2SessionHandler::onHttp2Output()`. Each stream is exposed as an HTTP/1.1
+ * request/response exchange (see Http2Stream), so that HttpServer can map a
+ * stream onto an ordinary Client/Request pair.
+ *
+ * Flow control is applied in both directions. Request body data is only
+ * acknowledged with WINDOW_UPDATE when the user takes it, so a slow consumer
+ * stalls only its own stream. `writeResponse()` refuses data when the stream
+ * or connection window is exhausted, or when the owner signals with
+ * `setOutputBlocked()` that the connection is not keeping up.
+ *
+ * Server push and stream priorities are not supported; PRIORITY frames are
+ * ignored.
+ *
+ * ## Reentrancy
+ *
+ * Handler callbacks may call back into the session, including `closeStream()`
+ * and `destroy()`. Stream objects and the session itself are only deleted
+ * when the outermost call into the session returns. Output that is generated
+ * during a call is passed to `onHttp2Output()` when the outermost call returns.
+ */
+class Http2Session {
+public:
+	typedef map<boost::uint32_t, Http2Stream *> StreamMap;
+
+	static const unsigned int FRAME_HEADER_SIZE = 9;
+	static const unsigned int DEFAULT_MAX_FRAME_SIZE = 16384;
+	static const unsigned int DEFAULT_WINDOW_SIZE = 65535;
+	static const boost::uint32_t MAX_WINDOW_SIZE = 0x7fffffff;
+	/** Header blocks larger than this (after reassembling CONTINUATION frames) are refused. */
+	static const unsigned int MAX_HEADER_BLOCK_SIZE = 128 * 1024;
+
+private:
+	enum FrameType {
+		DATA_FRAME          = 0x0,
+		HEADERS_FRAME       = 0x1,
+		PRIORITY_FRAME      = 0x2,
+		RST_STREAM_FRAME    = 0x3,
+		SETTINGS_FRAME      = 0x4,
+		PUSH_PROMISE_FRAME  = 0x5,
+		PING_FRAME          = 0x6,
+		GOAWAY_FRAME        = 0x7,
+		WINDOW_UPDATE_FRAME = 0x8,
+		CONTINUATION_FRAME  = 0x9
+	};
+
+	enum FrameFlag {
+		FLAG_END_STREAM  = 0x1,
+		FLAG_ACK         = 0x1,
+		FLAG_END_HEADERS = 0x4,
+		FLAG_PADDED      = 0x8,
+		FLAG_PRIORITY    = 0x20
+	};
+
+	enum SettingId {
+		SETTINGS_HEADER_TABLE_SIZE      = 0x1,
+		SETTINGS_ENABLE_PUSH            = 0x2,
+		SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+		SETTINGS_INITIAL_WINDOW_SIZE    = 0x4,
+		SETTINGS_MAX_FRAME_SIZE         = 0x5,
+		SETTINGS_MAX_HEADER_LIST_SIZE   = 0x6
+	};
+
+	enum InputState {
+		READING_PREFACE,
+		READING_FRAME_HEADER,
+		READING_FRAME_PAYLOAD,
+		READING_DATA_PAYLOAD,
+		DISCARDING_INPUT
+	};
+
+	/** The request pseudo-headers and headers of a header block being decoded. */
+	struct RequestHeaders {
+		string method;
+		string scheme;
+		string authority;
+		string path;
+		string host;
+		string cookie;
+		/** Regular headers, already formatted as "name: value\r\n" lines. */
+		string fields;
+		boost::uint64_t contentLength;
+		bool hasContentLength;
+		bool regularFieldSeen;
+		bool malformed;
+
+		void clear() {
+			method.clear();
+			scheme.clear();
+			authority.clear();
+			path.clear();
+			host.clear();
+			cookie.clear();
+			fields.clear();
+			contentLength = 0;
+			hasContentLength = false;
+			regularFieldSeen = false;
+			malformed = false;
+		}
+	};
+
+	/** Defers output, stream deletion and session deletion until the outermost call returns. */
+	class CallGuard {
+	private:
+		Http2Session *session;
+
+	public:
+		CallGuard(Http2Session *_session)
+			: session(_session)
+		{
+			session->callDepth++;
+		}
+
+		~CallGuard() {
+			if (session->callDepth == 1) {
+				session->finishOutermostCall();
+			}
+			session->callDepth--;
+			if (session->callDepth == 0 && session->destroyRequested) {
+				delete session;
+			}
+		}
+	};
+
+	friend class CallGuard;
+
+	Context *ctx;
+	Http2SessionHandler *handler;
+	HpackDecoder hpackDecoder;
+	StreamMap streams;
+	vector<Http2Stream *> closedStreams;
+	RequestHeaders requestHeaders;
+
+	// Input parsing state.
+	InputState inputState;
+	unsigned int prefaceBytesRead;
+	unsigned char frameHeader[FRAME_HEADER_SIZE];
+	unsigned int frameHeaderBytesRead;
+	unsigned int frameLength;
+	unsigned char frameType;
+	unsigned char frameFlags;
+	boost::uint32_t frameStreamId;
+	string framePayload;
+	// DATA frames are not buffered, but sliced directly into stream input.
+	Http2Stream *dataStream;
+	unsigned int dataRemaining;
+	unsigned int dataPadding;
+	bool dataPadLengthPending;
+	// A header block that is continued in CONTINUATION frames.
+	boost::uint32_t headerBlockStreamId;
+	bool headerBlockEndStream;
+	string headerBlock;
+
+	boost::uint32_t lastStreamId;
+	unsigned int maxConcurrentStreams;
+	boost::uint32_t peerInitialWindowSize;
+	unsigned int peerMaxFrameSize;
+	boost::int64_t connSendWindow;
+	boost::int64_t connRecvWindow;
+	boost::uint32_t connRecvWindowSize;
+	unsigned int connRecvUnacked;
+
+	// Output state.
+	MemoryKit::mbuf outputBlock;
+	unsigned int outputUsed;
+	deque<MemoryKit::mbuf> pendingOutput;
+	MemoryKit::mbuf inputScratch;
+
+	unsigned int callDepth;
+	bool started: 1;
+	bool goawaySent: 1;
+	bool goawayReceived: 1;
+	bool failed: 1;
+	bool outputBlocked: 1;
+	bool finishNotified: 1;
+	bool destroyRequested: 1;
+
+	/** The client connection preface (RFC 7540 section 3.5). */
+	static const char *getConnectionPreface() {
+		return "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+	}
+
+	static const unsigned int CONNECTION_PREFACE_SIZE = 24;
+
+
+	/***** Utility functions *****/
+
+	static boost::uint32_t readUint32(const unsigned char *data) {
+		return ((boost::uint32_t) data[0] << 24)
+			| ((boost::uint32_t) data[1] << 16)
+			| ((boost::uint32_t) data[2] << 8)
+			| (boost::uint32_t) data[3];
+	}
+
+	static void writeUint32(unsigned char *data, boost::uint32_t value) {
+		data[0] = (unsigned char) (value >> 24);
+		data[1] = (unsigned char) (value >> 16);
+		data[2] = (unsigned char) (value >> 8);
+		data[3] = (unsigned char) value;
+	}
+
+	static bool isConnectionSpecificHeader(const StaticString &name) {
+		return name == P_STATIC_STRING("connection")
+			|| name == P_STATIC_STRING("keep-alive")
+			|| name == P_STATIC_STRING("proxy-connection")
+			|| name == P_STATIC_STRING("transfer-encoding")
+			|| name == P_STATIC_STRING("upgrade");
+	}
+
+	static bool isValidHeaderName(const StaticString &name) {
+		if (name.empty()) {
+			return false;
+		}
+		for (string::size_type i = 0; i < name.size(); i++) {
+			char ch = name[i];
+			if ((ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9')) {
+				continue;
+			}
+			if (strchr("!#$%&'*+-.^_`|~", ch) == NULL || ch == '\0') {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool isValidHeaderValue(const StaticString &value) {
+		return memchr(value.data(), '\r', value.size()) == NULL
+			&& memchr(value.data(), '\n', value.size()) == NULL
+			&& memchr(value.data(), '\0', value.size()) == NULL;
+	}
+
+	static bool isDigits(const StaticString &value) {
+		for (string::size_type i = 0; i < value.size(); i++) {
+			if (value[i] < '0' || value[i] > '9') {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/** Whether `value` can be put in an HTTP/1.1 request line without changing its meaning. */
+	static bool isValidRequestLineToken(const string &value) {
+		if (value.empty()) {
+			return false;
+		}
+		for (string::size_type i = 0; i < value.size(); i++) {
+			unsigned char ch = value[i];
+			if (ch <= 0x20 || ch == 0x7f) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	/***** Output *****/
+
+	void flushOutputBlock() {
+		if (outputUsed > 0) {
+			pendingOutput.push_back(MemoryKit::mbuf(outputBlock, 0, outputUsed));
+			if (outputUsed == outputBlock.size()) {
+				outputBlock = MemoryKit::mbuf();
+			} else {
+				outputBlock = MemoryKit::mbuf(outputBlock, outputUsed);
+			}
+			outputUsed = 0;
+		}
+	}
+
+	void appendOutput(const char *data, size_t size) {
+		while (size > 0) {
+			if (outputUsed == outputBlock.size()) {
+				flushOutputBlock();
+				outputBlock = MemoryKit::mbuf_get(&ctx->mbuf_pool);
+			}
+			size_t n = std::min<size_t>(size, outputBlock.size() - outputUsed);
+			memcpy(outputBlock.start + outputUsed, data, n);
+			outputUsed += n;
+			data += n;
+			size -= n;
+		}
+	}
+
+	void writeFrameHeader(unsigned int length, unsigned char type, unsigned char flags,
+		boost::uint32_t streamId)
+	{
+		unsigned char header[FRAME_HEADER_SIZE];
+		header[0] = (unsigned char) (length >> 16);
+		header[1] = (unsigned char) (length >> 8);
+		header[2] = (unsigned char) length;
+		header[3] = type;
+		header[4] = flags;
+		writeUint32(header + 5, streamId & MAX_WINDOW_SIZE);
+		appendOutput((const char *) header, FRAME_HEADER_SIZE);
+	}
+
+	void sendSettings() {
+		unsigned char payload[12];
+		payload[0] = 0;
+		payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+		writeUint32(payload + 2, maxConcurrentStreams);
+		payload[6] = 0;
+		payload[7] = SETTINGS_ENABLE_PUSH;
+		writeUint32(payload + 8, 0);
+		writeFrameHeader(sizeof(payload), SETTINGS_FRAME, 0, 0);
+		appendOutput((const char *) payload, sizeof(payload));
+	}
+
+	void sendWindowUpdate(boost::uint32_t streamId, boost::uint32_t increment) {
+		unsigned char payload[4];
+		writeUint32(payload, increment);
+		writeFrameHeader(sizeof(payload), WINDOW_UPDATE_FRAME, 0, streamId);
+		appendOutput((const char *) payload, sizeof(payload));
+	}
+
+	void sendRstStream(boost::uint32_t streamId, Http2ErrorCode code) {
+		unsigned char payload[4];
+		writeUint32(payload, code);
+		writeFrameHeader(sizeof(payload), RST_STREAM_FRAME, 0, streamId);
+		appendOutput((const char *) payload, sizeof(payload));
+	}
+
+	void sendGoaway(Http2ErrorCode code) {
+		unsigned char payload[8];
+		writeUint32(payload, lastStreamId);
+		writeUint32(payload + 4, code);
+		writeFrameHeader(sizeof(payload), GOAWAY_FRAME, 0, 0);
+		appendOutput((const char *) payload, sizeof(payload));
+		goawaySent = true;
+	}
+
+	/** Sends a header block, split into HEADERS and CONTINUATION frames as necessary. */
+	void sendHeaderBlock(Http2Stream *stream, const string &block, bool endStream) {
+		string::size_type pos = 0;
+		unsigned char type = HEADERS_FRAME;
+		unsigned char flags = endStream ? FLAG_END_STREAM : 0;
+
+		do {
+			unsigned int size = (unsigned int) std::min<string::size_type>(
+				block.size() - pos, peerMaxFrameSize);
+			if (pos + size == block.size()) {
+				flags |= FLAG_END_HEADERS;
+			}
+			writeFrameHeader(size, type, flags, stream->id);
+			appendOutput(block.data() + pos, size);
+			pos += size;
+			type = CONTINUATION_FRAME;
+			flags = 0;
+		} while (pos < block.size());
+	}
+
+	/**
+	 * Sends a DATA frame. The payload is referenced instead of copied if
+	 * it lives in an mbuf block, and if it's large enough to be worth it.
+	 */
+	void sendDataFrame(Http2Stream *stream, const MemoryKit::mbuf *buffer,
+		const char *data, unsigned int size, bool endStream)
+	{
+		writeFrameHeader(size, DATA_FRAME, endStream ? FLAG_END_STREAM : 0, stream->id);
+		if (buffer != NULL && buffer->mbuf_block != NULL && size >= 1024) {
+			flushOutputBlock();
+			pendingOutput.push_back(MemoryKit::mbuf(*buffer,
+				data - buffer->start, size));
+		} else {
+			appendOutput(data, size);
+		}
+	}
+
+	void flushOutput() {
+		flushOutputBlock();
+		while (!pendingOutput.empty() && !destroyRequested) {
+			MemoryKit::mbuf buffer(pendingOutput.front());
+			pendingOutput.pop_front();
+			handler->onHttp2Output(this, buffer);
+		}
+		if (destroyRequested) {
+			pendingOutput.clear();
+		}
+	}
+
+	void finishOutermostCall() {
+		flushOutput();
+
+		while (!closedStreams.empty()) {
+			delete closedStreams.back();
+			closedStreams.pop_back();
+		}
+
+		if (!destroyRequested && !finishNotified && isFinished()) {
+			finishNotified = true;
+			handler->onHttp2SessionFinished(this);
+		}
+	}
+
+
+	/***** Errors *****/
+
+	void connectionError(Http2ErrorCode code) {
+		if (failed) {
+			return;
+		}
+		failed = true;
+		inputState = DISCARDING_INPUT;
+		sendGoaway(code);
+		resetAllStreams(code);
+	}
+
+	void resetAllStreams(Http2ErrorCode code) {
+		vector<Http2Stream *> toReset;
+		StreamMap::iterator it, end = streams.end();
+
+		for (it = streams.begin(); it != end; it++) {
+			toReset.push_back(it->second);
+		}
+		for (unsigned int i = 0; i < toReset.size() && !destroyRequested; i++) {
+			Http2Stream *stream = toReset[i];
+			if (!stream->closed && !stream->reset) {
+				stream->reset = true;
+				stream->remoteEnded = true;
+				stream->responseEnded = true;
+				handler->onHttp2StreamReset(this, stream, code);
+			}
+		}
+	}
+
+	/** Resets a stream. `stream` may be NULL if no stream object exists (anymore). */
+	void streamError(boost::uint32_t streamId, Http2Stream *stream, Http2ErrorCode code) {
+		if (stream == NULL) {
+			sendRstStream(streamId, code);
+		} else if (!stream->closed && !stream->reset) {
+			sendRstStream(streamId, code);
+			stream->reset = true;
+			stream->remoteEnded = true;
+			stream->responseEnded = true;
+			handler->onHttp2StreamReset(this, stream, code);
+		}
+	}
+
+
+	/***** Flow control *****/
+
+	void creditConnection(unsigned int size) {
+		connRecvUnacked += size;
+		if (connRecvUnacked >= connRecvWindowSize / 2 && !failed) {
+			sendWindowUpdate(0, connRecvUnacked);
+			connRecvWindow += connRecvUnacked;
+			connRecvUnacked = 0;
+		}
+	}
+
+	void creditStream(Http2Stream *stream, unsigned int size) {
+		stream->recvUnacked += size;
+		if (stream->recvUnacked >= DEFAULT_WINDOW_SIZE / 2
+		 && !stream->remoteEnded && !stream->reset && !failed)
+		{
+			sendWindowUpdate(stream->id, stream->recvUnacked);
+			stream->recvWindow += stream->recvUnacked;
+			stream->recvUnacked = 0;
+		}
+		creditConnection(size);
+	}
+
+	boost::int64_t getSendWindow(const Http2Stream *stream) const {
+		return std::max<boost::int64_t>(0,
+			std::min<boost::int64_t>(stream->sendWindow, connSendWindow));
+	}
+
+	void notifyWritableStreams() {
+		vector<Http2Stream *> writable;
+		StreamMap::iterator it, end = streams.end();
+
+		if (outputBlocked || connSendWindow <= 0) {
+			return;
+		}
+		for (it = streams.begin(); it != end; it++) {
+			Http2Stream *stream = it->second;
+			if (stream->waitingForWindow && stream->sendWindow > 0) {
+				writable.push_back(stream);
+			}
+		}
+		for (unsigned int i = 0; i < writable.size() && !destroyRequested; i++) {
+			Http2Stream *stream = writable[i];
+			if (!stream->closed && stream->waitingForWindow) {
+				stream->waitingForWindow = false;
+				handler->onHttp2StreamWritable(this, stream);
+			}
+		}
+	}
+
+
+	/***** Stream management *****/
+
+	Http2Stream *findStream(boost::uint32_t id) const {
+		StreamMap::const_iterator it = streams.find(id);
+		if (it == streams.end()) {
+			return NULL;
+		} else {
+			return it->second;
+		}
+	}
+
+	MemoryKit::mbuf copyToInputBuffer(const char *data, size_t size) {
+		if (size > mbuf_pool_data_size(&ctx->mbuf_pool)) {
+			MemoryKit::mbuf result(MemoryKit::mbuf_get_with_size(&ctx->mbuf_pool, size));
+			memcpy(result.start, data, size);
+			return result;
+		}
+
+		if (inputScratch.size() < size) {
+			inputScratch = MemoryKit::mbuf_get(&ctx->mbuf_pool);
+		}
+		memcpy(inputScratch.start, data, size);
+		MemoryKit::mbuf result(inputScratch, 0, size);
+		if (size == inputScratch.size()) {
+			inputScratch = MemoryKit::mbuf();
+		} else {
+			inputScratch = MemoryKit::mbuf(inputScratch, size);
+		}
+		return result;
+	}
+
+	void queueStreamInput(Http2Stream *stream, const MemoryKit::mbuf &data,
+		unsigned int flowControlled)
+	{
+		stream->input.push_back(Http2Stream::InputBuffer(data, flowControlled));
+	}
+
+	Http2Stream *createStream(boost::uint32_t id) {
+		Http2Stream *stream = new Http2Stream(this, id);
+		stream->sendWindow = peerInitialWindowSize;
+		stream->recvWindow = DEFAULT_WINDOW_SIZE;
+		streams.insert(make_pair(id, stream));
+		return stream;
+	}
+
+	/**
+	 * Registers a newly created stream with the handler and passes the
+	 * synthesized request to it.
+	 */
+	void openStream(Http2Stream *stream) {
+		if (handler->onHttp2StreamOpened(this, stream)) {
+			if (!stream->closed && !destroyRequested) {
+				handler->onHttp2StreamInput(this, stream);
+			}
+		} else {
+			streams.erase(stream->id);
+			sendRstStream(stream->id, HTTP2_REFUSED_STREAM);
+			delete stream;
+		}
+	}
+
+	void endRemoteStream(Http2Stream *stream) {
+		if (stream->hasContentLength && stream->bodyBytesReceived != stream->contentLength) {
+			streamError(stream->id, stream, HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+		stream->remoteEnded = true;
+		if (stream->chunkedRequestBody) {
+			queueStreamInput(stream, MemoryKit::mbuf("0\r\n\r\n", 5), 0);
+		}
+		handler->onHttp2StreamInput(this, stream);
+	}
+
+
+	/***** Request header handling *****/
+
+	static bool onRequestHeader(void *userData, const StaticString &name,
+		const StaticString &value)
+	{
+		RequestHeaders *headers = static_cast<RequestHeaders *>(userData);
+
+		if (headers->malformed) {
+			// Keep decoding so that the HPACK state stays in sync.
+			return true;
+		}
+		if (!isValidHeaderValue(value)) {
+			headers->malformed = true;
+			return true;
+		}
+
+		if (!name.empty() && name[0] == ':') {
+			string *target;
+
+			if (headers->regularFieldSeen) {
+				headers->malformed = true;
+				return true;
+			}
+			if (name == P_STATIC_STRING(":method")) {
+				target = &headers->method;
+			} else if (name == P_STATIC_STRING(":scheme")) {
+				target = &headers->scheme;
+			} else if (name == P_STATIC_STRING(":authority")) {
+				target = &headers->authority;
+			} else if (name == P_STATIC_STRING(":path")) {
+				target = &headers->path;
+			} else {
+				headers->malformed = true;
+				return true;
+			}
+			if (!target->empty()) {
+				headers->malformed = true;
+			} else {
+				target->assign(value.data(), value.size());
+			}
+			return true;
+		}
+
+		headers->regularFieldSeen = true;
+		if (!isValidHeaderName(name) || isConnectionSpecificHeader(name)) {
+			headers->malformed = true;
+		} else if (name == P_STATIC_STRING("te")) {
+			if (value != P_STATIC_STRING("trailers")) {
+				headers->malformed = true;
+			}
+		} else if (name == P_STATIC_STRING("cookie")) {
+			// RFC 7540 section 8.1.2.5: multiple cookie fields
+			// must be concatenated for HTTP/1.1.
+			if (!headers->cookie.empty()) {
+				headers->cookie.append("; ", 2);
+			}
+			headers->cookie.append(value.data(), value.size());
+		} else if (name == P_STATIC_STRING("host")) {
+			headers->host.assign(value.data(), value.size());
+		} else if (name == P_STATIC_STRING("content-length")) {
+			if (value.empty() || value.size() > 18
+			 || !isDigits(value)
+			 || headers->hasContentLength)
+			{
+				headers->malformed = true;
+			} else {
+				headers->hasContentLength = true;
+				headers->contentLength = stringToULL(value);
+			}
+		} else if (name == P_STATIC_STRING("expect")) {
+			// There is no interim response to wait for: the peer
+			// sends the body subject to flow control.
+		} else {
+			headers->fields.append(name.data(), name.size());
+			headers->fields.append(": ", 2);
+			headers->fields.append(value.data(), value.size());
+			headers->fields.append("\r\n", 2);
+		}
+		return true;
+	}
+
+	static bool onIgnoredHeader(void *userData, const StaticString &name,
+		const StaticString &value)
+	{
+		return true;
+	}
+
+	string synthesizeRequest(const RequestHeaders &headers, bool chunked) const {
+		string result;
+		const string &host = headers.authority.empty() ? headers.host : headers.authority;
+
+		result.reserve(headers.method.size() + headers.path.size() + host.size()
+			+ headers.cookie.size() + headers.fields.size() + 128);
+		result.append(headers.method);
+		result.append(" ", 1);
+		result.append(headers.path);
+		result.append(" HTTP/1.1\r\n", sizeof(" HTTP/1.1\r\n") - 1);
+		if (!host.empty()) {
+			result.append("Host: ", 6);
+			result.append(host);
+			result.append("\r\n", 2);
+		}
+		result.append(headers.fields);
+		if (!headers.cookie.empty()) {
+			result.append("Cookie: ", 8);
+			result.append(headers.cookie);
+			result.append("\r\n", 2);
+		}
+		if (headers.hasContentLength) {
+			result.append("Content-Length: ", 16);
+			result.append(toString(headers.contentLength));
+			result.append("\r\n", 2);
+		} else if (chunked) {
+			result.append("Transfer-Encoding: chunked\r\n");
+		}
+		// Each stream carries exactly one request.
+		result.append("Connection: close\r\n\r\n");
+		return result;
+	}
+
+	void processHeaderBlock(boost::uint32_t streamId, bool endStream) {
+		Http2Stream *stream = findStream(streamId);
+
+		if (stream != NULL || streamId <= lastStreamId) {
+			// Trailers, or a header block for a stream that we already closed.
+			if (!hpackDecoder.decode(headerBlock.data(), headerBlock.size(),
+				onIgnoredHeader, NULL))
+			{
+				connectionError(HTTP2_COMPRESSION_ERROR);
+			} else if (stream == NULL) {
+				sendRstStream(streamId, HTTP2_STREAM_CLOSED);
+			} else if (stream->closed || stream->reset) {
+				// Ignore.
+			} else if (stream->remoteEnded) {
+				streamError(streamId, stream, HTTP2_STREAM_CLOSED);
+			} else if (!endStream) {
+				streamError(streamId, stream, HTTP2_PROTOCOL_ERROR);
+			} else {
+				endRemoteStream(stream);
+			}
+			headerBlock.clear();
+			return;
+		}
+
+		lastStreamId = streamId;
+		requestHeaders.clear();
+		if (!hpackDecoder.decode(headerBlock.data(), headerBlock.size(),
+			onRequestHeader, &requestHeaders))
+		{
+			connectionError(HTTP2_COMPRESSION_ERROR);
+			return;
+		}
+		headerBlock.clear();
+
+		if (goawaySent || streams.size() >= maxConcurrentStreams) {
+			sendRstStream(streamId, HTTP2_REFUSED_STREAM);
+			return;
+		}
+		if (requestHeaders.malformed
+		 || requestHeaders.method == P_STATIC_STRING("CONNECT")
+		 || requestHeaders.scheme.empty()
+		 || !isValidRequestLineToken(requestHeaders.method)
+		 || !isValidRequestLineToken(requestHeaders.path)
+		 || (endStream && requestHeaders.contentLength > 0))
+		{
+			sendRstStream(streamId, HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+
+		stream = createStream(streamId);
+		stream->remoteEnded = endStream;
+		stream->headRequest = requestHeaders.method == P_STATIC_STRING("HEAD");
+		stream->hasContentLength = requestHeaders.hasContentLength;
+		stream->contentLength = requestHeaders.contentLength;
+		stream->chunkedRequestBody = !endStream && !requestHeaders.hasContentLength;
+
+		string head = synthesizeRequest(requestHeaders, stream->chunkedRequestBody);
+		queueStreamInput(stream, copyToInputBuffer(head.data(), head.size()), 0);
+		openStream(stream);
+	}
+
+
+	/***** Frame handling *****/
+
+	void beginDataFrame() {
+		if (frameStreamId == 0) {
+			connectionError(HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+		if (frameLength > connRecvWindow) {
+			connectionError(HTTP2_FLOW_CONTROL_ERROR);
+			return;
+		}
+		connRecvWindow -= frameLength;
+
+		dataStream = findStream(frameStreamId);
+		if (dataStream == NULL) {
+			if (frameStreamId > lastStreamId) {
+				connectionError(HTTP2_PROTOCOL_ERROR);
+				return;
+			}
+			// The stream was closed by us; the peer may not know that yet.
+			creditConnection(frameLength);
+		} else if (dataStream->closed || dataStream->reset) {
+			dataStream = NULL;
+			creditConnection(frameLength);
+		} else if (dataStream->remoteEnded) {
+			streamError(frameStreamId, dataStream, HTTP2_STREAM_CLOSED);
+			dataStream = NULL;
+			creditConnection(frameLength);
+		} else if (frameLength > dataStream->recvWindow) {
+			streamError(frameStreamId, dataStream, HTTP2_FLOW_CONTROL_ERROR);
+			dataStream = NULL;
+			creditConnection(frameLength);
+		} else {
+			dataStream->recvWindow -= frameLength;
+		}
+
+		dataRemaining = frameLength;
+		dataPadding = 0;
+		dataPadLengthPending = frameFlags & FLAG_PADDED;
+		if (dataPadLengthPending && frameLength == 0) {
+			connectionError(HTTP2_FRAME_SIZE_ERROR);
+			return;
+		}
+
+		inputState = READING_DATA_PAYLOAD;
+		if (frameLength == 0) {
+			endDataFrame();
+		}
+	}
+
+	/** Returns whether `dataStream` can still receive data. */
+	bool dataStreamAlive() const {
+		return dataStream != NULL && !dataStream->closed && !dataStream->reset;
+	}
+
+	/** Accounts for DATA frame bytes that are not passed on to the stream. */
+	void discardDataBytes(unsigned int size) {
+		if (dataStreamAlive()) {
+			creditStream(dataStream, size);
+		} else if (dataStream != NULL) {
+			// Stream was closed while processing this frame,
+			// and closeStream() did not account for these bytes.
+			creditConnection(size);
+		}
+	}
+
+	const char *processDataPayload(const MemoryKit::mbuf &buffer, const char *pos,
+		const char *end)
+	{
+		if (dataPadLengthPending) {
+			dataPadLengthPending = false;
+			dataPadding = (unsigned char) *pos;
+			pos++;
+			dataRemaining--;
+			if (dataPadding > dataRemaining) {
+				connectionError(HTTP2_PROTOCOL_ERROR);
+				return end;
+			}
+			discardDataBytes(1);
+		}
+
+		if (dataRemaining > dataPadding) {
+			unsigned int size = (unsigned int) std::min<size_t>(end - pos,
+				dataRemaining - dataPadding);
+			if (dataStreamAlive()) {
+				appendStreamBody(dataStream, MemoryKit::mbuf(buffer,
+					pos - buffer.start, size));
+			} else if (dataStream != NULL) {
+				creditConnection(size);
+			}
+			pos += size;
+			dataRemaining -= size;
+		} else {
+			unsigned int size = (unsigned int) std::min<size_t>(end - pos, dataRemaining);
+			discardDataBytes(size);
+			pos += size;
+			dataRemaining -= size;
+			dataPadding -= size;
+		}
+
+		if (dataRemaining == 0 && inputState == READING_DATA_PAYLOAD) {
+			endDataFrame();
+		}
+		return pos;
+	}
+
+	void appendStreamBody(Http2Stream *stream, const MemoryKit::mbuf &data) {
+		stream->bodyBytesReceived += data.size();
+		if (stream->hasContentLength && stream->bodyBytesReceived > stream->contentLength) {
+			creditConnection(data.size());
+			streamError(stream->id, stream, HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+
+		if (stream->chunkedRequestBody) {
+			char header[sizeof("ffffffff\r\n")];
+			int size = snprintf(header, sizeof(header), "%x\r\n",
+				(unsigned int) data.size());
+			queueStreamInput(stream, copyToInputBuffer(header, size), 0);
+			queueStreamInput(stream, data, data.size());
+			queueStreamInput(stream, MemoryKit::mbuf("\r\n", 2), 0);
+		} else {
+			queueStreamInput(stream, data, data.size());
+		}
+		handler->onHttp2StreamInput(this, stream);
+	}
+
+	void endDataFrame() {
+		inputState = READING_FRAME_HEADER;
+		if (dataStreamAlive() && (frameFlags & FLAG_END_STREAM)) {
+			endRemoteStream(dataStream);
+		}
+		dataStream = NULL;
+	}
+
+	void processFrameHeader() {
+		frameLength = ((unsigned int) frameHeader[0] << 16)
+			| ((unsigned int) frameHeader[1] << 8)
+			| (unsigned int) frameHeader[2];
+		frameType = frameHeader[3];
+		frameFlags = frameHeader[4];
+		frameStreamId = readUint32(frameHeader + 5) & MAX_WINDOW_SIZE;
+
+		if (frameLength > DEFAULT_MAX_FRAME_SIZE) {
+			connectionError(HTTP2_FRAME_SIZE_ERROR);
+			return;
+		}
+		if (headerBlockStreamId != 0
+		 && (frameType != CONTINUATION_FRAME || frameStreamId != headerBlockStreamId))
+		{
+			connectionError(HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+
+		if (frameType == DATA_FRAME) {
+			beginDataFrame();
+		} else {
+			framePayload.clear();
+			if (frameLength == 0) {
+				inputState = READING_FRAME_HEADER;
+				processFrame();
+			} else {
+				inputState = READING_FRAME_PAYLOAD;
+			}
+		}
+	}
+
+	void processFrame() {
+		switch (frameType) {
+		case HEADERS_FRAME:
+			processHeadersFrame();
+			break;
+		case PRIORITY_FRAME:
+			if (frameStreamId == 0) {
+				connectionError(HTTP2_PROTOCOL_ERROR);
+			} else if (frameLength != 5) {
+				streamError(frameStreamId, findStream(frameStreamId),
+					HTTP2_FRAME_SIZE_ERROR);
+			}
+			break;
+		case RST_STREAM_FRAME:
+			processRstStreamFrame();
+			break;
+		case SETTINGS_FRAME:
+			processSettingsFrame();
+			break;
+		case PUSH_PROMISE_FRAME:
+			// Clients may not push.
+			connectionError(HTTP2_PROTOCOL_ERROR);
+			break;
+		case PING_FRAME:
+			if (frameStreamId != 0) {
+				connectionError(HTTP2_PROTOCOL_ERROR);
+			} else if (frameLength != 8) {
+				connectionError(HTTP2_FRAME_SIZE_ERROR);
+			} else if (!(frameFlags & FLAG_ACK)) {
+				writeFrameHeader(8, PING_FRAME, FLAG_ACK, 0);
+				appendOutput(framePayload.data(), 8);
+			}
+			break;
+		case GOAWAY_FRAME:
+			if (frameStreamId != 0) {
+				connectionError(HTTP2_PROTOCOL_ERROR);
+			} else if (frameLength < 8) {
+				connectionError(HTTP2_FRAME_SIZE_ERROR);
+			} else {
+				// We never initiate streams, so there is nothing to retry.
+				// Existing streams run to completion.
+				goawayReceived = true;
+			}
+			break;
+		case WINDOW_UPDATE_FRAME:
+			processWindowUpdateFrame();
+			break;
+		case CONTINUATION_FRAME:
+			if (headerBlockStreamId == 0) {
+				connectionError(HTTP2_PROTOCOL_ERROR);
+				break;
+			}
+			if (headerBlock.size() + framePayload.size() > MAX_HEADER_BLOCK_SIZE) {
+				connectionError(HTTP2_ENHANCE_YOUR_CALM);
+				break;
+			}
+			headerBlock.append(framePayload);
+			if (frameFlags & FLAG_END_HEADERS) {
+				boost::uint32_t streamId = headerBlockStreamId;
+				headerBlockStreamId = 0;
+				processHeaderBlock(streamId, headerBlockEndStream);
+			}
+			break;
+		default:
+			// Unknown frame types must be ignored.
+			break;
+		}
+	}
+
+	void processHeadersFrame() {
+		const unsigned char *payload = (const unsigned char *) framePayload.data();
+		unsigned int pos = 0;
+		unsigned int padLength = 0;
+
+		if (frameStreamId == 0 || frameStreamId % 2 == 0) {
+			connectionError(HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+		if (frameFlags & FLAG_PADDED) {
+			if (frameLength < 1) {
+				connectionError(HTTP2_FRAME_SIZE_ERROR);
+				return;
+			}
+			padLength = payload[0];
+			pos++;
+		}
+		if (frameFlags & FLAG_PRIORITY) {
+			if (frameLength < pos + 5) {
+				connectionError(HTTP2_FRAME_SIZE_ERROR);
+				return;
+			}
+			pos += 5;
+		}
+		if (padLength > frameLength - pos) {
+			connectionError(HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+
+		headerBlock.assign(framePayload, pos, frameLength - pos - padLength);
+		headerBlockEndStream = frameFlags & FLAG_END_STREAM;
+		if (frameFlags & FLAG_END_HEADERS) {
+			processHeaderBlock(frameStreamId, headerBlockEndStream);
+		} else {
+			headerBlockStreamId = frameStreamId;
+		}
+	}
+
+	void processRstStreamFrame() {
+		if (frameStreamId == 0 || frameStreamId > lastStreamId) {
+			connectionError(HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+		if (frameLength != 4) {
+			connectionError(HTTP2_FRAME_SIZE_ERROR);
+			return;
+		}
+
+		Http2Stream *stream = findStream(frameStreamId);
+		if (stream != NULL && !stream->closed && !stream->reset) {
+			stream->reset = true;
+			stream->remoteEnded = true;
+			stream->responseEnded = true;
+			handler->onHttp2StreamReset(this, stream, (Http2ErrorCode)
+				readUint32((const unsigned char *) framePayload.data()));
+		}
+	}
+
+	void processSettingsFrame() {
+		if (frameStreamId != 0) {
+			connectionError(HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+		if (frameFlags & FLAG_ACK) {
+			if (frameLength != 0) {
+				connectionError(HTTP2_FRAME_SIZE_ERROR);
+			}
+			return;
+		}
+
+		Http2ErrorCode code = applySettings((const unsigned char *) framePayload.data(),
+			frameLength);
+		if (code != HTTP2_NO_ERROR) {
+			connectionError(code);
+		} else {
+			writeFrameHeader(0, SETTINGS_FRAME, FLAG_ACK, 0);
+			notifyWritableStreams();
+		}
+	}
+
+	Http2ErrorCode applySettings(const unsigned char *payload, unsigned int size) {
+		if (size % 6 != 0) {
+			return HTTP2_FRAME_SIZE_ERROR;
+		}
+
+		for (unsigned int pos = 0; pos < size; pos += 6) {
+			unsigned int id = ((unsigned int) payload[pos] << 8) | payload[pos + 1];
+			boost::uint32_t value = readUint32(payload + pos + 2);
+
+			switch (id) {
+			case SETTINGS_ENABLE_PUSH:
+				if (value > 1) {
+					return HTTP2_PROTOCOL_ERROR;
+				}
+				break;
+			case SETTINGS_INITIAL_WINDOW_SIZE: {
+				if (value > MAX_WINDOW_SIZE) {
+					return HTTP2_FLOW_CONTROL_ERROR;
+				}
+				boost::int64_t delta = (boost::int64_t) value - peerInitialWindowSize;
+				StreamMap::iterator it, end = streams.end();
+				for (it = streams.begin(); it != end; it++) {
+					it->second->sendWindow += delta;
+					if (it->second->sendWindow > MAX_WINDOW_SIZE) {
+						return HTTP2_FLOW_CONTROL_ERROR;
+					}
+				}
+				peerInitialWindowSize = value;
+				break;
+			}
+			case SETTINGS_MAX_FRAME_SIZE:
+				if (value < DEFAULT_MAX_FRAME_SIZE || value > 0xffffff) {
+					return HTTP2_PROTOCOL_ERROR;
+				}
+				peerMaxFrameSize = value;
+				break;
+			default:
+				// We don't use the dynamic table for encoding, don't push,
+				// and don't limit header list sizes, so the other settings
+				// don't affect us. Unknown settings must be ignored.
+				break;
+			}
+		}
+		return HTTP2_NO_ERROR;
+	}
+
+	void processWindowUpdateFrame() {
+		if (frameLength != 4) {
+			connectionError(HTTP2_FRAME_SIZE_ERROR);
+			return;
+		}
+
+		boost::uint32_t increment = readUint32((const unsigned char *) framePayload.data())
+			& MAX_WINDOW_SIZE;
+		if (frameStreamId == 0) {
+			if (increment == 0) {
+				connectionError(HTTP2_PROTOCOL_ERROR);
+				return;
+			}
+			connSendWindow += increment;
+			if (connSendWindow > MAX_WINDOW_SIZE) {
+				connectionError(HTTP2_FLOW_CONTROL_ERROR);
+				return;
+			}
+			notifyWritableStreams();
+		} else {
+			Http2Stream *stream = findStream(frameStreamId);
+			if (stream == NULL) {
+				if (frameStreamId > lastStreamId) {
+					connectionError(HTTP2_PROTOCOL_ERROR);
+				}
+				return;
+			}
+			if (increment == 0) {
+				streamError(frameStreamId, stream, HTTP2_PROTOCOL_ERROR);
+				return;
+			}
+			stream->sendWindow += increment;
+			if (stream->sendWindow > MAX_WINDOW_SIZE) {
+				streamError(frameStreamId, stream, HTTP2_FLOW_CONTROL_ERROR);
+				return;
+			}
+			notifyWritableStreams();
+		}
+	}
+
+
+	/***** Response translation *****/
+
+	static const http_parser_settings *getResponseParserSettings() {
+		static http_parser_settings settings;
+		static bool initialized = false;
+		if (!initialized) {
+			memset(&settings, 0, sizeof(settings));
+			settings.on_header_field = onResponseHeaderField;
+			settings.on_header_value = onResponseHeaderValue;
+			settings.on_headers_complete = onResponseHeadersComplete;
+			settings.on_body = onResponseBody;
+			settings.on_message_complete = onResponseMessageComplete;
+			initialized = true;
+		}
+		return &settings;
+	}
+
+	static void addResponseHeader(Http2Stream *stream) {
+		if (!stream->responseHeaderName.empty()) {
+			const StaticString name(stream->responseHeaderName);
+			if (!isConnectionSpecificHeader(name)
+			 && name != P_STATIC_STRING("status")
+			 && isValidHeaderName(name)
+			 && isValidHeaderValue(stream->responseHeaderValue))
+			{
+				HpackEncoder::encodeHeader(stream->responseHeaderBlock, name,
+					stream->responseHeaderValue);
+			}
+		}
+		stream->responseHeaderName.clear();
+		stream->responseHeaderValue.clear();
+	}
+
+	static int onResponseHeaderField(http_parser *parser, const char *data, size_t size) {
+		Http2Stream *stream = static_cast<Http2Stream *>(parser->data);
+		if (stream->lastResponseHeaderCallbackWasValue) {
+			addResponseHeader(stream);
+			stream->lastResponseHeaderCallbackWasValue = false;
+		}
+		for (size_t i = 0; i < size; i++) {
+			char ch = data[i];
+			if (ch >= 'A' && ch <= 'Z') {
+				ch = ch - 'A' + 'a';
+			}
+			stream->responseHeaderName.append(1, ch);
+		}
+		return 0;
+	}
+
+	static int onResponseHeaderValue(http_parser *parser, const char *data, size_t size) {
+		Http2Stream *stream = static_cast<Http2Stream *>(parser->data);
+		stream->lastResponseHeaderCallbackWasValue = true;
+		stream->responseHeaderValue.append(data, size);
+		return 0;
+	}
+
+	static int onResponseHeadersComplete(http_parser *parser) {
+		Http2Stream *stream = static_cast<Http2Stream *>(parser->data);
+		string headers;
+
+		addResponseHeader(stream);
+		stream->lastResponseHeaderCallbackWasValue = false;
+		if (parser->status_code >= 100 && parser->status_code < 200) {
+			// Interim responses are dropped; see onResponseMessageComplete().
+			stream->responseHeaderBlock.clear();
+			return 0;
+		}
+
+		headers.reserve(stream->responseHeaderBlock.size() + 5);
+		HpackEncoder::encodeStatus(headers, parser->status_code);
+		headers.append(stream->responseHeaderBlock);
+		stream->responseHeaderBlock.swap(headers);
+		stream->responseHeadersComplete = true;
+		stream->responseHeadersPending = true;
+
+		// Pause so that writeResponse() can limit the body to the flow control window.
+		// The parser stops before the final LF of the header, so that byte has to be
+		// let through on top of the window.
+		http_parser_pause(parser, 1);
+		stream->responseHeaderTerminatorPending = true;
+		return stream->headRequest ? 1 : 0;
+	}
+
+	static int onResponseBody(http_parser *parser, const char *data, size_t size) {
+		Http2Stream *stream = static_cast<Http2Stream *>(parser->data);
+		Http2Session *self = stream->session;
+
+		self->sendPendingResponseHeaders(stream, false);
+		while (size > 0) {
+			unsigned int frameSize = (unsigned int) std::min<size_t>(size,
+				self->peerMaxFrameSize);
+			self->sendDataFrame(stream, stream->currentResponseBuffer, data,
+				frameSize, false);
+			stream->sendWindow -= frameSize;
+			self->connSendWindow -= frameSize;
+			data += frameSize;
+			size -= frameSize;
+		}
+		return 0;
+	}
+
+	static int onResponseMessageComplete(http_parser *parser) {
+		Http2Stream *stream = static_cast<Http2Stream *>(parser->data);
+		Http2Session *self = stream->session;
+
+		if (parser->status_code >= 100 && parser->status_code < 200) {
+			return 0;
+		}
+		if (stream->responseHeadersPending) {
+			self->sendPendingResponseHeaders(stream, true);
+		} else {
+			self->sendDataFrame(stream, NULL, "", 0, true);
+		}
+		stream->responseEnded = true;
+		http_parser_pause(parser, 1);
+		return 0;
+	}
+
+	void sendPendingResponseHeaders(Http2Stream *stream, bool endStream) {
+		if (stream->responseHeadersPending) {
+			stream->responseHeadersPending = false;
+			sendHeaderBlock(stream, stream->responseHeaderBlock, endStream);
+			stream->responseHeaderBlock.clear();
+		}
+	}
+
+	void failResponse(Http2Stream *stream) {
+		stream->responseHeadersPending = false;
+		streamError(stream->id, stream, HTTP2_INTERNAL_ERROR);
+	}
+
+public:
+	/** Free for use by the Http2SessionHandler. */
+	void *userData;
+
+	Http2Session(Context *context, Http2SessionHandler *_handler,
+		unsigned int _maxConcurrentStreams = 100)
+		: ctx(context),
+		  handler(_handler),
+		  inputState(READING_PREFACE),
+		  prefaceBytesRead(0),
+		  frameHeaderBytesRead(0),
+		  frameLength(0),
+		  frameType(0),
+		  frameFlags(0),
+		  frameStreamId(0),
+		  dataStream(NULL),
+		  dataRemaining(0),
+		  dataPadding(0),
+		  dataPadLengthPending(false),
+		  headerBlockStreamId(0),
+		  headerBlockEndStream(false),
+		  lastStreamId(0),
+		  maxConcurrentStreams(std::max(1u, _maxConcurrentStreams)),
+		  peerInitialWindowSize(DEFAULT_WINDOW_SIZE),
+		  peerMaxFrameSize(DEFAULT_MAX_FRAME_SIZE),
+		  connSendWindow(DEFAULT_WINDOW_SIZE),
+		  connRecvWindow(DEFAULT_WINDOW_SIZE),
+		  connRecvWindowSize(DEFAULT_WINDOW_SIZE),
+		  connRecvUnacked(0),
+		  outputUsed(0),
+		  callDepth(0),
+		  started(false),
+		  goawaySent(false),
+		  goawayReceived(false),
+		  failed(false),
+		  outputBlocked(false),
+		  finishNotified(false),
+		  destroyRequested(false),
+		  userData(NULL)
+	{
+		requestHeaders.clear();
+	}
+
+	~Http2Session() {
+		StreamMap::iterator it, end = streams.end();
+		for (it = streams.begin(); it != end; it++) {
+			delete it->second;
+		}
+		for (unsigned int i = 0; i < closedStreams.size(); i++) {
+			delete closedStreams[i];
+		}
+	}
+
+	/**
+	 * Deletes the session once the outermost call into it has returned (or
+	 * immediately if there is none). The handler is not called anymore.
+	 */
+	void destroy() {
+		destroyRequested = true;
+		if (callDepth == 0) {
+			delete this;
+		}
+	}
+
+	/**
+	 * Sends the server connection preface. Must be called before anything
+	 * else, except for `applySettingsHeader()`.
+	 */
+	void start() {
+		CallGuard guard(this);
+		assert(!started);
+		started = true;
+		sendSettings();
+
+		// Allow every stream to use its full window at the same time, so that
+		// streams whose consumer is slow don't stall the other streams.
+		boost::uint64_t windowSize = (boost::uint64_t) maxConcurrentStreams * DEFAULT_WINDOW_SIZE;
+		connRecvWindowSize = (boost::uint32_t) std::min<boost::uint64_t>(windowSize, MAX_WINDOW_SIZE);
+		if (connRecvWindowSize > DEFAULT_WINDOW_SIZE) {
+			sendWindowUpdate(0, connRecvWindowSize - DEFAULT_WINDOW_SIZE);
+			connRecvWindow = connRecvWindowSize;
+		}
+	}
+
+	/**
+	 * Applies the base64url-encoded SETTINGS payload of an HTTP2-Settings
+	 * request header (RFC 7540 section 3.2.1). Returns false if it's invalid.
+	 */
+	bool applySettingsHeader(const StaticString &value) {
+		string base64(value.data(), value.size());
+		string payload;
+
+		for (string::size_type i = 0; i < base64.size(); i++) {
+			if (base64[i] == '-') {
+				base64[i] = '+';
+			} else if (base64[i] == '_') {
+				base64[i] = '/';
+			}
+		}
+		while (base64.size() % 4 != 0) {
+			base64.append(1, '=');
+		}
+		try {
+			payload = modp::b64_decode(base64.data(), base64.size());
+		} catch (const std::runtime_error &) {
+			return false;
+		}
+		return applySettings((const unsigned char *) payload.data(),
+			payload.size()) == HTTP2_NO_ERROR;
+	}
+
+	/**
+	 * Opens stream 1 for a request that was received over HTTP/1.1 with
+	 * `Upgrade: h2c` (RFC 7540 section 3.2). `head` is the request, already
+	 * synthesized by the caller in the same form as other streams (see
+	 * Http2Stream). The request may not have a body.
+	 */
+	void openUpgradedStream(const StaticString &head) {
+		CallGuard guard(this);
+		assert(started);
+		assert(lastStreamId == 0);
+		lastStreamId = 1;
+
+		Http2Stream *stream = createStream(1);
+		stream->remoteEnded = true;
+		stream->headRequest = head.size() >= 5 && memcmp(head.data(), "HEAD ", 5) == 0;
+		queueStreamInput(stream, copyToInputBuffer(head.data(), head.size()), 0);
+		openStream(stream);
+	}
+
+	/**
+	 * Processes connection data. Protocol errors are handled internally by
+	 * sending GOAWAY; after that, further data is ignored and the session
+	 * eventually reports `onHttp2SessionFinished()`.
+	 */
+	void feed(const MemoryKit::mbuf &buffer) {
+		CallGuard guard(this);
+		const char *pos = buffer.start;
+		const char *end = buffer.end;
+
+		while (pos < end && !destroyRequested) {
+			switch (inputState) {
+			case READING_PREFACE: {
+				size_t size = std::min<size_t>(end - pos,
+					CONNECTION_PREFACE_SIZE - prefaceBytesRead);
+				if (memcmp(pos, getConnectionPreface() + prefaceBytesRead, size) != 0) {
+					connectionError(HTTP2_PROTOCOL_ERROR);
+					return;
+				}
+				prefaceBytesRead += size;
+				pos += size;
+				if (prefaceBytesRead == CONNECTION_PREFACE_SIZE) {
+					inputState = READING_FRAME_HEADER;
+				}
+				break;
+			}
+			case READING_FRAME_HEADER: {
+				size_t size = std::min<size_t>(end - pos,
+					FRAME_HEADER_SIZE - frameHeaderBytesRead);
+				memcpy(frameHeader + frameHeaderBytesRead, pos, size);
+				frameHeaderBytesRead += size;
+				pos += size;
+				if (frameHeaderBytesRead == FRAME_HEADER_SIZE) {
+					frameHeaderBytesRead = 0;
+					processFrameHeader();
+				}
+				break;
+			}
+			case READING_FRAME_PAYLOAD: {
+				size_t size = std::min<size_t>(end - pos,
+					frameLength - framePayload.size());
+				framePayload.append(pos, size);
+				pos += size;
+				if (framePayload.size() == frameLength) {
+					inputState = READING_FRAME_HEADER;
+					processFrame();
+				}
+				break;
+			}
+			case READING_DATA_PAYLOAD:
+				pos = processDataPayload(buffer, pos, end);
+				break;
+			case DISCARDING_INPUT:
+				return;
+			}
+		}
+	}
+
+	/**
+	 * Takes the next buffer of synthesized request data from the stream, and
+	 * returns the flow control credit for it to the peer. Returns an empty
+	 * buffer if there is none.
+	 */
+	MemoryKit::mbuf takeStreamInput(Http2Stream *stream) {
+		CallGuard guard(this);
+		if (stream->input.empty()) {
+			return MemoryKit::mbuf();
+		}
+
+		Http2Stream::InputBuffer &front = stream->input.front();
+		MemoryKit::mbuf result(front.data);
+		unsigned int flowControlled = front.flowControlled;
+		stream->input.pop_front();
+		if (flowControlled > 0) {
+			creditStream(stream, flowControlled);
+		}
+		return result;
+	}
+
+	bool hasStreamInput(const Http2Stream *stream) const {
+		return !stream->input.empty();
+	}
+
+	/**
+	 * Writes HTTP/1.x response data for the given stream. Returns the number
+	 * of bytes consumed, or -1 if no data can be accepted right now, in which
+	 * case `onHttp2StreamWritable()` will be called later. Data written after
+	 * the response or the stream has ended is discarded.
+	 */
+	int writeResponse(Http2Stream *stream, const MemoryKit::mbuf &buffer) {
+		CallGuard guard(this);
+		size_t consumed = 0;
+
+		if (stream->closed || stream->responseEnded || failed) {
+			return buffer.size();
+		}
+
+		stream->currentResponseBuffer = &buffer;
+		while (consumed < buffer.size()) {
+			size_t size = buffer.size() - consumed;
+			bool headersComplete = stream->responseHeadersComplete;
+			if (headersComplete) {
+				// We're in the body. Limit it to the flow control window.
+				boost::int64_t window = getSendWindow(stream);
+				if (window == 0 || outputBlocked) {
+					break;
+				}
+				size = (size_t) std::min<boost::int64_t>(size,
+					window + stream->responseHeaderTerminatorPending);
+			}
+
+			size_t ret = http_parser_execute(&stream->responseParser,
+				getResponseParserSettings(), buffer.start + consumed, size);
+			consumed += ret;
+			if (headersComplete) {
+				stream->responseHeaderTerminatorPending = false;
+			}
+			if (HTTP_PARSER_ERRNO(&stream->responseParser) == HPE_PAUSED) {
+				http_parser_pause(&stream->responseParser, 0);
+			} else if (HTTP_PARSER_ERRNO(&stream->responseParser) != HPE_OK
+			        || stream->responseParser.upgrade)
+			{
+				failResponse(stream);
+				consumed = buffer.size();
+				break;
+			}
+			if (stream->responseEnded) {
+				// Anything after the response is discarded.
+				consumed = buffer.size();
+				break;
+			}
+		}
+		stream->currentResponseBuffer = NULL;
+
+		// Don't hold back the headers until the first body data arrives.
+		if (!stream->responseEnded) {
+			sendPendingResponseHeaders(stream, false);
+		}
+
+		if (consumed == 0) {
+			stream->waitingForWindow = true;
+			return -1;
+		} else {
+			return consumed;
+		}
+	}
+
+	/**
+	 * Tells the session that the response for this stream has been fully written.
+	 * If the response is incomplete, the stream is reset.
+	 */
+	void endResponse(Http2Stream *stream) {
+		CallGuard guard(this);
+		if (stream->closed || stream->responseEnded || failed) {
+			return;
+		}
+
+		// Responses that are delimited by EOF end here.
+		http_parser_execute(&stream->responseParser, getResponseParserSettings(), NULL, 0);
+		if (!stream->responseEnded) {
+			failResponse(stream);
+		}
+	}
+
+	/**
+	 * Tells the session that the user is done with the stream. If the exchange
+	 * wasn't complete, the stream is reset. The stream object is deleted later.
+	 */
+	void closeStream(Http2Stream *stream) {
+		CallGuard guard(this);
+		if (stream->closed) {
+			return;
+		}
+
+		if (!stream->reset && !failed) {
+			if (!stream->responseEnded) {
+				sendRstStream(stream->id, HTTP2_INTERNAL_ERROR);
+			} else if (!stream->remoteEnded) {
+				// RFC 7540 section 8.1: the response is complete, so
+				// ask the client to stop sending the request body.
+				sendRstStream(stream->id, HTTP2_NO_ERROR);
+			}
+		}
+
+		// Return the connection-level credit for request body data
+		// that was received, but that nobody will read anymore.
+		unsigned int unread = 0;
+		while (!stream->input.empty()) {
+			unread += stream->input.front().flowControlled;
+			stream->input.pop_front();
+		}
+		if (unread > 0) {
+			creditConnection(unread);
+		}
+
+		stream->closed = true;
+		stream->userData = NULL;
+		streams.erase(stream->id);
+		closedStreams.push_back(stream);
+	}
+
+	/**
+	 * Tells the session whether the connection's output is backed up. While it
+	 * is, `writeResponse()` accepts no more body data.
+	 */
+	void setOutputBlocked(bool blocked) {
+		CallGuard guard(this);
+		if (outputBlocked != blocked) {
+			outputBlocked = blocked;
+			if (!blocked) {
+				notifyWritableStreams();
+			}
+		}
+	}
+
+	/**
+	 * Initiates a graceful shutdown: no new streams are accepted, and the
+	 * session finishes once all current streams are closed.
+	 */
+	void goaway() {
+		CallGuard guard(this);
+		if (!goawaySent) {
+			sendGoaway(HTTP2_NO_ERROR);
+		}
+	}
+
+	bool isFinished() const {
+		return failed || ((goawaySent || goawayReceived) && streams.empty());
+	}
+
+	const StreamMap &getStreams() const {
+		return streams;
+	}
+
+	unsigned int getStreamCount() const {
+		return streams.size();
+	}
+
+	boost::uint32_t getLastStreamId() const {
+		return lastStreamId;
+	}
+
+	Json::Value inspectStateAsJson() const {
+		Json::Value doc;
+		Json::Value streamsDoc(Json::arrayValue);
+		StreamMap::const_iterator it, end = streams.end();
+
+		doc["stream_count"] = (Json::UInt) streams.size();
+		doc["last_stream_id"] = (Json::UInt) lastStreamId;
+		doc["send_window"] = (Json::Int64) connSendWindow;
+		doc["recv_window"] = (Json::Int64) connRecvWindow;
+		doc["output_blocked"] = (bool) outputBlocked;
+		doc["goaway_sent"] = (bool) goawaySent;
+		doc["goaway_received"] = (bool) goawayReceived;
+		doc["failed"] = (bool) failed;
+
+		for (it = streams.begin(); it != end; it++) {
+			const Http2Stream *stream = it->second;
+			Json::Value streamDoc;
+			streamDoc["id"] = (Json::UInt) stream->id;
+			streamDoc["send_window"] = (Json::Int64) stream->sendWindow;
+			streamDoc["recv_window"] = (Json::Int64) stream->recvWindow;
+			streamDoc["remote_ended"] = (bool) stream->remoteEnded;
+			streamDoc["response_ended"] = (bool) stream->responseEnded;
+			streamDoc["waiting_for_window"] = (bool) stream->waitingForWindow;
+			streamDoc["input_buffers"] = (Json::UInt) stream->input.size();
+			streamsDoc.append(streamDoc);
+		}
+		doc["streams"] = streamsDoc;
+		return doc;
+	}
+};
+
+
+} // namespace ServerKit
+} // namespace Passenger
+
+#endif /* _PASSENGER_SERVER_KIT_HTTP2_SESSION_H_ */
@@ -34,6 +34,9 @@ namespace Passenger {
 namespace ServerKit {
 
 
+class Http2Session;
+struct Http2Stream;
+
 template<typename Request = HttpRequest>
 class BaseHttpClient: public BaseClient {
 public:
@@ -48,11 +51,24 @@ public:
 	 */
 	Request *currentRequest;
 	unsigned int requestsBegun;
+	/**
+	 * Set if this client is a connection that was switched to HTTP/2.
+	 * Such a client has no currentRequest: its requests are handled
+	 * by stream clients.
+	 */
+	Http2Session *http2Session;
+	/**
+	 * Set if this client is not a connection, but a single stream
+	 * of an HTTP/2 connection. See `HttpServer::createHttp2StreamClient()`.
+	 */
+	Http2Stream *http2Stream;
 
 	BaseHttpClient(void *server)
 		: BaseClient(server),
 		  currentRequest(NULL),
-		  requestsBegun(0)
+		  requestsBegun(0),
+		  http2Session(NULL),
+		  http2Stream(NULL)
 		{ }
 };
 
@@ -42,6 +42,7 @@
 #include <ServerKit/HttpRequestRef.h>
 #include <ServerKit/HttpHeaderParser.h>
 #include <ServerKit/HttpChunkedBodyParser.h>
+#include <ServerKit/Http2Session.h>
 #include <Algorithms/MovingAverage.h>
 #include <Integrations/LibevJsonUtils.h>
 #include <Utils/SystemTime.h>
@@ -65,11 +66,13 @@ extern const unsigned int DEFAULT_INTERNAL_SERVER_ERROR_RESPONSE_SIZE;
  * (do not edit: following text is automatically generated
  * by 'rake configkit_schemas_inline_comments')
  *
- *   accept_burst_count           unsigned integer   -   default(32)
- *   client_freelist_limit        unsigned integer   -   default(0)
- *   min_spare_clients            unsigned integer   -   default(0)
- *   request_freelist_limit       unsigned integer   -   default(1024)
- *   start_reading_after_accept   boolean            -   default(true)
+ *   accept_burst_count             unsigned integer   -   default(32)
+ *   client_freelist_limit          unsigned integer   -   default(0)
+ *   http2                          boolean            -   default(false)
+ *   http2_max_concurrent_streams   unsigned integer   -   default(100)
+ *   min_spare_clients              unsigned integer   -   default(0)
+ *   request_freelist_limit         unsigned integer   -   default(1024)
+ *   start_reading_after_accept     boolean            -   default(true)
  *
  * END
  */
@@ -79,6 +82,8 @@ private:
 		using namespace ConfigKit;
 
 		add("request_freelist_limit", UINT_TYPE, OPTIONAL, 1024);
+		add("http2", BOOL_TYPE, OPTIONAL, false);
+		add("http2_max_concurrent_streams", UINT_TYPE, OPTIONAL, 100);
 	}
 
 public:
@@ -98,13 +103,19 @@ public:
 
 struct HttpServerConfigRealization {
 	unsigned int requestFreelistLimit;
+	unsigned int http2MaxConcurrentStreams;
+	bool http2;
 
 	HttpServerConfigRealization(const ConfigKit::Store &config)
-		: requestFreelistLimit(config["request_freelist_limit"].asUInt())
+		: requestFreelistLimit(config["request_freelist_limit"].asUInt()),
+		  http2MaxConcurrentStreams(config["http2_max_concurrent_streams"].asUInt()),
+		  http2(config["http2"].asBool())
 		{ }
 
 	void swap(HttpServerConfigRealization &other) BOOST_NOEXCEPT_OR_NOTHROW {
 		std::swap(requestFreelistLimit, other.requestFreelistLimit);
+		std::swap(http2MaxConcurrentStreams, other.http2MaxConcurrentStreams);
+		std::swap(http2, other.http2);
 	}
 };
 
@@ -157,6 +168,39 @@ private:
 
 	friend class RequestHooksImpl;
 
+	class Http2Handler: public Http2SessionHandler {
+	public:
+		HttpServer *server;
+
+		virtual void onHttp2Output(Http2Session *session, const MemoryKit::mbuf &buffer) {
+			server->onHttp2Output(session, buffer);
+		}
+
+		virtual bool onHttp2StreamOpened(Http2Session *session, Http2Stream *stream) {
+			return server->onHttp2StreamOpened(session, stream);
+		}
+
+		virtual void onHttp2StreamInput(Http2Session *session, Http2Stream *stream) {
+			server->onHttp2StreamInput(session, stream);
+		}
+
+		virtual void onHttp2StreamWritable(Http2Session *session, Http2Stream *stream) {
+			server->onHttp2StreamWritable(session, stream);
+		}
+
+		virtual void onHttp2StreamReset(Http2Session *session, Http2Stream *stream,
+			Http2ErrorCode code)
+		{
+			server->onHttp2StreamReset(session, stream, code);
+		}
+
+		virtual void onHttp2SessionFinished(Http2Session *session) {
+			server->onHttp2SessionFinished(session);
+		}
+	};
+
+	friend class Http2Handler;
+
 
 	/***** Configuration *****/
 
@@ -166,6 +210,7 @@ private:
 	/***** Working state *****/
 
 	RequestHooksImpl requestHooksImpl;
+	Http2Handler http2Handler;
 	object_pool<HttpHeaderParserState> headerParserStatePool;
 
 
@@ -326,6 +371,15 @@ private:
 	{
 		if (buffer.size() > 0) {
 			size_t ret;
+
+			if (OXT_UNLIKELY(shouldSwitchToHttp2WithPriorKnowledge(client, req, buffer))) {
+				SKC_DEBUG(client, "Client sent the HTTP/2 connection preface; switching to HTTP/2");
+				switchToHttp2(client, req, createHttp2Session(client));
+				client->http2Session->start();
+				client->http2Session->feed(buffer);
+				return Channel::Result(buffer.size(), false);
+			}
+
 			SKC_TRACE(client, 3, "Parsing " << buffer.size() <<
 				" bytes of HTTP header: \"" << cEscapeString(StaticString(
 					buffer.start, buffer.size())) << "\"");
@@ -366,7 +420,13 @@ private:
 				return Channel::Result(ret, false);
 			case Request::UPGRADED:
 				assert(!req->wantKeepAlive);
-				if (supportsUpgrade(client, req)) {
+				if (isHttp2UpgradeRequest(client, req)) {
+					if (upgradeToHttp2(client, req)) {
+						return Channel::Result(ret, false);
+					} else {
+						return Channel::Result(0, true);
+					}
+				} else if (supportsUpgrade(client, req)) {
 					SKC_TRACE(client, 2, "Expecting connection upgrade");
 					onRequestBegin(client, req);
 					return Channel::Result(ret, false);
@@ -603,6 +663,251 @@ private:
 	}
 
 
+	/***** HTTP/2 *****/
+
+	static Client *getHttp2ConnectionClient(Http2Session *session) {
+		return static_cast<Client *>(static_cast<BaseClient *>(session->userData));
+	}
+
+	static Client *getHttp2StreamClient(Http2Stream *stream) {
+		return static_cast<Client *>(static_cast<BaseClient *>(stream->userData));
+	}
+
+	static void appendLString(string &str, const LString *lstr) {
+		const LString::Part *part = lstr->start;
+		while (part != NULL) {
+			str.append(part->data, part->size);
+			part = part->next;
+		}
+	}
+
+	bool shouldSwitchToHttp2WithPriorKnowledge(Client *client, Request *req,
+		const MemoryKit::mbuf &buffer) const
+	{
+		// We only look at the first bytes of the connection. The connection
+		// preface starts with "PRI * HTTP/2.0", which is not a request that
+		// we would otherwise accept.
+		return configRlz.http2
+			&& client->requestsBegun == 0
+			&& client->http2Stream == NULL
+			&& req->parserState.headerParser->state == HttpHeaderParserState::PARSING_NOT_STARTED
+			&& buffer.size() >= 4
+			&& memcmp(buffer.start, "PRI ", 4) == 0;
+	}
+
+	bool isHttp2UpgradeRequest(Client *client, Request *req) const {
+		if (!configRlz.http2 || client->http2Stream != NULL || client->requestsBegun > 0) {
+			return false;
+		}
+
+		const LString *upgrade = req->headers.lookup(P_STATIC_STRING("upgrade"));
+		return upgrade != NULL
+			&& psg_lstr_cmp(upgrade, P_STATIC_STRING("h2c"))
+			&& req->headers.lookup(P_STATIC_STRING("http2-settings")) != NULL;
+	}
+
+	Http2Session *createHttp2Session(Client *client) {
+		Http2Session *session = new Http2Session(this->getContext(), &http2Handler,
+			configRlz.http2MaxConcurrentStreams);
+		session->userData = static_cast<BaseClient *>(client);
+		return session;
+	}
+
+	/**
+	 * Releases the current (HTTP/1) request object and turns the client into
+	 * an HTTP/2 connection. The caller must start the session.
+	 */
+	void switchToHttp2(Client *client, Request *req, Http2Session *session) {
+		deinitializeRequestAndAddToFreelist(client, req);
+		client->currentRequest = NULL;
+		unrefRequest(req, __FILE__, __LINE__);
+		client->http2Session = session;
+	}
+
+	/**
+	 * Handles an HTTP/1.1 request with `Upgrade: h2c` (RFC 7540 section 3.2).
+	 * The request itself becomes stream 1 of the new HTTP/2 connection.
+	 * Returns false if the request was ended with an error instead.
+	 */
+	bool upgradeToHttp2(Client *client, Request *req) {
+		Http2Session *session;
+		string settings, head;
+
+		SKC_DEBUG(client, "Upgrading connection to HTTP/2");
+
+		// Serialize the request before switchToHttp2() frees it. Hop-by-hop
+		// headers are left out, just like for other HTTP/2 requests.
+		head.append(http_method_str(req->method));
+		head.append(" ", 1);
+		appendLString(head, &req->path);
+		head.append(" HTTP/1.1\r\n");
+		HeaderTable::Iterator it(req->headers);
+		while (*it != NULL) {
+			const LString *key = &it->header->key;
+			if (!psg_lstr_cmp(key, P_STATIC_STRING("connection"))
+			 && !psg_lstr_cmp(key, P_STATIC_STRING("upgrade"))
+			 && !psg_lstr_cmp(key, P_STATIC_STRING("http2-settings"))
+			 && !psg_lstr_cmp(key, P_STATIC_STRING("keep-alive")))
+			{
+				appendLString(head, &it->header->origKey);
+				head.append(": ", 2);
+				appendLString(head, &it->header->val);
+				head.append("\r\n", 2);
+			}
+			it.next();
+		}
+		head.append("Connection: close\r\n\r\n");
+
+		session = createHttp2Session(client);
+		appendLString(settings, req->headers.lookup(P_STATIC_STRING("http2-settings")));
+		if (!session->applySettingsHeader(settings)) {
+			session->destroy();
+			req->httpState = Request::COMPLETE;
+			endAsBadRequest(&client, &req, "Invalid HTTP2-Settings header\n");
+			return false;
+		}
+
+		// Everything after the request belongs to the HTTP/2 connection and
+		// is passed to the session by onClientDataReceived().
+		switchToHttp2(client, req, session);
+		client->output.feed("HTTP/1.1 101 Switching Protocols\r\n"
+			"Connection: Upgrade\r\n"
+			"Upgrade: h2c\r\n\r\n");
+		client->http2Session->start();
+		client->http2Session->openUpgradedStream(head);
+		return true;
+	}
+
+	Channel::Result processHttp2ConnectionData(Client *client, const MemoryKit::mbuf &buffer,
+		int errcode)
+	{
+		if (buffer.size() > 0) {
+			client->http2Session->feed(buffer);
+			return Channel::Result(buffer.size(), false);
+		} else {
+			if (errcode != 0) {
+				SKC_DEBUG(client, "HTTP/2 connection receive error: " <<
+					getErrorDesc(errcode) << " (errno=" << errcode << ")");
+			}
+			this->disconnect(&client);
+			return Channel::Result(0, true);
+		}
+	}
+
+	/**
+	 * Creates a client object that represents a single HTTP/2 stream. Request
+	 * data is fed into its input channel, and its output channel passes the
+	 * response to the session. Apart from that, it's a normal client with a
+	 * single HTTP/1.1 request, so that HttpServer subclasses can handle it
+	 * like any other request.
+	 */
+	Client *createHttp2StreamClient(Http2Stream *stream) {
+		Client *sc = this->createDetachedClient();
+		sc->http2Stream = stream;
+		sc->output.sinkCallback = onHttp2StreamOutputData;
+		stream->userData = static_cast<BaseClient *>(sc);
+		SKC_TRACE(sc, 2, "Created client for HTTP/2 stream " << stream->id);
+		onClientAccepted(sc);
+		this->unrefClient(sc, __FILE__, __LINE__);
+		return sc;
+	}
+
+	void pumpHttp2StreamInput(Client *sc) {
+		this->refClient(sc, __FILE__, __LINE__);
+		while (sc->http2Stream != NULL
+		 && sc->http2Stream->session->hasStreamInput(sc->http2Stream))
+		{
+			if (!sc->input.acceptingInput()) {
+				if (!sc->input.ended()) {
+					sc->input.setConsumedCallback(onHttp2StreamInputConsumed);
+				}
+				break;
+			}
+			sc->input.feed(sc->http2Stream->session->takeStreamInput(sc->http2Stream));
+		}
+		this->unrefClient(sc, __FILE__, __LINE__);
+	}
+
+	void disconnectHttp2Streams(Http2Session *session) {
+		vector<Client *> streamClients;
+		Http2Session::StreamMap::const_iterator it, end = session->getStreams().end();
+
+		for (it = session->getStreams().begin(); it != end; it++) {
+			if (it->second->userData != NULL) {
+				streamClients.push_back(getHttp2StreamClient(it->second));
+			}
+		}
+		for (unsigned int i = 0; i < streamClients.size(); i++) {
+			Client *sc = streamClients[i];
+			this->disconnect(&sc);
+		}
+	}
+
+	void onHttp2Output(Http2Session *session, const MemoryKit::mbuf &buffer) {
+		Client *client = getHttp2ConnectionClient(session);
+		if (client->http2Session != session || client->output.ended()) {
+			return;
+		}
+
+		client->output.feed(buffer);
+		if (client->connected()
+		 && client->output.passedThreshold()
+		 && client->output.getBuffersFlushedCallback() == NULL)
+		{
+			SKC_TRACE(client, 2, "HTTP/2 connection output is backed up; "
+				"pausing response bodies");
+			session->setOutputBlocked(true);
+			client->output.setBuffersFlushedCallback(onHttp2ConnectionOutputBuffersFlushed);
+		}
+	}
+
+	bool onHttp2StreamOpened(Http2Session *session, Http2Stream *stream) {
+		Client *client = getHttp2ConnectionClient(session);
+		if (!client->connected() || client->http2Session != session) {
+			return false;
+		}
+		createHttp2StreamClient(stream);
+		return true;
+	}
+
+	void onHttp2StreamInput(Http2Session *session, Http2Stream *stream) {
+		if (stream->userData != NULL) {
+			pumpHttp2StreamInput(getHttp2StreamClient(stream));
+		}
+	}
+
+	void onHttp2StreamWritable(Http2Session *session, Http2Stream *stream) {
+		if (stream->userData != NULL) {
+			getHttp2StreamClient(stream)->output.sinkWritable();
+		}
+	}
+
+	void onHttp2StreamReset(Http2Session *session, Http2Stream *stream, Http2ErrorCode code) {
+		if (stream->userData != NULL) {
+			Client *sc = getHttp2StreamClient(stream);
+			SKC_DEBUG(sc, "HTTP/2 stream " << stream->id << " reset (error code " <<
+				(int) code << ")");
+			// Closes the stream through onClientDisconnecting().
+			this->disconnect(&sc);
+		} else {
+			session->closeStream(stream);
+		}
+	}
+
+	void onHttp2SessionFinished(Http2Session *session) {
+		Client *client = getHttp2ConnectionClient(session);
+		SKC_DEBUG(client, "HTTP/2 session finished; closing connection after "
+			"flushing output");
+		if (!client->output.ended()) {
+			client->output.feed(MemoryKit::mbuf());
+		}
+		if (client->output.endAcked()) {
+			this->disconnect(&client);
+		}
+		// Otherwise, _onClientOutputDataFlushed() disconnects the client.
+	}
+
+
 	/***** Miscellaneous *****/
 
 	void writeDefault500Response(Client *client, Request *req) {
@@ -690,9 +995,52 @@ private:
 		{
 			client->currentRequest->httpState = Request::WAITING_FOR_REFERENCES;
 			self->doneWithCurrentRequest(&client);
+		} else if (client->http2Session != NULL && client->output.endAcked()) {
+			self->disconnect(&client);
 		}
 	}
 
+	static void onHttp2ConnectionOutputBuffersFlushed(FileBufferedChannel *_channel) {
+		FileBufferedFdSinkChannel *channel =
+			reinterpret_cast<FileBufferedFdSinkChannel *>(_channel);
+		Client *client = static_cast<Client *>(static_cast<BaseClient *>(
+			channel->getHooks()->userData));
+
+		channel->clearBuffersFlushedCallback();
+		if (client->http2Session != NULL) {
+			client->http2Session->setOutputBlocked(false);
+		}
+	}
+
+	static Channel::Result onHttp2StreamOutputData(FileBufferedFdSinkChannel *channel,
+		const MemoryKit::mbuf &buffer, int errcode)
+	{
+		Client *client = static_cast<Client *>(static_cast<BaseClient *>(
+			channel->getHooks()->userData));
+		Http2Stream *stream = client->http2Stream;
+
+		if (stream == NULL) {
+			// The stream is already closed.
+			return Channel::Result(buffer.size(), false);
+		} else if (buffer.size() > 0) {
+			return Channel::Result(stream->session->writeResponse(stream, buffer), false);
+		} else {
+			if (errcode == 0) {
+				stream->session->endResponse(stream);
+			}
+			return Channel::Result(0, false);
+		}
+	}
+
+	static void onHttp2StreamInputConsumed(Channel *channel, unsigned int size) {
+		Client *client = static_cast<Client *>(static_cast<BaseClient *>(
+			channel->hooks->userData));
+		HttpServer *self = static_cast<HttpServer *>(HttpServer::getServerFromClient(client));
+
+		channel->consumedCallback = NULL;
+		self->pumpHttp2StreamInput(client);
+	}
+
 	static Channel::Result onRequestBodyChannelData(Channel *channel,
 		const MemoryKit::mbuf &buffer, int errcode)
 	{
@@ -767,6 +1115,9 @@ protected:
 		int errcode)
 	{
 		SKC_LOG_EVENT(HttpServer, client, "onClientDataReceived");
+		if (client->http2Session != NULL) {
+			return processHttp2ConnectionData(client, buffer, errcode);
+		}
 		assert(client->currentRequest != NULL);
 		Request *req = client->currentRequest;
 		RequestRef ref(req, __FILE__, __LINE__);
@@ -825,6 +1176,20 @@ protected:
 			client->currentRequest = NULL;
 			unrefRequest(req, __FILE__, __LINE__);
 		}
+
+		if (client->http2Stream != NULL) {
+			Http2Stream *stream = client->http2Stream;
+			client->http2Stream = NULL;
+			stream->session->closeStream(stream);
+		}
+		if (client->http2Session != NULL) {
+			Http2Session *session = client->http2Session;
+			// Further output from the session (such as RST_STREAM frames
+			// for the streams below) is dropped by onHttp2Output().
+			client->http2Session = NULL;
+			disconnectHttp2Streams(session);
+			session->destroy();
+		}
 	}
 
 	virtual void deinitializeClient(Client *client) {
@@ -833,6 +1198,16 @@ protected:
 	}
 
 	virtual bool shouldDisconnectClientOnShutdown(Client *client) {
+		if (client->http2Session != NULL) {
+			if (client->http2Session->getStreamCount() == 0) {
+				return true;
+			} else {
+				// Let the current streams finish. The session finishes,
+				// and the connection is closed, once they are done.
+				client->http2Session->goaway();
+				return false;
+			}
+		}
 		return client->currentRequest == NULL
 			|| client->currentRequest->upgraded();
 	}
@@ -906,6 +1281,9 @@ protected:
 	virtual void reinitializeClient(Client *client, int fd) {
 		ParentClass::reinitializeClient(client, fd);
 		client->requestsBegun = 0;
+		client->output.sinkCallback = NULL;
+		assert(client->http2Session == NULL);
+		assert(client->http2Stream == NULL);
 		assert(client->currentRequest == NULL);
 	}
 
@@ -1000,6 +1378,7 @@ public:
 		  headerParserStatePool(16, 256)
 	{
 		STAILQ_INIT(&freeRequests);
+		http2Handler.server = this;
 	}
 
 
@@ -1277,6 +1656,12 @@ public:
 		}
 		doc["requests_begun"] = client->requestsBegun;
 		doc["lingering_request_count"] = client->lingeringRequestCount;
+		if (client->http2Session != NULL) {
+			doc["http2"] = client->http2Session->inspectStateAsJson();
+		}
+		if (client->http2Stream != NULL) {
+			doc["http2_stream_id"] = (Json::UInt) client->http2Stream->id;
+		}
 		return doc;
 	}
 
@@ -30,6 +30,7 @@
 
 #include <boost/cstdint.hpp>
 #include <boost/config.hpp>
+#include <boost/atomic.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <oxt/system_calls.hpp>
 #include <oxt/backtrace.hpp>
@@ -307,10 +308,17 @@ private:
 	ev::timer acceptResumptionWatcher;
 	ev::timer statisticsUpdateWatcher;
 	ev::io endpoints[SERVER_KIT_MAX_SERVER_ENDPOINTS];
+	// A copy of `activeClientCount` that may be read from other threads,
+	// e.g. by the AcceptLoadBalancer.
+	boost::atomic<unsigned int> publishedActiveClientCount;
 
 
 	/***** Private methods *****/
 
+	void publishActiveClientCount() {
+		publishedActiveClientCount.store(activeClientCount, boost::memory_order_relaxed);
+	}
+
 	void preinitialize(Context *context) {
 		STAILQ_INIT(&freeClients);
 		TAILQ_INIT(&activeClients);
@@ -365,6 +373,7 @@ private:
 		}
 
 		if (acceptCount > 0) {
+			publishActiveClientCount();
 			SKS_DEBUG(acceptCount << " new client(s) accepted; there are now " <<
 				activeClientCount << " active client(s)");
 		}
@@ -750,7 +759,8 @@ public:
 		  ctx(context),
 		  nextClientNumber(1),
 		  nEndpoints(0),
-		  accept4Available(true)
+		  accept4Available(true),
+		  publishedActiveClientCount(0)
 	{
 		preinitialize(context);
 	}
@@ -866,6 +876,7 @@ public:
 
 		activeClientCount += size;
 		totalClientsAccepted += size;
+		publishActiveClientCount();
 
 		for (unsigned int i = 0; i < size; i++) {
 			client = checkoutClientObject();
@@ -883,6 +894,28 @@ public:
 		onClientsAccepted(acceptedClients, size);
 	}
 
+	/**
+	 * Creates an active client that is not associated with a file descriptor.
+	 * The caller is responsible for feeding its input and for consuming its
+	 * output (see `FdSourceChannel::feed()` and `FileBufferedFdSinkChannel::sinkCallback`).
+	 * This is used for protocols that multiplex several logical clients over a
+	 * single connection, such as HTTP/2.
+	 *
+	 * Like accepted clients, the returned client has a refcount of 2. The caller
+	 * must call `unrefClient()` once after it is done setting up the client.
+	 * The client is not passed to `onClientsAccepted()`.
+	 */
+	Client *createDetachedClient() {
+		Client *client = checkoutClientObject();
+		TAILQ_INSERT_HEAD(&activeClients, client, nextClient.activeOrDisconnectedClient);
+		activeClientCount++;
+		peakActiveClientCount = std::max(peakActiveClientCount, activeClientCount);
+		publishActiveClientCount();
+		client->number = getNextClientNumber();
+		reinitializeClient(client, -1);
+		return client;
+	}
+
 
 	/***** Server management *****/
 
@@ -919,6 +952,15 @@ public:
 		return string(buf, size);
 	}
 
+	/**
+	 * Returns the number of active clients. Unlike `activeClientCount`,
+	 * this may be called from any thread, but the result may be
+	 * slightly outdated.
+	 */
+	unsigned int getActiveClientCountFromAnyThread() const {
+		return publishedActiveClientCount.load(boost::memory_order_relaxed);
+	}
+
 	vector<ClientRefType> getActiveClients() {
 		vector<ClientRefType> result;
 		Client *client;
@@ -1050,17 +1092,20 @@ public:
 		c->setConnState(ClientType::DISCONNECTED);
 		TAILQ_REMOVE(&activeClients, c, nextClient.activeOrDisconnectedClient);
 		activeClientCount--;
+		publishActiveClientCount();
 		TAILQ_INSERT_HEAD(&disconnectedClients, c, nextClient.activeOrDisconnectedClient);
 		disconnectedClientCount++;
 
 		deinitializeClient(c);
-		SKC_TRACE(c, 2, "Closing client file descriptor: " << fdnum);
-		try {
-			safelyClose(fdnum);
-			P_LOG_FILE_DESCRIPTOR_CLOSE(fdnum);
-		} catch (const SystemException &e) {
-			SKC_WARN(c, "An error occurred while closing the client file descriptor: " <<
-				e.what() << " (errno=" << e.code() << ")");
+		if (fdnum != -1) {
+			SKC_TRACE(c, 2, "Closing client file descriptor: " << fdnum);
+			try {
+				safelyClose(fdnum);
+				P_LOG_FILE_DESCRIPTOR_CLOSE(fdnum);
+			} catch (const SystemException &e) {
+				SKC_WARN(c, "An error occurred while closing the client file descriptor: " <<
+					e.what() << " (errno=" << e.code() << ")");
+			}
 		}
 
 		*client = NULL;
@@ -0,0 +1,179 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2017 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_SERVER_KIT_SPLICE_PIPE_H_
+#define _PASSENGER_SERVER_KIT_SPLICE_PIPE_H_
+
+#ifdef __linux__
+	#ifndef _GNU_SOURCE
+		#define _GNU_SOURCE
+	#endif
+	#include <fcntl.h>
+#endif
+#include <sys/types.h>
+#include <cstddef>
+#include <cerrno>
+#include <FileDescriptor.h>
+
+namespace Passenger {
+namespace ServerKit {
+
+
+/**
+ * A kernel pipe through which data is moved from one file descriptor to
+ * another with splice(), without copying it into user space. Data is
+ * `fill()`ed into the pipe from a source socket and `drain()`ed from the
+ * pipe into a sink socket. The pipe keeps track of how many bytes it
+ * holds, so that the caller knows when it is safe to reuse it.
+ *
+ * Only supported on Linux. Elsewhere, `isSupported()` returns false and
+ * all other operations fail with ENOSYS.
+ *
+ * This class is copyable: copies share the same underlying pipe. That
+ * allows keeping a pool of idle pipes in a plain container.
+ */
+class SplicePipe {
+private:
+	FileDescriptor reader, writer;
+	size_t bytesBuffered;
+
+public:
+	/**
+	 * Pipe capacity that `open()` asks for. The kernel default of 64 KB
+	 * results in more system calls than necessary for large bodies.
+	 */
+	static const int PREFERRED_CAPACITY = 1024 * 256;
+
+	SplicePipe()
+		: bytesBuffered(0)
+		{ }
+
+	static bool isSupported() {
+		#ifdef __linux__
+			return true;
+		#else
+			return false;
+		#endif
+	}
+
+	/**
+	 * Creates the underlying pipe. Returns false and sets errno on failure.
+	 */
+	bool open(const char *file = NULL, unsigned int line = 0) {
+		#ifdef __linux__
+			int fds[2];
+
+			if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) == -1) {
+				return false;
+			}
+			reader.assign(fds[0], file, line);
+			writer.assign(fds[1], file, line);
+			bytesBuffered = 0;
+			#ifdef F_SETPIPE_SZ
+				// This fails if the size exceeds /proc/sys/fs/pipe-max-size,
+				// in which case the default capacity is fine too.
+				fcntl(writer, F_SETPIPE_SZ, PREFERRED_CAPACITY);
+			#endif
+			return true;
+		#else
+			errno = ENOSYS;
+			return false;
+		#endif
+	}
+
+	/**
+	 * Releases this object's reference to the underlying pipe.
+	 */
+	void reset() {
+		reader = FileDescriptor();
+		writer = FileDescriptor();
+		bytesBuffered = 0;
+	}
+
+	bool isOpen() const {
+		return reader != -1;
+	}
+
+	size_t getBytesBuffered() const {
+		return bytesBuffered;
+	}
+
+	bool empty() const {
+		return bytesBuffered == 0;
+	}
+
+	/**
+	 * Moves at most `size` bytes from `fd` into the pipe.
+	 * Returns the number of bytes moved, 0 on end-of-file, or -1 on error,
+	 * with errno set. EAGAIN means that `fd` has no data available.
+	 */
+	ssize_t fill(int fd, size_t size) {
+		#ifdef __linux__
+			ssize_t ret;
+
+			do {
+				ret = splice(fd, NULL, writer, NULL, size,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			} while (ret == -1 && errno == EINTR);
+			if (ret > 0) {
+				bytesBuffered += ret;
+			}
+			return ret;
+		#else
+			errno = ENOSYS;
+			return -1;
+		#endif
+	}
+
+	/**
+	 * Moves as much buffered data as possible from the pipe into `fd`.
+	 * Returns the number of bytes moved, or -1 on error, with errno set.
+	 * EAGAIN means that `fd` cannot accept more data right now. 0 means
+	 * that no progress was made; errno is not set in that case.
+	 */
+	ssize_t drain(int fd) {
+		#ifdef __linux__
+			ssize_t ret;
+
+			do {
+				ret = splice(reader, NULL, fd, NULL, bytesBuffered,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			} while (ret == -1 && errno == EINTR);
+			if (ret > 0) {
+				bytesBuffered -= ret;
+			}
+			return ret;
+		#else
+			errno = ENOSYS;
+			return -1;
+		#endif
+	}
+};
+
+
+} // namespace ServerKit
+} // namespace Passenger
+
+#endif /* _PASSENGER_SERVER_KIT_SPLICE_PIPE_H_ */
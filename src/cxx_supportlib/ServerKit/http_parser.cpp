@@ -29,6 +29,17 @@
 #include <string.h>
 #include <limits.h>
 
+/* Passenger addition: vectorized scanning of header names and values,
+ * selected at runtime based on the CPU's capabilities.
+ */
+#if !defined(HTTP_PARSER_NO_SIMD) \
+  && (defined(__x86_64__) || defined(__i386__)) \
+  && (defined(__clang__) \
+    || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+# define HTTP_PARSER_SIMD 1
+# include <immintrin.h>
+#endif
+
 #ifndef ULLONG_MAX
 # define ULLONG_MAX ((boost::uint64_t) -1) /* 2^64-1 */
 #endif
@@ -189,6 +200,153 @@ static const int8_t unhex[256] =
   };
 
 
+/* Passenger addition: header scanners.
+ *
+ * Most bytes of a typical request header (think of large Cookie headers)
+ * are in the "general" part of a header name or value, where the state
+ * machine below does nothing but advance. The scanners skip such runs
+ * in bulk. They return a pointer to the first byte in [p, end) that may
+ * need the attention of the state machine, or `end`. Stopping early is
+ * always safe; the state machine then simply handles that byte itself.
+ */
+typedef const char *(*header_scanner)(const char *p, const char *end);
+
+/* Returns the first byte that is not a token character. */
+static const char *
+scan_header_field_scalar(const char *p, const char *end)
+{
+  while (p != end && tokens[(unsigned char) *p]) {
+    p++;
+  }
+  return p;
+}
+
+/* Returns the first CR or LF. */
+static const char *
+scan_header_value_scalar(const char *p, const char *end)
+{
+  while (p != end && *p != '\r' && *p != '\n') {
+    p++;
+  }
+  return p;
+}
+
+#ifdef HTTP_PARSER_SIMD
+
+__attribute__((target("sse4.2")))
+static const char *
+scan_header_field_sse42(const char *p, const char *end)
+{
+  /* Token characters as byte ranges, except for '~' on which we
+   * simply stop early.
+   */
+  static const char ranges[16] = {
+    '!', '!', '#', '\'', '*', '+', '-', '.',
+    '0', '9', 'A', 'Z', '^', 'z', '|', '|'
+  };
+  const __m128i r = _mm_loadu_si128((const __m128i *) ranges);
+
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) p);
+    int index = _mm_cmpestri(r, 16, chunk, 16,
+      _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY
+      | _SIDD_LEAST_SIGNIFICANT);
+    if (index != 16) {
+      return p + index;
+    }
+    p += 16;
+  }
+  return scan_header_field_scalar(p, end);
+}
+
+__attribute__((target("sse4.2")))
+static const char *
+scan_header_value_sse42(const char *p, const char *end)
+{
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) p);
+    int mask = _mm_movemask_epi8(_mm_or_si128(
+      _mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+  return scan_header_value_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *
+scan_header_value_avx2(const char *p, const char *end)
+{
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+
+  while (end - p >= 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *) p);
+    unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(
+      _mm256_cmpeq_epi8(chunk, cr), _mm256_cmpeq_epi8(chunk, lf)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 32;
+  }
+  return scan_header_value_scalar(p, end);
+}
+
+#endif /* HTTP_PARSER_SIMD */
+
+static header_scanner scan_header_field = scan_header_field_scalar;
+static header_scanner scan_header_value = scan_header_value_scalar;
+static const char *header_scanner_name = "scalar";
+
+static void
+select_header_scanners(int simd_enabled)
+{
+  scan_header_field = scan_header_field_scalar;
+  scan_header_value = scan_header_value_scalar;
+  header_scanner_name = "scalar";
+#ifdef HTTP_PARSER_SIMD
+  if (!simd_enabled) {
+    return;
+  }
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    scan_header_field = scan_header_field_sse42;
+    scan_header_value = scan_header_value_sse42;
+    header_scanner_name = "sse4.2";
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    scan_header_value = scan_header_value_avx2;
+    header_scanner_name = "avx2";
+  }
+#endif
+}
+
+namespace {
+  struct HeaderScannerSelector {
+    HeaderScannerSelector() {
+      select_header_scanners(1);
+    }
+  } header_scanner_selector;
+}
+
+void
+http_parser_set_simd_enabled(int enabled)
+{
+  select_header_scanners(enabled);
+}
+
+const char *
+http_parser_header_scanner_name(void)
+{
+  return header_scanner_name;
+}
+
+
 #if HTTP_PARSER_STRICT
 # define T(v) 0
 #else
@@ -1283,7 +1441,16 @@ size_t http_parser_execute (http_parser *parser,
         if (c) {
           switch (parser->header_state) {
             case h_general:
+            {
+              const char *q = scan_header_field(p + 1, data + len);
+              parser->nread += q - (p + 1);
+              if (parser->nread > (HTTP_MAX_HEADER_SIZE)) {
+                SET_ERRNO(HPE_HEADER_OVERFLOW);
+                goto error;
+              }
+              p = q - 1;
               break;
+            }
 
             case h_C:
               parser->index++;
@@ -1492,7 +1659,16 @@ size_t http_parser_execute (http_parser *parser,
 
         switch (parser->header_state) {
           case h_general:
+          {
+            const char *q = scan_header_value(p + 1, data + len);
+            parser->nread += q - (p + 1);
+            if (parser->nread > (HTTP_MAX_HEADER_SIZE)) {
+              SET_ERRNO(HPE_HEADER_OVERFLOW);
+              goto error;
+            }
+            p = q - 1;
             break;
+          }
 
           case h_connection:
           case h_transfer_encoding:
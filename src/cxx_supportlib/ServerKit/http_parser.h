@@ -324,6 +324,16 @@ void http_parser_pause(http_parser *parser, int paused);
 /* Checks if this is the final chunk of the body. */
 int http_body_is_final(const http_parser *parser);
 
+/* Passenger addition: header names and values are scanned with SSE4.2 or
+ * AVX2 instructions if the CPU supports them. Passing 0 forces the scalar
+ * implementation, which is useful for testing and benchmarking. Not
+ * thread-safe; only call this while no parser is running.
+ */
+void http_parser_set_simd_enabled(int enabled);
+
+/* Returns the name of the header scanner in use: "avx2", "sse4.2" or "scalar". */
+const char *http_parser_header_scanner_name(void);
+
 #ifdef __cplusplus
 }
 #endif
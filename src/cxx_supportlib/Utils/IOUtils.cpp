@@ -56,6 +56,8 @@
 	// For accept4 macros
 	#include <sys/syscall.h>
 	#include <linux/net.h>
+	// For the SO_REUSEPORT steering program
+	#include <linux/filter.h>
 #endif
 
 #if defined(__APPLE__)
@@ -292,7 +294,7 @@ resolveHostname(const string &hostname, unsigned int port, bool shuffle) {
 
 int
 createServer(const StaticString &address, unsigned int backlogSize, bool autoDelete,
-	const char *file, unsigned int line)
+	const char *file, unsigned int line, bool reusePort)
 {
 	TRACE_POINT();
 	switch (getSocketAddressType(address)) {
@@ -304,7 +306,7 @@ createServer(const StaticString &address, unsigned int backlogSize, bool autoDel
 		unsigned short port;
 
 		parseTcpSocketAddress(address, host, port);
-		return createTcpServer(host.c_str(), port, backlogSize, file, line);
+		return createTcpServer(host.c_str(), port, backlogSize, file, line, reusePort);
 	}
 	default:
 		throw ArgumentException(string("Unknown address type for '") + address + "'");
@@ -370,7 +372,7 @@ createUnixServer(const StaticString &filename, unsigned int backlogSize, bool au
 
 int
 createTcpServer(const char *address, unsigned short port, unsigned int backlogSize,
-	const char *file, unsigned int line)
+	const char *file, unsigned int line, bool reusePort)
 {
 	union {
 		struct sockaddr_in v4;
@@ -423,6 +425,19 @@ createTcpServer(const char *address, unsigned short port, unsigned int backlogSi
 	// Ignore SO_REUSEADDR error, it's not fatal.
 
 	FdGuard guard(fd, file, line, true);
+	if (reusePort) {
+		#ifdef SO_REUSEPORT
+			optval = 1;
+			if (syscalls::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+				&optval, sizeof(optval)) == -1)
+			{
+				int e = errno;
+				throw SystemException("Cannot set SO_REUSEPORT on a TCP socket", e);
+			}
+		#else
+			throw RuntimeException("SO_REUSEPORT is not supported on this platform");
+		#endif
+	}
 	if (family == AF_INET) {
 		ret = syscalls::bind(fd, (const struct sockaddr *) &addr.v4, sizeof(struct sockaddr_in));
 	} else {
@@ -454,6 +469,30 @@ createTcpServer(const char *address, unsigned short port, unsigned int backlogSi
 	return fd;
 }
 
+void
+setReusePortCpuSteering(int fd, unsigned int groupSize) {
+	#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+		// Select socket number (current CPU % groupSize).
+		struct sock_filter code[] = {
+			{ BPF_LD | BPF_W | BPF_ABS, 0, 0, (unsigned int) (SKF_AD_OFF + SKF_AD_CPU) },
+			{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, groupSize },
+			{ BPF_RET | BPF_A, 0, 0, 0 }
+		};
+		struct sock_fprog prog;
+
+		prog.len = sizeof(code) / sizeof(code[0]);
+		prog.filter = code;
+		if (syscalls::setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+			&prog, sizeof(prog)) == -1)
+		{
+			int e = errno;
+			throw SystemException("Cannot attach a CPU steering program to a SO_REUSEPORT socket", e);
+		}
+	#else
+		throw RuntimeException("SO_REUSEPORT CPU steering is only supported on Linux >= 4.5");
+	#endif
+}
+
 int
 connectToServer(const StaticString &address, const char *file, unsigned int line) {
 	TRACE_POINT();
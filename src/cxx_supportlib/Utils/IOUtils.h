@@ -150,6 +150,8 @@ vector<string> resolveHostname(const string &hostname,
  *             for file descriptor logging purposes.
  * @param line The line in the source file that called this function.
  * @return The file descriptor of the newly created server socket.
+ * @param reusePort Whether to set SO_REUSEPORT on the socket. Only has effect
+ *                  on TCP sockets. See createTcpServer().
  * @throws ArgumentException The given address cannot be parsed.
  * @throws RuntimeException Something went wrong.
  * @throws SystemException Something went wrong while creating the Unix server socket.
@@ -160,7 +162,8 @@ int createServer(const StaticString &address,
 	unsigned int backlogSize = 0,
 	bool autoDelete = true,
 	const char *file = __FILE__,
-	unsigned int line = __LINE__);
+	unsigned int line = __LINE__,
+	bool reusePort = false);
 
 /**
  * Create a new Unix server socket which is bounded to <tt>filename</tt>.
@@ -196,9 +199,13 @@ int createUnixServer(const StaticString &filename,
  * @param file The name of the source file that called this function,
  *             for file descriptor logging purposes.
  * @param line The line in the source file that called this function.
+ * @param reusePort Whether to set SO_REUSEPORT on the socket, so that multiple
+ *                  sockets can be bound to the same address and port. The
+ *                  kernel then distributes incoming connections over them.
  * @return The file descriptor of the newly created server socket.
  * @throws SystemException Something went wrong while creating the server socket.
  * @throws ArgumentException The given address cannot be parsed.
+ * @throws RuntimeException <tt>reusePort</tt> is not supported on this platform.
  * @throws boost::thread_interrupted A system call has been interrupted.
  * @ingroup Support
  */
@@ -206,7 +213,23 @@ int createTcpServer(const char *address = "0.0.0.0",
 	unsigned short port = 0,
 	unsigned int backlogSize = 0,
 	const char *file = __FILE__,
-	unsigned int line = __LINE__);
+	unsigned int line = __LINE__,
+	bool reusePort = false);
+
+/**
+ * Given a listening TCP socket that is part of a group of <tt>groupSize</tt>
+ * SO_REUSEPORT sockets, makes the kernel hand each incoming connection to the
+ * socket whose index equals the number of the CPU that processed the
+ * connection, modulo <tt>groupSize</tt>. Sockets are indexed in the order in
+ * which they started listening. The program applies to the whole group.
+ * This only keeps connections on the CPU that received them if the thread
+ * that serves socket <em>i</em> is pinned to CPU <em>i</em>.
+ *
+ * @throws SystemException Something went wrong while attaching the program.
+ * @throws RuntimeException This is not supported on this platform.
+ * @ingroup Support
+ */
+void setReusePortCpuSteering(int fd, unsigned int groupSize);
 
 /**
  * Connect to a server at the given address in a blocking manner.
@@ -52,11 +52,14 @@
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <cstdio>
 #include <cstdlib>
 #include <cerrno>
 #include <cstring>
+#include <algorithm>
 
 #include <StaticString.h>
 #include <Exceptions.h>
@@ -64,6 +67,7 @@
 #include <FileTools/FileManip.h>
 #include <Utils/ScopeGuard.h>
 #include <Utils/IOUtils.h>
+#include <Utils/StrIntUtils.h>
 #include <Utils/StringScanning.h>
 
 namespace Passenger {
@@ -190,11 +194,26 @@ public:
 /**
  * Utility class for collection metrics on processes, such as CPU usage, memory usage,
  * command name, etc.
+ *
+ * On Linux, metrics are read from /proc directly. Elsewhere, or if /proc is not
+ * mounted, they are obtained by running 'ps'. The /proc files are read into a
+ * buffer that is reused by subsequent collect() calls on the same object, so
+ * a collector that is used periodically should be kept around. Because of
+ * that buffer, an object must not be used by multiple threads at the same time.
  */
 class ProcessMetricsCollector {
 private:
+	/**
+	 * Initial size of the buffer that /proc files are read into. Large
+	 * enough for all files that we read, except for the smaps file of a
+	 * process with a large number of mappings, which we parse incrementally.
+	 */
+	static const unsigned int PROC_BUFFER_SIZE = 1024 * 16;
+
 	bool canMeasureRealMemory;
+	bool canReadProc;
 	string psOutput;
+	mutable vector<char> procBuffer;
 
 	template<typename Collection, typename ConstIterator>
 	ProcessMetricMap parsePsOutput(const string &output, const Collection &allowedPids) const {
@@ -261,6 +280,329 @@ private:
 		setpriority(PRIO_PROCESS, getpid(), prio);
 	}
 
+	#ifndef __APPLE__
+		/**
+		 * Parses a "Name:   1234 kB" line from a smaps file, adding the
+		 * value to `total`. Returns false if the line is malformed.
+		 */
+		static bool parseSmapsField(const char *pos, const char *end, ssize_t &total) {
+			ssize_t value = 0;
+
+			pos = (const char *) memchr(pos, ':', end - pos);
+			if (pos == NULL) {
+				return false;
+			}
+			pos++;
+			while (pos < end && (*pos == ' ' || *pos == '\t')) {
+				pos++;
+			}
+			if (pos == end || *pos < '0' || *pos > '9') {
+				return false;
+			}
+			while (pos < end && *pos >= '0' && *pos <= '9') {
+				value = value * 10 + (*pos - '0');
+				pos++;
+			}
+			if (end - pos < 3 || memcmp(pos, " kB", 3) != 0) {
+				return false;
+			}
+			total += value;
+			return true;
+		}
+
+		/**
+		 * Reads the Pss, Private_Dirty and Swap fields from a smaps or
+		 * smaps_rollup file. The file is read in chunks of at most `bufsize`
+		 * bytes, and every line is parsed as soon as it is complete, so that
+		 * the smaps file of a large process doesn't have to fit in memory.
+		 *
+		 * Returns false if the file cannot be opened or parsed, with errno set
+		 * if it cannot be opened.
+		 */
+		static bool readSmaps(const char *filename, char *buf, size_t bufsize,
+			ssize_t &pss, ssize_t &privateDirty, ssize_t &swap)
+		{
+			int fd = syscalls::open(filename, O_RDONLY | O_CLOEXEC);
+			if (fd == -1) {
+				return false;
+			}
+			FdGuard guard(fd, NULL, 0);
+			bool hasPss = false;
+			bool hasPrivateDirty = false;
+			bool hasSwap = false;
+			// Whether we're skipping the remainder of a line that didn't
+			// fit in the buffer. Such lines describe mappings with long
+			// filenames; the fields that we're after are always short.
+			bool skippingLine = false;
+			size_t used = 0;
+			ssize_t ret;
+
+			// In KB.
+			pss = 0;
+			privateDirty = 0;
+			swap = 0;
+
+			do {
+				ret = syscalls::read(fd, buf + used, bufsize - used);
+				if (ret == -1) {
+					return false;
+				}
+				used += ret;
+
+				const char *pos = buf;
+				const char *end = buf + used;
+
+				while (pos < end) {
+					const char *newline = (const char *) memchr(pos, '\n', end - pos);
+					if (newline == NULL) {
+						if (ret > 0) {
+							// Incomplete line. Parse it after the next read.
+							break;
+						}
+						newline = end;
+					}
+
+					if (skippingLine) {
+						skippingLine = false;
+					} else if (startsWith(StaticString(pos, newline - pos), "Pss:")) {
+						/* Linux supports Proportional Set Size since kernel 2.6.25.
+						 * See kernel commit ec4dd3eb35759f9fbeb5c1abb01403b2fde64cc9.
+						 */
+						hasPss = true;
+						if (!parseSmapsField(pos, newline, pss)) {
+							return false;
+						}
+					} else if (startsWith(StaticString(pos, newline - pos), "Private_Dirty:")) {
+						hasPrivateDirty = true;
+						if (!parseSmapsField(pos, newline, privateDirty)) {
+							return false;
+						}
+					} else if (startsWith(StaticString(pos, newline - pos), "Swap:")) {
+						hasSwap = true;
+						if (!parseSmapsField(pos, newline, swap)) {
+							return false;
+						}
+					}
+					pos = std::min(newline + 1, end);
+				}
+
+				if (pos == buf && used == bufsize) {
+					// A single line fills the entire buffer.
+					skippingLine = true;
+					used = 0;
+				} else {
+					used = end - pos;
+					memmove(buf, pos, used);
+				}
+			} while (ret > 0);
+
+			if (!hasPss) {
+				pss = -1;
+			}
+			if (!hasPrivateDirty) {
+				privateDirty = -1;
+			}
+			if (!hasSwap) {
+				swap = -1;
+			}
+			return true;
+		}
+	#endif
+
+	#ifdef __linux__
+		/**
+		 * Reads an entire (small) /proc file into `procBuffer`, growing the
+		 * buffer if necessary. Returns the file size, or -1 if the file
+		 * cannot be read, with errno set.
+		 */
+		ssize_t readProcFile(const char *filename) const {
+			int fd = syscalls::open(filename, O_RDONLY | O_CLOEXEC);
+			if (fd == -1) {
+				return -1;
+			}
+			FdGuard guard(fd, NULL, 0);
+			size_t used = 0;
+			ssize_t ret;
+
+			do {
+				if (used == procBuffer.size()) {
+					procBuffer.resize(procBuffer.size() * 2);
+				}
+				ret = syscalls::read(fd, &procBuffer[used], procBuffer.size() - used);
+				if (ret == -1) {
+					return -1;
+				}
+				used += ret;
+			} while (ret > 0);
+			return used;
+		}
+
+		/**
+		 * Parses /proc/<pid>/stat. The command name in there is enclosed
+		 * in parentheses and may contain spaces and parentheses itself, so
+		 * the remaining fields are located from the last ')'.
+		 */
+		static bool parseProcStat(const char *data, size_t size, double uptime,
+			ProcessMetrics &metrics, string &comm, char &state)
+		{
+			const char *end = data + size;
+			const char *commStart = (const char *) memchr(data, '(', size);
+			const char *commEnd = (const char *) memrchr(data, ')', size);
+			if (commStart == NULL || commEnd == NULL || commEnd < commStart) {
+				return false;
+			}
+			comm.assign(commStart + 1, commEnd - commStart - 1);
+
+			// Fields 3 (state) up to and including 24 (rss).
+			const unsigned int FIELDS = 22;
+			unsigned long long fields[FIELDS];
+			const char *pos = commEnd + 1;
+			char *next;
+
+			for (unsigned int i = 0; i < FIELDS; i++) {
+				while (pos < end && *pos == ' ') {
+					pos++;
+				}
+				if (pos == end) {
+					return false;
+				}
+				if (i == 0) {
+					// The state is a character.
+					state = *pos;
+					fields[i] = *pos;
+					pos++;
+					continue;
+				}
+				// The file ends with a newline, so strtoll() stops in time.
+				fields[i] = (unsigned long long) strtoll(pos, &next, 10);
+				if (next == pos) {
+					return false;
+				}
+				pos = next;
+			}
+
+			static long ticksPerSecond = sysconf(_SC_CLK_TCK);
+			static long pageSize = sysconf(_SC_PAGESIZE);
+
+			metrics.ppid = (pid_t) fields[4 - 3];
+			metrics.processGroupId = (pid_t) fields[5 - 3];
+			metrics.vmsize = (ssize_t) (fields[23 - 3] / 1024);
+			metrics.rss = (ssize_t) (fields[24 - 3] * pageSize / 1024);
+
+			// Calculate %CPU the way 'ps' does: CPU time used over the
+			// lifetime of the process.
+			double cpuTime = (double) (fields[14 - 3] + fields[15 - 3]) / ticksPerSecond;
+			double lifetime = uptime - (double) fields[22 - 3] / ticksPerSecond;
+			if (lifetime > 0) {
+				metrics.cpu = (boost::uint8_t) (cpuTime * 100 / lifetime);
+			} else {
+				metrics.cpu = 0;
+			}
+			return true;
+		}
+
+		/** Extracts the effective UID from /proc/<pid>/status. */
+		static bool parseProcStatusUid(const char *data, size_t size, uid_t &uid) {
+			const char *end = data + size;
+			const char *pos = data;
+
+			while (pos < end) {
+				const char *newline = (const char *) memchr(pos, '\n', end - pos);
+				if (newline == NULL) {
+					newline = end;
+				}
+				if (startsWith(StaticString(pos, newline - pos), "Uid:")) {
+					// Real, effective, saved set and filesystem UID.
+					char *next;
+					pos += sizeof("Uid:") - 1;
+					strtoll(pos, &next, 10);
+					if (next == pos) {
+						return false;
+					}
+					pos = next;
+					uid = (uid_t) strtoll(pos, &next, 10);
+					return next != pos;
+				}
+				pos = newline + 1;
+			}
+			return false;
+		}
+
+		double readUptime() const {
+			ssize_t size = readProcFile("/proc/uptime");
+			if (size <= 0) {
+				return 0;
+			}
+			procBuffer[std::min<size_t>(size, procBuffer.size() - 1)] = '\0';
+			return atof(&procBuffer[0]);
+		}
+
+		/**
+		 * Collects the metrics of a single process from /proc. Returns
+		 * false if the process does not exist (anymore).
+		 */
+		bool collectFromProc(pid_t pid, double uptime, ProcessMetrics &metrics) const {
+			char filename[64];
+			string comm;
+			char state;
+			ssize_t size;
+
+			snprintf(filename, sizeof(filename), "/proc/%d/stat", (int) pid);
+			size = readProcFile(filename);
+			if (size <= 0 || !parseProcStat(&procBuffer[0], size, uptime, metrics, comm, state)) {
+				return false;
+			}
+
+			snprintf(filename, sizeof(filename), "/proc/%d/status", (int) pid);
+			size = readProcFile(filename);
+			if (size <= 0 || !parseProcStatusUid(&procBuffer[0], size, metrics.uid)) {
+				return false;
+			}
+
+			// The command line arguments are separated by NUL bytes. Just
+			// like 'ps', show the command name if there are none, which is
+			// the case for zombies, and mark zombies as defunct.
+			snprintf(filename, sizeof(filename), "/proc/%d/cmdline", (int) pid);
+			size = readProcFile(filename);
+			if (size > 0) {
+				while (size > 0 && procBuffer[size - 1] == '\0') {
+					size--;
+				}
+				for (ssize_t i = 0; i < size; i++) {
+					if (procBuffer[i] == '\0') {
+						procBuffer[i] = ' ';
+					}
+				}
+				metrics.command.assign(&procBuffer[0], size);
+			} else {
+				metrics.command = "[" + comm + "]";
+				if (state == 'Z') {
+					metrics.command.append(" <defunct>");
+				}
+			}
+
+			if (canMeasureRealMemory) {
+				snprintf(filename, sizeof(filename), "/proc/%d/smaps_rollup", (int) pid);
+				if (!readSmaps(filename, &procBuffer[0], procBuffer.size(),
+					metrics.pss, metrics.privateDirty, metrics.swap))
+				{
+					// smaps_rollup is only available since Linux 4.14.
+					snprintf(filename, sizeof(filename), "/proc/%d/smaps", (int) pid);
+					if (!readSmaps(filename, &procBuffer[0], procBuffer.size(),
+						metrics.pss, metrics.privateDirty, metrics.swap))
+					{
+						metrics.pss = -1;
+						metrics.privateDirty = -1;
+						metrics.swap = -1;
+					}
+				}
+			}
+
+			metrics.pid = pid;
+			return true;
+		}
+	#endif
+
 public:
 	ProcessMetricsCollector() {
 		#ifdef __APPLE__
@@ -268,6 +610,11 @@ public:
 		#else
 			canMeasureRealMemory = fileExists("/proc/self/smaps");
 		#endif
+		#ifdef __linux__
+			canReadProc = fileExists("/proc/self/stat");
+		#else
+			canReadProc = false;
+		#endif
 	}
 
 	/** Mock 'ps' output, used by unit tests. */
@@ -286,6 +633,55 @@ public:
 	 */
 	template<typename Collection, typename ConstIterator>
 	ProcessMetricMap collect(const Collection &pids) const {
+		#ifdef __linux__
+			if (canReadProc && psOutput.empty()) {
+				return collectFromProc<Collection, ConstIterator>(pids);
+			}
+		#endif
+		return collectWithPs<Collection, ConstIterator>(pids);
+	}
+
+	ProcessMetricMap collect(const vector<pid_t> &pids) const {
+		return collect< vector<pid_t>, vector<pid_t>::const_iterator >(pids);
+	}
+
+	#ifdef __linux__
+		/**
+		 * Like collect(), but always reads the metrics from /proc.
+		 * Only available on Linux.
+		 */
+		template<typename Collection, typename ConstIterator>
+		ProcessMetricMap collectFromProc(const Collection &pids) const {
+			ProcessMetricMap result;
+			if (pids.empty()) {
+				return result;
+			}
+
+			if (procBuffer.empty()) {
+				procBuffer.resize(PROC_BUFFER_SIZE);
+			}
+
+			double uptime = readUptime();
+			ConstIterator it, end = pids.end();
+			for (it = pids.begin(); it != end; it++) {
+				ProcessMetrics metrics;
+				if (collectFromProc(*it, uptime, metrics)) {
+					result[metrics.pid] = metrics;
+				}
+			}
+			return result;
+		}
+
+		ProcessMetricMap collectFromProc(const vector<pid_t> &pids) const {
+			return collectFromProc< vector<pid_t>, vector<pid_t>::const_iterator >(pids);
+		}
+	#endif
+
+	/**
+	 * Like collect(), but always runs 'ps'.
+	 */
+	template<typename Collection, typename ConstIterator>
+	ProcessMetricMap collectWithPs(const Collection &pids) const {
 		if (pids.empty()) {
 			return ProcessMetricMap();
 		}
@@ -344,8 +740,8 @@ public:
 		return result;
 	}
 
-	ProcessMetricMap collect(const vector<pid_t> &pids) const {
-		return collect< vector<pid_t>, vector<pid_t>::const_iterator >(pids);
+	ProcessMetricMap collectWithPs(const vector<pid_t> &pids) const {
+		return collectWithPs< vector<pid_t>, vector<pid_t>::const_iterator >(pids);
 	}
 
 	/**
@@ -421,79 +817,19 @@ public:
 			pss /= 1024;
 			privateDirty /= 1024;
 		#else
-			string smapsFilename = "/proc/";
-			smapsFilename.append(toString(pid));
-			smapsFilename.append("/smaps");
+			char smapsFilename[64];
+			char buf[PROC_BUFFER_SIZE];
 
-			FILE *f = syscalls::fopen(smapsFilename.c_str(), "r");
-			if (f == NULL) {
-				error:
-				pss = -1;
-				privateDirty = -1;
-				swap = -1;
+			// smaps_rollup is only available since Linux 4.14, and is much
+			// cheaper to read than smaps.
+			snprintf(smapsFilename, sizeof(smapsFilename), "/proc/%d/smaps_rollup", (int) pid);
+			if (readSmaps(smapsFilename, buf, sizeof(buf), pss, privateDirty, swap)) {
 				return;
 			}
-
-			StdioGuard guard(f, NULL, 0);
-			bool hasPss = false;
-			bool hasPrivateDirty = false;
-			bool hasSwap = false;
-
-			// In KB.
-			pss = 0;
-			privateDirty = 0;
-			swap = 0;
-
-			while (!feof(f)) {
-				char line[1024 * 4];
-				const char *buf;
-
-				buf = fgets(line, sizeof(line), f);
-				if (buf == NULL) {
-					if (ferror(f)) {
-						goto error;
-					} else {
-						break;
-					}
-				}
-				try {
-					if (startsWith(line, "Pss:")) {
-						/* Linux supports Proportional Set Size since kernel 2.6.25.
-						 * See kernel commit ec4dd3eb35759f9fbeb5c1abb01403b2fde64cc9.
-						 */
-						hasPss = true;
-						readNextWord(&buf);
-						pss += readNextWordAsLongLong(&buf);
-						if (readNextWord(&buf) != "kB") {
-							goto error;
-						}
-					} else if (startsWith(line, "Private_Dirty:")) {
-						hasPrivateDirty = true;
-						readNextWord(&buf);
-						privateDirty += readNextWordAsLongLong(&buf);
-						if (readNextWord(&buf) != "kB") {
-							goto error;
-						}
-					} else if (startsWith(line, "Swap:")) {
-						hasSwap = true;
-						readNextWord(&buf);
-						swap += readNextWordAsLongLong(&buf);
-						if (readNextWord(&buf) != "kB") {
-							goto error;
-						}
-					}
-				} catch (const ParseException &) {
-					goto error;
-				}
-			}
-
-			if (!hasPss) {
+			snprintf(smapsFilename, sizeof(smapsFilename), "/proc/%d/smaps", (int) pid);
+			if (!readSmaps(smapsFilename, buf, sizeof(buf), pss, privateDirty, swap)) {
 				pss = -1;
-			}
-			if (!hasPrivateDirty) {
 				privateDirty = -1;
-			}
-			if (!hasSwap) {
 				swap = -1;
 			}
 		#endif
@@ -582,6 +582,38 @@
     offsetof(passenger_loc_conf_t, autogenerated.force_max_concurrent_requests_per_process),
     NULL
 },
+{
+    ngx_string("passenger_routing_strategy"),
+    NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_HTTP_LIF_CONF | NGX_CONF_TAKE1,
+    passenger_conf_set_routing_strategy,
+    NGX_HTTP_LOC_CONF_OFFSET,
+    offsetof(passenger_loc_conf_t, autogenerated.routing_strategy),
+    NULL
+},
+{
+    ngx_string("passenger_spawn_concurrency"),
+    NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_HTTP_LIF_CONF | NGX_CONF_TAKE1,
+    passenger_conf_set_spawn_concurrency,
+    NGX_HTTP_LOC_CONF_OFFSET,
+    offsetof(passenger_loc_conf_t, autogenerated.spawn_concurrency),
+    NULL
+},
+{
+    ngx_string("passenger_predictive_spawning"),
+    NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_HTTP_LIF_CONF | NGX_CONF_FLAG,
+    passenger_conf_set_predictive_spawning,
+    NGX_HTTP_LOC_CONF_OFFSET,
+    offsetof(passenger_loc_conf_t, autogenerated.predictive_spawning),
+    NULL
+},
+{
+    ngx_string("passenger_memory_limit"),
+    NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_HTTP_LIF_CONF | NGX_CONF_TAKE1,
+    passenger_conf_set_memory_limit,
+    NGX_HTTP_LOC_CONF_OFFSET,
+    offsetof(passenger_loc_conf_t, autogenerated.memory_limit),
+    NULL
+},
 {
     ngx_string("passenger_fly_with"),
     NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
@@ -606,14 +638,6 @@
     0,
     NULL
 },
-{
-    ngx_string("passenger_memory_limit"),
-    NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_HTTP_LIF_CONF | NGX_CONF_TAKE1,
-    passenger_enterprise_only,
-    NGX_HTTP_LOC_CONF_OFFSET,
-    0,
-    NULL
-},
 {
     ngx_string("passenger_concurrency_model"),
     NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_HTTP_LIF_CONF | NGX_CONF_TAKE1,
@@ -829,3 +829,51 @@ passenger_conf_set_force_max_concurrent_requests_per_process(ngx_conf_t *cf, ngx
     return ngx_conf_set_num_slot(cf, cmd, conf);
 }
 
+static char *
+passenger_conf_set_routing_strategy(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    passenger_loc_conf_t *passenger_conf = conf;
+
+    passenger_conf->autogenerated.routing_strategy_explicitly_set = 1;
+    record_loc_conf_source_location(cf, passenger_conf,
+        &passenger_conf->autogenerated.routing_strategy_source_file,
+        &passenger_conf->autogenerated.routing_strategy_source_line);
+
+    return ngx_conf_set_str_slot(cf, cmd, conf);
+}
+
+static char *
+passenger_conf_set_spawn_concurrency(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    passenger_loc_conf_t *passenger_conf = conf;
+
+    passenger_conf->autogenerated.spawn_concurrency_explicitly_set = 1;
+    record_loc_conf_source_location(cf, passenger_conf,
+        &passenger_conf->autogenerated.spawn_concurrency_source_file,
+        &passenger_conf->autogenerated.spawn_concurrency_source_line);
+
+    return ngx_conf_set_num_slot(cf, cmd, conf);
+}
+
+static char *
+passenger_conf_set_predictive_spawning(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    passenger_loc_conf_t *passenger_conf = conf;
+
+    passenger_conf->autogenerated.predictive_spawning_explicitly_set = 1;
+    record_loc_conf_source_location(cf, passenger_conf,
+        &passenger_conf->autogenerated.predictive_spawning_source_file,
+        &passenger_conf->autogenerated.predictive_spawning_source_line);
+
+    return ngx_conf_set_flag_slot(cf, cmd, conf);
+}
+
+static char *
+passenger_conf_set_memory_limit(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    passenger_loc_conf_t *passenger_conf = conf;
+
+    passenger_conf->autogenerated.memory_limit_explicitly_set = 1;
+    record_loc_conf_source_location(cf, passenger_conf,
+        &passenger_conf->autogenerated.memory_limit_source_file,
+        &passenger_conf->autogenerated.memory_limit_source_line);
+
+    return ngx_conf_set_num_slot(cf, cmd, conf);
+}
+
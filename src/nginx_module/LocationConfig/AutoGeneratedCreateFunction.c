@@ -93,6 +93,11 @@ passenger_create_autogenerated_loc_conf(passenger_autogenerated_loc_conf_t  *con
     conf->vary_turbocache_by_cookie.len  = 0;
     conf->abort_websockets_on_process_shutdown = NGX_CONF_UNSET;
     conf->force_max_concurrent_requests_per_process = NGX_CONF_UNSET;
+    conf->routing_strategy.data = NULL;
+    conf->routing_strategy.len  = 0;
+    conf->spawn_concurrency = NGX_CONF_UNSET;
+    conf->predictive_spawning = NGX_CONF_UNSET;
+    conf->memory_limit = NGX_CONF_UNSET;
 
     conf->app_file_descriptor_ulimit_source_file.data = NULL;
     conf->app_file_descriptor_ulimit_source_file.len = 0;
@@ -278,5 +283,21 @@ passenger_create_autogenerated_loc_conf(passenger_autogenerated_loc_conf_t  *con
     conf->force_max_concurrent_requests_per_process_source_file.len = 0;
     conf->force_max_concurrent_requests_per_process_source_line = 0;
     conf->force_max_concurrent_requests_per_process_explicitly_set = 0;
+    conf->routing_strategy_source_file.data = NULL;
+    conf->routing_strategy_source_file.len = 0;
+    conf->routing_strategy_source_line = 0;
+    conf->routing_strategy_explicitly_set = 0;
+    conf->spawn_concurrency_source_file.data = NULL;
+    conf->spawn_concurrency_source_file.len = 0;
+    conf->spawn_concurrency_source_line = 0;
+    conf->spawn_concurrency_explicitly_set = 0;
+    conf->predictive_spawning_source_file.data = NULL;
+    conf->predictive_spawning_source_file.len = 0;
+    conf->predictive_spawning_source_line = 0;
+    conf->predictive_spawning_explicitly_set = 0;
+    conf->memory_limit_source_file.data = NULL;
+    conf->memory_limit_source_file.len = 0;
+    conf->memory_limit_source_line = 0;
+    conf->memory_limit_explicitly_set = 0;
 }
 
@@ -264,6 +264,39 @@ passenger_serialize_autogenerated_loc_conf_to_headers(ngx_conf_t *cf, passenger_
         len += sizeof("\r\n") - 1;
     }
 
+    if (conf->autogenerated.routing_strategy.data != NULL) {
+        len += sizeof("!~PASSENGER_ROUTING_STRATEGY: ") - 1;
+        len += conf->autogenerated.routing_strategy.len;
+        len += sizeof("\r\n") - 1;
+    }
+
+    if (conf->autogenerated.spawn_concurrency != NGX_CONF_UNSET) {
+        end = ngx_snprintf(int_buf,
+            sizeof(int_buf) - 1,
+            "%d",
+            conf->autogenerated.spawn_concurrency);
+        len += sizeof("!~PASSENGER_SPAWN_CONCURRENCY: ") - 1;
+        len += end - int_buf;
+        len += sizeof("\r\n") - 1;
+    }
+
+    if (conf->autogenerated.predictive_spawning != NGX_CONF_UNSET) {
+        len += sizeof("!~PASSENGER_PREDICTIVE_SPAWNING: ") - 1;
+        len += conf->autogenerated.predictive_spawning
+            ? sizeof("t\r\n") - 1
+            : sizeof("f\r\n") - 1;
+    }
+
+    if (conf->autogenerated.memory_limit != NGX_CONF_UNSET) {
+        end = ngx_snprintf(int_buf,
+            sizeof(int_buf) - 1,
+            "%d",
+            conf->autogenerated.memory_limit);
+        len += sizeof("!~PASSENGER_MEMORY_LIMIT: ") - 1;
+        len += end - int_buf;
+        len += sizeof("\r\n") - 1;
+    }
+
 
     /* Create string */
     buf = pos = ngx_pnalloc(cf->pool, len);
@@ -560,6 +593,49 @@ passenger_serialize_autogenerated_loc_conf_to_headers(ngx_conf_t *cf, passenger_
         pos = ngx_copy(pos, int_buf, end - int_buf);
         pos = ngx_copy(pos, (const u_char *) "\r\n", sizeof("\r\n") - 1);
     }
+    if (conf->autogenerated.routing_strategy.data != NULL) {
+        pos = ngx_copy(pos,
+            "!~PASSENGER_ROUTING_STRATEGY: ",
+            sizeof("!~PASSENGER_ROUTING_STRATEGY: ") - 1);
+        pos = ngx_copy(pos,
+            conf->autogenerated.routing_strategy.data,
+            conf->autogenerated.routing_strategy.len);
+        pos = ngx_copy(pos, (const u_char *) "\r\n", sizeof("\r\n") - 1);
+    }
+    if (conf->autogenerated.spawn_concurrency != NGX_CONF_UNSET) {
+        pos = ngx_copy(pos,
+            "!~PASSENGER_SPAWN_CONCURRENCY: ",
+            sizeof("!~PASSENGER_SPAWN_CONCURRENCY: ") - 1);
+        end = ngx_snprintf(int_buf,
+            sizeof(int_buf) - 1,
+            "%d",
+            conf->autogenerated.spawn_concurrency);
+        pos = ngx_copy(pos, int_buf, end - int_buf);
+        pos = ngx_copy(pos, (const u_char *) "\r\n", sizeof("\r\n") - 1);
+    }
+
+    if (conf->autogenerated.predictive_spawning != NGX_CONF_UNSET) {
+        pos = ngx_copy(pos,
+            "!~PASSENGER_PREDICTIVE_SPAWNING: ",
+            sizeof("!~PASSENGER_PREDICTIVE_SPAWNING: ") - 1);
+        if (conf->autogenerated.predictive_spawning) {
+            pos = ngx_copy(pos, "t\r\n", sizeof("t\r\n") - 1);
+        } else {
+            pos = ngx_copy(pos, "f\r\n", sizeof("f\r\n") - 1);
+        }
+    }
+
+    if (conf->autogenerated.memory_limit != NGX_CONF_UNSET) {
+        pos = ngx_copy(pos,
+            "!~PASSENGER_MEMORY_LIMIT: ",
+            sizeof("!~PASSENGER_MEMORY_LIMIT: ") - 1);
+        end = ngx_snprintf(int_buf,
+            sizeof(int_buf) - 1,
+            "%d",
+            conf->autogenerated.memory_limit);
+        pos = ngx_copy(pos, int_buf, end - int_buf);
+        pos = ngx_copy(pos, (const u_char *) "\r\n", sizeof("\r\n") - 1);
+    }
 
     conf->options_cache.data = buf;
     conf->options_cache.len = pos - buf;
@@ -155,6 +155,18 @@ passenger_merge_autogenerated_loc_conf(passenger_autogenerated_loc_conf_t *conf,
     ngx_conf_merge_value(conf->force_max_concurrent_requests_per_process,
         prev->force_max_concurrent_requests_per_process,
         NGX_CONF_UNSET);
+    ngx_conf_merge_str_value(conf->routing_strategy,
+        prev->routing_strategy,
+        NULL);
+    ngx_conf_merge_value(conf->spawn_concurrency,
+        prev->spawn_concurrency,
+        NGX_CONF_UNSET);
+    ngx_conf_merge_value(conf->predictive_spawning,
+        prev->predictive_spawning,
+        NGX_CONF_UNSET);
+    ngx_conf_merge_value(conf->memory_limit,
+        prev->memory_limit,
+        NGX_CONF_UNSET);
 
     return 1;
 }
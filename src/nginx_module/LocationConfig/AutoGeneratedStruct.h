@@ -55,8 +55,11 @@ typedef struct {
     ngx_int_t max_preloader_idle_time;
     ngx_int_t max_request_queue_size;
     ngx_int_t max_requests;
+    ngx_int_t memory_limit;
     ngx_int_t min_instances;
+    ngx_flag_t predictive_spawning;
     ngx_int_t request_queue_overflow_status_code;
+    ngx_int_t spawn_concurrency;
     ngx_int_t start_timeout;
     ngx_flag_t sticky_sessions;
     ngx_str_t app_group_name;
@@ -70,6 +73,7 @@ typedef struct {
     ngx_str_t nodejs;
     ngx_str_t python;
     ngx_str_t restart_dir;
+    ngx_str_t routing_strategy;
     ngx_str_t ruby;
     ngx_str_t spawn_method;
     ngx_str_t startup_file;
@@ -100,13 +104,17 @@ typedef struct {
     ngx_str_t max_preloader_idle_time_source_file;
     ngx_str_t max_request_queue_size_source_file;
     ngx_str_t max_requests_source_file;
+    ngx_str_t memory_limit_source_file;
     ngx_str_t meteor_app_settings_source_file;
     ngx_str_t min_instances_source_file;
     ngx_str_t nodejs_source_file;
+    ngx_str_t predictive_spawning_source_file;
     ngx_str_t python_source_file;
     ngx_str_t request_queue_overflow_status_code_source_file;
     ngx_str_t restart_dir_source_file;
+    ngx_str_t routing_strategy_source_file;
     ngx_str_t ruby_source_file;
+    ngx_str_t spawn_concurrency_source_file;
     ngx_str_t spawn_method_source_file;
     ngx_str_t start_timeout_source_file;
     ngx_str_t startup_file_source_file;
@@ -147,13 +155,17 @@ typedef struct {
     ngx_uint_t max_preloader_idle_time_source_line;
     ngx_uint_t max_request_queue_size_source_line;
     ngx_uint_t max_requests_source_line;
+    ngx_uint_t memory_limit_source_line;
     ngx_uint_t meteor_app_settings_source_line;
     ngx_uint_t min_instances_source_line;
     ngx_uint_t nodejs_source_line;
+    ngx_uint_t predictive_spawning_source_line;
     ngx_uint_t python_source_line;
     ngx_uint_t request_queue_overflow_status_code_source_line;
     ngx_uint_t restart_dir_source_line;
+    ngx_uint_t routing_strategy_source_line;
     ngx_uint_t ruby_source_line;
+    ngx_uint_t spawn_concurrency_source_line;
     ngx_uint_t spawn_method_source_line;
     ngx_uint_t start_timeout_source_line;
     ngx_uint_t startup_file_source_line;
@@ -194,13 +206,17 @@ typedef struct {
     ngx_int_t max_preloader_idle_time_explicitly_set;
     ngx_int_t max_request_queue_size_explicitly_set;
     ngx_int_t max_requests_explicitly_set;
+    ngx_int_t memory_limit_explicitly_set;
     ngx_int_t meteor_app_settings_explicitly_set;
     ngx_int_t min_instances_explicitly_set;
     ngx_int_t nodejs_explicitly_set;
+    ngx_int_t predictive_spawning_explicitly_set;
     ngx_int_t python_explicitly_set;
     ngx_int_t request_queue_overflow_status_code_explicitly_set;
     ngx_int_t restart_dir_explicitly_set;
+    ngx_int_t routing_strategy_explicitly_set;
     ngx_int_t ruby_explicitly_set;
+    ngx_int_t spawn_concurrency_explicitly_set;
     ngx_int_t spawn_method_explicitly_set;
     ngx_int_t start_timeout_explicitly_set;
     ngx_int_t startup_file_explicitly_set;
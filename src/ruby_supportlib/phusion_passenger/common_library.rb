@@ -341,6 +341,10 @@ def locate_source_file(path)
     :source   => 'ServerKit/Implementation.cpp',
     :category => :other,
     :optimize => true
+  define_component 'ServerKit/Http2Hpack.o',
+    :source   => 'ServerKit/Http2Hpack.cpp',
+    :category => :other,
+    :optimize => true
   define_component 'DataStructures/LString.o',
     :source   => 'DataStructures/LString.cpp',
     :category => :other
@@ -46,6 +46,7 @@ module SharedConstants
     DEFAULT_LOG_LEVEL_NAME = "notice"
     DEFAULT_APP_OUTPUT_LOG_LEVEL = 3
     DEFAULT_APP_OUTPUT_LOG_LEVEL_NAME = "notice"
+    DEFAULT_ASYNC_LOGGING_BUFFER_SIZE = 1024 * 64
     DEFAULT_INTEGRATION_MODE = "standalone"
     DEFAULT_SOCKET_BACKLOG = 2048
     DEFAULT_RUBY = "ruby"
@@ -64,8 +65,18 @@ module SharedConstants
     DEFAULT_STICKY_SESSIONS_COOKIE_NAME = "_passenger_route"
     DEFAULT_APP_THREAD_COUNT = 1
     DEFAULT_RESPONSE_BUFFER_HIGH_WATERMARK = 1024 * 1024 * 128
+    DEFAULT_RESPONSE_COMPRESSION_LEVEL = 6
+    DEFAULT_RESPONSE_COMPRESSION_MIN_SIZE = 256
     DEFAULT_MAX_REQUEST_QUEUE_SIZE = 100
+    DEFAULT_OPEN_FILE_CACHE_SIZE = 256
+    DEFAULT_SPLICE_RELAY_MIN_SIZE = 1024 * 128
     DEFAULT_STAT_THROTTLE_RATE = 10
+    DEFAULT_TURBOCACHE_MAX_ENTRIES = 1024
+    DEFAULT_TURBOCACHE_MAX_MEMORY = 1024 * 1024 * 32
+    DEFAULT_TURBOCACHE_MAX_BODY_SIZE = 1024 * 256
+    DEFAULT_TURBOCACHE_SHARDS = 16
+    DEFAULT_TURBOCACHE_COLLAPSED_FORWARDING_TIMEOUT = 5
+    DEFAULT_UST_ROUTER_ASYNC_QUEUE_SIZE = 1024 * 1024 * 4
     DEFAULT_ANALYTICS_LOG_USER = DEFAULT_WEB_APP_USER
     DEFAULT_ANALYTICS_LOG_GROUP = ""
     DEFAULT_ANALYTICS_LOG_PERMISSIONS = "u=rwx,g=rx,o=rx"
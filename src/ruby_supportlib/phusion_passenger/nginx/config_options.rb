@@ -440,6 +440,22 @@
     :name   => 'passenger_force_max_concurrent_requests_per_process',
     :type   => :integer
   },
+  {
+    :name   => 'passenger_routing_strategy',
+    :type   => :string
+  },
+  {
+    :name   => 'passenger_spawn_concurrency',
+    :type   => :integer
+  },
+  {
+    :name   => 'passenger_predictive_spawning',
+    :type   => :flag
+  },
+  {
+    :name   => 'passenger_memory_limit',
+    :type   => :integer
+  },
 
   ###### Enterprise features ######
   {
@@ -462,12 +478,6 @@
     :function => 'passenger_enterprise_only',
     :field    => nil
   },
-  {
-    :name     => 'passenger_memory_limit',
-    :type     => :integer,
-    :function => 'passenger_enterprise_only',
-    :field    => nil
-  },
   {
     :name     => 'passenger_concurrency_model',
     :type     => :string,
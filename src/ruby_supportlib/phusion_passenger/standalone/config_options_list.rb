@@ -350,6 +350,29 @@ module Standalone
                       "application process can handle the given\n" \
                       "number of concurrent requests per process"
       },
+      {
+        :name      => :routing_strategy,
+        :type_desc => 'NAME',
+        :desc      => "How requests are distributed over an\n" \
+                      "application's processes: 'lowest_busyness',\n" \
+                      "'power_of_two_choices' or 'least_latency'.\n" \
+                      "Default: lowest_busyness"
+      },
+      {
+        :name      => :spawn_concurrency,
+        :type      => :integer,
+        :min       => 1,
+        :desc      => "Maximum number of processes that are\n" \
+                      "spawned at the same time for a single\n" \
+                      "application. Default: 1"
+      },
+      {
+        :name      => :predictive_spawning,
+        :type      => :boolean,
+        :desc      => "Spawn and shut down processes ahead of\n" \
+                      "demand, based on the request arrival rate\n" \
+                      "and response times"
+      },
       {
         :name      => :start_timeout,
         :type      => :integer,
@@ -376,8 +399,9 @@ module Standalone
         :name      => :memory_limit,
         :type      => :integer,
         :type_desc => 'MB',
-        :desc      => "Restart application processes that go over\n" \
-                      "the given memory limit (Enterprise only)"
+        :desc      => "Gracefully replace application processes\n" \
+                      "that go over the given memory limit, one\n" \
+                      "at a time. Default: 0 (no limit)"
       },
       {
         :name      => :rolling_restarts,
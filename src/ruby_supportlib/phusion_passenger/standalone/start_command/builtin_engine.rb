@@ -155,6 +155,10 @@ def build_daemon_controller_options
             command << " --no-abort-websockets-on-process-shutdown"
           end
           add_param(command, :force_max_concurrent_requests_per_process, "--force-max-concurrent-requests-per-process")
+          add_param(command, :routing_strategy, "--routing-strategy")
+          add_param(command, :spawn_concurrency, "--spawn-concurrency")
+          add_flag_param(command, :predictive_spawning, "--predictive-spawning")
+          add_param(command, :memory_limit, "--memory-limit")
           add_flag_param(command, :load_shell_envvars, "--load-shell-envvars")
           add_param(command, :max_pool_size, "--max-pool-size")
           add_param(command, :min_instances, "--min-instances")
@@ -165,7 +169,6 @@ def build_daemon_controller_options
           add_enterprise_param(command, :thread_count, "--app-thread-count")
           add_param(command, :max_requests, "--max-requests")
           add_enterprise_param(command, :max_request_time, "--max-request-time")
-          add_enterprise_param(command, :memory_limit, "--memory-limit")
           add_enterprise_flag_param(command, :rolling_restarts, "--rolling-restarts")
           add_enterprise_flag_param(command, :resist_deployment_errors, "--resist-deployment-errors")
           add_enterprise_flag_param(command, :debugger, "--debugger")
@@ -228,7 +228,7 @@ namespace tut {
 		// as the new process is done spawning.
 		Options options = createOptions();
 
-		ScopedLock l(pool->syncher);
+		PoolScopedLock l(pool->syncher);
 		pool->asyncGet(options, callback, false);
 		ensure_equals("(1)", number, 0);
 		ensure("(2)", pool->getWaitlist.empty());
@@ -263,7 +263,7 @@ namespace tut {
 		ensure(!process->isTotallyBusy());
 
 		// Verify test assertion.
-		ScopedLock l(pool->syncher);
+		PoolScopedLock l(pool->syncher);
 		pool->asyncGet(options, callback, false);
 		ensure_equals("callback is immediately called", number, 2);
 	}
@@ -384,7 +384,7 @@ namespace tut {
 
 		// Now open another session. It should complete immediately
 		// and should not use the first process.
-		ScopedLock l(pool->syncher);
+		PoolScopedLock l(pool->syncher);
 		pool->asyncGet(options, callback, false);
 		ensure_equals("asyncGet() completed immediately", number, 2);
 		SessionPtr session2 = currentSession;
@@ -417,7 +417,7 @@ namespace tut {
 		GroupPtr group = pool->findOrCreateGroup(options);
 		spawningKitConfig->concurrency = 2;
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			group->spawn();
 		}
 		EVENTUALLY(5,
@@ -536,7 +536,7 @@ namespace tut {
 		);
 
 		// The next asyncGet() should spawn a new process and the action should be queued.
-		ScopedLock l(pool->syncher);
+		PoolScopedLock l(pool->syncher);
 		spawningKitConfig->spawnTime = 5000000;
 		pool->asyncGet(options, callback, false);
 		ensure(group->spawning());
@@ -620,6 +620,88 @@ namespace tut {
 		ensure_equals(pool->getGroupCount(), 0u);
 	}
 
+	TEST_METHOD(15) {
+		// With the power-of-two-choices routing strategy, asyncGet() picks
+		// the least busy of two random processes. With only 2 processes
+		// that is always the least busy process.
+		Options options = createOptions();
+		options.routingStrategy = RS_POWER_OF_TWO_CHOICES;
+		options.minProcesses = 2;
+		pool->setMax(2);
+		GroupPtr group = pool->findOrCreateGroup(options);
+		spawningKitConfig->concurrency = 2;
+		{
+			PoolLockGuard l(pool->syncher);
+			group->spawn();
+		}
+		EVENTUALLY(5,
+			result = pool->getProcessCount() == 2;
+		);
+
+		vector<SessionPtr> sessions;
+		for (int i = 0; i < 4; i++) {
+			pool->asyncGet(options, callback);
+			ensure_equals(number, i + 1);
+			sessions.push_back(currentSession);
+			currentSession.reset();
+		}
+
+		ProcessPtr process1 = sessions[0]->getProcess()->shared_from_this();
+		ProcessPtr process2 = sessions[1]->getProcess()->shared_from_this();
+		ensure("(1)", process1 != process2);
+		ensure_equals("(2)", process1->busyness(), process2->busyness());
+		ensure("(3)", process1->isTotallyBusy());
+	}
+
+	TEST_METHOD(16) {
+		// With the least-latency routing strategy, asyncGet() prefers the
+		// process with the lowest measured response time, as long as it
+		// isn't so busy that another process is expected to respond sooner.
+		Options options = createOptions();
+		options.routingStrategy = RS_LEAST_LATENCY;
+		options.minProcesses = 2;
+		pool->setMax(2);
+		GroupPtr group = pool->findOrCreateGroup(options);
+		spawningKitConfig->concurrency = 4;
+		{
+			PoolLockGuard l(pool->syncher);
+			group->spawn();
+		}
+		EVENTUALLY(5,
+			result = pool->getProcessCount() == 2;
+		);
+
+		ProcessPtr fastProcess, slowProcess;
+		{
+			PoolLockGuard l(pool->syncher);
+			unsigned long long now = SystemTime::getUsec();
+			slowProcess = group->enabledProcesses[0];
+			fastProcess = group->enabledProcesses[1];
+			slowProcess->responseTimeAverage.update(350000, now);
+			fastProcess->responseTimeAverage.update(100000, now);
+		}
+
+		vector<SessionPtr> sessions;
+		for (int i = 0; i < 3; i++) {
+			pool->asyncGet(options, callback);
+			ensure_equals(number, i + 1);
+			sessions.push_back(currentSession);
+			currentSession.reset();
+		}
+
+		// 100ms * 1, 100ms * 2 and 100ms * 3 are all expected to be
+		// faster than 350ms * 1.
+		ensure_equals("(1)", sessions[0]->getProcess(), fastProcess.get());
+		ensure_equals("(2)", sessions[1]->getProcess(), fastProcess.get());
+		ensure_equals("(3)", sessions[2]->getProcess(), fastProcess.get());
+
+		// 100ms * 4 is expected to be slower than 350ms * 1.
+		pool->asyncGet(options, callback);
+		ensure_equals(number, 4);
+		ensure_equals("(4)", currentSession->getProcess(), slowProcess.get());
+		currentSession.reset();
+	}
+
 	TEST_METHOD(17) {
 		// Test that restartGroupByName() spawns more processes to ensure
 		// that minProcesses and other constraints are met.
@@ -659,6 +741,26 @@ namespace tut {
 
 	/*********** Test asyncGet() behavior on multiple Groups ***********/
 
+	TEST_METHOD(19) {
+		// If an existing process can handle the request right away, then
+		// asyncGet() and closing the session go through the routing fast
+		// path, which takes the group's routing lock.
+		Options options = ensureMinProcesses(1);
+		GroupPtr group = pool->groups.lookupCopy("stub/rack");
+		boost::uint64_t acquisitions;
+		{
+			PoolLockGuard l(pool->syncher);
+			acquisitions = group->routingSyncher.getStats().acquisitions;
+		}
+
+		pool->asyncGet(options, callback);
+		ensure_equals("asyncGet() completed immediately", number, 2);
+		currentSession.reset();
+
+		PoolLockGuard l(pool->syncher);
+		ensure_equals(group->routingSyncher.getStats().acquisitions, acquisitions + 2);
+	}
+
 	TEST_METHOD(20) {
 		// If the pool is full, and one tries to asyncGet() from a nonexistant group,
 		// then it will kill the oldest idle process and spawn a new process.
@@ -837,7 +939,7 @@ namespace tut {
 		SystemTime::force(2);
 		GroupPtr barGroup = pool->get(options2, &ticket)->getGroup()->shared_from_this();
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure_equals("(1)", barGroup->spawn(), SR_OK);
 		}
 		debug->debugger->recv("Begin spawn loop iteration 1");
@@ -860,7 +962,7 @@ namespace tut {
 		debug->messages->send("Proceed with spawn loop iteration 2");
 		debug->debugger->recv("Spawn loop done");
 		EVENTUALLY(5,
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			vector<ProcessPtr> processes = pool->getProcesses(false);
 			if (processes.size() == 1) {
 				GroupPtr group = processes[0]->getGroup()->shared_from_this();
@@ -922,7 +1024,7 @@ namespace tut {
 		debug->messages->send("Proceed with spawn loop iteration 2");
 		debug->debugger->recv("Spawn loop done");
 		EVENTUALLY(5,
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			vector<ProcessPtr> processes = pool->getProcesses(false);
 			if (processes.size() == 1) {
 				GroupPtr group = processes[0]->getGroup()->shared_from_this();
@@ -957,7 +1059,7 @@ namespace tut {
 		ProcessPtr process = currentSession->getProcess()->shared_from_this();
 		pool->detachProcess(process);
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure(process->enabled == Process::DETACHED);
 		}
 		EVENTUALLY(5,
@@ -988,13 +1090,13 @@ namespace tut {
 		pool->asyncGet(options, callback);
 
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure_equals(pool->groups.lookupCopy("test")->getWaitlist.size(), 1u);
 		}
 
 		pool->detachProcess(session1->getProcess()->shared_from_this());
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure(pool->groups.lookupCopy("test")->spawning());
 			ensure_equals(pool->groups.lookupCopy("test")->enabledCount, 0);
 			ensure_equals(pool->groups.lookupCopy("test")->getWaitlist.size(), 1u);
@@ -1026,7 +1128,7 @@ namespace tut {
 		spawningKitConfig->spawnTime = 90000;
 		pool->asyncGet(options2, callback);
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure_equals(pool->getWaitlist.size(), 1u);
 		}
 
@@ -1039,7 +1141,7 @@ namespace tut {
 		currentSession.reset();
 		pool->detachProcess(session1->getProcess()->shared_from_this());
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure(pool->groups.lookupCopy("test2") != NULL);
 			ensure_equals(pool->getWaitlist.size(), 0u);
 		}
@@ -1060,7 +1162,7 @@ namespace tut {
 		currentSession.reset();
 		GroupPtr group = process->getGroup()->shared_from_this();
 		pool->detachProcess(process);
-		LockGuard l(pool->syncher);
+		PoolLockGuard l(pool->syncher);
 		ensure_equals(pool->groups.size(), 1u);
 		ensure(group->isAlive());
 		ensure(!group->garbageCollectable());
@@ -1077,18 +1179,18 @@ namespace tut {
 
 		ensure(pool->detachProcess(process));
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure_equals(process->enabled, Process::DETACHED);
 		}
 		SHOULD_NEVER_HAPPEN(100,
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			result = !process->isAlive()
 				|| !process->osProcessExists();
 		);
 
 		session.reset();
 		EVENTUALLY(1,
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			result = process->enabled == Process::DETACHED
 				&& !process->osProcessExists()
 				&& process->isDead();
@@ -1108,7 +1210,7 @@ namespace tut {
 
 		ensure(pool->detachProcess(process));
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure_equals(process->enabled, Process::DETACHED);
 		}
 		EVENTUALLY(1,
@@ -1116,7 +1218,7 @@ namespace tut {
 		);
 
 		SHOULD_NEVER_HAPPEN(100,
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			result = process->isDead()
 				|| !process->osProcessExists();
 		);
@@ -1125,7 +1227,7 @@ namespace tut {
 		g.clear();
 
 		EVENTUALLY(1,
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			result = process->enabled == Process::DETACHED
 				&& !process->osProcessExists()
 				&& process->isDead();
@@ -1155,7 +1257,7 @@ namespace tut {
 		pool->detachProcess(process);
 		debug->debugger->recv("About to start detached processes checker");
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure(process->enabled == Process::DETACHED);
 		}
 
@@ -1187,7 +1289,7 @@ namespace tut {
 		ensure_equals("Disabling succeeds",
 			pool->disableProcess(processes[0]->getGupid()), DR_SUCCESS);
 
-		LockGuard l(pool->syncher);
+		PoolLockGuard l(pool->syncher);
 		ensure(processes[0]->isAlive());
 		ensure_equals("Process is disabled",
 			processes[0]->enabled,
@@ -1261,7 +1363,7 @@ namespace tut {
 		TempThread thr2(boost::bind(&Core_ApplicationPool_PoolTest::disableProcess,
 			this, process2, &code2));
 		EVENTUALLY(5,
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			result = group->enabledCount == 0
 				&& group->disablingCount == 2
 				&& group->disabledCount == 0;
@@ -1280,7 +1382,7 @@ namespace tut {
 			result = code2 == DR_SUCCESS;
 		);
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure_equals(group->enabledCount, 1);
 			ensure_equals(group->disablingCount, 0);
 			ensure_equals(group->disabledCount, 2);
@@ -1308,7 +1410,7 @@ namespace tut {
 			this, session2->getProcess()->shared_from_this(), &code2));
 		EVENTUALLY(2,
 			GroupPtr group = session1->getGroup()->shared_from_this();
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			result = group->enabledCount == 0
 				&& group->disablingCount == 2
 				&& group->disabledCount == 0;
@@ -1327,7 +1429,7 @@ namespace tut {
 		);
 		{
 			GroupPtr group = session1->getGroup()->shared_from_this();
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure_equals(group->enabledCount, 2);
 			ensure_equals(group->disablingCount, 0);
 			ensure_equals(group->disabledCount, 0);
@@ -1386,7 +1488,7 @@ namespace tut {
 		ensure_equals(result, DR_SUCCESS);
 
 		{
-			ScopedLock l(pool->syncher);
+			PoolScopedLock l(pool->syncher);
 			GroupPtr group = processes[0]->getGroup()->shared_from_this();
 			ensure_equals(group->enabledCount, 1);
 			ensure_equals(group->disablingCount, 0);
@@ -1934,7 +2036,7 @@ namespace tut {
 		}
 		ensure_equals(number, 0);
 		{
-			LockGuard l(pool->syncher);
+			PoolLockGuard l(pool->syncher);
 			ensure_equals(group->getWaitlist.size(),
 				3u);
 		}
@@ -2024,6 +2126,177 @@ namespace tut {
 		currentSession.reset();
 	}
 
+	TEST_METHOD(80) {
+		// If spawnConcurrency allows it, then processes are spawned
+		// in parallel, and the time it took to reach the minimum
+		// number of processes is recorded.
+		Options options = createOptions();
+		options.minProcesses = 3;
+		options.spawnConcurrency = 3;
+		spawningKitConfig->spawnTime = 300000;
+		pool->asyncGet(options, callback);
+		{
+			PoolLockGuard l(pool->syncher);
+			GroupPtr group = pool->groups.lookupCopy("stub/rack");
+			ensure_equals(group->processesBeingSpawned, 3);
+		}
+
+		EVENTUALLY(5,
+			PoolLockGuard l(pool->syncher);
+			GroupPtr group = pool->groups.lookupCopy("stub/rack");
+			result = !group->spawning();
+		);
+		ensure_equals(number, 1);
+		ensure_equals(pool->getProcessCount(), 3u);
+		PoolLockGuard l(pool->syncher);
+		GroupPtr group = pool->groups.lookupCopy("stub/rack");
+		ensure_equals(group->lastSpawnBurstProcessCount, 3u);
+		ensure(group->lastTimeToCapacity >= 300000);
+	}
+
+	TEST_METHOD(81) {
+		// Parallel spawning respects the default spawnConcurrency
+		// of 1 as well as the pool capacity.
+		Options options = createOptions();
+		options.minProcesses = 3;
+		spawningKitConfig->spawnTime = 300000;
+		pool->asyncGet(options, callback);
+		{
+			PoolLockGuard l(pool->syncher);
+			GroupPtr group = pool->groups.lookupCopy("stub/rack");
+			ensure_equals(group->processesBeingSpawned, 1);
+		}
+
+		options.appGroupName = "test";
+		options.spawnConcurrency = 3;
+		pool->setMax(3);
+		pool->asyncGet(options, callback);
+		{
+			PoolLockGuard l(pool->syncher);
+			GroupPtr group = pool->groups.lookupCopy("test");
+			ensure_equals(group->processesBeingSpawned, 2);
+		}
+	}
+
+	TEST_METHOD(82) {
+		// Test that predictive spawning spawns processes ahead of demand,
+		// based on the arrival rate and the response time, and that it
+		// shuts down idle processes once demand drops.
+		ensureMinProcesses(1);
+		unsigned long long now = SystemTime::getUsec();
+		boost::container::vector<Callback> actions;
+		GroupPtr group = pool->groups.lookupCopy("stub/rack");
+		{
+			PoolLockGuard l(pool->syncher);
+			group->options.predictiveSpawning = true;
+			group->requestsArrived = 0;
+			group->responseTimeAverage.update(500000, now);
+			SystemTime::forceAll(now);
+			group->updatePredictiveSpawning(now, actions);
+			ensure_equals("No prediction is possible yet",
+				group->predictedProcessCount, 0u);
+
+			// 5 requests per second with a response time of 0.5 seconds
+			// means 2.5 concurrent requests. At 75% utilization, that
+			// needs 4 processes.
+			group->requestsArrived = 10;
+			now += 2000000;
+			SystemTime::forceAll(now);
+			group->updatePredictiveSpawning(now, actions);
+			ensure_equals(group->predictedProcessCount, 4u);
+			ensure(group->spawning());
+		}
+		EVENTUALLY(5,
+			result = pool->getProcessCount() == 4;
+		);
+
+		{
+			PoolLockGuard l(pool->syncher);
+			now += 28000000;
+			SystemTime::forceAll(now);
+			group->updatePredictiveSpawning(now, actions);
+			ensure_equals(group->predictedProcessCount, 1u);
+			ensure_equals(group->getProcessCount(), 3u);
+		}
+		Pool::runAllActions(actions);
+	}
+
+	TEST_METHOD(83) {
+		// Test that a process that goes over the memory limit is replaced
+		// in a rolling manner: the replacement is spawned first, and only
+		// then is the heaviest process detached.
+		pool->setMax(3);
+		ensureMinProcesses(2);
+		GroupPtr group = pool->groups.lookupCopy("stub/rack");
+		ProcessPtr heavy;
+		{
+			PoolLockGuard l(pool->syncher);
+			group->options.memoryLimit = 100;
+			ensure(group->findProcessToRecycleForMemory() == NULL);
+			ensure(!group->spawning());
+
+			ProcessList::const_iterator it = group->enabledProcesses.begin();
+			(*it)->metrics.pid = (*it)->getPid();
+			(*it)->metrics.privateDirty = 150 * 1024;
+			it++;
+			(*it)->metrics.pid = (*it)->getPid();
+			(*it)->metrics.privateDirty = 200 * 1024;
+			heavy = *it;
+
+			ensure("Replacement is spawned first",
+				group->findProcessToRecycleForMemory() == NULL);
+			ensure(group->spawning());
+			ensure_equals(group->memoryRecyclingTarget, 3u);
+		}
+		EVENTUALLY(5,
+			result = pool->getProcessCount() == 3;
+		);
+		{
+			PoolLockGuard l(pool->syncher);
+			ensure("Heaviest process is recycled",
+				group->findProcessToRecycleForMemory() == heavy);
+			ensure_equals(group->memoryRecyclingTarget, 0u);
+		}
+	}
+
+	TEST_METHOD(84) {
+		// Test that if no replacement process can be spawned because the
+		// pool is at full capacity, a process that goes over the memory
+		// limit is kept until a replacement can be spawned.
+		pool->setMax(2);
+		ensureMinProcesses(2);
+		GroupPtr group = pool->groups.lookupCopy("stub/rack");
+		{
+			PoolLockGuard l(pool->syncher);
+			group->options.memoryLimit = 100;
+			foreach (const ProcessPtr &process, group->enabledProcesses) {
+				process->metrics.pid = process->getPid();
+				process->metrics.privateDirty = 200 * 1024;
+			}
+
+			ensure("(1)", group->findProcessToRecycleForMemory() == NULL);
+			ensure("(2)", !group->spawning());
+			ensure_equals("(3)", group->memoryRecyclingTarget, 0u);
+			ensure("(4)", group->findProcessToRecycleForMemory() == NULL);
+			ensure_equals("(5)", group->enabledCount, 2);
+		}
+
+		pool->setMax(3);
+		{
+			PoolLockGuard l(pool->syncher);
+			ensure("(6)", group->findProcessToRecycleForMemory() == NULL);
+			ensure("(7)", group->spawning());
+			ensure_equals("(8)", group->enabledCount, 2);
+		}
+		EVENTUALLY(5,
+			result = pool->getProcessCount() == 3;
+		);
+		{
+			PoolLockGuard l(pool->syncher);
+			ensure("(9)", group->findProcessToRecycleForMemory() != NULL);
+		}
+	}
+
 	// TODO: Persistent connections.
 	// TODO: If one closes the session before it has reached EOF, and process's maximum concurrency
 	//       has already been reached, then the pool should ping the process so that it can detect
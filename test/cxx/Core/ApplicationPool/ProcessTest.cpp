@@ -38,7 +38,7 @@ namespace tut {
 			server1.assign(createTcpServer("127.0.0.1", 0, 0, __FILE__, __LINE__), NULL, 0);
 			getsockname(server1, (struct sockaddr *) &addr, &len);
 			socket["name"] = "main1";
-			socket["address"] = "tcp://127.0.0.1:" + toString(addr.sin_port);
+			socket["address"] = "tcp://127.0.0.1:" + toString(ntohs(addr.sin_port));
 			socket["protocol"] = "session";
 			socket["concurrency"] = 3;
 			sockets.append(socket);
@@ -47,7 +47,7 @@ namespace tut {
 			getsockname(server2, (struct sockaddr *) &addr, &len);
 			socket = Json::Value();
 			socket["name"] = "main2";
-			socket["address"] = "tcp://127.0.0.1:" + toString(addr.sin_port);
+			socket["address"] = "tcp://127.0.0.1:" + toString(ntohs(addr.sin_port));
 			socket["protocol"] = "session";
 			socket["concurrency"] = 3;
 			sockets.append(socket);
@@ -56,7 +56,7 @@ namespace tut {
 			getsockname(server3, (struct sockaddr *) &addr, &len);
 			socket = Json::Value();
 			socket["name"] = "main3";
-			socket["address"] = "tcp://127.0.0.1:" + toString(addr.sin_port);
+			socket["address"] = "tcp://127.0.0.1:" + toString(ntohs(addr.sin_port));
 			socket["protocol"] = "session";
 			socket["concurrency"] = 3;
 			sockets.append(socket);
@@ -223,4 +223,61 @@ namespace tut {
 				&& gatheredOutput.find("errorPipe 2\n") != string::npos;
 		);
 	}
+
+	TEST_METHOD(6) {
+		set_test_name("Connections that the application keeps alive are pooled and reused");
+		Json::Value socket = sockets[0];
+		sockets.clear();
+		sockets.append(socket);
+		ProcessPtr process = createProcess();
+
+		SessionPtr session = process->newSession();
+		session->initiate();
+		int fd = session->fd();
+		process->sessionClosed(session.get());
+		session->close(true, true);
+
+		session = process->newSession();
+		session->initiate();
+		ensure_equals("The most recently used connection is reused", session->fd(), fd);
+		Socket *s = session->getSocket();
+		ensure_equals(s->getTotalConnectionsCreated(), 1u);
+		ensure_equals(s->getTotalConnectionsReused(), 1u);
+		process->sessionClosed(session.get());
+		session->close(true, false);
+
+		session = process->newSession();
+		session->initiate();
+		ensure_equals("Connections that are not kept alive are not pooled",
+			s->getTotalConnectionsCreated(), 2u);
+		process->sessionClosed(session.get());
+		session->close(true, false);
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("Idle connections that the application has closed are discarded");
+		Json::Value socket = sockets[0];
+		sockets.clear();
+		sockets.append(socket);
+		ProcessPtr process = createProcess();
+
+		SessionPtr session = process->newSession();
+		session->initiate();
+		process->sessionClosed(session.get());
+		session->close(true, true);
+
+		FileDescriptor appConnection(syscalls::accept(server1, NULL, NULL),
+			__FILE__, __LINE__);
+		appConnection.close();
+		syscalls::usleep(10000);
+
+		session = process->newSession();
+		session->initiate();
+		Socket *s = session->getSocket();
+		ensure_equals(s->getTotalIdleConnectionsDiscarded(), 1u);
+		ensure_equals(s->getTotalConnectionsReused(), 0u);
+		ensure_equals(s->getTotalConnectionsCreated(), 2u);
+		process->sessionClosed(session.get());
+		session->close(true, false);
+	}
 }
@@ -1,4 +1,5 @@
 #include <TestSupport.h>
+#include <zlib.h>
 #include <Constants.h>
 #include <Utils/IOUtils.h>
 #include <Utils/BufferedIO.h>
@@ -18,6 +19,10 @@ namespace tut {
 			virtual void asyncGetFromApplicationPool(Request *req,
 				ApplicationPool2::GetCallback callback)
 			{
+				lastMaxRequests = req->options->maxRequests;
+				lastSnapshotMaxRequests = req->optionsSnapshot->maxRequests;
+				lastSnapshotEnvvars = req->optionsSnapshot->environmentVariables;
+				lastUsedSnapshot = req->options == req->optionsSnapshot.get();
 				callback(sessionToReturn, exceptionToReturn);
 				sessionToReturn.reset();
 			}
@@ -25,6 +30,10 @@ namespace tut {
 		public:
 			ApplicationPool2::AbstractSessionPtr sessionToReturn;
 			ApplicationPool2::ExceptionPtr exceptionToReturn;
+			unsigned long lastMaxRequests;
+			unsigned long lastSnapshotMaxRequests;
+			string lastSnapshotEnvvars;
+			bool lastUsedSnapshot;
 
 			MyController(ServerKit::Context *context,
 				const Core::ControllerSchema &schema,
@@ -32,7 +41,10 @@ namespace tut {
 				const Core::ControllerSingleAppModeSchema &singleAppModeSchema,
 				const Json::Value &singleAppModeConfig)
 				: Core::Controller(context, schema, initialConfig, ConfigKit::DummyTranslator(),
-					&singleAppModeSchema, &singleAppModeConfig, ConfigKit::DummyTranslator())
+					&singleAppModeSchema, &singleAppModeConfig, ConfigKit::DummyTranslator()),
+				  lastMaxRequests(0),
+				  lastSnapshotMaxRequests(0),
+				  lastUsedSnapshot(false)
 				{ }
 		};
 
@@ -96,6 +108,7 @@ namespace tut {
 			}
 			safelyClose(serverSocket);
 			unlink("tmp.server");
+			unlink("tmp.sendfile");
 			LoggingKit::setLevel(LoggingKit::Level(DEFAULT_LOG_LEVEL));
 			bg.stop();
 		}
@@ -258,9 +271,75 @@ namespace tut {
 		string readResponseBody() {
 			return clientConnectionIO.readAll();
 		}
+
+		string createSendfileTestFile(unsigned int size) {
+			string contents;
+			contents.reserve(size);
+			for (unsigned int i = 0; i < size; i++) {
+				contents.append(1, (char) ('a' + i % 26));
+			}
+			createFile("tmp.sendfile", contents);
+			return contents;
+		}
+
+		void sendPeerResponseInBackground(string data) {
+			sendPeerResponse(data);
+		}
+
+		void sendRequestInBackground(string data) {
+			sendRequest(data);
+		}
+
+		static string dechunk(const string &data) {
+			string result;
+			string::size_type pos = 0;
+			while (true) {
+				string::size_type crlf = data.find("\r\n", pos);
+				ensure("Valid chunk header", crlf != string::npos);
+				unsigned int size = hexToULL(data.substr(pos, crlf - pos));
+				pos = crlf + 2;
+				if (size == 0) {
+					return result;
+				}
+				result.append(data, pos, size);
+				pos += size + 2;
+			}
+		}
+
+		static string gunzip(const string &data) {
+			z_stream stream;
+			char buf[4096];
+			string result;
+			int ret;
+
+			memset(&stream, 0, sizeof(stream));
+			ensure_equals(inflateInit2(&stream, MAX_WBITS + 16), Z_OK);
+			stream.next_in = (Bytef *) data.data();
+			stream.avail_in = data.size();
+			do {
+				stream.next_out = (Bytef *) buf;
+				stream.avail_out = sizeof(buf);
+				ret = inflate(&stream, Z_NO_FLUSH);
+				result.append(buf, sizeof(buf) - stream.avail_out);
+			} while (ret == Z_OK);
+			inflateEnd(&stream);
+			ensure_equals("Compressed stream is complete", ret, Z_STREAM_END);
+			return result;
+		}
+
+		Json::Value inspectState() {
+			Json::Value result;
+			bg.safe->runSync(boost::bind(&Core_ControllerTest::_inspectState,
+				this, &result));
+			return result;
+		}
+
+		void _inspectState(Json::Value *result) {
+			*result = controller->inspectStateAsJson();
+		}
 	};
 
-	DEFINE_TEST_GROUP(Core_ControllerTest);
+	DEFINE_TEST_GROUP_WITH_LIMIT(Core_ControllerTest, 70);
 
 
 	/***** Passing request information to the app *****/
@@ -499,6 +578,36 @@ namespace tut {
 	}
 
 
+	TEST_METHOD(23) {
+		set_test_name("HTTP protocol: ask the application to keep the connection alive");
+
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		ensure("(1)", containsSubstring(peerRequestHeader,
+			"Connection: keep-alive\r\n"));
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/plain\r\n"
+			"Content-Length: 2\r\n\r\n"
+			"ok");
+
+		waitUntilSessionClosed();
+		ensure("(2)", testSession.isSuccessful());
+		ensure("(3)", testSession.wantsKeepAlive());
+	}
+
+
 	/***** Passing half-close events to the app *****/
 
 	TEST_METHOD(30) {
@@ -865,4 +974,649 @@ namespace tut {
 		string header = readResponseHeader();
 		ensure(containsSubstring(header, "HTTP/1.1 502"));
 	}
+
+	TEST_METHOD(42) {
+		set_test_name("Turbocache collapsed forwarding: identical cacheable requests"
+			" that arrive while the first one is in flight are not forwarded to the"
+			" application, but are answered from the turbocache");
+
+		config["turbocache_collapsed_forwarding"] = true;
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+
+		FileDescriptor connection2(connectToUnixServer("tmp.server", __FILE__, __LINE__),
+			NULL, 0);
+		BufferedIO connection2IO(connection2);
+		writeExact(connection2,
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		EVENTUALLY(5,
+			result = inspectState()["turbocaching"]["collapsed_forwarding"]["waiting"].asUInt() == 1;
+		);
+
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Length: 5\r\n"
+			"Cache-Control: public, max-age=60\r\n"
+			"\r\n"
+			"hello");
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200"));
+		ensure_equals("(2)", readResponseBody(), "hello");
+
+		header = readHeader(connection2IO);
+		ensure("(3)", containsSubstring(header, "HTTP/1.1 200"));
+		ensure_equals("(4)", connection2IO.readAll(), "hello");
+
+		Json::Value doc = inspectState()["turbocaching"];
+		ensure_equals("(5)", doc["hits"].asUInt(), 1u);
+		ensure_equals("(6)", doc["collapsed_forwarding"]["waiting"].asUInt(), 0u);
+		ensure_equals("(7)", doc["collapsed_forwarding"]["collapsed"].asUInt(), 1u);
+	}
+
+
+	/***** Pool options *****/
+
+	TEST_METHOD(43) {
+		set_test_name("Requests without per-request overrides use the shared options snapshot");
+
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		ensure(controller->lastUsedSnapshot);
+		ensure_equals(controller->lastMaxRequests, 0u);
+	}
+
+	TEST_METHOD(44) {
+		set_test_name("Per-request overrides are applied to a private copy of the options snapshot");
+
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"!~: \r\n"
+			"!~PASSENGER_MAX_REQUESTS: 5\r\n"
+			"!~: \r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		ensure("(1)", !controller->lastUsedSnapshot);
+		ensure_equals("(2)", controller->lastMaxRequests, 5u);
+		ensure_equals("(3)", controller->lastSnapshotMaxRequests, 0u);
+	}
+
+	TEST_METHOD(56) {
+		set_test_name("Per-request overrides in the request that creates the options"
+			" snapshot are not stored in the snapshot");
+
+		config["multi_app"] = true;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"!~: \r\n"
+			"!~PASSENGER_APP_GROUP_NAME: stub/rack\r\n"
+			"!~PASSENGER_APP_ROOT: stub/rack\r\n"
+			"!~PASSENGER_APP_TYPE: rack\r\n"
+			"!~PASSENGER_MAX_REQUESTS: 5\r\n"
+			"!~PASSENGER_ENV_VARS: Zm9vAGJhcgA=\r\n"
+			"!~: \r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		ensure("(1)", !controller->lastUsedSnapshot);
+		ensure_equals("(2)", controller->lastMaxRequests, 5u);
+		ensure_equals("(3)", controller->lastSnapshotMaxRequests, 0u);
+		ensure("(4)", controller->lastSnapshotEnvvars.empty());
+	}
+
+
+	/***** Response compression *****/
+
+	TEST_METHOD(45) {
+		set_test_name("Textual responses are compressed with chunked framing"
+			" if the client accepts gzip");
+
+		config["response_compression"] = true;
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Accept-Encoding: gzip, deflate\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+
+		string body;
+		for (unsigned int i = 0; i < 500; i++) {
+			body.append("<p>Paragraph " + toString(i) + "</p>\n");
+		}
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/html; charset=utf-8\r\n"
+			"Content-Length: " + toString(body.size()) + "\r\n"
+			"ETag: \"v1\"\r\n"
+			"\r\n"
+			+ body);
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(2)", containsSubstring(header, "Content-Encoding: gzip\r\n"));
+		ensure("(3)", containsSubstring(header, "Vary: Accept-Encoding\r\n"));
+		ensure("(4)", containsSubstring(header, "Transfer-Encoding: chunked\r\n"));
+		ensure("(5)", containsSubstring(header, "ETag: W/\"v1\"\r\n"));
+		ensure("(6)", !containsSubstring(header, "Content-Length"));
+
+		string compressed = dechunk(readResponseBody());
+		ensure("(7)", compressed.size() < body.size());
+		ensure_equals("(8)", gunzip(compressed), body);
+	}
+
+	TEST_METHOD(46) {
+		set_test_name("Responses are not compressed if the client does not accept"
+			" any coding that we support");
+
+		config["response_compression"] = true;
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Accept-Encoding: gzip;q=0, br\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+
+		string body(1000, 'x');
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/plain\r\n"
+			"Content-Length: " + toString(body.size()) + "\r\n"
+			"\r\n"
+			+ body);
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(2)", !containsSubstring(header, "Content-Encoding"));
+		ensure("(3)", containsSubstring(header, "Content-Length: 1000\r\n"));
+		ensure_equals("(4)", readResponseBody(), body);
+	}
+
+	TEST_METHOD(47) {
+		set_test_name("The turbocache stores the compressed variant, and serves it"
+			" to clients that negotiate the same content coding");
+
+		config["response_compression"] = true;
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Accept-Encoding: gzip, deflate\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+
+		string body;
+		for (unsigned int i = 0; i < 500; i++) {
+			body.append("{\"id\": " + toString(i) + "},\n");
+		}
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/json\r\n"
+			"Content-Length: " + toString(body.size()) + "\r\n"
+			"Cache-Control: public, max-age=60\r\n"
+			"\r\n"
+			+ body);
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "Content-Encoding: gzip\r\n"));
+		ensure_equals("(2)", gunzip(dechunk(readResponseBody())), body);
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Accept-Encoding: deflate;q=0.5, gzip\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		header = readResponseHeader();
+		ensure("(3)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(4)", containsSubstring(header, "Content-Encoding: gzip\r\n"));
+		ensure("(5)", containsSubstring(header, "Content-Length: "));
+		ensure_equals("(6)", gunzip(readResponseBody()), body);
+		ensure_equals("(7)", inspectState()["turbocaching"]["hits"].asUInt(), 1u);
+	}
+
+
+	/***** Native X-Sendfile and X-Accel-Redirect *****/
+
+	TEST_METHOD(48) {
+		set_test_name("With native_x_sendfile, it serves the file named by the"
+			" X-Sendfile response header itself");
+
+		config["native_x_sendfile"] = true;
+		config["x_sendfile_root"] = absolutizePath(".");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+		string contents = createSendfileTestFile(3 * 1024 * 1024);
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/octet-stream\r\n"
+			"X-Sendfile: " + absolutizePath("tmp.sendfile") + "\r\n"
+			"Content-Length: 0\r\n"
+			"\r\n");
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(2)", containsSubstring(header, "Content-Length: " + toString(contents.size()) + "\r\n"));
+		ensure("(3)", containsSubstring(header, "Accept-Ranges: bytes\r\n"));
+		ensure("(4)", !containsSubstring(header, "X-Sendfile"));
+		// The application is released before the body is sent.
+		waitUntilSessionClosed();
+		ensure("(5)", readResponseBody() == contents);
+	}
+
+	TEST_METHOD(49) {
+		set_test_name("It honors a Range request header for files that it serves itself");
+
+		config["native_x_sendfile"] = true;
+		config["x_sendfile_root"] = absolutizePath(".");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+		string contents = createSendfileTestFile(1000);
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Range: bytes=10-19\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Sendfile: " + absolutizePath("tmp.sendfile") + "\r\n"
+			"\r\n");
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 206 Partial Content\r\n"));
+		ensure("(2)", containsSubstring(header, "Content-Range: bytes 10-19/1000\r\n"));
+		ensure("(3)", containsSubstring(header, "Content-Length: 10\r\n"));
+		ensure_equals("(4)", readResponseBody(), contents.substr(10, 10));
+	}
+
+	TEST_METHOD(50) {
+		set_test_name("It responds with 416 to an unsatisfiable Range request header");
+
+		config["native_x_sendfile"] = true;
+		config["x_sendfile_root"] = absolutizePath(".");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+		createSendfileTestFile(1000);
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Range: bytes=1000-\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Sendfile: " + absolutizePath("tmp.sendfile") + "\r\n"
+			"\r\n");
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 416 Requested Range Not Satisfiable\r\n"));
+		ensure("(2)", containsSubstring(header, "Content-Range: bytes */1000\r\n"));
+		ensure_equals("(3)", readResponseBody(), "");
+	}
+
+	TEST_METHOD(51) {
+		set_test_name("It serves X-Accel-Redirect URIs relative to x_accel_redirect_root");
+
+		config["native_x_sendfile"] = true;
+		config["x_accel_redirect_root"] = absolutizePath(".") + "/";
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+		string contents = createSendfileTestFile(5000);
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Accel-Redirect: /tmp.sendfile?foo=bar\r\n"
+			"\r\n");
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(2)", !containsSubstring(header, "X-Accel-Redirect"));
+		ensure("(3)", readResponseBody() == contents);
+	}
+
+	TEST_METHOD(52) {
+		set_test_name("It responds with 404 if the file does not exist");
+
+		config["native_x_sendfile"] = true;
+		config["x_sendfile_root"] = absolutizePath(".");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Sendfile: " + absolutizePath("tmp.nonexistant") + "\r\n"
+			"\r\n");
+		ensure(containsSubstring(readResponseHeader(), "HTTP/1.1 404 Not Found\r\n"));
+	}
+
+	TEST_METHOD(53) {
+		set_test_name("It responds with 403 if the X-Accel-Redirect URI escapes the root");
+
+		config["native_x_sendfile"] = true;
+		config["x_accel_redirect_root"] = absolutizePath(".");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Accel-Redirect: /../etc/passwd\r\n"
+			"\r\n");
+		ensure(containsSubstring(readResponseHeader(), "HTTP/1.1 403 Forbidden\r\n"));
+	}
+
+	TEST_METHOD(57) {
+		set_test_name("It responds with 403 if the X-Sendfile path is outside x_sendfile_root");
+
+		TempDir root("tmp.sendfile_root");
+		createSendfileTestFile(1000);
+		config["native_x_sendfile"] = true;
+		config["x_sendfile_root"] = absolutizePath("tmp.sendfile_root");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Sendfile: " + absolutizePath("tmp.sendfile") + "\r\n"
+			"\r\n");
+		ensure(containsSubstring(readResponseHeader(), "HTTP/1.1 403 Forbidden\r\n"));
+	}
+
+	TEST_METHOD(58) {
+		set_test_name("It responds with 403 if the X-Sendfile path escapes x_sendfile_root"
+			" through '..'");
+
+		TempDir root("tmp.sendfile_root");
+		createSendfileTestFile(1000);
+		config["native_x_sendfile"] = true;
+		config["x_sendfile_root"] = absolutizePath("tmp.sendfile_root");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Sendfile: " + absolutizePath("tmp.sendfile_root") + "/../tmp.sendfile\r\n"
+			"\r\n");
+		ensure(containsSubstring(readResponseHeader(), "HTTP/1.1 403 Forbidden\r\n"));
+	}
+
+	TEST_METHOD(59) {
+		set_test_name("It responds with 403 if an X-Accel-Redirect URI escapes"
+			" x_accel_redirect_root through a symlink");
+
+		TempDir root("tmp.sendfile_root");
+		createSendfileTestFile(1000);
+		ensure_equals(symlink(absolutizePath(".").c_str(), "tmp.sendfile_root/link"), 0);
+		config["native_x_sendfile"] = true;
+		config["x_accel_redirect_root"] = absolutizePath("tmp.sendfile_root");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Accel-Redirect: /link/tmp.sendfile\r\n"
+			"\r\n");
+		ensure(containsSubstring(readResponseHeader(), "HTTP/1.1 403 Forbidden\r\n"));
+	}
+
+	TEST_METHOD(60) {
+		set_test_name("It passes the X-Sendfile header on if x_sendfile_root is not set");
+
+		config["native_x_sendfile"] = true;
+		config["x_accel_redirect_root"] = absolutizePath(".");
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"X-Sendfile: /etc/passwd\r\n"
+			"\r\n");
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(2)", containsSubstring(header, "X-Sendfile: /etc/passwd\r\n"));
+		ensure_equals("(3)", readResponseBody(), "");
+	}
+
+	TEST_METHOD(61) {
+		set_test_name("native_x_sendfile cannot be enabled without x_sendfile_root"
+			" or x_accel_redirect_root");
+		vector<ConfigKit::Error> errors;
+
+		config["native_x_sendfile"] = true;
+		ConfigKit::Store store(schema);
+		ensure("(1)", !store.update(config, errors));
+		ensure_equals("(2)", errors.size(), 1u);
+		ensure("(3)", containsSubstring(errors[0].getMessage(), "native_x_sendfile"));
+
+		errors.clear();
+		config["x_sendfile_root"] = absolutizePath(".");
+		ensure("(4)", store.update(config, errors));
+	}
+
+
+	/***** Splice relay *****/
+
+	TEST_METHOD(54) {
+		set_test_name("With splice_relay, it relays large response bodies with splice()");
+
+		config["splice_relay"] = true;
+		config["splice_relay_min_size"] = 1024;
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+
+		string body;
+		for (unsigned int i = 0; body.size() < 2 * 1024 * 1024; i++) {
+			body.append(toString(i));
+			body.append("\n");
+		}
+		// The app can only finish writing once the client reads.
+		TempThread thr(boost::bind(&Core_ControllerTest::sendPeerResponseInBackground,
+			this,
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/plain\r\n"
+			"Content-Length: " + toString(body.size()) + "\r\n"
+			"\r\n"
+			+ body));
+
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(2)", containsSubstring(header, "Content-Length: " + toString(body.size()) + "\r\n"));
+		ensure("(3)", readResponseBody() == body);
+		thr.join();
+		ensure("(4)", inspectState()["splice_relay"]["bytes_spliced_to_clients"]["bytes"].asUInt64() > 0);
+	}
+
+	TEST_METHOD(55) {
+		set_test_name("With splice_relay, it relays large request bodies with splice()");
+
+		config["splice_relay"] = true;
+		config["splice_relay_min_size"] = 1024;
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+
+		string body;
+		for (unsigned int i = 0; body.size() < 2 * 1024 * 1024; i++) {
+			body.append(toString(i));
+			body.append("\n");
+		}
+
+		connectToServer();
+		// The client can only finish writing once the app reads.
+		TempThread thr(boost::bind(&Core_ControllerTest::sendRequestInBackground,
+			this,
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Content-Length: " + toString(body.size()) + "\r\n"
+			"Connection: close\r\n"
+			"\r\n"
+			+ body));
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+
+		string receivedBody(body.size(), '\0');
+		ensure_equals("(1)", testSession.getPeerBufferedIO().read(&receivedBody[0], body.size()),
+			(unsigned int) body.size());
+		ensure("(2)", receivedBody == body);
+		thr.join();
+
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Length: 2\r\n"
+			"\r\n"
+			"ok");
+		string header = readResponseHeader();
+		ensure("(3)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure_equals("(4)", readResponseBody(), "ok");
+		ensure("(5)", inspectState()["splice_relay"]["bytes_spliced_to_apps"]["bytes"].asUInt64() > 0);
+	}
 }
@@ -0,0 +1,172 @@
+#include <TestSupport.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <Core/OpenFileCache.h>
+#include <ServerKit/ByteRange.h>
+
+using namespace Passenger;
+using namespace Passenger::Core;
+using namespace Passenger::ServerKit;
+using namespace std;
+
+namespace tut {
+	struct Core_OpenFileCacheTest {
+		OpenFileCache cache;
+
+		Core_OpenFileCacheTest()
+			: cache(2)
+			{ }
+
+		~Core_OpenFileCacheTest() {
+			cache.clear();
+			unlink("tmp.file1");
+			unlink("tmp.file2");
+			unlink("tmp.file3");
+		}
+
+		ByteRangeResult parse(const StaticString &value, boost::uint64_t size,
+			boost::uint64_t &begin, boost::uint64_t &length)
+		{
+			begin = length = 12345;
+			return parseByteRange(value, size, begin, length);
+		}
+	};
+
+	DEFINE_TEST_GROUP(Core_OpenFileCacheTest);
+
+
+	/***** OpenFileCache *****/
+
+	TEST_METHOD(1) {
+		set_test_name("It reuses the file descriptor of a file that hasn't changed");
+		OpenFileCache::File file1, file2;
+
+		createFile("tmp.file1", "hello");
+		ensure_equals("(1)", cache.open("tmp.file1", 0, file1), 0);
+		ensure_equals("(2)", file1.size, 5u);
+		ensure_equals("(3)", cache.open("tmp.file1", 0, file2), 0);
+		ensure_equals("(4)", (int) file2.fd, (int) file1.fd);
+		ensure_equals("(5)", cache.size(), 1u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It reopens a file that has been replaced");
+		OpenFileCache::File file1, file2;
+		char buf[16];
+
+		createFile("tmp.file1", "hello");
+		ensure_equals("(1)", cache.open("tmp.file1", 0, file1), 0);
+		createFile("tmp.file2", "hello world");
+		ensure_equals("(2)", rename("tmp.file2", "tmp.file1"), 0);
+
+		ensure_equals("(3)", cache.open("tmp.file1", 0, file2), 0);
+		ensure("(4)", file2.fd != file1.fd);
+		ensure_equals("(5)", file2.size, 11u);
+		ensure_equals("(6)", pread(file2.fd, buf, sizeof(buf), 0), (ssize_t) 11);
+		ensure_equals("(7)", string(buf, 11), "hello world");
+		// The old file descriptor is still usable by whoever holds it.
+		ensure_equals("(8)", pread(file1.fd, buf, sizeof(buf), 0), (ssize_t) 5);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("It reports errors for nonexistant files and for directories");
+		OpenFileCache::File file;
+
+		ensure_equals("(1)", cache.open("tmp.nonexistant", 0, file), ENOENT);
+		ensure_equals("(2)", cache.open(".", 0, file), EISDIR);
+		ensure_equals("(3)", cache.size(), 0u);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("It evicts the least recently used file");
+		OpenFileCache::File file1, file2, file3, file;
+
+		createFile("tmp.file1", "1");
+		createFile("tmp.file2", "2");
+		createFile("tmp.file3", "3");
+		ensure_equals(cache.open("tmp.file1", 0, file1), 0);
+		ensure_equals(cache.open("tmp.file2", 0, file2), 0);
+		ensure_equals(cache.open("tmp.file1", 0, file), 0);
+		ensure_equals(cache.open("tmp.file3", 0, file3), 0);
+		ensure_equals("(1)", cache.size(), 2u);
+
+		ensure_equals(cache.open("tmp.file1", 0, file), 0);
+		ensure_equals("(2) file1 is still cached", (int) file.fd, (int) file1.fd);
+		ensure_equals(cache.open("tmp.file2", 0, file), 0);
+		ensure("(3) file2 was evicted", file.fd != file2.fd);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("A maximum size of 0 disables caching");
+		OpenFileCache::File file1, file2;
+
+		cache.setMaxSize(0);
+		createFile("tmp.file1", "hello");
+		ensure_equals(cache.open("tmp.file1", 0, file1), 0);
+		ensure_equals(cache.open("tmp.file1", 0, file2), 0);
+		ensure("(1)", file1.fd != file2.fd);
+		ensure_equals("(2)", cache.size(), 0u);
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("It doesn't block on a FIFO that replaced a file after it was stat()ed");
+		OpenFileCache::File file;
+
+		cache.setMaxSize(0);
+		createFile("tmp.file1", "hello");
+		ensure_equals("(1)", cache.open("tmp.file1", 60, file), 0);
+		unlink("tmp.file1");
+		ensure_equals("(2)", mkfifo("tmp.file1", 0600), 0);
+		// The stat() result is throttled, so the file is still believed
+		// to be a regular file.
+		ensure_equals("(3)", cache.open("tmp.file1", 60, file), EISDIR);
+	}
+
+
+	/***** parseByteRange() *****/
+
+	TEST_METHOD(10) {
+		set_test_name("It parses single byte ranges");
+		boost::uint64_t begin, length;
+
+		ensure_equals("(1)", parse("bytes=0-99", 1000, begin, length), BR_SATISFIABLE);
+		ensure_equals("(2)", begin, 0u);
+		ensure_equals("(3)", length, 100u);
+
+		ensure_equals("(4)", parse("bytes=500-", 1000, begin, length), BR_SATISFIABLE);
+		ensure_equals("(5)", begin, 500u);
+		ensure_equals("(6)", length, 500u);
+
+		ensure_equals("(7)", parse("bytes=-100", 1000, begin, length), BR_SATISFIABLE);
+		ensure_equals("(8)", begin, 900u);
+		ensure_equals("(9)", length, 100u);
+
+		ensure_equals("(10)", parse("bytes=900-5000", 1000, begin, length), BR_SATISFIABLE);
+		ensure_equals("(11)", length, 100u);
+
+		ensure_equals("(12)", parse("bytes=-5000", 1000, begin, length), BR_SATISFIABLE);
+		ensure_equals("(13)", begin, 0u);
+		ensure_equals("(14)", length, 1000u);
+	}
+
+	TEST_METHOD(11) {
+		set_test_name("It detects unsatisfiable byte ranges");
+		boost::uint64_t begin, length;
+
+		ensure_equals("(1)", parse("bytes=1000-", 1000, begin, length), BR_UNSATISFIABLE);
+		ensure_equals("(2)", parse("bytes=-0", 1000, begin, length), BR_UNSATISFIABLE);
+		ensure_equals("(3)", parse("bytes=0-", 0, begin, length), BR_UNSATISFIABLE);
+	}
+
+	TEST_METHOD(12) {
+		set_test_name("It ignores malformed and multiple byte ranges");
+		boost::uint64_t begin, length;
+
+		ensure_equals("(1)", parse("bytes=0-1,5-6", 1000, begin, length), BR_IGNORE);
+		ensure_equals("(2)", parse("bytes=5-1", 1000, begin, length), BR_IGNORE);
+		ensure_equals("(3)", parse("items=0-1", 1000, begin, length), BR_IGNORE);
+		ensure_equals("(4)", parse("bytes=-", 1000, begin, length), BR_IGNORE);
+		ensure_equals("(5)", parse("bytes=a-b", 1000, begin, length), BR_IGNORE);
+		ensure_equals("(6)", parse("", 1000, begin, length), BR_IGNORE);
+	}
+}
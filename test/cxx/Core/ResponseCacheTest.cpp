@@ -74,6 +74,7 @@ namespace tut {
 			req.cacheKey = HashedStaticString();
 			req.cacheControl = NULL;
 			req.varyCookie = NULL;
+			req.staleCacheEntry = ResponseCacheEntry();
 			req.envvars = NULL;
 
 			req.appResponse.headers.clear();
@@ -91,6 +92,7 @@ namespace tut {
 			req.appResponse.cacheControl  = NULL;
 			req.appResponse.expiresHeader = NULL;
 			req.appResponse.lastModifiedHeader = NULL;
+			req.appResponse.vary = NULL;
 			req.appResponse.headerCacheBuffers = NULL;
 			req.appResponse.nHeaderCacheBuffers = 0;
 			psg_lstr_init(&req.appResponse.bodyCacheBuffer);
@@ -152,6 +154,63 @@ namespace tut {
 			req.appResponse.bodyType = AppResponse::RBT_CONTENT_LENGTH;
 			req.appResponse.aux.bodyInfo.contentLength = body.size();
 		}
+
+		void initCacheBuffers(const string &header, const string &body) {
+			StaticString headerCopy = psg_pstrdup(req.pool, header);
+			StaticString bodyCopy = psg_pstrdup(req.pool, body);
+			struct iovec *buffer = (struct iovec *) psg_palloc(req.pool, sizeof(struct iovec));
+			buffer->iov_base = (void *) headerCopy.data();
+			buffer->iov_len  = headerCopy.size();
+			req.appResponse.headerCacheBuffers = buffer;
+			req.appResponse.nHeaderCacheBuffers = 1;
+			psg_lstr_init(&req.appResponse.bodyCacheBuffer);
+			psg_lstr_append(&req.appResponse.bodyCacheBuffer, req.pool,
+				bodyCopy.data(), bodyCopy.size());
+		}
+
+		void initStorableResponse(const string &cacheControl, const string &body) {
+			insertAppResponseHeader(createHeader(
+				"cache-control", cacheControl),
+				req.pool);
+			initResponseBody(body);
+			initCacheBuffers("cache-control: " + cacheControl + "\r\n", body);
+		}
+
+		void setPath(const StaticString &path) {
+			psg_lstr_init(&req.path);
+			psg_lstr_append(&req.path, req.pool, path.data(), path.size());
+		}
+
+		ResponseCacheType::Entry storeResponse(const StaticString &path,
+			const string &body = "hello")
+		{
+			reset();
+			setPath(path);
+			initCacheableResponse();
+			initResponseBody(body);
+			initCacheBuffers("cache-control: public,max-age=99999\r\n", body);
+			ensure("(store 1)", responseCache.prepareRequest(this, &req));
+			ensure("(store 2)", responseCache.requestAllowsStoring(&req));
+			ensure("(store 3)", responseCache.prepareRequestForStoring(&req));
+			return responseCache.store(&req, time(NULL));
+		}
+
+		ResponseCacheType::Entry fetchResponse(const StaticString &path) {
+			reset();
+			setPath(path);
+			ensure("(fetch 1)", responseCache.prepareRequest(this, &req));
+			ensure("(fetch 2)", responseCache.requestAllowsFetching(&req));
+			return responseCache.fetch(&req, time(NULL));
+		}
+
+		string readBody(const ResponseCacheType::Entry &entry) {
+			string result;
+			for (unsigned int i = 0; i < entry.item->httpBodyBuffers.size(); i++) {
+				result.append(entry.item->httpBodyBuffers[i].start,
+					entry.item->httpBodyBuffers[i].size());
+			}
+			return result;
+		}
 	};
 
 	DEFINE_TEST_GROUP_WITH_LIMIT(Core_ResponseCacheTest, 100);
@@ -209,14 +268,14 @@ namespace tut {
 		string responseBodyStr = "hello";
 		initCacheableResponse();
 		initResponseBody(responseBodyStr);
+		initCacheBuffers(responseHeadersStr, responseBodyStr);
 		ensure("(1)", responseCache.prepareRequest(this, &req));
 		ensure("(2)", responseCache.requestAllowsStoring(&req));
 		ensure("(3)", responseCache.prepareRequestForStoring(&req));
 
-		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL),
-			responseHeadersStr.size(), responseBodyStr.size()));
+		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL)));
 		ensure("(5)", entry.valid());
-		ensure_equals("(6)", entry.index, 0u);
+		ensure_equals("(6)", responseCache.getEntryCount(), 1u);
 
 
 		reset();
@@ -224,9 +283,12 @@ namespace tut {
 		ensure("(11)", responseCache.requestAllowsFetching(&req));
 		ResponseCacheType::Entry entry2(responseCache.fetch(&req, time(NULL)));
 		ensure("(12)", entry2.valid());
-		ensure_equals("(13)", entry2.index, 0u);
-		ensure_equals<int>("(14)", entry2.body->httpHeaderSize, responseHeadersStr.size());
-		ensure_equals<int>("(15)", entry2.body->httpBodySize, responseBodyStr.size());
+		ensure_equals("(13)", entry2.item, entry.item);
+		ensure_equals<int>("(14)", entry2.item->httpHeaderSize, responseHeadersStr.size());
+		ensure_equals<int>("(15)", entry2.item->httpBodySize, responseBodyStr.size());
+		ensure_equals("(16)", StaticString(entry2.item->httpHeaderData,
+			entry2.item->httpHeaderSize), responseHeadersStr);
+		ensure_equals("(17)", readBody(entry2), responseBodyStr);
 	}
 
 	TEST_METHOD(11) {
@@ -237,6 +299,35 @@ namespace tut {
 		ensure("(3)", !entry2.valid());
 	}
 
+	TEST_METHOD(12) {
+		set_test_name("Bodies larger than a single mbuf are stored in an mbuf chain");
+		string body(ResponseCacheType::MBUF_BLOCK_CHUNK_SIZE * 3 + 10, 'x');
+		for (unsigned int i = 0; i < body.size(); i++) {
+			body[i] = 'a' + (i % 26);
+		}
+		ensure("(1)", storeResponse("/", body).valid());
+
+		ResponseCacheType::Entry entry(fetchResponse("/"));
+		ensure("(2)", entry.valid());
+		ensure("(3)", entry.item->httpBodyBuffers.size() > 1);
+		ensure_equals("(4)", readBody(entry), body);
+	}
+
+	TEST_METHOD(13) {
+		set_test_name("Storing fails if the body is larger than the maximum body size");
+		responseCache.setLimits(16, 1024 * 1024, 10);
+		ensure("(1)", !storeResponse("/", "hello world").valid());
+		ensure("(2)", storeResponse("/", "hello").valid());
+	}
+
+	TEST_METHOD(14) {
+		set_test_name("Storing a response for an existing key replaces the old entry");
+		ensure("(1)", storeResponse("/", "hello").valid());
+		ensure("(2)", storeResponse("/", "world").valid());
+		ensure_equals("(3)", responseCache.getEntryCount(), 1u);
+		ensure_equals("(4)", readBody(fetchResponse("/")), "world");
+	}
+
 
 	/***** Checking whether request should be fetched from cache *****/
 
@@ -417,10 +508,10 @@ namespace tut {
 	}
 
 	TEST_METHOD(48) {
-		set_test_name("It fails if the response has a Vary header");
+		set_test_name("It fails if the response has a Vary: * header");
 		initCacheableResponse();
 		insertAppResponseHeader(createHeader(
-			"vary", "foo"),
+			"vary", "foo, *"),
 			req.pool);
 		ensure("(1)", responseCache.prepareRequest(this, &req));
 		ensure("(2)", responseCache.requestAllowsStoring(&req));
@@ -471,14 +562,14 @@ namespace tut {
 		string responseBodyStr = "hello";
 		initCacheableResponse();
 		initResponseBody(responseBodyStr);
+		initCacheBuffers(responseHeadersStr, responseBodyStr);
 		ensure("(1)", responseCache.prepareRequest(this, &req));
 		ensure("(2)", responseCache.requestAllowsStoring(&req));
 		ensure("(3)", responseCache.prepareRequestForStoring(&req));
 
-		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL),
-			responseHeadersStr.size(), responseBodyStr.size()));
+		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL)));
 		ensure("(5)", entry.valid());
-		ensure_equals("(6)", entry.index, 0u);
+		ensure_equals("(6)", responseCache.getEntryCount(), 1u);
 
 
 		reset();
@@ -504,14 +595,14 @@ namespace tut {
 		string responseBodyStr = "hello";
 		initCacheableResponse();
 		initResponseBody(responseBodyStr);
+		initCacheBuffers(responseHeadersStr, responseBodyStr);
 		ensure("(1)", responseCache.prepareRequest(this, &req));
 		ensure("(2)", responseCache.requestAllowsStoring(&req));
 		ensure("(3)", responseCache.prepareRequestForStoring(&req));
 
-		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL),
-			responseHeadersStr.size(), responseBodyStr.size()));
+		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL)));
 		ensure("(5)", entry.valid());
-		ensure_equals("(6)", entry.index, 0u);
+		ensure_equals("(6)", responseCache.getEntryCount(), 1u);
 
 
 		reset();
@@ -542,14 +633,14 @@ namespace tut {
 		string responseBodyStr = "hello";
 		initCacheableResponse();
 		initResponseBody(responseBodyStr);
+		initCacheBuffers(responseHeadersStr, responseBodyStr);
 		ensure("(1)", responseCache.prepareRequest(this, &req));
 		ensure("(2)", responseCache.requestAllowsStoring(&req));
 		ensure("(3)", responseCache.prepareRequestForStoring(&req));
 
-		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL),
-			responseHeadersStr.size(), responseBodyStr.size()));
+		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL)));
 		ensure("(5)", entry.valid());
-		ensure_equals("(6)", entry.index, 0u);
+		ensure_equals("(6)", responseCache.getEntryCount(), 1u);
 
 
 		reset();
@@ -571,4 +662,318 @@ namespace tut {
 		ResponseCacheType::Entry entry2(responseCache.fetch(&req, time(NULL)));
 		ensure("(22)", !entry2.valid());
 	}
+
+
+	/***** Eviction *****/
+
+	TEST_METHOD(70) {
+		set_test_name("The least recently used entry is evicted when the cache is full");
+		responseCache.setLimits(4, 1024 * 1024, 1024);
+		ensure("(1)", storeResponse("/1").valid());
+		ensure("(2)", storeResponse("/2").valid());
+		ensure("(3)", storeResponse("/3").valid());
+		ensure("(4)", storeResponse("/4").valid());
+		ensure("(5)", storeResponse("/5").valid());
+		ensure_equals("(6)", responseCache.getEntryCount(), 4u);
+		ensure_equals("(7)", responseCache.getEvictions(), 1u);
+		ensure("(8)", !fetchResponse("/1").valid());
+		ensure("(9)", fetchResponse("/2").valid());
+		ensure("(10)", fetchResponse("/5").valid());
+	}
+
+	TEST_METHOD(71) {
+		set_test_name("Entries that are hit are protected from eviction by new entries");
+		responseCache.setLimits(4, 1024 * 1024, 1024);
+		ensure("(1)", storeResponse("/hot").valid());
+		ensure("(2)", fetchResponse("/hot").valid());
+		ensure_equals("(3)", responseCache.getProtectedEntryCount(), 1u);
+		for (unsigned int i = 0; i < 20; i++) {
+			ensure("(4)", storeResponse("/cold" + toString(i)).valid());
+		}
+		ensure_equals("(5)", responseCache.getEntryCount(), 4u);
+		ensure("(6)", fetchResponse("/hot").valid());
+	}
+
+	TEST_METHOD(72) {
+		set_test_name("Entries are evicted in order to stay within the memory budget");
+		string body(ResponseCacheType::MBUF_BLOCK_CHUNK_SIZE * 2, 'x');
+		responseCache.setLimits(1024, ResponseCacheType::MBUF_BLOCK_CHUNK_SIZE * 7,
+			ResponseCacheType::MBUF_BLOCK_CHUNK_SIZE * 4);
+		for (unsigned int i = 0; i < 10; i++) {
+			ensure("(1)", storeResponse("/" + toString(i), body).valid());
+			ensure("(2)", responseCache.getMemoryUsage() <= responseCache.getMaxMemory());
+		}
+		ensure_equals("(3)", responseCache.getEntryCount(), 2u);
+		ensure("(4)", fetchResponse("/9").valid());
+		ensure("(5)", !fetchResponse("/0").valid());
+	}
+
+	TEST_METHOD(73) {
+		set_test_name("clear() removes all entries and releases their memory");
+		ensure("(1)", storeResponse("/1").valid());
+		ensure("(2)", storeResponse("/2").valid());
+		responseCache.clear();
+		ensure_equals("(3)", responseCache.getEntryCount(), 0u);
+		ensure_equals("(4)", responseCache.getMemoryUsage(), 0u);
+		ensure("(5)", !fetchResponse("/1").valid());
+	}
+
+
+	/***** Sharing *****/
+
+	TEST_METHOD(80) {
+		set_test_name("An entry remains readable after its response has been evicted");
+		responseCache.setLimits(1, 1024 * 1024, 1024);
+		ResponseCacheType::Entry entry(storeResponse("/1", "first"));
+		ensure("(1)", entry.valid());
+		ensure("(2)", storeResponse("/2", "second").valid());
+		ensure_equals("(3)", responseCache.getEvictions(), 1u);
+		ensure("(4)", !fetchResponse("/1").valid());
+		ensure_equals("(5)", readBody(entry), "first");
+	}
+
+	TEST_METHOD(81) {
+		set_test_name("Responses stored through one cache can be fetched through another cache that shares its store");
+		ResponseCacheStorePtr store = boost::make_shared<ResponseCacheStore>(
+			16, 1024 * 1024, 4, true);
+		ResponseCacheType otherCache;
+		responseCache.setStore(store, 1024);
+		otherCache.setStore(store, 1024);
+		ensure("(1)", responseCache.isShared());
+		ensure("(2)", storeResponse("/", "shared").valid());
+
+		reset();
+		ensure("(3)", otherCache.prepareRequest(this, &req));
+		ensure("(4)", otherCache.requestAllowsFetching(&req));
+		ResponseCacheType::Entry entry(otherCache.fetch(&req, time(NULL)));
+		ensure("(5)", entry.valid());
+		ensure_equals("(6)", readBody(entry), "shared");
+		ensure_equals("(7)", otherCache.getHits(), 1u);
+		ensure_equals("(8)", responseCache.getHits(), 0u);
+	}
+
+	TEST_METHOD(82) {
+		set_test_name("The store reports per-shard hit and miss counters");
+		ResponseCacheStorePtr store = boost::make_shared<ResponseCacheStore>(
+			16, 1024 * 1024, 4, true);
+		responseCache.setStore(store, 1024);
+		ensure_equals("(1)", store->getShardCount(), 4u);
+		ensure("(2)", storeResponse("/1").valid());
+		ensure("(3)", fetchResponse("/1").valid());
+		ensure("(4)", !fetchResponse("/2").valid());
+
+		Json::Value doc = store->inspectStateAsJson();
+		unsigned int hits = 0, misses = 0;
+		ensure_equals("(5)", doc["shards"].size(), 4u);
+		for (unsigned int i = 0; i < doc["shards"].size(); i++) {
+			hits += doc["shards"][i]["hits"].asUInt();
+			misses += doc["shards"][i]["misses"].asUInt();
+		}
+		ensure_equals("(6)", hits, 1u);
+		ensure_equals("(7)", misses, 1u);
+		ensure_equals("(8)", doc["hits"].asUInt(), 1u);
+		ensure_equals("(9)", doc["entries"].asUInt(), 1u);
+	}
+
+
+	/***** Vary *****/
+
+	TEST_METHOD(85) {
+		set_test_name("Responses with a Vary header are stored per value of the request headers");
+		const char *encodings[] = { "gzip", "br" };
+		for (unsigned int i = 0; i < 2; i++) {
+			reset();
+			insertReqHeader(createHeader("accept-encoding", encodings[i]), req.pool);
+			insertAppResponseHeader(createHeader("vary", "Accept-Encoding"), req.pool);
+			initStorableResponse("public,max-age=99999", encodings[i]);
+			ensure("(1)", responseCache.prepareRequest(this, &req));
+			ensure("(2)", responseCache.prepareRequestForStoring(&req));
+			ensure("(3)", responseCache.store(&req, time(NULL)).valid());
+		}
+
+		for (unsigned int i = 0; i < 2; i++) {
+			reset();
+			insertReqHeader(createHeader("accept-encoding", encodings[i]), req.pool);
+			ensure("(4)", responseCache.prepareRequest(this, &req));
+			ResponseCacheType::Entry entry(responseCache.fetch(&req, time(NULL)));
+			ensure("(5)", entry.valid());
+			ensure_equals("(6)", readBody(entry), encodings[i]);
+		}
+
+		ensure("(7)", !fetchResponse("/").valid());
+		// One Vary marker plus two responses.
+		ensure_equals("(8)", responseCache.getEntryCount(), 3u);
+	}
+
+	TEST_METHOD(86) {
+		set_test_name("Invalidating a Vary marker makes all its responses unreachable");
+		reset();
+		insertReqHeader(createHeader("accept-language", "nl"), req.pool);
+		insertAppResponseHeader(createHeader("vary", "accept-language"), req.pool);
+		initStorableResponse("public,max-age=99999", "hallo");
+		ensure("(1)", responseCache.prepareRequest(this, &req));
+		ensure("(2)", responseCache.prepareRequestForStoring(&req));
+		ensure("(3)", responseCache.store(&req, time(NULL)).valid());
+
+		reset();
+		req.method = HTTP_POST;
+		ensure("(4)", responseCache.prepareRequest(this, &req));
+		ensure("(5)", responseCache.requestAllowsInvalidating(&req));
+		responseCache.invalidate(&req);
+
+		reset();
+		insertReqHeader(createHeader("accept-language", "nl"), req.pool);
+		ensure("(6)", responseCache.prepareRequest(this, &req));
+		ensure("(7)", !responseCache.fetch(&req, time(NULL)).valid());
+
+		reset();
+		insertReqHeader(createHeader("accept-language", "en"), req.pool);
+		insertAppResponseHeader(createHeader("vary", "accept-language"), req.pool);
+		initStorableResponse("public,max-age=99999", "hello");
+		ensure("(8)", responseCache.prepareRequest(this, &req));
+		ensure("(9)", responseCache.prepareRequestForStoring(&req));
+		ensure("(10)", responseCache.store(&req, time(NULL)).valid());
+
+		reset();
+		insertReqHeader(createHeader("accept-language", "nl"), req.pool);
+		ensure("(11)", responseCache.prepareRequest(this, &req));
+		ensure("(12) the old response is not served", !responseCache.fetch(&req, time(NULL)).valid());
+	}
+
+
+	/***** Conditional requests *****/
+
+	TEST_METHOD(87) {
+		set_test_name("If-None-Match is matched against the cached ETag using weak comparison");
+		reset();
+		insertAppResponseHeader(createHeader("etag", "W/\"v1\""), req.pool);
+		initStorableResponse("public,max-age=99999", "hello");
+		ensure("(1)", responseCache.prepareRequest(this, &req));
+		ensure("(2)", responseCache.prepareRequestForStoring(&req));
+		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL)));
+		ensure("(3)", entry.valid());
+		ensure("(4)", StaticString(entry.item->notModifiedHeaderData,
+			entry.item->notModifiedHeaderSize).find("ETag: W/\"v1\"\r\n") != string::npos);
+
+		reset();
+		insertReqHeader(createHeader("if-none-match", "\"v0\", \"v1\""), req.pool);
+		ensure("(5)", responseCache.requestIsNotModified(&req, entry));
+
+		reset();
+		insertReqHeader(createHeader("if-none-match", "\"v2\""), req.pool);
+		ensure("(6)", !responseCache.requestIsNotModified(&req, entry));
+
+		reset();
+		insertReqHeader(createHeader("if-none-match", "*"), req.pool);
+		ensure("(7)", responseCache.requestIsNotModified(&req, entry));
+	}
+
+	TEST_METHOD(88) {
+		set_test_name("If-Modified-Since is compared against the cached Last-Modified date");
+		reset();
+		insertAppResponseHeader(createHeader("last-modified",
+			"Sun, 06 Nov 1994 08:49:37 GMT"), req.pool);
+		initStorableResponse("public,max-age=99999", "hello");
+		ensure("(1)", responseCache.prepareRequest(this, &req));
+		ensure("(2)", responseCache.prepareRequestForStoring(&req));
+		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL)));
+		ensure("(3)", entry.valid());
+
+		reset();
+		insertReqHeader(createHeader("if-modified-since",
+			"Sun, 06 Nov 1994 08:49:37 GMT"), req.pool);
+		ensure("(4)", responseCache.requestIsNotModified(&req, entry));
+
+		reset();
+		insertReqHeader(createHeader("if-modified-since",
+			"Sat, 05 Nov 1994 08:49:37 GMT"), req.pool);
+		ensure("(5)", !responseCache.requestIsNotModified(&req, entry));
+	}
+
+
+	/***** Stale responses *****/
+
+	TEST_METHOD(89) {
+		set_test_name("With stale-while-revalidate, only one request revalidates while the others get the stale response");
+		time_t now = time(NULL);
+		reset();
+		initStorableResponse("public,max-age=10,stale-while-revalidate=60", "hello");
+		ensure("(1)", responseCache.prepareRequest(this, &req));
+		ensure("(2)", responseCache.prepareRequestForStoring(&req));
+		ensure("(3)", responseCache.store(&req, now).valid());
+
+		reset();
+		ensure("(4)", responseCache.prepareRequest(this, &req));
+		ResponseCacheType::Entry entry(responseCache.fetch(&req, now + 20));
+		ensure("(5) the first request revalidates", !entry.valid());
+		ensure("(6)", req.staleCacheEntry.valid());
+
+		reset();
+		ensure("(7)", responseCache.prepareRequest(this, &req));
+		entry = responseCache.fetch(&req, now + 21);
+		ensure("(8) the second request gets the stale response", entry.valid());
+		ensure("(9)", entry.stale);
+		ensure_equals("(10)", readBody(entry), "hello");
+		ensure_equals("(11)", responseCache.getStore()->getStatistics().staleHits, 1u);
+
+		reset();
+		ensure("(12)", responseCache.prepareRequest(this, &req));
+		entry = responseCache.fetch(&req, now + 71);
+		ensure("(13) the response is dropped after the window", !entry.valid());
+		ensure("(14)", !req.staleCacheEntry.valid());
+		ensure_equals("(15)", responseCache.getEntryCount(), 0u);
+	}
+
+	TEST_METHOD(90) {
+		set_test_name("With stale-if-error, the stale response is kept for serving in case of errors");
+		time_t now = time(NULL);
+		reset();
+		initStorableResponse("public,max-age=10,stale-if-error=60", "hello");
+		ensure("(1)", responseCache.prepareRequest(this, &req));
+		ensure("(2)", responseCache.prepareRequestForStoring(&req));
+		ensure("(3)", responseCache.store(&req, now).valid());
+
+		reset();
+		ensure("(4)", responseCache.prepareRequest(this, &req));
+		ResponseCacheType::Entry entry(responseCache.fetch(&req, now + 20));
+		ensure("(5)", !entry.valid());
+		ensure("(6)", req.staleCacheEntry.valid());
+		ensure("(7)", req.staleCacheEntry.stale);
+		ensure_equals("(8)", req.staleCacheEntry.item->staleIfErrorDate, now + 70);
+
+		reset();
+		ensure("(9)", responseCache.prepareRequest(this, &req));
+		entry = responseCache.fetch(&req, now + 21);
+		ensure("(10) no stale response is served without an error", !entry.valid());
+		ensure("(11)", req.staleCacheEntry.valid());
+	}
+
+	TEST_METHOD(91) {
+		set_test_name("Accept-Encoding values that negotiate the same coding share a variant,"
+			" unless they mention codings that we don't know about");
+		reset();
+		insertReqHeader(createHeader("accept-encoding", "gzip, deflate"), req.pool);
+		insertAppResponseHeader(createHeader("vary", "Accept-Encoding"), req.pool);
+		initStorableResponse("public,max-age=99999", "compressed");
+		ensure("(1)", responseCache.prepareRequest(this, &req));
+		ensure("(2)", responseCache.prepareRequestForStoring(&req));
+		ensure("(3)", responseCache.store(&req, time(NULL)).valid());
+
+		reset();
+		insertReqHeader(createHeader("accept-encoding", "deflate;q=0.5, GZIP"), req.pool);
+		ensure("(4)", responseCache.prepareRequest(this, &req));
+		ResponseCacheType::Entry entry(responseCache.fetch(&req, time(NULL)));
+		ensure("(5)", entry.valid());
+		ensure_equals("(6)", readBody(entry), "compressed");
+
+		reset();
+		insertReqHeader(createHeader("accept-encoding", "gzip, deflate, br"), req.pool);
+		ensure("(7)", responseCache.prepareRequest(this, &req));
+		ensure("(8)", !responseCache.fetch(&req, time(NULL)).valid());
+
+		reset();
+		insertReqHeader(createHeader("accept-encoding", "deflate"), req.pool);
+		ensure("(9)", responseCache.prepareRequest(this, &req));
+		ensure("(10)", !responseCache.fetch(&req, time(NULL)).valid());
+	}
 }
@@ -0,0 +1,208 @@
+#include <TestSupport.h>
+#include <boost/scoped_ptr.hpp>
+#include <zlib.h>
+#include <Constants.h>
+#include <Core/ResponseCompressor.h>
+
+using namespace Passenger;
+using namespace Passenger::Core;
+using namespace Passenger::ServerKit;
+using namespace std;
+
+namespace tut {
+	struct Core_ResponseCompressorTest {
+		struct MemoryKit::mbuf_pool pool;
+		boost::scoped_ptr<ResponseCompressor> compressor;
+		string output;
+		string payload;
+		unsigned int blocks;
+
+		Core_ResponseCompressorTest() {
+			pool.mbuf_block_chunk_size = DEFAULT_MBUF_CHUNK_SIZE;
+			MemoryKit::mbuf_pool_init(&pool);
+			compressor.reset(new ResponseCompressor());
+			blocks = 0;
+		}
+
+		~Core_ResponseCompressorTest() {
+			compressor.reset();
+			MemoryKit::mbuf_pool_deinit(&pool);
+		}
+
+		static bool onOutput(void *userData, const MemoryKit::mbuf &output,
+			const MemoryKit::mbuf &payload)
+		{
+			Core_ResponseCompressorTest *self =
+				static_cast<Core_ResponseCompressorTest *>(userData);
+			self->output.append(output.start, output.size());
+			self->payload.append(payload.start, payload.size());
+			self->blocks++;
+			return true;
+		}
+
+		static string makeBody(unsigned int size) {
+			string result;
+			unsigned int i = 0;
+			while (result.size() < size) {
+				result.append("<li class=\"item\">Item number " + toString(i) + "</li>\n");
+				i++;
+			}
+			result.resize(size);
+			return result;
+		}
+
+		void compress(const string &body, size_t pieceSize) {
+			for (size_t pos = 0; pos < body.size(); pos += pieceSize) {
+				ensure(compressor->feed(body.data() + pos,
+					std::min(pieceSize, body.size() - pos), onOutput, this));
+			}
+			ensure(compressor->finish(onOutput, this));
+		}
+
+		static string inflate(const string &data) {
+			z_stream stream;
+			char buf[4096];
+			string result;
+			int ret;
+
+			memset(&stream, 0, sizeof(stream));
+			// Automatically detect the gzip or zlib header.
+			ensure_equals(inflateInit2(&stream, MAX_WBITS + 32), Z_OK);
+			stream.next_in = (Bytef *) data.data();
+			stream.avail_in = data.size();
+			do {
+				stream.next_out = (Bytef *) buf;
+				stream.avail_out = sizeof(buf);
+				ret = ::inflate(&stream, Z_NO_FLUSH);
+				result.append(buf, sizeof(buf) - stream.avail_out);
+			} while (ret == Z_OK);
+			inflateEnd(&stream);
+			ensure_equals("Compressed stream is complete", ret, Z_STREAM_END);
+			return result;
+		}
+
+		/** Removes the chunked framing, checking it along the way. */
+		static string dechunk(const string &data, string::size_type *pos) {
+			string result;
+			while (true) {
+				string::size_type crlf = data.find("\r\n", *pos);
+				ensure(crlf != string::npos);
+				unsigned int size = hexToULL(data.substr(*pos, crlf - *pos));
+				*pos = crlf + 2;
+				if (size == 0) {
+					ensure_equals(data.substr(*pos, 2), "\r\n");
+					*pos += 2;
+					return result;
+				}
+				result.append(data, *pos, size);
+				*pos += size;
+				ensure_equals(data.substr(*pos, 2), "\r\n");
+				*pos += 2;
+			}
+		}
+	};
+
+	DEFINE_TEST_GROUP(Core_ResponseCompressorTest);
+
+
+	/***** Content coding negotiation *****/
+
+	TEST_METHOD(1) {
+		set_test_name("It prefers gzip, then deflate");
+		ensure_equals("(1)", negotiateContentCoding("gzip"), CC_GZIP);
+		ensure_equals("(2)", negotiateContentCoding("deflate"), CC_DEFLATE);
+		ensure_equals("(3)", negotiateContentCoding("deflate, gzip"), CC_GZIP);
+		ensure_equals("(4)", negotiateContentCoding("gzip, deflate, br"), CC_GZIP);
+		ensure_equals("(5)", negotiateContentCoding("X-GZIP"), CC_GZIP);
+		ensure_equals("(6)", negotiateContentCoding("br"), CC_IDENTITY);
+		ensure_equals("(7)", negotiateContentCoding(""), CC_IDENTITY);
+		ensure_equals("(8)", negotiateContentCoding("identity"), CC_IDENTITY);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It respects qvalues and wildcards");
+		ensure_equals("(1)", negotiateContentCoding("gzip;q=0.5, deflate"), CC_DEFLATE);
+		ensure_equals("(2)", negotiateContentCoding("gzip; q=0, deflate;q=0.1"), CC_DEFLATE);
+		ensure_equals("(3)", negotiateContentCoding("gzip;q=0.000"), CC_IDENTITY);
+		ensure_equals("(4)", negotiateContentCoding("*"), CC_GZIP);
+		ensure_equals("(5)", negotiateContentCoding("*;q=0"), CC_IDENTITY);
+		ensure_equals("(6)", negotiateContentCoding("gzip;q=0, *"), CC_DEFLATE);
+		ensure_equals("(7)", negotiateContentCoding("gzip;q=1.0, deflate;q=1"), CC_GZIP);
+		ensure_equals("(8)", negotiateContentCoding(" , gzip ;q=0.8 ,"), CC_GZIP);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("It reports whether the header only mentions codings that it knows");
+		bool known;
+		negotiateContentCoding("gzip, deflate;q=0.5, identity, *;q=0", &known);
+		ensure("(1)", known);
+		negotiateContentCoding("gzip, br", &known);
+		ensure("(2)", !known);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("It only compresses textual content types");
+		ensure("(1)", isCompressibleContentType("text/html"));
+		ensure("(2)", isCompressibleContentType("text/html; charset=utf-8"));
+		ensure("(3)", isCompressibleContentType("Application/JSON"));
+		ensure("(4)", isCompressibleContentType("application/vnd.api+json; charset=utf-8"));
+		ensure("(5)", isCompressibleContentType("image/svg+xml"));
+		ensure("(6)", isCompressibleContentType("application/javascript"));
+		ensure("(7)", !isCompressibleContentType("text/event-stream"));
+		ensure("(8)", !isCompressibleContentType("image/png"));
+		ensure("(9)", !isCompressibleContentType("application/octet-stream"));
+		ensure("(10)", !isCompressibleContentType(""));
+	}
+
+
+	/***** Compression *****/
+
+	TEST_METHOD(10) {
+		set_test_name("It compresses a body that is fed in pieces with gzip");
+		string body = makeBody(400000);
+		ensure(compressor->initialize(&pool, CC_GZIP, 6, body.size(), false));
+		compress(body, 1000);
+
+		ensure("(1) it produces several blocks", blocks > 1);
+		ensure_equals("(2)", output, payload);
+		ensure("(3) the gzip magic is present", payload.size() > 2
+			&& (unsigned char) payload[0] == 0x1f && (unsigned char) payload[1] == 0x8b);
+		ensure("(4) it compresses", payload.size() < body.size() / 4);
+		ensure_equals("(5)", inflate(payload), body);
+		ensure_equals("(6)", compressor->getBytesIn(), (boost::uint64_t) body.size());
+		ensure_equals("(7)", compressor->getBytesOut(), (boost::uint64_t) payload.size());
+	}
+
+	TEST_METHOD(11) {
+		set_test_name("It compresses with deflate in the zlib format");
+		string body = makeBody(5000);
+		ensure(compressor->initialize(&pool, CC_DEFLATE, 1, 0, false));
+		compress(body, body.size());
+		ensure("(1) the zlib header is present", payload.size() > 2
+			&& ((unsigned char) payload[0] & 0x0f) == Z_DEFLATED
+			&& (((unsigned char) payload[0] << 8) | (unsigned char) payload[1]) % 31 == 0);
+		ensure_equals("(2)", inflate(payload), body);
+	}
+
+	TEST_METHOD(12) {
+		set_test_name("With chunked framing, every block is a valid chunk around the payload");
+		string body = makeBody(300000);
+		ensure(compressor->initialize(&pool, CC_GZIP, 6, 0, true));
+		compress(body, 4096);
+		output.append("0\r\n\r\n");
+
+		string::size_type pos = 0;
+		ensure("(1)", blocks > 1);
+		ensure_equals("(2)", dechunk(output, &pos), payload);
+		ensure_equals("(3) nothing follows the last chunk", pos, output.size());
+		ensure_equals("(4)", inflate(payload), body);
+	}
+
+	TEST_METHOD(13) {
+		set_test_name("An empty body results in a valid empty stream");
+		ensure(compressor->initialize(&pool, CC_GZIP, 6, 0, true));
+		ensure(compressor->finish(onOutput, this));
+		ensure_equals("(1)", blocks, 1u);
+		ensure_equals("(2)", inflate(payload), "");
+	}
+}
@@ -0,0 +1,129 @@
+#include <TestSupport.h>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <Core/SpawningKit/OutputMultiplexer.h>
+#include <Core/SpawningKit/PipeWatcher.h>
+#include <FileDescriptor.h>
+#include <Utils/IOUtils.h>
+#include <Utils/StrIntUtils.h>
+#include <vector>
+
+using namespace Passenger;
+using namespace Passenger::SpawningKit;
+using namespace std;
+
+namespace tut {
+	struct Core_SpawningKit_OutputMultiplexerTest {
+		ConfigPtr config;
+		boost::scoped_ptr<OutputMultiplexer> multiplexer;
+		string gatheredOutput;
+		boost::mutex gatheredOutputSyncher;
+
+		Core_SpawningKit_OutputMultiplexerTest() {
+			config = boost::make_shared<Config>();
+			config->resourceLocator = resourceLocator;
+			config->outputHandler = boost::bind(
+				&Core_SpawningKit_OutputMultiplexerTest::gatherOutput, this, _1, _2);
+			config->finalize();
+			multiplexer.reset(new OutputMultiplexer());
+			LoggingKit::setLevel(LoggingKit::WARN);
+		}
+
+		~Core_SpawningKit_OutputMultiplexerTest() {
+			multiplexer.reset();
+			LoggingKit::setLevel(LoggingKit::Level(DEFAULT_LOG_LEVEL));
+		}
+
+		void gatherOutput(const char *data, unsigned int size) {
+			boost::lock_guard<boost::mutex> l(gatheredOutputSyncher);
+			gatheredOutput.append(data, size);
+		}
+
+		bool gatheredOutputContains(const string &str) {
+			boost::lock_guard<boost::mutex> l(gatheredOutputSyncher);
+			return gatheredOutput.find(str) != string::npos;
+		}
+	};
+
+	DEFINE_TEST_GROUP(Core_SpawningKit_OutputMultiplexerTest);
+
+	TEST_METHOD(1) {
+		set_test_name("It forwards the output of a pipe to the output handler");
+		Pipe p = createPipe(__FILE__, __LINE__);
+		multiplexer->add(config, p.first, "stdout", 1234);
+
+		writeExact(p.second, "hello\n");
+		writeExact(p.second, "world\n");
+		EVENTUALLY(5,
+			result = gatheredOutputContains("hello\nworld\n");
+		);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It watches multiple pipes at the same time");
+		vector<Pipe> pipes;
+		for (unsigned int i = 0; i < 20; i++) {
+			pipes.push_back(createPipe(__FILE__, __LINE__));
+			multiplexer->add(config, pipes.back().first, "stderr", 1000 + i);
+		}
+		ensure_equals(multiplexer->getWatcherCount(), 20u);
+
+		for (unsigned int i = 0; i < pipes.size(); i++) {
+			writeExact(pipes[i].second, "pipe " + toString(i) + "\n");
+		}
+		for (unsigned int i = 0; i < pipes.size(); i++) {
+			EVENTUALLY(5,
+				result = gatheredOutputContains("pipe " + toString(i) + "\n");
+			);
+		}
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("It stops watching a pipe when it reaches EOF");
+		Pipe p1 = createPipe(__FILE__, __LINE__);
+		Pipe p2 = createPipe(__FILE__, __LINE__);
+		multiplexer->add(config, p1.first, "stdout", 1234);
+		multiplexer->add(config, p2.first, "stderr", 1234);
+		ensure_equals(multiplexer->getWatcherCount(), 2u);
+
+		p1.second.close();
+		EVENTUALLY(5,
+			result = multiplexer->getWatcherCount() == 1;
+		);
+		p2.second.close();
+		EVENTUALLY(5,
+			result = multiplexer->getWatcherCount() == 0;
+		);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("It keeps watching a pipe after the caller has dropped its"
+			" reference to the file descriptor");
+		Pipe p = createPipe(__FILE__, __LINE__);
+		multiplexer->add(config, p.first, "stdout", 1234);
+		p.first = FileDescriptor();
+
+		writeExact(p.second, "hello\n");
+		EVENTUALLY(5,
+			result = gatheredOutputContains("hello\n");
+		);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("PipeWatcher registers its pipe with the multiplexer if one is configured");
+		config->outputMultiplexer = multiplexer.get();
+		Pipe p = createPipe(__FILE__, __LINE__);
+		PipeWatcherPtr watcher = boost::make_shared<PipeWatcher>(config,
+			p.first, "stdout", 1234);
+		watcher->initialize();
+		watcher->start();
+		watcher.reset();
+		ensure_equals(multiplexer->getWatcherCount(), 1u);
+
+		writeExact(p.second, "hello\n");
+		EVENTUALLY(5,
+			result = gatheredOutputContains("hello\n");
+		);
+		ensure_equals(multiplexer->inspectStateAsJson()["bytes_read"].asUInt(), 6u);
+	}
+}
@@ -0,0 +1,135 @@
+#include <TestSupport.h>
+#include <boost/scoped_ptr.hpp>
+#include <Core/UnionStation/Context.h>
+#include <Core/UnionStation/AsyncSender.h>
+#include <Core/UnionStation/Transaction.h>
+#include <FileDescriptor.h>
+#include <Utils/IOUtils.h>
+#include <Utils/MessageIO.h>
+
+using namespace Passenger;
+using namespace Passenger::UnionStation;
+using namespace std;
+
+namespace tut {
+	struct Core_UnionStation_AsyncSenderTest {
+		boost::scoped_ptr<AsyncSender> sender;
+		ConnectionPtr connection;
+		FileDescriptor peer;
+
+		Core_UnionStation_AsyncSenderTest() {
+			SocketPair p = createUnixSocketPair(__FILE__, __LINE__);
+			connection = boost::make_shared<Connection>(dup(p.first));
+			peer = p.second;
+		}
+
+		~Core_UnionStation_AsyncSenderTest() {
+			sender.reset();
+			LoggingKit::setLevel(LoggingKit::Level(DEFAULT_LOG_LEVEL));
+		}
+
+		bool send(const string &str) {
+			string data = str;
+			return sender->send(connection, data);
+		}
+
+		string readAvailable() {
+			char buf[1024 * 16];
+			string result;
+			ssize_t ret;
+
+			setNonBlocking(peer);
+			do {
+				ret = read(peer, buf, sizeof(buf));
+				if (ret > 0) {
+					result.append(buf, ret);
+				}
+			} while (ret > 0);
+			setBlocking(peer);
+			return result;
+		}
+	};
+
+	DEFINE_TEST_GROUP(Core_UnionStation_AsyncSenderTest);
+
+	TEST_METHOD(1) {
+		set_test_name("Queued data is written to the connection in order");
+		sender.reset(new AsyncSender());
+		ensure(send("hello "));
+		ensure(send("world"));
+		sender->flush();
+		ensure_equals(readAvailable(), "hello world");
+		ensure_equals(sender->inspectStateAsJson()["messages_sent"].asUInt(), 2u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("Data that does not fit in the queue is dropped and counted");
+		sender.reset(new AsyncSender(1024));
+		// Fill the socket so that the sender thread blocks on it.
+		setNonBlocking(connection->fd);
+		string filler(1024 * 64, 'x');
+		while (write(connection->fd, filler.data(), filler.size()) > 0) {
+			// Continue.
+		}
+		setBlocking(connection->fd);
+
+		ensure(send(string(100, 'a')));
+		EVENTUALLY(5,
+			result = sender->inspectStateAsJson()["queued_messages"].asUInt() == 0;
+		);
+		// The sender thread is now blocked writing the first message.
+		unsigned int queued = 0;
+		for (unsigned int i = 0; i < 20; i++) {
+			if (send(string(100, 'b'))) {
+				queued++;
+			}
+		}
+		ensure_equals(queued, 10u);
+		ensure_equals(sender->getMessagesDropped(), 10u);
+
+		// Unblock the sender thread.
+		LoggingKit::setLevel(LoggingKit::CRIT);
+		peer.close();
+		sender.reset();
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("The data that closes a transaction is never dropped, and the"
+			" connection is checked into the context after it has been written");
+		ContextPtr context = boost::make_shared<Context>("unix:/nonexistant",
+			"username", "password");
+		sender.reset(new AsyncSender(1));
+		string data = "close";
+		ensure(sender->send(connection, data, context.get()));
+		sender->flush();
+		ensure_equals(readAvailable(), "close");
+		ensure_equals(context->checkoutConnection(), connection);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("Transactions in asynchronous mode send protocol messages through the sender");
+		ContextPtr context = boost::make_shared<Context>("unix:/nonexistant",
+			"username", "password");
+		context->enableAsyncSending();
+		{
+			Transaction transaction(context, connection, "txn-id", "group",
+				"requests", "key", THROW, context->getAsyncSender());
+			transaction.message("hello");
+		}
+		context->getAsyncSender()->flush();
+
+		vector<string> args;
+		ensure(readArrayMessage(peer, args));
+		ensure_equals(args.size(), 3u);
+		ensure_equals(args[0], "log");
+		ensure_equals(args[1], "txn-id");
+		ensure_equals(readScalarMessage(peer), "hello");
+
+		ensure(readArrayMessage(peer, args));
+		ensure_equals(args.size(), 3u);
+		ensure_equals(args[0], "closeTransaction");
+		ensure_equals(args[1], "txn-id");
+
+		ensure_equals(context->checkoutConnection(), connection);
+	}
+}
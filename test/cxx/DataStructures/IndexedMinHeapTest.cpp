@@ -0,0 +1,144 @@
+#include <TestSupport.h>
+#include <cstdlib>
+#include <vector>
+#include <DataStructures/IndexedMinHeap.h>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct DataStructures_IndexedMinHeapTest {
+		IndexedMinHeap heap;
+		vector<int> keys;
+
+		void push(int key) {
+			heap.push(key);
+			keys.push_back(key);
+		}
+
+		void update(unsigned int item, int key) {
+			heap.update(item, key);
+			keys[item] = key;
+		}
+
+		void erase(unsigned int item) {
+			heap.erase(item);
+			keys.erase(keys.begin() + item);
+		}
+
+		// The linear scan that the heap replaces.
+		unsigned int scan() const {
+			unsigned int result = 0;
+			for (unsigned int i = 1; i < keys.size(); i++) {
+				if (keys[i] < keys[result]) {
+					result = i;
+				}
+			}
+			return result;
+		}
+
+		void verify() {
+			ensure_equals("size", heap.size(), (unsigned int) keys.size());
+			for (unsigned int i = 0; i < keys.size(); i++) {
+				ensure_equals("key", heap.get(i), keys[i]);
+			}
+			if (!keys.empty()) {
+				ensure_equals("top", heap.top(), scan());
+				ensure_equals("topKey", heap.topKey(), keys[scan()]);
+			}
+		}
+	};
+
+	DEFINE_TEST_GROUP(DataStructures_IndexedMinHeapTest);
+
+	TEST_METHOD(1) {
+		set_test_name("Initial state");
+		ensure(heap.empty());
+		ensure_equals(heap.size(), 0u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("top() returns the item with the smallest key");
+		push(5);
+		push(3);
+		push(8);
+		push(1);
+		ensure_equals(heap.top(), 3u);
+		ensure_equals(heap.topKey(), 1);
+		verify();
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("Items with equal keys are ordered by item number");
+		push(2);
+		push(1);
+		push(1);
+		push(1);
+		ensure_equals(heap.top(), 1u);
+		update(1, 2);
+		ensure_equals(heap.top(), 2u);
+		update(3, 0);
+		ensure_equals(heap.top(), 3u);
+		update(3, 1);
+		ensure_equals(heap.top(), 2u);
+		verify();
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("update() moves items up and down");
+		for (int i = 0; i < 10; i++) {
+			push(i * 10);
+		}
+		update(0, 100);
+		ensure_equals(heap.top(), 1u);
+		update(9, -1);
+		ensure_equals(heap.top(), 9u);
+		verify();
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("erase() renumbers the items after the erased one");
+		push(4);
+		push(3);
+		push(2);
+		push(1);
+		erase(1);
+		ensure_equals(heap.size(), 3u);
+		ensure_equals(heap.get(0), 4);
+		ensure_equals(heap.get(1), 2);
+		ensure_equals(heap.get(2), 1);
+		ensure_equals(heap.top(), 2u);
+		erase(2);
+		ensure_equals(heap.top(), 1u);
+		erase(1);
+		erase(0);
+		ensure(heap.empty());
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("It behaves like a linear scan under random operations");
+		srand(1234);
+		for (int i = 0; i < 5000; i++) {
+			int op = rand() % 10;
+			if (keys.empty() || op < 3) {
+				push(rand() % 8);
+			} else if (op < 9) {
+				update(rand() % keys.size(), rand() % 8);
+			} else {
+				erase(rand() % keys.size());
+			}
+			verify();
+		}
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("clear() removes all items");
+		push(1);
+		push(2);
+		heap.clear();
+		ensure(heap.empty());
+		heap.push(7);
+		ensure_equals(heap.top(), 0u);
+		ensure_equals(heap.topKey(), 7);
+	}
+}
@@ -4,6 +4,9 @@
 #include <oxt/system_calls.hpp>
 #include <boost/bind.hpp>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
 #include <cerrno>
 #include <string>
 
@@ -893,4 +896,55 @@ namespace tut {
 			ensure(timeout <= 2000);
 		}
 	}
+
+	/***** Test createTcpServer() *****/
+
+	static unsigned short getLocalPort(int fd) {
+		struct sockaddr_in addr;
+		socklen_t len = sizeof(addr);
+		if (getsockname(fd, (struct sockaddr *) &addr, &len) == -1) {
+			int e = errno;
+			throw SystemException("getsockname() failed", e);
+		}
+		return ntohs(addr.sin_port);
+	}
+
+	TEST_METHOD(85) {
+		set_test_name("SO_REUSEPORT sockets can share a port");
+
+		#ifdef SO_REUSEPORT
+			FileDescriptor fd1(createTcpServer("127.0.0.1", 0, 0, __FILE__, __LINE__, true),
+				__FILE__, __LINE__);
+			unsigned short port = getLocalPort(fd1);
+			FileDescriptor fd2(createTcpServer("127.0.0.1", port, 0, __FILE__, __LINE__, true),
+				__FILE__, __LINE__);
+			ensure_equals(getLocalPort(fd2), port);
+
+			#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+				setReusePortCpuSteering(fd1, 2);
+			#endif
+
+			FileDescriptor client(connectToTcpServer("127.0.0.1", port, __FILE__, __LINE__),
+				__FILE__, __LINE__);
+			struct pollfd fds[2];
+			fds[0].fd = fd1;
+			fds[0].events = POLLIN;
+			fds[1].fd = fd2;
+			fds[1].events = POLLIN;
+			ensure_equals(poll(fds, 2, 5000), 1);
+		#endif
+	}
+
+	TEST_METHOD(86) {
+		set_test_name("Sockets without SO_REUSEPORT cannot share a port");
+
+		FileDescriptor fd1(createTcpServer("127.0.0.1", 0, 0, __FILE__, __LINE__),
+			__FILE__, __LINE__);
+		try {
+			createTcpServer("127.0.0.1", getLocalPort(fd1), 0, __FILE__, __LINE__);
+			fail("SystemException expected");
+		} catch (const SystemException &e) {
+			ensure_equals(e.code(), EADDRINUSE);
+		}
+	}
 }
@@ -0,0 +1,166 @@
+#include <TestSupport.h>
+#include <boost/scoped_ptr.hpp>
+#include <IoUring.h>
+#include <FileTools/FileManip.h>
+#include <Utils/ScopeGuard.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct IoUringTest {
+		boost::scoped_ptr<IoUring> ring;
+		string path;
+		uv_fs_t req;
+		unsigned int callbacks;
+
+		IoUringTest()
+			: path("tmp.io_uring"),
+			  callbacks(0)
+		{
+			if (IoUring::isSupported()) {
+				ring.reset(new IoUring(8));
+			}
+			req.data = this;
+		}
+
+		~IoUringTest() {
+			ring.reset();
+			unlink(path.c_str());
+		}
+
+		static void callback(uv_fs_t *req) {
+			IoUringTest *self = (IoUringTest *) req->data;
+			self->callbacks++;
+		}
+
+		void wait() {
+			ring->drain();
+		}
+
+		int openFile(int flags) {
+			ensure_equals(ring->open(&req, path.c_str(), flags, 0600, callback), 0);
+			wait();
+			return (int) req.result;
+		}
+	};
+
+	DEFINE_TEST_GROUP(IoUringTest);
+
+	TEST_METHOD(1) {
+		set_test_name("Operations are only handed to the kernel upon submit()");
+		if (ring == NULL) {
+			return;
+		}
+
+		ensure_equals(ring->open(&req, path.c_str(), O_RDWR | O_CREAT, 0600, callback), 0);
+		ensure("(1)", ring->hasPendingSubmissions());
+		ensure_equals("(2)", ring->getInFlight(), 0u);
+		ensure_equals("(3)", callbacks, 0u);
+
+		ring->submit();
+		ensure("(4)", !ring->hasPendingSubmissions());
+		ensure_equals("(5)", ring->getInFlight(), 1u);
+
+		wait();
+		ensure_equals("(6)", callbacks, 1u);
+		ensure_equals("(7)", ring->getInFlight(), 0u);
+		ensure("(8)", req.result >= 0);
+		close((int) req.result);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It writes and reads files at the given offsets");
+		if (ring == NULL) {
+			return;
+		}
+
+		int fd = openFile(O_RDWR | O_CREAT);
+		ensure("(1)", fd >= 0);
+		FdGuard guard(fd, __FILE__, __LINE__);
+
+		char data[] = "hello world";
+		uv_buf_t buf = uv_buf_init(data, 5);
+		ensure_equals(ring->write(&req, fd, &buf, 1, 0, callback), 0);
+		wait();
+		ensure_equals("(2)", req.result, 5);
+
+		buf = uv_buf_init(data + 5, 6);
+		ensure_equals(ring->write(&req, fd, &buf, 1, 5, callback), 0);
+		wait();
+		ensure_equals("(3)", req.result, 6);
+
+		char result[6];
+		buf = uv_buf_init(result, 5);
+		ensure_equals(ring->read(&req, fd, &buf, 1, 6, callback), 0);
+		wait();
+		ensure_equals("(4)", req.result, 5);
+		ensure_equals("(5)", string(result, 5), "world");
+		ensure_equals("(6)", callbacks, 4u);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("It closes and unlinks files");
+		if (ring == NULL) {
+			return;
+		}
+
+		int fd = openFile(O_RDWR | O_CREAT);
+		ensure("(1)", fd >= 0);
+
+		ensure_equals(ring->close(&req, fd, callback), 0);
+		wait();
+		ensure_equals("(2)", req.result, 0);
+		ensure_equals("(3)", fcntl(fd, F_GETFD), -1);
+
+		ensure_equals(ring->unlink(&req, path.c_str(), callback), 0);
+		wait();
+		ensure_equals("(4)", req.result, 0);
+		ensure_equals("(5)", getFileType(path), FT_NONEXISTANT);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("Errors are reported as negative libuv error codes");
+		if (ring == NULL) {
+			return;
+		}
+
+		ensure_equals("(1)", openFile(O_RDONLY), UV_ENOENT);
+		ensure_equals("(2)", callbacks, 1u);
+
+		ensure_equals(ring->unlink(&req, path.c_str(), callback), 0);
+		wait();
+		ensure_equals("(3)", req.result, UV_ENOENT);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("Queueing more operations than the ring holds submits "
+			"the queued ones first");
+		if (ring == NULL) {
+			return;
+		}
+
+		int fd = openFile(O_RDWR | O_CREAT);
+		ensure("(1)", fd >= 0);
+		FdGuard guard(fd, __FILE__, __LINE__);
+
+		uv_fs_t reqs[20];
+		char data[20];
+		uv_buf_t bufs[20];
+		for (unsigned int i = 0; i < 20; i++) {
+			data[i] = 'a' + i;
+			bufs[i] = uv_buf_init(&data[i], 1);
+			reqs[i].data = this;
+			ensure_equals(ring->write(&reqs[i], fd, &bufs[i], 1, i, callback), 0);
+		}
+		wait();
+		ensure_equals("(2)", callbacks, 21u);
+
+		char result[20];
+		ensure_equals("(3)", pread(fd, result, 20, 0), (ssize_t) 20);
+		ensure_equals("(4)", string(result, 20), string(data, 20));
+	}
+}
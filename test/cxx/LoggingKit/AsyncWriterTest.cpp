@@ -0,0 +1,260 @@
+#include <TestSupport.h>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <FileDescriptor.h>
+#include <LoggingKit/AsyncWriter.h>
+#include <Utils/IOUtils.h>
+#include <Utils/StrIntUtils.h>
+
+using namespace Passenger;
+using namespace Passenger::LoggingKit;
+using namespace std;
+
+namespace tut {
+	struct LoggingKit_AsyncWriterTest {
+		FileDescriptor reader, writerFd;
+		boost::scoped_ptr<AsyncWriter> writer;
+		boost::mutex syncher;
+		string received;
+
+		LoggingKit_AsyncWriterTest() {
+			Pipe p = createPipe(__FILE__, __LINE__);
+			reader = p.first;
+			writerFd = p.second;
+		}
+
+		~LoggingKit_AsyncWriterTest() {
+			// Make sure that the writer thread isn't blocked on the pipe.
+			if (writer) {
+				TempThread thr(boost::bind(&LoggingKit_AsyncWriterTest::readUntilEof,
+					this, (int) reader));
+				writer.reset();
+				writerFd.close();
+				thr.join();
+			}
+		}
+
+		void readUntilEof(int fd) {
+			char buf[1024 * 16];
+			ssize_t ret;
+
+			do {
+				ret = syscalls::read(fd, buf, sizeof(buf));
+				if (ret > 0) {
+					boost::lock_guard<boost::mutex> l(syncher);
+					received.append(buf, ret);
+				}
+			} while (ret > 0);
+		}
+
+		string readAvailable() {
+			char buf[1024 * 16];
+			string result;
+			ssize_t ret;
+
+			setNonBlocking(reader);
+			do {
+				ret = syscalls::read(reader, buf, sizeof(buf));
+				if (ret > 0) {
+					result.append(buf, ret);
+				}
+			} while (ret > 0);
+			setBlocking(reader);
+			return result;
+		}
+
+		/** Fills the pipe so that the writer thread blocks on the next write. */
+		void fillPipe() {
+			char buf[1024 * 16];
+			memset(buf, 'x', sizeof(buf));
+			setNonBlocking(writerFd);
+			while (write(writerFd, buf, sizeof(buf)) > 0 || errno != EAGAIN) {
+				// Continue.
+			}
+			setBlocking(writerFd);
+		}
+
+		/** Reads the data that fillPipe() wrote, plus `size` more bytes. */
+		string drainPipe(size_t size) {
+			string result;
+			char buf[1024 * 16];
+
+			while (true) {
+				ssize_t ret = syscalls::read(reader, buf, sizeof(buf));
+				ensure("(drainPipe) read succeeds", ret > 0);
+				result.append(buf, ret);
+
+				string::size_type pos = result.find_first_not_of('x');
+				if (pos != string::npos && result.size() - pos >= size) {
+					return result.substr(pos);
+				}
+			}
+		}
+
+		void writeEntries(const string &prefix, unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				string entry = prefix + toString(i) + "\n";
+				writer->write(writerFd, entry.data(), entry.size());
+			}
+		}
+
+		static unsigned int countLines(const string &data) {
+			unsigned int count = 0;
+			for (string::size_type i = 0; i < data.size(); i++) {
+				if (data[i] == '\n') {
+					count++;
+				}
+			}
+			return count;
+		}
+	};
+
+	DEFINE_TEST_GROUP(LoggingKit_AsyncWriterTest);
+
+	TEST_METHOD(1) {
+		set_test_name("Entries are written in the order in which they were logged");
+		writer.reset(new AsyncWriter());
+		writeEntries("entry ", 3);
+		writer->flush();
+		ensure_equals(readAvailable(), "entry 0\nentry 1\nentry 2\n");
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("Entries that do not fit in the remainder of the buffer wrap around");
+		writer.reset(new AsyncWriter(AsyncWriter::MIN_BUFFER_SIZE));
+		string expected;
+
+		for (unsigned int i = 0; i < 20; i++) {
+			string entry = string(700, 'a' + i) + "\n";
+			writer->write(writerFd, entry.data(), entry.size());
+			writer->flush();
+			expected.append(entry);
+		}
+		ensure_equals(readAvailable(), expected);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("Entries from multiple threads are all written, and in order per thread");
+		writer.reset(new AsyncWriter());
+		{
+			TempThread thr1(boost::bind(&LoggingKit_AsyncWriterTest::writeEntries,
+				this, string("a"), 500));
+			TempThread thr2(boost::bind(&LoggingKit_AsyncWriterTest::writeEntries,
+				this, string("b"), 500));
+			thr1.join();
+			thr2.join();
+		}
+		writer->flush();
+
+		vector<string> lines;
+		split(readAvailable(), '\n', lines);
+		unsigned int nextA = 0, nextB = 0;
+		for (unsigned int i = 0; i < lines.size(); i++) {
+			if (lines[i].empty()) {
+				continue;
+			} else if (lines[i][0] == 'a') {
+				ensure_equals(lines[i], "a" + toString(nextA));
+				nextA++;
+			} else {
+				ensure_equals(lines[i], "b" + toString(nextB));
+				nextB++;
+			}
+		}
+		ensure_equals(nextA, 500u);
+		ensure_equals(nextB, 500u);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("Entries larger than half the buffer are written synchronously,"
+			" after the entries before them");
+		writer.reset(new AsyncWriter(AsyncWriter::MIN_BUFFER_SIZE));
+		string large(AsyncWriter::MIN_BUFFER_SIZE, 'x');
+		large.append("\n");
+
+		writeEntries("entry ", 2);
+		writer->write(writerFd, large.data(), large.size());
+		ensure_equals(readAvailable(), "entry 0\nentry 1\n" + large);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("With the 'drop' policy, entries that don't fit in the buffer are dropped and counted");
+		writer.reset(new AsyncWriter(AsyncWriter::MIN_BUFFER_SIZE,
+			AsyncWriter::DROP_ON_OVERFLOW));
+		fillPipe();
+
+		string entry = string(999, 'e') + "\n";
+		for (unsigned int i = 0; i < 20; i++) {
+			writer->write(writerFd, entry.data(), entry.size());
+		}
+		ensure("Entries have been dropped", writer->getEntriesDropped() > 0);
+		ensure(writer->getEntriesDropped() < 20);
+
+		unsigned int written = 20 - writer->getEntriesDropped();
+		string data = drainPipe(written * entry.size());
+		ensure_equals(countLines(data), written);
+		ensure_equals(writer->inspectStateAsJson()["entries_dropped"].asUInt(),
+			20 - written);
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("With the 'block' policy, logging waits until there is room in the buffer");
+		writer.reset(new AsyncWriter(AsyncWriter::MIN_BUFFER_SIZE,
+			AsyncWriter::BLOCK_ON_OVERFLOW));
+		fillPipe();
+
+		string data;
+		{
+			TempThread thr(boost::bind(&LoggingKit_AsyncWriterTest::writeEntries,
+				this, string(999, 'e'), 20));
+			EVENTUALLY(5,
+				result = writer->inspectStateAsJson()["entries_blocked"].asUInt() > 0;
+			);
+			// 10 entries with a single-digit suffix, 10 with two digits.
+			data = drainPipe(10 * 1001 + 10 * 1002);
+			thr.join();
+		}
+		writer->flush();
+		data.append(readAvailable());
+
+		ensure_equals(countLines(data), 20u);
+		ensure_equals(writer->getEntriesDropped(), 0u);
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("Consecutive entries for the same file descriptor are written with a single writev()");
+		writer.reset(new AsyncWriter());
+		fillPipe();
+		writeEntries("entry ", 1);
+		// Give the writer thread the time to block on the first entry.
+		usleep(100000);
+		writeEntries("more ", 10);
+		drainPipe(sizeof("entry 0\n") - 1);
+		writer->flush();
+		readAvailable();
+
+		Json::Value state = writer->inspectStateAsJson();
+		ensure_equals(state["entries_written"].asUInt(), 11u);
+		ensure("(write calls: " + toString(state["write_calls"].asUInt()) + ")",
+			state["write_calls"].asUInt() <= 3);
+	}
+
+	TEST_METHOD(8) {
+		set_test_name("The buffer of a thread is freed after the thread exits");
+		writer.reset(new AsyncWriter());
+		{
+			TempThread thr(boost::bind(&LoggingKit_AsyncWriterTest::writeEntries,
+				this, string("entry "), 1));
+			thr.join();
+		}
+		EVENTUALLY(5,
+			result = writer->inspectStateAsJson()["threads"].asUInt() == 0;
+		);
+		ensure_equals(readAvailable(), "entry 0\n");
+	}
+}
@@ -5,6 +5,7 @@
 #include <TestSupport.h>
 #include <ProcessManagement/Spawn.h>
 #include <Utils/StrIntUtils.h>
+#include <Utils/IOUtils.h>
 #include <Utils/ProcessMetricsCollector.h>
 
 using namespace Passenger;
@@ -113,4 +114,86 @@ namespace tut {
 			ensure(swap < 10000 || swap == -1);
 		#endif
 	}
+
+	#ifdef __linux__
+		TEST_METHOD(4) {
+			// On Linux, it collects the metrics from /proc.
+			child = spawnChild(50);
+			usleep(500000);
+			vector<pid_t> pids;
+			pids.push_back(getpid());
+			pids.push_back(child);
+			ProcessMetricMap result = collector.collectFromProc(pids);
+
+			ensure_equals(result.size(), 2u);
+
+			ProcessMetrics &self = result[getpid()];
+			ensure_equals(self.pid, getpid());
+			ensure_equals(self.ppid, getppid());
+			ensure_equals(self.processGroupId, getpgrp());
+			ensure_equals(self.uid, geteuid());
+			ensure("CPU is correct", self.cpu <= 100);
+			ensure("RSS is correct", self.rss > 0);
+			ensure("VM size is correct", self.vmsize >= self.rss);
+			ensure("Command is correct", !self.command.empty());
+
+			ProcessMetrics &other = result[child];
+			ensure_equals(other.pid, child);
+			ensure_equals(other.ppid, getpid());
+			ensure_equals(other.uid, geteuid());
+			ensure("RSS is correct", other.rss > 50000 && other.rss < 60000);
+			ensure("Private dirty is correct", other.privateDirty > 50000 && other.privateDirty < 60000);
+			ensure("Child command is correct", containsSubstring(other.command, "allocate_memory 50"));
+		}
+
+		TEST_METHOD(5) {
+			// On Linux, collecting from /proc does not collect the metrics
+			// for PIDs that don't exist.
+			child = spawnChild(1);
+			kill(child, SIGKILL);
+			waitpid(child, NULL, 0);
+			pid_t deadChild = child;
+			child = -1;
+
+			vector<pid_t> pids;
+			pids.push_back(getpid());
+			pids.push_back(deadChild);
+			ProcessMetricMap result = collector.collectFromProc(pids);
+
+			ensure_equals(result.size(), 1u);
+			ensure(result.find(getpid()) != result.end());
+			ensure(result.find(deadChild) == result.end());
+		}
+
+		TEST_METHOD(6) {
+			// On Linux, collecting from /proc yields the same results as 'ps'.
+			child = spawnChild(10);
+			usleep(500000);
+			vector<pid_t> pids;
+			pids.push_back(getpid());
+			pids.push_back(child);
+			ProcessMetricMap fromProc = collector.collectFromProc(pids);
+			ProcessMetricMap fromPs = collector.collectWithPs(pids);
+
+			ensure_equals(fromProc.size(), 2u);
+			ensure_equals(fromPs.size(), 2u);
+			ensure_equals(fromProc[child].ppid, fromPs[child].ppid);
+			ensure_equals(fromProc[child].processGroupId, fromPs[child].processGroupId);
+			ensure_equals(fromProc[child].uid, fromPs[child].uid);
+			ensure_equals(fromProc[child].vmsize, fromPs[child].vmsize);
+			ensure_equals(fromProc[child].command, fromPs[child].command);
+			ensure_equals(fromProc[getpid()].command, fromPs[getpid()].command);
+
+			// Also for zombies.
+			kill(child, SIGKILL);
+			EVENTUALLY(5,
+				string stat = readAll("/proc/" + toString(child) + "/stat");
+				result = stat.find(") Z ") != string::npos;
+			);
+			fromProc = collector.collectFromProc(pids);
+			fromPs = collector.collectWithPs(pids);
+			ensure_equals(fromProc[child].command, "[allocate_memory] <defunct>");
+			ensure_equals(fromProc[child].command, fromPs[child].command);
+		}
+	#endif
 }
@@ -0,0 +1,233 @@
+#include <TestSupport.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <oxt/system_calls.hpp>
+#include <BackgroundEventLoop.h>
+#include <ServerKit/Server.h>
+#include <ServerKit/AcceptLoadBalancer.h>
+#include <LoggingKit/LoggingKit.h>
+#include <FileDescriptor.h>
+#include <Utils/IOUtils.h>
+
+using namespace Passenger;
+using namespace Passenger::ServerKit;
+using namespace std;
+using namespace oxt;
+
+namespace tut {
+	struct ServerKit_AcceptLoadBalancerTest {
+		typedef Server<Client> ServerType;
+
+		BackgroundEventLoop bg1, bg2;
+		Json::Value config;
+		ServerKit::Schema skSchema;
+		ServerKit::Context context1, context2;
+		ServerKit::BaseServerSchema schema;
+		boost::shared_ptr<ServerType> server1, server2;
+		boost::scoped_ptr< AcceptLoadBalancer<ServerType> > loadBalancer;
+		int serverSocket;
+		vector<FileDescriptor> clients;
+
+		boost::mutex syncher;
+		boost::condition_variable cond;
+		bool loopBlocked;
+
+		ServerKit_AcceptLoadBalancerTest()
+			: bg1(false, true),
+			  bg2(false, true),
+			  context1(skSchema),
+			  context2(skSchema),
+			  loopBlocked(false)
+		{
+			LoggingKit::setLevel(LoggingKit::CRIT);
+			context1.libev = bg1.safe;
+			context1.libuv = bg1.libuv_loop;
+			context1.initialize();
+			context2.libev = bg2.safe;
+			context2.libuv = bg2.libuv_loop;
+			context2.initialize();
+			serverSocket = createUnixServer("tmp.server");
+
+			server1 = boost::make_shared<ServerType>(&context1, schema, config);
+			server1->initialize();
+			server2 = boost::make_shared<ServerType>(&context2, schema, config);
+			server2->initialize();
+
+			loadBalancer.reset(new AcceptLoadBalancer<ServerType>());
+			loadBalancer->strategy = ALB_LEAST_ACTIVE_CLIENTS;
+			loadBalancer->servers.push_back(server1.get());
+			loadBalancer->servers.push_back(server2.get());
+			loadBalancer->listen(serverSocket);
+		}
+
+		~ServerKit_AcceptLoadBalancerTest() {
+			unblockLoop();
+			loadBalancer.reset();
+			clients.clear();
+			shutdownServer(bg1, server1);
+			shutdownServer(bg2, server2);
+			safelyClose(serverSocket);
+			unlink("tmp.server");
+			LoggingKit::setLevel(LoggingKit::Level(DEFAULT_LOG_LEVEL));
+			bg1.stop();
+			bg2.stop();
+		}
+
+		void start() {
+			bg1.start();
+			bg2.start();
+			loadBalancer->start();
+		}
+
+		void shutdownServer(BackgroundEventLoop &bg, boost::shared_ptr<ServerType> &server) {
+			if (!bg.isStarted()) {
+				bg.start();
+			}
+			bg.safe->runSync(boost::bind(&ServerType::shutdown, server.get(), true));
+			while (getServerState(bg, server.get()) != ServerType::FINISHED_SHUTDOWN) {
+				syscalls::usleep(10000);
+			}
+			bg.safe->runSync(boost::bind(&ServerKit_AcceptLoadBalancerTest::destroyServer,
+				this, &server));
+		}
+
+		void destroyServer(boost::shared_ptr<ServerType> *server) {
+			server->reset();
+		}
+
+		ServerType::State getServerState(BackgroundEventLoop &bg, ServerType *server) {
+			ServerType::State result;
+			bg.safe->runSync(boost::bind(&ServerKit_AcceptLoadBalancerTest::_getServerState,
+				this, server, &result));
+			return result;
+		}
+
+		void _getServerState(ServerType *server, ServerType::State *state) {
+			*state = server->serverState;
+		}
+
+		/**
+		 * Blocks the event loop of server 1, so that clients that are
+		 * handed to it remain pending.
+		 */
+		void blockLoop() {
+			boost::unique_lock<boost::mutex> l(syncher);
+			loopBlocked = true;
+			bg1.safe->runLater(boost::bind(&ServerKit_AcceptLoadBalancerTest::_blockLoop,
+				this));
+		}
+
+		void _blockLoop() {
+			boost::unique_lock<boost::mutex> l(syncher);
+			while (loopBlocked) {
+				cond.wait(l);
+			}
+		}
+
+		void unblockLoop() {
+			boost::unique_lock<boost::mutex> l(syncher);
+			loopBlocked = false;
+			cond.notify_all();
+		}
+
+		unsigned int getTotalClientsDistributed(unsigned int server) {
+			Json::Value doc = loadBalancer->inspectStateAsJson();
+			return doc["threads"]["thread" + toString(server)]["total_clients_distributed"].asUInt();
+		}
+
+		unsigned int getPendingClientCount(unsigned int server) {
+			Json::Value doc = loadBalancer->inspectStateAsJson();
+			return doc["threads"]["thread" + toString(server)]["pending_client_count"].asUInt();
+		}
+
+		/**
+		 * Connects a client and waits until the load balancer has handed
+		 * it to a server.
+		 */
+		void connectClient() {
+			unsigned int total = getTotalClientsDistributed(1) + getTotalClientsDistributed(2);
+			clients.push_back(FileDescriptor(connectToUnixServer("tmp.server",
+				__FILE__, __LINE__), NULL, 0));
+			EVENTUALLY(5,
+				result = getTotalClientsDistributed(1) + getTotalClientsDistributed(2)
+					== total + 1;
+			);
+		}
+	};
+
+	DEFINE_TEST_GROUP(ServerKit_AcceptLoadBalancerTest);
+
+	TEST_METHOD(1) {
+		set_test_name("With the least-active-clients strategy, a new client is handed"
+			" to the server with the fewest active plus pending clients");
+
+		start();
+		connectClient();
+		EVENTUALLY(5,
+			result = server1->getActiveClientCountFromAnyThread() == 1u;
+		);
+		connectClient();
+		EVENTUALLY(5,
+			result = server2->getActiveClientCountFromAnyThread() == 1u;
+		);
+
+		// Server 1 now gets a client that it can't pick up yet.
+		blockLoop();
+		connectClient();
+		ensure_equals("(1)", getTotalClientsDistributed(1), 2u);
+		ensure_equals("(2)", getPendingClientCount(1), 1u);
+
+		// Server 2's client disconnects, then a new client arrives. Both
+		// strategies pick server 2 for that one.
+		clients[1].close();
+		EVENTUALLY(5,
+			result = server2->getActiveClientCountFromAnyThread() == 0u;
+		);
+		connectClient();
+		ensure_equals("(3)", getTotalClientsDistributed(2), 2u);
+
+		// Server 1 has 1 active and 1 pending client, server 2 has 1 client.
+		// Round-robin would pick server 1, but server 2 is less loaded.
+		connectClient();
+		ensure_equals("(4)", getTotalClientsDistributed(1), 2u);
+		ensure_equals("(5)", getTotalClientsDistributed(2), 3u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("With the least-active-clients strategy, ties between equally"
+			" loaded servers are broken in a round-robin manner");
+
+		start();
+		connectClient();
+		EVENTUALLY(5,
+			result = server1->getActiveClientCountFromAnyThread() == 1u;
+		);
+		ensure_equals("(1)", getTotalClientsDistributed(1), 1u);
+
+		connectClient();
+		EVENTUALLY(5,
+			result = server2->getActiveClientCountFromAnyThread() == 1u;
+		);
+		ensure_equals("(2)", getTotalClientsDistributed(2), 1u);
+
+		// Both servers have 1 client.
+		connectClient();
+		EVENTUALLY(5,
+			result = server1->getActiveClientCountFromAnyThread() == 2u;
+		);
+		ensure_equals("(3)", getTotalClientsDistributed(1), 2u);
+		ensure_equals("(4)", getTotalClientsDistributed(2), 1u);
+
+		connectClient();
+		EVENTUALLY(5,
+			result = server2->getActiveClientCountFromAnyThread() == 2u;
+		);
+
+		// Both servers have 2 clients.
+		connectClient();
+		ensure_equals("(5)", getTotalClientsDistributed(1), 3u);
+		ensure_equals("(6)", getTotalClientsDistributed(2), 2u);
+	}
+}
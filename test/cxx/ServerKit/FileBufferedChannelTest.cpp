@@ -29,7 +29,7 @@ namespace tut {
 		string log;
 
 		ServerKit_FileBufferedChannelTest()
-			: bg(false, true),
+			: bg(false, true, true),
 			  context(skSchema),
 			  channel(&context),
 			  toConsume(CONSUME_FULLY),
@@ -65,6 +65,18 @@ namespace tut {
 			}
 		}
 
+		/**
+		 * Makes the channel perform file I/O through io_uring instead of
+		 * libuv. Returns false if the kernel doesn't support io_uring.
+		 */
+		bool useIoUring() {
+			if (bg.io_uring == NULL) {
+				return false;
+			}
+			context.ioUring = bg.io_uring;
+			return true;
+		}
+
 		static Channel::Result dataCallback(Channel *_channel, const mbuf &buffer, int errcode)
 		{
 			FileBufferedChannel *channel = reinterpret_cast<FileBufferedChannel *>(_channel);
@@ -1080,4 +1092,89 @@ namespace tut {
 			ensure_equals(counter, 2u);
 		}
 	}
+
+
+	/***** When using io_uring for file I/O *****/
+
+	TEST_METHOD(50) {
+		set_test_name("It moves memory buffers to disk through io_uring");
+		if (!useIoUring()) {
+			return;
+		}
+
+		Json::Value config;
+		vector<ConfigKit::Error> errors;
+		config["file_buffered_channel_threshold"] = 1;
+		ensure(context.configure(config, errors));
+
+		toConsume = -1;
+		startLoop();
+
+		feedChannel("hello");
+		feedChannel("world");
+		EVENTUALLY(5,
+			result = getChannelMode() == FileBufferedChannel::IN_FILE_MODE;
+		);
+		EVENTUALLY(5,
+			result = getChannelWriterState() == FileBufferedChannel::WS_INACTIVE;
+		);
+		ensure_equals(getChannelBytesBuffered(), 0u);
+	}
+
+	TEST_METHOD(51) {
+		set_test_name("It reads unread data from disk through io_uring and switches "
+			"back to in-memory mode once everything has been read");
+		if (!useIoUring()) {
+			return;
+		}
+
+		Json::Value config;
+		vector<ConfigKit::Error> errors;
+		config["file_buffered_channel_threshold"] = 1;
+		ensure(context.configure(config, errors));
+
+		toConsume = -1;
+		startLoop();
+
+		feedChannel("hello");
+		feedChannel("world!");
+		EVENTUALLY(5,
+			result = getChannelWriterState() == FileBufferedChannel::WS_INACTIVE;
+		);
+		ensure_equals(getChannelBytesBuffered(), 0u);
+
+		channelConsumed(sizeof("hello") - 1, false);
+		EVENTUALLY(5,
+			LOCK();
+			result = log ==
+				"Data: hello\n"
+				"Data: world!\n";
+		);
+		channelConsumed(sizeof("world!") - 1, false);
+		EVENTUALLY(5,
+			result = getChannelMode() == FileBufferedChannel::IN_MEMORY_MODE;
+		);
+	}
+
+	TEST_METHOD(52) {
+		set_test_name("Deinitializing the channel while io_uring operations are "
+			"in progress is safe");
+		if (!useIoUring()) {
+			return;
+		}
+
+		Json::Value config;
+		vector<ConfigKit::Error> errors;
+		config["file_buffered_channel_threshold"] = 1;
+		ensure(context.configure(config, errors));
+
+		toConsume = -1;
+		startLoop();
+
+		feedChannel("hello");
+		feedChannel("world");
+		bg.safe->runSync(boost::bind(&ServerKit_FileBufferedChannelTest::deinitializeChannel,
+			this));
+		ensure_equals(getChannelMode(), FileBufferedChannel::IN_MEMORY_MODE);
+	}
 }
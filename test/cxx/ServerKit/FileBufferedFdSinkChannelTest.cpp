@@ -0,0 +1,131 @@
+#include <TestSupport.h>
+#include <string>
+#include <fcntl.h>
+#include <BackgroundEventLoop.h>
+#include <FileDescriptor.h>
+#include <ServerKit/FileBufferedFdSinkChannel.h>
+#include <Utils/IOUtils.h>
+
+using namespace Passenger;
+using namespace Passenger::ServerKit;
+using namespace std;
+
+namespace tut {
+	struct ServerKit_FileBufferedFdSinkChannelTest: public ServerKit::Hooks {
+		BackgroundEventLoop bg;
+		ServerKit::Schema skSchema;
+		ServerKit::Context context;
+		FileBufferedFdSinkChannel channel;
+		Pipe pipes;
+
+		ServerKit_FileBufferedFdSinkChannelTest()
+			: bg(false, true),
+			  context(skSchema)
+		{
+			context.libev = bg.safe;
+			context.libuv = bg.libuv_loop;
+			context.initialize();
+			channel.setContext(&context);
+			channel.setHooks(this);
+			Hooks::impl = NULL;
+			Hooks::userData = NULL;
+
+			pipes = createPipe(__FILE__, __LINE__);
+			setNonBlocking(pipes[1]);
+			channel.reinitialize();
+			channel.setFd(pipes[1]);
+			bg.start();
+		}
+
+		~ServerKit_FileBufferedFdSinkChannelTest() {
+			bg.safe->runSync(boost::bind(
+				&ServerKit_FileBufferedFdSinkChannelTest::deinitializeChannel, this));
+			bg.stop();
+		}
+
+		void deinitializeChannel() {
+			channel.deinitialize();
+		}
+
+		void feedChannel(const string &data) {
+			bg.safe->runSync(boost::bind(
+				&ServerKit_FileBufferedFdSinkChannelTest::_feedChannel, this, data));
+		}
+
+		void _feedChannel(string data) {
+			assert(data.size() < context.mbuf_pool.mbuf_block_chunk_size);
+			MemoryKit::mbuf buf = MemoryKit::mbuf_get(&context.mbuf_pool);
+			memcpy(buf.start, data.data(), data.size());
+			buf = MemoryKit::mbuf(buf, 0, (unsigned int) data.size());
+			channel.feed(buf);
+		}
+
+		void startChannel() {
+			bg.safe->runSync(boost::bind(
+				&ServerKit_FileBufferedFdSinkChannelTest::_startChannel, this));
+		}
+
+		void _startChannel() {
+			channel.start();
+		}
+
+		unsigned int getChannelBytesBuffered() {
+			unsigned int result;
+			bg.safe->runSync(boost::bind(
+				&ServerKit_FileBufferedFdSinkChannelTest::_getChannelBytesBuffered,
+				this, &result));
+			return result;
+		}
+
+		void _getChannelBytesBuffered(unsigned int *result) {
+			*result = channel.getBytesBuffered();
+		}
+
+		string readFromPipe(unsigned int size) {
+			string result(size, '\0');
+			unsigned long long timeout = 5000000;
+			unsigned int ret = readExact(pipes[0], &result[0], size, &timeout);
+			result.resize(ret);
+			return result;
+		}
+	};
+
+	DEFINE_TEST_GROUP(ServerKit_FileBufferedFdSinkChannelTest);
+
+	TEST_METHOD(1) {
+		set_test_name("It writes out all buffers that were queued while stopped, in order");
+
+		feedChannel("hello");
+		feedChannel(" ");
+		feedChannel("world");
+		ensure_equals(getChannelBytesBuffered(), 11u);
+
+		startChannel();
+		ensure_equals(readFromPipe(11), "hello world");
+		EVENTUALLY(5,
+			result = getChannelBytesBuffered() == 0;
+		);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("If a write of several queued buffers is incomplete, "
+			"it continues with the unwritten part once the fd is writable");
+
+		#ifdef F_SETPIPE_SZ
+			fcntl(pipes[1], F_SETPIPE_SZ, 4096);
+		#endif
+
+		string expected;
+		for (char c = 'a'; c <= 'j'; c++) {
+			string data(3000, c);
+			feedChannel(data);
+			expected.append(data);
+		}
+
+		startChannel();
+		ensure("(1)", readFromPipe(expected.size()) == expected);
+		EVENTUALLY(5,
+			result = getChannelBytesBuffered() == 0;
+		);
+	}
+}
@@ -0,0 +1,381 @@
+#include <TestSupport.h>
+#include <BackgroundEventLoop.h>
+#include <ServerKit/Context.h>
+#include <ServerKit/Http2Session.h>
+#include <ServerKit/Http2Hpack.h>
+#include <string>
+#include <vector>
+
+using namespace Passenger;
+using namespace Passenger::ServerKit;
+using namespace std;
+
+namespace tut {
+	struct ServerKit_Http2SessionTest: public Http2SessionHandler {
+		struct Frame {
+			unsigned char type;
+			unsigned char flags;
+			boost::uint32_t streamId;
+			string payload;
+		};
+
+		BackgroundEventLoop bg;
+		ServerKit::Schema skSchema;
+		ServerKit::Context context;
+		Http2Session *session;
+		string output;
+		vector<Http2Stream *> openedStreams;
+		vector<Http2ErrorCode> resetCodes;
+		bool finished;
+
+		ServerKit_Http2SessionTest()
+			: bg(false, true),
+			  context(skSchema),
+			  finished(false)
+		{
+			context.libev = bg.safe;
+			context.libuv = bg.libuv_loop;
+			context.initialize();
+			session = new Http2Session(&context, this, 10);
+		}
+
+		~ServerKit_Http2SessionTest() {
+			if (session != NULL) {
+				session->destroy();
+			}
+		}
+
+		virtual void onHttp2Output(Http2Session *session, const MemoryKit::mbuf &buffer) {
+			output.append(buffer.start, buffer.size());
+		}
+
+		virtual bool onHttp2StreamOpened(Http2Session *session, Http2Stream *stream) {
+			openedStreams.push_back(stream);
+			return true;
+		}
+
+		virtual void onHttp2StreamInput(Http2Session *session, Http2Stream *stream) {
+			// Input is taken explicitly by the tests.
+		}
+
+		virtual void onHttp2StreamWritable(Http2Session *session, Http2Stream *stream) {
+			// Nothing to do.
+		}
+
+		virtual void onHttp2StreamReset(Http2Session *session, Http2Stream *stream,
+			Http2ErrorCode code)
+		{
+			resetCodes.push_back(code);
+			session->closeStream(stream);
+		}
+
+		virtual void onHttp2SessionFinished(Http2Session *session) {
+			finished = true;
+		}
+
+		void feed(const string &data) {
+			size_t pos = 0;
+			while (pos < data.size()) {
+				MemoryKit::mbuf buffer = MemoryKit::mbuf_get(&context.mbuf_pool);
+				size_t size = std::min<size_t>(data.size() - pos, buffer.size());
+				memcpy(buffer.start, data.data() + pos, size);
+				session->feed(MemoryKit::mbuf(buffer, 0, size));
+				pos += size;
+			}
+		}
+
+		void writeResponse(Http2Stream *stream, const string &data) {
+			MemoryKit::mbuf buffer = MemoryKit::mbuf_get(&context.mbuf_pool);
+			assert(data.size() <= buffer.size());
+			memcpy(buffer.start, data.data(), data.size());
+			ensure_equals("writeResponse() consumes everything",
+				session->writeResponse(stream, MemoryKit::mbuf(buffer, 0, data.size())),
+				(int) data.size());
+		}
+
+		string takeStreamInput(Http2Stream *stream) {
+			string result;
+			while (session->hasStreamInput(stream)) {
+				MemoryKit::mbuf buffer = session->takeStreamInput(stream);
+				result.append(buffer.start, buffer.size());
+			}
+			return result;
+		}
+
+		static string makeFrame(unsigned char type, unsigned char flags,
+			boost::uint32_t streamId, const string &payload)
+		{
+			string result(9, '\0');
+			result[0] = (char) (payload.size() >> 16);
+			result[1] = (char) (payload.size() >> 8);
+			result[2] = (char) payload.size();
+			result[3] = (char) type;
+			result[4] = (char) flags;
+			result[5] = (char) (streamId >> 24);
+			result[6] = (char) (streamId >> 16);
+			result[7] = (char) (streamId >> 8);
+			result[8] = (char) streamId;
+			result.append(payload);
+			return result;
+		}
+
+		static string makeHeaders(boost::uint32_t streamId, const string &method,
+			const string &path, const string &extraHeaders, bool endStream)
+		{
+			string block;
+			HpackEncoder::encodeHeader(block, ":method", method);
+			HpackEncoder::encodeHeader(block, ":scheme", "http");
+			HpackEncoder::encodeHeader(block, ":authority", "localhost");
+			HpackEncoder::encodeHeader(block, ":path", path);
+			block.append(extraHeaders);
+			return makeFrame(0x1, 0x4 | (endStream ? 0x1 : 0), streamId, block);
+		}
+
+		static string makePreface() {
+			return string("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n")
+				+ makeFrame(0x4, 0, 0, "");
+		}
+
+		/** Parses all frames in `output` and clears it. */
+		vector<Frame> takeFrames() {
+			vector<Frame> result;
+			size_t pos = 0;
+
+			while (pos + 9 <= output.size()) {
+				const unsigned char *header = (const unsigned char *) output.data() + pos;
+				Frame frame;
+				unsigned int length = (header[0] << 16) | (header[1] << 8) | header[2];
+				frame.type = header[3];
+				frame.flags = header[4];
+				frame.streamId = ((header[5] & 0x7f) << 24) | (header[6] << 16)
+					| (header[7] << 8) | header[8];
+				ensure("Frame is complete", pos + 9 + length <= output.size());
+				frame.payload = output.substr(pos + 9, length);
+				result.push_back(frame);
+				pos += 9 + length;
+			}
+			ensure_equals("All output consists of frames", pos, output.size());
+			output.clear();
+			return result;
+		}
+
+		const Frame *findFrame(const vector<Frame> &frames, unsigned char type,
+			boost::uint32_t streamId)
+		{
+			for (unsigned int i = 0; i < frames.size(); i++) {
+				if (frames[i].type == type && frames[i].streamId == streamId) {
+					return &frames[i];
+				}
+			}
+			return NULL;
+		}
+
+		static string collectData(const vector<Frame> &frames, boost::uint32_t streamId) {
+			string result;
+			for (unsigned int i = 0; i < frames.size(); i++) {
+				if (frames[i].type == 0x0 && frames[i].streamId == streamId) {
+					result.append(frames[i].payload);
+				}
+			}
+			return result;
+		}
+
+		static boost::uint32_t readUint32(const string &data, size_t offset) {
+			const unsigned char *p = (const unsigned char *) data.data() + offset;
+			return ((boost::uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+		}
+
+		static bool collectHeader(void *userData, const StaticString &name,
+			const StaticString &value)
+		{
+			string *result = (string *) userData;
+			result->append(name.data(), name.size());
+			result->append(": ");
+			result->append(value.data(), value.size());
+			result->append("\n");
+			return true;
+		}
+
+		static string decodeHeaders(const string &block) {
+			HpackDecoder decoder;
+			string result;
+			ensure("Header block is valid", decoder.decode(block.data(), block.size(),
+				collectHeader, &result));
+			return result;
+		}
+
+		Http2Stream *openGetStream(const string &path) {
+			feed(makePreface());
+			session->start();
+			feed(makeHeaders(1, "GET", path, "", true));
+			ensure_equals("A stream is opened", openedStreams.size(), 1u);
+			takeFrames();
+			return openedStreams[0];
+		}
+	};
+
+	DEFINE_TEST_GROUP(ServerKit_Http2SessionTest);
+
+	TEST_METHOD(1) {
+		set_test_name("It sends its SETTINGS on start, and acknowledges the client's SETTINGS");
+
+		session->start();
+		feed(makePreface());
+
+		vector<Frame> frames = takeFrames();
+		ensure("(1)", frames.size() >= 2);
+		ensure_equals("(2)", frames[0].type, 0x4);
+		ensure_equals("(3)", frames[0].flags, 0);
+		ensure_equals("(4)", frames[frames.size() - 1].type, 0x4);
+		ensure_equals("(5)", frames[frames.size() - 1].flags, 0x1);
+		ensure_equals("(6)", frames[frames.size() - 1].payload.size(), 0u);
+		ensure("(7)", !finished);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It translates a HEADERS frame into an HTTP/1.1 request");
+
+		Http2Stream *stream = openGetStream("/foo?bar=1");
+		ensure_equals("(1)", stream->id, 1u);
+		ensure_equals("(2)", takeStreamInput(stream),
+			"GET /foo?bar=1 HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("It translates an HTTP/1.1 response into HEADERS and DATA frames");
+
+		Http2Stream *stream = openGetStream("/");
+		takeStreamInput(stream);
+		writeResponse(stream,
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/plain\r\n"
+			"Content-Length: 5\r\n"
+			"Connection: close\r\n"
+			"\r\n"
+			"hello");
+
+		vector<Frame> frames = takeFrames();
+		const Frame *headers = findFrame(frames, 0x1, 1);
+		ensure("(1)", headers != NULL);
+		ensure("(2)", headers->flags & 0x4);
+		string decoded = decodeHeaders(headers->payload);
+		ensure("(3)", decoded.find(":status: 200\n") != string::npos);
+		ensure("(4)", decoded.find("content-type: text/plain\n") != string::npos);
+		ensure("(5)", decoded.find("content-length: 5\n") != string::npos);
+		ensure("Connection-specific headers are dropped",
+			decoded.find("connection") == string::npos);
+
+		ensure_equals("(6)", collectData(frames, 1), "hello");
+		ensure("(7)", frames.back().type == 0x0 && (frames.back().flags & 0x1));
+		ensure("(8)", stream->responseEnded);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("Request body data is only acknowledged with WINDOW_UPDATE "
+			"once it's taken");
+
+		feed(makePreface());
+		session->start();
+		string contentLength;
+		HpackEncoder::encodeHeader(contentLength, "content-length", "50000");
+		feed(makeHeaders(1, "POST", "/", contentLength, false));
+		ensure_equals("(1)", openedStreams.size(), 1u);
+		Http2Stream *stream = openedStreams[0];
+		takeFrames();
+
+		feed(makeFrame(0x0, 0, 1, string(16384, 'a')));
+		feed(makeFrame(0x0, 0, 1, string(16384, 'b')));
+		feed(makeFrame(0x0, 0, 1, string(40000 - 2 * 16384, 'c')));
+		ensure("(2)", findFrame(takeFrames(), 0x8, 1) == NULL);
+
+		string input = takeStreamInput(stream);
+		ensure("(3)", input.find("Content-Length: 50000\r\n") != string::npos);
+		string::size_type bodyStart = input.find("\r\n\r\n") + 4;
+		ensure_equals("(4)", input.size() - bodyStart, 40000u);
+
+		vector<Frame> frames = takeFrames();
+		const Frame *windowUpdate = findFrame(frames, 0x8, 1);
+		ensure("(5)", windowUpdate != NULL);
+		ensure("(6)", readUint32(windowUpdate->payload, 0) >= 32768);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("It refuses to send response body data beyond the stream's send window");
+
+		feed(makePreface());
+		session->start();
+		// Shrink the initial stream window to 3 bytes.
+		string settings("\x00\x04\x00\x00\x00\x03", 6);
+		feed(makeFrame(0x4, 0, 0, settings));
+		feed(makeHeaders(1, "GET", "/", "", true));
+		Http2Stream *stream = openedStreams[0];
+		takeStreamInput(stream);
+		takeFrames();
+
+		MemoryKit::mbuf buffer = MemoryKit::mbuf_get(&context.mbuf_pool);
+		string response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+		memcpy(buffer.start, response.data(), response.size());
+		int ret = session->writeResponse(stream, MemoryKit::mbuf(buffer, 0, response.size()));
+		ensure_equals("(1)", ret, (int) response.size() - 2);
+
+		vector<Frame> frames = takeFrames();
+		ensure_equals("(2)", collectData(frames, 1), "hel");
+		ensure("(3)", !(frames.back().flags & 0x1));
+
+		string increment("\x00\x00\x00\x02", 4);
+		feed(makeFrame(0x8, 0, 1, increment));
+		writeResponse(stream, "lo");
+		frames = takeFrames();
+		ensure_equals("(4)", collectData(frames, 1), "lo");
+		ensure("(5)", frames.back().type == 0x0 && (frames.back().flags & 0x1));
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("An invalid connection preface results in a GOAWAY with PROTOCOL_ERROR");
+
+		session->start();
+		takeFrames();
+		feed("GET / HTTP/1.1\r\n\r\n");
+
+		vector<Frame> frames = takeFrames();
+		const Frame *goaway = findFrame(frames, 0x7, 0);
+		ensure("(1)", goaway != NULL);
+		ensure_equals("(2)", readUint32(goaway->payload, 4), (boost::uint32_t) HTTP2_PROTOCOL_ERROR);
+		ensure("(3)", finished);
+		ensure("(4)", session->isFinished());
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("A RST_STREAM from the peer resets the stream");
+
+		Http2Stream *stream = openGetStream("/");
+		takeStreamInput(stream);
+		string code("\x00\x00\x00\x08", 4);
+		feed(makeFrame(0x3, 0, 1, code));
+
+		ensure_equals("(1)", resetCodes.size(), 1u);
+		ensure_equals("(2)", resetCodes[0], HTTP2_CANCEL);
+		ensure_equals("(3)", session->getStreamCount(), 0u);
+		ensure("We don't reset a stream that the peer reset",
+			findFrame(takeFrames(), 0x3, 1) == NULL);
+	}
+
+	TEST_METHOD(8) {
+		set_test_name("Streams beyond the concurrency limit are refused");
+
+		feed(makePreface());
+		session->start();
+		for (unsigned int i = 0; i < 11; i++) {
+			feed(makeHeaders(1 + 2 * i, "GET", "/", "", true));
+		}
+		ensure_equals("(1)", openedStreams.size(), 10u);
+
+		vector<Frame> frames = takeFrames();
+		const Frame *rst = findFrame(frames, 0x3, 21);
+		ensure("(2)", rst != NULL);
+		ensure_equals("(3)", readUint32(rst->payload, 0), (boost::uint32_t) HTTP2_REFUSED_STREAM);
+	}
+}
@@ -0,0 +1,149 @@
+#include <TestSupport.h>
+#include <ServerKit/http_parser.h>
+#include <cstring>
+#include <string>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct ServerKit_HttpParserTest {
+		http_parser parser;
+		http_parser_settings settings;
+		string log;
+
+		ServerKit_HttpParserTest() {
+			memset(&settings, 0, sizeof(settings));
+			settings.on_header_field = onHeaderField;
+			settings.on_header_value = onHeaderValue;
+			settings.on_headers_complete = onHeadersComplete;
+		}
+
+		~ServerKit_HttpParserTest() {
+			http_parser_set_simd_enabled(1);
+		}
+
+		static int onHeaderField(http_parser *parser, const char *data, size_t len) {
+			ServerKit_HttpParserTest *self = (ServerKit_HttpParserTest *) parser->data;
+			self->log.append("F:");
+			self->log.append(data, len);
+			self->log.append("\n");
+			return 0;
+		}
+
+		static int onHeaderValue(http_parser *parser, const char *data, size_t len) {
+			ServerKit_HttpParserTest *self = (ServerKit_HttpParserTest *) parser->data;
+			self->log.append("V:");
+			self->log.append(data, len);
+			self->log.append("\n");
+			return 0;
+		}
+
+		static int onHeadersComplete(http_parser *parser) {
+			ServerKit_HttpParserTest *self = (ServerKit_HttpParserTest *) parser->data;
+			self->log.append("complete\n");
+			return 0;
+		}
+
+		/**
+		 * Parses the given data in chunks of `chunkSize` bytes and returns
+		 * the log of callbacks, or the parser error.
+		 */
+		string parse(const string &data, size_t chunkSize, bool simd) {
+			http_parser_set_simd_enabled(simd);
+			http_parser_init(&parser, HTTP_REQUEST);
+			parser.data = this;
+			log.clear();
+
+			for (size_t pos = 0; pos < data.size(); pos += chunkSize) {
+				size_t size = std::min(chunkSize, data.size() - pos);
+				size_t ret = http_parser_execute(&parser, &settings, data.data() + pos, size);
+				if (HTTP_PARSER_ERRNO(&parser) != HPE_OK) {
+					return string("error: ") + http_errno_name(HTTP_PARSER_ERRNO(&parser));
+				}
+				if (ret != size) {
+					return "error: short parse";
+				}
+			}
+			return log;
+		}
+
+		/** Joins split header callbacks, so that logs of different chunkings compare equal. */
+		static string normalize(const string &log) {
+			string result;
+			string::size_type pos = 0;
+			char lastType = 0;
+
+			while (pos < log.size()) {
+				string::size_type end = log.find('\n', pos);
+				string line = log.substr(pos, end - pos);
+				pos = end + 1;
+				if (line.size() >= 2 && line[1] == ':' && line[0] == lastType) {
+					result.resize(result.size() - 1);
+					result.append(line, 2, string::npos);
+				} else {
+					result.append(line);
+					lastType = (line.size() >= 2 && line[1] == ':') ? line[0] : 0;
+				}
+				result.append("\n");
+			}
+			return result;
+		}
+	};
+
+	DEFINE_TEST_GROUP(ServerKit_HttpParserTest);
+
+	TEST_METHOD(1) {
+		set_test_name("The SIMD and scalar header scanners produce the same results for "
+			"header names and values of all lengths around the vector widths");
+
+		string data = "GET / HTTP/1.1\r\n";
+		for (unsigned int i = 0; i <= 70; i++) {
+			data.append("X-Header-" + string(i, 'n') + ": " + string(i, 'v')
+				+ "~\"" + string(i % 7, ';') + "\r\n");
+		}
+		data.append("Content-Length: 0\r\n");
+		data.append("\r\n");
+
+		string expected = parse(data, data.size(), false);
+		ensure("(1)", expected.find("complete\n") != string::npos);
+		ensure_equals("(2)", parse(data, data.size(), true), expected);
+		ensure_equals("(3)", normalize(parse(data, 1, true)), expected);
+		ensure_equals("(4)", normalize(parse(data, 13, true)), expected);
+		ensure_equals("(5)", normalize(parse(data, 13, false)), expected);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("Special headers are still recognized");
+
+		string data = "POST / HTTP/1.1\r\n"
+			"Connection: close\r\n"
+			"Transfer-Encoding: chunked\r\n"
+			"\r\n";
+
+		ensure_equals(parse(data, data.size(), true),
+			"F:Connection\n"
+			"V:close\n"
+			"F:Transfer-Encoding\n"
+			"V:chunked\n"
+			"complete\n");
+		ensure("(1)", parser.flags & F_CONNECTION_CLOSE);
+		ensure("(2)", parser.flags & F_CHUNKED);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("Headers that exceed HTTP_MAX_HEADER_SIZE are rejected even "
+			"if they are skipped in bulk");
+
+		string data = "GET / HTTP/1.1\r\n"
+			"Cookie: " + string(HTTP_MAX_HEADER_SIZE, 'a') + "\r\n"
+			"\r\n";
+		ensure_equals("(1)", parse(data, data.size(), true), "error: HPE_HEADER_OVERFLOW");
+		ensure_equals("(2)", parse(data, data.size(), false), "error: HPE_HEADER_OVERFLOW");
+
+		data = "GET / HTTP/1.1\r\n"
+			"X-" + string(HTTP_MAX_HEADER_SIZE, 'a') + ": foo\r\n"
+			"\r\n";
+		ensure_equals("(3)", parse(data, data.size(), true), "error: HPE_HEADER_OVERFLOW");
+	}
+}
@@ -7,6 +7,7 @@
 #include <oxt/system_calls.hpp>
 #include <BackgroundEventLoop.h>
 #include <ServerKit/HttpServer.h>
+#include <ServerKit/Http2Hpack.h>
 #include <LoggingKit/LoggingKit.h>
 #include <FileDescriptor.h>
 #include <Utils.h>
@@ -326,6 +327,16 @@ namespace tut {
 			server.reset();
 		}
 
+		void enableHttp2() {
+			Json::Value config;
+			vector<ConfigKit::Error> errors;
+			MyServer::ConfigChangeRequest req;
+
+			config["http2"] = true;
+			ensure(server->prepareConfigChange(config, errors, req));
+			server->commitConfigChange(req);
+		}
+
 		FileDescriptor &connectToServer() {
 			startLoop();
 			fd = FileDescriptor(connectToUnixServer("tmp.server", __FILE__, __LINE__), NULL, 0);
@@ -346,6 +357,99 @@ namespace tut {
 			ensure_equals(getTotalBytesConsumed(), totalBytesConsumed + data.size());
 		}
 
+		static string makeHttp2Frame(unsigned char type, unsigned char flags,
+			unsigned int streamId, const string &payload)
+		{
+			string result(9, '\0');
+			result[0] = (char) (payload.size() >> 16);
+			result[1] = (char) (payload.size() >> 8);
+			result[2] = (char) payload.size();
+			result[3] = (char) type;
+			result[4] = (char) flags;
+			result[5] = (char) (streamId >> 24);
+			result[6] = (char) (streamId >> 16);
+			result[7] = (char) (streamId >> 8);
+			result[8] = (char) streamId;
+			result.append(payload);
+			return result;
+		}
+
+		static string makeHttp2Preface() {
+			return string("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n")
+				+ makeHttp2Frame(0x4, 0, 0, "");
+		}
+
+		static string makeHttp2Request(unsigned int streamId, const string &method,
+			const string &path, const string &body = string())
+		{
+			string block;
+			HpackEncoder::encodeHeader(block, ":method", method);
+			HpackEncoder::encodeHeader(block, ":scheme", "http");
+			HpackEncoder::encodeHeader(block, ":authority", "localhost");
+			HpackEncoder::encodeHeader(block, ":path", path);
+			if (body.empty()) {
+				return makeHttp2Frame(0x1, 0x4 | 0x1, streamId, block);
+			} else {
+				return makeHttp2Frame(0x1, 0x4, streamId, block)
+					+ makeHttp2Frame(0x0, 0x1, streamId, body);
+			}
+		}
+
+		static bool collectHttp2Header(void *userData, const StaticString &name,
+			const StaticString &value)
+		{
+			string *result = (string *) userData;
+			result->append(name.data(), name.size());
+			result->append(": ");
+			result->append(value.data(), value.size());
+			result->append("\n");
+			return true;
+		}
+
+		/**
+		 * Reads HTTP/2 frames until the responses on `count` streams have ended.
+		 * Returns, per stream ID, the decoded response headers followed by
+		 * an empty line and the body.
+		 */
+		map<unsigned int, string> readHttp2Responses(unsigned int count) {
+			map<unsigned int, string> headers, bodies, result;
+			map<unsigned int, string>::iterator it;
+			HpackDecoder decoder;
+			unsigned int ended = 0;
+
+			while (ended < count) {
+				unsigned char header[9];
+				unsigned long long timeout = 5000000;
+				ensure_equals("Frame header received",
+					io.read(header, 9, &timeout), 9u);
+				unsigned int length = (header[0] << 16) | (header[1] << 8) | header[2];
+				unsigned int streamId = ((header[5] & 0x7f) << 24) | (header[6] << 16)
+					| (header[7] << 8) | header[8];
+				string payload(length, '\0');
+				if (length > 0) {
+					ensure_equals("Frame payload received",
+						io.read(&payload[0], length, &timeout), length);
+				}
+
+				if (header[3] == 0x1) {
+					ensure("Header block is valid", decoder.decode(payload.data(),
+						payload.size(), collectHttp2Header, &headers[streamId]));
+				} else if (header[3] == 0x0) {
+					bodies[streamId].append(payload);
+				} else if (header[3] == 0x7 || header[3] == 0x3) {
+					fail("Unexpected GOAWAY or RST_STREAM");
+				}
+				if ((header[3] == 0x0 || header[3] == 0x1) && (header[4] & 0x1)) {
+					ended++;
+				}
+			}
+
+			for (it = headers.begin(); it != headers.end(); it++) {
+				result[it->first] = it->second + "\n" + bodies[it->first];
+			}
+			return result;
+		}
+
 		bool hasResponseData() {
 			unsigned long long timeout = 0;
 			return waitUntilReadable(fd, &timeout);
@@ -489,7 +593,7 @@ namespace tut {
 		}
 	};
 
-	DEFINE_TEST_GROUP_WITH_LIMIT(ServerKit_HttpServerTest, 100);
+	DEFINE_TEST_GROUP_WITH_LIMIT(ServerKit_HttpServerTest, 110);
 
 
 	/***** Valid HTTP header parsing *****/
@@ -1744,4 +1848,74 @@ namespace tut {
 			result = getActiveClientCount() == 0;
 		);
 	}
+
+	TEST_METHOD(98) {
+		set_test_name("HTTP/2 with prior knowledge");
+
+		enableHttp2();
+		connectToServer();
+		sendRequest(makeHttp2Preface() + makeHttp2Request(1, "GET", "/foo"));
+
+		map<unsigned int, string> responses = readHttp2Responses(1);
+		ensure_equals(responses[1],
+			":status: 200\n"
+			"content-type: text/plain\n"
+			"date: Thu, 11 Sep 2014 12:54:09 GMT\n"
+			"content-length: 10\n"
+			"\n"
+			"hello /foo");
+	}
+
+	TEST_METHOD(99) {
+		set_test_name("HTTP/2 streams are processed concurrently on one connection");
+
+		enableHttp2();
+		connectToServer();
+		sendRequest(makeHttp2Preface()
+			+ makeHttp2Request(1, "GET", "/foo")
+			+ makeHttp2Request(3, "POST", "/body_test", "hello world")
+			+ makeHttp2Request(5, "GET", "/bar"));
+
+		map<unsigned int, string> responses = readHttp2Responses(3);
+		ensure("(1)", containsSubstring(responses[1], "\nhello /foo"));
+		ensure("(2)", containsSubstring(responses[3], "\n11 bytes: hello world"));
+		ensure("(3)", containsSubstring(responses[5], "\nhello /bar"));
+		ensure_equals("(4)", getTotalRequestsBegun(), 3u);
+	}
+
+	TEST_METHOD(100) {
+		set_test_name("Upgrading to HTTP/2 with Upgrade: h2c");
+
+		enableHttp2();
+		connectToServer();
+		sendRequest(
+			"GET /foo HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: Upgrade, HTTP2-Settings\r\n"
+			"Upgrade: h2c\r\n"
+			"HTTP2-Settings: AAMAAABkAAQAAP__\r\n"
+			"\r\n");
+		string header = readResponseHeader();
+		ensure(containsSubstring(header, "HTTP/1.1 101 Switching Protocols\r\n"));
+		ensure(containsSubstring(header, "Upgrade: h2c\r\n"));
+
+		sendRequest(makeHttp2Preface());
+		map<unsigned int, string> responses = readHttp2Responses(1);
+		ensure(containsSubstring(responses[1], ":status: 200\n"));
+		ensure(containsSubstring(responses[1], "\nhello /foo"));
+	}
+
+	TEST_METHOD(101) {
+		set_test_name("HTTP/2 is not used unless it's enabled");
+
+		connectToServer();
+		sendRequest(
+			"GET /foo HTTP/1.1\r\n"
+			"Connection: Upgrade, HTTP2-Settings\r\n"
+			"Upgrade: h2c\r\n"
+			"HTTP2-Settings: AAMAAABkAAQAAP__\r\n"
+			"\r\n");
+		string header = readResponseHeader();
+		ensure(!containsSubstring(header, " 101 "));
+	}
 }
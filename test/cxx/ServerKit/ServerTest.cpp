@@ -321,6 +321,23 @@ namespace tut {
 		ensure_equals(getFreeClientCount(), 0u);
 	}
 
+	TEST_METHOD(12) {
+		set_test_name("The active client count can be queried from other threads");
+
+		init();
+		startServer();
+		ensure_equals(server->getActiveClientCountFromAnyThread(), 0u);
+
+		FileDescriptor fd(connectToServer1());
+		EVENTUALLY(5,
+			result = server->getActiveClientCountFromAnyThread() == 1u;
+		);
+		fd.close();
+		EVENTUALLY(5,
+			result = server->getActiveClientCountFromAnyThread() == 0u;
+		);
+	}
+
 
 	/****** Multiple listen endpoints *****/
 